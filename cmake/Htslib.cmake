@@ -26,6 +26,23 @@ if(NOT TARGET htslib) # lazy include guard
             set(CONFIGURE_FLAGS "--host=aarch64-apple-darwin")
         endif()
 
+        # htslib compresses BGZF blocks with libdeflate, if it is built with it, which is 2-3x
+        # faster per thread than zlib at the same level.
+        option(DORADO_HTSLIB_LIBDEFLATE "Build htslib with libdeflate, if it is found" ON)
+        if(DORADO_HTSLIB_LIBDEFLATE)
+            find_path(LIBDEFLATE_INCLUDE_DIR libdeflate.h)
+            find_library(LIBDEFLATE_LIBRARY NAMES libdeflate.a deflate)
+        endif()
+        if(LIBDEFLATE_INCLUDE_DIR AND LIBDEFLATE_LIBRARY)
+            message(STATUS "Building htslib with libdeflate: ${LIBDEFLATE_LIBRARY}")
+            get_filename_component(LIBDEFLATE_LIBRARY_DIR ${LIBDEFLATE_LIBRARY} DIRECTORY)
+            list(APPEND CONFIGURE_FLAGS --with-libdeflate
+                "CPPFLAGS=-I${LIBDEFLATE_INCLUDE_DIR}" "LDFLAGS=-L${LIBDEFLATE_LIBRARY_DIR}")
+        else()
+            message(STATUS "Building htslib without libdeflate: BGZF compression uses zlib")
+            list(APPEND CONFIGURE_FLAGS --without-libdeflate)
+        endif()
+
         include(ExternalProject)
         ExternalProject_Add(htslib_project
                 PREFIX ${htslib_PREFIX}
@@ -46,6 +63,9 @@ if(NOT TARGET htslib) # lazy include guard
         include_directories(${htslib_PREFIX}/include/htslib)
         add_library(htslib STATIC IMPORTED)
         set_property(TARGET htslib APPEND PROPERTY IMPORTED_LOCATION ${htslib_PREFIX}/lib/libhts.a)
+        if(LIBDEFLATE_INCLUDE_DIR AND LIBDEFLATE_LIBRARY)
+            set_property(TARGET htslib APPEND PROPERTY INTERFACE_LINK_LIBRARIES ${LIBDEFLATE_LIBRARY})
+        endif()
         message(STATUS "Done Building htslib")
     endif()
 endif()
@@ -0,0 +1,415 @@
+#include "dorado_api.h"
+
+#include "nn/CRFModel.h"
+#include "nn/Runners.h"
+#include "read_pipeline/BasecallerNode.h"
+#include "read_pipeline/ModBaseCallerNode.h"
+#include "read_pipeline/Pipeline.h"
+#include "read_pipeline/ScalerNode.h"
+#include "utils/base_mod_utils.h"
+#include "utils/parameters.h"
+#include "utils/time_utils.h"
+
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+
+struct dorado_read {
+    std::shared_ptr<dorado::Read> read;
+};
+
+struct dorado_pipeline {
+    // Hands a called read to the read callback, or queues it to be polled.
+    void deliver(std::unique_ptr<dorado_read> read) {
+        if (read_callback) {
+            read_callback(read.release(), read_callback_user_data);
+            return;
+        }
+        {
+            std::lock_guard lock(reads_mutex);
+            reads.push_back(std::move(read));
+        }
+        reads_cv.notify_one();
+    }
+
+    dorado_read_callback read_callback{nullptr};
+    void* read_callback_user_data{nullptr};
+    uint16_t model_sample_rate{0};
+
+    // Held shared while reads are submitted, and exclusively to finish the pipeline, so that
+    // no read is pushed into it once it has been terminated.
+    std::shared_mutex submit_mutex;
+    bool finished{false};
+    std::unique_ptr<dorado::Pipeline> pipeline;
+    dorado::NodeHandle scaler_node{dorado::PipelineDescriptor::InvalidNodeHandle};
+
+    // Called reads waiting to be polled, if there's no read callback.
+    std::mutex reads_mutex;
+    std::condition_variable reads_cv;
+    std::deque<std::unique_ptr<dorado_read>> reads;
+    // Set once the pipeline is finished and every read is queued.  Guarded by reads_mutex.
+    bool all_reads_queued{false};
+};
+
+namespace {
+
+thread_local std::string t_last_error;
+
+dorado_status fail(dorado_status status, std::string message) {
+    t_last_error = std::move(message);
+    return status;
+}
+
+// Runs an API call, turning exceptions into a failed status.
+dorado_status run_api_call(const std::function<dorado_status()>& call) {
+    try {
+        t_last_error.clear();
+        return call();
+    } catch (const std::exception& e) {
+        return fail(DORADO_ERROR_FAILED, e.what());
+    } catch (...) {
+        return fail(DORADO_ERROR_FAILED, "Unknown error");
+    }
+}
+
+// Sizes of the structs in API version 1, i.e. the smallest struct_size a caller can pass.
+constexpr size_t kPipelineOptionsV1Size =
+        offsetof(dorado_pipeline_options, read_callback_user_data) + sizeof(void*);
+constexpr size_t kSignalV1Size = offsetof(dorado_signal, start_time_ms) + sizeof(uint64_t);
+
+// Copies a struct passed in, which has the fields of the header the caller was built against.
+// Fields the caller's header doesn't have keep the defaults set by init, and those it has which
+// this header doesn't are ignored.  Returns std::nullopt if the struct is missing or smaller
+// than in version 1.
+template <typename T>
+std::optional<T> copy_api_struct(const T* in, size_t min_size, void (*init)(T*)) {
+    if (!in || in->struct_size < min_size) {
+        return std::nullopt;
+    }
+    T out;
+    init(&out);
+    std::memcpy(&out, in, std::min(in->struct_size, sizeof(T)));
+    out.struct_size = sizeof(T);
+    return out;
+}
+
+template <typename T>
+T positive_or(int32_t value, T default_value) {
+    return value > 0 ? T(value) : default_value;
+}
+
+// The end of an API pipeline: called reads are handed straight on from the pushing thread.
+class ApiOutputSink : public dorado::MessageSink {
+public:
+    explicit ApiOutputSink(dorado_pipeline& pipeline) : MessageSink(1), m_pipeline(pipeline) {}
+
+    void push_message(dorado::Message&& message) override {
+        // Only reads come out of a simplex pipeline.
+        if (!std::holds_alternative<std::shared_ptr<dorado::Read>>(message)) {
+            return;
+        }
+        auto read = std::make_unique<dorado_read>();
+        read->read = std::get<std::shared_ptr<dorado::Read>>(std::move(message));
+        m_pipeline.deliver(std::move(read));
+    }
+    void push_messages(std::vector<dorado::Message>&& messages) override {
+        for (auto& message : messages) {
+            push_message(std::move(message));
+        }
+    }
+
+private:
+    dorado_pipeline& m_pipeline;
+};
+
+// Wraps the caller's samples without copying them, releasing them once the tensor is freed.
+torch::Tensor signal_tensor(const dorado_signal& signal) {
+    auto* const samples = const_cast<int16_t*>(signal.samples);
+    const auto num_samples = int64_t(signal.num_samples);
+    if (!signal.release) {
+        return torch::from_blob(samples, {num_samples}, torch::kInt16).clone();
+    }
+    return torch::from_blob(
+            samples, {num_samples},
+            [release = signal.release, user_data = signal.release_user_data](void* data) {
+                release(static_cast<const int16_t*>(data), user_data);
+            },
+            torch::kInt16);
+}
+
+}  // namespace
+
+extern "C" {
+
+int dorado_api_version(void) { return DORADO_API_VERSION; }
+
+const char* dorado_last_error(void) { return t_last_error.c_str(); }
+
+void dorado_pipeline_options_init(dorado_pipeline_options* options) {
+    *options = dorado_pipeline_options{};
+    options->struct_size = sizeof(dorado_pipeline_options);
+}
+
+void dorado_signal_init(dorado_signal* signal) {
+    *signal = dorado_signal{};
+    signal->struct_size = sizeof(dorado_signal);
+    signal->calibration_scale = 1.f;
+    signal->channel = -1;
+    signal->mux = -1;
+    signal->read_number = -1;
+    signal->start_sample = -1;
+}
+
+dorado_status dorado_pipeline_create(const dorado_pipeline_options* caller_options,
+                                     dorado_pipeline** pipeline) {
+    const auto options = copy_api_struct(caller_options, kPipelineOptionsV1Size,
+                                         dorado_pipeline_options_init);
+    if (!options || !pipeline) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT,
+                    "Options must be set up with dorado_pipeline_options_init()");
+    }
+    if (!options->model_path || !std::filesystem::is_directory(options->model_path)) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT,
+                    std::string("Model path ") + (options->model_path ? options->model_path : "") +
+                            " is not a directory");
+    }
+    return run_api_call([&] {
+        using namespace dorado;
+        const auto& defaults = utils::default_parameters;
+        const std::filesystem::path model_path(options->model_path);
+        const std::string device = options->device ? options->device : defaults.device;
+        const auto modbase_batch_size =
+                positive_or(options->modbase_batch_size, size_t(defaults.remora_batchsize));
+
+        auto result = std::make_unique<dorado_pipeline>();
+        result->read_callback = options->read_callback;
+        result->read_callback_user_data = options->read_callback_user_data;
+        result->model_sample_rate = get_model_sample_rate(model_path);
+
+        // Modbase runners are created first so that the basecall runners can size their
+        // batches to the memory left.
+        auto modbase_runners =
+                create_modbase_runners(options->modbase_models ? options->modbase_models : "",
+                                       device, defaults.remora_runners_per_caller,
+                                       modbase_batch_size);
+        const bool has_modbase_models = !modbase_runners.empty();
+        const auto model_config = load_crf_model_config(model_path);
+        auto [runners, num_devices] = create_basecall_runners(
+                model_config, device, positive_or(options->num_runners, defaults.num_runners),
+                positive_or(options->batch_size, size_t(defaults.batchsize)),
+                positive_or(options->chunk_size, size_t(defaults.chunksize)));
+        const auto model_stride = runners.front()->model_stride();
+        const auto overlap =
+                positive_or(options->overlap, size_t(defaults.overlap)) / model_stride *
+                model_stride;
+        const utils::ThreadAllocations thread_allocations(
+                int(num_devices), has_modbase_models ? defaults.remora_threads : 0);
+
+        PipelineDescriptor pipeline_desc;
+        auto output = pipeline_desc.add_node<ApiOutputSink>({}, std::ref(*result));
+        auto basecaller_sink = output;
+        if (has_modbase_models) {
+            basecaller_sink = pipeline_desc.add_node<ModBaseCallerNode>(
+                    {output}, std::move(modbase_runners),
+                    thread_allocations.remora_threads * num_devices, model_stride,
+                    modbase_batch_size, size_t(1000), true);
+        }
+        const int kBatchTimeoutMS = 100;
+        const auto model_name = std::filesystem::canonical(model_path).filename().string();
+        auto basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                {basecaller_sink}, std::move(runners), overlap, kBatchTimeoutMS, model_name,
+                size_t(1000), "BasecallerNode", false, ChunkSchedulingPolicy::FIFO,
+                !has_modbase_models);
+        result->scaler_node = pipeline_desc.add_node<ScalerNode>(
+                {basecaller_node}, model_config.signal_norm_params,
+                thread_allocations.scaler_node_threads);
+        result->pipeline = Pipeline::create(std::move(pipeline_desc));
+
+        spdlog::debug("> Created API pipeline for {} on {}", model_name, device);
+        *pipeline = result.release();
+        return DORADO_OK;
+    });
+}
+
+dorado_status dorado_pipeline_submit(dorado_pipeline* pipeline,
+                                     const dorado_signal* caller_signal) {
+    const auto signal = copy_api_struct(caller_signal, kSignalV1Size, dorado_signal_init);
+    if (!pipeline || !signal) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT,
+                    "Signals must be set up with dorado_signal_init()");
+    }
+    if (!signal->read_id || !signal->samples || signal->num_samples == 0) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT, "A read ID and samples are required");
+    }
+    if (!dorado::sample_rates_compatible(uint16_t(signal->sample_rate),
+                                         pipeline->model_sample_rate)) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT,
+                    "Sample rate " + std::to_string(signal->sample_rate) +
+                            " is not compatible with the model's " +
+                            std::to_string(pipeline->model_sample_rate));
+    }
+    return run_api_call([&] {
+        auto read = std::make_shared<dorado::Read>();
+        read->read_id = signal->read_id;
+        read->read_tag = signal->read_tag;
+        read->raw_data = signal_tensor(*signal);
+        read->sample_rate = signal->sample_rate;
+        read->offset = signal->calibration_offset;
+        read->scaling = signal->calibration_scale;
+        read->num_trimmed_samples = 0;
+        read->is_duplex = false;
+        read->attributes.num_samples = signal->num_samples;
+        if (signal->channel >= 0) {
+            read->attributes.channel_number = signal->channel;
+        }
+        if (signal->mux >= 0) {
+            read->attributes.mux = uint32_t(signal->mux);
+        }
+        read->attributes.read_number = signal->read_number;
+        read->start_sample = signal->start_sample >= 0 ? uint64_t(signal->start_sample) : 0;
+        read->end_sample = read->start_sample + signal->num_samples;
+        read->start_time_ms = signal->start_time_ms;
+        read->run_acquisition_start_time_ms = 0;
+        if (signal->start_time_ms != 0) {
+            read->attributes.start_time =
+                    dorado::utils::get_string_timestamp_from_unix_time(signal->start_time_ms);
+        }
+
+        std::shared_lock lock(pipeline->submit_mutex);
+        if (pipeline->finished) {
+            return fail(DORADO_ERROR_INVALID_STATE, "The pipeline is finished");
+        }
+        pipeline->pipeline->get_node(pipeline->scaler_node).push_message(std::move(read));
+        return DORADO_OK;
+    });
+}
+
+dorado_status dorado_pipeline_poll(dorado_pipeline* pipeline,
+                                   dorado_read** read,
+                                   int32_t timeout_ms) {
+    if (!pipeline || !read) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT, "A pipeline and read are required");
+    }
+    if (pipeline->read_callback) {
+        return fail(DORADO_ERROR_INVALID_STATE, "Reads are passed to the read callback");
+    }
+    std::unique_lock lock(pipeline->reads_mutex);
+    const auto has_read = [pipeline] {
+        return !pipeline->reads.empty() || pipeline->all_reads_queued;
+    };
+    if (timeout_ms < 0) {
+        pipeline->reads_cv.wait(lock, has_read);
+    } else if (!pipeline->reads_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                            has_read)) {
+        return DORADO_TIMEOUT;
+    }
+    if (pipeline->reads.empty()) {
+        return DORADO_FINISHED;
+    }
+    *read = pipeline->reads.front().release();
+    pipeline->reads.pop_front();
+    return DORADO_OK;
+}
+
+dorado_status dorado_pipeline_finish(dorado_pipeline* pipeline) {
+    if (!pipeline) {
+        return fail(DORADO_ERROR_INVALID_ARGUMENT, "A pipeline is required");
+    }
+    return run_api_call([&] {
+        std::unique_lock lock(pipeline->submit_mutex);
+        if (!pipeline->finished) {
+            pipeline->finished = true;
+            // Waits for every read to reach the output.
+            pipeline->pipeline->terminate();
+            {
+                std::lock_guard reads_lock(pipeline->reads_mutex);
+                pipeline->all_reads_queued = true;
+            }
+            pipeline->reads_cv.notify_all();
+        }
+        return DORADO_OK;
+    });
+}
+
+void dorado_pipeline_destroy(dorado_pipeline* pipeline) {
+    if (!pipeline) {
+        return;
+    }
+    dorado_pipeline_finish(pipeline);
+    delete pipeline;
+}
+
+const char* dorado_read_id(const dorado_read* read) { return read->read->read_id.c_str(); }
+
+uint64_t dorado_read_tag(const dorado_read* read) { return read->read->read_tag; }
+
+const char* dorado_read_sequence(const dorado_read* read, size_t* length) {
+    if (length) {
+        *length = read->read->seq.size();
+    }
+    return read->read->seq.c_str();
+}
+
+const char* dorado_read_qstring(const dorado_read* read, size_t* length) {
+    if (length) {
+        *length = read->read->qstring.size();
+    }
+    return read->read->qstring.c_str();
+}
+
+float dorado_read_mean_qscore(const dorado_read* read) { return read->read->mean_qscore(); }
+
+const uint8_t* dorado_read_moves(const dorado_read* read,
+                                 size_t* num_moves,
+                                 int32_t* model_stride,
+                                 uint64_t* trimmed_samples) {
+    const auto& called = *read->read;
+    if (num_moves) {
+        *num_moves = called.moves.size();
+    }
+    if (model_stride) {
+        *model_stride = called.model_stride;
+    }
+    if (trimmed_samples) {
+        *trimmed_samples = called.num_trimmed_samples;
+    }
+    return called.moves.data();
+}
+
+const uint8_t* dorado_read_modbase_probs(const dorado_read* read,
+                                         const uint32_t** positions,
+                                         size_t* num_positions,
+                                         const char** alphabet) {
+    const auto& called = *read->read;
+    if (!called.base_mod_info || called.base_mod_positions.empty()) {
+        return nullptr;
+    }
+    if (positions) {
+        *positions = called.base_mod_positions.data();
+    }
+    if (num_positions) {
+        *num_positions = called.base_mod_positions.size();
+    }
+    if (alphabet) {
+        *alphabet = called.base_mod_info->alphabet.c_str();
+    }
+    return called.base_mod_probs.data();
+}
+
+void dorado_read_free(dorado_read* read) { delete read; }
+
+}  // extern "C"
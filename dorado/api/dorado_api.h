@@ -0,0 +1,169 @@
+#ifndef DORADO_API_H
+#define DORADO_API_H
+
+/*
+ * C API for basecalling in process, for services which acquire or analyse signal themselves
+ * and want the calls without writing and parsing BAM.
+ *
+ * A pipeline is created from a model, is given reads' raw signal, and hands back each called
+ * read, either to a callback or to dorado_pipeline_poll().  Signal is used in place rather
+ * than copied, and released through a callback once dorado no longer needs it.
+ *
+ * The API is stable: structs passed in carry their own size, set by their _init functions, so
+ * fields can be added at the end without breaking callers built against an older header, and
+ * reads are only accessed through functions.  Fields a caller's header doesn't have take their
+ * defaults, and fields from a newer header than the library's are ignored.
+ *
+ * Functions returning dorado_status leave a description of any failure, for the calling
+ * thread, in dorado_last_error().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DORADO_API_VERSION 1
+
+typedef enum dorado_status {
+    DORADO_OK = 0,
+    // An argument was missing or invalid, e.g. a model path that doesn't exist.
+    DORADO_ERROR_INVALID_ARGUMENT = 1,
+    // The call is not allowed in the pipeline's state, e.g. submitting after finishing, or
+    // polling a pipeline with a read callback.
+    DORADO_ERROR_INVALID_STATE = 2,
+    // Anything else that went wrong, such as failing to load the model.
+    DORADO_ERROR_FAILED = 3,
+    // dorado_pipeline_poll() timed out without a read.
+    DORADO_TIMEOUT = 4,
+    // dorado_pipeline_poll() has no more reads to return, since the pipeline is finished.
+    DORADO_FINISHED = 5,
+} dorado_status;
+
+typedef struct dorado_pipeline dorado_pipeline;
+typedef struct dorado_read dorado_read;
+
+// Receives a called read, which it owns and must free with dorado_read_free().  It is called
+// from the pipeline's threads, possibly several at once, so must be thread safe, and should
+// return quickly, since the pipeline waits for it.
+typedef void (*dorado_read_callback)(dorado_read* read, void* user_data);
+
+// Called once dorado no longer needs a read's samples.
+typedef void (*dorado_release_callback)(const int16_t* samples, void* user_data);
+
+typedef struct dorado_pipeline_options {
+    // sizeof(dorado_pipeline_options), as set by dorado_pipeline_options_init().
+    size_t struct_size;
+    // Directory of the basecall model.  Required.
+    const char* model_path;
+    // Comma separated directories of modified base models, or NULL for none.
+    const char* modbase_models;
+    // Device string such as "cuda:all", "cuda:0,1", "metal" or "cpu", or NULL for the
+    // default for the build.
+    const char* device;
+    // Chunk size and overlap in samples, 0 for the defaults.
+    int32_t chunk_size;
+    int32_t overlap;
+    // Basecall batch size, or 0 to pick one for the device.
+    int32_t batch_size;
+    // Runners per device, or 0 for the default.
+    int32_t num_runners;
+    // Modified base batch size, or 0 for the default.
+    int32_t modbase_batch_size;
+    // If set, called reads are passed to it.  Otherwise they are queued for
+    // dorado_pipeline_poll().
+    dorado_read_callback read_callback;
+    void* read_callback_user_data;
+} dorado_pipeline_options;
+
+typedef struct dorado_signal {
+    // sizeof(dorado_signal), as set by dorado_signal_init().
+    size_t struct_size;
+    // The read's ID.  Required, and copied.
+    const char* read_id;
+    // Returned with the called read, for the caller to match it with what it submitted.
+    uint64_t read_tag;
+    // The read's raw signal, in ADC units.  Unless release is NULL, in which case the samples
+    // are copied, they are used in place and must stay valid and unchanged until release is
+    // called, which may be from another thread, and at the latest once the read is called.
+    const int16_t* samples;
+    uint64_t num_samples;
+    dorado_release_callback release;
+    void* release_user_data;
+    // Sampling rate in Hz, which must suit the model.
+    uint64_t sample_rate;
+    // Converts ADC units to picoamps: pA = (adc + calibration_offset) * calibration_scale.
+    float calibration_offset;
+    float calibration_scale;
+    // Acquisition details, written with the read.  Negative values, and a start time of 0,
+    // leave them unset.
+    int32_t channel;
+    int32_t mux;
+    int32_t read_number;
+    int64_t start_sample;
+    uint64_t start_time_ms;
+} dorado_signal;
+
+// The API version the library was built with, DORADO_API_VERSION in its header.
+int dorado_api_version(void);
+
+// Description of the last failure on the calling thread, or "" if there was none.
+const char* dorado_last_error(void);
+
+// Fills in struct_size and the defaults.
+void dorado_pipeline_options_init(dorado_pipeline_options* options);
+void dorado_signal_init(dorado_signal* signal);
+
+// Loads the models and starts the pipeline.  On success *pipeline is set, to be destroyed
+// with dorado_pipeline_destroy().
+dorado_status dorado_pipeline_create(const dorado_pipeline_options* options,
+                                     dorado_pipeline** pipeline);
+
+// Submits a read for basecalling.  Blocks while the pipeline is full.  Can be called from
+// several threads at once.
+dorado_status dorado_pipeline_submit(dorado_pipeline* pipeline, const dorado_signal* signal);
+
+// Without a read callback, waits up to timeout_ms, or indefinitely if it is negative, for a
+// called read.  On DORADO_OK, *read is set and must be freed with dorado_read_free().
+// Returns DORADO_FINISHED once the pipeline is finished and every read has been returned.
+dorado_status dorado_pipeline_poll(dorado_pipeline* pipeline,
+                                   dorado_read** read,
+                                   int32_t timeout_ms);
+
+// Stops taking reads, and waits for every submitted read to be called and handed on.  Reads
+// not yet polled can still be polled afterwards.
+dorado_status dorado_pipeline_finish(dorado_pipeline* pipeline);
+
+// Finishes the pipeline if that hasn't been done, and frees it along with any reads not
+// polled.  Reads already handed on stay valid.
+void dorado_pipeline_destroy(dorado_pipeline* pipeline);
+
+// Accessors for a called read.  Pointers returned are valid until the read is freed.
+const char* dorado_read_id(const dorado_read* read);
+uint64_t dorado_read_tag(const dorado_read* read);
+// The basecall, and its qscores as a Phred+33 string of the same length.
+const char* dorado_read_sequence(const dorado_read* read, size_t* length);
+const char* dorado_read_qstring(const dorado_read* read, size_t* length);
+float dorado_read_mean_qscore(const dorado_read* read);
+// The move table, one entry per model_stride samples of the signal after the
+// trimmed_samples trimmed from its start.
+const uint8_t* dorado_read_moves(const dorado_read* read,
+                                 size_t* num_moves,
+                                 int32_t* model_stride,
+                                 uint64_t* trimmed_samples);
+// Modified base probabilities, if modified base models ran: for each of the *num_positions
+// increasing positions in the sequence, a row of strlen(*alphabet) probabilities in 1/256
+// units.  Returns NULL if there are none.
+const uint8_t* dorado_read_modbase_probs(const dorado_read* read,
+                                         const uint32_t** positions,
+                                         size_t* num_positions,
+                                         const char** alphabet);
+void dorado_read_free(dorado_read* read);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // DORADO_API_H
@@ -3,6 +3,8 @@
 #include "read_pipeline/AlignerNode.h"
 #include "read_pipeline/HtsReader.h"
 #include "read_pipeline/HtsWriter.h"
+#include "read_pipeline/NullNode.h"
+#include "read_pipeline/PafWriter.h"
 #include "read_pipeline/ProgressTracker.h"
 #include "utils/bam_utils.h"
 #include "utils/cli_utils.h"
@@ -53,6 +55,41 @@ int aligner(int argc, char* argv[]) {
     parser.add_argument("-k").help("k-mer size (maximum 28).").default_value(15).scan<'i', int>();
     parser.add_argument("-w").help("minimizer window size.").default_value(10).scan<'i', int>();
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
+    parser.add_argument("-d", "--save-index")
+            .help("save the index built from the reference to this .mmi file, for reuse as the "
+                  "reference of later runs. If no reads are given, exit once it is saved.")
+            .default_value(std::string(""));
+    parser.add_argument("--keep-order")
+            .help("write alignments in the order of the input reads, as minimap2 does.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("-o", "--output")
+            .help("file to write alignments to, rather than stdout. Sorted BAM written to a file "
+                  "is indexed.")
+            .default_value(std::string("-"));
+    parser.add_argument("--sort")
+            .help("write alignments sorted by coordinate, as samtools sort does.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--sort-memory")
+            .help("memory to hold alignments in while sorting, before spilling them to "
+                  "temporary files.")
+            .default_value(std::string("4G"));
+    parser.add_argument("--compression-level")
+            .help("compression level of BAM and CRAM output, from 1 (fastest) to 9. 1 suits "
+                  "outputs which will be re-sorted or converted. -1 for htslib's default.")
+            .default_value(-1)
+            .scan<'i', int>();
+    parser.add_argument("--emit-paf")
+            .help("write the mappings as PAF, as minimap2 does without -c. Reads are mapped "
+                  "without base-level alignment, so there is no CIGAR or MD.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--emit-cram")
+            .help("write CRAM, with sequences encoded against the reference, which must be a "
+                  "FASTA rather than a prebuilt index.")
+            .default_value(false)
+            .implicit_value(true);
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     try {
@@ -76,6 +113,23 @@ int aligner(int argc, char* argv[]) {
     auto kmer_size(parser.get<int>("k"));
     auto window_size(parser.get<int>("w"));
     auto index_batch_size = utils::parse_string_to_size(parser.get<std::string>("I"));
+    auto index_output(parser.get<std::string>("save-index"));
+    auto keep_order(parser.get<bool>("keep-order"));
+    auto output(parser.get<std::string>("output"));
+    auto emit_paf(parser.get<bool>("emit-paf"));
+    auto emit_cram(parser.get<bool>("emit-cram"));
+    if (emit_paf && parser.get<bool>("sort")) {
+        spdlog::error("--sort needs SAM or BAM output, not PAF.");
+        return 1;
+    }
+    if (emit_paf && emit_cram) {
+        spdlog::error("Only one of --emit-paf and --emit-cram can be set.");
+        return 1;
+    }
+    size_t sort_memory_bytes = 0;
+    if (parser.get<bool>("sort")) {
+        sort_memory_bytes = utils::parse_string_to_size(parser.get<std::string>("sort-memory"));
+    }
 
     threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
     // The input thread is the total number of threads to use for dorado
@@ -86,6 +140,15 @@ int aligner(int argc, char* argv[]) {
             utils::aligner_writer_thread_allocation(threads, 0.1f);
     spdlog::debug("> aligner threads {}, writer threads {}", aligner_threads, writer_threads);
 
+    if (reads.size() == 0 && !index_output.empty()) {
+        spdlog::info("> building index {}", index);
+        NullNode null_sink;
+        Aligner aligner(null_sink, index, kmer_size, window_size, index_batch_size,
+                        aligner_threads, index_output);
+        spdlog::info("> saved index {}", index_output);
+        return 0;
+    }
+
     if (reads.size() == 0) {
 #ifndef _WIN32
         if (isatty(fileno(stdin))) {
@@ -104,19 +167,38 @@ int aligner(int argc, char* argv[]) {
     std::vector<dorado::stats::StatsCallable> stats_callables;
     ProgressTracker tracker(0, false);
     stats_callables.push_back(
-            [&tracker](const stats::NamedStats& stats) { tracker.update_progress_bar(stats); });
-
-    HtsWriter writer("-", HtsWriter::OutputMode::BAM, writer_threads, 0);
-    Aligner aligner(writer, index, kmer_size, window_size, index_batch_size, aligner_threads);
+            [&tracker](const stats::NamedStats&) { tracker.update_progress_bar(); });
+
+    // PAF has no header or records, so has its own writer.
+    std::unique_ptr<HtsWriter> hts_writer;
+    std::unique_ptr<PafWriter> paf_writer;
+    if (emit_paf) {
+        paf_writer = std::make_unique<PafWriter>(output);
+    } else {
+        hts_writer = std::make_unique<HtsWriter>(
+                output, emit_cram ? HtsWriter::OutputMode::CRAM : HtsWriter::OutputMode::BAM,
+                writer_threads, 0, "", "HtsWriter", sort_memory_bytes, nullptr,
+                parser.get<int>("compression-level"), index);
+    }
+    MessageSink& writer = emit_paf ? static_cast<MessageSink&>(*paf_writer) : *hts_writer;
+    Aligner aligner(writer, index, kmer_size, window_size, index_batch_size, aligner_threads,
+                    index_output, keep_order, {}, emit_paf);
     HtsReader reader(reads[0]);
+    // Input is decompressed on as many threads as output is compressed on.
+    reader.set_decompression_threads(writer_threads);
 
     spdlog::debug("> input fmt: {} aligned: {}", reader.format, reader.is_aligned);
-    auto header = sam_hdr_dup(reader.header);
-    add_pg_hdr(header);
-    utils::add_sq_hdr(header, aligner.get_sequence_records_for_header());
-    writer.write_header(header);
+    if (hts_writer) {
+        auto header = sam_hdr_dup(reader.header);
+        add_pg_hdr(header);
+        utils::add_sq_hdr(header, aligner.get_sequence_records_for_header());
+        hts_writer->write_header(header);
+    }
 
     // Setup stats counting.
+    stats::CounterRegistry counters;
+    writer.register_counters(counters);
+    tracker.set_counters(counters);
     std::unique_ptr<dorado::stats::StatsSampler> stats_sampler;
     std::vector<dorado::stats::StatsReporter> stats_reporters;
     using dorado::stats::make_stats_reporter;
@@ -136,8 +218,12 @@ int aligner(int argc, char* argv[]) {
     tracker.summarize();
 
     spdlog::info("> finished alignment");
-    spdlog::info("> total/primary/unmapped {}/{}/{}", writer.total, writer.primary,
-                 writer.unmapped);
+    if (hts_writer) {
+        spdlog::info("> total/primary/unmapped {}/{}/{}", hts_writer->total, hts_writer->primary,
+                     hts_writer->unmapped);
+    } else {
+        spdlog::info("> total/unmapped {}/{}", paf_writer->total, paf_writer->unmapped);
+    }
 
     return 0;
 }
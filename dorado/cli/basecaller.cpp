@@ -3,24 +3,44 @@
 #include "nn/CRFModel.h"
 #include "nn/ModBaseRunner.h"
 #include "nn/ModelRunner.h"
+#include "nn/ReplayRunner.h"
 #include "nn/Runners.h"
 #include "read_pipeline/AlignerNode.h"
+#include "read_pipeline/ArrowWriterNode.h"
+#include "read_pipeline/BarcodeClassifierNode.h"
 #include "read_pipeline/BasecallerNode.h"
 #include "read_pipeline/HtsReader.h"
 #include "read_pipeline/HtsWriter.h"
 #include "read_pipeline/ModBaseCallerNode.h"
+#include "read_pipeline/ModelFallbackController.h"
+#include "read_pipeline/OutputShards.h"
+#include "read_pipeline/Pipeline.h"
 #include "read_pipeline/ProgressTracker.h"
 #include "read_pipeline/ReadFilterNode.h"
+#include "read_pipeline/ReadOrderNode.h"
 #include "read_pipeline/ReadToBamTypeNode.h"
 #include "read_pipeline/ResumeLoaderNode.h"
 #include "read_pipeline/ScalerNode.h"
+#include "read_pipeline/SignalFilterNode.h"
+#include "read_pipeline/SummaryWriterNode.h"
+#include "read_pipeline/TargetMapper.h"
+#include "utils/BasecallCache.h"
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include "utils/GpuMonitor.h"
+#include "utils/cuda_utils.h"
+#endif
 #include "utils/bam_utils.h"
+#include "utils/barcode_kits.h"
 #include "utils/basecaller_utils.h"
+#include "utils/cache_utils.h"
 #include "utils/cli_utils.h"
 #include "utils/log_utils.h"
+#include "utils/metrics_server.h"
 #include "utils/models.h"
 #include "utils/parameters.h"
+#include "utils/resume_utils.h"
 #include "utils/stats.h"
+#include "utils/trace.h"
 
 #include <argparse.hpp>
 #include <htslib/sam.h>
@@ -31,16 +51,29 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <thread>
+#include <tuple>
 
 namespace dorado {
 
 using dorado::utils::default_parameters;
 using namespace std::chrono_literals;
 
+namespace {
+
+// Prefix mappings of lower quality don't count as on target.  This is low, since calling an
+// off-target read in full costs less than truncating an on-target one.
+constexpr int kTargetMinMapq = 5;
+
+}  // namespace
+
 void setup(std::vector<std::string> args,
            const std::filesystem::path& model_path,
+           const std::vector<std::string>& extra_model_paths,
+           const std::string& fallback_model_path,
+           double fallback_backlog_s,
            const std::string& data_path,
            const std::string& remora_models,
            const std::string& device,
@@ -54,6 +87,7 @@ void setup(std::vector<std::string> args,
            float methylation_threshold_pct,
            HtsWriter::OutputMode output_mode,
            bool emit_moves,
+           bool pack_moves,
            size_t max_reads,
            size_t min_qscore,
            std::string read_list_file_path,
@@ -64,16 +98,136 @@ void setup(std::vector<std::string> args,
            bool skip_model_compatibility_check,
            const std::string& dump_stats_file,
            const std::string& dump_stats_filter,
-           const std::string& resume_from_file) {
+           bool memory_summary,
+           int metrics_port,
+           const std::string& metrics_host,
+           size_t num_cuda_streams,
+           bool use_cuda_graphs,
+           bool cuda_workspace_arena,
+           int num_short_read_chunk_sizes,
+           ChunkSchedulingPolicy chunk_scheduling,
+           const std::string& resume_from_file,
+           const std::string& progress_file,
+           const std::string& progress_journal_file,
+           int watch_timeout_s,
+           const std::string& summary_file,
+           const std::string& arrow_file,
+           size_t num_output_shards,
+           const OutputShardPolicy& output_shard_policy,
+           const std::string& output_prefix,
+           bool modbase_signal_on_device,
+           int modbase_batch_timeout_ms,
+           bool modbase_kmers_on_device,
+           bool modbase_fuse_models,
+           bool metal_viterbi_decode,
+           bool decode_kept_steps_only,
+           size_t max_working_reads_bytes,
+           float min_signal_stdev_pa,
+           bool trim_adapter_tail,
+           bool scale_on_device,
+           int adaptive_batch_latency_ms,
+           bool pack_short_reads,
+           int aligner_extension_band,
+           bool keep_read_order,
+           size_t sort_memory_bytes,
+           int compression_level,
+           const BarcodeClassifierSettings& barcode_settings,
+           const std::string& recall_model_path,
+           const RecallSelection& recall_selection,
+           bool call_on_target_only,
+           const std::string& target_bed,
+           size_t target_prefix_chunks,
+           bool use_basecall_cache,
+           const std::string& record_model_outputs,
+           const std::string& replay_model_outputs,
+           double replay_chunks_per_s) {
     torch::set_num_threads(1);
 
     // create modbase runners first so basecall runners can pick batch sizes based on available memory
     auto remora_runners = create_modbase_runners(
             remora_models, device, default_parameters.remora_runners_per_caller, remora_batch_size);
 
+    // With a recall model, half of the GPU memory is left for its runners, and with extra
+    // models each model gets an equal share.
+    const bool recall = !recall_model_path.empty();
+    const bool multi_model = !extra_model_paths.empty();
+    if (multi_model) {
+        if (recall) {
+            throw std::runtime_error("Extra models cannot be used with a recall model.");
+        }
+        if (call_on_target_only || use_basecall_cache) {
+            throw std::runtime_error(
+                    "Extra models cannot be used with --call-on-target-only or --basecall-cache.");
+        }
+        if (!record_model_outputs.empty() || !replay_model_outputs.empty()) {
+            throw std::runtime_error("Model outputs cannot be recorded or replayed with extra "
+                                     "models.");
+        }
+    }
+    // A fallback model takes new reads while the main model has too much of a backlog.
+    const bool fallback = !fallback_model_path.empty();
+    if (fallback) {
+        if (recall || multi_model) {
+            throw std::runtime_error(
+                    "A fallback model cannot be used with a recall model or extra models.");
+        }
+        if (call_on_target_only || use_basecall_cache) {
+            throw std::runtime_error(
+                    "A fallback model cannot be used with --call-on-target-only or "
+                    "--basecall-cache.");
+        }
+        if (!record_model_outputs.empty() || !replay_model_outputs.empty()) {
+            throw std::runtime_error(
+                    "Model outputs cannot be recorded or replayed with a fallback model.");
+        }
+    }
+    const float memory_fraction =
+            recall || fallback ? 0.5f : 1.f / float(1 + extra_model_paths.size());
     auto model_config = dorado::load_crf_model_config(model_path);
-    auto [runners, num_devices] =
-            create_basecall_runners(model_config, device, num_runners, batch_size, chunk_size);
+    // A replayed recording stands in for every runner the recorded run had.
+    std::vector<Runner> runners;
+    size_t num_devices = 1;
+    if (!replay_model_outputs.empty()) {
+        auto replayed = std::make_shared<const ModelOutputRecording>(replay_model_outputs);
+        spdlog::info("> Replaying {} recorded chunks from {}", replayed->size(),
+                     replay_model_outputs);
+        runners = create_replay_runners(replayed, replay_chunks_per_s);
+        // The recording has the short read runners too.
+        num_short_read_chunk_sizes = 0;
+    } else {
+        std::tie(runners, num_devices) = create_basecall_runners(
+                model_config, device, num_runners, batch_size, chunk_size, memory_fraction, false,
+                num_cuda_streams, use_cuda_graphs, metal_viterbi_decode, overlap,
+                cuda_workspace_arena);
+    }
+
+    // Smaller chunk sizes for short reads, which would otherwise be padded out to a full chunk.
+    // These use the main runners' batch size, so each needs at most half their memory, and
+    // otherwise run with the same streams, graphs and memory settings as the main runners.
+    if (num_short_read_chunk_sizes > 0 && device == "cpu") {
+        spdlog::warn("Short read chunk sizes are not supported on CPU, ignoring.");
+    } else {
+        const auto main_batch_size = runners.front()->batch_size();
+        const auto main_chunk_size = runners.front()->chunk_size();
+        // Short reads are left to the GPUs, without CPU runners spilling over them.
+        const auto bucket_device = split_cpu_spill_device(device).first;
+        for (int i = 1; i <= num_short_read_chunk_sizes; ++i) {
+            auto bucket_runners =
+                    create_basecall_runners(model_config, bucket_device, num_runners,
+                                            main_batch_size, main_chunk_size >> i,
+                                            memory_fraction, false, num_cuda_streams,
+                                            use_cuda_graphs, metal_viterbi_decode, overlap,
+                                            cuda_workspace_arena)
+                            .first;
+            runners.insert(runners.end(), bucket_runners.begin(), bucket_runners.end());
+        }
+    }
+
+    std::shared_ptr<ModelOutputRecording> recording;
+    if (!record_model_outputs.empty()) {
+        recording = std::make_shared<ModelOutputRecording>();
+        record_runners(runners, recording);
+    }
 
     // verify that all runners are using the same stride, in case we allow multiple models in future
     auto model_stride = runners.front()->model_stride();
@@ -86,62 +240,459 @@ void setup(std::vector<std::string> args,
         overlap = adjusted_overlap;
     }
 
-    if (!remora_runners.empty() && output_mode == HtsWriter::OutputMode::FASTQ) {
+    // Reads the recall selection picks are called again by a second basecaller, with the
+    // recall model's runners on the same GPUs, without CPU runners.
+    std::vector<Runner> recall_runners;
+    std::string recall_model_name;
+    size_t recall_overlap = 0;
+    if (recall) {
+        if (get_model_sample_rate(recall_model_path) != get_model_sample_rate(model_path)) {
+            throw std::runtime_error("The recall model must have the same sample rate as " +
+                                     model_path.filename().string());
+        }
+        auto recall_config = dorado::load_crf_model_config(recall_model_path);
+        recall_runners =
+                create_basecall_runners(recall_config, split_cpu_spill_device(device).first,
+                                        num_runners, batch_size, chunk_size, 1.f, false,
+                                        num_cuda_streams, use_cuda_graphs, metal_viterbi_decode,
+                                        overlap, cuda_workspace_arena)
+                        .first;
+        const auto recall_stride = recall_runners.front()->model_stride();
+        if (!remora_runners.empty() && recall_stride != model_stride) {
+            throw std::runtime_error(
+                    "Modified bases can only be called with a recall model of the same stride.");
+        }
+        recall_overlap = (overlap / recall_stride) * recall_stride;
+        recall_model_name = std::filesystem::canonical(recall_model_path).filename().string();
+    }
+
+    // Each extra model calls the reads of its own sample rate, with its own scaling and runners
+    // on the same devices as the main model's.
+    struct ExtraModel {
+        CRFModelConfig config;
+        std::string name;
+        uint16_t sample_rate;
+        std::vector<Runner> runners;
+        size_t overlap;
+    };
+    std::vector<ExtraModel> extra_models;
+    const auto model_sample_rate = get_model_sample_rate(model_path);
+    const bool rna = utils::is_rna_model(model_path);
+    for (const auto& extra_model_path : extra_model_paths) {
+        const auto extra_sample_rate = get_model_sample_rate(extra_model_path);
+        if (sample_rates_compatible(extra_sample_rate, model_sample_rate) ||
+            std::any_of(extra_models.begin(), extra_models.end(), [&](const ExtraModel& other) {
+                return sample_rates_compatible(extra_sample_rate, other.sample_rate);
+            })) {
+            throw std::runtime_error("Extra model " + extra_model_path +
+                                     " has the same sample rate as another model, so their reads "
+                                     "can't be told apart.");
+        }
+        if (utils::is_rna_model(extra_model_path) != rna) {
+            throw std::runtime_error("Extra model " + extra_model_path +
+                                     " must be for the same kind of strand, RNA or DNA, as " +
+                                     model_path.filename().string());
+        }
+        auto& extra = extra_models.emplace_back();
+        extra.config = dorado::load_crf_model_config(extra_model_path);
+        extra.name = std::filesystem::canonical(extra_model_path).filename().string();
+        extra.sample_rate = extra_sample_rate;
+        // Each model takes its share of the memory the models before it left.
+        const float extra_memory_fraction = 1.f / float(extra_model_paths.size() + 1 -
+                                                        extra_models.size());
+        extra.runners = create_basecall_runners(extra.config, device, num_runners, batch_size,
+                                                chunk_size, extra_memory_fraction, false,
+                                                num_cuda_streams, use_cuda_graphs,
+                                                metal_viterbi_decode, overlap, cuda_workspace_arena)
+                                .first;
+        const auto extra_stride = extra.runners.front()->model_stride();
+        if (!remora_runners.empty() && extra_stride != model_stride) {
+            throw std::runtime_error(
+                    "Modified bases can only be called with extra models of the same stride.");
+        }
+        extra.overlap = (overlap / extra_stride) * extra_stride;
+    }
+
+    std::vector<Runner> fallback_runners;
+    std::optional<CRFModelConfig> fallback_config;
+    std::string fallback_model_name;
+    size_t fallback_overlap = 0;
+    if (fallback) {
+        if (!sample_rates_compatible(get_model_sample_rate(fallback_model_path),
+                                     model_sample_rate)) {
+            throw std::runtime_error("The fallback model must have the same sample rate as " +
+                                     model_path.filename().string());
+        }
+        if (utils::is_rna_model(fallback_model_path) != rna) {
+            throw std::runtime_error(
+                    "The fallback model must be for the same kind of strand, RNA or DNA, as " +
+                    model_path.filename().string());
+        }
+        fallback_config = dorado::load_crf_model_config(fallback_model_path);
+        fallback_runners = create_basecall_runners(*fallback_config, device, num_runners,
+                                                   batch_size, chunk_size, 1.f, false,
+                                                   num_cuda_streams, use_cuda_graphs,
+                                                   metal_viterbi_decode, overlap,
+                                                   cuda_workspace_arena)
+                                   .first;
+        const auto fallback_stride = fallback_runners.front()->model_stride();
+        if (!remora_runners.empty() && fallback_stride != model_stride) {
+            throw std::runtime_error(
+                    "Modified bases can only be called with a fallback model of the same "
+                    "stride.");
+        }
+        fallback_overlap = (overlap / fallback_stride) * fallback_stride;
+        fallback_model_name =
+                std::filesystem::canonical(fallback_model_path).filename().string();
+    }
+
+    if (!remora_runners.empty() && HtsWriter::is_fastq(output_mode)) {
         throw std::runtime_error("Modified base models cannot be used with FASTQ output");
     }
 
-    if (!ref.empty() && output_mode == HtsWriter::OutputMode::FASTQ) {
+    if (call_on_target_only && ref.empty()) {
+        throw std::runtime_error("Calling only on-target reads needs a reference.");
+    }
+
+    if (!ref.empty() && HtsWriter::is_fastq(output_mode)) {
         throw std::runtime_error("Alignment to reference cannot be used with FASTQ output.");
     }
 
+    if (num_output_shards > 0 && (!progress_file.empty() || !progress_journal_file.empty())) {
+        throw std::runtime_error("A progress file cannot be recorded for sharded output.");
+    }
+
+    // The read groups, sample rate and read count all come from one pass over the files.
+    const auto data_metadata = DataLoader::scan_metadata(data_path, recursive_file_loading);
+
     std::string model_name = std::filesystem::canonical(model_path).filename().string();
-    auto read_groups = DataLoader::load_read_groups(data_path, model_name, recursive_file_loading);
+    auto read_groups = data_metadata.read_groups(model_name);
+    if (recall) {
+        // Recalled reads are in the recall model's read groups.
+        read_groups.merge(data_metadata.read_groups(recall_model_name));
+    }
+    for (const auto& extra : extra_models) {
+        read_groups.merge(data_metadata.read_groups(extra.name));
+    }
+    if (fallback) {
+        // Reads are in the read groups of whichever model called them.
+        read_groups.merge(data_metadata.read_groups(fallback_model_name));
+    }
 
     auto read_list = utils::load_read_list(read_list_file_path);
 
+    const bool watch = watch_timeout_s > 0;
+
     // Check sample rate of model vs data.
-    auto data_sample_rate = DataLoader::get_sample_rate(data_path, recursive_file_loading);
-    auto model_sample_rate = get_model_sample_rate(model_path);
-    if (!skip_model_compatibility_check &&
-        !sample_rates_compatible(data_sample_rate, model_sample_rate)) {
+    // When watching for new data there may not be any yet, in which case it can't be checked.
+    const auto data_sample_rate = data_metadata.sample_rate;
+    if (!data_sample_rate) {
+        if (!watch) {
+            throw std::runtime_error("Unable to determine sample rate for data.");
+        }
+        spdlog::warn("No reads in {} yet, so the model's sample rate can't be checked.",
+                     data_path);
+    }
+    // With extra models, the data only has to suit one of them.
+    const bool any_model_compatible =
+            !data_sample_rate || sample_rates_compatible(*data_sample_rate, model_sample_rate) ||
+            std::any_of(extra_models.begin(), extra_models.end(), [&](const ExtraModel& extra) {
+                return sample_rates_compatible(*data_sample_rate, extra.sample_rate);
+            });
+    if (!skip_model_compatibility_check && !any_model_compatible) {
         std::stringstream err;
-        err << "Sample rate for model (" << model_sample_rate << ") and data (" << data_sample_rate
-            << ") are not compatible.";
+        err << "Sample rate for model (" << model_sample_rate << ") and data ("
+            << *data_sample_rate << ") are not compatible.";
         throw std::runtime_error(err.str());
     }
 
-    size_t num_reads = DataLoader::get_num_reads(
-            data_path, read_list, {} /*reads_already_processed*/, recursive_file_loading);
+    // Reads recorded in the progress file by earlier runs are skipped, so only new records are
+    // written and the output of each run goes to its own file.
+    ReadIDSet reads_already_processed;
+    if (!progress_file.empty()) {
+        reads_already_processed = utils::load_progress_file(progress_file, model_name);
+    }
+    // Batches the journal lists are skipped without being read.  Reads are journalled by their
+    // place in the load order, so the records are written in that order.
+    std::unique_ptr<utils::ProgressJournal> progress_journal;
+    if (!progress_journal_file.empty()) {
+        progress_journal =
+                std::make_unique<utils::ProgressJournal>(progress_journal_file, model_name);
+        if (auto size = progress_journal->previous_output_size()) {
+            spdlog::info(
+                    "> The previous run's journalled records are its output's first {} bytes. "
+                    "Any after them are written again, so truncate it to that size.",
+                    *size);
+        }
+        keep_read_order = true;
+    }
+
+    size_t num_reads = data_metadata.num_reads_to_load(read_list, reads_already_processed);
     num_reads = max_reads == 0 ? num_reads : std::min(num_reads, max_reads);
+    if (watch) {
+        // More reads will arrive, so the total isn't known.
+        num_reads = max_reads;
+    }
 
-    bool rna = utils::is_rna_model(model_path), duplex = false;
+    bool duplex = false;
 
     auto const thread_allocations = utils::default_thread_allocations(
             num_devices, !remora_runners.empty() ? num_remora_threads : 0);
 
+    PipelineDescriptor pipeline_desc;
+    // Sharded output is split between files by a router, each with its own writer thread and
+    // share of the compression threads.
+    std::vector<PipelineDescriptor::NodeHandle> hts_writers;
+    auto hts_writer = PipelineDescriptor::InvalidNodeHandle;
+    if (num_output_shards > 0) {
+        const size_t shard_threads =
+                std::max(thread_allocations.writer_threads / num_output_shards, size_t(1));
+        for (size_t shard = 0; shard < num_output_shards; ++shard) {
+            hts_writers.push_back(pipeline_desc.add_node<HtsWriter>(
+                    {}, output_shard_filename(output_prefix, shard, output_mode), output_mode,
+                    shard_threads, num_reads, std::string(),
+                    "HtsWriter_shard" + std::to_string(shard),
+                    (sort_memory_bytes + num_output_shards - 1) / num_output_shards, nullptr,
+                    compression_level, ref));
+        }
+        std::vector<std::string> read_group_ids;
+        for (const auto& read_group : read_groups) {
+            read_group_ids.push_back(read_group.first);
+        }
+        std::sort(read_group_ids.begin(), read_group_ids.end());
+        hts_writer = pipeline_desc.add_router(
+                hts_writers,
+                make_output_shard_route(
+                        output_shard_policy, num_output_shards, read_group_ids,
+                        BarcodeClassifierNode::barcode_names(barcode_settings.kits)),
+                "OutputShardRouter");
+    } else {
+        hts_writer = pipeline_desc.add_node<HtsWriter>(
+                {}, "-", output_mode, thread_allocations.writer_threads, num_reads, progress_file,
+                "HtsWriter", sort_memory_bytes, progress_journal.get(), compression_level, ref);
+        hts_writers.push_back(hts_writer);
+    }
+    // Records are put back in the order their reads were loaded just before they are written,
+    // if asked to.  The window is enough reads in flight to keep every stage busy.
+    constexpr size_t kReadOrderWindow = 10000;
+    auto records_sink = hts_writer;
+    auto read_order_node = PipelineDescriptor::InvalidNodeHandle;
+    if (keep_read_order) {
+        read_order_node = pipeline_desc.add_node<ReadOrderNode>({hts_writer}, kReadOrderWindow);
+        records_sink = read_order_node;
+    }
+    // The aligner converts reads to records itself, aligning their sequence directly, so that
+    // it takes over the read converter's threads.
+    auto aligner = PipelineDescriptor::InvalidNodeHandle;
+    auto filtered_reads_sink = PipelineDescriptor::InvalidNodeHandle;
+    if (!ref.empty()) {
+        // Alignments can be extended on the first GPU, leaving minimap2 only seeding and chaining.
+        std::shared_ptr<utils::BandedAligner> device_extender;
+        if (aligner_extension_band > 0) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            const auto cuda_devices =
+                    utils::parse_cuda_device_string(split_cpu_spill_device(device).first);
+            if (!cuda_devices.empty()) {
+                device_extender = std::make_shared<utils::BandedAligner>(
+                        torch::Device(cuda_devices.front()), aligner_extension_band);
+            }
+#endif
+            if (!device_extender) {
+                spdlog::warn("Alignments can only be extended on a CUDA device, so "
+                             "--aligner_extension_band is ignored.");
+            }
+        }
+        aligner = pipeline_desc.add_node<Aligner>(
+                {records_sink}, ref, kmer_size, window_size, mm2_index_batch_size,
+                thread_allocations.aligner_threads + thread_allocations.read_converter_threads,
+                std::string(), false,
+                ReadConversionOptions{emit_moves, rna, methylation_threshold_pct, pack_moves},
+                false, std::move(device_extender));
+        filtered_reads_sink = aligner;
+    } else {
+        filtered_reads_sink = pipeline_desc.add_node<ReadToBamType>(
+                {records_sink}, emit_moves, rna, thread_allocations.read_converter_threads,
+                methylation_threshold_pct, 1000, pack_moves);
+    }
+    // Summary rows are written from the reads themselves, as they go on to be written out.
+    if (!summary_file.empty()) {
+        filtered_reads_sink =
+                pipeline_desc.add_node<SummaryWriterNode>({filtered_reads_sink}, summary_file);
+    }
+    if (!arrow_file.empty()) {
+        filtered_reads_sink =
+                pipeline_desc.add_node<ArrowWriterNode>({filtered_reads_sink}, arrow_file);
+    }
+    auto read_filter_node = pipeline_desc.add_node<ReadFilterNode>(
+            {filtered_reads_sink}, min_qscore, default_parameters.min_seqeuence_length,
+            std::unordered_set<std::string>{}, thread_allocations.read_filter_threads);
+
+    // Reads are classified, and trimmed, before filtering so that the length filter applies to
+    // what will be written.
+    auto called_reads_sink = read_filter_node;
+    if (!barcode_settings.kits.empty()) {
+        called_reads_sink = pipeline_desc.add_node<BarcodeClassifierNode>(
+                {read_filter_node}, barcode_settings, thread_allocations.read_filter_threads);
+    }
+
+    // Nothing after basecalling (and modbase calling) needs the signal, so it is freed as soon
+    // as the last caller is done with each read.
+    const bool has_modbase_models = !remora_runners.empty();
+    auto basecaller_node_sink = called_reads_sink;
+    if (has_modbase_models) {
+        basecaller_node_sink = pipeline_desc.add_node<ModBaseCallerNode>(
+                {called_reads_sink}, std::move(remora_runners),
+                thread_allocations.remora_threads * num_devices, model_stride, remora_batch_size,
+                size_t(1000), true, modbase_signal_on_device, modbase_batch_timeout_ms,
+                modbase_kmers_on_device, modbase_fuse_models);
+        // Reads the filter will drop anyway aren't modbase called.  Trimming only shortens
+        // reads, so too short reads can always go, but trimming a barcode changes the mean
+        // qscore, so that is only filtered on early without barcoding.
+        basecaller_node_sink = pipeline_desc.add_node<ReadFilterNode>(
+                {basecaller_node_sink}, barcode_settings.kits.empty() ? min_qscore : 0,
+                default_parameters.min_seqeuence_length, std::unordered_set<std::string>{},
+                thread_allocations.read_filter_threads, "ModBaseReadFilterNode");
+    }
+    // Only reads whose first chunks map on target are called in full.  The mapper has its own
+    // index, without the alignments the aligner makes.
+    std::optional<TargetedCalling> targeted_calling;
+    if (call_on_target_only) {
+        targeted_calling = TargetedCalling{
+                std::make_shared<TargetMapper>(ref, target_bed, kmer_size, window_size,
+                                               mm2_index_batch_size, kTargetMinMapq,
+                                               int(thread_allocations.aligner_threads)),
+                std::max(target_prefix_chunks, size_t(1))};
+    }
+    // Calls depend on the model, the device, how reads are chunked and decoded, and with
+    // targeted calling on which reads are on target, so each combination has its own cache.
+    std::shared_ptr<utils::BasecallCache> basecall_cache;
+    if (use_basecall_cache) {
+        if (auto cache_dir = utils::get_cache_dir()) {
+            std::string chunk_sizes;
+            for (const auto& runner : runners) {
+                chunk_sizes += std::to_string(runner->chunk_size()) + ',';
+            }
+            std::vector<std::string> key_parts = {utils::directory_fingerprint(model_path),
+                                                  device,
+                                                  chunk_sizes,
+                                                  std::to_string(overlap),
+                                                  decode_kept_steps_only ? "kept" : "all"};
+            if (call_on_target_only) {
+                key_parts.push_back(utils::file_fingerprint(ref));
+                key_parts.push_back(target_bed.empty() ? "" : utils::file_fingerprint(target_bed));
+                key_parts.push_back(std::to_string(target_prefix_chunks));
+            }
+            const auto cache_path = *cache_dir / utils::kBasecallCacheDir /
+                                    utils::cache_file_name(key_parts, ".calls");
+            try {
+                basecall_cache = std::make_shared<utils::BasecallCache>(cache_path);
+                spdlog::info("> Using basecall cache {} of {} reads", cache_path.string(),
+                             basecall_cache->size());
+            } catch (const std::exception& e) {
+                spdlog::warn("Not caching calls: {}", e.what());
+            }
+        } else {
+            spdlog::warn("Caching is disabled, so --basecall-cache is ignored.");
+        }
+    }
+    const int kBatchTimeoutMS = 100;
+    if (recall) {
+        basecaller_node_sink = pipeline_desc.add_node<BasecallerNode>(
+                {basecaller_node_sink}, std::move(recall_runners), recall_overlap,
+                kBatchTimeoutMS, recall_model_name, size_t(1000), "RecallBasecallerNode", false,
+                chunk_scheduling, !has_modbase_models, max_working_reads_bytes,
+                decode_kept_steps_only, recall_selection);
+    }
+    auto basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+            {basecaller_node_sink}, std::move(runners), overlap, kBatchTimeoutMS, model_name,
+            size_t(1000), "BasecallerNode", false, chunk_scheduling,
+            !has_modbase_models && !recall, max_working_reads_bytes, decode_kept_steps_only,
+            std::nullopt, std::move(targeted_calling), std::move(basecall_cache),
+            adaptive_batch_latency_ms, pack_short_reads);
+    // Reads can be normalised on the first GPU, leaving the CPU only their trimming.
+    std::string scaler_device;
+    if (scale_on_device) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        const auto cuda_devices =
+                utils::parse_cuda_device_string(split_cpu_spill_device(device).first);
+        if (!cuda_devices.empty()) {
+            scaler_device = cuda_devices.front();
+        }
+#endif
+        if (scaler_device.empty()) {
+            spdlog::warn("Reads can only be normalised on a CUDA device, so --scale_on_device is "
+                         "ignored.");
+        }
+    }
+    auto scaler_node = pipeline_desc.add_node<ScalerNode>(
+            {basecaller_node}, model_config.signal_norm_params,
+            thread_allocations.scaler_node_threads, size_t(1000), trim_adapter_tail,
+            "ScalerNode", scaler_device);
+    // With extra models, reads are routed to the model of their sample rate, which scales and
+    // calls them before they rejoin the rest of the pipeline.
+    auto called_reads_source = scaler_node;
+    if (multi_model) {
+        std::vector<PipelineDescriptor::NodeHandle> scaler_nodes{scaler_node};
+        std::vector<uint16_t> sample_rates{model_sample_rate};
+        for (size_t i = 0; i < extra_models.size(); ++i) {
+            auto& extra = extra_models[i];
+            const auto suffix = "_" + std::to_string(i + 1);
+            auto extra_basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                    {basecaller_node_sink}, std::move(extra.runners), extra.overlap,
+                    kBatchTimeoutMS, extra.name, size_t(1000), "BasecallerNode" + suffix, false,
+                    chunk_scheduling, !has_modbase_models, max_working_reads_bytes,
+                    decode_kept_steps_only);
+            scaler_nodes.push_back(pipeline_desc.add_node<ScalerNode>(
+                    {extra_basecaller_node}, extra.config.signal_norm_params,
+                    thread_allocations.scaler_node_threads, size_t(1000), trim_adapter_tail,
+                    "ScalerNode" + suffix, scaler_device));
+            sample_rates.push_back(extra.sample_rate);
+        }
+        called_reads_source = pipeline_desc.add_router(
+                scaler_nodes, MessageRouterNode::route_by_sample_rate(std::move(sample_rates)),
+                "SampleRateRouter");
+    }
+    std::shared_ptr<ModelFallbackController> fallback_controller;
+    if (fallback) {
+        auto fallback_basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                {basecaller_node_sink}, std::move(fallback_runners), fallback_overlap,
+                kBatchTimeoutMS, fallback_model_name, size_t(1000), "FallbackBasecallerNode",
+                false, chunk_scheduling, !has_modbase_models, max_working_reads_bytes,
+                decode_kept_steps_only);
+        auto fallback_scaler_node = pipeline_desc.add_node<ScalerNode>(
+                {fallback_basecaller_node}, fallback_config->signal_norm_params,
+                thread_allocations.scaler_node_threads, size_t(1000), trim_adapter_tail,
+                "FallbackScalerNode", scaler_device);
+        fallback_controller = std::make_shared<ModelFallbackController>(fallback_backlog_s);
+        called_reads_source = pipeline_desc.add_router(
+                {scaler_node, fallback_scaler_node},
+                [fallback_controller](const Message& message) -> size_t {
+                    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+                        return 0;
+                    }
+                    return fallback_controller->route_read();
+                },
+                "FallbackRouter");
+    }
+    // Reads which would certainly be filtered out after basecalling are dropped beforehand.
+    auto signal_filter_node = pipeline_desc.add_node<SignalFilterNode>(
+            {called_reads_source}, default_parameters.min_seqeuence_length,
+            default_parameters.max_bases_per_second, min_signal_stdev_pa,
+            thread_allocations.scaler_node_threads);
+
+    auto pipeline = Pipeline::create(std::move(pipeline_desc));
+
     std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> hdr(sam_hdr_init(), sam_hdr_destroy);
     utils::add_pg_hdr(hdr.get(), args);
     utils::add_rg_hdr(hdr.get(), read_groups);
-    std::shared_ptr<HtsWriter> bam_writer;
-    std::shared_ptr<Aligner> aligner;
-    MessageSink* converted_reads_sink = nullptr;
-    if (ref.empty()) {
-        bam_writer = std::make_shared<HtsWriter>("-", output_mode,
-                                                 thread_allocations.writer_threads, num_reads);
-        bam_writer->write_header(hdr.get());
-        converted_reads_sink = bam_writer.get();
-    } else {
-        bam_writer = std::make_shared<HtsWriter>("-", output_mode,
-                                                 thread_allocations.writer_threads, num_reads);
-        aligner =
-                std::make_shared<Aligner>(*bam_writer, ref, kmer_size, window_size,
-                                          mm2_index_batch_size, thread_allocations.aligner_threads);
-        utils::add_sq_hdr(hdr.get(), aligner->get_sequence_records_for_header());
-        bam_writer->write_header(hdr.get());
-        converted_reads_sink = aligner.get();
+    if (aligner != PipelineDescriptor::InvalidNodeHandle) {
+        utils::add_sq_hdr(hdr.get(),
+                          pipeline->get_node<Aligner>(aligner).get_sequence_records_for_header());
+    }
+    for (auto writer : hts_writers) {
+        pipeline->get_node<HtsWriter>(writer).write_header(hdr.get());
     }
 
-    std::unordered_set<std::string> reads_already_processed;
     if (!resume_from_file.empty()) {
         spdlog::info("> Inspecting resume file...");
         // Turn off warning logging as header info is fetched.
@@ -157,55 +708,66 @@ void setup(std::vector<std::string> args,
                     "Resume only works if the same model is used. Resume model was " +
                     resume_model_name + " and current model is " + model_name);
         }
-        ResumeLoaderNode resume_loader(*bam_writer, resume_from_file);
+        ResumeLoaderNode resume_loader(pipeline->get_node(hts_writer), resume_from_file);
         resume_loader.copy_completed_reads();
-        reads_already_processed = resume_loader.get_processed_read_ids();
+        const auto& resumed_reads = resume_loader.get_processed_read_ids();
+        reads_already_processed.insert(resumed_reads.begin(), resumed_reads.end());
     }
 
-    ReadToBamType read_converter(*converted_reads_sink, emit_moves, rna,
-                                 thread_allocations.read_converter_threads,
-                                 methylation_threshold_pct);
-    ReadFilterNode read_filter_node(read_converter, min_qscore,
-                                    default_parameters.min_seqeuence_length, {},
-                                    thread_allocations.read_filter_threads);
-
-    std::unique_ptr<ModBaseCallerNode> mod_base_caller_node;
-    MessageSink* basecaller_node_sink = static_cast<MessageSink*>(&read_filter_node);
-    if (!remora_runners.empty()) {
-        mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
-                read_filter_node, std::move(remora_runners),
-                thread_allocations.remora_threads * num_devices, model_stride, remora_batch_size);
-        basecaller_node_sink = static_cast<MessageSink*>(mod_base_caller_node.get());
-    }
-    const int kBatchTimeoutMS = 100;
-    BasecallerNode basecaller_node(*basecaller_node_sink, std::move(runners), overlap,
-                                   kBatchTimeoutMS, model_name, 1000);
-    ScalerNode scaler_node(basecaller_node, model_config.signal_norm_params,
-                           thread_allocations.scaler_node_threads);
-
-    DataLoader loader(scaler_node, "cpu", thread_allocations.loader_threads, max_reads, read_list,
+    DataLoader loader(pipeline->get_node(signal_filter_node), "cpu",
+                      thread_allocations.loader_threads, max_reads, read_list,
                       reads_already_processed);
+    if (read_order_node != PipelineDescriptor::InvalidNodeHandle) {
+        loader.set_read_order(pipeline->get_node<ReadOrderNode>(read_order_node));
+    }
+    if (progress_journal) {
+        loader.set_progress_journal(*progress_journal);
+    }
 
     // Setup stats counting
-    std::unique_ptr<dorado::stats::StatsSampler> stats_sampler;
-    std::vector<dorado::stats::StatsReporter> stats_reporters;
-    using dorado::stats::make_stats_reporter;
-    stats_reporters.push_back(make_stats_reporter(basecaller_node));
-    if (mod_base_caller_node) {
-        stats_reporters.push_back(make_stats_reporter(*mod_base_caller_node));
+    std::unique_ptr<stats::MetricsServer> metrics_server;
+    if (metrics_port > 0) {
+        metrics_server = std::make_unique<stats::MetricsServer>(metrics_port, metrics_host);
     }
-    if (aligner) {
-        stats_reporters.push_back(make_stats_reporter(*aligner));
+    stats::CounterRegistry counters;
+    pipeline->register_counters(counters);
+    if (fallback_controller) {
+        // The main model's backlog is measured against the reads it has called.
+        if (auto handle = counters.find("BasecallerNode.called_reads_pushed")) {
+            fallback_controller->set_reads_called_source(
+                    [&counters, handle = *handle] { return int64_t(counters.value(handle)); });
+        }
+    }
+    std::unique_ptr<dorado::stats::StatsSampler> stats_sampler;
+    std::vector<dorado::stats::StatsReporter> stats_reporters = pipeline->get_stats_reporters();
+    stats_reporters.push_back(dorado::stats::make_stats_reporter(loader));
+    if (fallback_controller) {
+        stats_reporters.push_back(dorado::stats::make_stats_reporter(*fallback_controller));
     }
-    stats_reporters.push_back(make_stats_reporter(*bam_writer));
-    stats_reporters.push_back(make_stats_reporter(loader));
-    stats_reporters.push_back(make_stats_reporter(scaler_node));
-    stats_reporters.push_back(make_stats_reporter(read_filter_node));
 
     std::vector<dorado::stats::StatsCallable> stats_callables;
     ProgressTracker tracker(num_reads, duplex);
+    tracker.set_counters(counters);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    // Replayed runs don't use the GPUs.
+    std::unique_ptr<utils::GpuMonitor> gpu_monitor;
+    if (replay_model_outputs.empty()) {
+        gpu_monitor = utils::GpuMonitor::create(split_cpu_spill_device(device).first);
+    }
+    if (gpu_monitor) {
+        stats_reporters.push_back(dorado::stats::make_stats_reporter(*gpu_monitor));
+        tracker.add_warning_source([&gpu_monitor] { return gpu_monitor->throttling_warnings(); });
+    }
+#endif
     stats_callables.push_back(
-            [&tracker](const stats::NamedStats& stats) { tracker.update_progress_bar(stats); });
+            [&tracker](const stats::NamedStats&) { tracker.update_progress_bar(); });
+    if (metrics_server) {
+        stats_callables.push_back(metrics_server->get_stats_callable());
+    }
+    stats::PeakTracker memory_peaks;
+    if (memory_summary) {
+        stats_callables.push_back(memory_peaks.get_callable());
+    }
 
     constexpr auto kStatsPeriod = 100ms;
     stats_sampler = std::make_unique<dorado::stats::StatsSampler>(kStatsPeriod, stats_reporters,
@@ -213,13 +775,27 @@ void setup(std::vector<std::string> args,
     // End stats counting setup.
 
     // Run pipeline.
-    loader.load_reads(data_path, recursive_file_loading);
+    if (watch) {
+        constexpr auto kWatchPollInterval = 1s;
+        loader.watch_reads(data_path, recursive_file_loading, kWatchPollInterval,
+                           std::chrono::seconds(watch_timeout_s));
+    } else {
+        loader.load_reads(data_path, recursive_file_loading);
+    }
 
-    bam_writer->join();
+    // Wait for the pipeline to drain before the final stats are collected.
+    pipeline->terminate();
     // End pipeline
 
     stats_sampler->terminate();
     tracker.summarize();
+    if (memory_summary) {
+        tracker.summarize_peak_memory(memory_peaks);
+    }
+    if (recording) {
+        recording->save(record_model_outputs);
+        spdlog::info("> Recorded {} chunks to {}", recording->size(), record_model_outputs);
+    }
     if (!dump_stats_file.empty()) {
         std::ofstream stats_file(dump_stats_file);
         stats_sampler->dump_stats(stats_file,
@@ -236,13 +812,14 @@ int basecaller(int argc, char* argv[]) {
 
     parser.add_argument("model").help("the basecaller model to run.");
 
-    parser.add_argument("data").help("the data directory.");
+    parser.add_argument("data").help("the data directory, or an s3:// or gs:// URL of one.");
 
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     parser.add_argument("-x", "--device")
             .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
-                  "etc..")
+                  "etc.. CUDA devices may be followed by \",cpu:N\" for N CPU runners to take "
+                  "chunks the GPUs are too busy for.")
             .default_value(default_parameters.device);
 
     parser.add_argument("-l", "--read-ids")
@@ -255,6 +832,39 @@ int basecaller(int argc, char* argv[]) {
                   "processed again.")
             .default_value(std::string(""));
 
+    parser.add_argument("--progress-file")
+            .help("Record the reads written in this file. If it already exists, reads recorded "
+                  "in it by an earlier run are not processed again, so an interrupted run can be "
+                  "resumed by writing only the remaining reads to a new output file.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--progress-journal")
+            .help("Journal the POD5 read batches written in this file, syncing the output to disk "
+                  "at each checkpoint. If it already exists, batches journalled by an earlier run "
+                  "are skipped without being read, so an interrupted run can be resumed by "
+                  "writing only the remaining reads to a new output file. Implies "
+                  "--keep-read-order.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--trace")
+            .help("Write a trace of the pipeline's work to this file, as Chrome trace event JSON "
+                  "for viewing in Perfetto or chrome://tracing.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--keep-read-order")
+            .help("Write reads in the order they were loaded, so that the output is the same "
+                  "from run to run.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--watch")
+            .help("Keep basecalling new files as they are written to the data directory, e.g. "
+                  "during acquisition, until none have arrived for this many seconds. 0 to "
+                  "basecall only the files already there. Read groups are only added to the "
+                  "output header for files present at the start.")
+            .default_value(0)
+            .scan<'i', int>();
+
     parser.add_argument("-n", "--max-reads").default_value(0).scan<'i', int>();
 
     parser.add_argument("--min-qscore").default_value(0).scan<'i', int>();
@@ -267,7 +877,9 @@ int basecaller(int argc, char* argv[]) {
 
     parser.add_argument("-c", "--chunksize")
             .default_value(default_parameters.chunksize)
-            .scan<'i', int>();
+            .scan<'i', int>()
+            .help("if 0 a chunk size (and a batch size, if that is 0 too) will be selected by "
+                  "timing the model on the GPU. Other devices use the default.");
 
     parser.add_argument("-o", "--overlap")
             .default_value(default_parameters.overlap)
@@ -308,12 +920,122 @@ int basecaller(int argc, char* argv[]) {
             .help("Output in fastq format.")
             .default_value(false)
             .implicit_value(true);
+    parser.add_argument("--gzip")
+            .help("Compress fastq output with BGZF, which gzip can read, across the output "
+                  "threads.")
+            .default_value(false)
+            .implicit_value(true);
     parser.add_argument("--emit-sam")
             .help("Output in SAM format.")
             .default_value(false)
             .implicit_value(true);
+    parser.add_argument("--emit-cram")
+            .help("Output in CRAM format, with sequences encoded against the --reference FASTA, "
+                  "which must not be a prebuilt index.")
+            .default_value(false)
+            .implicit_value(true);
 
     parser.add_argument("--emit-moves").default_value(false).implicit_value(true);
+    parser.add_argument("--pack-moves")
+            .help("With --emit-moves, write the move table one bit per timestep in the mp tag, "
+                  "rather than a byte per timestep in the mv tag.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--emit-summary")
+            .help("Also write a sequencing summary of the reads to this file, as `dorado summary` "
+                  "would from the output, without reading it again.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--emit-arrow")
+            .help("Also write the called reads to this file as an Arrow IPC stream, for analyses "
+                  "to read in place without parsing. Can be a named pipe, or in /dev/shm.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--output-shards")
+            .help("Write the output to this many files, <output-prefix>_<shard>.<bam|sam|fastq|"
+                  "cram>, rather than to stdout, each with its own writer thread and compression "
+                  "pool. 0 to write to stdout.")
+            .default_value(0)
+            .scan<'i', int>();
+    parser.add_argument("--output-shard-by")
+            .help("How records are divided between output shards: read_id (by a hash of it), "
+                  "read_group, channel[:max_channel] (in equal ranges of the channels up to "
+                  "max_channel, 3000 by default), or barcode.")
+            .default_value(std::string("read_id"));
+    parser.add_argument("--output-prefix")
+            .help("Path prefix of the output shards, which may be an s3:// or gs:// URL to "
+                  "upload them to as they are written.")
+            .default_value(std::string("calls"));
+
+    parser.add_argument("--barcode-kits")
+            .help("A comma separated list of barcode kits to classify reads by, adding a BC tag to "
+                  "each read. With --output-shard-by barcode and one more shard than barcodes, "
+                  "each barcode is written to its own file and unclassified reads to shard 0.")
+            .default_value(std::string(""));
+    parser.add_argument("--trim-barcodes")
+            .help("Trim the barcodes found, and everything outside them, from the reads.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--barcode-both-ends")
+            .help("Only classify reads whose barcode is found at both ends.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--extra-models")
+            .help("A comma separated list of further basecaller models, for data which mixes "
+                  "sample rates. Each read is called by the model whose sample rate is closest to "
+                  "its own, with that model's scaling, and each model's runners get an equal "
+                  "share of the GPU memory. Reads are in their model's read groups.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--fallback-model")
+            .help("A faster basecaller model to call new reads with while the main model has "
+                  "more than --fallback-backlog seconds of reads waiting for it, such as to keep "
+                  "up with acquisition when calling live with --watch. Reads are in the read "
+                  "groups of the model which called them.")
+            .default_value(std::string(""));
+    parser.add_argument("--fallback-backlog")
+            .help("With --fallback-model, the seconds of calling waiting for the main model at "
+                  "which new reads go to the fallback model, until half of it is left.")
+            .default_value(60.f)
+            .scan<'f', float>();
+
+    parser.add_argument("--recall-model")
+            .help("A larger basecaller model to call the reads selected by --recall-min-length "
+                  "and --recall-max-qscore again with, after the first model has called every "
+                  "read. Recalled reads are in the recall model's read groups.")
+            .default_value(std::string(""));
+    parser.add_argument("--recall-min-length")
+            .help("Only recall reads of at least this many bases.")
+            .default_value(0)
+            .scan<'i', int>();
+    parser.add_argument("--recall-max-qscore")
+            .help("Only recall reads whose mean qscore is below this. 0 for no limit.")
+            .default_value(0.f)
+            .scan<'f', float>();
+
+    parser.add_argument("--call-on-target-only")
+            .help("Call only the first chunks of each read until they have been mapped to the "
+                  "reference, and the rest of the read only if it is on target. Off-target reads "
+                  "are written truncated to their first chunks.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--target-bed")
+            .help("With --call-on-target-only, a BED file of the target regions, rather than "
+                  "the whole reference.")
+            .default_value(std::string(""));
+    parser.add_argument("--target-prefix-chunks")
+            .help("With --call-on-target-only, the number of chunks called before mapping.")
+            .default_value(2)
+            .scan<'i', int>();
+
+    parser.add_argument("--basecall-cache")
+            .help("Keep the calls of reads in the cache directory, and take the calls of reads "
+                  "already called there with the same model and settings rather than calling "
+                  "them again.")
+            .default_value(false)
+            .implicit_value(true);
 
     parser.add_argument("--reference")
             .help("Path to reference for alignment.")
@@ -327,6 +1049,20 @@ int basecaller(int argc, char* argv[]) {
             .default_value(10)
             .scan<'i', int>();
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
+    parser.add_argument("--sort")
+            .help("Write alignments sorted by coordinate, as samtools sort does. Sharded BAM "
+                  "output is indexed.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--sort-memory")
+            .help("Memory to hold alignments in while sorting, before spilling them to "
+                  "temporary files.")
+            .default_value(std::string("4G"));
+    parser.add_argument("--compression-level")
+            .help("Compression level of BAM and CRAM output, from 1 (fastest) to 9. 1 suits "
+                  "outputs which will be re-sorted or converted. -1 for htslib's default.")
+            .default_value(-1)
+            .scan<'i', int>();
 
     argparse::ArgumentParser internal_parser;
 
@@ -346,7 +1082,18 @@ int basecaller(int argc, char* argv[]) {
         utils::SetDebugLogging();
     }
 
+    if (internal_parser.get<bool>("--clear_cache")) {
+        utils::clear_cache();
+    }
+
     auto model = parser.get<std::string>("model");
+    std::vector<std::string> extra_models;
+    std::istringstream extra_models_list(parser.get<std::string>("--extra-models"));
+    for (std::string extra_model; std::getline(extra_models_list, extra_model, ',');) {
+        if (!extra_model.empty()) {
+            extra_models.push_back(extra_model);
+        }
+    }
     auto mod_bases = parser.get<std::vector<std::string>>("--modified-bases");
     auto mod_bases_models = parser.get<std::string>("--modified-bases-models");
 
@@ -374,40 +1121,134 @@ int basecaller(int argc, char* argv[]) {
 
     auto emit_fastq = parser.get<bool>("--emit-fastq");
     auto emit_sam = parser.get<bool>("--emit-sam");
+    auto emit_cram = parser.get<bool>("--emit-cram");
 
-    if (emit_fastq && emit_sam) {
-        throw std::runtime_error("Only one of --emit-{fastq, sam} can be set (or none).");
+    if (int(emit_fastq) + int(emit_sam) + int(emit_cram) > 1) {
+        throw std::runtime_error("Only one of --emit-{fastq, sam, cram} can be set (or none).");
+    }
+    if (emit_cram && parser.get<std::string>("--reference").empty()) {
+        throw std::runtime_error("--emit-cram needs a --reference.");
     }
 
+    const auto num_output_shards = parser.get<int>("--output-shards");
+    if (parser.get<bool>("--gzip") && !emit_fastq) {
+        throw std::runtime_error("--gzip can only be set with --emit-fastq.");
+    }
     if (emit_fastq) {
-        output_mode = HtsWriter::OutputMode::FASTQ;
+        output_mode = parser.get<bool>("--gzip") ? HtsWriter::OutputMode::FASTQ_GZ
+                                                 : HtsWriter::OutputMode::FASTQ;
+    } else if (emit_cram) {
+        output_mode = HtsWriter::OutputMode::CRAM;
+    } else if (num_output_shards > 0) {
+        // Shards are files, whatever stdout is.
+        output_mode = emit_sam ? HtsWriter::OutputMode::SAM : HtsWriter::OutputMode::BAM;
     } else if (emit_sam || utils::is_fd_tty(stdout)) {
         output_mode = HtsWriter::OutputMode::SAM;
     } else if (utils::is_fd_pipe(stdout)) {
-        output_mode = HtsWriter::OutputMode::UBAM;
+        output_mode = internal_parser.get<bool>("--stream_ubam")
+                              ? HtsWriter::OutputMode::UBAM_STREAM
+                              : HtsWriter::OutputMode::UBAM;
+    }
+
+    const auto trace_path = parser.get<std::string>("--trace");
+    if (!trace_path.empty()) {
+        utils::trace::start(trace_path);
+    }
+
+    size_t sort_memory_bytes = 0;
+    if (parser.get<bool>("--sort")) {
+        if (parser.get<std::string>("--reference").empty() || emit_fastq) {
+            spdlog::error("--sort needs --reference, and SAM or BAM output.");
+            std::exit(EXIT_FAILURE);
+        }
+        if (!parser.get<std::string>("--progress-file").empty() ||
+            !parser.get<std::string>("--progress-journal").empty()) {
+            spdlog::error("--sort can't be used with --progress-file or --progress-journal.");
+            std::exit(EXIT_FAILURE);
+        }
+        // Sorted records are written by htslib, since the stream writer can't be sorted.
+        if (output_mode == HtsWriter::OutputMode::UBAM_STREAM) {
+            output_mode = HtsWriter::OutputMode::UBAM;
+        }
+        sort_memory_bytes =
+                std::max(utils::parse_string_to_size(parser.get<std::string>("--sort-memory")),
+                         uint64_t(1));
     }
 
     spdlog::info("> Creating basecall pipeline");
 
     try {
-        setup(args, model, parser.get<std::string>("data"), mod_bases_models,
+        BarcodeClassifierSettings barcode_settings;
+        barcode_settings.kits =
+                utils::parse_barcode_kits(parser.get<std::string>("--barcode-kits"));
+        barcode_settings.trim = parser.get<bool>("--trim-barcodes");
+        barcode_settings.require_both_ends = parser.get<bool>("--barcode-both-ends");
+
+        RecallSelection recall_selection;
+        recall_selection.min_length = std::max(parser.get<int>("--recall-min-length"), 0);
+        if (parser.get<float>("--recall-max-qscore") > 0.f) {
+            recall_selection.max_mean_qscore = parser.get<float>("--recall-max-qscore");
+        }
+
+        setup(args, model, extra_models, parser.get<std::string>("--fallback-model"),
+              parser.get<float>("--fallback-backlog"), parser.get<std::string>("data"),
+              mod_bases_models,
               parser.get<std::string>("-x"), parser.get<std::string>("--reference"),
               parser.get<int>("-c"), parser.get<int>("-o"), parser.get<int>("-b"),
               default_parameters.num_runners, default_parameters.remora_batchsize,
               default_parameters.remora_threads, methylation_threshold, output_mode,
-              parser.get<bool>("--emit-moves"), parser.get<int>("--max-reads"),
+              parser.get<bool>("--emit-moves"), parser.get<bool>("--pack-moves"),
+              parser.get<int>("--max-reads"),
               parser.get<int>("--min-qscore"), parser.get<std::string>("--read-ids"),
               parser.get<bool>("--recursive"), parser.get<int>("k"), parser.get<int>("w"),
               utils::parse_string_to_size(parser.get<std::string>("I")),
               internal_parser.get<bool>("--skip-model-compatibility-check"),
               internal_parser.get<std::string>("--dump_stats_file"),
               internal_parser.get<std::string>("--dump_stats_filter"),
-              parser.get<std::string>("--resume-from"));
+              internal_parser.get<bool>("--memory_summary"),
+              internal_parser.get<int>("--metrics_port"),
+              internal_parser.get<std::string>("--metrics_host"),
+              internal_parser.get<int>("--cuda_streams_per_device"),
+              internal_parser.get<bool>("--cuda_graphs"),
+              internal_parser.get<bool>("--cuda_workspace_arena"),
+              internal_parser.get<int>("--short_read_chunk_sizes"),
+              parse_chunk_scheduling_policy(internal_parser.get<std::string>("--chunk_scheduling")),
+              parser.get<std::string>("--resume-from"), parser.get<std::string>("--progress-file"),
+              parser.get<std::string>("--progress-journal"), parser.get<int>("--watch"),
+              parser.get<std::string>("--emit-summary"), parser.get<std::string>("--emit-arrow"),
+              std::max(num_output_shards, 0),
+              parse_output_shard_policy(parser.get<std::string>("--output-shard-by")),
+              parser.get<std::string>("--output-prefix"),
+              internal_parser.get<bool>("--modbase_signal_on_device"),
+              internal_parser.get<int>("--modbase_batch_timeout_ms"),
+              internal_parser.get<bool>("--modbase_kmers_on_device"),
+              internal_parser.get<bool>("--modbase_fuse_models"),
+              internal_parser.get<bool>("--metal_viterbi_decode"),
+              internal_parser.get<bool>("--decode_kept_steps_only"),
+              utils::parse_string_to_size(
+                      internal_parser.get<std::string>("--max_working_reads_bytes")),
+              internal_parser.get<float>("--min_signal_stdev_pa"),
+              internal_parser.get<bool>("--trim_adapter_tail"),
+              internal_parser.get<bool>("--scale_on_device"),
+              internal_parser.get<int>("--adaptive_batch_latency_ms"),
+              internal_parser.get<bool>("--pack_short_reads"),
+              internal_parser.get<int>("--aligner_extension_band"),
+              parser.get<bool>("--keep-read-order"), sort_memory_bytes,
+              parser.get<int>("--compression-level"), barcode_settings,
+              parser.get<std::string>("--recall-model"), recall_selection,
+              parser.get<bool>("--call-on-target-only"), parser.get<std::string>("--target-bed"),
+              std::max(parser.get<int>("--target-prefix-chunks"), 1),
+              parser.get<bool>("--basecall-cache"),
+              internal_parser.get<std::string>("--record_model_outputs"),
+              internal_parser.get<std::string>("--replay_model_outputs"),
+              internal_parser.get<float>("--replay_chunks_per_s"));
     } catch (const std::exception& e) {
         spdlog::error("{}", e.what());
+        utils::trace::stop();
         return 1;
     }
 
+    utils::trace::stop();
     spdlog::info("> Finished");
     return 0;
 }
@@ -1,16 +1,580 @@
+#include "../data_loader/DataLoader.h"
+#include "../modbase/remora_encoder.h"
+#include "../read_pipeline/FakeDataLoader.h"
+#include "../read_pipeline/NullNode.h"
+#include "../read_pipeline/PairingNode.h"
+#include "../read_pipeline/Pipeline.h"
+#include "../read_pipeline/ReadFilterNode.h"
+#include "../read_pipeline/ReadPipeline.h"
+#include "../read_pipeline/ReadToBamTypeNode.h"
+#include "../read_pipeline/ScalerNode.h"
+#include "../read_pipeline/SignalFilterNode.h"
+#include "../utils/AsyncQueue.h"
+#include "../utils/memory_utils.h"
+#include "../utils/parameters.h"
+#include "../utils/sequence_utils.h"
+#include "../utils/stats.h"
+#include "../utils/stitch.h"
 #include "../utils/tensor_utils.h"
 #include "Version.h"
 
 #include <argparse.hpp>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 namespace dorado {
 
-int benchmark(int argc, char* argv[]) {
-    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+namespace {
+
+// Shape of the synthetic basecalls, roughly that of a 4kHz DNA model.
+constexpr int kModelStride = 5;
+constexpr int kChunkSize = 4000;
+constexpr int kChunkOverlap = 500;
+
+// Work done by one timed stage.  Rates are only reported for the counts which are set.
+struct StageResult {
+    std::string name;
+    double seconds = 0;
+    int64_t num_reads = 0;
+    int64_t num_samples = 0;
+    int64_t num_bases = 0;
+};
+
+// A synthetic read and the basecall chunks it would have been split into.
+struct BenchmarkRead {
+    torch::Tensor raw_signal;  // int16, as loaded from file
+    std::shared_ptr<Read> read;
+};
+
+std::vector<BenchmarkRead> make_reads(int num_reads, int read_length, std::mt19937& rng) {
+    std::normal_distribution<float> current(500.f, 60.f);
+    std::bernoulli_distribution move(0.4);
+    std::uniform_int_distribution<int> base(0, 3);
+    const char bases[] = "ACGT";
+
+    // Chunk offsets must be multiples of the stride for stitching.
+    read_length = std::max(kChunkSize, read_length / kModelStride * kModelStride);
+
+    std::vector<BenchmarkRead> reads;
+    reads.reserve(num_reads);
+    for (int i = 0; i < num_reads; ++i) {
+        std::vector<int16_t> samples(read_length);
+        std::generate(samples.begin(), samples.end(),
+                      [&] { return static_cast<int16_t>(current(rng)); });
+
+        auto read = std::make_shared<Read>();
+        read->read_id = "benchmark_read_" + std::to_string(i);
+        read->run_id = "benchmark";
+        read->model_name = "benchmark_model";
+        read->sample_rate = 4000;
+        read->scaling = 1.f;
+        read->offset = 0.f;
+        read->num_trimmed_samples = 0;
+        read->is_duplex = false;
+
+        std::vector<size_t> offsets{0};
+        const size_t last_offset = read_length - kChunkSize;
+        while (offsets.back() < last_offset) {
+            offsets.push_back(std::min(offsets.back() + kChunkSize - kChunkOverlap, last_offset));
+        }
+        for (size_t idx = 0; idx < offsets.size(); ++idx) {
+            auto chunk = std::make_shared<Chunk>(read.get(), offsets[idx], idx, kChunkSize);
+            chunk->moves.resize(kChunkSize / kModelStride);
+            std::generate(chunk->moves.begin(), chunk->moves.end(),
+                          [&] { return static_cast<uint8_t>(move(rng)); });
+            // The first block always emits a base.
+            chunk->moves[0] = 1;
+            const auto num_bases = std::accumulate(chunk->moves.begin(), chunk->moves.end(), 0);
+            chunk->seq.resize(num_bases);
+            std::generate(chunk->seq.begin(), chunk->seq.end(), [&] { return bases[base(rng)]; });
+            chunk->qstring.assign(num_bases, '5');
+            read->called_chunks.push_back(std::move(chunk));
+        }
+        read->num_chunks = read->called_chunks.size();
+
+        auto raw_signal = torch::from_blob(samples.data(), {read_length}, torch::kInt16).clone();
+        read->raw_data = raw_signal.to(torch::kFloat16);
+        reads.push_back({std::move(raw_signal), std::move(read)});
+    }
+    return reads;
+}
+
+template <typename Fn>
+double time_seconds(Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int64_t total_samples(const std::vector<BenchmarkRead>& reads) {
+    int64_t samples = 0;
+    for (const auto& r : reads) {
+        samples += r.raw_signal.size(0);
+    }
+    return samples;
+}
+
+int64_t total_bases(const std::vector<BenchmarkRead>& reads) {
+    int64_t bases = 0;
+    for (const auto& r : reads) {
+        bases += r.read->seq.size();
+    }
+    return bases;
+}
+
+// Counts the reads, and their samples, reaching the end of a pipeline, and discards them.
+class CountingSink : public MessageSink {
+public:
+    CountingSink() : MessageSink(1000), m_worker(&CountingSink::worker_thread, this) {}
+    ~CountingSink() {
+        terminate();
+        join();
+    }
+    void join() override {
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+    int64_t get_count() const { return m_count; }
+    int64_t get_samples() const { return m_samples; }
+
+private:
+    void worker_thread() {
+        Message message;
+        while (m_work_queue.try_pop(message)) {
+            ++m_count;
+            if (const auto* read = std::get_if<std::shared_ptr<Read>>(&message)) {
+                m_samples += (*read)->raw_data.size(0);
+            }
+        }
+    }
+
+    std::atomic<int64_t> m_count{0};
+    std::atomic<int64_t> m_samples{0};
+    std::thread m_worker;
+};
+
+StageResult benchmark_async_queue() {
+    constexpr int64_t kNumMessages = 1000000;
+    AsyncQueue<int64_t> queue(1000);
+    StageResult result{"async_queue"};
+    result.seconds = time_seconds([&] {
+        std::thread producer([&] {
+            for (int64_t i = 0; i < kNumMessages; ++i) {
+                queue.try_push(std::move(i));
+            }
+            queue.terminate();
+        });
+        int64_t item;
+        while (queue.try_pop(item)) {
+        }
+        producer.join();
+    });
+    result.num_reads = kNumMessages;
+    return result;
+}
+
+std::vector<StageResult> benchmark_quantiles(const std::vector<BenchmarkRead>& reads) {
+    const auto q = torch::tensor({0.2, 0.9}, {torch::kFloat32});
+    const auto samples = total_samples(reads);
+
+    std::vector<StageResult> results;
+    const std::vector<std::pair<std::string, std::function<torch::Tensor(const torch::Tensor&)>>>
+            methods{
+                    {"quantile_torch",
+                     [&](const torch::Tensor& x) {
+                         return torch::quantile(x.to(torch::kFloat32), q);
+                     }},
+                    {"quantile_nth_element",
+                     [&](const torch::Tensor& x) {
+                         return utils::quantile(x.to(torch::kFloat32), q);
+                     }},
+                    {"quantile_counting",
+                     [&](const torch::Tensor& x) { return utils::quantile_counting(x, q); }},
+            };
+    for (const auto& [name, method] : methods) {
+        StageResult result{name};
+        result.seconds = time_seconds([&, &method = method] {
+            for (const auto& r : reads) {
+                method(r.raw_signal);
+            }
+        });
+        result.num_reads = reads.size();
+        result.num_samples = samples;
+        results.push_back(result);
+    }
+    return results;
+}
+
+StageResult benchmark_scaler(const std::vector<BenchmarkRead>& reads, int num_threads) {
+    StageResult result{"scaler_node"};
+    CountingSink sink;
+    {
+        ScalerNode scaler(sink, SignalNormalisationParams{}, num_threads);
+        // Each read gets its own copy so that the stage sees what DataLoader produces.
+        std::vector<std::shared_ptr<Read>> inputs;
+        for (const auto& r : reads) {
+            auto read = std::make_shared<Read>();
+            read->read_id = r.read->read_id;
+            read->raw_data = r.raw_signal.clone();
+            read->scaling = r.read->scaling;
+            read->offset = r.read->offset;
+            inputs.push_back(std::move(read));
+        }
+        result.seconds = time_seconds([&] {
+            for (auto& read : inputs) {
+                scaler.push_message(std::move(read));
+            }
+            scaler.terminate();
+            scaler.join();
+        });
+    }
+    sink.join();
+    result.num_reads = sink.get_count();
+    result.num_samples = total_samples(reads);
+    return result;
+}
+
+StageResult benchmark_stitching(const std::vector<BenchmarkRead>& reads) {
+    StageResult result{"stitching"};
+    result.seconds = time_seconds([&] {
+        for (const auto& r : reads) {
+            utils::stitch_chunks(r.read);
+        }
+    });
+    result.num_reads = reads.size();
+    result.num_samples = total_samples(reads);
+    result.num_bases = total_bases(reads);
+    return result;
+}
+
+StageResult benchmark_remora_encoder(const std::vector<BenchmarkRead>& reads) {
+    // Context of a typical CpG model.
+    constexpr size_t kContextSamples = 200;
+    constexpr int kBasesBefore = 2;
+    constexpr int kBasesAfter = 2;
+
+    StageResult result{"remora_encoder"};
+    result.seconds = time_seconds([&] {
+        for (const auto& r : reads) {
+            const auto& read = *r.read;
+            const auto sequence_ints = utils::sequence_to_ints(read.seq);
+            const auto seq_to_sig_map = utils::moves_to_map(read.moves, kModelStride,
+                                                            r.raw_signal.size(0),
+                                                            read.seq.size() + 1);
+            RemoraEncoder encoder(kModelStride, kContextSamples, kBasesBefore, kBasesAfter);
+            encoder.init(sequence_ints, seq_to_sig_map);
+            for (size_t pos = 0; pos + 1 < read.seq.size(); ++pos) {
+                if (read.seq[pos] == 'C' && read.seq[pos + 1] == 'G') {
+                    encoder.get_context(pos);
+                }
+            }
+        }
+    });
+    result.num_reads = reads.size();
+    result.num_samples = total_samples(reads);
+    result.num_bases = total_bases(reads);
+    return result;
+}
+
+// Loads the read files in data_path repeats times, optionally scaling the reads as the
+// basecaller would, so the stage covers file decoding as well as the nodes.
+StageResult benchmark_loading(const std::string& data_path,
+                              int repeats,
+                              int num_threads,
+                              bool scale) {
+    StageResult result{scale ? "load_and_scale" : "load"};
+    for (int i = 0; i < repeats; ++i) {
+        CountingSink sink;
+        std::unique_ptr<ScalerNode> scaler;
+        if (scale) {
+            scaler = std::make_unique<ScalerNode>(sink, SignalNormalisationParams{}, num_threads);
+        }
+        MessageSink& loader_sink = scale ? static_cast<MessageSink&>(*scaler) : sink;
+        DataLoader loader(loader_sink, "cpu", size_t(num_threads));
+        result.seconds += time_seconds([&] {
+            // The loader terminates its sink once every file is loaded.
+            loader.load_reads(data_path);
+            if (scaler) {
+                scaler->join();
+                sink.terminate();
+            }
+            sink.join();
+        });
+        result.num_reads += sink.get_count();
+        result.num_samples += sink.get_samples();
+    }
+    return result;
+}
+
+StageResult benchmark_sam_records(const std::vector<BenchmarkRead>& reads) {
+    StageResult result{"sam_records"};
+    result.seconds = time_seconds([&] {
+        for (const auto& r : reads) {
+            r.read->extract_sam_lines(true);
+        }
+    });
+    result.num_reads = reads.size();
+    result.num_samples = total_samples(reads);
+    result.num_bases = total_bases(reads);
+    return result;
+}
+
+void print_results(const std::vector<StageResult>& results) {
+    std::cerr << std::left << std::setw(22) << "stage" << std::right << std::setw(12) << "ms"
+              << std::setw(14) << "reads/s" << std::setw(14) << "samples/s" << std::setw(12)
+              << "ns/base" << std::endl;
+    for (const auto& r : results) {
+        std::cerr << std::left << std::setw(22) << r.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << r.seconds * 1000
+                  << std::setprecision(0) << std::setw(14)
+                  << (r.num_reads ? r.num_reads / r.seconds : 0) << std::setw(14)
+                  << (r.num_samples ? r.num_samples / r.seconds : 0) << std::setprecision(2)
+                  << std::setw(12) << (r.num_bases ? r.seconds * 1e9 / r.num_bases : 0)
+                  << std::endl;
+    }
+}
+
+// A recorded measurement which a run is expected to match: reads_per_s and samples_per_s of a
+// stage, which may fall by at most the tolerance, or the process's peak_rss_bytes, which may
+// rise by at most the tolerance.
+struct BaselineEntry {
+    std::string stage;
+    std::string metric;
+    double value = 0;
+};
+
+std::optional<double> measured_value(const std::vector<StageResult>& results,
+                                     size_t peak_rss,
+                                     const BaselineEntry& entry) {
+    if (entry.stage == "process" && entry.metric == "peak_rss_bytes") {
+        return peak_rss ? std::optional<double>(double(peak_rss)) : std::nullopt;
+    }
+    for (const auto& r : results) {
+        if (r.name != entry.stage || r.seconds <= 0) {
+            continue;
+        }
+        if (entry.metric == "reads_per_s" && r.num_reads) {
+            return r.num_reads / r.seconds;
+        }
+        if (entry.metric == "samples_per_s" && r.num_samples) {
+            return r.num_samples / r.seconds;
+        }
+    }
+    return std::nullopt;
+}
+
+// Baselines are stored as lines of "<stage> <metric> <value>", with # starting a comment.
+std::vector<BaselineEntry> read_baseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Couldn't open baseline " + path);
+    }
+    std::vector<BaselineEntry> baseline;
+    for (std::string line; std::getline(in, line);) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        BaselineEntry entry;
+        if (fields >> entry.stage >> entry.metric >> entry.value) {
+            baseline.push_back(std::move(entry));
+        }
+    }
+    return baseline;
+}
+
+void write_baseline(const std::string& path,
+                    const std::vector<StageResult>& results,
+                    size_t peak_rss) {
+    std::ofstream out(path);
+    out << "# dorado benchmark baseline, recorded by " << DORADO_VERSION << "\n";
+    for (const auto& r : results) {
+        for (const auto& metric : {"reads_per_s", "samples_per_s"}) {
+            if (const auto value = measured_value(results, peak_rss, {r.name, metric})) {
+                out << r.name << " " << metric << " " << std::fixed << std::setprecision(0)
+                    << *value << "\n";
+            }
+        }
+    }
+    if (peak_rss) {
+        out << "process peak_rss_bytes " << peak_rss << "\n";
+    }
+}
+
+// Describes each measurement which is worse than its baseline by more than the tolerance.
+std::vector<std::string> find_regressions(const std::vector<StageResult>& results,
+                                          size_t peak_rss,
+                                          const std::vector<BaselineEntry>& baseline,
+                                          double tolerance) {
+    std::vector<std::string> regressions;
+    for (const auto& entry : baseline) {
+        const auto value = measured_value(results, peak_rss, entry);
+        if (!value) {
+            continue;
+        }
+        const bool lower_is_better = entry.metric == "peak_rss_bytes";
+        const bool regressed = lower_is_better ? *value > entry.value * (1 + tolerance)
+                                               : *value < entry.value * (1 - tolerance);
+        if (regressed) {
+            std::ostringstream description;
+            description << std::fixed << std::setprecision(0) << entry.stage << " "
+                        << entry.metric << " " << *value << " vs baseline " << entry.value;
+            regressions.push_back(description.str());
+        }
+    }
+    return regressions;
+}
+
+void write_json(std::ostream& out,
+                const std::vector<StageResult>& results,
+                size_t peak_rss,
+                const std::vector<std::string>& regressions) {
+    out << "{\n  \"version\": \"" << DORADO_VERSION << "\",\n  \"peak_rss_bytes\": " << peak_rss
+        << ",\n  \"stages\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << r.name
+            << "\", \"seconds\": " << r.seconds << ", \"reads\": " << r.num_reads
+            << ", \"samples\": " << r.num_samples << ", \"bases\": " << r.num_bases;
+        if (r.num_reads) {
+            out << ", \"reads_per_s\": " << r.num_reads / r.seconds;
+        }
+        if (r.num_samples) {
+            out << ", \"samples_per_s\": " << r.num_samples / r.seconds;
+        }
+        if (r.num_bases) {
+            out << ", \"ns_per_base\": " << r.seconds * 1e9 / r.num_bases;
+        }
+        out << "}";
+    }
+    out << "\n  ],\n  \"regressions\": [";
+    for (size_t i = 0; i < regressions.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << regressions[i] << "\"";
+    }
+    out << (regressions.empty() ? "" : "\n  ") << "]\n}\n";
+}
+
+// Adds the named node to the pipeline, in front of sink.
+NodeHandle add_pipeline_node(PipelineDescriptor& pipeline_desc,
+                                                 const std::string& name,
+                                                 NodeHandle sink,
+                                                 int num_threads) {
+    if (name == "scaler") {
+        return pipeline_desc.add_node<ScalerNode>({sink}, SignalNormalisationParams{},
+                                                  num_threads);
+    }
+    if (name == "signal_filter") {
+        return pipeline_desc.add_node<SignalFilterNode>(
+                {sink}, utils::default_parameters.min_seqeuence_length,
+                utils::default_parameters.max_bases_per_second, 0.f, num_threads);
+    }
+    if (name == "read_filter") {
+        return pipeline_desc.add_node<ReadFilterNode>(
+                {sink}, size_t(0), utils::default_parameters.min_seqeuence_length,
+                std::unordered_set<std::string>{}, size_t(num_threads));
+    }
+    if (name == "pairing") {
+        return pipeline_desc.add_node<PairingNode>({sink}, nullptr, num_threads);
+    }
+    if (name == "read_to_bam") {
+        return pipeline_desc.add_node<ReadToBamType>({sink}, true, false, size_t(num_threads));
+    }
+    throw std::runtime_error("Unknown pipeline node " + name +
+                             ", expected scaler, signal_filter, read_filter, pairing or "
+                             "read_to_bam.");
+}
+
+std::vector<std::string> split_node_list(const std::string& node_list) {
+    std::vector<std::string> nodes;
+    std::istringstream stream(node_list);
+    for (std::string node; std::getline(stream, node, ',');) {
+        if (!node.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+
+// A pipeline of the named nodes, in order, ending in a NullNode.  first_node is set to the
+// node reads should be pushed to.
+std::unique_ptr<Pipeline> create_node_pipeline(const std::vector<std::string>& nodes,
+                                               int num_threads,
+                                               NodeHandle& first_node) {
+    PipelineDescriptor pipeline_desc;
+    first_node = pipeline_desc.add_node<NullNode>({});
+    for (auto node = nodes.rbegin(); node != nodes.rend(); ++node) {
+        first_node = add_pipeline_node(pipeline_desc, *node, first_node, num_threads);
+    }
+    return Pipeline::create(std::move(pipeline_desc));
+}
+
+// Loads a pipeline of the chosen nodes with synthetic reads, ending in a NullNode, and
+// reports the rate they were taken at and each node's final stats.
+int benchmark_pipeline(int argc, char* argv[]) {
+    argparse::ArgumentParser parser("dorado benchmark pipeline", DORADO_VERSION,
+                                    argparse::default_arguments::help);
+    parser.add_argument("--nodes")
+            .help("comma separated nodes to load, in pipeline order, from scaler, "
+                  "signal_filter, read_filter, pairing and read_to_bam.")
+            .default_value(std::string("scaler,signal_filter"));
+    parser.add_argument("-n", "--num-reads")
+            .help("number of synthetic reads to load.")
+            .default_value(100000)
+            .scan<'i', int>();
+    parser.add_argument("-l", "--read-length")
+            .help("median read length in samples.")
+            .default_value(40000)
+            .scan<'i', int>();
+    parser.add_argument("--read-length-sigma")
+            .help("standard deviation of the log of the read lengths. 0 for a fixed length.")
+            .default_value(0.f)
+            .scan<'f', float>();
+    parser.add_argument("--read-rate")
+            .help("reads loaded per second. 0 for as fast as the pipeline takes them.")
+            .default_value(0.f)
+            .scan<'f', float>();
+    parser.add_argument("--channels")
+            .help("number of channels the reads are spread over.")
+            .default_value(512)
+            .scan<'i', int>();
+    parser.add_argument("--duplex-fraction")
+            .help("fraction of reads followed on their channel by their complement.")
+            .default_value(0.f)
+            .scan<'f', float>();
+    parser.add_argument("--current-stdev")
+            .help("standard deviation of the signal in pA.")
+            .default_value(15.f)
+            .scan<'f', float>();
+    parser.add_argument("--basecalled")
+            .help("give the reads random basecalls. Implied by read_filter, pairing and "
+                  "read_to_bam.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("-t", "--threads")
+            .help("number of worker threads for each node.")
+            .default_value(4)
+            .scan<'i', int>();
+    parser.add_argument("--dump-stats")
+            .help("also write the nodes' stats, sampled every 100ms, to this file.")
+            .default_value(std::string(""));
 
     try {
         parser.parse_args(argc, argv);
@@ -20,52 +584,423 @@ int benchmark(int argc, char* argv[]) {
         std::exit(1);
     }
 
-    std::vector<size_t> sizes{1000, 1000, 2000, 3000, 4000, 10000, 100000, 1000000, 10000000};
+    const auto nodes = split_node_list(parser.get<std::string>("--nodes"));
+
+    FakeReadSettings settings;
+    settings.median_read_samples = size_t(std::max(parser.get<int>("--read-length"), 1));
+    settings.read_samples_sigma = std::max(parser.get<float>("--read-length-sigma"), 0.f);
+    settings.reads_per_s = std::max(parser.get<float>("--read-rate"), 0.f);
+    settings.num_channels = parser.get<int>("--channels");
+    settings.duplex_fraction = std::clamp(parser.get<float>("--duplex-fraction"), 0.f, 1.f);
+    settings.current_stdev_pa = parser.get<float>("--current-stdev");
+    settings.basecalled = parser.get<bool>("--basecalled");
+    for (const auto& node : nodes) {
+        settings.basecalled |= node == "read_filter" || node == "pairing" || node == "read_to_bam";
+    }
+    const auto num_reads = parser.get<int>("--num-reads");
+    const auto num_threads = std::max(parser.get<int>("--threads"), 1);
+    const auto stats_file = parser.get<std::string>("--dump-stats");
+
+    std::unique_ptr<Pipeline> pipeline;
+    NodeHandle first_node;
+    try {
+        pipeline = create_node_pipeline(nodes, num_threads, first_node);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<stats::StatsSampler> stats_sampler;
+    if (!stats_file.empty()) {
+        using namespace std::chrono_literals;
+        stats_sampler = std::make_unique<stats::StatsSampler>(
+                100ms, pipeline->get_stats_reporters(), std::vector<stats::StatsCallable>{});
+    }
+
+    FakeDataLoader loader(pipeline->get_node(first_node), settings);
+    const auto seconds = time_seconds([&] {
+        loader.load_reads(num_reads);
+        pipeline->terminate();
+    });
+
+    std::cerr << std::fixed << std::setprecision(2) << "loaded " << num_reads << " reads in "
+              << seconds << " s: " << std::setprecision(0) << num_reads / seconds
+              << " reads/s, " << double(num_reads) * double(settings.median_read_samples) / seconds
+              << " samples/s at the median length" << std::endl;
+    // Sorted so that each node's stats are together.
+    std::map<std::string, double> final_stats;
+    for (const auto& reporter : pipeline->get_stats_reporters()) {
+        const auto [name, stats] = reporter();
+        for (const auto& [stat, value] : stats) {
+            final_stats[name + "." + stat] = value;
+        }
+    }
+    for (const auto& [stat, value] : final_stats) {
+        std::cerr << std::left << std::setw(48) << stat << std::right << std::setprecision(2)
+                  << value << std::endl;
+    }
 
-    for (auto n : sizes) {
-        std::cerr << "samples : " << n << std::endl;
+    if (stats_sampler) {
+        stats_sampler->terminate();
+        std::ofstream out(stats_file);
+        stats_sampler->dump_stats(out);
+    }
+    return 0;
+}
 
-        // generate some input
-        auto x = torch::randint(0, 2047, n);
-        auto q = torch::tensor({0.2, 0.9}, {torch::kFloat32});
+// One sample of a soak run, taken by the StatsSampler: the process's RSS, the reads loaded so
+// far, and the bytes held by each node which reports them, as <node>.<stat>_bytes.
+struct SoakSample {
+    double elapsed_s = 0;
+    double rss_bytes = 0;
+    double reads_loaded = 0;
+    std::map<std::string, double> node_bytes;
+};
 
-        // torch::quantile
-        auto start = std::chrono::system_clock::now();
-        auto res = torch::quantile(x, q);
-        auto end = std::chrono::system_clock::now();
+// Memory which grows by less than this is never reported, however large the relative growth,
+// so that small and noisy baselines don't fail a run.
+constexpr double kMinSoakMemoryGrowthBytes = 16.0 * 1024 * 1024;
 
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+// Compares the start and end of a soak run, from the samples taken after the warmup: the mean
+// of each memory measurement over the first and last quarter of them, and the rate reads were
+// loaded at over each.  Describes each check in report, and returns the failures.
+std::vector<std::string> check_soak_samples(const std::vector<SoakSample>& samples,
+                                            double max_memory_growth,
+                                            double max_throughput_drift,
+                                            std::vector<std::string>& report) {
+    const size_t window = samples.size() / 4;
+    const auto first = samples.begin();
+    const auto last = samples.end() - window;
 
-        std::cerr << "torch:quant  "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl;
+    auto mean = [window](auto begin, auto value) {
+        double sum = 0;
+        for (auto it = begin; it != begin + window; ++it) {
+            sum += value(*it);
+        }
+        return sum / window;
+    };
+    auto rate = [window](auto begin) {
+        const auto& start = *begin;
+        const auto& end = *(begin + window - 1);
+        return end.elapsed_s > start.elapsed_s
+                       ? (end.reads_loaded - start.reads_loaded) / (end.elapsed_s - start.elapsed_s)
+                       : 0.;
+    };
 
-        // nth_element
-        start = std::chrono::system_clock::now();
-        res = utils::quantile(x, q);
-        end = std::chrono::system_clock::now();
+    std::vector<std::string> failures;
+    auto check = [&](const std::string& name, double start, double end, bool failed) {
+        std::ostringstream description;
+        description << std::fixed << std::setprecision(0) << name << " " << start << " -> "
+                    << end;
+        if (start > 0) {
+            description << std::setprecision(1) << " (" << std::showpos
+                        << (end / start - 1) * 100 << std::noshowpos << "%)";
+        }
+        report.push_back(description.str());
+        if (failed) {
+            failures.push_back(description.str());
+        }
+    };
+    auto check_memory = [&](const std::string& name, double start, double end) {
+        check(name, start, end,
+              end - start > kMinSoakMemoryGrowthBytes && end > start * (1 + max_memory_growth));
+    };
 
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    check_memory("rss_bytes", mean(first, [](const SoakSample& s) { return s.rss_bytes; }),
+                 mean(last, [](const SoakSample& s) { return s.rss_bytes; }));
+    for (const auto& [stat, value] : samples.back().node_bytes) {
+        auto node_bytes = [&stat = stat](const SoakSample& s) {
+            const auto it = s.node_bytes.find(stat);
+            return it != s.node_bytes.end() ? it->second : 0.;
+        };
+        check_memory(stat, mean(first, node_bytes), mean(last, node_bytes));
+    }
+    const auto start_rate = rate(first);
+    const auto end_rate = rate(last);
+    check("reads_per_s", start_rate, end_rate, end_rate < start_rate * (1 - max_throughput_drift));
+    return failures;
+}
 
-        std::cerr << "nth_element  "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl;
+// Loads a pipeline of the chosen nodes with synthetic reads for a set time, sampling the
+// process's memory, the nodes' memory and the throughput as it goes, and fails if memory grows
+// or throughput falls by more than set amounts between the start and the end.  Catches leaks,
+// unbounded caches and fragmentation that only show after hours.
+int benchmark_soak(int argc, char* argv[]) {
+    argparse::ArgumentParser parser("dorado benchmark soak", DORADO_VERSION,
+                                    argparse::default_arguments::help);
+    parser.add_argument("--nodes")
+            .help("comma separated nodes to load, in pipeline order, from scaler, "
+                  "signal_filter, read_filter, pairing and read_to_bam.")
+            .default_value(std::string("scaler,signal_filter,read_filter,pairing,read_to_bam"));
+    parser.add_argument("-d", "--duration")
+            .help("seconds to load the pipeline for.")
+            .default_value(3600)
+            .scan<'i', int>();
+    parser.add_argument("--warmup")
+            .help("seconds at the start which are not compared, while caches and pools fill.")
+            .default_value(60)
+            .scan<'i', int>();
+    parser.add_argument("--sample-interval")
+            .help("seconds between samples of memory and throughput.")
+            .default_value(10)
+            .scan<'i', int>();
+    parser.add_argument("--max-memory-growth")
+            .help("fraction by which the RSS, or any node's reported memory, may grow between "
+                  "the first and last quarter of the run after the warmup.")
+            .default_value(0.1f)
+            .scan<'f', float>();
+    parser.add_argument("--max-throughput-drift")
+            .help("fraction by which the reads loaded per second may fall between the first "
+                  "and last quarter of the run after the warmup.")
+            .default_value(0.1f)
+            .scan<'f', float>();
+    parser.add_argument("-l", "--read-length")
+            .help("median read length in samples.")
+            .default_value(40000)
+            .scan<'i', int>();
+    parser.add_argument("--read-length-sigma")
+            .help("standard deviation of the log of the read lengths. 0 for a fixed length.")
+            .default_value(0.5f)
+            .scan<'f', float>();
+    parser.add_argument("--read-rate")
+            .help("reads loaded per second. 0 for as fast as the pipeline takes them.")
+            .default_value(0.f)
+            .scan<'f', float>();
+    parser.add_argument("--channels")
+            .help("number of channels the reads are spread over.")
+            .default_value(512)
+            .scan<'i', int>();
+    parser.add_argument("--duplex-fraction")
+            .help("fraction of reads followed on their channel by their complement.")
+            .default_value(0.1f)
+            .scan<'f', float>();
+    parser.add_argument("-t", "--threads")
+            .help("number of worker threads for each node.")
+            .default_value(4)
+            .scan<'i', int>();
+    parser.add_argument("--dump-stats")
+            .help("also write every sample of the nodes' stats, the RSS and the reads loaded "
+                  "to this file.")
+            .default_value(std::string(""));
 
-        x = x.to(torch::kInt16);
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
 
-        // counting
-        start = std::chrono::system_clock::now();
-        res = utils::quantile_counting(x, q);
-        end = std::chrono::system_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    const auto nodes = split_node_list(parser.get<std::string>("--nodes"));
+    const auto duration = std::chrono::seconds(std::max(parser.get<int>("--duration"), 1));
+    const auto warmup_s = double(std::max(parser.get<int>("--warmup"), 0));
+    const auto sample_interval = std::chrono::seconds(
+            std::max(parser.get<int>("--sample-interval"), 1));
+    const auto max_memory_growth = std::max(parser.get<float>("--max-memory-growth"), 0.f);
+    const auto max_throughput_drift =
+            std::clamp(parser.get<float>("--max-throughput-drift"), 0.f, 1.f);
+    const auto num_threads = std::max(parser.get<int>("--threads"), 1);
+    const auto stats_file = parser.get<std::string>("--dump-stats");
 
-        std::cerr << "counting     "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl
-                  << std::endl;
+    FakeReadSettings settings;
+    settings.median_read_samples = size_t(std::max(parser.get<int>("--read-length"), 1));
+    settings.read_samples_sigma = std::max(parser.get<float>("--read-length-sigma"), 0.f);
+    settings.reads_per_s = std::max(parser.get<float>("--read-rate"), 0.f);
+    settings.num_channels = parser.get<int>("--channels");
+    settings.duplex_fraction = std::clamp(parser.get<float>("--duplex-fraction"), 0.f, 1.f);
+    for (const auto& node : nodes) {
+        settings.basecalled |= node == "read_filter" || node == "pairing" || node == "read_to_bam";
     }
 
-    return 0;
+    std::unique_ptr<Pipeline> pipeline;
+    NodeHandle first_node;
+    try {
+        pipeline = create_node_pipeline(nodes, num_threads, first_node);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::atomic<int64_t> reads_loaded{0};
+    auto stats_reporters = pipeline->get_stats_reporters();
+    stats_reporters.push_back([&reads_loaded] {
+        return std::make_tuple(std::string("soak"),
+                               stats::NamedStats{
+                                       {"rss_bytes", double(utils::current_rss_bytes())},
+                                       {"reads_loaded", double(reads_loaded.load())},
+                               });
+    });
+
+    // Only the sampler's thread adds samples, and they're read once it has stopped.
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<SoakSample> samples;
+    auto record_sample = [&](const stats::NamedStats& stats) {
+        const auto elapsed_s =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed_s < warmup_s) {
+            return;
+        }
+        SoakSample sample;
+        sample.elapsed_s = elapsed_s;
+        for (const auto& [name, value] : stats) {
+            if (name == "soak.rss_bytes") {
+                sample.rss_bytes = value;
+            } else if (name == "soak.reads_loaded") {
+                sample.reads_loaded = value;
+            } else if (name.size() > 6 && name.compare(name.size() - 6, 6, "_bytes") == 0) {
+                sample.node_bytes[name] = value;
+            }
+        }
+        samples.push_back(std::move(sample));
+    };
+    auto stats_sampler = std::make_unique<stats::StatsSampler>(
+            sample_interval, std::move(stats_reporters),
+            std::vector<stats::StatsCallable>{record_sample});
+
+    // Reads are loaded in small batches so the run stops soon after its duration.
+    constexpr int kReadsPerBatch = 100;
+    FakeDataLoader loader(pipeline->get_node(first_node), settings);
+    while (std::chrono::steady_clock::now() - start < duration) {
+        loader.load_reads(kReadsPerBatch);
+        reads_loaded += kReadsPerBatch;
+    }
+    stats_sampler->terminate();
+    pipeline->terminate();
+
+    if (!stats_file.empty()) {
+        std::ofstream out(stats_file);
+        stats_sampler->dump_stats(out);
+    }
+
+    // Each quarter needs at least two samples for a rate.
+    if (samples.size() < 8) {
+        std::cerr << "Only " << samples.size() << " samples were taken after the warmup, "
+                  << "which is too few to compare. Increase --duration or reduce --warmup or "
+                  << "--sample-interval." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> report;
+    const auto failures =
+            check_soak_samples(samples, max_memory_growth, max_throughput_drift, report);
+    std::cerr << "loaded " << reads_loaded << " reads in " << samples.back().elapsed_s
+              << " s, comparing the first and last quarter after the warmup:" << std::endl;
+    for (const auto& line : report) {
+        std::cerr << "  " << line << std::endl;
+    }
+    for (const auto& failure : failures) {
+        std::cerr << "soak failure: " << failure << std::endl;
+    }
+    return failures.empty() ? 0 : 1;
+}
+
+}  // namespace
+
+int benchmark(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "pipeline") {
+        return benchmark_pipeline(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "soak") {
+        return benchmark_soak(argc - 1, argv + 1);
+    }
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+    parser.add_argument("-n", "--num-reads")
+            .help("number of synthetic reads per stage.")
+            .default_value(200)
+            .scan<'i', int>();
+    parser.add_argument("-l", "--read-length")
+            .help("length of each synthetic read in samples.")
+            .default_value(40000)
+            .scan<'i', int>();
+    parser.add_argument("-t", "--threads")
+            .help("number of worker threads for the pipeline node stages.")
+            .default_value(1)
+            .scan<'i', int>();
+    parser.add_argument("--json")
+            .help("also write the results as JSON to this file.")
+            .default_value(std::string(""));
+    parser.add_argument("--data")
+            .help("also time loading, and loading and scaling, the read files in this "
+                  "directory, such as tests/data/pod5.")
+            .default_value(std::string(""));
+    parser.add_argument("--data-repeats")
+            .help("number of times the read files are loaded for each stage timing them.")
+            .default_value(10)
+            .scan<'i', int>();
+    parser.add_argument("--baseline")
+            .help("compare the results with the baseline in this file, failing if any rate "
+                  "falls, or the peak RSS rises, by more than the tolerance.")
+            .default_value(std::string(""));
+    parser.add_argument("--tolerance")
+            .help("fraction by which results may be worse than the baseline.")
+            .default_value(0.1f)
+            .scan<'f', float>();
+    parser.add_argument("--record-baseline")
+            .help("write the results to this file as a baseline for later runs.")
+            .default_value(std::string(""));
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
+
+    const auto num_reads = parser.get<int>("--num-reads");
+    const auto read_length = parser.get<int>("--read-length");
+    const auto num_threads = parser.get<int>("--threads");
+    const auto json_file = parser.get<std::string>("--json");
+    const auto data_path = parser.get<std::string>("--data");
+    const auto data_repeats = std::max(parser.get<int>("--data-repeats"), 1);
+    const auto baseline_file = parser.get<std::string>("--baseline");
+    const auto tolerance = std::max(parser.get<float>("--tolerance"), 0.f);
+    const auto record_baseline_file = parser.get<std::string>("--record-baseline");
+
+    std::mt19937 rng(42);
+    const auto reads = make_reads(num_reads, read_length, rng);
+
+    std::vector<StageResult> results;
+    results.push_back(benchmark_async_queue());
+    for (auto& result : benchmark_quantiles(reads)) {
+        results.push_back(result);
+    }
+    results.push_back(benchmark_scaler(reads, num_threads));
+    // Stitching fills in the basecalls that the later stages consume.
+    results.push_back(benchmark_stitching(reads));
+    results.push_back(benchmark_remora_encoder(reads));
+    results.push_back(benchmark_sam_records(reads));
+    if (!data_path.empty()) {
+        results.push_back(benchmark_loading(data_path, data_repeats, num_threads, false));
+        results.push_back(benchmark_loading(data_path, data_repeats, num_threads, true));
+    }
+    const size_t peak_rss = utils::peak_rss_bytes();
+
+    print_results(results);
+    std::cerr << "peak RSS: " << peak_rss / (1024 * 1024) << " MB" << std::endl;
+
+    std::vector<std::string> regressions;
+    if (!baseline_file.empty()) {
+        try {
+            regressions =
+                    find_regressions(results, peak_rss, read_baseline(baseline_file), tolerance);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        for (const auto& regression : regressions) {
+            std::cerr << "regression: " << regression << std::endl;
+        }
+    }
+    if (!json_file.empty()) {
+        std::ofstream out(json_file);
+        write_json(out, results, peak_rss, regressions);
+    }
+    if (!record_baseline_file.empty()) {
+        write_baseline(record_baseline_file, results, peak_rss);
+    }
+
+    return regressions.empty() ? 0 : 1;
 }
 
 }  // namespace dorado
@@ -5,5 +5,8 @@ int duplex(int argc, char *argv[]);
 int download(int argc, char *argv[]);
 int aligner(int argc, char *argv[]);
 int summary(int argc, char *argv[]);
+int serve(int argc, char *argv[]);
+int benchmark(int argc, char *argv[]);
+int coordinate(int argc, char *argv[]);
 
 }  // namespace dorado
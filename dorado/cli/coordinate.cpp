@@ -0,0 +1,130 @@
+#include "Version.h"
+#include "data_loader/DataLoader.h"
+#include "utils/log_utils.h"
+#include "utils/work_coordinator.h"
+
+#include <argparse.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dorado {
+
+namespace {
+
+// How long the coordinator keeps answering once every unit is complete, so that workers
+// waiting for a unit are told the run is over rather than finding the coordinator gone.
+// Longer than the workers' lease retry interval.
+constexpr auto kCompletionGracePeriod = std::chrono::seconds(30);
+
+// The POD5 files under path, in name order so that a restarted coordinator plans the same
+// units.
+std::vector<std::string> find_pod5_files(const std::string& path, bool recursive) {
+    std::vector<std::string> paths;
+    auto add_file = [&paths](const std::filesystem::directory_entry& entry) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (entry.is_regular_file() && ext == ".pod5") {
+            paths.push_back(entry.path().string());
+        }
+    };
+    if (recursive) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+            add_file(entry);
+        }
+    } else {
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+            add_file(entry);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+}  // namespace
+
+int coordinate(int argc, char* argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+    parser.add_argument("data").help(
+            "the data directory, which every worker must be able to read at the same path.");
+    parser.add_argument("manifest").help(
+            "file to list each completed unit and its output in. Units it already lists, from "
+            "an earlier run of the coordinator, are not called again.");
+    parser.add_argument("--host")
+            .help("address to hand out work on.")
+            .default_value(std::string("0.0.0.0"));
+    parser.add_argument("-p", "--port")
+            .help("port to hand out work on.")
+            .default_value(7781)
+            .scan<'i', int>();
+    parser.add_argument("--batches-per-unit")
+            .help("number of POD5 read batches in each unit of work.")
+            .default_value(8)
+            .scan<'i', int>();
+    parser.add_argument("--lease-timeout")
+            .help("seconds after which a unit a worker hasn't completed is handed to another.")
+            .default_value(3600)
+            .scan<'i', int>();
+    parser.add_argument("-r", "--recursive")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Recursively scan through directories to load POD5 files");
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        utils::SetDebugLogging();
+    }
+
+    const auto batches_per_unit = parser.get<int>("--batches-per-unit");
+    const auto lease_timeout = parser.get<int>("--lease-timeout");
+    if (batches_per_unit <= 0 || lease_timeout <= 0) {
+        spdlog::error("--batches-per-unit and --lease-timeout must be positive.");
+        return 1;
+    }
+
+    try {
+        std::vector<std::pair<std::string, size_t>> files;
+        for (auto& path : find_pod5_files(parser.get<std::string>("data"),
+                                          parser.get<bool>("--recursive"))) {
+            const auto num_batches = DataLoader::get_num_pod5_batches(path);
+            files.emplace_back(std::move(path), num_batches);
+        }
+        auto units = utils::plan_work_units(files, size_t(batches_per_unit));
+        spdlog::info("> Split {} POD5 files into {} work units", files.size(), units.size());
+
+        utils::WorkCoordinator coordinator(
+                parser.get<int>("--port"), parser.get<std::string>("--host"), std::move(units),
+                std::chrono::seconds(lease_timeout), parser.get<std::string>("manifest"));
+        coordinator.wait_for_completion();
+        std::this_thread::sleep_for(kCompletionGracePeriod);
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+
+    spdlog::info("> Finished, outputs are listed in {}", parser.get<std::string>("manifest"));
+    return 0;
+}
+
+}  // namespace dorado
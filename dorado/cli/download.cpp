@@ -1,6 +1,7 @@
 #include "Version.h"
 #include "utils/log_utils.h"
 #include "utils/models.h"
+#include "utils/packed_weights.h"
 
 #include <argparse.hpp>
 #include <spdlog/spdlog.h>
@@ -30,6 +31,12 @@ int download(int argc, char* argv[]) {
     parser.add_argument("--list").default_value(false).implicit_value(true).help(
             "list the available models for download");
 
+    parser.add_argument("--pack")
+            .default_value(false)
+            .implicit_value(true)
+            .help("pack the weights of each selected model into a single file which is memory "
+                  "mapped when loading, downloading only the models not already in --directory");
+
     try {
         parser.parse_args(argc, argv);
     } catch (const std::exception& e) {
@@ -100,7 +107,30 @@ int download(int argc, char* argv[]) {
         return 1;
     }
 
-    utils::download_models(directory.string(), selected_model);
+    if (!parser.get<bool>("--pack")) {
+        utils::download_models(directory.string(), selected_model);
+        return 0;
+    }
+
+    // Models already downloaded are packed where they are, so existing model directories
+    // can be converted without downloading them again.
+    for (const auto* model_set : {&simplex::models, &stereo::models, &modified::models}) {
+        for (const auto& model : *model_set) {
+            if (selected_model != "all" && selected_model != model) {
+                continue;
+            }
+            if (!fs::exists(directory / model)) {
+                utils::download_models(directory.string(), model);
+            }
+            try {
+                const auto num_tensors = utils::pack_model_weights(directory / model);
+                spdlog::info(" - packed {} tensors of {}", num_tensors, model);
+            } catch (const std::exception& e) {
+                spdlog::error("> error: failed to pack {}: {}", model, e.what());
+                return 1;
+            }
+        }
+    }
 
     return 0;
 }
@@ -1,24 +1,39 @@
 #include "Version.h"
 #include "data_loader/DataLoader.h"
 #include "nn/CRFModel.h"
+#include "nn/DeviceShareScheduler.h"
 #include "nn/Runners.h"
 #include "read_pipeline/AlignerNode.h"
 #include "read_pipeline/BaseSpaceDuplexCallerNode.h"
 #include "read_pipeline/BasecallerNode.h"
 #include "read_pipeline/DuplexSplitNode.h"
 #include "read_pipeline/HtsWriter.h"
+#include "read_pipeline/MessageRouterNode.h"
 #include "read_pipeline/PairingNode.h"
+#include "read_pipeline/Pipeline.h"
 #include "read_pipeline/ProgressTracker.h"
 #include "read_pipeline/ReadFilterNode.h"
 #include "read_pipeline/ReadToBamTypeNode.h"
 #include "read_pipeline/ScalerNode.h"
+#include "read_pipeline/SimplexReuseNode.h"
 #include "read_pipeline/StereoDuplexEncoderNode.h"
+#include "utils/BandedAligner.h"
+#include "utils/PairTable.h"
 #include "utils/bam_utils.h"
+#include "utils/cache_utils.h"
 #include "utils/cli_utils.h"
 #include "utils/duplex_utils.h"
 #include "utils/log_utils.h"
+#include "utils/metrics_server.h"
 #include "utils/models.h"
 #include "utils/parameters.h"
+#include "utils/trace.h"
+#include "utils/uuid_utils.h"
+
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include "utils/GpuMonitor.h"
+#include "utils/cuda_utils.h"
+#endif
 
 #include <argparse.hpp>
 #include <htslib/sam.h>
@@ -46,6 +61,11 @@ int duplex(int argc, char* argv[]) {
             .help("Space-delimited csv containing read ID pairs. If not provided, pairing will be "
                   "performed automatically");
     parser.add_argument("--emit-fastq").default_value(false).implicit_value(true);
+    parser.add_argument("--gzip")
+            .help("Compress fastq output with BGZF, which gzip can read, across the output "
+                  "threads.")
+            .default_value(false)
+            .implicit_value(true);
     parser.add_argument("--emit-sam")
             .help("Output in SAM format.")
             .default_value(false)
@@ -80,6 +100,26 @@ int duplex(int argc, char* argv[]) {
                   "reads will be basecalled")
             .default_value(std::string(""));
 
+    parser.add_argument("--simplex-bam")
+            .help("A BAM file written by `dorado basecaller --emit-moves` with the same model from "
+                  "these reads. Its simplex basecalls are used rather than basecalling the reads "
+                  "again, so only the pairs are called. With --pairs, only the signal of the "
+                  "paired reads is loaded.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--channel-shard")
+            .help("Only call the channels in this shard, given as <index>/<count>, to split a run "
+                  "across count nodes without losing pairs. Shard i calls the channels whose "
+                  "number is i modulo count.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--stereo-gpu-share")
+            .help("Percentage of each GPU's time given to the stereo model while both it and the "
+                  "simplex model have batches to call. Either model gets the whole GPU while the "
+                  "other has nothing to call.")
+            .default_value(50)
+            .scan<'i', int>();
+
     parser.add_argument("--min-qscore").default_value(0).scan<'i', int>();
 
     parser.add_argument("--reference")
@@ -99,6 +139,11 @@ int duplex(int argc, char* argv[]) {
 
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
 
+    parser.add_argument("--trace")
+            .help("Write a trace of the pipeline's work to this file, as Chrome trace event JSON "
+                  "for viewing in Perfetto or chrome://tracing.")
+            .default_value(std::string(""));
+
     parser.add_argument("--guard-gpus")
             .default_value(false)
             .implicit_value(true)
@@ -112,6 +157,10 @@ int duplex(int argc, char* argv[]) {
 
         auto device(parser.get<std::string>("-x"));
         auto model(parser.get<std::string>("model"));
+        if (split_cpu_spill_device(device).second != 0) {
+            // The GPUs are shared between the simplex and stereo runners by device.
+            throw std::runtime_error("CPU runners can't be added to the devices in duplex.");
+        }
 
         if (model.find("fast") != std::string::npos) {
             spdlog::warn("Fast models are currently not recommended for duplex basecalling.");
@@ -128,16 +177,64 @@ int duplex(int argc, char* argv[]) {
         if (parser.get<bool>("--verbose")) {
             utils::SetDebugLogging();
         }
+        if (internal_parser.get<bool>("--clear_cache")) {
+            utils::clear_cache();
+        }
+        const auto trace_path = parser.get<std::string>("--trace");
+        if (!trace_path.empty()) {
+            utils::trace::start(trace_path);
+        }
         std::map<std::string, std::string> template_complement_map;
         auto read_list = utils::load_read_list(parser.get<std::string>("--read-ids"));
+        const auto channel_shard_str = parser.get<std::string>("--channel-shard");
+        const auto channel_shard = channel_shard_str.empty()
+                                           ? ChannelShard{}
+                                           : ChannelShard::parse(channel_shard_str);
+        if (basespace_duplex && channel_shard.count > 1) {
+            throw std::runtime_error("--channel-shard needs signal data, not basespace reads.");
+        }
+        const auto simplex_bam = parser.get<std::string>("--simplex-bam");
+        if (basespace_duplex && !simplex_bam.empty()) {
+            throw std::runtime_error("--simplex-bam needs signal data, not basespace reads.");
+        }
+        const int stereo_gpu_share = parser.get<int>("--stereo-gpu-share");
+        if (stereo_gpu_share <= 0 || stereo_gpu_share >= 100) {
+            throw std::runtime_error("--stereo-gpu-share must be between 0 and 100.");
+        }
+
+        // Pairs are aligned in batches on the first GPU, if asked to, rather than with edlib.
+        std::shared_ptr<utils::BandedAligner> duplex_aligner;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        const int duplex_alignment_band = internal_parser.get<int>("--duplex_alignment_band");
+        if (duplex_alignment_band > 0) {
+            const auto devices = utils::parse_cuda_device_string(device);
+            if (!devices.empty()) {
+                duplex_aligner = std::make_shared<utils::BandedAligner>(
+                        torch::Device(devices.front()), duplex_alignment_band);
+            }
+        }
+#endif
 
         std::unordered_set<std::string> read_list_from_pairs;
+        // Pairs of reads loaded from read files, whose IDs are UUIDs, are held compactly.
+        // Basespace reads come from a BAM whose read names needn't be, so are kept as strings.
+        std::shared_ptr<const utils::PairTable> pair_table;
 
         if (!pairs_file.empty()) {
             spdlog::info("> Loading pairs file");
-            template_complement_map = utils::load_pairs_file(pairs_file);
-            read_list_from_pairs = utils::get_read_list_from_pairs(template_complement_map);
-            spdlog::info("> Pairs file loaded with {} reads.", read_list_from_pairs.size());
+            if (basespace_duplex) {
+                template_complement_map = utils::load_pairs_file(pairs_file);
+                read_list_from_pairs = utils::get_read_list_from_pairs(template_complement_map);
+                spdlog::info("> Pairs file loaded with {} reads.", read_list_from_pairs.size());
+            } else {
+                auto table = utils::PairTable::load(pairs_file);
+                if (table.num_skipped_lines() != 0) {
+                    spdlog::warn("Ignoring {} lines of the pairs file: read IDs must be UUIDs",
+                                 table.num_skipped_lines());
+                }
+                spdlog::info("> Pairs file loaded with {} pairs.", table.size());
+                pair_table = std::make_shared<const utils::PairTable>(std::move(table));
+            }
         } else {
             spdlog::info(
                     "> No duplex pairs file provided, pairing will be performed automatically");
@@ -154,59 +251,93 @@ int duplex(int argc, char* argv[]) {
             throw std::runtime_error("Only one of --emit-{fastq, sam} can be set (or none).");
         }
 
+        if (parser.get<bool>("--gzip") && !emit_fastq) {
+            throw std::runtime_error("--gzip can only be set with --emit-fastq.");
+        }
         if (emit_fastq) {
-            output_mode = HtsWriter::OutputMode::FASTQ;
+            output_mode = parser.get<bool>("--gzip") ? HtsWriter::OutputMode::FASTQ_GZ
+                                                     : HtsWriter::OutputMode::FASTQ;
         } else if (emit_sam || utils::is_fd_tty(stdout)) {
             output_mode = HtsWriter::OutputMode::SAM;
         } else if (utils::is_fd_pipe(stdout)) {
-            output_mode = HtsWriter::OutputMode::UBAM;
+            output_mode = internal_parser.get<bool>("--stream_ubam")
+                                  ? HtsWriter::OutputMode::UBAM_STREAM
+                                  : HtsWriter::OutputMode::UBAM;
         }
 
         bool recursive_file_loading = parser.get<bool>("--recursive");
 
+        // The read count, and for stereo duplex the sample rate and read groups, come from one
+        // pass over the read files.
+        std::optional<DataSetMetadata> data_metadata;
+        if (!basespace_duplex) {
+            data_metadata = DataLoader::scan_metadata(reads, recursive_file_loading);
+        }
         size_t num_reads = (basespace_duplex ? read_list_from_pairs.size()
-                                             : DataLoader::get_num_reads(reads, read_list, {},
-                                                                         recursive_file_loading));
+                                             : data_metadata->num_reads_to_load(read_list, {}));
+        // Reads are spread over channels roughly evenly, which is close enough for progress.
+        num_reads /= channel_shard.count;
         spdlog::debug("> Reads to process: {}", num_reads);
 
         std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> hdr(sam_hdr_init(), sam_hdr_destroy);
         utils::add_pg_hdr(hdr.get(), args);
-        std::shared_ptr<HtsWriter> bam_writer;
-        std::shared_ptr<Aligner> aligner;
-        MessageSink* converted_reads_sink = nullptr;
 
-        if (ref.empty()) {
-            bam_writer = std::make_shared<HtsWriter>("-", output_mode, 4, num_reads);
-            converted_reads_sink = bam_writer.get();
-        } else {
-            bam_writer = std::make_shared<HtsWriter>("-", output_mode, 4, num_reads);
-            aligner = std::make_shared<Aligner>(
-                    *bam_writer, ref, parser.get<int>("k"), parser.get<int>("w"),
+        PipelineDescriptor pipeline_desc;
+        auto hts_writer = pipeline_desc.add_node<HtsWriter>({}, "-", output_mode, 4, num_reads);
+        // The aligner converts reads to records itself, aligning their sequence directly.
+        auto aligner = PipelineDescriptor::InvalidNodeHandle;
+        auto filtered_reads_sink = PipelineDescriptor::InvalidNodeHandle;
+        if (!ref.empty()) {
+            aligner = pipeline_desc.add_node<Aligner>(
+                    {hts_writer}, ref, parser.get<int>("k"), parser.get<int>("w"),
                     utils::parse_string_to_size(parser.get<std::string>("I")),
-                    std::thread::hardware_concurrency());
-            utils::add_sq_hdr(hdr.get(), aligner->get_sequence_records_for_header());
-            converted_reads_sink = aligner.get();
+                    std::thread::hardware_concurrency(), std::string(), false,
+                    ReadConversionOptions{emit_moves, rna});
+            filtered_reads_sink = aligner;
+        } else {
+            filtered_reads_sink =
+                    pipeline_desc.add_node<ReadToBamType>({hts_writer}, emit_moves, rna, 2);
         }
-        ReadToBamType read_converter(*converted_reads_sink, emit_moves, rna, 2);
         // The minimum sequence length is set to 5 to avoid issues with duplex node printing very short sequences for mismatched pairs.
-        ReadFilterNode read_filter_node(read_converter, min_qscore,
-                                        default_parameters.min_seqeuence_length, {}, 5);
+        auto read_filter_node = pipeline_desc.add_node<ReadFilterNode>(
+                {filtered_reads_sink}, min_qscore, default_parameters.min_seqeuence_length,
+                std::unordered_set<std::string>{}, 5);
 
         torch::set_num_threads(1);
 
-        // Add stats reporting for shared nodes.
-        using dorado::stats::make_stats_reporter;
-        std::vector<dorado::stats::StatsReporter> stats_reporters;
-        if (aligner) {
-            stats_reporters.push_back(make_stats_reporter(*aligner));
-        }
-        stats_reporters.push_back(make_stats_reporter(*bam_writer));
-        stats_reporters.push_back(make_stats_reporter(read_filter_node));
+        // Adds the aligner's SQ lines to the header and writes it.  Must be called before any
+        // reads reach the writer.
+        auto write_header = [&](Pipeline& pipeline) {
+            if (aligner != PipelineDescriptor::InvalidNodeHandle) {
+                utils::add_sq_hdr(hdr.get(), pipeline.get_node<Aligner>(aligner)
+                                                     .get_sequence_records_for_header());
+            }
+            pipeline.get_node<HtsWriter>(hts_writer).write_header(hdr.get());
+        };
 
         std::vector<dorado::stats::StatsCallable> stats_callables;
         ProgressTracker tracker(num_reads, duplex);
         stats_callables.push_back(
-                [&tracker](const stats::NamedStats& stats) { tracker.update_progress_bar(stats); });
+                [&tracker](const stats::NamedStats&) { tracker.update_progress_bar(); });
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        auto gpu_monitor = utils::GpuMonitor::create(device);
+        if (gpu_monitor) {
+            tracker.add_warning_source(
+                    [&gpu_monitor] { return gpu_monitor->throttling_warnings(); });
+        }
+#endif
+        std::unique_ptr<stats::MetricsServer> metrics_server;
+        const auto metrics_port = internal_parser.get<int>("--metrics_port");
+        if (metrics_port > 0) {
+            metrics_server = std::make_unique<stats::MetricsServer>(
+                    metrics_port, internal_parser.get<std::string>("--metrics_host"));
+            stats_callables.push_back(metrics_server->get_stats_callable());
+        }
+        stats::PeakTracker memory_peaks;
+        const bool memory_summary = internal_parser.get<bool>("--memory_summary");
+        if (memory_summary) {
+            stats_callables.push_back(memory_peaks.get_callable());
+        }
 
         if (basespace_duplex) {  // Execute a Basespace duplex pipeline.
             if (pairs_file.empty()) {
@@ -214,22 +345,31 @@ int duplex(int argc, char* argv[]) {
                 return 1;  // Exit with an error code
             }
             // Write header as no read group info is needed.
-            bam_writer->write_header(hdr.get());
+            auto pipeline = Pipeline::create(std::move(pipeline_desc));
+            write_header(*pipeline);
+
+            threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
 
             spdlog::info("> Loading reads");
-            auto read_map = read_bam(reads, read_list_from_pairs);
+            auto read_map = read_bam(reads, read_list_from_pairs, threads);
 
             spdlog::info("> Starting Basespace Duplex Pipeline");
-            threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
 
+            stats::CounterRegistry counters;
+            pipeline->register_counters(counters);
+            tracker.set_counters(counters);
             constexpr auto kStatsPeriod = 100ms;
             auto stats_sampler = std::make_unique<dorado::stats::StatsSampler>(
-                    kStatsPeriod, stats_reporters, stats_callables);
+                    kStatsPeriod, pipeline->get_stats_reporters(), stats_callables);
             // End stats counting setup.
 
-            BaseSpaceDuplexCallerNode duplex_caller_node(read_filter_node, template_complement_map,
-                                                         read_map, threads);
-            bam_writer->join();  // Explicitly wait for all output rows to be written.
+            // The duplex caller starts working as soon as it is constructed, so it feeds the
+            // pipeline from outside, once the header has been written.
+            BaseSpaceDuplexCallerNode duplex_caller_node(pipeline->get_node(read_filter_node),
+                                                         template_complement_map, read_map,
+                                                         threads, duplex_aligner);
+            duplex_caller_node.join();
+            pipeline->terminate();  // Explicitly wait for all output rows to be written.
             stats_sampler->terminate();
         } else {  // Execute a Stereo Duplex pipeline.
 
@@ -237,7 +377,10 @@ int duplex(int argc, char* argv[]) {
             model = model_path.filename().string();
             auto model_config = load_crf_model_config(model_path);
 
-            auto data_sample_rate = DataLoader::get_sample_rate(reads, recursive_file_loading);
+            if (!data_metadata->sample_rate) {
+                throw std::runtime_error("Unable to determine sample rate for data.");
+            }
+            const auto data_sample_rate = *data_metadata->sample_rate;
             auto model_sample_rate = get_model_sample_rate(model_path);
             auto skip_model_compatibility_check =
                     internal_parser.get<bool>("--skip-model-compatibility-check");
@@ -257,13 +400,11 @@ int duplex(int argc, char* argv[]) {
             }
             auto stereo_model_config = load_crf_model_config(stereo_model_path);
 
-            // Write read group info to header.
-            auto read_groups = DataLoader::load_read_groups(reads, model, recursive_file_loading);
+            // Read group info is written to the header once the pipeline is created.
+            auto read_groups = data_metadata->read_groups(model);
             auto duplex_rg_name = std::string(model + "_" + stereo_model_name);
-            read_groups.merge(
-                    DataLoader::load_read_groups(reads, duplex_rg_name, recursive_file_loading));
+            read_groups.merge(data_metadata->read_groups(duplex_rg_name));
             utils::add_rg_hdr(hdr.get(), read_groups);
-            bam_writer->write_header(hdr.get());
 
             int batch_size(parser.get<int>("-b"));
             int chunk_size(parser.get<int>("-c"));
@@ -282,8 +423,48 @@ int duplex(int argc, char* argv[]) {
             // Note: The memory assignment between simplex and duplex callers have been
             // performed based on empirical results considering a SUP model for simplex
             // calling.
-            auto [runners, num_devices] = create_basecall_runners(
-                    model_config, device, num_runners, batch_size, chunk_size, 0.9f, guard_gpus);
+            const size_t num_cuda_streams = internal_parser.get<int>("--cuda_streams_per_device");
+            const bool use_cuda_graphs = internal_parser.get<bool>("--cuda_graphs");
+            const size_t max_working_reads_bytes = utils::parse_string_to_size(
+                    internal_parser.get<std::string>("--max_working_reads_bytes"));
+
+            // Reads already basecalled by a simplex run only need their pairs called, so no
+            // simplex runners are made, and with a pairs file only the paired reads are loaded.
+            read_map simplex_reads;
+            const bool reuse_simplex = !simplex_bam.empty();
+            if (reuse_simplex) {
+                auto pg_keys = utils::extract_pg_keys_from_hdr(simplex_bam, {"CL"});
+                auto tokens = utils::extract_token_from_cli(pg_keys["CL"]);
+                if (tokens.size() < 3 || utils::extract_model_from_model_path(tokens[2]) != model) {
+                    throw std::runtime_error("--simplex-bam must have been basecalled with " +
+                                             model);
+                }
+                if (pair_table) {
+                    std::unordered_set<std::string> paired_read_ids;
+                    for (const auto& [template_id, complement_id] : pair_table->pairs()) {
+                        for (const auto& read_id : {template_id, complement_id}) {
+                            auto read_id_str = utils::format_read_id(read_id);
+                            if (!read_list || read_list->count(read_id_str)) {
+                                paired_read_ids.insert(std::move(read_id_str));
+                            }
+                        }
+                    }
+                    read_list = std::move(paired_read_ids);
+                }
+                spdlog::info("> Loading simplex basecalls");
+                const auto bam_threads =
+                        int(threads == 0 ? std::thread::hardware_concurrency() : threads);
+                simplex_reads = read_simplex_bam(simplex_bam, read_list, bam_threads);
+                spdlog::info("> Loaded {} simplex basecalls", simplex_reads.size());
+            }
+
+            std::vector<Runner> runners;
+            size_t num_devices = 1;
+            if (!reuse_simplex) {
+                std::tie(runners, num_devices) = create_basecall_runners(
+                        model_config, device, num_runners, batch_size, chunk_size, 0.9f,
+                        guard_gpus, num_cuda_streams, use_cuda_graphs);
+            }
 
             std::vector<Runner> stereo_runners;
             // The fraction argument for GPU memory allocates the fraction of the
@@ -291,9 +472,25 @@ int duplex(int argc, char* argv[]) {
             // memory after simplex caller has been instantiated to the duplex caller.
             // ALWAYS auto tune the duplex batch size (i.e. batch_size passed in is 0.)
             // except for on metal
-            std::tie(stereo_runners, std::ignore) =
+            size_t num_stereo_devices = 0;
+            std::tie(stereo_runners, num_stereo_devices) =
                     create_basecall_runners(stereo_model_config, device, num_runners,
-                                            stereo_batch_size, chunk_size, 1.f, guard_gpus);
+                                            stereo_batch_size, chunk_size, 1.f, guard_gpus,
+                                            num_cuda_streams, use_cuda_graphs);
+            if (reuse_simplex) {
+                num_devices = num_stereo_devices;
+            }
+
+            // The simplex and stereo runners take turns on each GPU by their shares, rather
+            // than contending for it.
+            std::vector<std::shared_ptr<DeviceShareScheduler>> device_schedulers;
+            const bool cuda_device = device != "cpu" && device != "metal";
+            if (cuda_device && !reuse_simplex) {
+                device_schedulers = share_devices(
+                        {&runners, &stereo_runners}, {"simplex", "stereo"},
+                        {double(100 - stereo_gpu_share), double(stereo_gpu_share)}, num_devices,
+                        num_cuda_streams);
+            }
 
             spdlog::info("> Starting Stereo Duplex pipeline");
 
@@ -302,18 +499,32 @@ int duplex(int argc, char* argv[]) {
             auto adjusted_stereo_overlap = (overlap / stereo_model_stride) * stereo_model_stride;
 
             const int kStereoBatchTimeoutMS = 5000;
-            auto stereo_basecaller_node = std::make_unique<BasecallerNode>(
-                    read_filter_node, std::move(stereo_runners), adjusted_stereo_overlap,
-                    kStereoBatchTimeoutMS, duplex_rg_name, 1000, "StereoBasecallerNode", true);
-            auto simplex_model_stride = runners.front()->model_stride();
-
-            StereoDuplexEncoderNode stereo_node =
-                    StereoDuplexEncoderNode(*stereo_basecaller_node, simplex_model_stride);
-
-            PairingNode pairing_node(stereo_node,
-                                     template_complement_map.empty()
-                                             ? std::optional<std::map<std::string, std::string>>{}
-                                             : template_complement_map);
+            auto stereo_basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                    {read_filter_node}, std::move(stereo_runners), adjusted_stereo_overlap,
+                    kStereoBatchTimeoutMS, duplex_rg_name, size_t(1000),
+                    std::string("StereoBasecallerNode"), true, ChunkSchedulingPolicy::FIFO, false,
+                    max_working_reads_bytes);
+            auto simplex_model_stride =
+                    reuse_simplex ? model_config.stride : runners.front()->model_stride();
+
+            // Reads which failed stereo encoding have already been called, so they go
+            // straight to the read filter rather than through the stereo basecaller.
+            auto stereo_router =
+                    pipeline_desc.add_router({stereo_basecaller_node, read_filter_node},
+                                             MessageRouterNode::route_uncalled_reads,
+                                             "StereoRouterNode");
+            auto stereo_node = pipeline_desc.add_node<StereoDuplexEncoderNode>(
+                    {stereo_router}, int(simplex_model_stride), duplex_aligner);
+
+            DuplexPairingParameters pairing_params;
+            pairing_params.max_time_delta_ms =
+                    internal_parser.get<int>("--pairing_max_time_delta_ms");
+            pairing_params.min_seq_len_ratio =
+                    internal_parser.get<float>("--pairing_min_seq_len_ratio");
+            pairing_params.min_shared_minimizer_frac =
+                    internal_parser.get<float>("--pairing_min_shared_minimizer_frac");
+            auto pairing_node = pipeline_desc.add_node<PairingNode>(
+                    {stereo_node}, pair_table, 2, size_t(1000), pairing_params);
 
             // Initialize duplex split settings and create a duplex split node
             // with the given settings and number of devices. If
@@ -321,29 +532,48 @@ int duplex(int argc, char* argv[]) {
             // act as a passthrough, meaning it won't perform any splitting
             // operations and will just pass data through.
             DuplexSplitSettings splitter_settings;
-            DuplexSplitNode splitter_node(pairing_node, splitter_settings, num_devices);
+            auto splitter_node = pipeline_desc.add_node<DuplexSplitNode>(
+                    {pairing_node}, splitter_settings, int(num_devices));
 
             auto adjusted_simplex_overlap = (overlap / simplex_model_stride) * simplex_model_stride;
 
-            const int kSimplexBatchTimeoutMS = 100;
-            auto basecaller_node = std::make_unique<BasecallerNode>(
-                    splitter_node, std::move(runners), adjusted_simplex_overlap,
-                    kSimplexBatchTimeoutMS, model, 1000, "BasecallerNode", true);
+            auto basecaller_node = PipelineDescriptor::InvalidNodeHandle;
+            if (reuse_simplex) {
+                basecaller_node = pipeline_desc.add_node<SimplexReuseNode>(
+                        {splitter_node}, std::move(simplex_reads), simplex_model_stride, model,
+                        int(num_devices * 2));
+            } else {
+                const int kSimplexBatchTimeoutMS = 100;
+                basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                        {splitter_node}, std::move(runners), adjusted_simplex_overlap,
+                        kSimplexBatchTimeoutMS, model, size_t(1000), std::string("BasecallerNode"),
+                        true, ChunkSchedulingPolicy::FIFO, false, max_working_reads_bytes);
+            }
+
+            auto scaler_node = pipeline_desc.add_node<ScalerNode>(
+                    {basecaller_node}, model_config.signal_norm_params, int(num_devices * 2));
 
-            ScalerNode scaler_node(*basecaller_node, model_config.signal_norm_params,
-                                   num_devices * 2);
+            auto pipeline = Pipeline::create(std::move(pipeline_desc));
+            write_header(*pipeline);
 
-            DataLoader loader(scaler_node, "cpu", num_devices, 0, std::move(read_list));
+            DataLoader loader(pipeline->get_node(scaler_node), "cpu", num_devices, 0,
+                              std::move(read_list));
+            loader.set_channel_shard(channel_shard);
 
             // Setup stats counting
-            using dorado::stats::make_stats_reporter;
-            stats_reporters.push_back(make_stats_reporter(*stereo_basecaller_node));
-            stats_reporters.push_back(make_stats_reporter(stereo_node));
-            stats_reporters.push_back(make_stats_reporter(pairing_node));
-            stats_reporters.push_back(make_stats_reporter(splitter_node));
-            stats_reporters.push_back(make_stats_reporter(*basecaller_node));
-            stats_reporters.push_back(make_stats_reporter(loader));
-            stats_reporters.push_back(make_stats_reporter(scaler_node));
+            stats::CounterRegistry counters;
+            pipeline->register_counters(counters);
+            tracker.set_counters(counters);
+            auto stats_reporters = pipeline->get_stats_reporters();
+            stats_reporters.push_back(dorado::stats::make_stats_reporter(loader));
+            for (const auto& scheduler : device_schedulers) {
+                stats_reporters.push_back(dorado::stats::make_stats_reporter(*scheduler));
+            }
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            if (gpu_monitor) {
+                stats_reporters.push_back(dorado::stats::make_stats_reporter(*gpu_monitor));
+            }
+#endif
 
             constexpr auto kStatsPeriod = 100ms;
             auto stats_sampler = std::make_unique<dorado::stats::StatsSampler>(
@@ -351,14 +581,19 @@ int duplex(int argc, char* argv[]) {
             // End stats counting setup.
 
             loader.load_reads(reads, parser.get<bool>("--recursive"), DataLoader::BY_CHANNEL);
-            bam_writer->join();  // Explicitly wait for all output rows to be written.
+            pipeline->terminate();  // Explicitly wait for all output rows to be written.
             stats_sampler->terminate();
         }
         tracker.summarize();
+        if (memory_summary) {
+            tracker.summarize_peak_memory(memory_peaks);
+        }
     } catch (const std::exception& e) {
         spdlog::error(e.what());
+        utils::trace::stop();
         return 1;
     }
+    utils::trace::stop();
     return 0;
 }
 }  // namespace dorado
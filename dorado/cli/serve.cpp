@@ -0,0 +1,436 @@
+#include "Version.h"
+#include "data_loader/DataLoader.h"
+#include "nn/CRFModel.h"
+#include "nn/Runners.h"
+#include "read_pipeline/BasecallerNode.h"
+#include "read_pipeline/ClientRouterNode.h"
+#include "read_pipeline/HtsWriter.h"
+#include "read_pipeline/ModBaseCallerNode.h"
+#include "read_pipeline/Pipeline.h"
+#include "read_pipeline/ReadFilterNode.h"
+#include "read_pipeline/ReadToBamTypeNode.h"
+#include "read_pipeline/ScalerNode.h"
+#include "utils/basecaller_utils.h"
+#include "utils/bam_utils.h"
+#include "utils/cache_utils.h"
+#include "utils/cli_utils.h"
+#include "utils/job_server.h"
+#include "utils/log_utils.h"
+#include "utils/metrics_server.h"
+#include "utils/models.h"
+#include "utils/parameters.h"
+#include "utils/stats.h"
+#include "utils/work_coordinator.h"
+
+#include <argparse.hpp>
+#include <htslib/sam.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace dorado {
+
+using dorado::utils::default_parameters;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Passes a job's reads on to the shared pipeline.  DataLoader terminates its sink once it has
+// loaded everything, which must not stop the shared pipeline while other jobs are using it.
+class JobInputSink : public MessageSink {
+public:
+    JobInputSink(MessageSink& sink) : MessageSink(1), m_sink(sink) {}
+    void push_message(Message&& message) override { m_sink.push_message(std::move(message)); }
+    void push_messages(std::vector<Message>&& messages) override {
+        m_sink.push_messages(std::move(messages));
+    }
+    void terminate() override {}
+
+private:
+    MessageSink& m_sink;
+};
+
+// Holds the models and the shared part of the pipeline -- scaling, basecalling and modbase
+// calling -- for the lifetime of the server.  Each job loads its reads into the shared
+// pipeline tagged with its own client_id, so reads from concurrent jobs are called in the
+// same batches, and gets them back from the ClientRouterNode at the end of it to filter,
+// convert and write in a pipeline of its own.
+class BasecallServer {
+public:
+    BasecallServer(std::vector<std::string> args,
+                   const std::filesystem::path& model_path,
+                   const std::string& remora_models,
+                   const std::string& device,
+                   size_t chunk_size,
+                   size_t overlap,
+                   size_t batch_size,
+                   size_t num_runners,
+                   size_t remora_batch_size,
+                   size_t num_remora_threads,
+                   float methylation_threshold_pct,
+                   bool emit_moves,
+                   size_t min_qscore,
+                   bool skip_model_compatibility_check,
+                   size_t num_cuda_streams,
+                   bool use_cuda_graphs,
+                   ChunkSchedulingPolicy chunk_scheduling)
+            : m_args(std::move(args)),
+              m_model_name(std::filesystem::canonical(model_path).filename().string()),
+              m_methylation_threshold_pct(methylation_threshold_pct),
+              m_emit_moves(emit_moves),
+              m_rna(utils::is_rna_model(model_path)),
+              m_min_qscore(min_qscore),
+              m_skip_model_compatibility_check(skip_model_compatibility_check) {
+        torch::set_num_threads(1);
+
+        // create modbase runners first so basecall runners can pick batch sizes based on available memory
+        auto remora_runners =
+                create_modbase_runners(remora_models, device,
+                                       default_parameters.remora_runners_per_caller,
+                                       remora_batch_size);
+        m_has_modbase_models = !remora_runners.empty();
+
+        auto model_config = dorado::load_crf_model_config(model_path);
+        auto [runners, num_devices] =
+                create_basecall_runners(model_config, device, num_runners, batch_size,
+                                        chunk_size, 1.f, false, num_cuda_streams, use_cuda_graphs);
+        m_model_sample_rate = get_model_sample_rate(model_path);
+
+        auto model_stride = runners.front()->model_stride();
+        overlap = (overlap / model_stride) * model_stride;
+
+        m_thread_allocations = std::make_unique<utils::ThreadAllocations>(
+                int(num_devices), m_has_modbase_models ? int(num_remora_threads) : 0);
+
+        PipelineDescriptor pipeline_desc;
+        m_router = pipeline_desc.add_node<ClientRouterNode>({});
+        auto basecaller_node_sink = m_router;
+        if (m_has_modbase_models) {
+            basecaller_node_sink = pipeline_desc.add_node<ModBaseCallerNode>(
+                    {m_router}, std::move(remora_runners),
+                    m_thread_allocations->remora_threads * num_devices, model_stride,
+                    remora_batch_size, size_t(1000), true);
+        }
+        const int kBatchTimeoutMS = 100;
+        m_basecaller_node = pipeline_desc.add_node<BasecallerNode>(
+                {basecaller_node_sink}, std::move(runners), overlap, kBatchTimeoutMS,
+                m_model_name, size_t(1000), "BasecallerNode", false, chunk_scheduling,
+                !m_has_modbase_models);
+        m_scaler_node = pipeline_desc.add_node<ScalerNode>(
+                {m_basecaller_node}, model_config.signal_norm_params,
+                m_thread_allocations->scaler_node_threads);
+
+        m_pipeline = Pipeline::create(std::move(pipeline_desc));
+    }
+
+    std::vector<stats::StatsReporter> get_stats_reporters() const {
+        return m_pipeline->get_stats_reporters();
+    }
+
+    // Basecalls the job's reads into its output file.  Throws if the job can't be run.
+    std::string run_job(const utils::BasecallJob& job) {
+        const auto output_mode = HtsWriter::get_output_mode(job.output_format);
+        if (m_has_modbase_models && HtsWriter::is_fastq(output_mode)) {
+            throw std::runtime_error("Modified base models cannot be used with FASTQ output");
+        }
+        if (!std::filesystem::exists(job.data_path)) {
+            throw std::runtime_error("Data path " + job.data_path + " does not exist");
+        }
+
+        const auto data_metadata = DataLoader::scan_metadata(job.data_path, job.recursive);
+        if (!data_metadata.sample_rate) {
+            throw std::runtime_error("Unable to determine sample rate for data.");
+        }
+        const auto data_sample_rate = *data_metadata.sample_rate;
+        if (!m_skip_model_compatibility_check &&
+            !sample_rates_compatible(data_sample_rate, m_model_sample_rate)) {
+            std::stringstream err;
+            err << "Sample rate for model (" << m_model_sample_rate << ") and data ("
+                << data_sample_rate << ") are not compatible.";
+            throw std::runtime_error(err.str());
+        }
+
+        const int32_t client_id = m_next_client_id++;
+        spdlog::info("> Starting job {}: {} -> {}", client_id, job.data_path, job.output_path);
+
+        if (job.end_batch != 0 && !std::filesystem::is_regular_file(job.data_path)) {
+            throw std::runtime_error("Batches can only be called from a single POD5 file, not " +
+                                     job.data_path);
+        }
+        const auto read_groups = data_metadata.read_groups(m_model_name);
+        const size_t num_reads = data_metadata.num_reads_to_load(std::nullopt, {});
+
+        PipelineDescriptor job_desc;
+        auto hts_writer = job_desc.add_node<HtsWriter>({}, job.output_path, output_mode,
+                                                       m_thread_allocations->writer_threads,
+                                                       num_reads);
+        auto read_converter = job_desc.add_node<ReadToBamType>(
+                {hts_writer}, m_emit_moves, m_rna,
+                m_thread_allocations->read_converter_threads, m_methylation_threshold_pct);
+        auto read_filter_node = job_desc.add_node<ReadFilterNode>(
+                {read_converter}, m_min_qscore, default_parameters.min_seqeuence_length,
+                std::unordered_set<std::string>{}, m_thread_allocations->read_filter_threads);
+        auto job_pipeline = Pipeline::create(std::move(job_desc));
+
+        std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> hdr(sam_hdr_init(), sam_hdr_destroy);
+        utils::add_pg_hdr(hdr.get(), m_args);
+        utils::add_rg_hdr(hdr.get(), read_groups);
+        job_pipeline->get_node<HtsWriter>(hts_writer).write_header(hdr.get());
+
+        auto& router = m_pipeline->get_node<ClientRouterNode>(m_router);
+        router.add_client(client_id, job_pipeline->get_node(read_filter_node));
+        auto& basecaller = m_pipeline->get_node<BasecallerNode>(m_basecaller_node);
+        basecaller.set_client_weight(client_id, job.weight);
+
+        JobInputSink job_input(m_pipeline->get_node(m_scaler_node));
+        DataLoader loader(job_input, "cpu", m_thread_allocations->loader_threads, 0, std::nullopt,
+                          {}, client_id);
+        try {
+            if (job.end_batch != 0) {
+                loader.load_pod5_batches(job.data_path, job.first_batch, job.end_batch);
+            } else {
+                loader.load_reads(job.data_path, job.recursive);
+            }
+        } catch (...) {
+            // Reads which were loaded are still in flight, so they must arrive before the
+            // job's pipeline can go.
+            router.wait_for_reads(client_id, loader.get_num_reads_loaded());
+            router.remove_client(client_id);
+            basecaller.set_client_weight(client_id, 1);
+            throw;
+        }
+
+        const size_t num_reads_loaded = loader.get_num_reads_loaded();
+        const bool complete = router.wait_for_reads(client_id, num_reads_loaded);
+        router.remove_client(client_id);
+        basecaller.set_client_weight(client_id, 1);
+        job_pipeline->terminate();
+        if (!complete) {
+            throw std::runtime_error("Server shut down before job " + std::to_string(client_id) +
+                                     " completed");
+        }
+
+        spdlog::info("> Finished job {}: {} reads", client_id, num_reads_loaded);
+        return "Basecalled " + std::to_string(num_reads_loaded) + " reads into " +
+               job.output_path;
+    }
+
+    // Waits for reads already submitted to drain.
+    void terminate() { m_pipeline->terminate(); }
+
+private:
+    std::vector<std::string> m_args;
+    std::string m_model_name;
+    uint16_t m_model_sample_rate{0};
+    float m_methylation_threshold_pct;
+    bool m_emit_moves;
+    bool m_rna;
+    size_t m_min_qscore;
+    bool m_skip_model_compatibility_check;
+    bool m_has_modbase_models{false};
+    std::unique_ptr<utils::ThreadAllocations> m_thread_allocations;
+
+    std::unique_ptr<Pipeline> m_pipeline;
+    NodeHandle m_router{PipelineDescriptor::InvalidNodeHandle};
+    NodeHandle m_basecaller_node{PipelineDescriptor::InvalidNodeHandle};
+    NodeHandle m_scaler_node{PipelineDescriptor::InvalidNodeHandle};
+    std::atomic<int32_t> m_next_client_id{0};
+};
+
+// How often a worker asks again for a unit while every remaining one is leased.
+constexpr auto kLeaseRetryInterval = 5s;
+
+// Basecalls work units from the coordinator until there are none left, each into a file of
+// its own in output_dir.  A unit another worker completed first is removed again, since the
+// coordinator only keeps the first output of each.
+void run_worker(BasecallServer& server,
+                const std::string& coordinator,
+                std::string worker_name,
+                const std::filesystem::path& output_dir) {
+    std::filesystem::create_directories(output_dir);
+    utils::WorkClient client(coordinator, std::move(worker_name));
+    spdlog::info("> Working for {} as {}", coordinator, client.worker_name());
+    while (auto unit = client.lease(kLeaseRetryInterval)) {
+        utils::BasecallJob job;
+        job.data_path = unit->path;
+        job.output_path = (output_dir / (client.worker_name() + ".unit" +
+                                         std::to_string(unit->id) + ".bam"))
+                                  .string();
+        job.first_batch = unit->first_batch;
+        job.end_batch = unit->end_batch;
+        server.run_job(job);
+        if (!client.complete(*unit, job.output_path)) {
+            spdlog::info("> Work unit {} was completed by another worker", unit->id);
+            std::filesystem::remove(job.output_path);
+        }
+    }
+    spdlog::info("> All work units are complete");
+}
+
+std::string default_worker_name() {
+#ifndef _WIN32
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) == 0 && host[0] != '\0') {
+        return std::string(host) + "-" + std::to_string(getpid());
+    }
+#endif
+    return "worker";
+}
+
+}  // namespace
+
+int serve(int argc, char* argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+
+    parser.add_argument("model").help("the basecaller model to keep loaded.");
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    parser.add_argument("-x", "--device")
+            .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
+                  "etc..")
+            .default_value(default_parameters.device);
+
+    parser.add_argument("--host")
+            .help("address to accept jobs on.")
+            .default_value(std::string("127.0.0.1"));
+
+    parser.add_argument("-p", "--port")
+            .help("port to accept jobs on.")
+            .default_value(7780)
+            .scan<'i', int>();
+
+    parser.add_argument("--coordinator")
+            .help("instead of accepting jobs, basecall work units from the `dorado coordinate` "
+                  "at host:port until the run is complete.")
+            .default_value(std::string());
+
+    parser.add_argument("--output-dir")
+            .help("directory to write each work unit's BAM file to, when working for a "
+                  "coordinator.")
+            .default_value(std::string("."));
+
+    parser.add_argument("--worker-name")
+            .help("name to work for a coordinator under, which must be unique. Defaults to the "
+                  "host name and process ID.")
+            .default_value(std::string());
+
+    parser.add_argument("--min-qscore").default_value(0).scan<'i', int>();
+
+    parser.add_argument("-b", "--batchsize")
+            .default_value(default_parameters.batchsize)
+            .scan<'i', int>()
+            .help("if 0 an optimal batchsize will be selected. batchsizes are rounded to the "
+                  "closest multiple of 64.");
+
+    parser.add_argument("-c", "--chunksize")
+            .default_value(default_parameters.chunksize)
+            .scan<'i', int>();
+
+    parser.add_argument("-o", "--overlap")
+            .default_value(default_parameters.overlap)
+            .scan<'i', int>();
+
+    parser.add_argument("--modified-bases-models")
+            .default_value(std::string())
+            .help("a comma separated list of modified base models");
+
+    parser.add_argument("--modified-bases-threshold")
+            .default_value(default_parameters.methylation_threshold)
+            .scan<'f', float>()
+            .help("the minimum predicted methylation probability for a modified base to be emitted "
+                  "in an all-context model, [0, 1]");
+
+    parser.add_argument("--emit-moves").default_value(false).implicit_value(true);
+
+    argparse::ArgumentParser internal_parser;
+    try {
+        auto remaining_args = parser.parse_known_args(argc, argv);
+        internal_parser = utils::parse_internal_options(remaining_args);
+    } catch (const std::exception& e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    std::vector<std::string> args(argv, argv + argc);
+
+    if (parser.get<bool>("--verbose")) {
+        utils::SetDebugLogging();
+    }
+
+    if (internal_parser.get<bool>("--clear_cache")) {
+        utils::clear_cache();
+    }
+
+    auto methylation_threshold = parser.get<float>("--modified-bases-threshold");
+    if (methylation_threshold < 0.f || methylation_threshold > 1.f) {
+        spdlog::error("--modified-bases-threshold must be between 0 and 1.");
+        std::exit(EXIT_FAILURE);
+    }
+
+    try {
+        spdlog::info("> Loading models");
+        BasecallServer server(
+                args, parser.get<std::string>("model"),
+                parser.get<std::string>("--modified-bases-models"), parser.get<std::string>("-x"),
+                parser.get<int>("-c"), parser.get<int>("-o"), parser.get<int>("-b"),
+                default_parameters.num_runners, default_parameters.remora_batchsize,
+                default_parameters.remora_threads, methylation_threshold,
+                parser.get<bool>("--emit-moves"), parser.get<int>("--min-qscore"),
+                internal_parser.get<bool>("--skip-model-compatibility-check"),
+                internal_parser.get<int>("--cuda_streams_per_device"),
+                internal_parser.get<bool>("--cuda_graphs"),
+                parse_chunk_scheduling_policy(
+                        internal_parser.get<std::string>("--chunk_scheduling")));
+
+        std::unique_ptr<stats::MetricsServer> metrics_server;
+        std::unique_ptr<stats::StatsSampler> stats_sampler;
+        if (const int metrics_port = internal_parser.get<int>("--metrics_port");
+            metrics_port > 0) {
+            metrics_server = std::make_unique<stats::MetricsServer>(
+                    metrics_port, internal_parser.get<std::string>("--metrics_host"));
+            constexpr auto kStatsPeriod = 100ms;
+            stats_sampler = std::make_unique<stats::StatsSampler>(
+                    kStatsPeriod, server.get_stats_reporters(),
+                    std::vector<stats::StatsCallable>{metrics_server->get_stats_callable()});
+        }
+
+        if (const auto coordinator = parser.get<std::string>("--coordinator");
+            !coordinator.empty()) {
+            auto worker_name = parser.get<std::string>("--worker-name");
+            run_worker(server, coordinator,
+                       worker_name.empty() ? default_worker_name() : std::move(worker_name),
+                       parser.get<std::string>("--output-dir"));
+        } else {
+            utils::JobServer job_server(
+                    parser.get<int>("--port"), parser.get<std::string>("--host"),
+                    [&server](const utils::BasecallJob& job) { return server.run_job(job); });
+            job_server.wait_for_shutdown();
+        }
+
+        server.terminate();
+        if (stats_sampler) {
+            stats_sampler->terminate();
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+
+    spdlog::info("> Finished");
+    return 0;
+}
+
+}  // namespace dorado
@@ -1,170 +1,144 @@
 #include "Version.h"
+#include "cxxpool.h"
 #include "read_pipeline/HtsReader.h"
 #include "utils/bam_utils.h"
 #include "utils/log_utils.h"
+#include "utils/summary_utils.h"
+#include "utils/time_utils.h"
 
 #include <argparse.hpp>
 #include <date/date.h>
 #include <date/tz.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cctype>
 #include <csignal>
 #include <filesystem>
+#include <future>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace dorado {
 
 volatile sig_atomic_t interrupt = 0;
 
-// todo: move to time_utils after !273
-double time_difference_seconds(const std::string &timestamp1, const std::string &timestamp2) {
+namespace {
+
+// Records are converted to rows in batches of this many, spread across the threads.
+constexpr size_t kBatchSize = 10000;
+constexpr size_t kRecordsPerTask = 500;
+
+// Parses a timestamp to microseconds since the epoch, falling back to date::parse for any form
+// utils::parse_timestamp_us() doesn't handle.
+int64_t timestamp_us(std::string_view timestamp) {
+    if (auto time_us = utils::parse_timestamp_us(timestamp)) {
+        return *time_us;
+    }
     using namespace date;
     using namespace std::chrono;
     try {
-        std::istringstream ss1(timestamp1);
-        std::istringstream ss2(timestamp2);
-        sys_time<microseconds> time1, time2;
-        ss1 >> parse("%FT%T%Ez", time1);
-        ss2 >> parse("%FT%T%Ez", time2);
+        std::istringstream ss{std::string(timestamp)};
+        sys_time<microseconds> time;
+        ss >> parse("%FT%T%Ez", time);
         // If parsing with timezone offset failed, try parsing with 'Z' format
-        if (ss1.fail()) {
-            ss1.clear();
-            ss1.str(timestamp1);
-            ss1 >> parse("%FT%TZ", time1);
-        }
-        if (ss2.fail()) {
-            ss2.clear();
-            ss2.str(timestamp2);
-            ss2 >> parse("%FT%TZ", time2);
+        if (ss.fail()) {
+            ss.clear();
+            ss.str(std::string(timestamp));
+            ss >> parse("%FT%TZ", time);
         }
-        duration<double> diff = time1 - time2;
-        return diff.count();
+        return time.time_since_epoch().count();
     } catch (const std::exception &e) {
         throw std::runtime_error("Failed to parse timestamps");
     }
 }
 
-int summary(int argc, char *argv[]) {
-    utils::InitLogging();
-
-    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
-    parser.add_argument("reads").help("SAM/BAM file produced by dorado basecaller.");
-    parser.add_argument("-s", "--separator").default_value(std::string("\t"));
-    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
-
-    try {
-        parser.parse_args(argc, argv);
-    } catch (const std::exception &e) {
-        std::ostringstream parser_stream;
-        parser_stream << parser;
-        spdlog::error("{}\n{}", e.what(), parser_stream.str());
-        std::exit(1);
+template <typename T>
+T get_tag(bam1_t *record, const char *tagname) {
+    uint8_t *tag = bam_aux_get(record, tagname);
+    if (!tag) {
+        return T{};
     }
-
-    if (parser.get<bool>("--verbose")) {
-        utils::SetDebugLogging();
+    if constexpr (std::is_integral_v<T>) {
+        return static_cast<T>(bam_aux2i(tag));
+    } else if constexpr (std::is_floating_point_v<T>) {
+        return static_cast<T>(bam_aux2f(tag));
+    } else {
+        const char *value = bam_aux2Z(tag);
+        return value ? T(value) : T{};
     }
+}
 
-    std::vector<std::string> header = {
-            "filename",
-            "read_id",
-            "run_id",
-            "channel",
-            "mux",
-            "start_time",
-            "duration",
-            "template_start",
-            "template_duration",
-            "sequence_length_template",
-            "mean_qscore_template",
-    };
-
-    std::vector<std::string> aligned_header = {
-            "alignment_genome",         "alignment_genome_start",    "alignment_genome_end",
-            "alignment_strand_start",   "alignment_strand_end",      "alignment_direction",
-            "alignment_length",         "alignment_num_aligned",     "alignment_num_correct",
-            "alignment_num_insertions", "alignment_num_deletions",   "alignment_num_substitutions",
-            "alignment_mapq",           "alignment_strand_coverage", "alignment_identity",
-            "alignment_accuracy"};
-
-    auto reads(parser.get<std::string>("reads"));
-    auto separator(parser.get<std::string>("separator"));
-
-    HtsReader reader(reads);
-
-    auto read_group_exp_start_time = utils::get_read_group_info(reader.header, "DT");
-
-    spdlog::debug("> input fmt: {} aligned: {}", reader.format, reader.is_aligned);
-#ifndef _WIN32
-    std::signal(SIGPIPE, [](int signum) { interrupt = 1; });
-#endif
-    std::signal(SIGINT, [](int signum) { interrupt = 1; });
-
-    for (int col = 0; col < header.size() - 1; col++) {
-        std::cout << header[col] << separator;
-    }
-    std::cout << header[header.size() - 1];
-
-    if (reader.is_aligned) {
-        for (int col = 0; col < aligned_header.size() - 1; col++) {
-            std::cout << separator << aligned_header[col];
-        }
-        std::cout << separator << aligned_header[aligned_header.size() - 1];
-    }
-
-    std::cout << '\n';
-
-    while (reader.read() && !interrupt) {
-        if (reader.record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
+struct ConvertedRows {
+    std::string rows;
+    // Set if conversion stopped at a record with no read group, after the rows before it.
+    bool missing_read_group{false};
+};
+
+// Formats the rows of the primary records in [begin, end).
+ConvertedRows convert_records(const std::vector<BamPtr> &records,
+                              size_t begin,
+                              size_t end,
+                              const sam_hdr_t *header,
+                              bool is_aligned,
+                              std::string_view separator,
+                              const std::unordered_map<std::string, int64_t> &exp_start_times_us) {
+    ConvertedRows converted;
+    utils::SummaryRowWriter row(converted.rows, separator);
+    for (size_t i = begin; i < end; ++i) {
+        bam1_t *record = records[i].get();
+        if (record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
             continue;
         }
 
-        auto rg_value = reader.get_tag<std::string>("RG");
+        auto rg_value = get_tag<std::string_view>(record, "RG");
         if (rg_value.length() == 0) {
-            spdlog::error("> Cannot generate sequencing summary for files with no RG tags");
-            return 1;
+            converted.missing_read_group = true;
+            break;
         }
         auto rg_split = rg_value.find("_");
         auto run_id = rg_value.substr(0, rg_split);
-        auto model = rg_value.substr(rg_split + 1, rg_value.length());
 
-        auto filename = reader.get_tag<std::string>("f5");
+        auto filename = get_tag<std::string_view>(record, "f5");
         if (filename.empty()) {
-            filename = reader.get_tag<std::string>("fn");
+            filename = get_tag<std::string_view>(record, "fn");
         }
-        auto read_id = bam_get_qname(reader.record);
-        auto channel = reader.get_tag<int>("ch");
-        auto mux = reader.get_tag<int>("mx");
+        auto read_id = bam_get_qname(record);
+        auto channel = get_tag<int>(record, "ch");
+        auto mux = get_tag<int>(record, "mx");
 
-        auto start_time_dt = reader.get_tag<std::string>("st");
-        auto duration = reader.get_tag<float>("du");
+        auto start_time_dt = get_tag<std::string_view>(record, "st");
+        auto duration = get_tag<float>(record, "du");
 
-        auto seqlen = reader.record->core.l_qseq;
-        auto mean_qscore = reader.get_tag<int>("qs");
+        auto seqlen = record->core.l_qseq;
+        auto mean_qscore = get_tag<int>(record, "qs");
 
-        auto num_samples = reader.get_tag<int>("ns");
-        auto trim_samples = reader.get_tag<int>("ts");
+        auto num_samples = get_tag<int>(record, "ns");
+        auto trim_samples = get_tag<int>(record, "ts");
 
         float sample_rate = num_samples / duration;
         float template_duration = (num_samples - trim_samples) / sample_rate;
-        auto exp_start_dt = read_group_exp_start_time.at(rg_value);
-        auto start_time = time_difference_seconds(start_time_dt, exp_start_dt);
+        auto exp_start_it = exp_start_times_us.find(std::string(rg_value));
+        if (exp_start_it == exp_start_times_us.end()) {
+            throw std::runtime_error("Read group " + std::string(rg_value) +
+                                     " is missing from the header");
+        }
+        double start_time = (timestamp_us(start_time_dt) - exp_start_it->second) / 1e6;
         auto template_start_time = start_time + (duration - template_duration);
 
-        std::cout << filename << separator << read_id << separator << run_id << separator << channel
-                  << separator << mux << separator << start_time << separator << duration
-                  << separator << template_start_time << separator << template_duration << separator
-                  << seqlen << separator << mean_qscore;
+        row.first(filename) << read_id << run_id << channel << mux << start_time << duration
+                            << template_start_time << template_duration << seqlen << mean_qscore;
 
-        if (reader.is_aligned) {
-            int32_t query_start = 0;
-            int32_t query_end = 0;
-            std::string alignment_genome = "*";
+        if (is_aligned) {
+            std::string_view alignment_genome = "*";
             int32_t alignment_genome_start = -1;
             int32_t alignment_genome_end = -1;
             int32_t alignment_strand_start = -1;
             int32_t alignment_strand_end = -1;
-            std::string alignment_direction = "*";
+            std::string_view alignment_direction = "*";
             int32_t alignment_length = 0;
             int32_t alignment_mapq = 0;
             int alignment_num_aligned = 0;
@@ -176,15 +150,15 @@ int summary(int argc, char *argv[]) {
             float alignment_identity = 0.0;
             float alignment_accurary = 0.0;
 
-            if (!(reader.record->core.flag & BAM_FUNMAP)) {
-                alignment_mapq = static_cast<int>(reader.record->core.qual);
-                alignment_genome = reader.header->target_name[reader.record->core.tid];
+            if (!(record->core.flag & BAM_FUNMAP)) {
+                alignment_mapq = static_cast<int>(record->core.qual);
+                alignment_genome = header->target_name[record->core.tid];
 
-                alignment_genome_start = reader.record->core.pos;
-                alignment_genome_end = bam_endpos(reader.record.get());
-                alignment_direction = bam_is_rev(reader.record) ? "-" : "+";
+                alignment_genome_start = record->core.pos;
+                alignment_genome_end = bam_endpos(record);
+                alignment_direction = bam_is_rev(record) ? "-" : "+";
 
-                auto alignment_counts = utils::get_alignment_op_counts(reader.record.get());
+                auto alignment_counts = utils::get_alignment_op_counts(record);
                 alignment_num_aligned = alignment_counts.matches;
                 alignment_num_correct = alignment_counts.matches - alignment_counts.substitutions;
                 alignment_num_insertions = alignment_counts.insertions;
@@ -202,18 +176,122 @@ int summary(int argc, char *argv[]) {
                 alignment_accurary = alignment_num_correct / static_cast<float>(alignment_length);
             }
 
-            std::cout << separator << alignment_genome << separator << alignment_genome_start
-                      << separator << alignment_genome_end << separator << alignment_strand_start
-                      << separator << alignment_strand_end << separator << alignment_direction
-                      << separator << alignment_length << separator << alignment_num_aligned
-                      << separator << alignment_num_correct << separator << alignment_num_insertions
-                      << separator << alignment_num_deletions << separator
-                      << alignment_num_substitutions << separator << alignment_mapq << separator
-                      << strand_coverage << separator << alignment_identity << separator
-                      << alignment_accurary;
+            row << alignment_genome << alignment_genome_start << alignment_genome_end
+                << alignment_strand_start << alignment_strand_end << alignment_direction
+                << alignment_length << alignment_num_aligned << alignment_num_correct
+                << alignment_num_insertions << alignment_num_deletions
+                << alignment_num_substitutions << alignment_mapq << strand_coverage
+                << alignment_identity << alignment_accurary;
         }
 
-        std::cout << '\n';
+        converted.rows.push_back('\n');
+    }
+    return converted;
+}
+
+}  // namespace
+
+int summary(int argc, char *argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+    parser.add_argument("reads").help("SAM/BAM file produced by dorado basecaller.");
+    parser.add_argument("-s", "--separator").default_value(std::string("\t"));
+    parser.add_argument("-t", "--threads")
+            .help("number of threads for BAM decompression and row formatting, 0 for all cores.")
+            .default_value(0)
+            .scan<'i', int>();
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception &e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        utils::SetDebugLogging();
+    }
+
+    auto reads(parser.get<std::string>("reads"));
+    auto separator(parser.get<std::string>("separator"));
+
+    auto threads(parser.get<int>("threads"));
+    threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
+    threads = std::max(threads, 1);
+
+    HtsReader reader(reads);
+    reader.set_decompression_threads(threads);
+
+    // Parse each read group's start time once, rather than for every record.
+    std::unordered_map<std::string, int64_t> exp_start_times_us;
+    for (const auto &[read_group, exp_start_dt] : utils::get_read_group_info(reader.header, "DT")) {
+        exp_start_times_us.emplace(read_group, timestamp_us(exp_start_dt));
+    }
+
+    spdlog::debug("> input fmt: {} aligned: {} threads: {}", reader.format, reader.is_aligned,
+                  threads);
+#ifndef _WIN32
+    std::signal(SIGPIPE, [](int signum) { interrupt = 1; });
+#endif
+    std::signal(SIGINT, [](int signum) { interrupt = 1; });
+
+    std::cout << utils::summary_header(reader.is_aligned, separator);
+
+    // One batch of records is formatted on the pool while the next is read, and the rows are
+    // written in the order of the records.  The records of each batch are reused, so decoding
+    // doesn't allocate once they have grown to fit.
+    cxxpool::thread_pool pool{static_cast<size_t>(threads)};
+    std::vector<BamPtr> batches[2];
+    std::vector<std::future<ConvertedRows>> conversions;
+
+    const auto read_batch = [&](std::vector<BamPtr> &batch) {
+        size_t num_records = 0;
+        while (!interrupt && reader.read()) {
+            if (num_records == batch.size()) {
+                batch.emplace_back(bam_init1());
+            }
+            std::swap(reader.record, batch[num_records++]);
+            if (num_records == kBatchSize) {
+                break;
+            }
+        }
+        return num_records;
+    };
+
+    // Writes the rows of the batch being converted, returning false if it had a record with no
+    // read group.
+    const auto write_rows = [&] {
+        for (auto &conversion : conversions) {
+            auto converted = conversion.get();
+            std::cout.write(converted.rows.data(), converted.rows.size());
+            if (converted.missing_read_group) {
+                spdlog::error("> Cannot generate sequencing summary for files with no RG tags");
+                return false;
+            }
+        }
+        conversions.clear();
+        return true;
+    };
+
+    int current = 0;
+    size_t num_records = read_batch(batches[current]);
+    while (num_records > 0) {
+        for (size_t begin = 0; begin < num_records; begin += kRecordsPerTask) {
+            const size_t end = std::min(begin + kRecordsPerTask, num_records);
+            conversions.push_back(pool.push([&, begin, end, current] {
+                return convert_records(batches[current], begin, end, reader.header,
+                                       reader.is_aligned, separator, exp_start_times_us);
+            }));
+        }
+        current ^= 1;
+        num_records = read_batch(batches[current]);
+        if (!write_rows()) {
+            return 1;
+        }
     }
 
     return 0;
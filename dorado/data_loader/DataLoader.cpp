@@ -1,10 +1,17 @@
 #include "DataLoader.h"
 
+#include "../utils/cache_utils.h"
 #include "../utils/compat_utils.h"
 #include "../utils/types.h"
 #include "cxxpool.h"
 #include "pod5_format/c_api.h"
+#include "read_pipeline/ReadOrderNode.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/FileReadAhead.h"
+#include "utils/ObjectStore.h"
+#include "utils/SignalBufferPool.h"
+#include "utils/log_utils.h"
+#include "utils/resume_utils.h"
 #include "utils/time_utils.h"
 #include "vbz_plugin_user_utils.h"
 
@@ -14,13 +21,24 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <future>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <thread>
 
 namespace {
 
+// Channels loaded together when loading by channel, and the number of groups of them loaded
+// at once, which together are PairingNode's number of shards.
+constexpr size_t kChannelsPerGroup = 16;
+constexpr size_t kChannelGroupsInFlight = 4;
+
 // ReadID should be a drop-in replacement for read_id_t
 static_assert(sizeof(dorado::ReadID) == sizeof(read_id_t));
 
@@ -67,13 +85,14 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
     ReadBatchRowInfo_t read_data;
     if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION, &read_data,
                                           &read_table_version) != POD5_OK) {
-        spdlog::error("Failed to get read {}", row);
+        DORADO_LOG_EVERY_MS(spdlog::level::err, 1000, "Failed to get read {}", row);
     }
 
     //Retrieve global information for the run
     RunInfoDictData_t* run_info_data;
     if (pod5_get_run_info(batch, read_data.run_info, &run_info_data) != POD5_OK) {
-        spdlog::error("Failed to get Run Info {}{}", row, pod5_get_error_string());
+        DORADO_LOG_EVERY_MS(spdlog::level::err, 1000, "Failed to get Run Info {}{}", row,
+                            pod5_get_error_string());
     }
     auto run_acquisition_start_time_ms = run_info_data->acquisition_start_time_ms;
     auto run_sample_rate = run_info_data->sample_rate;
@@ -82,12 +101,12 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
     pod5_error_t err = pod5_format_read_id(read_data.read_id, read_id_tmp);
     std::string read_id_str(read_id_tmp);
 
-    auto options = torch::TensorOptions().dtype(torch::kInt16);
-    auto samples = torch::empty(read_data.num_samples, options);
+    auto samples = utils::SignalBufferPool::shared().allocate(read_data.num_samples, torch::kInt16);
 
     if (pod5_get_read_complete_signal(file, batch, row, read_data.num_samples,
                                       samples.data_ptr<int16_t>()) != POD5_OK) {
-        spdlog::error("Failed to get read {} signal: {}", row, pod5_get_error_string());
+        DORADO_LOG_EVERY_MS(spdlog::level::err, 1000, "Failed to get read {} signal: {}", row,
+                            pod5_get_error_string());
     }
 
     auto new_read = std::make_shared<dorado::Read>();
@@ -124,26 +143,55 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
 
 bool can_process_pod5_row(Pod5ReadRecordBatch_t* batch,
                           int row,
-                          const std::optional<std::unordered_set<std::string>>& allowed_read_ids,
-                          const std::unordered_set<std::string>& ignored_read_ids) {
+                          const std::optional<dorado::ReadIDSet>& allowed_read_ids,
+                          const dorado::ReadIDSet& ignored_read_ids,
+                          const dorado::ChannelShard& channel_shard) {
     uint16_t read_table_version = 0;
     ReadBatchRowInfo_t read_data;
     if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION, &read_data,
                                           &read_table_version) != POD5_OK) {
-        spdlog::error("Failed to get read {}", row);
+        DORADO_LOG_EVERY_MS(spdlog::level::err, 1000, "Failed to get read {}", row);
         return false;
     }
 
-    char read_id_tmp[POD5_READ_ID_LEN];
-    pod5_error_t err = pod5_format_read_id(read_data.read_id, read_id_tmp);
-    std::string read_id_str(read_id_tmp);
-    bool read_in_ignore_list = ignored_read_ids.find(read_id_str) != ignored_read_ids.end();
-    bool read_in_read_list =
-            !allowed_read_ids || (allowed_read_ids->find(read_id_str) != allowed_read_ids->end());
-    if (!read_in_ignore_list && read_in_read_list) {
-        return true;
+    dorado::ReadID read_id;
+    std::memcpy(read_id.data(), read_data.read_id, dorado::POD5_READ_ID_SIZE);
+    return channel_shard.contains(read_data.channel) && ignored_read_ids.count(read_id) == 0 &&
+           (!allowed_read_ids || allowed_read_ids->count(read_id) != 0);
+}
+
+// Gives each of the reads a ticket from read_order, if their order is being kept.
+void issue_order_tickets(ReadOrderNode* read_order, std::vector<Message>& reads) {
+    if (!read_order) {
+        return;
+    }
+    for (auto& read : reads) {
+        std::get<std::shared_ptr<Read>>(read)->order_ticket = read_order->issue_ticket();
     }
-    return false;
+}
+
+ChannelShard ChannelShard::parse(const std::string& text) {
+    const auto slash = text.find('/');
+    ChannelShard shard;
+    try {
+        if (slash == std::string::npos) {
+            throw std::invalid_argument(text);
+        }
+        size_t index_end = 0, count_end = 0;
+        const auto index = std::stoull(text.substr(0, slash), &index_end);
+        const auto count = std::stoull(text.substr(slash + 1), &count_end);
+        if (index_end != slash || count_end != text.size() - slash - 1 ||
+            text[0] == '-' || text[slash + 1] == '-') {
+            throw std::invalid_argument(text);
+        }
+        shard = {size_t(index), size_t(count)};
+    } catch (const std::exception&) {
+        throw std::runtime_error("Channel shard must be given as <index>/<count>, not " + text);
+    }
+    if (shard.count == 0 || shard.index >= shard.count) {
+        throw std::runtime_error("Channel shard index must be less than the count, not " + text);
+    }
+    return shard;
 }
 
 void Pod5Destructor::operator()(Pod5FileReader_t* pod5) { pod5_close_and_free_reader(pod5); }
@@ -151,6 +199,15 @@ void Pod5Destructor::operator()(Pod5FileReader_t* pod5) { pod5_close_and_free_re
 void DataLoader::load_reads(const std::string& path,
                             bool recursive_file_loading,
                             ReadOrder traversal_order) {
+    if (utils::is_object_store_url(path)) {
+        if (traversal_order != UNRESTRICTED) {
+            throw std::runtime_error("Traversing reads by channel is only available for local "
+                                     "POD5 files.");
+        }
+        load_object_store_reads(path, recursive_file_loading);
+        m_read_sink.terminate();
+        return;
+    }
     if (!std::filesystem::exists(path)) {
         spdlog::error("Requested input path {} does not exist!", path);
         m_read_sink.terminate();
@@ -164,7 +221,7 @@ void DataLoader::load_reads(const std::string& path,
 
     auto iterate_directory = [&](const auto& iterator_fn) {
         switch (traversal_order) {
-        case BY_CHANNEL:
+        case BY_CHANNEL: {
             // If traversal in channel order is required, the following algorithm
             // is used -
             // 1. iterate through all the read metadata to collect channel information
@@ -173,33 +230,29 @@ void DataLoader::load_reads(const std::string& path,
             spdlog::info("> Reading read channel info");
             load_read_channels(path, recursive_file_loading);
             spdlog::info("> Processed read channel info");
-            // 3. for each channel, iterate through all files and in each iteration
-            // only load the reads that correspond to that channel.
-            for (int channel = 0; channel <= m_max_channel; channel++) {
-                for (const auto& entry : iterator_fn(path)) {
-                    if (m_loaded_read_count == m_max_reads) {
-                        break;
-                    }
-                    auto path = std::filesystem::path(entry);
-                    std::string ext = path.extension().string();
-                    std::transform(ext.begin(), ext.end(), ext.begin(),
-                                   [](unsigned char c) { return std::tolower(c); });
-                    if (ext == ".fast5") {
-                        throw std::runtime_error(
-                                "Traversing reads by channel is only availabls for POD5. "
-                                "Encountered FAST5 at " +
-                                path.string());
-                    } else if (ext == ".pod5") {
-                        auto& channel_to_read_ids = m_file_channel_read_order_map.at(path.string());
-                        auto& read_ids = channel_to_read_ids[channel];
-                        if (!read_ids.empty()) {
-                            load_pod5_reads_from_file_by_read_ids(path.string(), read_ids);
-                        }
-                    }
+            // 3. load the reads of each group of channels from every file in turn.
+            std::vector<std::string> pod5_paths;
+            for (const auto& entry : iterator_fn(path)) {
+                auto path = std::filesystem::path(entry);
+                std::string ext = path.extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(),
+                               [](unsigned char c) { return std::tolower(c); });
+                if (ext == ".fast5") {
+                    throw std::runtime_error(
+                            "Traversing reads by channel is only availabls for POD5. "
+                            "Encountered FAST5 at " +
+                            path.string());
+                } else if (ext == ".pod5") {
+                    pod5_paths.push_back(path.string());
                 }
             }
+            load_pod5_reads_by_channel(pod5_paths);
             break;
-        case UNRESTRICTED:
+        }
+        case UNRESTRICTED: {
+            // Consecutive POD5 files are loaded together, so that decoding can run ahead
+            // into the next file.
+            std::vector<std::string> pod5_paths;
             for (const auto& entry : iterator_fn(path)) {
                 if (m_loaded_read_count == m_max_reads) {
                     break;
@@ -207,13 +260,17 @@ void DataLoader::load_reads(const std::string& path,
                 std::string ext = std::filesystem::path(entry).extension().string();
                 std::transform(ext.begin(), ext.end(), ext.begin(),
                                [](unsigned char c) { return std::tolower(c); });
-                if (ext == ".fast5") {
+                if (ext == ".pod5") {
+                    pod5_paths.push_back(entry.path().string());
+                } else if (ext == ".fast5") {
+                    load_pod5_reads_from_files(pod5_paths);
+                    pod5_paths.clear();
                     load_fast5_reads_from_file(entry.path().string());
-                } else if (ext == ".pod5") {
-                    load_pod5_reads_from_file(entry.path().string());
                 }
             }
+            load_pod5_reads_from_files(pod5_paths);
             break;
+        }
         default:
             throw std::runtime_error("Unsupported traversal order detected " +
                                      std::to_string(traversal_order));
@@ -232,198 +289,246 @@ void DataLoader::load_reads(const std::string& path,
     m_read_sink.terminate();
 }
 
-int DataLoader::get_num_reads(std::string data_path,
-                              std::optional<std::unordered_set<std::string>> read_list,
-                              const std::unordered_set<std::string>& ignore_read_list,
-                              bool recursive_file_loading) {
-    size_t num_reads = 0;
+void DataLoader::watch_reads(const std::string& path,
+                             bool recursive_file_loading,
+                             std::chrono::milliseconds poll_interval,
+                             std::chrono::milliseconds idle_timeout) {
+    if (!std::filesystem::is_directory(path)) {
+        spdlog::error("Requested input path {} is not a directory!", path);
+        m_read_sink.terminate();
+        return;
+    }
 
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn(data_path)) {
-            std::string ext = std::filesystem::path(entry).extension().string();
+    auto list_files = [&] {
+        std::vector<std::filesystem::path> files;
+        auto add_file = [&files](const std::filesystem::directory_entry& entry) {
+            std::string ext = entry.path().extension().string();
             std::transform(ext.begin(), ext.end(), ext.begin(),
                            [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(entry.path().string().c_str());
-
-                size_t read_count;
-                pod5_get_read_count(file, &read_count);
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", entry.path().string().c_str(),
-                                  pod5_get_error_string());
-                }
-
-                num_reads += read_count;
-                if (pod5_close_and_free_reader(file) != POD5_OK) {
-                    spdlog::error("Failed to close and free POD5 reader");
-                }
+            if (entry.is_regular_file() && (ext == ".fast5" || ext == ".pod5")) {
+                files.push_back(entry.path());
+            }
+        };
+        if (recursive_file_loading) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                add_file(entry);
+            }
+        } else {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                add_file(entry);
             }
         }
+        // Load files in name order, which for acquisition output is the order they were written.
+        std::sort(files.begin(), files.end());
+        return files;
     };
 
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+    std::unordered_set<std::string> loaded_files;
+    // Files still being watched, and their sizes at the last poll.
+    std::unordered_map<std::string, std::uintmax_t> pending_file_sizes;
+    auto last_activity = std::chrono::steady_clock::now();
+    spdlog::info("> Watching {} for new reads", path);
+    while (m_loaded_read_count < m_max_reads) {
+        for (const auto& file : list_files()) {
+            if (m_loaded_read_count == m_max_reads) {
+                break;
+            }
+            const auto file_name = file.string();
+            if (loaded_files.count(file_name)) {
+                continue;
+            }
+            std::error_code error;
+            const auto size = std::filesystem::file_size(file, error);
+            if (error) {
+                continue;
+            }
+            auto pending = pending_file_sizes.find(file_name);
+            if (pending != pending_file_sizes.end() && pending->second == size) {
+                load_read_file(file);
+                loaded_files.insert(file_name);
+                pending_file_sizes.erase(pending);
+            } else {
+                pending_file_sizes[file_name] = size;
+            }
+            last_activity = std::chrono::steady_clock::now();
+        }
+        if (std::chrono::steady_clock::now() - last_activity >= idle_timeout) {
+            break;
+        }
+        std::this_thread::sleep_for(poll_interval);
     }
+    spdlog::info("> Stopped watching {}", path);
 
-    // Remove the reads in the ignore list from the total dataset read count.
-    num_reads -= ignore_read_list.size();
+    m_read_sink.terminate();
+}
 
-    if (read_list) {
-        // Get the unique read ids in the read list, since everything in the ignore
-        // list will be skipped over.
-        std::vector<std::string> final_read_list;
-        std::set_difference(read_list->begin(), read_list->end(), ignore_read_list.begin(),
-                            ignore_read_list.end(),
-                            std::inserter(final_read_list, final_read_list.begin()));
-        num_reads = std::min(num_reads, final_read_list.size());
+void DataLoader::load_read_file(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (ext == ".fast5") {
+        load_fast5_reads_from_file(path.string());
+    } else if (ext == ".pod5") {
+        load_pod5_reads_from_file(path.string());
     }
-
-    return num_reads;
 }
 
-void DataLoader::load_read_channels(std::string data_path, bool recursive_file_loading) {
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn(data_path)) {
-            auto file_path = std::filesystem::path(entry);
-            std::string ext = file_path.extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext != ".pod5") {
-                continue;
-            }
-            pod5_init();
+namespace {
 
-            // Use a std::map to store by sorted channel order.
-            m_file_channel_read_order_map.emplace(file_path.string(), channel_to_read_id_t());
-            auto& channel_to_read_id = m_file_channel_read_order_map[file_path.string()];
+// Reads the channel and ID of every read in a POD5 file.
+channel_to_read_id_t scan_read_channels(const std::string& path) {
+    // Use a std::map to store by sorted channel order.
+    channel_to_read_id_t channel_to_read_id;
 
-            // Open the file ready for walking:
-            Pod5FileReader_t* file = pod5_open_file(file_path.string().c_str());
+    // Open the file ready for walking:
+    Pod5FileReader_t* file = pod5_open_file(path.c_str());
 
-            if (!file) {
-                spdlog::error("Failed to open file {}: {}", file_path.string().c_str(),
-                              pod5_get_error_string());
+    if (!file) {
+        spdlog::error("Failed to open file {}: {}", path, pod5_get_error_string());
+        return channel_to_read_id;
+    }
+    std::size_t batch_count = 0;
+    if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
+        spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+    }
+
+    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
+        Pod5ReadRecordBatch_t* batch = nullptr;
+        if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
+            spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+            continue;
+        }
+
+        std::size_t batch_row_count = 0;
+        if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
+            spdlog::error("Failed to get batch row count");
+            continue;
+        }
+
+        for (std::size_t row = 0; row < batch_row_count; ++row) {
+            uint16_t read_table_version = 0;
+            ReadBatchRowInfo_t read_data;
+            if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
+                                                  &read_data, &read_table_version) != POD5_OK) {
+                DORADO_LOG_EVERY_MS(spdlog::level::err, 1000, "Failed to get read {}", row);
                 continue;
             }
-            std::size_t batch_count = 0;
-            if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
-                spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
-            }
 
-            for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-                Pod5ReadRecordBatch_t* batch = nullptr;
-                if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
-                    spdlog::error("Failed to get batch: {}", pod5_get_error_string());
-                    continue;
-                }
-
-                std::size_t batch_row_count = 0;
-                if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
-                    spdlog::error("Failed to get batch row count");
-                    continue;
-                }
+            // Store the read_id in the channel's list.
+            ReadID read_id;
+            std::memcpy(read_id.data(), read_data.read_id, POD5_READ_ID_SIZE);
+            channel_to_read_id[read_data.channel].push_back(std::move(read_id));
+        }
 
-                for (std::size_t row = 0; row < batch_row_count; ++row) {
-                    uint16_t read_table_version = 0;
-                    ReadBatchRowInfo_t read_data;
-                    if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
-                                                          &read_data,
-                                                          &read_table_version) != POD5_OK) {
-                        spdlog::error("Failed to get read {}", row);
-                        continue;
-                    }
-
-                    int channel = read_data.channel;
-
-                    // Update maximum number of channels encountered.
-                    m_max_channel = std::max(m_max_channel, channel);
-
-                    // Store the read_id in the channel's list.
-                    ReadID read_id;
-                    std::memcpy(read_id.data(), read_data.read_id, POD5_READ_ID_SIZE);
-                    channel_to_read_id[channel].push_back(std::move(read_id));
-                }
+        if (pod5_free_read_batch(batch) != POD5_OK) {
+            spdlog::error("Failed to release batch");
+        }
+    }
+    if (pod5_close_and_free_reader(file) != POD5_OK) {
+        spdlog::error("Failed to close and free POD5 reader");
+    }
+    return channel_to_read_id;
+}
 
-                if (pod5_free_read_batch(batch) != POD5_OK) {
-                    spdlog::error("Failed to release batch");
-                }
-            }
-            if (pod5_close_and_free_reader(file) != POD5_OK) {
-                spdlog::error("Failed to close and free POD5 reader");
-            }
+// Channel indexes are cached, as building them means reading the metadata of every read.
+// An index is a version, the number of channels, then for each channel its number, its read
+// count and the IDs of its reads, in file order.
+constexpr uint32_t kChannelIndexVersion = 1;
+
+void write_channel_index(const std::filesystem::path& path,
+                         const channel_to_read_id_t& channel_to_read_id) {
+    utils::write_cache_file(path, [&channel_to_read_id](const std::filesystem::path& temp_path) {
+        std::ofstream file(temp_path, std::ios::binary);
+        auto write_u32 = [&file](uint32_t value) {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        write_u32(kChannelIndexVersion);
+        write_u32(static_cast<uint32_t>(channel_to_read_id.size()));
+        for (const auto& [channel, read_ids] : channel_to_read_id) {
+            write_u32(static_cast<uint32_t>(channel));
+            write_u32(static_cast<uint32_t>(read_ids.size()));
+            file.write(reinterpret_cast<const char*>(read_ids.data()),
+                       read_ids.size() * sizeof(ReadID));
         }
+        if (!file) {
+            throw std::runtime_error("write failed");
+        }
+    });
+}
+
+std::optional<channel_to_read_id_t> read_channel_index(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    auto read_u32 = [&file] {
+        uint32_t value = 0;
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
     };
+    if (!file || read_u32() != kChannelIndexVersion) {
+        return std::nullopt;
+    }
+    channel_to_read_id_t channel_to_read_id;
+    const uint32_t num_channels = read_u32();
+    for (uint32_t i = 0; i < num_channels && file; ++i) {
+        const auto channel = static_cast<int>(read_u32());
+        const uint32_t num_reads = read_u32();
+        if (!file) {
+            break;
+        }
+        auto& read_ids = channel_to_read_id[channel];
+        read_ids.resize(num_reads);
+        file.read(reinterpret_cast<char*>(read_ids.data()), num_reads * sizeof(ReadID));
+    }
+    if (!file) {
+        spdlog::debug("Ignoring truncated channel index {}", path.string());
+        return std::nullopt;
+    }
+    return channel_to_read_id;
+}
 
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+// Reads the file's channel index from the cache, building and caching it if need be.
+channel_to_read_id_t load_file_read_channels(const std::string& path) {
+    std::optional<std::filesystem::path> index_path;
+    if (auto cache_dir = utils::get_cache_dir()) {
+        try {
+            // The index goes stale if the file is changed or replaced.
+            index_path = *cache_dir / utils::kChannelIndexCacheDir /
+                         utils::cache_file_name({utils::file_fingerprint(path)}, ".idx");
+        } catch (const std::filesystem::filesystem_error& e) {
+            spdlog::debug("Not caching channel index for {}: {}", path, e.what());
+        }
     }
+    if (index_path) {
+        if (auto channel_to_read_id = read_channel_index(*index_path)) {
+            return std::move(*channel_to_read_id);
+        }
+    }
+
+    auto channel_to_read_id = scan_read_channels(path);
+    if (index_path) {
+        write_channel_index(*index_path, channel_to_read_id);
+    }
+    return channel_to_read_id;
 }
 
-std::unordered_map<std::string, ReadGroup> DataLoader::load_read_groups(
-        std::string data_path,
-        std::string model_path,
-        bool recursive_file_loading) {
-    std::unordered_map<std::string, ReadGroup> read_groups;
+}  // namespace
 
+void DataLoader::load_read_channels(std::string data_path, bool recursive_file_loading) {
+    pod5_init();
+
+    // Files are indexed in parallel, and indexes of files seen before are reused.
+    std::vector<std::pair<std::string, std::future<channel_to_read_id_t>>> file_channels;
     auto iterate_directory = [&](const auto& iterator_fn) {
         for (const auto& entry : iterator_fn(data_path)) {
-            std::string ext = std::filesystem::path(entry).extension().string();
+            auto file_path = std::filesystem::path(entry);
+            std::string ext = file_path.extension().string();
             std::transform(ext.begin(), ext.end(), ext.begin(),
                            [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(entry.path().string().c_str());
-
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", entry.path().string().c_str(),
-                                  pod5_get_error_string());
-                } else {
-                    // First get the run info count
-                    run_info_index_t run_info_count;
-                    pod5_get_file_run_info_count(file, &run_info_count);
-                    for (run_info_index_t idx = 0; idx < run_info_count; idx++) {
-                        RunInfoDictData_t* run_info_data;
-                        pod5_get_file_run_info(file, idx, &run_info_data);
-
-                        auto exp_start_time_ms = run_info_data->acquisition_start_time_ms;
-                        std::string flowcell_id = run_info_data->flow_cell_id;
-                        std::string device_id = run_info_data->system_name;
-                        std::string run_id = run_info_data->acquisition_id;
-                        std::string sample_id = run_info_data->sample_id;
-
-                        if (pod5_free_run_info(run_info_data) != POD5_OK) {
-                            spdlog::error("Failed to free run info");
-                        }
-
-                        std::string id = run_id + "_" + model_path;
-                        read_groups[id] = ReadGroup{
-                                run_id,
-                                model_path,
-                                flowcell_id,
-                                device_id,
-                                utils::get_string_timestamp_from_unix_time(exp_start_time_ms),
-                                sample_id};
-                    }
-                    if (pod5_close_and_free_reader(file) != POD5_OK) {
-                        spdlog::error("Failed to close and free POD5 reader");
-                    }
-                }
+            if (ext != ".pod5") {
+                continue;
             }
+            file_channels.emplace_back(
+                    file_path.string(),
+                    m_thread_pool->push(load_file_read_channels, file_path.string()));
         }
     };
 
@@ -436,98 +541,371 @@ std::unordered_map<std::string, ReadGroup> DataLoader::load_read_groups(
                 [](const auto& path) { return std::filesystem::directory_iterator(path); });
     }
 
-    return read_groups;
+    for (auto& [path, channel_to_read_id] : file_channels) {
+        auto& file_channel_read_order = m_file_channel_read_order_map[path];
+        file_channel_read_order = channel_to_read_id.get();
+        // Update maximum number of channels encountered.
+        if (!file_channel_read_order.empty()) {
+            m_max_channel = std::max(m_max_channel, file_channel_read_order.rbegin()->first);
+        }
+    }
 }
 
-uint16_t DataLoader::get_sample_rate(std::string data_path, bool recursive_file_loading) {
-    std::optional<uint16_t> sample_rate = std::nullopt;
+namespace {
 
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn((data_path))) {
-            std::string ext = std::filesystem::path(entry).extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            auto file_path = entry.path().string();
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(file_path.c_str());
-
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", file_path.c_str(),
-                                  pod5_get_error_string());
-                } else {
-                    // First get the run info count
-                    run_info_index_t run_info_count;
-                    if (pod5_get_file_run_info_count(file, &run_info_count) != POD5_OK) {
-                        spdlog::error("Failed to fetch POD5 run info count for file {} : {}",
-                                      file_path.c_str(), pod5_get_error_string());
-                        continue;
-                    }
-                    if (run_info_count > static_cast<run_info_index_t>(0)) {
-                        RunInfoDictData_t* run_info_data;
-                        if (pod5_get_file_run_info(file, 0, &run_info_data) != POD5_OK) {
-                            spdlog::error(
-                                    "Failed to fetch POD5 run info dict for file {} and run info "
-                                    "index 0: {}",
-                                    file_path.c_str(), pod5_get_error_string());
-                            continue;
-                        }
-                        sample_rate = run_info_data->sample_rate;
-
-                        if (pod5_free_run_info(run_info_data) != POD5_OK) {
-                            spdlog::error(
-                                    "Failed to free POD5 run info for file {} and run info index 0",
-                                    file_path.c_str());
-                        }
-                    }
-                }
+// The metadata of one read file.
+struct FileMetadata {
+    size_t num_reads{0};
+    std::vector<ReadGroup> runs;
+    std::optional<uint16_t> sample_rate;
+};
 
-                if (pod5_close_and_free_reader(file) != POD5_OK) {
-                    spdlog::error("Failed to close and free POD5 reader for file {}",
-                                  file_path.c_str());
-                }
-            } else if (ext == ".fast5") {
-                H5Easy::File file(entry.path().string(), H5Easy::File::ReadOnly);
-                HighFive::Group reads = file.getGroup("/");
-                int num_reads = reads.getNumberObjects();
-
-                if (num_reads > 0) {
-                    auto read_id = reads.getObjectName(0);
-                    HighFive::Group read = reads.getGroup(read_id);
-
-                    HighFive::Group channel_id_group = read.getGroup("channel_id");
-                    HighFive::Attribute sampling_rate_attr =
-                            channel_id_group.getAttribute("sampling_rate");
-
-                    float sampling_rate;
-                    sampling_rate_attr.read(sampling_rate);
-                    sample_rate = static_cast<uint16_t>(sampling_rate);
-                }
-            }
+std::string lowercase_extension(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
 
-            // Break out of loop if sample rate is found.
-            if (sample_rate) {
-                break;
+// Read files of data_path in the order they are found: data_path itself if it is a file,
+// otherwise the FAST5 and POD5 files in it, and with recursive_file_loading in its
+// subdirectories too.
+std::vector<std::filesystem::path> find_read_files(const std::string& data_path,
+                                                   bool recursive_file_loading) {
+    std::vector<std::filesystem::path> paths;
+    auto add_read_file = [&paths](const std::filesystem::path& path) {
+        const auto ext = lowercase_extension(path);
+        if (ext == ".pod5" || ext == ".fast5") {
+            paths.push_back(path);
+        }
+    };
+    if (std::filesystem::is_regular_file(data_path)) {
+        // A single file, as in the work units of a distributed run.
+        add_read_file(data_path);
+    } else if (recursive_file_loading) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(data_path)) {
+            add_read_file(entry.path());
+        }
+    } else {
+        for (const auto& entry : std::filesystem::directory_iterator(data_path)) {
+            add_read_file(entry.path());
+        }
+    }
+    return paths;
+}
+
+FileMetadata scan_pod5_metadata(const std::string& path) {
+    FileMetadata metadata;
+    Pod5Ptr file(pod5_open_file(path.c_str()));
+    if (!file) {
+        spdlog::error("Failed to open file {}: {}", path, pod5_get_error_string());
+        return metadata;
+    }
+
+    if (pod5_get_read_count(file.get(), &metadata.num_reads) != POD5_OK) {
+        spdlog::error("Failed to fetch POD5 read count for file {} : {}", path,
+                      pod5_get_error_string());
+    }
+
+    run_info_index_t run_info_count;
+    if (pod5_get_file_run_info_count(file.get(), &run_info_count) != POD5_OK) {
+        spdlog::error("Failed to fetch POD5 run info count for file {} : {}", path,
+                      pod5_get_error_string());
+        return metadata;
+    }
+    for (run_info_index_t idx = 0; idx < run_info_count; idx++) {
+        RunInfoDictData_t* run_info_data;
+        if (pod5_get_file_run_info(file.get(), idx, &run_info_data) != POD5_OK) {
+            spdlog::error("Failed to fetch POD5 run info dict for file {} and run info index "
+                          "{}: {}",
+                          path, idx, pod5_get_error_string());
+            continue;
+        }
+        if (!metadata.sample_rate) {
+            metadata.sample_rate = run_info_data->sample_rate;
+        }
+        metadata.runs.push_back(ReadGroup{
+                run_info_data->acquisition_id, "", run_info_data->flow_cell_id,
+                run_info_data->system_name,
+                utils::get_string_timestamp_from_unix_time(
+                        run_info_data->acquisition_start_time_ms),
+                run_info_data->sample_id});
+        if (pod5_free_run_info(run_info_data) != POD5_OK) {
+            spdlog::error("Failed to free POD5 run info for file {} and run info index {}", path,
+                          idx);
+        }
+    }
+    return metadata;
+}
+
+// FAST5 files are only opened for their sample rate, from their first read.
+FileMetadata scan_fast5_metadata(const std::string& path) {
+    FileMetadata metadata;
+    H5Easy::File file(path, H5Easy::File::ReadOnly);
+    HighFive::Group reads = file.getGroup("/");
+    if (reads.getNumberObjects() > 0) {
+        auto read_id = reads.getObjectName(0);
+        HighFive::Group read = reads.getGroup(read_id);
+
+        HighFive::Group channel_id_group = read.getGroup("channel_id");
+        HighFive::Attribute sampling_rate_attr = channel_id_group.getAttribute("sampling_rate");
+
+        float sampling_rate;
+        sampling_rate_attr.read(sampling_rate);
+        metadata.sample_rate = static_cast<uint16_t>(sampling_rate);
+    }
+    return metadata;
+}
+
+// File metadata is cached by file, as gathering it means opening every file, which is slow on
+// network storage.  An entry is a version, the read count, whether there is a sample rate and
+// the rate, then the number of runs and each run's strings, each preceded by its length.
+constexpr uint32_t kFileMetadataVersion = 1;
+
+void write_file_metadata(const std::filesystem::path& path, const FileMetadata& metadata) {
+    utils::write_cache_file(path, [&metadata](const std::filesystem::path& temp_path) {
+        std::ofstream file(temp_path, std::ios::binary);
+        auto write = [&file](const auto& value) {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        auto write_string = [&](const std::string& value) {
+            write(static_cast<uint32_t>(value.size()));
+            file.write(value.data(), value.size());
+        };
+        write(kFileMetadataVersion);
+        write(static_cast<uint64_t>(metadata.num_reads));
+        write(static_cast<uint8_t>(metadata.sample_rate.has_value()));
+        write(metadata.sample_rate.value_or(0));
+        write(static_cast<uint32_t>(metadata.runs.size()));
+        for (const auto& run : metadata.runs) {
+            for (const auto* value : {&run.run_id, &run.flowcell_id, &run.device_id,
+                                      &run.exp_start_time, &run.sample_id}) {
+                write_string(*value);
             }
         }
+        if (!file) {
+            throw std::runtime_error("write failed");
+        }
+    });
+}
+
+std::optional<FileMetadata> read_file_metadata(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    auto read = [&file](auto& value) {
+        file.read(reinterpret_cast<char*>(&value), sizeof(value));
+    };
+    auto read_string = [&](std::string& value) {
+        uint32_t size = 0;
+        read(size);
+        if (file) {
+            value.resize(size);
+            file.read(value.data(), size);
+        }
     };
+    uint32_t version = 0;
+    read(version);
+    if (!file || version != kFileMetadataVersion) {
+        return std::nullopt;
+    }
+    FileMetadata metadata;
+    uint64_t num_reads = 0;
+    uint8_t has_sample_rate = 0;
+    uint16_t sample_rate = 0;
+    uint32_t num_runs = 0;
+    read(num_reads);
+    read(has_sample_rate);
+    read(sample_rate);
+    read(num_runs);
+    metadata.num_reads = num_reads;
+    if (has_sample_rate) {
+        metadata.sample_rate = sample_rate;
+    }
+    for (uint32_t i = 0; i < num_runs && file; ++i) {
+        auto& run = metadata.runs.emplace_back();
+        for (auto* value : {&run.run_id, &run.flowcell_id, &run.device_id, &run.exp_start_time,
+                            &run.sample_id}) {
+            read_string(*value);
+        }
+    }
+    if (!file) {
+        spdlog::debug("Ignoring truncated file metadata {}", path.string());
+        return std::nullopt;
+    }
+    return metadata;
+}
 
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+// Reads the POD5 file's metadata from the cache, scanning and caching it if need be.
+FileMetadata load_pod5_metadata(const std::string& path) {
+    std::optional<std::filesystem::path> metadata_path;
+    if (auto cache_dir = utils::get_cache_dir()) {
+        try {
+            // The entry goes stale if the file is changed or replaced.
+            metadata_path = *cache_dir / utils::kFileMetadataCacheDir /
+                            utils::cache_file_name({utils::file_fingerprint(path)}, ".meta");
+        } catch (const std::filesystem::filesystem_error& e) {
+            spdlog::debug("Not caching metadata for {}: {}", path, e.what());
+        }
+    }
+    if (metadata_path) {
+        if (auto metadata = read_file_metadata(*metadata_path)) {
+            return std::move(*metadata);
+        }
     }
 
-    if (sample_rate) {
-        return *sample_rate;
-    } else {
+    auto metadata = scan_pod5_metadata(path);
+    if (metadata_path) {
+        write_file_metadata(*metadata_path, metadata);
+    }
+    return metadata;
+}
+
+// Files are opened this many at a time, as their latency adds up on network storage.
+constexpr size_t kMaxMetadataScanThreads = 16;
+
+// Where objects are staged for loading: in the cache, so that an interrupted run can pick up
+// the objects it had already downloaded, or a temporary directory if there is no cache.
+std::filesystem::path object_staging_dir() {
+    if (auto cache_dir = utils::get_cache_dir()) {
+        return *cache_dir / utils::kObjectCacheDir;
+    }
+    return std::filesystem::temp_directory_path() / ("dorado_" + utils::kObjectCacheDir);
+}
+
+// The read files under the object store URL, directly under its prefix unless recursive.
+std::vector<utils::ObjectInfo> list_read_objects(const std::string& url, bool recursive) {
+    utils::ObjectStoreClient client(url);
+    std::vector<utils::ObjectInfo> read_objects;
+    for (auto& object : client.list_objects()) {
+        auto name = object.key.substr(client.prefix().size());
+        if (!name.empty() && name.front() == '/') {
+            name.erase(0, 1);
+        }
+        const auto ext = lowercase_extension(object.key);
+        if ((ext == ".pod5" || ext == ".fast5") &&
+            (recursive || name.find('/') == std::string::npos)) {
+            read_objects.push_back(std::move(object));
+        }
+    }
+    return read_objects;
+}
+
+// Only the first read file is downloaded for the metadata, rather than the whole dataset, and
+// kept staged for loading, so the read count isn't known and the read groups are those of the
+// first file.
+DataSetMetadata scan_object_store_metadata(const std::string& url, bool recursive) {
+    auto objects = list_read_objects(url, recursive);
+    DataSetMetadata metadata;
+    if (objects.empty()) {
+        return metadata;
+    }
+    spdlog::info("> Taking read groups and sample rate from the first of {} files in {}",
+                 objects.size(), url);
+    objects.resize(1);
+    utils::ObjectPrefetcher prefetcher(url, std::move(objects), object_staging_dir());
+    if (auto path = prefetcher.next()) {
+        auto file_metadata = lowercase_extension(*path) == ".pod5"
+                                     ? load_pod5_metadata(path->string())
+                                     : scan_fast5_metadata(path->string());
+        metadata.runs = std::move(file_metadata.runs);
+        metadata.sample_rate = file_metadata.sample_rate;
+    }
+    return metadata;
+}
+
+}  // namespace
+
+std::unordered_map<std::string, ReadGroup> DataSetMetadata::read_groups(
+        const std::string& model_name) const {
+    std::unordered_map<std::string, ReadGroup> read_groups;
+    for (const auto& run : runs) {
+        auto read_group = run;
+        read_group.basecalling_model = model_name;
+        read_groups[run.run_id + "_" + model_name] = std::move(read_group);
+    }
+    return read_groups;
+}
+
+size_t DataSetMetadata::num_reads_to_load(
+        const std::optional<std::unordered_set<std::string>>& read_list,
+        const ReadIDSet& ignore_read_list) const {
+    // Remove the reads in the ignore list from the total dataset read count.
+    size_t num_reads_left = num_reads - std::min(num_reads, ignore_read_list.size());
+
+    if (read_list) {
+        // Only the listed reads which aren't also ignored will be loaded.
+        size_t num_listed_reads = 0;
+        for (const auto& read_id : *read_list) {
+            auto parsed = utils::parse_read_id(read_id);
+            if (!parsed || ignore_read_list.find(*parsed) == ignore_read_list.end()) {
+                ++num_listed_reads;
+            }
+        }
+        num_reads_left = std::min(num_reads_left, num_listed_reads);
+    }
+    return num_reads_left;
+}
+
+DataSetMetadata DataLoader::scan_metadata(const std::string& data_path,
+                                          bool recursive_file_loading) {
+    pod5_init();
+    if (utils::is_object_store_url(data_path)) {
+        return scan_object_store_metadata(data_path, recursive_file_loading);
+    }
+    const auto paths = find_read_files(data_path, recursive_file_loading);
+
+    // Every POD5 file is scanned for the read count and read groups, but FAST5 files are only
+    // opened until one gives the sample rate.
+    const size_t num_threads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                                  kMaxMetadataScanThreads);
+    cxxpool::thread_pool pool(num_threads);
+    std::vector<std::optional<std::future<FileMetadata>>> pod5_metadata;
+    for (const auto& path : paths) {
+        if (lowercase_extension(path) == ".pod5") {
+            pod5_metadata.emplace_back(pool.push(load_pod5_metadata, path.string()));
+        } else {
+            pod5_metadata.emplace_back();
+        }
+    }
+
+    DataSetMetadata metadata;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        FileMetadata file_metadata;
+        if (pod5_metadata[i]) {
+            file_metadata = pod5_metadata[i]->get();
+        } else if (!metadata.sample_rate) {
+            file_metadata = scan_fast5_metadata(paths[i].string());
+        }
+        metadata.num_reads += file_metadata.num_reads;
+        metadata.runs.insert(metadata.runs.end(), file_metadata.runs.begin(),
+                             file_metadata.runs.end());
+        if (!metadata.sample_rate) {
+            metadata.sample_rate = file_metadata.sample_rate;
+        }
+    }
+    return metadata;
+}
+
+std::unordered_map<std::string, ReadGroup> DataLoader::load_read_groups(
+        std::string data_path,
+        std::string model_path,
+        bool recursive_file_loading) {
+    return scan_metadata(data_path, recursive_file_loading).read_groups(model_path);
+}
+
+int DataLoader::get_num_reads(std::string data_path,
+                              std::optional<std::unordered_set<std::string>> read_list,
+                              const ReadIDSet& ignore_read_list,
+                              bool recursive_file_loading) {
+    return int(scan_metadata(data_path, recursive_file_loading)
+                       .num_reads_to_load(read_list, ignore_read_list));
+}
+
+uint16_t DataLoader::get_sample_rate(std::string data_path, bool recursive_file_loading) {
+    const auto sample_rate = scan_metadata(data_path, recursive_file_loading).sample_rate;
+    if (!sample_rate) {
         throw std::runtime_error("Unable to determine sample rate for data.");
     }
+    return *sample_rate;
 }
 
 void DataLoader::load_pod5_reads_from_file_by_read_ids(const std::string& path,
@@ -575,33 +953,47 @@ void DataLoader::load_pod5_reads_from_file_by_read_ids(const std::string& path,
         throw std::runtime_error("Plan traveral didn't yield correct number of reads");
     }
 
-    cxxpool::thread_pool pool{m_num_worker_threads};
-
     uint32_t row_offset = 0;
-    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-        if (m_loaded_read_count == m_max_reads) {
-            break;
-        }
+    bool reached_max_reads = false;
+    for (std::size_t batch_index = 0; batch_index < batch_count && !reached_max_reads;
+         ++batch_index) {
         Pod5ReadRecordBatch_t* batch = nullptr;
         if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
             spdlog::error("Failed to get batch: {}", pod5_get_error_string());
             continue;
         }
 
-        std::vector<std::future<std::shared_ptr<Read>>> futures;
+        std::vector<uint32_t> rows;
         for (std::size_t row_idx = 0; row_idx < traversal_batch_counts[batch_index]; row_idx++) {
             uint32_t row = traversal_batch_rows[row_idx + row_offset];
-
-            if (can_process_pod5_row(batch, row, m_allowed_read_ids, m_ignored_read_ids)) {
-                futures.push_back(pool.push(process_pod5_read, row, batch, file, path, m_device));
+            if (can_process_pod5_row(batch, row, m_allowed_read_ids, m_ignored_read_ids,
+                                     m_channel_shard)) {
+                rows.push_back(row);
             }
         }
+        // Several channel groups may be loading at once, so the batch's reads are claimed
+        // before they are decoded.
+        const size_t num_reserved = reserve_reads(rows.size());
+        if (num_reserved < rows.size()) {
+            rows.resize(num_reserved);
+            reached_max_reads = true;
+        }
 
+        std::vector<std::future<std::shared_ptr<Read>>> futures;
+        for (const uint32_t row : rows) {
+            futures.push_back(
+                    m_thread_pool->push(process_pod5_read, row, batch, file, path, m_device));
+        }
+
+        std::vector<Message> reads;
+        reads.reserve(futures.size());
         for (auto& v : futures) {
             auto read = v.get();
-            m_read_sink.push_message(std::move(read));
-            m_loaded_read_count++;
+            read->client_id = m_client_id;
+            reads.push_back(std::move(read));
         }
+        issue_order_tickets(m_read_order, reads);
+        m_read_sink.push_messages(std::move(reads));
 
         if (pod5_free_read_batch(batch) != POD5_OK) {
             spdlog::error("Failed to release batch");
@@ -614,72 +1006,366 @@ void DataLoader::load_pod5_reads_from_file_by_read_ids(const std::string& path,
     }
 }
 
+size_t DataLoader::reserve_reads(size_t count) {
+    size_t loaded = m_loaded_read_count.load();
+    size_t reserved = 0;
+    do {
+        reserved = loaded < m_max_reads ? std::min(count, m_max_reads - loaded) : 0;
+    } while (reserved > 0 &&
+             !m_loaded_read_count.compare_exchange_weak(loaded, loaded + reserved));
+    return reserved;
+}
+
+void DataLoader::load_pod5_reads_by_channel(const std::vector<std::string>& paths) {
+    // Consecutive channels are grouped, and a group's reads are loaded from each file in one
+    // traversal, so each file is opened and planned once per group rather than once per
+    // channel.  Each channel's reads still arrive in file order.  PairingNode keeps the reads of
+    // the last few pores of each of its shards of channels, so the channels in flight at once are
+    // kept to about one per shard, to keep each pore's reads together until they are paired.
+    std::vector<std::vector<int>> channel_groups;
+    for (int channel = 0; channel <= m_max_channel; channel++) {
+        if (!m_channel_shard.contains(channel)) {
+            continue;
+        }
+        if (channel_groups.empty() || channel_groups.back().size() == kChannelsPerGroup) {
+            channel_groups.emplace_back();
+        }
+        channel_groups.back().push_back(channel);
+    }
+
+    auto load_channel_group = [this, &paths](const std::vector<int>& channels) {
+        for (const auto& path : paths) {
+            if (m_loaded_read_count >= m_max_reads) {
+                return;
+            }
+            const auto& channel_to_read_ids = m_file_channel_read_order_map.at(path);
+            std::vector<ReadID> read_ids;
+            for (const int channel : channels) {
+                auto channel_read_ids = channel_to_read_ids.find(channel);
+                if (channel_read_ids != channel_to_read_ids.end()) {
+                    read_ids.insert(read_ids.end(), channel_read_ids->second.begin(),
+                                    channel_read_ids->second.end());
+                }
+            }
+            if (!read_ids.empty()) {
+                load_pod5_reads_from_file_by_read_ids(path, read_ids);
+            }
+        }
+    };
+
+    // Groups are loaded a few at a time, the first on this thread.  Their reads are decoded by
+    // the shared thread pool.
+    for (size_t first = 0; first < channel_groups.size(); first += kChannelGroupsInFlight) {
+        const size_t end = std::min(first + kChannelGroupsInFlight, channel_groups.size());
+        std::vector<std::future<void>> other_groups;
+        for (size_t group = first + 1; group < end; ++group) {
+            other_groups.push_back(std::async(std::launch::async, load_channel_group,
+                                              std::cref(channel_groups[group])));
+        }
+        load_channel_group(channel_groups[first]);
+        for (auto& other_group : other_groups) {
+            other_group.get();
+        }
+    }
+}
+
+void DataLoader::load_object_store_reads(const std::string& url, bool recursive_file_loading) {
+    auto objects = list_read_objects(url, recursive_file_loading);
+    spdlog::info("> Streaming {} read files from {}", objects.size(), url);
+    // Each file is loaded once it has been downloaded, while the next ones download.
+    utils::ObjectPrefetcher prefetcher(url, std::move(objects), object_staging_dir());
+    while (m_loaded_read_count < m_max_reads) {
+        auto path = prefetcher.next();
+        if (!path) {
+            break;
+        }
+        if (lowercase_extension(*path) == ".pod5") {
+            load_pod5_reads_from_file(path->string());
+        } else {
+            load_fast5_reads_from_file(path->string());
+        }
+        prefetcher.release(*path);
+    }
+}
+
 void DataLoader::load_pod5_reads_from_file(const std::string& path) {
-    pod5_init();
+    load_pod5_reads_from_files({path});
+}
 
-    // Open the file ready for walking:
-    Pod5FileReader_t* file = pod5_open_file(path.c_str());
+void DataLoader::load_pod5_batches(const std::string& path,
+                                   size_t first_batch,
+                                   size_t end_batch) {
+    load_pod5_reads_from_files({path}, std::make_pair(first_batch, end_batch));
+    m_read_sink.terminate();
+}
 
+size_t DataLoader::get_num_pod5_batches(const std::string& path) {
+    pod5_init();
+    Pod5Ptr file(pod5_open_file(path.c_str()));
     if (!file) {
-        spdlog::error("Failed to open file {}: {}", path, pod5_get_error_string());
+        throw std::runtime_error("Failed to open file " + path + ": " + pod5_get_error_string());
     }
+    size_t batch_count = 0;
+    if (pod5_get_read_batch_count(&batch_count, file.get()) != POD5_OK) {
+        throw std::runtime_error("Failed to query batch count of " + path + ": " +
+                                 pod5_get_error_string());
+    }
+    return batch_count;
+}
 
+void DataLoader::load_pod5_reads_from_files(
+        const std::vector<std::string>& paths,
+        std::optional<std::pair<size_t, size_t>> batch_range) {
+    pod5_init();
+
+    // Decoding runs this many batches ahead of the one being pushed, so the workers stay busy
+    // while the sink is blocked, and there's always a decoded batch ready when it's not.
+    constexpr size_t kMaxBatchesInFlight = 3;
+
+    struct BatchInFlight {
+        Pod5FileReader_t* file;
+        Pod5ReadRecordBatch_t* batch;
+        std::vector<std::future<std::shared_ptr<Read>>> reads;
+        // The file is closed once its last batch has been pushed.
+        bool last_in_file;
+        std::string path;
+        std::size_t index;
+        // Whether to add the batch to the progress journal once its reads are pushed, which
+        // isn't done if it was already journalled, couldn't be read or was cut short.
+        bool journal;
+    };
+    const bool use_journal = m_progress_journal && m_read_order;
+    // One past the order of the last read pushed, which a batch with no reads ends at too.
+    uint64_t journal_end_order = 0;
+    std::deque<BatchInFlight> batches_in_flight;
+
+    // The file batches are currently being submitted from.
+    size_t next_path_idx = 0;
+    std::string path;
+    Pod5FileReader_t* file = nullptr;
     std::size_t batch_count = 0;
-    if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
-        spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+    std::size_t batch_index = 0;
+    // Batches of the file, of which only those before batch_count are loaded with a range.
+    std::size_t num_file_batches = 0;
+    // With a read list, only the batches holding listed reads are read, and only the listed
+    // rows within them, as planned by pod5_plan_traversal.
+    const bool use_plan = m_allowed_read_ids.has_value();
+    std::vector<std::uint32_t> plan_batch_counts;
+    std::vector<std::uint32_t> plan_batch_rows;
+    // Offset into plan_batch_rows of the rows of batch_index.
+    std::size_t plan_row_offset = 0;
+    // Reads which have been submitted for decoding, including those already pushed.
+    size_t num_reads_submitted = m_loaded_read_count;
+    // Whole files are read ahead of the batches being loaded, unless only some of their
+    // batches or rows are wanted.
+    std::optional<utils::FileReadAhead> read_ahead;
+    if (!batch_range && !use_plan) {
+        read_ahead.emplace(paths);
     }
 
-    cxxpool::thread_pool pool{m_num_worker_threads};
-
-    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-        if (m_loaded_read_count == m_max_reads) {
-            break;
+    // Moves batch_index on to the next planned batch with rows to load, if there is one.
+    auto skip_unplanned_batches = [&] {
+        while (batch_index < batch_count && plan_batch_counts[batch_index] == 0) {
+            ++batch_index;
         }
-        Pod5ReadRecordBatch_t* batch = nullptr;
-        if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
-            spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+    };
+    // Whether there are batches after batch_index to load.
+    auto is_last_batch = [&] {
+        if (!use_plan) {
+            return batch_index + 1 == batch_count;
+        }
+        for (auto i = batch_index + 1; i < batch_count; ++i) {
+            if (plan_batch_counts[i] > 0) {
+                return false;
+            }
         }
+        return true;
+    };
 
-        std::size_t batch_row_count = 0;
-        if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
-            spdlog::error("Failed to get batch row count");
+    // Plans which rows to load from the file, and returns whether there are any.
+    auto plan_traversal = [&]() -> bool {
+        const size_t num_listed_reads = m_allowed_read_id_array.size() / POD5_READ_ID_SIZE;
+        plan_batch_counts.assign(num_file_batches, 0);
+        plan_batch_rows.assign(num_listed_reads, 0);
+        plan_row_offset = 0;
+        size_t find_success_count = 0;
+        if (num_listed_reads == 0) {
+            return false;
+        }
+        if (pod5_plan_traversal(file, m_allowed_read_id_array.data(), num_listed_reads,
+                                plan_batch_counts.data(), plan_batch_rows.data(),
+                                &find_success_count) != POD5_OK) {
+            spdlog::error("Couldn't create plan for {}: {}", path, pod5_get_error_string());
+            return false;
         }
-        batch_row_count = std::min(batch_row_count, m_max_reads - m_loaded_read_count);
+        // Rows of the batches before a range are planned too, so are skipped over.
+        for (std::size_t i = 0; i < batch_index; ++i) {
+            plan_row_offset += plan_batch_counts[i];
+        }
+        skip_unplanned_batches();
+        return find_success_count > 0 && batch_index < batch_count;
+    };
 
-        std::vector<std::future<std::shared_ptr<Read>>> futures;
+    // Opens the next file with batches to submit, if the current one has none left.
+    auto open_next_file = [&]() -> bool {
+        while (!file) {
+            if (next_path_idx == paths.size()) {
+                return false;
+            }
+            path = paths[next_path_idx++];
+            file = pod5_open_file(path.c_str());
+            if (!file) {
+                spdlog::error("Failed to open file {}: {}", path, pod5_get_error_string());
+                continue;
+            }
+            num_file_batches = 0;
+            if (pod5_get_read_batch_count(&num_file_batches, file) != POD5_OK) {
+                spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+            }
+            batch_count = num_file_batches;
+            batch_index = 0;
+            if (batch_range) {
+                batch_index = batch_range->first;
+                batch_count = std::min(batch_range->second, num_file_batches);
+            }
+            if (batch_index >= batch_count || (use_plan && !plan_traversal())) {
+                if (pod5_close_and_free_reader(file) != POD5_OK) {
+                    spdlog::error("Failed to close and free POD5 reader");
+                }
+                file = nullptr;
+            }
+        }
+        return true;
+    };
 
-        for (std::size_t row = 0; row < batch_row_count; ++row) {
-            // TODO - check the read ID here, for each one, only send the row if it is in the list of ones we care about
+    auto submit_next_batch = [&] {
+        if (read_ahead && num_file_batches > 0) {
+            const auto file_index = next_path_idx - 1;
+            read_ahead->set_read_position(
+                    file_index, read_ahead->file_size(file_index) * batch_index / num_file_batches);
+        }
+        BatchInFlight in_flight{file, nullptr, {}, is_last_batch(),
+                                path, batch_index, use_journal};
+        if (use_journal && m_progress_journal->is_complete(path, batch_index)) {
+            in_flight.journal = false;
+        } else if (pod5_get_read_batch(&in_flight.batch, file, batch_index) != POD5_OK) {
+            spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+            in_flight.batch = nullptr;
+            in_flight.journal = false;
+        } else {
+            std::size_t batch_row_count = 0;
+            if (use_plan) {
+                batch_row_count = plan_batch_counts[batch_index];
+            } else if (pod5_get_read_batch_row_count(&batch_row_count, in_flight.batch) !=
+                       POD5_OK) {
+                spdlog::error("Failed to get batch row count");
+            }
+            if (batch_row_count > m_max_reads - num_reads_submitted) {
+                batch_row_count = m_max_reads - num_reads_submitted;
+                in_flight.journal = false;
+            }
 
-            if (can_process_pod5_row(batch, row, m_allowed_read_ids, m_ignored_read_ids)) {
-                futures.push_back(pool.push(process_pod5_read, row, batch, file, path, m_device));
+            for (std::size_t row_idx = 0; row_idx < batch_row_count; ++row_idx) {
+                const auto row = use_plan ? plan_batch_rows[plan_row_offset + row_idx] : row_idx;
+                if (can_process_pod5_row(in_flight.batch, row, m_allowed_read_ids,
+                                         m_ignored_read_ids, m_channel_shard)) {
+                    in_flight.reads.push_back(m_thread_pool->push(
+                            process_pod5_read, row, in_flight.batch, file, path, m_device));
+                }
             }
+            num_reads_submitted += in_flight.reads.size();
+        }
+        if (use_plan) {
+            plan_row_offset += plan_batch_counts[batch_index];
+            ++batch_index;
+            skip_unplanned_batches();
+        } else {
+            ++batch_index;
+        }
+        if (in_flight.last_in_file) {
+            // The batch now owns the file.
+            file = nullptr;
         }
+        batches_in_flight.push_back(std::move(in_flight));
+    };
 
-        for (auto& v : futures) {
+    while (true) {
+        while (batches_in_flight.size() < kMaxBatchesInFlight &&
+               num_reads_submitted < m_max_reads && open_next_file()) {
+            submit_next_batch();
+        }
+        if (batches_in_flight.empty()) {
+            break;
+        }
+
+        auto in_flight = std::move(batches_in_flight.front());
+        batches_in_flight.pop_front();
+
+        std::vector<Message> reads;
+        reads.reserve(in_flight.reads.size());
+        for (auto& v : in_flight.reads) {
             auto read = v.get();
-            m_read_sink.push_message(read);
-            m_loaded_read_count++;
+            read->client_id = m_client_id;
+            reads.push_back(std::move(read));
+        }
+        issue_order_tickets(m_read_order, reads);
+        if (use_journal) {
+            if (!reads.empty()) {
+                const auto& ticket = std::get<std::shared_ptr<Read>>(reads.back())->order_ticket;
+                journal_end_order = ticket->order() + 1;
+            }
+            if (in_flight.journal) {
+                m_progress_journal->add_batch(in_flight.path, in_flight.index, journal_end_order);
+            }
         }
+        m_loaded_read_count += reads.size();
+        m_read_sink.push_messages(std::move(reads));
 
-        if (pod5_free_read_batch(batch) != POD5_OK) {
+        if (in_flight.batch && pod5_free_read_batch(in_flight.batch) != POD5_OK) {
             spdlog::error("Failed to release batch");
         }
+        if (in_flight.last_in_file && pod5_close_and_free_reader(in_flight.file) != POD5_OK) {
+            spdlog::error("Failed to close and free POD5 reader");
+        }
     }
-    if (pod5_close_and_free_reader(file) != POD5_OK) {
+
+    // Loading stops partway through a file once max_reads have been loaded.
+    if (file && pod5_close_and_free_reader(file) != POD5_OK) {
         spdlog::error("Failed to close and free POD5 reader");
     }
 }
 
-void DataLoader::load_fast5_reads_from_file(const std::string& path) {
-    // Read the file into a vector of torch tensors
-    H5Easy::File file(path, H5Easy::File::ReadOnly);
+namespace {
+
+// Loads the reads at indices [begin, end) of a FAST5 file's root group, skipping any whose IDs
+// aren't wanted before their signal is read.
+std::vector<std::shared_ptr<Read>> load_fast5_reads(
+        const H5Easy::File& file,
+        const std::string& fast5_filename,
+        int begin,
+        int end,
+        const std::optional<ReadIDSet>& allowed_read_ids,
+        const ReadIDSet& ignored_read_ids) {
+    std::vector<std::shared_ptr<Read>> loaded_reads;
     HighFive::Group reads = file.getGroup("/");
-    int num_reads = reads.getNumberObjects();
+    for (int i = begin; i < end; i++) {
+        auto read_name = reads.getObjectName(i);
+        HighFive::Group read = reads.getGroup(read_name);
 
-    for (int i = 0; i < num_reads && m_loaded_read_count < m_max_reads; i++) {
-        auto read_id = reads.getObjectName(i);
-        HighFive::Group read = reads.getGroup(read_id);
+        HighFive::Group raw = read.getGroup("Raw");
+        HighFive::Attribute read_id_attr = raw.getAttribute("read_id");
+        std::string read_id;
+        string_reader(read_id_attr, read_id);
+        if (allowed_read_ids || !ignored_read_ids.empty()) {
+            // Reads whose IDs aren't UUIDs can't be listed.
+            auto parsed = utils::parse_read_id(read_id);
+            if (allowed_read_ids && (!parsed || allowed_read_ids->count(*parsed) == 0)) {
+                continue;
+            }
+            if (parsed && ignored_read_ids.count(*parsed) != 0) {
+                continue;
+            }
+        }
 
         // Fetch the digitisation parameters
         HighFive::Group channel_id_group = read.getGroup("channel_id");
@@ -708,29 +1394,24 @@ void DataLoader::load_fast5_reads_from_file(const std::string& path) {
         float sampling_rate;
         sampling_rate_attr.read(sampling_rate);
 
-        HighFive::Group raw = read.getGroup("Raw");
         auto ds = raw.getDataSet("Signal");
         if (ds.getDataType().string() != "Integer16")
             throw std::runtime_error("Invalid FAST5 Signal data type of " +
                                      ds.getDataType().string());
 
-        auto options = torch::TensorOptions().dtype(torch::kInt16);
-        auto samples = torch::empty(ds.getElementCount(), options);
+        auto samples =
+                utils::SignalBufferPool::shared().allocate(ds.getElementCount(), torch::kInt16);
         ds.read(samples.data_ptr<int16_t>());
 
         HighFive::Attribute mux_attr = raw.getAttribute("start_mux");
         HighFive::Attribute read_number_attr = raw.getAttribute("read_number");
         HighFive::Attribute start_time_attr = raw.getAttribute("start_time");
-        HighFive::Attribute read_id_attr = raw.getAttribute("read_id");
         uint32_t mux;
         uint32_t read_number;
         uint64_t start_time;
         mux_attr.read(mux);
         read_number_attr.read(read_number);
         start_time_attr.read(start_time);
-        string_reader(read_id_attr, read_id);
-
-        std::string fast5_filename = std::filesystem::path(path).filename().string();
 
         HighFive::Group tracking_id_group = read.getGroup("tracking_id");
         HighFive::Attribute exp_start_time_attr = tracking_id_group.getAttribute("exp_start_time");
@@ -747,7 +1428,7 @@ void DataLoader::load_fast5_reads_from_file(const std::string& path) {
         new_read->range = range;
         new_read->offset = offset;
         new_read->scaling = range / digitisation;
-        new_read->read_id = read_id;
+        new_read->read_id = std::move(read_id);
         new_read->num_trimmed_samples = 0;
         new_read->attributes.mux = mux;
         new_read->attributes.read_number = read_number;
@@ -755,12 +1436,67 @@ void DataLoader::load_fast5_reads_from_file(const std::string& path) {
         new_read->attributes.start_time = start_time_str;
         new_read->attributes.fast5_filename = fast5_filename;
         new_read->is_duplex = false;
+        loaded_reads.push_back(std::move(new_read));
+    }
+    return loaded_reads;
+}
+
+}  // namespace
+
+void DataLoader::load_fast5_reads_from_file(const std::string& path) {
+    // Reads are loaded and pushed this many at a time.
+    constexpr int kReadsPerBatch = 1000;
+
+    H5Easy::File file(path, H5Easy::File::ReadOnly);
+    const int num_reads = file.getGroup("/").getNumberObjects();
+    const std::string fast5_filename = std::filesystem::path(path).filename().string();
+
+#ifdef H5_HAVE_THREADSAFE
+    // Each worker reads a share of every batch through its own file handle.
+    const int num_workers = static_cast<int>(m_num_worker_threads);
+#else
+    // Without a thread-safe HDF5 build only one thread may use the library at a time.
+    const int num_workers = 1;
+#endif
+
+    for (int batch_begin = 0; batch_begin < num_reads && m_loaded_read_count < m_max_reads;
+         batch_begin += kReadsPerBatch) {
+        const int batch_size = static_cast<int>(
+                std::min({size_t(kReadsPerBatch), size_t(num_reads - batch_begin),
+                          m_max_reads - m_loaded_read_count}));
+        const int worker_share = (batch_size + num_workers - 1) / num_workers;
+
+        std::vector<std::shared_ptr<Read>> reads;
+        if (num_workers == 1) {
+            reads = load_fast5_reads(file, fast5_filename, batch_begin, batch_begin + batch_size,
+                                     m_allowed_read_ids, m_ignored_read_ids);
+        } else {
+            std::vector<std::future<std::vector<std::shared_ptr<Read>>>> futures;
+            for (int begin = batch_begin; begin < batch_begin + batch_size;
+                 begin += worker_share) {
+                const int end = std::min(begin + worker_share, batch_begin + batch_size);
+                futures.push_back(m_thread_pool->push([this, &path, &fast5_filename, begin, end] {
+                    H5Easy::File worker_file(path, H5Easy::File::ReadOnly);
+                    return load_fast5_reads(worker_file, fast5_filename, begin, end,
+                                            m_allowed_read_ids, m_ignored_read_ids);
+                }));
+            }
+            for (auto& future : futures) {
+                auto worker_reads = future.get();
+                reads.insert(reads.end(), std::make_move_iterator(worker_reads.begin()),
+                             std::make_move_iterator(worker_reads.end()));
+            }
+        }
 
-        if (!m_allowed_read_ids ||
-            (m_allowed_read_ids->find(new_read->read_id) != m_allowed_read_ids->end())) {
-            m_read_sink.push_message(new_read);
-            m_loaded_read_count++;
+        std::vector<Message> messages;
+        messages.reserve(reads.size());
+        for (auto& read : reads) {
+            read->client_id = m_client_id;
+            messages.push_back(std::move(read));
         }
+        issue_order_tickets(m_read_order, messages);
+        m_loaded_read_count += messages.size();
+        m_read_sink.push_messages(std::move(messages));
     }
 }
 
@@ -769,18 +1505,36 @@ DataLoader::DataLoader(MessageSink& read_sink,
                        size_t num_worker_threads,
                        size_t max_reads,
                        std::optional<std::unordered_set<std::string>> read_list,
-                       std::unordered_set<std::string> read_ignore_list)
+                       ReadIDSet read_ignore_list,
+                       int32_t client_id)
         : m_read_sink(read_sink),
           m_device(device),
           m_num_worker_threads(num_worker_threads),
-          m_allowed_read_ids(std::move(read_list)),
-          m_ignored_read_ids(std::move(read_ignore_list)) {
+          m_ignored_read_ids(std::move(read_ignore_list)),
+          m_client_id(client_id) {
     m_max_reads = max_reads == 0 ? std::numeric_limits<decltype(m_max_reads)>::max() : max_reads;
     assert(m_num_worker_threads > 0);
+    m_thread_pool = std::make_unique<cxxpool::thread_pool>(m_num_worker_threads);
+    if (read_list) {
+        // IDs which aren't UUIDs can't be in a read file, so are left out.
+        m_allowed_read_ids.emplace();
+        m_allowed_read_ids->reserve(read_list->size());
+        m_allowed_read_id_array.reserve(read_list->size() * POD5_READ_ID_SIZE);
+        for (const auto& read_id : *read_list) {
+            if (auto parsed = utils::parse_read_id(read_id)) {
+                if (m_allowed_read_ids->insert(*parsed).second) {
+                    m_allowed_read_id_array.insert(m_allowed_read_id_array.end(),
+                                                   parsed->begin(), parsed->end());
+                }
+            }
+        }
+    }
     static std::once_flag vbz_init_flag;
     std::call_once(vbz_init_flag, vbz_register);
 }
 
+DataLoader::~DataLoader() = default;
+
 stats::NamedStats DataLoader::sample_stats() const {
     return stats::NamedStats{{"loaded_read_count", static_cast<double>(m_loaded_read_count)}};
 }
@@ -1,24 +1,36 @@
 #pragma once
 #include "utils/stats.h"
+#include "utils/types.h"
+#include "utils/uuid_utils.h"
 
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <map>
 #include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 struct Pod5FileReader;
 
+namespace cxxpool {
+class thread_pool;
+}
+
+namespace dorado::utils {
+class ProgressJournal;
+}
+
 namespace dorado {
 
 class MessageSink;
-struct ReadGroup;
+class ReadOrderNode;
 
-constexpr size_t POD5_READ_ID_SIZE = 16;
-using ReadID = std::array<uint8_t, POD5_READ_ID_SIZE>;
 typedef std::map<int, std::vector<ReadID>> channel_to_read_id_t;
 
 struct Pod5Destructor {
@@ -26,6 +38,35 @@ struct Pod5Destructor {
 };
 using Pod5Ptr = std::unique_ptr<Pod5FileReader, Pod5Destructor>;
 
+// The share of a run's channels one node of a distributed duplex run calls: those whose number
+// is index modulo count.  Both reads of a duplex pair come from the same channel, so sharding
+// by channel keeps every pair on one node.
+struct ChannelShard {
+    size_t index{0};
+    size_t count{1};
+
+    bool contains(int channel) const { return size_t(channel) % count == index; }
+    // Parses "<index>/<count>", such as "0/4".  Throws if it isn't a valid shard.
+    static ChannelShard parse(const std::string& text);
+};
+
+// What the CLI needs to know about a dataset before loading it, gathered in one pass over its
+// read files: how many reads there are, the runs they come from and their sample rate.
+struct DataSetMetadata {
+    // Reads and runs of the POD5 files.
+    size_t num_reads{0};
+    // A read group per run, without a basecalling model.
+    std::vector<ReadGroup> runs;
+    // From the first file, in the order they were found, to give one.
+    std::optional<uint16_t> sample_rate;
+
+    // The runs' read groups for reads basecalled with the model.
+    std::unordered_map<std::string, ReadGroup> read_groups(const std::string& model_name) const;
+    // How many reads would be loaded with the read list and ignore list.
+    size_t num_reads_to_load(const std::optional<std::unordered_set<std::string>>& read_list,
+                             const ReadIDSet& ignore_read_list) const;
+};
+
 class DataLoader {
 public:
     enum ReadOrder {
@@ -38,12 +79,37 @@ public:
                size_t num_worker_threads,
                size_t max_reads = 0,
                std::optional<std::unordered_set<std::string>> read_list = std::nullopt,
-               std::unordered_set<std::string> read_ignore_list = {});
-    ~DataLoader() = default;
+               ReadIDSet read_ignore_list = {},
+               int32_t client_id = -1);
+    ~DataLoader();
     void load_reads(const std::string& path,
                     bool recursive_file_loading = false,
                     ReadOrder traversal_order = UNRESTRICTED);
+    // Loads read files as they appear under path, so that reads can be basecalled while they
+    // are still being acquired.  Files are only read once their size has stayed the same for
+    // a whole poll_interval, since a file being written can't be read yet.  Returns, and
+    // terminates the sink, once no file has appeared or changed for idle_timeout.
+    void watch_reads(const std::string& path,
+                     bool recursive_file_loading,
+                     std::chrono::milliseconds poll_interval,
+                     std::chrono::milliseconds idle_timeout);
 
+    // Loads batches [first_batch, end_batch) of the POD5 file at path, such as a work unit of
+    // a distributed run, then terminates the sink.
+    void load_pod5_batches(const std::string& path, size_t first_batch, size_t end_batch);
+
+    // The number of read batches in the POD5 file at path.  Throws if it can't be read.
+    static size_t get_num_pod5_batches(const std::string& path);
+
+    // These take either a directory of read files or a single file, or for scan_metadata and
+    // load_reads an s3:// or gs:// URL of a prefix of read files.
+    // scan_metadata opens each read file once for its metadata, several at a time.  The
+    // metadata of each POD5 file is cached, so runs over files seen before only stat them.
+    static DataSetMetadata scan_metadata(const std::string& data_path,
+                                         bool recursive_file_loading = false);
+
+    // Each of these scans the files again, so callers needing more than one of them should use
+    // scan_metadata().
     static std::unordered_map<std::string, ReadGroup> load_read_groups(
             std::string data_path,
             std::string model_path,
@@ -52,27 +118,68 @@ public:
     static int get_num_reads(
             std::string data_path,
             std::optional<std::unordered_set<std::string>> read_list = std::nullopt,
-            const std::unordered_set<std::string>& ignore_read_list = {},
+            const ReadIDSet& ignore_read_list = {},
             bool recursive_file_loading = false);
 
     static uint16_t get_sample_rate(std::string data_path, bool recursive_file_loading = false);
 
+    // Gives each read loaded from now on a ticket from node, so that their records are
+    // written in the order they were loaded.
+    void set_read_order(ReadOrderNode& node) { m_read_order = &node; }
+
+    // Skips the POD5 batches journal lists as complete, and adds those loaded from now on to
+    // it.  Needs a read order to have been set, which gives the journal each read's order.
+    void set_progress_journal(utils::ProgressJournal& journal) { m_progress_journal = &journal; }
+
+    // Only loads POD5 reads from the shard's channels from now on.
+    void set_channel_shard(ChannelShard shard) { m_channel_shard = shard; }
+
+    // Number of reads pushed to the sink so far, including any still being decoded.
+    size_t get_num_reads_loaded() const { return m_loaded_read_count; }
+
     std::string get_name() const { return "Dataloader"; }
     stats::NamedStats sample_stats() const;
 
 private:
+    // Loads the file's reads if it is a read file, i.e. FAST5 or POD5.
+    void load_read_file(const std::filesystem::path& path);
     void load_fast5_reads_from_file(const std::string& path);
     void load_pod5_reads_from_file(const std::string& path);
+    // Loads the files in order, decoding the next few batches, which may be in later files,
+    // while the current one is being pushed to the sink.
+    // With a batch_range, only batches [first, second) of each file are loaded.
+    void load_pod5_reads_from_files(
+            const std::vector<std::string>& paths,
+            std::optional<std::pair<size_t, size_t>> batch_range = std::nullopt);
+    // Claims up to count of the reads left under the max reads limit, and returns how many it
+    // got.  Loaders which run concurrently claim reads before decoding them, so that together
+    // they never load more than the limit.
+    size_t reserve_reads(size_t count);
     void load_pod5_reads_from_file_by_read_ids(const std::string& path,
                                                const std::vector<ReadID>& read_ids);
+    // Loads the read files under an s3:// or gs:// URL, downloading them ahead of loading.
+    void load_object_store_reads(const std::string& url, bool recursive_file_loading);
+    // Loads the reads of the POD5 files in channel order, from an index made by
+    // load_read_channels.
+    void load_pod5_reads_by_channel(const std::vector<std::string>& paths);
     void load_read_channels(std::string data_path, bool recursive_file_loading = false);
     MessageSink& m_read_sink;  // Where should the loaded reads go?
+    ReadOrderNode* m_read_order{nullptr};
+    utils::ProgressJournal* m_progress_journal{nullptr};
     std::atomic<size_t> m_loaded_read_count{0};
     std::string m_device;
     size_t m_num_worker_threads{1};
+    // Decodes reads, shared by every file loaded.
+    std::unique_ptr<cxxpool::thread_pool> m_thread_pool;
     size_t m_max_reads{0};
-    std::optional<std::unordered_set<std::string>> m_allowed_read_ids;
-    std::unordered_set<std::string> m_ignored_read_ids;
+    std::optional<ReadIDSet> m_allowed_read_ids;
+    // The allowed read IDs in binary form, for planning POD5 traversals.
+    std::vector<uint8_t> m_allowed_read_id_array;
+    ReadIDSet m_ignored_read_ids;
+    ChannelShard m_channel_shard;
+    // Set on every loaded read, so that the reads can be routed back to the client they
+    // were loaded for.
+    int32_t m_client_id{-1};
 
     std::unordered_map<std::string, channel_to_read_id_t> m_file_channel_read_order_map;
     int m_max_channel{0};
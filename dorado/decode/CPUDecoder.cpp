@@ -1,11 +1,15 @@
 #include "CPUDecoder.h"
 
 #include "beam_search.h"
+#include "cxxpool.h"
 
 #include <math.h>
 #include <spdlog/spdlog.h>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <future>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -97,52 +101,54 @@ namespace dorado {
 std::vector<DecodedChunk> CPUDecoder::beam_search(const torch::Tensor& scores,
                                                   const int num_chunks,
                                                   const DecoderOptions& options) {
+    // Shared by every CPU runner, so the number of decode threads is bounded by the number of
+    // cores however many runners there are, and threads aren't started for every batch.
+    static cxxpool::thread_pool pool{std::max(1u, std::thread::hardware_concurrency())};
+
     const auto scores_cpu = scores.to(torch::kCPU);
-    int num_threads = std::min(num_chunks, 4);
-    int chunks_per_thread = num_chunks / num_threads;
-    int num_threads_with_one_more_chunk = num_chunks % num_threads;
+    // Small enough groups that runners' batches interleave on the pool, large enough for the
+    // forward/backward scans to be worth batching.
+    const int kChunksPerTask = 16;
+    int num_tasks = (num_chunks + kChunksPerTask - 1) / kChunksPerTask;
 
     std::vector<DecodedChunk> chunk_results(num_chunks);
 
-    std::vector<std::unique_ptr<std::thread>> threads;
-    threads.reserve(num_threads);
-    for (int i = 0; i < num_threads; ++i) {
-        threads.emplace_back(new std::thread(
-                [&](int i) {
-                    int t_first_chunk =
-                            i * chunks_per_thread + std::min(i, num_threads_with_one_more_chunk);
-                    int t_num_chunks = chunks_per_thread + int(i < num_threads_with_one_more_chunk);
-
-                    using Slice = torch::indexing::Slice;
-                    auto t_scores = scores_cpu.index(
-                            {Slice(), Slice(t_first_chunk, t_first_chunk + t_num_chunks)});
-
-                    torch::Tensor fwd = forward_scores(t_scores, options.blank_score);
-                    torch::Tensor bwd = backward_scores(t_scores, options.blank_score);
-
-                    torch::Tensor posts = torch::softmax(fwd + bwd, -1);
-
-                    t_scores = t_scores.transpose(0, 1);
-                    bwd = bwd.transpose(0, 1).contiguous();
-                    posts = posts.transpose(0, 1).contiguous();
-
-                    for (int i = 0; i < t_num_chunks; i++) {
-                        auto decode_result = beam_search_decode(
-                                t_scores[i], bwd[i], posts[i], options.beam_width, options.beam_cut,
-                                options.blank_score, options.q_shift, options.q_scale,
-                                options.temperature, 1.0f);
-                        chunk_results[t_first_chunk + i] = DecodedChunk{
-                                std::get<0>(decode_result),
-                                std::get<1>(decode_result),
-                                std::get<2>(decode_result),
-                        };
-                    }
-                },
-                i));
+    std::vector<std::future<void>> futures;
+    futures.reserve(num_tasks);
+    for (int i = 0; i < num_tasks; ++i) {
+        futures.push_back(pool.push([&, i] {
+            int t_first_chunk = i * kChunksPerTask;
+            int t_num_chunks = std::min(kChunksPerTask, num_chunks - t_first_chunk);
+
+            using Slice = torch::indexing::Slice;
+            auto t_scores =
+                    scores_cpu.index({Slice(), Slice(t_first_chunk, t_first_chunk + t_num_chunks)});
+
+            torch::Tensor fwd = forward_scores(t_scores, options.blank_score);
+            torch::Tensor bwd = backward_scores(t_scores, options.blank_score);
+
+            torch::Tensor posts = torch::softmax(fwd + bwd, -1);
+
+            t_scores = t_scores.transpose(0, 1);
+            bwd = bwd.transpose(0, 1).contiguous();
+            posts = posts.transpose(0, 1).contiguous();
+
+            for (int i = 0; i < t_num_chunks; i++) {
+                auto decode_result = beam_search_decode(
+                        t_scores[i], bwd[i], posts[i], options.beam_width, options.beam_cut,
+                        options.blank_score, options.q_shift, options.q_scale, options.temperature,
+                        1.0f);
+                chunk_results[t_first_chunk + i] = DecodedChunk{
+                        std::move(std::get<0>(decode_result)),
+                        std::move(std::get<1>(decode_result)),
+                        std::move(std::get<2>(decode_result)),
+                };
+            }
+        }));
     }
 
-    for (auto& thread : threads) {
-        thread->join();
+    for (auto& future : futures) {
+        future.get();
     }
 
     return chunk_results;
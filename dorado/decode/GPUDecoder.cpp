@@ -1,23 +1,32 @@
 #include "GPUDecoder.h"
 
 #include "../utils/cuda_utils.h"
+#include "../utils/trace.h"
 #include "Decoder.h"
 
 #include <c10/cuda/CUDAGuard.h>
-#include <nvtx3/nvtx3.hpp>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <cassert>
+
 extern "C" {
 #include "koi.h"
 }
 
 namespace dorado {
 
-torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores, int num_chunks, DecoderOptions options) {
-    nvtx3::scoped_range loop{"gpu_decode"};
+std::pair<torch::Tensor, torch::Tensor> GPUDecoder::gpu_part(torch::Tensor scores,
+                                                             int num_chunks,
+                                                             DecoderOptions options,
+                                                             torch::Tensor chunk_steps) {
+    DORADO_TRACE_SCOPE("gpu_decode");
+    assert(scores.is_contiguous());
     long int N = scores.sizes()[0];
     long int T = scores.sizes()[1];
     long int C = scores.sizes()[2];
+    // The working memory only needs to cover the chunks decoded at once.
+    const long int max_chunks_per_decode = std::min<long int>(N, kMaxChunksPerDecode);
 
     auto tensor_options_int32 = torch::TensorOptions()
                                         .dtype(torch::kInt32)
@@ -27,77 +36,116 @@ torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores, int num_chunks, Decoder
     auto tensor_options_int8 =
             torch::TensorOptions().dtype(torch::kInt8).device(scores.device()).requires_grad(false);
 
-    if (!initialized) {
-        chunks = torch::empty({N, 4}, tensor_options_int32);
-        chunks.index({torch::indexing::Slice(), 0}) = torch::arange(0, int(T * N), int(T));
-        chunks.index({torch::indexing::Slice(), 2}) = torch::arange(0, int(T * N), int(T));
+    // Batches may be smaller than the largest seen, as partial batches are run at a smaller
+    // size, so the buffers are only reallocated to grow.
+    if (!initialized || chunks.size(0) < max_chunks_per_decode ||
+        moves_sequence_qstring.size(1) < N * T) {
+        // Chunk offsets are relative to the first chunk of each decode, so the same table
+        // serves every one of them.
+        const int M = int(std::max<long int>(max_chunks_per_decode,
+                                             initialized ? chunks.size(0) : 0));
+        chunks = torch::empty({M, 4}, tensor_options_int32);
+        chunks.index({torch::indexing::Slice(), 0}) = torch::arange(0, int(T * M), int(T));
+        chunks.index({torch::indexing::Slice(), 2}) = torch::arange(0, int(T * M), int(T));
         chunks.index({torch::indexing::Slice(), 1}) = int(T);
         chunks.index({torch::indexing::Slice(), 3}) = 0;
 
-        chunk_results = torch::empty({N, 8}, tensor_options_int32);
+        chunk_results = torch::empty({M, 8}, tensor_options_int32);
 
         chunk_results = chunk_results.contiguous();
 
-        aux = torch::empty(N * (T + 1) * (C + 4 * options.beam_width), tensor_options_int8);
-        path = torch::zeros(N * (T + 1), tensor_options_int32);
+        aux = torch::empty(M * (T + 1) * (C + 4 * options.beam_width), tensor_options_int8);
+        path = torch::zeros(M * (T + 1), tensor_options_int32);
 
-        moves_sequence_qstring = torch::zeros({3, N * T}, tensor_options_int8);
+        moves_sequence_qstring = torch::zeros(
+                {3, std::max<long int>(N * T, initialized ? moves_sequence_qstring.size(1) : 0)},
+                tensor_options_int8);
 
         initialized = true;
+        partial_steps = false;
     }
 
-    moves_sequence_qstring.index({torch::indexing::Slice()}) = 0.0;
-    auto moves = moves_sequence_qstring[0];
-    auto sequence = moves_sequence_qstring[1];
-    auto qstring = moves_sequence_qstring[2];
+    auto batch_moves_sequence_qstring = moves_sequence_qstring.narrow(1, 0, N * T);
+    batch_moves_sequence_qstring.zero_();
+    auto moves = batch_moves_sequence_qstring[0];
+    auto sequence = batch_moves_sequence_qstring[1];
+    auto qstring = batch_moves_sequence_qstring[2];
 
     c10::cuda::CUDAGuard device_guard(scores.device());
-    dorado::utils::handle_cuda_result(host_back_guide_step(
-            chunks.data_ptr(), chunk_results.data_ptr(), N, scores.data_ptr(), C, aux.data_ptr(),
-            path.data_ptr(), moves.data_ptr(), NULL, sequence.data_ptr(), qstring.data_ptr(),
-            options.q_scale, options.q_shift, options.beam_width, options.beam_cut,
-            options.blank_score));
-
-    dorado::utils::handle_cuda_result(host_beam_search_step(
-            chunks.data_ptr(), chunk_results.data_ptr(), N, scores.data_ptr(), C, aux.data_ptr(),
-            path.data_ptr(), moves.data_ptr(), NULL, sequence.data_ptr(), qstring.data_ptr(),
-            options.q_scale, options.q_shift, options.beam_width, options.beam_cut,
-            options.blank_score));
-
-    dorado::utils::handle_cuda_result(host_compute_posts_step(
-            chunks.data_ptr(), chunk_results.data_ptr(), N, scores.data_ptr(), C, aux.data_ptr(),
-            path.data_ptr(), moves.data_ptr(), NULL, sequence.data_ptr(), qstring.data_ptr(),
-            options.q_scale, options.q_shift, options.beam_width, options.beam_cut,
-            options.blank_score));
-
-    dorado::utils::handle_cuda_result(host_run_decode(
-            chunks.data_ptr(), chunk_results.data_ptr(), N, scores.data_ptr(), C, aux.data_ptr(),
-            path.data_ptr(), moves.data_ptr(), NULL, sequence.data_ptr(), qstring.data_ptr(),
-            options.q_scale, options.q_shift, options.beam_width, options.beam_cut,
-            options.blank_score, options.move_pad));
-
-    return moves_sequence_qstring.reshape({3, N, -1});
+    // Only the chunks which were filled in are decoded, a slice of them at a time.
+    const long int num_chunks_to_decode = std::min<long int>(num_chunks, N);
+    for (long int first_chunk = 0; first_chunk < num_chunks_to_decode;
+         first_chunk += max_chunks_per_decode) {
+        const int n = int(std::min(max_chunks_per_decode, num_chunks_to_decode - first_chunk));
+        void *scores_ptr = scores.narrow(0, first_chunk, n).data_ptr();
+        void *moves_ptr = static_cast<int8_t *>(moves.data_ptr()) + first_chunk * T;
+        void *sequence_ptr = static_cast<int8_t *>(sequence.data_ptr()) + first_chunk * T;
+        void *qstring_ptr = static_cast<int8_t *>(qstring.data_ptr()) + first_chunk * T;
+        // The kernels stop each chunk at the length in its row of the table.
+        auto chunk_lengths = chunks.select(1, 1);
+        if (chunk_steps.defined()) {
+            chunk_lengths.narrow(0, 0, n).copy_(chunk_steps.narrow(0, first_chunk, n),
+                                                /*non_blocking=*/true);
+            partial_steps = true;
+        } else if (partial_steps) {
+            chunk_lengths.fill_(int(T));
+            partial_steps = false;
+        }
+
+        dorado::utils::handle_cuda_result(host_back_guide_step(
+                chunks.data_ptr(), chunk_results.data_ptr(), n, scores_ptr, C, aux.data_ptr(),
+                path.data_ptr(), moves_ptr, NULL, sequence_ptr, qstring_ptr, options.q_scale,
+                options.q_shift, options.beam_width, options.beam_cut, options.blank_score));
+
+        dorado::utils::handle_cuda_result(host_beam_search_step(
+                chunks.data_ptr(), chunk_results.data_ptr(), n, scores_ptr, C, aux.data_ptr(),
+                path.data_ptr(), moves_ptr, NULL, sequence_ptr, qstring_ptr, options.q_scale,
+                options.q_shift, options.beam_width, options.beam_cut, options.blank_score));
+
+        dorado::utils::handle_cuda_result(host_compute_posts_step(
+                chunks.data_ptr(), chunk_results.data_ptr(), n, scores_ptr, C, aux.data_ptr(),
+                path.data_ptr(), moves_ptr, NULL, sequence_ptr, qstring_ptr, options.q_scale,
+                options.q_shift, options.beam_width, options.beam_cut, options.blank_score));
+
+        dorado::utils::handle_cuda_result(host_run_decode(
+                chunks.data_ptr(), chunk_results.data_ptr(), n, scores_ptr, C, aux.data_ptr(),
+                path.data_ptr(), moves_ptr, NULL, sequence_ptr, qstring_ptr, options.q_scale,
+                options.q_shift, options.beam_width, options.beam_cut, options.blank_score,
+                options.move_pad));
+    }
+
+    // Counting bases here saves a reduction per chunk on the host.
+    auto base_offsets = moves.reshape({N, -1}).sum(1).cumsum(0, torch::kInt32);
+    return {batch_moves_sequence_qstring.view({3, N, T}), base_offsets};
 }
 
-std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor moves_sequence_qstring_cpu) {
-    nvtx3::scoped_range loop{"cpu_decode"};
+std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor moves_sequence_qstring_cpu,
+                                               torch::Tensor base_offsets_cpu) {
+    DORADO_TRACE_SCOPE("cpu_decode");
     assert(moves_sequence_qstring_cpu.device() == torch::kCPU);
-    auto moves_cpu = moves_sequence_qstring_cpu[0];
-    auto sequence_cpu = moves_sequence_qstring_cpu[1];
-    auto qstring_cpu = moves_sequence_qstring_cpu[2];
-    int N = moves_cpu.size(0);
-    int T = moves_cpu.size(1);
+    assert(base_offsets_cpu.device() == torch::kCPU && base_offsets_cpu.is_contiguous());
+    // Rows may be strided, as when only some of a batch's chunks were copied back, but each
+    // row is contiguous, so read them in place rather than indexing a tensor per chunk.
+    assert(moves_sequence_qstring_cpu.stride(2) == 1);
+    const auto *const data = static_cast<const char *>(moves_sequence_qstring_cpu.data_ptr());
+    const int64_t plane_stride = moves_sequence_qstring_cpu.stride(0);
+    const int64_t row_stride = moves_sequence_qstring_cpu.stride(1);
+    const auto *const base_offsets = base_offsets_cpu.data_ptr<int32_t>();
+    int N = moves_sequence_qstring_cpu.size(1);
+    int T = moves_sequence_qstring_cpu.size(2);
 
     std::vector<DecodedChunk> called_chunks;
+    called_chunks.reserve(N);
 
     for (int idx = 0; idx < N; idx++) {
-        std::vector<uint8_t> mov((uint8_t *)moves_cpu[idx].data_ptr(),
-                                 (uint8_t *)moves_cpu[idx].data_ptr() + T);
-        auto num_bases = moves_cpu[idx].sum().item<int>();
-        std::string seq((char *)sequence_cpu[idx].data_ptr(),
-                        (char *)sequence_cpu[idx].data_ptr() + num_bases);
-        std::string qstr((char *)qstring_cpu[idx].data_ptr(),
-                         (char *)qstring_cpu[idx].data_ptr() + num_bases);
+        const auto *const moves_ptr = reinterpret_cast<const uint8_t *>(data + idx * row_stride);
+        const auto *const sequence_ptr = data + plane_stride + idx * row_stride;
+        const auto *const qstring_ptr = data + 2 * plane_stride + idx * row_stride;
+
+        std::vector<uint8_t> mov(moves_ptr, moves_ptr + T);
+        const int num_bases = base_offsets[idx] - (idx == 0 ? 0 : base_offsets[idx - 1]);
+        std::string seq(sequence_ptr, sequence_ptr + num_bases);
+        std::string qstr(qstring_ptr, qstring_ptr + num_bases);
 
         called_chunks.emplace_back(DecodedChunk{std::move(seq), std::move(qstr), std::move(mov)});
     }
@@ -108,7 +156,8 @@ std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor moves_sequence_qstr
 std::vector<DecodedChunk> GPUDecoder::beam_search(const torch::Tensor &scores,
                                                   int num_chunks,
                                                   const DecoderOptions &options) {
-    return cpu_part(gpu_part(scores, num_chunks, options));
+    auto [moves_sequence_qstring, base_offsets] = gpu_part(scores, num_chunks, options);
+    return cpu_part(moves_sequence_qstring.cpu(), base_offsets.cpu());
 }
 
 }  // namespace dorado
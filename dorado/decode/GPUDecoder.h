@@ -4,6 +4,8 @@
 
 #include <torch/torch.h>
 
+#include <utility>
+
 namespace dorado {
 
 class GPUDecoder : Decoder {
@@ -12,12 +14,29 @@ public:
                                           int num_chunks,
                                           const DecoderOptions& options) final;
     constexpr static torch::ScalarType dtype = torch::kF16;
+    // Larger batches are decoded this many chunks at a time, which bounds the decoder's
+    // working memory, itself about half the size of the scores, whatever the batch size.
+    constexpr static int kMaxChunksPerDecode = 512;
 
     // We split beam_search into two parts, the first one running on the GPU and the second
     // one on the CPU. While the second part is running we can submit more commands to the GPU
     // on another thread.
-    torch::Tensor gpu_part(torch::Tensor scores, int num_chunks, DecoderOptions options);
-    std::vector<DecodedChunk> cpu_part(torch::Tensor moves_sequence_qstring_cpu);
+    // gpu_part returns the moves, sequence and qstring of each chunk, shape (3, N, T), and the
+    // running total of bases called up to the end of each chunk, shape (N).  cpu_part takes
+    // host copies of both, which may cover just the first chunks of the batch.
+    // Only the first num_chunks chunks are decoded; the rows of the others are left zeroed.
+    // If given, chunk_steps is a pinned int32 host tensor of the number of steps at the start
+    // of each chunk to decode, and each chunk's moves, sequence and qstring after those are
+    // left zeroed.  It is read asynchronously, so must be left untouched until the results
+    // have been copied back.
+    // A decoder's buffers are reused by each call, and grown for larger batches than it has
+    // decoded before, so it must not be shared between threads.
+    std::pair<torch::Tensor, torch::Tensor> gpu_part(torch::Tensor scores,
+                                                     int num_chunks,
+                                                     DecoderOptions options,
+                                                     torch::Tensor chunk_steps = {});
+    static std::vector<DecodedChunk> cpu_part(torch::Tensor moves_sequence_qstring_cpu,
+                                              torch::Tensor base_offsets_cpu);
 
 private:
     torch::Tensor chunks;
@@ -26,6 +45,8 @@ private:
     torch::Tensor path;
     torch::Tensor moves_sequence_qstring;
     bool initialized{false};
+    // Whether the chunk table holds lengths from chunk_steps, rather than the full length.
+    bool partial_steps{false};
 };
 
 }  // namespace dorado
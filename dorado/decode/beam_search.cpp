@@ -1,6 +1,7 @@
 #include "beam_search.h"
 
 #include "fast_hash.h"
+#include "utils/simd.h"
 
 #include <math.h>
 #include <spdlog/spdlog.h>
@@ -8,6 +9,7 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstring>
 #include <iostream>
 #include <limits>
@@ -20,7 +22,7 @@ namespace {
 // 16 bit state supports 7-mers with 4 bases.
 typedef int16_t state_t;
 
-const int num_bases = 4;
+constexpr int num_bases = 4;
 
 // This is the data we need to retain for the whole beam
 struct BeamElement {
@@ -39,6 +41,28 @@ struct BeamFrontElement {
     bool stay;
 };
 
+// Working buffers for decoding, kept per thread so that a decoding thread stops allocating
+// them once it has decoded its first chunk, and only the decoded chunk itself is allocated.
+// Every element that is read is first written by the same call, so stale contents from
+// earlier calls are harmless.
+struct BeamSearchScratch {
+    std::vector<BeamElement> beam_vector;
+    std::vector<BeamFrontElement> beam_front_vector_1;
+    std::vector<BeamFrontElement> beam_front_vector_2;
+    std::vector<float> candidate_scores;
+    std::vector<float> sorted_back_guides;
+    // The path and its qual data, for generate_sequence.
+    std::vector<int32_t> states;
+    std::vector<float> qual_data;
+    std::vector<float> base_probs;
+    std::vector<float> total_probs;
+};
+
+BeamSearchScratch& beam_search_scratch() {
+    static thread_local BeamSearchScratch scratch;
+    return scratch;
+}
+
 float log_sum_exp(float x, float y, float t) {
     float abs_diff = fabsf(x - y) / t;
     return fmaxf(x, y) + ((abs_diff < 17.0f) ? (log1pf(expf(-abs_diff)) * t) : 0.0f);
@@ -46,6 +70,120 @@ float log_sum_exp(float x, float y, float t) {
 
 bool score_sort(const BeamFrontElement& a, const BeamFrontElement& b) { return a.score > b.score; }
 
+}  // anonymous namespace
+
+// Kernels over the scores of a beam front, declared in beam_search.h so they can be tested.
+// On x86 the AVX2 versions are picked at runtime if the CPU supports them.
+
+#if !ENABLE_NEON_IMPL
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+float max_beam_front_score(const float* const scores, size_t count) {
+    float max = -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < count; ++i) {
+        if (scores[i] > max) {
+            max = scores[i];
+        }
+    }
+    return max;
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+size_t count_beam_front_scores_at_least(const float* const scores,
+                                        size_t count,
+                                        float threshold) {
+    size_t num_at_least = 0;
+    for (size_t i = 0; i < count; ++i) {
+        num_at_least += scores[i] >= threshold;
+    }
+    return num_at_least;
+}
+#endif  // !ENABLE_NEON_IMPL
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2"))) float max_beam_front_score(const float* const scores,
+                                                           size_t count) {
+    static constexpr size_t kUnroll = 8;
+    // maxps returns its second operand if either is NaN, so NaN scores never replace the max.
+    __m256 max_vec = _mm256_set1_ps(-std::numeric_limits<float>::max());
+    size_t i = 0;
+    for (; i + kUnroll <= count; i += kUnroll) {
+        max_vec = _mm256_max_ps(_mm256_loadu_ps(&scores[i]), max_vec);
+    }
+    alignas(32) float lanes[kUnroll];
+    _mm256_store_ps(lanes, max_vec);
+    float max = lanes[0];
+    for (size_t lane = 1; lane < kUnroll; ++lane) {
+        max = std::max(max, lanes[lane]);
+    }
+    for (; i < count; ++i) {
+        if (scores[i] > max) {
+            max = scores[i];
+        }
+    }
+    return max;
+}
+
+__attribute__((target("avx2"))) size_t count_beam_front_scores_at_least(
+        const float* const scores,
+        size_t count,
+        float threshold) {
+    static constexpr size_t kUnroll = 8;
+    const __m256 threshold_vec = _mm256_set1_ps(threshold);
+    size_t num_at_least = 0;
+    size_t i = 0;
+    for (; i + kUnroll <= count; i += kUnroll) {
+        const __m256 at_least =
+                _mm256_cmp_ps(_mm256_loadu_ps(&scores[i]), threshold_vec, _CMP_GE_OQ);
+        num_at_least += __builtin_popcount(_mm256_movemask_ps(at_least));
+    }
+    for (; i < count; ++i) {
+        num_at_least += scores[i] >= threshold;
+    }
+    return num_at_least;
+}
+#elif ENABLE_NEON_IMPL
+float max_beam_front_score(const float* const scores, size_t count) {
+    static constexpr size_t kUnroll = 4;
+    // fmaxnm returns the number if one operand is NaN, so NaN scores never replace the max.
+    float32x4_t max_vec = vdupq_n_f32(-std::numeric_limits<float>::max());
+    size_t i = 0;
+    for (; i + kUnroll <= count; i += kUnroll) {
+        max_vec = vmaxnmq_f32(vld1q_f32(&scores[i]), max_vec);
+    }
+    float max = vmaxnmvq_f32(max_vec);
+    for (; i < count; ++i) {
+        if (scores[i] > max) {
+            max = scores[i];
+        }
+    }
+    return max;
+}
+
+size_t count_beam_front_scores_at_least(const float* const scores,
+                                        size_t count,
+                                        float threshold) {
+    static constexpr size_t kUnroll = 4;
+    const float32x4_t threshold_vec = vdupq_n_f32(threshold);
+    // Comparisons set all bits of a lane, i.e. -1, so subtracting the mask counts matches.
+    uint32x4_t count_vec = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + kUnroll <= count; i += kUnroll) {
+        count_vec = vsubq_u32(count_vec, vcgeq_f32(vld1q_f32(&scores[i]), threshold_vec));
+    }
+    size_t num_at_least = vaddvq_u32(count_vec);
+    for (; i < count; ++i) {
+        num_at_least += scores[i] >= threshold;
+    }
+    return num_at_least;
+}
+#endif
+
+namespace {
+
 int get_num_states(size_t num_trans_states) {
 #ifdef REMOVE_FIXED_BEAM_STAYS
     if (num_trans_states % num_bases != 0) {
@@ -72,7 +210,11 @@ std::tuple<std::string, std::string> generate_sequence(const std::vector<uint8_t
     std::string sequence(seqLen, 'N');
     std::string qstring(seqLen, '!');
     std::array<char, 4> alphabet = {'A', 'C', 'G', 'T'};
-    std::vector<float> baseProbs(seqLen), totalProbs(seqLen);
+    auto& scratch = beam_search_scratch();
+    auto& baseProbs = scratch.base_probs;
+    auto& totalProbs = scratch.total_probs;
+    baseProbs.assign(seqLen, 0.f);
+    totalProbs.assign(seqLen, 0.f);
 
     for (size_t blk = 0; blk < num_blocks; ++blk) {
         int state = states[blk];
@@ -111,16 +253,86 @@ std::tuple<std::string, std::string> generate_sequence(const std::vector<uint8_t
     return make_tuple(sequence, qstring);
 }
 
+// Replaces each of the path's states with the base it emits, and computes per-base qual data
+// from the posteriors of the path's kmers.
+void compute_qual_data(std::vector<int32_t>& states,
+                       const float* const posts,
+                       size_t num_states,
+                       std::vector<float>& qual_data) {
+    const size_t num_blocks = states.size();
+    int shifted_states[2 * num_bases];
+
+    // Compute per-base qual data
+    for (size_t block_idx = 0; block_idx < num_blocks; block_idx++) {
+        int state = states[block_idx];
+        states[block_idx] = states[block_idx] % num_bases;
+        int base_to_emit = states[block_idx];
+
+        // Compute a probability for this block, based on the path kmer. See the following explanation:
+        // https://git.oxfordnanolabs.local/machine-learning/notebooks/-/blob/master/bonito-basecaller-qscores.ipynb
+        const float* timestep_posts = posts + ((block_idx + 1) * num_states);
+
+        float block_prob = float(timestep_posts[state]);
+
+        // Get indices of left- and right-shifted kmers
+        int l_shift_idx = state / num_bases;
+        int r_shift_idx = (state * num_bases) % num_states;
+        int msb = int(num_states) / num_bases;
+        int l_shift_state, r_shift_state;
+        for (int shift_base = 0; shift_base < num_bases; shift_base++) {
+            l_shift_state = l_shift_idx + msb * shift_base;
+            shifted_states[2 * shift_base] = l_shift_state;
+
+            r_shift_state = r_shift_idx + shift_base;
+            shifted_states[2 * shift_base + 1] = r_shift_state;
+        }
+
+        // Add probabilities for unique states
+        int candidate_state;
+        for (size_t state_idx = 0; state_idx < 2 * num_bases; ++state_idx) {
+            candidate_state = shifted_states[state_idx];
+            // don't double-count this shifted state if it matches the current state
+            bool count_state = (candidate_state != state);
+            // or any other shifted state that we've seen so far
+            if (count_state) {
+                for (int inner_state = 0; inner_state < state_idx; ++inner_state) {
+                    if (shifted_states[inner_state] == candidate_state) {
+                        count_state = false;
+                        break;
+                    }
+                }
+            }
+            if (count_state) {
+                block_prob += float(timestep_posts[candidate_state]);
+            }
+        }
+
+        block_prob = std::clamp(block_prob, 0.0f, 1.0f);
+        block_prob = powf(block_prob, 0.4f);  // Power fudge factor
+
+        // Calculate a placeholder qscore for the "wrong" bases
+        float wrong_base_prob = (1.0f - block_prob) / 3.0f;
+
+        for (size_t base = 0; base < num_bases; base++) {
+            qual_data[block_idx * num_bases + base] =
+                    (int(base) == base_to_emit ? block_prob : wrong_base_prob);
+        }
+    }
+}
+
 }  // anonymous namespace
 
-template <typename T>
+// kNumStates and kBeamWidth, if not 0, fix the number of states and beam width at compile time,
+// with scores for each transition of a block contiguous, so that the state arithmetic and loop
+// bounds are constants and the beam fronts live on the stack.
+template <typename T, size_t kNumStates = 0, size_t kBeamWidth = 0>
 float beam_search(const T* const scores,
-                  size_t scores_block_stride,
+                  size_t runtime_scores_block_stride,
                   const float* const back_guide,
                   const float* const posts,
-                  size_t num_states,
+                  size_t runtime_num_states,
                   size_t num_blocks,
-                  size_t max_beam_width,
+                  size_t runtime_beam_width,
                   float beam_cut,
                   float fixed_stay_score,
                   std::vector<int32_t>& states,
@@ -128,6 +340,12 @@ float beam_search(const T* const scores,
                   std::vector<float>& qual_data,
                   float temperature,
                   float score_scale) {
+    const size_t num_states = kNumStates != 0 ? kNumStates : runtime_num_states;
+    const size_t scores_block_stride =
+            kNumStates != 0 ? kNumStates * num_bases : runtime_scores_block_stride;
+    const size_t max_beam_width = kBeamWidth != 0 ? kBeamWidth : runtime_beam_width;
+    assert(num_states == runtime_num_states && max_beam_width == runtime_beam_width &&
+           scores_block_stride == runtime_scores_block_stride);
     if (max_beam_width > 256) {
         throw std::range_error("Beamsearch max_beam_width cannot be greater than 256.");
     }
@@ -138,28 +356,44 @@ float beam_search(const T* const scores,
             (beam_cut > 0.0f) ? (temperature * logf(beam_cut)) : std::numeric_limits<float>::max();
 
     // Create the beam.  We need to keep beam_width elements for each block, plus the initial state
-    std::vector<BeamElement> beam_vector(max_beam_width * (num_blocks + 1));
+    auto& scratch = beam_search_scratch();
+    auto& beam_vector = scratch.beam_vector;
+    beam_vector.resize(max_beam_width * (num_blocks + 1));
 
     // Create the previous and current beam fronts
     // Each existing element can be extended by one of num_bases, or be a stay.
     size_t max_beam_candidates = (num_bases + 1) * max_beam_width;
 
-    std::vector<BeamFrontElement> beam_front_vector_1(max_beam_candidates);
-    std::vector<BeamFrontElement> beam_front_vector_2(max_beam_candidates);
-    std::vector<BeamFrontElement>* current_beam_front = &beam_front_vector_1;
-    std::vector<BeamFrontElement>* prev_beam_front = &beam_front_vector_2;
+    // With a fixed beam width the fronts are on the stack, and otherwise in the scratch buffers.
+    constexpr size_t kMaxBeamCandidates = (num_bases + 1) * std::max<size_t>(kBeamWidth, 1);
+    std::array<BeamFrontElement, kMaxBeamCandidates> fixed_beam_front_1;
+    std::array<BeamFrontElement, kMaxBeamCandidates> fixed_beam_front_2;
+    std::array<float, kMaxBeamCandidates> fixed_candidate_scores;
+    BeamFrontElement* current_beam_front = fixed_beam_front_1.data();
+    BeamFrontElement* prev_beam_front = fixed_beam_front_2.data();
+    // Scores of the current beam front's candidates, for the vectorised selection kernels.
+    float* candidate_scores = fixed_candidate_scores.data();
+    if constexpr (kBeamWidth == 0) {
+        scratch.beam_front_vector_1.resize(max_beam_candidates);
+        scratch.beam_front_vector_2.resize(max_beam_candidates);
+        scratch.candidate_scores.resize(max_beam_candidates);
+        current_beam_front = scratch.beam_front_vector_1.data();
+        prev_beam_front = scratch.beam_front_vector_2.data();
+        candidate_scores = scratch.candidate_scores.data();
+    }
 
     // Find the score an initial element needs in order to make it into the beam
-    T beam_init_threshold = std::numeric_limits<T>::lowest();
+    // Back guides are floats whatever the type of the scores.
+    float beam_init_threshold = std::numeric_limits<float>::lowest();
     if (max_beam_width < num_states) {
         // Copy the first set of back guides and sort to extract max_beam_width highest elements
-        std::vector<T> sorted_back_guides(num_states);
-        memcpy(sorted_back_guides.data(), back_guide, num_states * sizeof(T));
+        auto& sorted_back_guides = scratch.sorted_back_guides;
+        sorted_back_guides.assign(back_guide, back_guide + num_states);
 
         // Note we don't need a full sort here to get the max_beam_width highest values
         std::nth_element(sorted_back_guides.begin(),
                          sorted_back_guides.begin() + max_beam_width - 1, sorted_back_guides.end(),
-                         std::greater<T>());
+                         std::greater<float>());
         beam_init_threshold = sorted_back_guides[max_beam_width - 1];
     }
 
@@ -168,7 +402,7 @@ float beam_search(const T* const scores,
          state++) {
         if (back_guide[state] >= beam_init_threshold) {
             // Note that this first element has a prev_element_index of 0
-            (*prev_beam_front)[beam_element++] = {chainfasthash64(hash_seed, state), 0.0f,
+            prev_beam_front[beam_element++] = {chainfasthash64(hash_seed, state), 0.0f,
                                                   state_t(state), 0, false};
         }
     }
@@ -176,10 +410,10 @@ float beam_search(const T* const scores,
     // Copy this initial beam front into the beam persistent state
     size_t current_beam_width = std::min(max_beam_width, num_states);
     for (size_t element_idx = 0; element_idx < current_beam_width; element_idx++) {
-        beam_vector[element_idx].state = (*prev_beam_front)[element_idx].state;
+        beam_vector[element_idx].state = prev_beam_front[element_idx].state;
         beam_vector[element_idx].prev_element_index =
-                (*prev_beam_front)[element_idx].prev_element_index;
-        beam_vector[element_idx].stay = (*prev_beam_front)[element_idx].stay;
+                prev_beam_front[element_idx].prev_element_index;
+        beam_vector[element_idx].stay = prev_beam_front[element_idx].stay;
     }
 
     // Iterate through blocks, extending beam
@@ -240,7 +474,7 @@ float beam_search(const T* const scores,
         // Generate list of candidate elements for this timestep (block)
         size_t new_elem_count = 0;
         for (size_t prev_elem_idx = 0; prev_elem_idx < current_beam_width; prev_elem_idx++) {
-            const auto& previous_element = (*prev_beam_front)[prev_elem_idx];
+            const auto& previous_element = prev_beam_front[prev_elem_idx];
 
             // Expand all the possible steps
             for (size_t new_base = 0; new_base < num_bases; new_base++) {
@@ -253,13 +487,13 @@ float beam_search(const T* const scores,
                 uint64_t new_hash = chainfasthash64(previous_element.hash, new_state);
 
                 // Add new element to the candidate list
-                (*current_beam_front)[new_elem_count++] = {new_hash, new_score, new_state,
+                current_beam_front[new_elem_count++] = {new_hash, new_score, new_state,
                                                            (uint8_t)prev_elem_idx, false};
             }
         }
 
         for (size_t prev_elem_idx = 0; prev_elem_idx < current_beam_width; prev_elem_idx++) {
-            const auto& previous_element = (*prev_beam_front)[prev_elem_idx];
+            const auto& previous_element = prev_beam_front[prev_elem_idx];
             // Add the possible stay
 #ifdef REMOVE_FIXED_BEAM_STAYS
             const float stay_score = previous_element.score + fixed_stay_score +
@@ -269,7 +503,7 @@ float beam_search(const T* const scores,
             const float stay_score = previous_element.score + fetch_block_score(stay_idx) +
                                      static_cast<float>(block_back_scores[previous_element.state]);
 #endif
-            (*current_beam_front)[new_elem_count++] = {previous_element.hash, stay_score,
+            current_beam_front[new_elem_count++] = {previous_element.hash, stay_score,
                                                        previous_element.state,
                                                        (uint8_t)prev_elem_idx, true};
         }
@@ -279,31 +513,31 @@ float beam_search(const T* const scores,
             // The index of the stay in the beamfront
             size_t stay_elem_idx = num_bases * current_beam_width + prev_elem_idx;
             // latest base is in smallest bits
-            int stay_latest_base = int((*current_beam_front)[stay_elem_idx].state % num_bases);
+            int stay_latest_base = int(current_beam_front[stay_elem_idx].state % num_bases);
 
             // Go through all the possible step extensions that match this destination base with the stay and compare
             //  their hashes, merging if we find any
             for (size_t prev_elem_comp_idx = 0; prev_elem_comp_idx < current_beam_width;
                  prev_elem_comp_idx++) {
                 size_t step_elem_idx = prev_elem_comp_idx * num_bases + stay_latest_base;
-                if ((*current_beam_front)[stay_elem_idx].hash ==
-                    (*current_beam_front)[step_elem_idx].hash) {
-                    if ((*current_beam_front)[stay_elem_idx].score >
-                        (*current_beam_front)[step_elem_idx].score) {
+                if (current_beam_front[stay_elem_idx].hash ==
+                    current_beam_front[step_elem_idx].hash) {
+                    if (current_beam_front[stay_elem_idx].score >
+                        current_beam_front[step_elem_idx].score) {
                         // Fold the step into the stay
-                        (*current_beam_front)[stay_elem_idx].score = log_sum_exp(
-                                (*current_beam_front)[stay_elem_idx].score,
-                                (*current_beam_front)[step_elem_idx].score, temperature);
+                        current_beam_front[stay_elem_idx].score = log_sum_exp(
+                                current_beam_front[stay_elem_idx].score,
+                                current_beam_front[step_elem_idx].score, temperature);
                         // The step element will end up last, sorted by score
-                        (*current_beam_front)[step_elem_idx].score =
+                        current_beam_front[step_elem_idx].score =
                                 -std::numeric_limits<float>::max();
                     } else {
                         // Fold the stay into the step
-                        (*current_beam_front)[step_elem_idx].score = log_sum_exp(
-                                (*current_beam_front)[stay_elem_idx].score,
-                                (*current_beam_front)[step_elem_idx].score, temperature);
+                        current_beam_front[step_elem_idx].score = log_sum_exp(
+                                current_beam_front[stay_elem_idx].score,
+                                current_beam_front[step_elem_idx].score, temperature);
                         // The stay element will end up last, sorted by score
-                        (*current_beam_front)[stay_elem_idx].score =
+                        current_beam_front[stay_elem_idx].score =
                                 -std::numeric_limits<float>::max();
                     }
                 }
@@ -311,35 +545,28 @@ float beam_search(const T* const scores,
         }
 
         // There are now `new_elem_count` elements in the list.  Let's get the max
-        float max_score = -std::numeric_limits<float>::max();
         for (size_t elem_idx = 0; elem_idx < new_elem_count; elem_idx++) {
-            if ((*current_beam_front)[elem_idx].score > max_score)
-                max_score = (*current_beam_front)[elem_idx].score;
+            candidate_scores[elem_idx] = current_beam_front[elem_idx].score;
         }
+        const float block_max_score = max_beam_front_score(candidate_scores, new_elem_count);
 
         // Starting point for finding the cutoff score is the beam cut score
-        float beam_cutoff_score = max_score - log_beam_cut;
+        float beam_cutoff_score = block_max_score - log_beam_cut;
 
-        auto get_elem_count = [](const std::vector<BeamFrontElement>* current_beam_front,
-                                 size_t new_elem_count, float beam_score) {
+        auto get_elem_count = [candidate_scores, new_elem_count](float beam_score) {
             // Count the elements which meet the beam score
-            size_t count = 0;
-            for (size_t elem_idx = 0; elem_idx < new_elem_count; elem_idx++) {
-                if ((*current_beam_front)[elem_idx].score >= beam_score)
-                    count++;
-            }
-            return count;
+            return count_beam_front_scores_at_least(candidate_scores, new_elem_count, beam_score);
         };
 
         // Count the elements which meet the min score
-        size_t elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+        size_t elem_count = get_elem_count(beam_cutoff_score);
 
         if (elem_count > max_beam_width) {
             // Need to find a score which doesn't return too many scores, but doesn't reduce beam width too much
             size_t min_beam_width =
                     (max_beam_width * 8) / 10;  // 80% of beam width is the minimum we accept.
             float low_score = beam_cutoff_score;
-            float hi_score = max_score;
+            float hi_score = block_max_score;
             int num_guesses = 1;
             static const int MAX_GUESSES = 10;
             while ((elem_count > max_beam_width || elem_count < min_beam_width) &&
@@ -353,7 +580,7 @@ float beam_search(const T* const scores,
                     hi_score = beam_cutoff_score;
                     beam_cutoff_score = (beam_cutoff_score + low_score) / 2.0f;  // binary search.
                 }
-                elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+                elem_count = get_elem_count(beam_cutoff_score);
                 num_guesses++;
             }
             // If we made 10 guesses and didn't find a suitable score, a couple of things may have happened:
@@ -365,7 +592,7 @@ float beam_search(const T* const scores,
             //  - in this case we should just take the hi_score and accept it will return us less than 80% of the beam
             if (num_guesses == MAX_GUESSES) {
                 beam_cutoff_score = hi_score;
-                elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+                elem_count = get_elem_count(beam_cutoff_score);
             }
         }
         // Clamp the element count to the max beam width in case of failure 2 from above.
@@ -373,37 +600,41 @@ float beam_search(const T* const scores,
 
         size_t write_idx = 0;
         for (unsigned int read_idx = 0; read_idx < new_elem_count; read_idx++) {
-            if ((*current_beam_front)[read_idx].score >= beam_cutoff_score) {
+            if (candidate_scores[read_idx] >= beam_cutoff_score) {
                 if (write_idx < max_beam_width) {
-                    (*prev_beam_front)[write_idx] = (*current_beam_front)[read_idx];
+                    prev_beam_front[write_idx] = current_beam_front[read_idx];
                     write_idx++;
                 }
             }
         }
 
-        // At the last timestep, we need to sort the prev_beam_front as the best path needs to be at the start
-        // NOTE: We only want the top score out, so the cutoff is set to 1
-        if (block_idx == num_blocks - 1) {
-            merge_sort(prev_beam_front->data(), elem_count, 1, score_sort);
+        // At the last timestep the best path needs to be at the start.  Only it is traced back,
+        // so it is swapped there rather than sorting the front.  Of equal scores the first wins,
+        // as in a stable sort.
+        if (block_idx == num_blocks - 1 && elem_count != 0) {
+            auto best = std::max_element(
+                    prev_beam_front, prev_beam_front + elem_count,
+                    [](const auto& a, const auto& b) { return score_sort(b, a); });
+            std::swap(prev_beam_front[0], *best);
         }
 
         size_t beam_offset = (block_idx + 1) * max_beam_width;
         for (size_t i = 0; i < elem_count; i++) {
             // Remove backwards contribution from score
-            (*prev_beam_front)[i].score -= float(block_back_scores[(*prev_beam_front)[i].state]);
+            prev_beam_front[i].score -= float(block_back_scores[prev_beam_front[i].state]);
 
             // Copy this new beam front into the beam persistent state
-            beam_vector[beam_offset + i].state = (*prev_beam_front)[i].state;
+            beam_vector[beam_offset + i].state = prev_beam_front[i].state;
             beam_vector[beam_offset + i].prev_element_index =
-                    (*prev_beam_front)[i].prev_element_index;
-            beam_vector[beam_offset + i].stay = (*prev_beam_front)[i].stay;
+                    prev_beam_front[i].prev_element_index;
+            beam_vector[beam_offset + i].stay = prev_beam_front[i].stay;
         }
 
         current_beam_width = elem_count;
     }
 
     // Extract final score
-    const float final_score = (*prev_beam_front)[0].score;
+    const float final_score = prev_beam_front[0].score;
 
     // Write out sequence bases and move table
     moves.resize(num_blocks);
@@ -419,66 +650,48 @@ float beam_search(const T* const scores,
     }
     moves[0] = 1;  // Always step in the first event
 
-    int shifted_states[2 * num_bases];
-
-    // Compute per-base qual data
-    for (size_t block_idx = 0; block_idx < num_blocks; block_idx++) {
-        int state = states[block_idx];
-        states[block_idx] = states[block_idx] % num_bases;
-        int base_to_emit = states[block_idx];
-
-        // Compute a probability for this block, based on the path kmer. See the following explanation:
-        // https://git.oxfordnanolabs.local/machine-learning/notebooks/-/blob/master/bonito-basecaller-qscores.ipynb
-        const float* timestep_posts = posts + ((block_idx + 1) * num_states);
+    compute_qual_data(states, posts, num_states, qual_data);
 
-        float block_prob = float(timestep_posts[state]);
-
-        // Get indices of left- and right-shifted kmers
-        int l_shift_idx = state / num_bases;
-        int r_shift_idx = (state * num_bases) % num_states;
-        int msb = int(num_states) / num_bases;
-        int l_shift_state, r_shift_state;
-        for (int shift_base = 0; shift_base < num_bases; shift_base++) {
-            l_shift_state = l_shift_idx + msb * shift_base;
-            shifted_states[2 * shift_base] = l_shift_state;
-
-            r_shift_state = r_shift_idx + shift_base;
-            shifted_states[2 * shift_base + 1] = r_shift_state;
-        }
-
-        // Add probabilities for unique states
-        int candidate_state;
-        for (size_t state_idx = 0; state_idx < 2 * num_bases; ++state_idx) {
-            candidate_state = shifted_states[state_idx];
-            // don't double-count this shifted state if it matches the current state
-            bool count_state = (candidate_state != state);
-            // or any other shifted state that we've seen so far
-            if (count_state) {
-                for (int inner_state = 0; inner_state < state_idx; ++inner_state) {
-                    if (shifted_states[inner_state] == candidate_state) {
-                        count_state = false;
-                        break;
-                    }
-                }
-            }
-            if (count_state) {
-                block_prob += float(timestep_posts[candidate_state]);
-            }
-        }
-
-        block_prob = std::clamp(block_prob, 0.0f, 1.0f);
-        block_prob = powf(block_prob, 0.4f);  // Power fudge factor
-
-        // Calculate a placeholder qscore for the "wrong" bases
-        float wrong_base_prob = (1.0f - block_prob) / 3.0f;
+    return final_score;
+}
 
-        for (size_t base = 0; base < num_bases; base++) {
-            qual_data[block_idx * num_bases + base] =
-                    (int(base) == base_to_emit ? block_prob : wrong_base_prob);
+// Picks a specialised beam search for the common state lengths (3, 4 and 5) and beam width,
+// when the scores of each block are contiguous, and the general one otherwise.
+template <typename T>
+float dispatch_beam_search(const T* const scores,
+                           size_t scores_block_stride,
+                           const float* const back_guide,
+                           const float* const posts,
+                           size_t num_states,
+                           size_t num_blocks,
+                           size_t max_beam_width,
+                           float beam_cut,
+                           float fixed_stay_score,
+                           std::vector<int32_t>& states,
+                           std::vector<uint8_t>& moves,
+                           std::vector<float>& qual_data,
+                           float temperature,
+                           float score_scale) {
+    constexpr size_t kCommonBeamWidth = 32;
+    auto search = beam_search<T>;
+    if (max_beam_width == kCommonBeamWidth && scores_block_stride == num_states * num_bases) {
+        switch (num_states) {
+        case 64:
+            search = beam_search<T, 64, kCommonBeamWidth>;
+            break;
+        case 256:
+            search = beam_search<T, 256, kCommonBeamWidth>;
+            break;
+        case 1024:
+            search = beam_search<T, 1024, kCommonBeamWidth>;
+            break;
+        default:
+            break;
         }
     }
-
-    return final_score;
+    return search(scores, scores_block_stride, back_guide, posts, num_states, num_blocks,
+                  max_beam_width, beam_cut, fixed_stay_score, states, moves, qual_data,
+                  temperature, score_scale);
 }
 
 std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
@@ -496,9 +709,13 @@ std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
     const int num_states = get_num_states(scores_t.size(1));
 
     std::string sequence, qstring;
-    std::vector<int32_t> states(num_blocks);
+    auto& scratch = beam_search_scratch();
+    auto& states = scratch.states;
+    auto& qual_data = scratch.qual_data;
+    states.resize(num_blocks);
+    qual_data.resize(num_blocks * num_bases);
+    // Returned with the chunk, so it can't be reused.
     std::vector<uint8_t> moves(num_blocks);
-    std::vector<float> qual_data(num_blocks * num_bases);
 
     // Posterior probabilities and back guides must be floats regardless of scores type.
     if (posts_t.dtype() != torch::kFloat32 || back_guides_t.dtype() != torch::kFloat32) {
@@ -518,17 +735,17 @@ std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
         const auto back_guides = back_guides_contig->data_ptr<float>();
         const auto posts = posts_contig->data_ptr<float>();
 
-        beam_search<float>(scores, scores_block_stride, back_guides, posts, num_states, num_blocks,
-                           beam_width, beam_cut, fixed_stay_score, states, moves, qual_data,
-                           temperature, 1.0f);
+        dispatch_beam_search<float>(scores, scores_block_stride, back_guides, posts, num_states,
+                                    num_blocks, beam_width, beam_cut, fixed_stay_score, states,
+                                    moves, qual_data, temperature, 1.0f);
     } else if (scores_t.dtype() == torch::kInt8) {
         const auto scores = scores_block_contig.data_ptr<int8_t>();
         const auto back_guides = back_guides_contig->data_ptr<float>();
         const auto posts = posts_contig->data_ptr<float>();
 
-        beam_search<int8_t>(scores, scores_block_stride, back_guides, posts, num_states, num_blocks,
-                            beam_width, beam_cut, fixed_stay_score, states, moves, qual_data,
-                            temperature, byte_score_scale);
+        dispatch_beam_search<int8_t>(scores, scores_block_stride, back_guides, posts, num_states,
+                                     num_blocks, beam_width, beam_cut, fixed_stay_score, states,
+                                     moves, qual_data, temperature, byte_score_scale);
     } else {
         throw std::runtime_error(std::string("beam_search_decode: unsupported tensor type ") +
                                  std::string(scores_t.dtype().name()));
@@ -538,3 +755,25 @@ std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
 
     return std::make_tuple(sequence, qstring, moves);
 }
+
+std::tuple<std::string, std::string, std::vector<uint8_t>> path_decode(
+        std::vector<int32_t> states,
+        std::vector<uint8_t> moves,
+        const torch::Tensor& posts_t,
+        float q_shift,
+        float q_scale) {
+    if (posts_t.dtype() != torch::kFloat32) {
+        throw std::runtime_error("path_decode: posts must be float");
+    }
+    const size_t num_blocks = states.size();
+    if (moves.size() != num_blocks || posts_t.size(0) != int64_t(num_blocks) + 1) {
+        throw std::runtime_error("path_decode: mismatched path and posts lengths");
+    }
+    auto posts_contig = posts_t.expect_contiguous();
+    auto& qual_data = beam_search_scratch().qual_data;
+    qual_data.resize(num_blocks * num_bases);
+    compute_qual_data(states, posts_contig->data_ptr<float>(), posts_t.size(1), qual_data);
+
+    auto [sequence, qstring] = generate_sequence(moves, states, qual_data, q_shift, q_scale);
+    return std::make_tuple(std::move(sequence), std::move(qstring), std::move(moves));
+}
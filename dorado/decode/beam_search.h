@@ -57,6 +57,13 @@ void merge_sort(T* data,
     }
 }
 
+// Kernels over the scores of a beam front, vectorised where the CPU allows.  NaN scores are
+// ignored by both, as in a scalar comparison.
+// Returns the largest score, or -FLT_MAX if there are none.
+float max_beam_front_score(const float* scores, size_t count);
+// Returns how many scores are >= threshold.
+size_t count_beam_front_scores_at_least(const float* scores, size_t count, float threshold);
+
 std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
         const torch::Tensor& scores_t,
         const torch::Tensor& back_guides_t,
@@ -67,4 +74,14 @@ std::tuple<std::string, std::string, std::vector<uint8_t>> beam_search_decode(
         float q_shift,
         float q_scale,
         float temperature,
-        float byte_score_scale);
\ No newline at end of file
+        float byte_score_scale);
+
+// Finishes decoding a chunk whose path was found elsewhere, such as by a Viterbi search on the
+// GPU: states holds the path's state after each timestep, and moves whether it stepped into
+// it.  posts are the chunk's posteriors, shape (T + 1, num_states).
+std::tuple<std::string, std::string, std::vector<uint8_t>> path_decode(
+        std::vector<int32_t> states,
+        std::vector<uint8_t> moves,
+        const torch::Tensor& posts_t,
+        float q_shift,
+        float q_scale);
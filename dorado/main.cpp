@@ -56,7 +56,8 @@ int main(int argc, char* argv[]) {
     const std::map<std::string, entry_ptr> subcommands = {
             {"basecaller", &dorado::basecaller}, {"duplex", &dorado::duplex},
             {"download", &dorado::download},     {"aligner", &dorado::aligner},
-            {"summary", &dorado::summary},
+            {"summary", &dorado::summary},       {"serve", &dorado::serve},
+            {"benchmark", &dorado::benchmark},   {"coordinate", &dorado::coordinate},
     };
 
     std::vector<std::string> arguments(argv + 1, argv + argc);
@@ -7,6 +7,7 @@
 #include <nvtx3/nvtx3.hpp>
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace dorado {
@@ -36,13 +37,59 @@ void RemoraEncoder::init(const std::vector<int>& sequence_ints,
     m_seq_len = int(sequence_ints.size());
 }
 
+size_t RemoraEncoder::encoded_context_size() const {
+    return size_t(m_kmer_len) * RemoraUtils::NUM_BASES * size_t(m_context_samples);
+}
+
 RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
+    std::vector<int8_t> data(encoded_context_size());
+    auto context = get_context(seq_pos, data.data());
+    context.data = std::move(data);
+    return context;
+}
+
+RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos, int8_t* output) const {
+    NVTX3_FUNC_RANGE();
+    std::vector<int> seq_ints;
+    std::vector<int> chunk_seq_to_sig;
+    const auto context = locate_context(seq_pos, seq_ints, chunk_seq_to_sig);
+    encode_kmer(seq_ints, chunk_seq_to_sig, output);
+    return context;
+}
+
+RemoraEncoder::Context RemoraEncoder::get_context_bases(size_t seq_pos,
+                                                        int8_t* bases,
+                                                        int16_t* base_ends) const {
     NVTX3_FUNC_RANGE();
+    std::vector<int> seq_ints;
+    std::vector<int> chunk_seq_to_sig;
+    const auto context = locate_context(seq_pos, seq_ints, chunk_seq_to_sig);
+
+    const auto num_bases = chunk_seq_to_sig.size() - 1;
+    const auto max_bases = max_context_bases(m_block_stride, m_context_samples);
+    if (num_bases > max_bases) {
+        throw std::runtime_error("Context spans more bases than its samples allow.");
+    }
+    // Unused entries give no kmer, and end after the last sample, so no sample maps to them.
+    std::fill_n(bases, max_bases + m_kmer_len - 1, int8_t(-1));
+    std::copy(seq_ints.begin(), seq_ints.end(), bases);
+    std::fill_n(base_ends, max_bases, int16_t(m_context_samples));
+    std::copy(chunk_seq_to_sig.begin() + 1, chunk_seq_to_sig.end(), base_ends);
+    return context;
+}
+
+size_t RemoraEncoder::max_context_bases(size_t block_stride, size_t context_samples) {
+    // A part base at either end, and whole bases in between.
+    return context_samples / block_stride + 2;
+}
+
+RemoraEncoder::Context RemoraEncoder::locate_context(size_t seq_pos,
+                                                     std::vector<int>& seq_ints,
+                                                     std::vector<int>& chunk_seq_to_sig) const {
     if (seq_pos >= size_t(m_seq_len)) {
         throw std::out_of_range("Sequence position out of range.");
     }
 
-    auto encoded_kmer_len = m_kmer_len * RemoraUtils::NUM_BASES;
     Context context{};
     int base_sample_pos =
             (compute_sample_pos(int(seq_pos)) + compute_sample_pos(int(seq_pos) + 1)) / 2;
@@ -73,8 +120,7 @@ RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
     auto seq_start = std::distance(m_sample_offsets.begin(), start_it) - 1;
     auto seq_end = std::distance(m_sample_offsets.begin(), end_it);
 
-    std::vector<int> seq_ints;
-
+    seq_ints.clear();
     if (seq_start >= m_bases_before &&
         seq_end + m_bases_after < static_cast<int>(m_sequence_ints.size())) {
         seq_ints = {m_sequence_ints.begin() + seq_start - m_bases_before,
@@ -95,8 +141,8 @@ RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
                   seq_ints.begin() + fill_st);
     }
 
-    std::vector<int> chunk_seq_to_sig = {m_sample_offsets.begin() + seq_start,
-                                         m_sample_offsets.begin() + seq_end + 1};
+    chunk_seq_to_sig.assign(m_sample_offsets.begin() + seq_start,
+                            m_sample_offsets.begin() + seq_end + 1);
     std::transform(
             chunk_seq_to_sig.begin(), chunk_seq_to_sig.end(), chunk_seq_to_sig.begin(),
             [sig_start = context.first_sample, seq_to_sig_offset = context.lead_samples_needed](
@@ -104,8 +150,6 @@ RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
     chunk_seq_to_sig.front() = 0;
     chunk_seq_to_sig.back() = m_context_samples;
 
-    context.data = encode_kmer(seq_ints, chunk_seq_to_sig);
-
     return context;
 }
 
@@ -127,16 +171,15 @@ int RemoraEncoder::compute_sample_pos(int base_pos) const {
 namespace {
 
 // Fallback path for non-AVX / kmer lengths not specifically optimised.
-inline std::vector<int8_t> encode_kmer_generic(const std::vector<int>& seq,
-                                               const std::vector<int>& seq_mappings,
-                                               int bases_before,
-                                               int bases_after,
-                                               int context_samples,
-                                               int kmer_len) {
+inline void encode_kmer_generic(const std::vector<int>& seq,
+                                const std::vector<int>& seq_mappings,
+                                int bases_before,
+                                int bases_after,
+                                int kmer_len,
+                                int8_t* output) {
     const size_t seq_len = seq.size() - bases_before - bases_after;
-    std::vector<int8_t> output(kmer_len * RemoraUtils::NUM_BASES * context_samples);
 
-    int8_t* output_ptr = &output[0];
+    int8_t* output_ptr = output;
     for (size_t seq_pos = 0; seq_pos < seq_len; ++seq_pos) {
         auto base_st = seq_mappings[seq_pos];
         auto base_en = seq_mappings[seq_pos + 1];
@@ -151,32 +194,30 @@ inline std::vector<int8_t> encode_kmer_generic(const std::vector<int>& seq,
             }
         }
     }
-    return output;
 }
 
 // For non-AVX we use the generic path that handles any kmer length.
 #if ENABLE_AVX2_IMPL
 __attribute__((target("default")))
 #endif
-std::vector<int8_t>
-encode_kmer_len9(const std::vector<int>& seq,
-                 const std::vector<int>& seq_mappings,
-                 int bases_before,
-                 int bases_after,
-                 int context_samples) {
-    return encode_kmer_generic(seq, seq_mappings, bases_before, bases_after, context_samples, 9);
+void encode_kmer_len9(const std::vector<int>& seq,
+                      const std::vector<int>& seq_mappings,
+                      int bases_before,
+                      int bases_after,
+                      int8_t* output) {
+    encode_kmer_generic(seq, seq_mappings, bases_before, bases_after, 9, output);
 }
 
 #if ENABLE_AVX2_IMPL
-__attribute__((target("avx2"))) std::vector<int8_t> encode_kmer_len9(
-        const std::vector<int>& seq,
-        const std::vector<int>& seq_mappings,
-        int bases_before,
-        int bases_after,
-        int context_samples) {
+__attribute__((target("avx2"))) void encode_kmer_len9(const std::vector<int>& seq,
+                                                      const std::vector<int>& seq_mappings,
+                                                      int bases_before,
+                                                      int bases_after,
+                                                      int8_t* output) {
     // These cannot change without a rewrite.
     constexpr int kKmerLen = 9;
     constexpr int kNumBases = 4;
+    static_assert(kKmerLen * kNumBases == 36, "Each sample's encoding is written as 36 bytes");
 
     const __m256i kOnes = _mm256_set_epi32(1, 1, 1, 1, 1, 1, 1, 1);
 
@@ -186,8 +227,7 @@ __attribute__((target("avx2"))) std::vector<int8_t> encode_kmer_len9(
     const __m256i kRotate3 = _mm256_setr_epi32(5, 6, 7, 0, 1, 2, 3, 4);
 
     const size_t seq_len = seq.size() - bases_before - bases_after;
-    std::vector<int8_t> output_t(kKmerLen * kNumBases * context_samples);
-    std::byte* output_t_ptr = reinterpret_cast<std::byte*>(&output_t[0]);
+    std::byte* output_t_ptr = reinterpret_cast<std::byte*>(output);
     for (size_t seq_pos = 0; seq_pos < seq_len; ++seq_pos) {
         const auto base_st = seq_mappings[seq_pos];
         const auto base_en = seq_mappings[seq_pos + 1];
@@ -255,22 +295,45 @@ __attribute__((target("avx2"))) std::vector<int8_t> encode_kmer_len9(
             output_t_ptr += 36;
         }
     }
-
-    return output_t;
 }
 #endif
 
 }  // namespace
 
-std::vector<int8_t> RemoraEncoder::encode_kmer(const std::vector<int>& seq,
-                                               const std::vector<int>& seq_mappings) const {
+void RemoraEncoder::encode_kmer(const std::vector<int>& seq,
+                                const std::vector<int>& seq_mappings,
+                                int8_t* output) const {
     // Specialised version for the case of kmer_len 9 that can be faster.
     if (m_kmer_len == 9)
-        return encode_kmer_len9(seq, seq_mappings, m_bases_before, m_bases_after,
-                                m_context_samples);
+        return encode_kmer_len9(seq, seq_mappings, m_bases_before, m_bases_after, output);
+
+    encode_kmer_generic(seq, seq_mappings, m_bases_before, m_bases_after, m_kmer_len, output);
+}
 
-    return encode_kmer_generic(seq, seq_mappings, m_bases_before, m_bases_after, m_context_samples,
-                               m_kmer_len);
+torch::Tensor expand_kmer_encoding(const torch::Tensor& bases,
+                                   const torch::Tensor& base_ends,
+                                   int context_samples,
+                                   torch::ScalarType dtype) {
+    const auto num_contexts = bases.size(0);
+    const auto kmer_len = bases.size(1) - base_ends.size(1) + 1;
+    const auto options = torch::TensorOptions().device(bases.device());
+
+    // Each sample's base is the number of bases which end at or before it.
+    const auto samples = torch::arange(context_samples, options.dtype(torch::kInt32))
+                                 .expand({num_contexts, context_samples})
+                                 .contiguous();
+    const auto sample_bases = torch::searchsorted(base_ends.to(torch::kInt32).contiguous(),
+                                                  samples, /*out_int32=*/false, /*right=*/true);
+    // The kmer of a base starts at that base's entry of bases.
+    const auto kmer_positions =
+            (sample_bases.unsqueeze(2) + torch::arange(kmer_len, options.dtype(torch::kInt64)))
+                    .view({num_contexts, -1});
+    const auto kmer_bases = bases.to(torch::kInt64).gather(1, kmer_positions).unsqueeze(2);
+    // -1 matches no base, so gives all zeros.
+    const auto one_hot =
+            kmer_bases == torch::arange(RemoraUtils::NUM_BASES, options.dtype(torch::kInt64));
+    return one_hot.to(dtype).view(
+            {num_contexts, context_samples, kmer_len * RemoraUtils::NUM_BASES});
 }
 
 }  // namespace dorado
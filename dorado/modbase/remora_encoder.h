@@ -23,8 +23,9 @@ private:
 
     int compute_sample_pos(int base_pos) const;
 
-    std::vector<int8_t> encode_kmer(const std::vector<int>& seq,
-                                    const std::vector<int>& seq_mappings) const;
+    void encode_kmer(const std::vector<int>& seq,
+                     const std::vector<int>& seq_mappings,
+                     int8_t* output) const;
 
 public:
     /** Encoder for Remora-style modified base detection.
@@ -61,6 +62,45 @@ public:
      *  The data is arranged in Feature-Time order i.e each column corresponds to the kmer at a given sample.
      */
     Context get_context(size_t seq_pos) const;
+
+    /** As get_context(), but writes the encoded data to output rather than to the context's data, which is left empty.
+     *  @param output Where to write the encoded data, which must have room for encoded_context_size() entries.
+     */
+    Context get_context(size_t seq_pos, int8_t* output) const;
+
+    /// The number of entries in the encoded data of a context.
+    size_t encoded_context_size() const;
+
+    /** As get_context(), but writes the context in compact form, from which expand_kmer_encoding() gives the encoded data.
+     *  @param bases Where to write the bases the context's kmers are taken from, -1 where there are none, which must
+     *  have room for max_context_bases() + kmer_len - 1 entries.
+     *  @param base_ends Where to write the context sample at which each base's samples end, which must have room for
+     *  max_context_bases() entries.
+     */
+    Context get_context_bases(size_t seq_pos, int8_t* bases, int16_t* base_ends) const;
+
+    /// The most bases a context of context_samples samples can span, given that each base has at least block_stride.
+    static size_t max_context_bases(size_t block_stride, size_t context_samples);
+
+private:
+    // Finds the context centred on seq_pos, the bases its kmers are taken from (padded with -1
+    // beyond the ends of the read), and where each base's samples start within the context.
+    Context locate_context(size_t seq_pos,
+                           std::vector<int>& seq_ints,
+                           std::vector<int>& chunk_seq_to_sig) const;
 };
 
+/** Expands contexts written by RemoraEncoder::get_context_bases() into the encoded data get_context() gives, on the
+ *  device the inputs are on.
+ *  @param bases (N, max_context_bases + kmer_len - 1) int8 tensor of each context's bases.
+ *  @param base_ends (N, max_context_bases) int16 tensor of where each context's bases end.
+ *  @param context_samples The number of samples in a context.
+ *  @param dtype The dtype of the result.
+ *  @return (N, context_samples, kmer_len * 4) one-hot kmer encodings.
+ */
+torch::Tensor expand_kmer_encoding(const torch::Tensor& bases,
+                                   const torch::Tensor& base_ends,
+                                   int context_samples,
+                                   torch::ScalarType dtype);
+
 }  // namespace dorado
@@ -30,13 +30,20 @@ torch::Tensor RemoraScaler::scale_signal(const torch::Tensor& signal,
                                          const std::vector<int>& seq_ints,
                                          const std::vector<uint64_t>& seq_to_sig_map) const {
     NVTX3_FUNC_RANGE();
+    auto [offset, scale] = signal_offset_scale(signal, seq_ints, seq_to_sig_map);
+    auto scaled_signal = signal * scale + offset;
+    return scaled_signal;
+}
+
+std::pair<float, float> RemoraScaler::signal_offset_scale(
+        const torch::Tensor& signal,
+        const std::vector<int>& seq_ints,
+        const std::vector<uint64_t>& seq_to_sig_map) const {
     auto levels = extract_levels(seq_ints);
 
     // generate the signal values at the centre of each base, create the nx5% quantiles (sorted)
     // and perform a linear regression against the expected kmer levels to generate a new shift and scale
-    auto [offset, scale] = calc_offset_scale(signal, seq_to_sig_map, levels);
-    auto scaled_signal = signal * scale + offset;
-    return scaled_signal;
+    return calc_offset_scale(signal, seq_to_sig_map, levels);
 }
 
 std::vector<float> RemoraScaler::extract_levels(const std::vector<int>& int_seq) const {
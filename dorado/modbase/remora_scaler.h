@@ -56,6 +56,17 @@ public:
                                const std::vector<int>& seq_ints,
                                const std::vector<uint64_t>& seq_to_sig_map) const;
 
+    /**
+     * Calculate the rescaling that scale_signal() applies, as signal * scale + offset
+     * @param signal The signal for the basecalled sequence
+     * @param seq_ints The basecall sequence, encoded as integers with A=0, C=1, G=2, T=3
+     * @param seq_to_sig_map The indices of the samples corresponding to moves in the move table
+     * @return The offset and scale values
+    */
+    std::pair<float, float> signal_offset_scale(const torch::Tensor& signal,
+                                                const std::vector<int>& seq_ints,
+                                                const std::vector<uint64_t>& seq_to_sig_map) const;
+
     /** Scale calculator for v1 Remora-style modified base detection.
      *  @param kmer_levels A vector of expected signal levels per kmer.
      *  @param kmer_len The length of the kmers referred to in kmer_levels.
@@ -8,6 +8,7 @@
 namespace dorado {
 
 class Read;
+class RemoraEncoder;
 
 class RemoraUtils {
 public:
@@ -15,21 +16,29 @@ public:
     static const std::vector<int> BASE_IDS;
 };
 
+// The signal and kmer encoding of a chunk are written into the model's input straight from the
+// read's scaled signal and its encoder, which all of a read's chunks share.
 struct RemoraChunk {
-    RemoraChunk(std::shared_ptr<Read> read,
-                torch::Tensor input_signal,
-                std::vector<int8_t> kmer_data,
+    RemoraChunk(Read* read,
+                torch::Tensor scaled_signal,
+                std::shared_ptr<const RemoraEncoder> kmer_encoder,
                 size_t position)
             : source_read(read),
-              signal(input_signal),
-              encoded_kmers(std::move(kmer_data)),
+              signal(std::move(scaled_signal)),
+              encoder(std::move(kmer_encoder)),
               context_hit(position) {}
 
-    std::weak_ptr<Read> source_read;
+    // Not owned: the ModBaseCallerNode's working reads hold the read until its chunks are scored.
+    Read* source_read;
     torch::Tensor signal;
-    std::vector<int8_t> encoded_kmers;
+    std::shared_ptr<const RemoraEncoder> encoder;
+    // Applied to the signal as the chunk's window is gathered, if it was left unscaled on the
+    // device.
+    float signal_offset{0.f};
+    float signal_scale{1.f};
     size_t context_hit;
-    std::vector<float> scores;
+    // Which of the runner's callers the chunk is for.
+    size_t caller_id{0};
 };
 
 }  // namespace dorado
\ No newline at end of file
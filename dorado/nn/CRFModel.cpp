@@ -1,8 +1,10 @@
 #include "CRFModel.h"
 
+#include "../utils/cache_utils.h"
 #include "../utils/models.h"
 #include "../utils/module_utils.h"
 #include "../utils/tensor_utils.h"
+#include "../utils/trace.h"
 
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
 #include "../utils/cuda_utils.h"
@@ -27,6 +29,7 @@ extern "C" {
 #include <torch/torch.h>
 
 #include <limits>
+#include <optional>
 #include <string>
 
 // Different configurations for running Quantised LSTM
@@ -48,6 +51,15 @@ static bool cuda_lstm_is_quantized(int layer_size, cudaDeviceProp *prop) {
            ((layer_size == 96) || (layer_size == 128 && prop->major < 8));
 }
 
+// The Cutlass LSTM kernels, which run the layers after the first in int8, need a GPU with
+// plenty of shared memory: A100, Ada or Hopper.
+static bool cuda_lstm_use_cutlass(cudaDeviceProp *prop) {
+    const bool a100_gpu = (prop->major == 8) && (prop->minor == 0);
+    const bool ada_gpu = (prop->major == 8) && (prop->minor == 9);
+    const bool hopper_gpu = (prop->major == 9);
+    return a100_gpu || ada_gpu || hopper_gpu;
+}
+
 #endif  // if USE_CUDA_LSTM
 
 #if CUDA_PROFILE_TO_CERR
@@ -98,19 +110,74 @@ private:
     bool m_active;
 };
 #else  // if CUDA_PROFILE_TO_CERR
-using ScopedProfileRange = nvtx3::scoped_range;
+using ScopedProfileRange = dorado::utils::trace::Span;
 #endif
 
 namespace {
+// Loads weights which were converted to dtype by a previous run.  Returns false if there
+// are none, or they don't fit the model.
+template <class Model>
+bool load_cached_weights(Model &model, const std::filesystem::path &cache_path) {
+    if (!std::filesystem::exists(cache_path)) {
+        return false;
+    }
+    try {
+        std::vector<torch::Tensor> weights;
+        torch::load(weights, cache_path.string());
+        if (weights.size() != model->parameters().size()) {
+            return false;
+        }
+        for (size_t idx = 0; idx < weights.size(); ++idx) {
+            if (weights[idx].sizes() != model->parameters()[idx].sizes()) {
+                return false;
+            }
+        }
+        dorado::utils::load_state_dict(*model, weights);
+        return true;
+    } catch (const std::exception &e) {
+        spdlog::debug("Ignoring unreadable weights cache {}: {}", cache_path.string(), e.what());
+        return false;
+    }
+}
+
 template <class Model>
 ModuleHolder<AnyModule> populate_model(Model &&model,
                                        const std::filesystem::path &path,
                                        const torch::TensorOptions &options,
                                        bool decomposition,
-                                       bool linear_layer_bias) {
-    auto state_dict = dorado::load_crf_model_weights(path, decomposition, linear_layer_bias);
-    model->load_state_dict(state_dict);
-    model->to(options.dtype_opt().value().toScalarType());
+                                       bool linear_layer_bias,
+                                       const std::string &model_kind) {
+    const auto dtype = options.dtype_opt().value().toScalarType();
+
+    // Weights are cached after conversion to the model's dtype, in a single file, keyed by the
+    // model's files, so that repeat runs skip reading and converting each weight tensor.
+    const auto cache_max_bytes = dorado::utils::get_weights_cache_max_bytes();
+    std::optional<std::filesystem::path> cache_path;
+    auto cache_dir = dorado::utils::get_cache_dir();
+    if (cache_dir && cache_max_bytes > 0) {
+        cache_path = *cache_dir / dorado::utils::kWeightsCacheDir /
+                     dorado::utils::cache_file_name({dorado::utils::directory_fingerprint(path),
+                                                     model_kind, c10::toString(dtype),
+                                                     std::to_string(decomposition),
+                                                     std::to_string(linear_layer_bias)},
+                                                    ".pt");
+    }
+
+    if (cache_path && load_cached_weights(model, *cache_path)) {
+        spdlog::debug("- loaded cached weights for {}", path.string());
+        dorado::utils::touch_cache_file(*cache_path);
+    } else {
+        auto state_dict = dorado::load_crf_model_weights(path, decomposition, linear_layer_bias);
+        model->load_state_dict(state_dict);
+        model->to(dtype);
+        if (cache_path) {
+            if (dorado::utils::write_cache_file(*cache_path, [&model](const auto &temp_path) {
+                    torch::save(model->parameters(), temp_path.string());
+                })) {
+                dorado::utils::trim_cache_dir(cache_path->parent_path(), cache_max_bytes);
+            }
+        }
+    }
     model->to(options.device_opt().value());
     model->eval();
 
@@ -150,7 +217,7 @@ struct ConvolutionImpl : Module {
     torch::Tensor forward(torch::Tensor x) {
         // Input x is [N, C_in, T_in], contiguity optional
 #if USE_CUDA_LSTM
-        if (to_lstm && x.device() != torch::kCPU) {
+        if (x.device() != torch::kCPU) {
             c10::cuda::CUDAGuard device_guard(x.device());
             auto stream = at::cuda::getCurrentCUDAStream().stream();
 
@@ -163,12 +230,9 @@ struct ConvolutionImpl : Module {
                                     .contiguous();
             auto b_device = conv->bias.to(x.options());
 
-            cudaDeviceProp *prop = at::cuda::getCurrentDeviceProperties();
-            const bool output_NTC = cuda_lstm_is_quantized(out_size, prop);
-            const bool output_int8 = !g_options_no_conv_i8 && !g_options_no_i8 && !output_NTC &&
-                                     clamp && prop->major >= 8;
-
-            if (output_NTC) {
+            // Windows the input, multiplies by the weights, and applies the bias, swish and
+            // clamp in place in a single pass, giving [N, T_out, C_out], contiguous.
+            const auto window_matmul_bias_swish = [&] {
                 auto res = torch::empty({batch_size, chunk_size_out, out_size}, x.options());
                 auto res_2D = res.view({-1, out_size});
                 auto ntcw_mat = torch::empty({batch_size, chunk_size_out, in_size, window_size},
@@ -181,8 +245,24 @@ struct ConvolutionImpl : Module {
                                           res_2D);
                 host_bias_swish_f16_clamp(stream, res_2D.size(0), res_2D.size(1), res_2D.stride(0),
                                           res_2D.data_ptr(), b_device.data_ptr(), max_value);
-                // Output is [N, T_out, C_out], contiguous
                 return res;
+            };
+
+            if (!to_lstm) {
+                // The next convolution windows its input through the strides, so it reads the
+                // [N, T, C] layout as it is, and no permute is needed within the stem.
+                // Output is [N, C_out, T_out], non-contiguous
+                return window_matmul_bias_swish().transpose(1, 2);
+            }
+
+            cudaDeviceProp *prop = at::cuda::getCurrentDeviceProperties();
+            const bool output_NTC = cuda_lstm_is_quantized(out_size, prop);
+            const bool output_int8 = !g_options_no_conv_i8 && !g_options_no_i8 && !output_NTC &&
+                                     clamp && prop->major >= 8;
+
+            if (output_NTC) {
+                // Output is [N, T_out, C_out], contiguous
+                return window_matmul_bias_swish();
             } else {
                 torch::Tensor res, mm_out;
                 if (output_int8) {
@@ -375,11 +455,7 @@ private:
 #ifdef DORADO_TX2
         constexpr bool use_int8 = false;
 #else
-        cudaDeviceProp *prop = at::cuda::getCurrentDeviceProperties();
-        // Limit Cutlass usage to A100 and H100 GPUs
-        const bool a100_gpu = (prop->major == 8) && (prop->minor == 0);
-        const bool h100_gpu = (prop->major == 9) && (prop->minor == 0);
-        const bool use_cutlass = a100_gpu || h100_gpu;
+        const bool use_cutlass = cuda_lstm_use_cutlass(at::cuda::getCurrentDeviceProperties());
         const bool use_int8 = !g_options_no_i8 && use_cutlass;
 #endif
 
@@ -574,13 +650,30 @@ private:
                                 1)
                                 .max(1)) *
                 2;
-        auto quantization_scale = levels / fp_range;
         auto quantization_max = (levels / 2) - 1;
+        const auto quantize = [&](const torch::Tensor &scale) {
+            return (tensor * scale).round().clip(-quantization_max, quantization_max);
+        };
+
+        // Calibrate each channel's scale: clipping its few largest weights trades their error
+        // for finer steps across the rest, so keep whichever clipping range reconstructs the
+        // channel best. Clipping nothing is among the candidates, so this is never worse than
+        // scaling by the full range.
+        auto quantization_scale = levels / fp_range;
+        auto quantization_error =
+                (quantize(quantization_scale) / quantization_scale - tensor).square().sum(0);
+        const auto full_range_error = quantization_error.sum().item<float>();
+        for (const float clip_ratio : {0.95f, 0.9f, 0.85f, 0.8f, 0.75f, 0.7f}) {
+            auto scale = levels / (fp_range * clip_ratio);
+            auto error = (quantize(scale) / scale - tensor).square().sum(0);
+            auto better = error < quantization_error;
+            quantization_scale = torch::where(better, scale, quantization_scale);
+            quantization_error = torch::where(better, error, quantization_error);
+        }
+        spdlog::trace("LSTM int8 weight calibration: squared error {} -> {}", full_range_error,
+                      quantization_error.sum().item<float>());
 
-        auto tensor_quantized = (tensor * quantization_scale)
-                                        .round()
-                                        .clip(-quantization_max, quantization_max)
-                                        .to(torch::kI8);
+        auto tensor_quantized = quantize(quantization_scale).to(torch::kI8);
 
         return std::pair<torch::Tensor, torch::Tensor>(quantization_scale.to(torch::kFloat32),
                                                        tensor_quantized);
@@ -913,20 +1006,25 @@ std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path &d
 
 ModuleHolder<AnyModule> load_crf_model(const CRFModelConfig &model_config,
                                        const torch::TensorOptions &options) {
+    const auto key = utils::shared_module_key("crf", model_config.model_path, options);
+    return utils::load_shared_module(key, [&]() -> ModuleHolder<AnyModule> {
 #if USE_CUDA_LSTM
-    if (options.device().is_cuda()) {
-        const bool expand_blanks = false;
-        auto model = nn::CudaCRFModel(model_config, expand_blanks);
-        return populate_model(model, model_config.model_path, options,
-                              model_config.out_features.has_value(), model_config.bias);
-    } else
+        if (options.device().is_cuda()) {
+            const bool expand_blanks = false;
+            auto model = nn::CudaCRFModel(model_config, expand_blanks);
+            return populate_model(model, model_config.model_path, options,
+                                  model_config.out_features.has_value(), model_config.bias,
+                                  "cuda_lstm");
+        } else
 #endif
-    {
-        const bool expand_blanks = true;
-        auto model = nn::CpuCRFModel(model_config, expand_blanks);
-        return populate_model(model, model_config.model_path, options,
-                              model_config.out_features.has_value(), model_config.bias);
-    }
+        {
+            const bool expand_blanks = true;
+            auto model = nn::CpuCRFModel(model_config, expand_blanks);
+            return populate_model(model, model_config.model_path, options,
+                                  model_config.out_features.has_value(), model_config.bias,
+                                  "cpu_lstm");
+        }
+    });
 }
 
 uint16_t get_model_sample_rate(const std::filesystem::path &model_path) {
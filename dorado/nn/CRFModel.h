@@ -48,6 +48,7 @@ std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path& d
                                                   bool decomposition,
                                                   bool bias);
 
+// Runners loading the same model onto the same device share one module, and its weights.
 torch::nn::ModuleHolder<torch::nn::AnyModule> load_crf_model(const CRFModelConfig& model_config,
                                                              const torch::TensorOptions& options);
 
@@ -3,17 +3,39 @@
 #include "decode/GPUDecoder.h"
 #include "utils/cuda_utils.h"
 #include "utils/math_utils.h"
+#include "utils/numa_utils.h"
+#include "utils/trace.h"
 
+#include <ATen/cuda/CUDAEvent.h>
+#include <ATen/cuda/CUDAGraph.h>
 #include <c10/cuda/CUDAGuard.h>
 #include <c10/cuda/CUDAStream.h>
-#include <nvtx3/nvtx3.hpp>
+#include <cuda_runtime.h>
+#include <spdlog/spdlog.h>
 #include <toml.hpp>
 #include <torch/torch.h>
+#include <torch/version.h>
+
+#include <algorithm>
+#include <mutex>
 
 using namespace std::chrono_literals;
 
 namespace dorado {
 
+namespace {
+
+// With a workspace arena, batches are run at the full batch size, or at most this many
+// successive halvings of it, each captured as a CUDA graph.
+constexpr int kNumArenaBatchHalvings = 3;
+
+// CUDA graphs are captured one at a time across the process.  Where libtorch can't capture in
+// thread-local mode, a capture is in global mode, which concurrent captures on other threads
+// would invalidate.
+std::mutex g_graph_capture_mutex;
+
+}  // namespace
+
 class CudaCaller {
 public:
     CudaCaller(const CRFModelConfig &model_config,
@@ -21,34 +43,61 @@ public:
                int batch_size,
                const std::string &device,
                float memory_limit_fraction,
-               bool exclusive_gpu_access)
-            : m_device(device), m_exclusive_gpu_access(exclusive_gpu_access) {
+               bool exclusive_gpu_access,
+               int num_streams,
+               bool use_cuda_graphs,
+               int overlap,
+               bool use_workspace_arena)
+            : m_device(device),
+              m_exclusive_gpu_access(exclusive_gpu_access),
+              m_use_cuda_graphs(use_cuda_graphs || use_workspace_arena),
+              m_use_workspace_arena(use_workspace_arena) {
         m_model_stride = static_cast<size_t>(model_config.stride);
 
         m_decoder_options = DecoderOptions();
         m_decoder_options.q_shift = model_config.qbias;
         m_decoder_options.q_scale = model_config.qscale;
-        m_decoder = std::make_unique<GPUDecoder>();
         m_num_input_features = model_config.num_features;
         m_exclusive_gpu_access = exclusive_gpu_access;
-        // adjust chunk size to be a multiple of the stride
-        m_out_chunk_size = chunk_size / m_model_stride;
-        m_in_chunk_size = m_out_chunk_size * m_model_stride;
 
+        m_reserve_memory = utils::gpu_memory_limit() != 0 || use_workspace_arena;
         m_options = torch::TensorOptions().dtype(GPUDecoder::dtype).device(device);
         assert(m_options.device().is_cuda());
+        m_numa_node = utils::cuda_device_numa_node(m_options.device().index());
+        spdlog::debug("- {} is local to NUMA node {}", m_device, m_numa_node);
 
         torch::InferenceMode guard;
+        utils::apply_gpu_memory_limit(m_options.device());
         m_module = load_crf_model(model_config, m_options);
 
         // Batch size will be rounded up to a multiple of batch_size_granularity, regardless of
         // user choice. This makes sure batch size is compatible with GPU kernels.
-        int batch_size_granularity = get_batch_size_granularity(model_config, m_options);
+        const int batch_size_granularity = get_batch_size_granularity(model_config, m_options);
+        m_batch_size_granularity = batch_size_granularity;
         m_batch_size = utils::pad_to(batch_size, batch_size_granularity);
-        if (batch_size == 0) {
-            m_batch_size =
-                    utils::auto_gpu_batch_size(m_module, model_config, m_options,
-                                               batch_size_granularity, memory_limit_fraction);
+        num_streams = std::max(num_streams, 1);
+        // Each in-flight batch needs its own working memory.  With CUDA graphs a stream holds
+        // it twice: in the graphs' private memory pool, and in the allocator's cache from the
+        // passes run outside a graph, so the graph pool's share comes out of the budget too.
+        const float batch_memory_fraction =
+                memory_limit_fraction / num_streams / (m_use_cuda_graphs ? 2 : 1);
+        if (chunk_size == 0) {
+            // Chunk size and batch size (unless one was given) are picked together, since the
+            // batch size that fits and runs best depends on the chunk size.
+            const auto choice = utils::auto_gpu_chunk_size(
+                    m_module, model_config, m_options, batch_size_granularity,
+                    batch_memory_fraction, overlap, m_batch_size);
+            chunk_size = choice.chunk_size;
+            m_batch_size = choice.batch_size;
+        }
+        // adjust chunk size to be a multiple of the stride
+        m_out_chunk_size = chunk_size / m_model_stride;
+        m_in_chunk_size = m_out_chunk_size * m_model_stride;
+
+        if (m_batch_size == 0) {
+            m_batch_size = utils::auto_gpu_batch_size(m_module, model_config, m_options,
+                                                      batch_size_granularity,
+                                                      batch_memory_fraction);
         } else {
             // Warmup
             auto input =
@@ -57,13 +106,44 @@ public:
             torch::cuda::synchronize(m_options.device().index());
         }
 
-        m_cuda_thread.reset(new std::thread(&CudaCaller::cuda_thread_fn, this));
+        // The batch sizes the forward pass is captured at, largest first.
+        m_graph_batch_sizes.push_back(m_batch_size);
+        for (int i = 0; m_use_workspace_arena && i < kNumArenaBatchHalvings; ++i) {
+            const int half = utils::pad_to(m_graph_batch_sizes.back() / 2, batch_size_granularity);
+            if (half == 0 || half == m_graph_batch_sizes.back()) {
+                break;
+            }
+            m_graph_batch_sizes.push_back(half);
+        }
+
+        // Each thread runs one batch at a time on its own stream, so with several threads
+        // one batch's decode and copies overlap another's forward pass.
+        const size_t memory_before = utils::available_memory(m_options.device());
+        for (int i = 0; i < num_streams; ++i) {
+            m_cuda_threads.emplace_back(&CudaCaller::cuda_thread_fn, this);
+        }
+
+        // With a memory limit, wait for each thread to have reserved its working memory, so
+        // the caller's footprint is fixed before any other model or process is set up.  With
+        // CUDA graphs, wait for their captures, so the runners' allocations don't overlap them.
+        if (m_reserve_memory || m_use_cuda_graphs) {
+            std::unique_lock lock(m_reserved_mutex);
+            m_reserved_cv.wait(lock, [this, num_streams] { return m_num_reserved == num_streams; });
+        }
+        if (m_use_workspace_arena) {
+            const size_t memory_after = utils::available_memory(m_options.device());
+            spdlog::debug("- workspace arenas of {} MB in total for {} streams on {}",
+                          (memory_before - std::min(memory_before, memory_after)) >> 20,
+                          num_streams, m_device);
+        }
     }
 
     ~CudaCaller() {
         m_terminate.store(true);
-        m_input_cv.notify_one();
-        m_cuda_thread->join();
+        m_input_cv.notify_all();
+        for (auto &thread : m_cuda_threads) {
+            thread.join();
+        }
     }
 
     static int get_batch_size_granularity(const CRFModelConfig &model_config,
@@ -73,48 +153,206 @@ public:
     }
 
     struct NNTask {
-        NNTask(torch::Tensor input_, int num_chunks_) : input(input_), num_chunks(num_chunks_) {}
+        NNTask(torch::Tensor input_,
+               torch::Tensor output_,
+               torch::Tensor base_offsets_,
+               torch::Tensor decode_steps_,
+               int num_chunks_)
+                : input(input_),
+                  decode_steps(decode_steps_),
+                  output(output_),
+                  base_offsets(base_offsets_),
+                  num_chunks(num_chunks_) {}
         torch::Tensor input;
+        // Pinned host steps of each chunk to decode, or undefined to decode all of them.
+        torch::Tensor decode_steps;
+        // Recorded on the runner's stream once the input has been uploaded.
+        at::cuda::CUDAEvent input_ready;
+        // Recorded on the caller's stream before the forward pass, before the decode, and
+        // once the results are copied back, which also times the batch on the device.
+        at::cuda::CUDAEvent started{cudaEventDefault};
+        at::cuda::CUDAEvent forward_done{cudaEventDefault};
+        at::cuda::CUDAEvent output_ready{cudaEventDefault};
         std::mutex mut;
         std::condition_variable cv;
-        torch::Tensor out;
+        // Host buffers the results are copied back into, as the decoder reuses its device
+        // buffers for the next batch.  They are ready once output_ready has completed.
+        torch::Tensor output;
+        torch::Tensor base_offsets;
+        // Set once the batch's work has been queued on the caller's stream.
         bool done{false};
         int num_chunks;
     };
 
+    // input is a pinned host buffer, which is uploaded asynchronously into input_device on
+    // the runner's stream, so one runner's upload overlaps another's forward pass.
+    // decode_steps, if defined, is passed to the decoder as its chunk_steps.
     std::vector<DecodedChunk> call_chunks(torch::Tensor &input,
+                                          torch::Tensor &input_device,
                                           torch::Tensor &output,
+                                          torch::Tensor &base_offsets,
+                                          const torch::Tensor &decode_steps,
                                           int num_chunks,
                                           c10::cuda::CUDAStream stream) {
-        NVTX3_FUNC_RANGE();
+        DORADO_TRACE_FUNCTION();
         c10::cuda::CUDAStreamGuard stream_guard(stream);
 
         if (num_chunks == 0) {
             return std::vector<DecodedChunk>();
         }
-        NNTask task(input.to(m_options.device()), num_chunks);
+        // A partial batch is uploaded and run at the smallest multiple of the granularity
+        // which holds its chunks, rather than at the full batch size.  Within a workspace
+        // arena, it is run at the smallest captured batch size which holds it.
+        int run_size = std::min(m_batch_size, utils::pad_to(num_chunks, m_batch_size_granularity));
+        if (m_use_workspace_arena) {
+            run_size = *std::find_if(m_graph_batch_sizes.rbegin(), m_graph_batch_sizes.rend(),
+                                     [run_size](int size) { return size >= run_size; });
+        }
+        if (run_size < m_batch_size) {
+            ++m_num_right_sized_batches;
+        }
+        auto run_input = input_device.narrow(0, 0, run_size);
+        run_input.copy_(input.narrow(0, 0, run_size), /*non_blocking=*/true);
+        // Only bring back the chunks that were filled in, which matters for partial batches.
+        NNTask task(run_input, output.narrow(1, 0, num_chunks),
+                    base_offsets.narrow(0, 0, num_chunks), decode_steps, num_chunks);
+        task.input_ready.record(stream);
         {
             std::lock_guard<std::mutex> lock(m_input_lock);
             m_input_queue.push_front(&task);
         }
         m_input_cv.notify_one();
 
-        std::unique_lock lock(task.mut);
-        while (!task.done) {
-            task.cv.wait(lock);
+        {
+            std::unique_lock lock(task.mut);
+            while (!task.done) {
+                task.cv.wait(lock);
+            }
         }
+        // The caller thread has moved on to queueing later batches behind this one.
+        task.output_ready.synchronize();
+        const auto forward_ms = task.started.elapsed_time(task.forward_done);
+        const auto decode_ms = task.forward_done.elapsed_time(task.output_ready);
+        m_model_us += int64_t(1000 * forward_ms);
+        m_decode_us += int64_t(1000 * decode_ms);
+
+        return GPUDecoder::cpu_part(task.output, task.base_offsets);
+    }
+
+    // The forward pass for a batch size, captured as a CUDA graph so it can be replayed
+    // without relaunching each kernel.  The graph reads from input and writes to output,
+    // whose memory is owned by the graph for its lifetime.
+    struct CapturedForward {
+        at::cuda::CUDAGraph graph;
+        torch::Tensor input;
+        torch::Tensor output;
+    };
 
-        output.copy_(task.out);
-        return m_decoder->cpu_part(output);
+    // Captures the forward pass at batch_size on the current stream, which must not be the
+    // default stream, allocating its memory from pool, or a pool of its own by default.
+    // Returns nullptr if the model can't be captured, in which case the caller should run
+    // the forward pass directly.
+    std::unique_ptr<CapturedForward> capture_forward(c10::cuda::CUDAStream stream,
+                                                     int batch_size,
+                                                     c10::cuda::MempoolId_t pool = {0, 0}) {
+        auto captured = std::make_unique<CapturedForward>();
+        captured->input =
+                torch::zeros({batch_size, m_num_input_features, m_in_chunk_size}, m_options);
+        std::lock_guard capture_lock(g_graph_capture_mutex);
+        try {
+            // Run once outside the capture so lazily initialised state, such as cuBLAS
+            // workspaces, already exists.
+            m_module->forward(captured->input);
+            stream.synchronize();
+#if TORCH_VERSION_MAJOR > 2 || (TORCH_VERSION_MAJOR == 2 && TORCH_VERSION_MINOR >= 1)
+            // Other threads' CUDA calls, such as the runners' allocations, are allowed while
+            // this thread captures.
+            captured->graph.capture_begin(pool, cudaStreamCaptureModeThreadLocal);
+#else
+            captured->graph.capture_begin(pool);
+#endif
+            captured->output = m_module->forward(captured->input);
+            captured->graph.capture_end();
+            stream.synchronize();
+        } catch (const std::exception &e) {
+            // Make sure the stream isn't left capturing.
+            cudaStreamCaptureStatus status;
+            if (cudaStreamIsCapturing(stream.stream(), &status) == cudaSuccess &&
+                status != cudaStreamCaptureStatusNone) {
+                cudaGraph_t graph = nullptr;
+                cudaStreamEndCapture(stream.stream(), &graph);
+                if (graph) {
+                    cudaGraphDestroy(graph);
+                }
+            }
+            spdlog::warn("CUDA graph capture failed on {}, running eagerly: {}", m_device,
+                         e.what());
+            return nullptr;
+        }
+        spdlog::debug("- captured CUDA graph on {} for batch size {}", m_device, batch_size);
+        return captured;
     }
 
     void cuda_thread_fn() {
+        // Keep the host side of the GPU's work on the socket it is attached to.
+        utils::bind_thread_to_numa_node(m_numa_node);
         torch::InferenceMode guard;
         c10::cuda::CUDAGuard device_guard(m_options.device());
-        auto stream = c10::cuda::getCurrentCUDAStream(m_options.device().index());
+        // Run on a stream of our own, so the forward pass does not wait on the runners'
+        // uploads beyond the one it needs.
+        auto stream = c10::cuda::getStreamFromPool(false, m_options.device().index());
+        c10::cuda::CUDAStreamGuard stream_guard(stream);
+        // Each thread decodes into buffers of its own.
+        GPUDecoder decoder;
+
+        // Full batches have the same batch and chunk size, so a single capture per thread
+        // covers them.  Smaller batches are run eagerly, unless there is a workspace arena.
+        // The arena is a memory pool of the thread's own, which all its captures allocate
+        // from, largest first, so that it is sized by the full batch and the smaller batch
+        // sizes reuse its memory.  Their replays are ordered by the thread's stream.
+        std::vector<std::unique_ptr<CapturedForward>> captured_forwards;
+        if (m_use_cuda_graphs) {
+            const auto pool = m_use_workspace_arena ? at::cuda::graph_pool_handle()
+                                                    : c10::cuda::MempoolId_t{0, 0};
+            for (const int batch_size : m_graph_batch_sizes) {
+                auto captured = capture_forward(stream, batch_size, pool);
+                if (!captured) {
+                    break;
+                }
+                captured_forwards.push_back(std::move(captured));
+            }
+        }
+        auto find_captured_forward = [&captured_forwards](int64_t batch_size) {
+            auto it = std::find_if(captured_forwards.begin(), captured_forwards.end(),
+                                   [batch_size](const auto &captured) {
+                                       return captured->input.size(0) == batch_size;
+                                   });
+            return it == captured_forwards.end() ? nullptr : it->get();
+        };
+        if (m_reserve_memory) {
+            // A full batch through the forward pass and decoder leaves its working memory cached
+            // by the allocator for this stream, so later batches don't allocate more of it.
+            // The decoder's buffers only grow, so are sized for every later batch.
+            if (auto *captured_forward = find_captured_forward(m_batch_size)) {
+                captured_forward->graph.replay();
+                decoder.gpu_part(captured_forward->output, m_batch_size, m_decoder_options);
+            } else {
+                auto input = torch::zeros({m_batch_size, m_num_input_features, m_in_chunk_size},
+                                          m_options);
+                auto scores = m_module->forward(input);
+                decoder.gpu_part(scores, m_batch_size, m_decoder_options);
+            }
+            stream.synchronize();
+            spdlog::debug("- reserved working memory for batch size {} on {}", m_batch_size,
+                          m_device);
+        }
+        if (m_reserve_memory || m_use_cuda_graphs) {
+            std::lock_guard lock(m_reserved_mutex);
+            ++m_num_reserved;
+            m_reserved_cv.notify_one();
+        }
 
         while (true) {
-            nvtx3::scoped_range loop{"cuda_thread_fn"};
             std::unique_lock<std::mutex> input_lock(m_input_lock);
             while (m_input_queue.empty() && !m_terminate.load()) {
                 m_input_cv.wait_for(input_lock, 100ms);
@@ -127,20 +365,45 @@ public:
             NNTask *task = m_input_queue.back();
             m_input_queue.pop_back();
             input_lock.unlock();
+            // Opened once there is a batch, so waiting for one isn't counted.
+            DORADO_TRACE_SCOPE("cuda_thread_fn");
 
+            // With exclusive access this also serialises this caller's own streams.
             auto gpu_lock = dorado::utils::acquire_gpu_lock(m_options.device().index(),
                                                             m_exclusive_gpu_access);
             std::unique_lock<std::mutex> task_lock(task->mut);
-            stats::Timer timer;
-            auto scores = m_module->forward(task->input);
-            torch::cuda::synchronize();
-            const auto forward_ms = timer.GetElapsedMS();
-            task->out = m_decoder->gpu_part(scores, task->num_chunks, m_decoder_options);
-            stream.synchronize();
-            const auto forward_plus_decode_ms = timer.GetElapsedMS();
+            // Nothing here waits for the device, so that launching each batch's kernels
+            // overlaps the device's work on the batches queued before it.  The stream orders
+            // the reuse of the forward pass's and decoder's buffers.
+            task->input_ready.block(stream);
+            task->started.record(stream);
+            torch::Tensor scores;
+            {
+                DORADO_TRACE_SCOPE("model_forward");
+                if (auto *captured_forward = find_captured_forward(task->input.size(0))) {
+                    captured_forward->input.copy_(task->input, /*non_blocking=*/true);
+                    captured_forward->graph.replay();
+                    scores = captured_forward->output;
+                } else {
+                    scores = m_module->forward(task->input);
+                }
+            }
+            task->forward_done.record(stream);
+            {
+                DORADO_TRACE_SCOPE("decode");
+                auto [moves_sequence_qstring, base_offsets] = decoder.gpu_part(
+                        scores, task->num_chunks, m_decoder_options, task->decode_steps);
+                task->output.copy_(moves_sequence_qstring.narrow(1, 0, task->num_chunks),
+                                   /*non_blocking=*/true);
+                task->base_offsets.copy_(base_offsets.narrow(0, 0, task->num_chunks),
+                                         /*non_blocking=*/true);
+            }
+            task->output_ready.record(stream);
+            if (m_exclusive_gpu_access) {
+                // Other callers may only use the device once this batch is off it.
+                task->output_ready.synchronize();
+            }
             ++m_num_batches_called;
-            m_model_ms += forward_ms;
-            m_decode_ms += forward_plus_decode_ms - forward_ms;
             task->done = true;
             task->cv.notify_one();
             task_lock.unlock();
@@ -153,14 +416,16 @@ public:
     stats::NamedStats sample_stats() const {
         stats::NamedStats stats;
         stats["batches_called"] = m_num_batches_called;
-        stats["model_ms"] = m_model_ms;
-        stats["decode_ms"] = m_decode_ms;
+        stats["model_ms"] = m_model_us / 1000;
+        stats["decode_ms"] = m_decode_us / 1000;
+        stats["right_sized_batches"] = m_num_right_sized_batches;
         return stats;
     }
 
     std::string m_device;
     torch::TensorOptions m_options;
-    std::unique_ptr<GPUDecoder> m_decoder;
+    // NUMA node local to the device, or -1 if unknown.
+    int m_numa_node{-1};
     DecoderOptions m_decoder_options;
     torch::nn::ModuleHolder<torch::nn::AnyModule> m_module{nullptr};
     size_t m_model_stride;
@@ -168,14 +433,30 @@ public:
     std::deque<NNTask *> m_input_queue;
     std::mutex m_input_lock;
     std::condition_variable m_input_cv;
-    std::unique_ptr<std::thread> m_cuda_thread;
+    std::vector<std::thread> m_cuda_threads;
     int m_num_input_features, m_batch_size, m_in_chunk_size, m_out_chunk_size;
+    int m_batch_size_granularity{1};
     bool m_exclusive_gpu_access{false};
+    bool m_use_cuda_graphs{false};
+    // Whether each thread's forward passes run in a fixed memory pool, sized at warmup.
+    bool m_use_workspace_arena{false};
+    // Batch sizes each thread captures the forward pass at, largest first.
+    std::vector<int> m_graph_batch_sizes;
+    // Whether each thread reserves its working memory before the caller is constructed, as it
+    // does with a gpu_memory_limit.  m_num_reserved counts the threads which have done so, and
+    // captured their CUDA graphs.
+    bool m_reserve_memory{false};
+    std::mutex m_reserved_mutex;
+    std::condition_variable m_reserved_cv;
+    int m_num_reserved{0};
 
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
-    std::atomic<int64_t> m_model_ms = 0;
-    std::atomic<int64_t> m_decode_ms = 0;
+    // Partial batches run at less than the full batch size.
+    std::atomic<int64_t> m_num_right_sized_batches = 0;
+    // Device time of the batches, in microseconds so that short batches aren't rounded away.
+    std::atomic<int64_t> m_model_us = 0;
+    std::atomic<int64_t> m_decode_us = 0;
 };
 
 std::shared_ptr<CudaCaller> create_cuda_caller(const CRFModelConfig &model_config,
@@ -183,37 +464,63 @@ std::shared_ptr<CudaCaller> create_cuda_caller(const CRFModelConfig &model_confi
                                                int batch_size,
                                                const std::string &device,
                                                float memory_limit_fraction,
-                                               bool exclusive_gpu_access) {
+                                               bool exclusive_gpu_access,
+                                               int num_streams,
+                                               bool use_cuda_graphs,
+                                               int overlap,
+                                               bool use_workspace_arena) {
     return std::make_shared<CudaCaller>(model_config, chunk_size, batch_size, device,
-                                        memory_limit_fraction, exclusive_gpu_access);
+                                        memory_limit_fraction, exclusive_gpu_access, num_streams,
+                                        use_cuda_graphs, overlap, use_workspace_arena);
 }
 
 CudaModelRunner::CudaModelRunner(std::shared_ptr<CudaCaller> caller)
         : m_caller(caller),
           m_stream(c10::cuda::getStreamFromPool(false, m_caller->m_options.device().index())) {
+    // Pinned pages are touched when they are allocated, so allocating them while bound to the
+    // device's NUMA node places them there.
+    utils::ScopedNumaBinding numa_binding(m_caller->m_numa_node);
     auto opts = torch::TensorOptions().device(torch::kCPU).pinned_memory(true);
     m_input = torch::empty(
             {caller->m_batch_size, caller->m_num_input_features, caller->m_in_chunk_size},
             opts.dtype(m_caller->m_options.dtype()));
+    m_input_device = torch::empty(m_input.sizes(), m_caller->m_options);
 
     m_output = torch::empty({3, caller->m_batch_size, caller->m_out_chunk_size},
                             opts.dtype(torch::kInt8));
+    m_base_offsets = torch::empty({caller->m_batch_size}, opts.dtype(torch::kInt32));
+    m_decode_steps = torch::full({caller->m_batch_size}, caller->m_out_chunk_size,
+                                 opts.dtype(torch::kInt32));
 }
 
-void CudaModelRunner::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
-    m_input.index_put_({chunk_idx, torch::indexing::Ellipsis}, chunk);
+void CudaModelRunner::accept_chunks(int first_chunk_idx,
+                                    const std::vector<utils::ChunkSource> &chunks) {
+    // Fill the pinned staging buffer directly, ready for the asynchronous upload.
+    utils::gather_chunks(m_input, first_chunk_idx, chunks);
+    const int32_t num_steps = m_caller->m_out_chunk_size;
+    auto *const decode_steps = m_decode_steps.data_ptr<int32_t>();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const auto steps = chunks[i].num_decode_steps;
+        auto &chunk_steps = decode_steps[first_chunk_idx + i];
+        chunk_steps = steps == 0 ? num_steps : int32_t(std::min<size_t>(steps, num_steps));
+        m_partial_decode = m_partial_decode || chunk_steps != num_steps;
+    }
 }
 
 std::vector<DecodedChunk> CudaModelRunner::call_chunks(int num_chunks) {
     ++m_num_batches_called;
     stats::Timer timer;
-    auto decoded_chunks = m_caller->call_chunks(m_input, m_output, num_chunks, m_stream);
+    auto decoded_chunks = m_caller->call_chunks(
+            m_input, m_input_device, m_output, m_base_offsets,
+            m_partial_decode ? m_decode_steps : torch::Tensor(), num_chunks, m_stream);
+    m_partial_decode = false;
     return decoded_chunks;
 }
 
 size_t CudaModelRunner::model_stride() const { return m_caller->m_model_stride; }
 size_t CudaModelRunner::chunk_size() const { return m_input.size(2); }
 size_t CudaModelRunner::batch_size() const { return m_input.size(0); }
+int CudaModelRunner::numa_node() const { return m_caller->m_numa_node; }
 void CudaModelRunner::terminate() { m_caller->terminate(); }
 
 std::string CudaModelRunner::get_name() const {
@@ -14,21 +14,37 @@ namespace dorado {
 
 class CudaCaller;
 
+// num_streams is the number of batches the caller runs on the GPU concurrently, each on its
+// own CUDA stream.  Auto-selected batch sizes are scaled down to share memory between them.
+// If use_cuda_graphs is set, the model's forward pass is captured as a CUDA graph at startup
+// and replayed for each batch, falling back to running it directly if capture fails.
+// A chunk_size of 0 has one picked by timing the model, to suit chunks overlapping by overlap.
+// If use_workspace_arena is set, each stream's forward passes are captured as CUDA graphs, at
+// the batch size and a few halvings of it, into one memory pool of the stream's own, which is
+// sized at startup.  Every batch runs within it, at the smallest captured size which holds it,
+// and is decoded into buffers sized for a full batch at startup, so the caller's memory use
+// doesn't change as it runs, and can't be fragmented by other callers on the device.
+
 std::shared_ptr<CudaCaller> create_cuda_caller(const CRFModelConfig& model_config,
                                                int chunk_size,
                                                int batch_size,
                                                const std::string& device,
                                                float memory_limit_fraction = 1.f,
-                                               bool exclusive_gpu_access = false);
+                                               bool exclusive_gpu_access = false,
+                                               int num_streams = 1,
+                                               bool use_cuda_graphs = false,
+                                               int overlap = 0,
+                                               bool use_workspace_arena = false);
 
 class CudaModelRunner : public ModelRunnerBase {
 public:
     explicit CudaModelRunner(std::shared_ptr<CudaCaller> caller);
-    void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource>& chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final;
     size_t chunk_size() const final;
     size_t batch_size() const final;
+    int numa_node() const final;
     void terminate() final;
     std::string get_name() const final;
     stats::NamedStats sample_stats() const final;
@@ -36,8 +52,17 @@ public:
 private:
     std::shared_ptr<CudaCaller> m_caller;
     c10::cuda::CUDAStream m_stream;
+    // Pinned host staging buffer for the next batch, and its device copy.  Each runner has
+    // its own pair, so with several runners per caller one batch uploads while another runs.
     torch::Tensor m_input;
+    torch::Tensor m_input_device;
+    // Pinned host buffers the decoded batch is copied back into.
     torch::Tensor m_output;
+    torch::Tensor m_base_offsets;
+    // Pinned host steps of each chunk in the batch worth decoding, and whether any of the
+    // batch's chunks stop short of the full chunk.
+    torch::Tensor m_decode_steps;
+    bool m_partial_decode{false};
 
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
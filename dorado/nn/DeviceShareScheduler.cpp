@@ -0,0 +1,144 @@
+#include "DeviceShareScheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace dorado {
+
+DeviceShareScheduler::DeviceShareScheduler(std::string name, size_t max_concurrent_calls)
+        : m_name(std::move(name)),
+          m_max_concurrent_calls(std::max<size_t>(max_concurrent_calls, 1)) {}
+
+size_t DeviceShareScheduler::add_pipeline(std::string pipeline_name, double weight) {
+    if (!(weight > 0.)) {
+        throw std::runtime_error("Device share of " + pipeline_name + " must be positive");
+    }
+    std::lock_guard lock(m_mutex);
+    m_pipelines.push_back({std::move(pipeline_name), weight});
+    return m_pipelines.size() - 1;
+}
+
+bool DeviceShareScheduler::is_next(size_t pipeline) const {
+    if (m_num_running >= m_max_concurrent_calls) {
+        return false;
+    }
+    const auto &state = m_pipelines[pipeline];
+    for (size_t i = 0; i < m_pipelines.size(); ++i) {
+        const auto &other = m_pipelines[i];
+        if (i != pipeline && other.num_waiting != 0 &&
+            (other.virtual_ms < state.virtual_ms ||
+             (other.virtual_ms == state.virtual_ms && i < pipeline))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DeviceShareScheduler::acquire(size_t pipeline) {
+    std::unique_lock lock(m_mutex);
+    auto &state = m_pipelines[pipeline];
+    if (state.num_waiting == 0 && state.num_running == 0) {
+        // A pipeline which was idle doesn't get back the time it left to the others, so it
+        // starts level with the busy pipeline furthest behind, or with the furthest ahead if
+        // none is busy.
+        double min_busy_ms = std::numeric_limits<double>::max();
+        double max_ms = 0.;
+        for (const auto &other : m_pipelines) {
+            if (other.num_waiting != 0 || other.num_running != 0) {
+                min_busy_ms = std::min(min_busy_ms, other.virtual_ms);
+            }
+            max_ms = std::max(max_ms, other.virtual_ms);
+        }
+        state.virtual_ms = std::max(
+                state.virtual_ms,
+                min_busy_ms != std::numeric_limits<double>::max() ? min_busy_ms : max_ms);
+    }
+
+    const auto wait_start = std::chrono::steady_clock::now();
+    ++state.num_waiting;
+    m_free_cv.wait(lock, [this, pipeline] { return is_next(pipeline); });
+    --state.num_waiting;
+    ++state.num_running;
+    ++m_num_running;
+    ++state.num_calls;
+    state.wait_ms += std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - wait_start)
+                             .count();
+    // Another pipeline may now be first in line for a slot that is still free.
+    if (m_num_running < m_max_concurrent_calls) {
+        m_free_cv.notify_all();
+    }
+}
+
+void DeviceShareScheduler::release(size_t pipeline, std::chrono::steady_clock::duration call_time) {
+    {
+        std::lock_guard lock(m_mutex);
+        auto &state = m_pipelines[pipeline];
+        --state.num_running;
+        --m_num_running;
+        state.virtual_ms +=
+                std::chrono::duration<double, std::milli>(call_time).count() / state.weight;
+    }
+    m_free_cv.notify_all();
+}
+
+stats::NamedStats DeviceShareScheduler::sample_stats() const {
+    std::lock_guard lock(m_mutex);
+    stats::NamedStats stats;
+    for (const auto &state : m_pipelines) {
+        stats[state.name + ".calls"] = double(state.num_calls);
+        stats[state.name + ".device_ms"] = state.virtual_ms * state.weight;
+        stats[state.name + ".wait_ms"] = double(state.wait_ms);
+        stats[state.name + ".waiting"] = double(state.num_waiting);
+    }
+    return stats;
+}
+
+SharedDeviceRunner::SharedDeviceRunner(Runner runner,
+                                       std::shared_ptr<DeviceShareScheduler> scheduler,
+                                       size_t pipeline)
+        : m_runner(std::move(runner)), m_scheduler(std::move(scheduler)), m_pipeline(pipeline) {}
+
+std::vector<DecodedChunk> SharedDeviceRunner::call_chunks(int num_chunks) {
+    m_scheduler->acquire(m_pipeline);
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        auto decoded_chunks = m_runner->call_chunks(num_chunks);
+        m_scheduler->release(m_pipeline, std::chrono::steady_clock::now() - start);
+        return decoded_chunks;
+    } catch (...) {
+        m_scheduler->release(m_pipeline, std::chrono::steady_clock::now() - start);
+        throw;
+    }
+}
+
+std::vector<std::shared_ptr<DeviceShareScheduler>> share_devices(
+        const std::vector<std::vector<Runner> *> &pipeline_runners,
+        const std::vector<std::string> &pipeline_names,
+        const std::vector<double> &weights,
+        size_t num_devices,
+        size_t max_concurrent_calls) {
+    std::vector<std::shared_ptr<DeviceShareScheduler>> schedulers;
+    for (size_t device = 0; device < num_devices; ++device) {
+        schedulers.push_back(std::make_shared<DeviceShareScheduler>(
+                "DeviceShareScheduler" + std::to_string(device), max_concurrent_calls));
+    }
+    for (size_t i = 0; i < pipeline_runners.size(); ++i) {
+        // create_basecall_runners makes the same number of runners for each device, in order.
+        auto &runners = *pipeline_runners[i];
+        const size_t runners_per_device = runners.size() / num_devices;
+        std::vector<size_t> pipeline_ids;
+        for (auto &scheduler : schedulers) {
+            pipeline_ids.push_back(scheduler->add_pipeline(pipeline_names[i], weights[i]));
+        }
+        for (size_t r = 0; r < runners.size(); ++r) {
+            const size_t device = std::min(r / runners_per_device, num_devices - 1);
+            runners[r] = std::make_shared<SharedDeviceRunner>(
+                    std::move(runners[r]), schedulers[device], pipeline_ids[device]);
+        }
+    }
+    return schedulers;
+}
+
+}  // namespace dorado
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ModelRunner.h"
+#include "utils/stats.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+// Shares one device between the runners of several pipelines, such as the simplex and stereo
+// basecallers of a duplex run.  At most max_concurrent_calls batches run on the device at once,
+// and when one finishes the next is taken from the waiting pipeline which has had the least
+// device time for its weight, so each pipeline with batches waiting gets its weighted share.
+// A pipeline which has nothing to call leaves its share to the others.  Thread-safe.
+class DeviceShareScheduler {
+public:
+    DeviceShareScheduler(std::string name, size_t max_concurrent_calls);
+
+    // Returns the id of a new pipeline which gets weight parts of the device time.
+    size_t add_pipeline(std::string pipeline_name, double weight);
+
+    // Blocks until one of the pipeline's batches may run on the device.
+    void acquire(size_t pipeline);
+    // Frees the device for the next batch, charging the pipeline for the time its batch took.
+    void release(size_t pipeline, std::chrono::steady_clock::duration call_time);
+
+    std::string get_name() const { return m_name; }
+    stats::NamedStats sample_stats() const;
+
+private:
+    struct PipelineState {
+        std::string name;
+        double weight;
+        // Device time the pipeline has had, divided by its weight.
+        double virtual_ms = 0.;
+        int num_waiting = 0;
+        int num_running = 0;
+        int64_t wait_ms = 0;
+        int64_t num_calls = 0;
+    };
+
+    // Whether the pipeline is the one whose batch runs next, if the device is free.  Must be
+    // called with m_mutex held.
+    bool is_next(size_t pipeline) const;
+
+    const std::string m_name;
+    const size_t m_max_concurrent_calls;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_free_cv;
+    std::vector<PipelineState> m_pipelines;
+    size_t m_num_running = 0;
+};
+
+// Runs a pipeline's batches on its device when the device's scheduler allows.
+class SharedDeviceRunner final : public ModelRunnerBase {
+public:
+    SharedDeviceRunner(Runner runner,
+                       std::shared_ptr<DeviceShareScheduler> scheduler,
+                       size_t pipeline);
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource> &chunks) final {
+        m_runner->accept_chunks(first_chunk_idx, chunks);
+    }
+    std::vector<DecodedChunk> call_chunks(int num_chunks) final;
+    size_t model_stride() const final { return m_runner->model_stride(); }
+    size_t chunk_size() const final { return m_runner->chunk_size(); }
+    size_t batch_size() const final { return m_runner->batch_size(); }
+    int numa_node() const final { return m_runner->numa_node(); }
+    void terminate() final { m_runner->terminate(); }
+    std::string get_name() const final { return m_runner->get_name(); }
+    stats::NamedStats sample_stats() const final { return m_runner->sample_stats(); }
+
+private:
+    Runner m_runner;
+    std::shared_ptr<DeviceShareScheduler> m_scheduler;
+    size_t m_pipeline;
+};
+
+// Wraps the runners of each pipeline, as made by create_basecall_runners for the same device
+// string, so that each of the num_devices devices is shared between the pipelines with the
+// given weights, running at most max_concurrent_calls batches at once.  Returns the devices'
+// schedulers.
+std::vector<std::shared_ptr<DeviceShareScheduler>> share_devices(
+        const std::vector<std::vector<Runner> *> &pipeline_runners,
+        const std::vector<std::string> &pipeline_names,
+        const std::vector<double> &weights,
+        size_t num_devices,
+        size_t max_concurrent_calls);
+
+}  // namespace dorado
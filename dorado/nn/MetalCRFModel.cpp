@@ -4,22 +4,27 @@
 #include "MetalCRFModel.h"
 
 #include "../decode/beam_search.h"
+#include "../utils/cache_utils.h"
 #include "../utils/math_utils.h"
 #include "../utils/metal_utils.h"
 #include "../utils/module_utils.h"
 #include "../utils/tensor_utils.h"
+#include "../utils/thread_qos.h"
 
 #include <math.h>
 #include <spdlog/spdlog.h>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <string>
 #include <vector>
 
 using namespace dorado::utils;
 using namespace std::chrono_literals;
 using namespace torch::nn;
 namespace F = torch::nn::functional;
-using torch::indexing::Ellipsis;
 using torch::indexing::Slice;
 
 static constexpr auto torch_dtype = torch::kF16;
@@ -28,6 +33,9 @@ static const size_t dtype_bytes = torch::elementSize(torch_dtype);
 namespace {
 // SIMD tile size dictated by the metal spec.
 const int kTileSize = 8;
+// Columns of output tiles each SIMD group computes at a time in the lstm and linear kernels.
+// Their _wide variants compute twice as many.
+const int kSimdTilesN = 4;
 
 bool finishCommandBuffer(const char *label, MTL::CommandBuffer *cb, int try_count) {
     cb->commit();
@@ -225,13 +233,6 @@ struct MetalBlockImpl : Module {
             args_lstm = create_vec_buffer(device, args_lstm_);
         }
 
-        // args for conversion to half
-        {
-            const std::vector<int32_t> args_to_half_{in_chunk_size * batch_size *
-                                                     config.num_features};
-            args_to_half = create_vec_buffer(device, args_to_half_);
-        }
-
         // args for final (possibly only) linear layer kernel.
         // Each output buffer requires a distinct input offset, so we must have a separate args buffer.
         args_linear.resize(out_split_);
@@ -272,17 +273,31 @@ struct MetalBlockImpl : Module {
             kernel_simd_groups = 16;
         }
         kernel_thread_groups = get_mtl_device_core_count();
+        // From the M3 generation on, GPUs have the registers to hold twice as wide a block of
+        // accumulators per SIMD group, so each input tile loaded is used twice as often.  The
+        // wide kernels are only used where every SIMD group still gets a block of its own.
+        const bool wide_tiles_fit = device->supportsFamily(MTL::GPUFamilyApple9);
+        const auto wide_kernel = [&](int out_cols) {
+            const int wide_block_cols = 2 * kSimdTilesN * kTileSize;
+            return wide_tiles_fit && out_cols % wide_block_cols == 0 &&
+                   out_cols / wide_block_cols >= kernel_simd_groups;
+        };
+        const bool lstm_wide = wide_kernel(kLstmGates * config.insize);
+        lstm_tiles_n = lstm_wide ? 2 * kSimdTilesN : kSimdTilesN;
+        const std::string lstm_kernel = lstm_wide ? "lstm_wide" : "lstm";
+        spdlog::debug("Metal LSTM kernel: {}", lstm_kernel);
         const int lstm_threads = kernel_simd_groups * 32;
-        lstm_cps[0] = make_cps(device, "lstm",
+        lstm_cps[0] = make_cps(device, lstm_kernel,
                                {{"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", false}},
                                lstm_threads);
-        lstm_cps[1] = make_cps(device, "lstm",
+        lstm_cps[1] = make_cps(device, lstm_kernel,
                                {{"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", true}},
                                lstm_threads);
-        to_half_cps = make_cps(device, "float_to_half", {});
+        const auto linear_kernel = [&](std::string name, int out_cols) {
+            return wide_kernel(out_cols) ? name + "_wide" : name;
+        };
 
         // The temp buffer used for these purposes (number of elements of `torch_dtype` in []):
-        // - Store inputs converted to F16 (if torch_dtype == kF16) [in_chunk_size * batch_size]
         // - Store output of second conv layer [in_chunk_size * batch_size * kMaxConv2OutChannels]
         // - Store temp output of lstm layers [batch_size * layer_size]
         // - Store output of first linear layer if there are two
@@ -325,8 +340,8 @@ struct MetalBlockImpl : Module {
                      {"kLinearOutputClamp", false},
                      {"kLinearOutputTanh", false},
                      {"kLinearOutputAsByte", false}});
-            linear_cps[0] =
-                    make_cps(device, "linear_from_rev_lstm", linear_constants1, linear_threads);
+            linear_cps[0] = make_cps(device, linear_kernel("linear_from_rev_lstm", decomposition),
+                                     linear_constants1, linear_threads);
             const auto linear_constants2 = std::vector<std::tuple<std::string, MetalConstant>>(
                     {{"kLinearInSize", decomposition},
                      {"kLinearOutSize", config.outsize},
@@ -335,7 +350,8 @@ struct MetalBlockImpl : Module {
                      {"kLinearOutputClamp", true},
                      {"kLinearOutputTanh", false},
                      {"kLinearOutputAsByte", true}});
-            linear_cps[1] = make_cps(device, "linear", linear_constants2, linear_threads);
+            linear_cps[1] = make_cps(device, linear_kernel("linear", config.outsize),
+                                     linear_constants2, linear_threads);
             mat_temp_elems = std::max(mat_temp_elems,
                                       decomposition * (batch_size / out_split_) * lstm_chunk_size);
         } else {
@@ -350,8 +366,8 @@ struct MetalBlockImpl : Module {
                      {"kLinearOutputClamp", !is_v3_model},
                      {"kLinearOutputTanh", is_v3_model},
                      {"kLinearOutputAsByte", true}});
-            linear_cps[0] =
-                    make_cps(device, "linear_from_rev_lstm", linear_constants, linear_threads);
+            linear_cps[0] = make_cps(device, linear_kernel("linear_from_rev_lstm", config.outsize),
+                                     linear_constants, linear_threads);
             // Single matmul that may or may not have a bias.
             if (!config.out_features.has_value()) {
                 linear1 = register_module("linear1",
@@ -421,26 +437,20 @@ struct MetalBlockImpl : Module {
         }
     }
 
-    // Executes the model, with the linear layer held off by linear_hold_off, if non-NULL.
-    MTL::CommandBuffer *forward_async(torch::Tensor &in,
-                                      MTL::SharedEvent *const linear_hold_off_event,
-                                      uint64_t linear_hold_off_id,
-                                      std::vector<torch::Tensor> &out) {
+    // Runs the convolution and LSTM layers, leaving their output for the linear layer.
+    // Returns false if either command buffer failed.
+    bool forward_lstm(torch::Tensor &in, int try_count) {
         auto command_buffer = command_queue->commandBuffer();
 
-        assert(in.dtype() == torch::kF16 || in.dtype() == torch::kF32);
-        if (in.dtype() == torch::kF32 && torch_dtype == torch::kF16) {
-            // Convert input activations from float32 to float16.
-            launch_kernel_no_wait(to_half_cps.get(), command_buffer,
-                                  {args_to_half.get(), mtl_for_tensor(in), mat_temp.get()}, {},
-                                  kernel_thread_groups, 256);
-            conv1->run(command_buffer, mat_temp.get(), mat_working_mem.get());
-        } else {
-            conv1->run(command_buffer, mtl_for_tensor(in), mat_working_mem.get());
-        }
+        // Runners write chunks straight into the input's shared buffer, already in half
+        // precision and in the layout the first convolution reads.
+        assert(in.dtype() == torch_dtype);
+        conv1->run(command_buffer, mtl_for_tensor(in), mat_working_mem.get());
         conv2->run(command_buffer, mat_working_mem.get(), mat_temp.get());
         conv3->run(command_buffer, mat_temp.get(), mat_working_mem.get());
-        finishCommandBuffer("convolutions", command_buffer, 0);
+        if (!finishCommandBuffer("convolutions", command_buffer, try_count)) {
+            return false;
+        }
         command_buffer = command_queue->commandBuffer();
 
         for (auto &rnn : {rnn1, rnn2, rnn3, rnn4, rnn5}) {
@@ -448,13 +458,23 @@ struct MetalBlockImpl : Module {
                                                      mtl_for_tensor(rnn->t_weights_bias),
                                                      mat_state.get()};
             const int kResBufSize = dtype_bytes * kernel_simd_groups * 2 * kTileSize * kTileSize;
-            const int kOutBufSize = dtype_bytes * kernel_simd_groups * kTileSize * kTileSize;
+            // Each SIMD group's output buffer holds a row of tiles of the hidden state.
+            const int kOutBufSize =
+                    dtype_bytes * kernel_simd_groups * kTileSize * 2 * lstm_tiles_n;
             const std::vector<int> tg_buffer_lens{kResBufSize, kOutBufSize};
             launch_kernel_no_wait(lstm_cps[rnn->reverse].get(), command_buffer, buffers,
                                   tg_buffer_lens, kernel_thread_groups, kernel_simd_groups * 32);
         }
-        finishCommandBuffer("lstm", command_buffer, 0);
-        command_buffer = command_queue->commandBuffer();
+        return finishCommandBuffer("lstm", command_buffer, try_count);
+    }
+
+    // Executes the linear layer for one piece of the batch, output to out, held off by
+    // linear_hold_off_event until it reaches linear_hold_off_id.
+    MTL::CommandBuffer *linear_async(int piece,
+                                     MTL::SharedEvent *const linear_hold_off_event,
+                                     uint64_t linear_hold_off_id,
+                                     torch::Tensor &out) {
+        auto command_buffer = command_queue->commandBuffer();
 
         // The output buffers of conv/LSTM layers are not used by the decoding, so
         // can be overwritten by subsequent batches as soon as they have been consumed by
@@ -468,38 +488,37 @@ struct MetalBlockImpl : Module {
                 static_cast<int>(dtype_bytes * kernel_simd_groups * kTileSize * kTileSize);
         const std::vector<int> linear_tg_buffer_lens{kLinearTGOutBufSize};
 
-        // The output of the linear layer is split into multiple buffers, each generated
-        // by a separate kernel launch.
-        for (int i = 0; i < out.size(); ++i) {
-            MTL::Buffer *const args_buffer = args_linear.at(i).get();
-            MTL::Buffer *const out_buffer = mtl_for_tensor(out.at(i));
-            if (config.out_features.has_value()) {
-                launch_kernel_no_wait(linear_cps[0].get(), command_buffer,
-                                      {args_buffer, mat_working_mem.get(), linear_weights[0].get(),
-                                       mat_temp.get()},
-                                      linear_tg_buffer_lens, kernel_thread_groups,
-                                      kernel_simd_groups * 32);
-                launch_kernel_no_wait(
-                        linear_cps[1].get(), command_buffer,
-                        {args_linear2.get(), mat_temp.get(), linear_weights[1].get(), out_buffer},
-                        linear_tg_buffer_lens, kernel_thread_groups, kernel_simd_groups * 32);
-            } else {
-                launch_kernel_no_wait(
-                        linear_cps[0].get(), command_buffer,
-                        {args_buffer, mat_working_mem.get(), linear_weights[0].get(), out_buffer},
-                        linear_tg_buffer_lens, kernel_thread_groups, kernel_simd_groups * 32);
-            }
+        // Each piece's kernel launch reads its own batch elements of the LSTM output.
+        MTL::Buffer *const args_buffer = args_linear.at(piece).get();
+        MTL::Buffer *const out_buffer = mtl_for_tensor(out);
+        if (config.out_features.has_value()) {
+            launch_kernel_no_wait(linear_cps[0].get(), command_buffer,
+                                  {args_buffer, mat_working_mem.get(), linear_weights[0].get(),
+                                   mat_temp.get()},
+                                  linear_tg_buffer_lens, kernel_thread_groups,
+                                  kernel_simd_groups * 32);
+            launch_kernel_no_wait(
+                    linear_cps[1].get(), command_buffer,
+                    {args_linear2.get(), mat_temp.get(), linear_weights[1].get(), out_buffer},
+                    linear_tg_buffer_lens, kernel_thread_groups, kernel_simd_groups * 32);
+        } else {
+            launch_kernel_no_wait(
+                    linear_cps[0].get(), command_buffer,
+                    {args_buffer, mat_working_mem.get(), linear_weights[0].get(), out_buffer},
+                    linear_tg_buffer_lens, kernel_thread_groups, kernel_simd_groups * 32);
         }
         return command_buffer;
     }
 
     MTL::Device *device;
     NS::SharedPtr<MTL::CommandQueue> command_queue;
-    NS::SharedPtr<MTL::ComputePipelineState> lstm_cps[2], to_half_cps, linear_cps[2];
-    NS::SharedPtr<MTL::Buffer> mat_working_mem, mat_state, mat_temp, args_lstm, args_to_half,
-            linear_weights[2], args_linear2;
+    NS::SharedPtr<MTL::ComputePipelineState> lstm_cps[2], linear_cps[2];
+    NS::SharedPtr<MTL::Buffer> mat_working_mem, mat_state, mat_temp, args_lstm, linear_weights[2],
+            args_linear2;
     std::vector<NS::SharedPtr<MTL::Buffer>> args_linear;
     int in_chunk_size, lstm_chunk_size, batch_size, kernel_thread_groups, kernel_simd_groups;
+    // Output tile columns each SIMD group of the lstm kernel computes at a time.
+    int lstm_tiles_n;
     CRFModelConfig config;
     MetalLSTM rnn1{nullptr}, rnn2{nullptr}, rnn3{nullptr}, rnn4{nullptr}, rnn5{nullptr};
     MetalConv1d conv1{nullptr}, conv2{nullptr}, conv3{nullptr};
@@ -523,11 +542,15 @@ struct MetalModelImpl : Module {
         mtl_block->load_weights();
     }
 
-    MTL::CommandBuffer *forward_async(torch::Tensor &in,
-                                      MTL::SharedEvent *const linear_hold_off_event,
-                                      uint64_t linear_hold_off_id,
-                                      std::vector<torch::Tensor> &out) {
-        return mtl_block->forward_async(in, linear_hold_off_event, linear_hold_off_id, out);
+    bool forward_lstm(torch::Tensor &in, int try_count) {
+        return mtl_block->forward_lstm(in, try_count);
+    }
+
+    MTL::CommandBuffer *linear_async(int piece,
+                                     MTL::SharedEvent *const linear_hold_off_event,
+                                     uint64_t linear_hold_off_id,
+                                     torch::Tensor &out) {
+        return mtl_block->linear_async(piece, linear_hold_off_event, linear_hold_off_id, out);
     }
 
     MetalBlock mtl_block{nullptr};
@@ -537,9 +560,197 @@ TORCH_MODULE(MetalModel);
 
 }  // namespace nn
 
+namespace {
+
+constexpr int MTL_CORE_BATCH_SIZE = 48;
+// Auto batch sizes are re-measured after this long, in case anything the key misses changed.
+constexpr auto kBatchSizeCacheMaxAge = std::chrono::hours(24 * 30);
+
+// Number of pieces the linear layer output of a batch is split into.  Allocations beyond 4GB
+// can fail, and the linear layer output buffer hits this limit with batch sizes larger than
+// 384 with typical chunk sizes.  At the same time, the LSTM layer performance benefits from
+// large batch sizes.
+// We therefore run the linear layer via 1 or more kernel runs, each with an output buffer with
+// a size <= 4GB, with a reduced batch size.  The linear layer kernel requires a batch size
+// that is an integral multiple of 48.
+// As things stand, we need an exactly even split of batch elements in the linear layer output
+// buffers (this could be relaxed).  We therefore need the smallest divisor of batch_size that
+// results in linear layer output buffers < 4GB, and a linear layer batch size that is an
+// integral multiple of 48.  Since the LSTM batch size is already constrained to be an integral
+// multiple of 48, this means the batch splitting factor must be an exact divisor of the
+// batch_size / 48.
+// Each piece is decoded as soon as its scores are ready, and the pieces take turns in
+// kMetalBatchesInFlight sets of score buffers, so however large the batch, only that many
+// pieces' scores are resident at once.
+int linear_out_split(const CRFModelConfig &model_config, int out_chunk_size, int batch_size) {
+    constexpr auto kMaxBufferSize = static_cast<int64_t>(1) << 32;
+    const auto complete_linear_out_size = static_cast<int64_t>(out_chunk_size) *
+                                          static_cast<int64_t>(batch_size) *
+                                          static_cast<int64_t>(model_config.outsize) *
+                                          sizeof(float);
+    const int num_batch_pieces = batch_size / MTL_CORE_BATCH_SIZE;
+    int out_split = 1;
+    for (; out_split < num_batch_pieces; ++out_split) {
+        if (num_batch_pieces % out_split == 0 &&
+            complete_linear_out_size / out_split < kMaxBufferSize)
+            break;
+    }
+    // If we exited the loop above without breaking, then out_split = num_batch_pieces, which
+    // satisfies the divisor criterion, and should mean small enough linear layer output
+    // buffers, given other reasonable parameters.
+    assert(num_batch_pieces % out_split == 0);
+    assert(complete_linear_out_size / out_split < kMaxBufferSize);
+    return out_split;
+}
+
+// Approximate device memory used by a caller of batch_size chunks: the model's working
+// buffers, as allocated by MetalBlock, its input, and the score buffers of the batch pieces in
+// flight.
+size_t caller_memory_bytes(const CRFModelConfig &model_config,
+                           int in_chunk_size,
+                           int batch_size) {
+    const size_t out_chunk_size = in_chunk_size / model_config.stride;
+    const size_t out_batch_size =
+            batch_size / linear_out_split(model_config, int(out_chunk_size), batch_size);
+    const size_t num_states = size_t(1) << (2 * model_config.state_len);
+    const size_t working_mem = (out_chunk_size + 3) * batch_size * model_config.insize;
+    const size_t temp_elems =
+            size_t(batch_size) * std::max(16 * in_chunk_size, model_config.insize);
+    const size_t temp = temp_elems * 20 * model_config.num_features;
+    const size_t input = size_t(batch_size) * in_chunk_size * model_config.num_features;
+    const size_t scores = out_chunk_size * out_batch_size * model_config.outsize;
+    const size_t scans = 2 * out_batch_size * (out_chunk_size + 1) * num_states * sizeof(float);
+    return (working_mem + temp + input) * dtype_bytes + kMetalBatchesInFlight * (scores + scans);
+}
+
+// Where the auto batch size for this chip, model and chunk size is cached, if caching is
+// enabled.
+std::optional<std::filesystem::path> batch_size_cache_path(const CRFModelConfig &model_config,
+                                                           MTL::Device *device,
+                                                           int in_chunk_size) {
+    auto cache_dir = get_cache_dir();
+    if (!cache_dir) {
+        return std::nullopt;
+    }
+    return *cache_dir / kBatchSizeCacheDir /
+           cache_file_name({"metal", device->name()->utf8String(),
+                            std::to_string(get_mtl_device_core_count()),
+                            directory_fingerprint(model_config.model_path),
+                            std::to_string(in_chunk_size)},
+                           ".txt");
+}
+
+// Chunks per second the convolution, LSTM and linear layers get through at batch_size.  The
+// scans and decoding scale linearly with the batch, so they don't change which size wins.
+float time_batch_size(const CRFModelConfig &model_config,
+                      const std::vector<torch::Tensor> &weights,
+                      int in_chunk_size,
+                      int batch_size,
+                      MTL::Device *device) {
+    ScopedAutoReleasePool autorelease_pool;
+    const int out_chunk_size = in_chunk_size / model_config.stride;
+    const int out_split = linear_out_split(model_config, out_chunk_size, batch_size);
+    nn::MetalModel model(model_config, in_chunk_size, batch_size, out_split, device);
+    model->load_state_dict(weights);
+    model->eval();
+
+    auto input = torch::zeros({batch_size, in_chunk_size, model_config.num_features}, torch_dtype);
+    auto scores = torch::empty({out_chunk_size, batch_size / out_split, model_config.outsize},
+                               torch::kInt8);
+    // Signalled value 0, so the linear layers wait for nothing.
+    auto event = NS::TransferPtr(device->newSharedEvent());
+    const auto run_batch = [&] {
+        bool ok = model->forward_lstm(input, 0);
+        for (int piece = 0; piece < out_split && ok; ++piece) {
+            ok = finishCommandBuffer("linear", model->linear_async(piece, event.get(), 0, scores),
+                                     0);
+        }
+        return ok;
+    };
+
+    // The first batch also compiles and uploads everything.
+    constexpr int kTimedBatches = 3;
+    if (!run_batch()) {
+        return 0.f;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kTimedBatches; ++i) {
+        if (!run_batch()) {
+            return 0.f;
+        }
+    }
+    const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+    return kTimedBatches * batch_size / std::max(elapsed.count(), 1e-6f);
+}
+
+// Picks the fastest batch size, timing multiples of MTL_CORE_BATCH_SIZE from a half to four
+// times the core count heuristic, within the device's recommended working set.
+int auto_metal_batch_size(const CRFModelConfig &model_config,
+                          const std::vector<torch::Tensor> &weights,
+                          int in_chunk_size,
+                          MTL::Device *device) {
+    const int core_count = get_mtl_device_core_count();
+    const int default_batch_size = MTL_CORE_BATCH_SIZE * core_count;
+    const auto cache_path = batch_size_cache_path(model_config, device, in_chunk_size);
+    const auto memory_limit = static_cast<size_t>(device->recommendedMaxWorkingSetSize() * 0.8);
+    const auto fits = [&](int batch_size) {
+        return caller_memory_bytes(model_config, in_chunk_size, batch_size) <= memory_limit;
+    };
+    if (cache_path) {
+        if (auto cached = read_cached_value(*cache_path, kBatchSizeCacheMaxAge)) {
+            try {
+                const int cached_batch_size = std::stoi(*cached);
+                if (cached_batch_size >= MTL_CORE_BATCH_SIZE &&
+                    cached_batch_size % MTL_CORE_BATCH_SIZE == 0 && fits(cached_batch_size)) {
+                    spdlog::debug("Auto batch size: using cached batch size {}", cached_batch_size);
+                    return cached_batch_size;
+                }
+            } catch (const std::exception &) {
+                // Fall through and measure it again.
+            }
+        }
+    }
+
+    int best_batch_size = 0;
+    float best_rate = 0.f;
+    int prev_batch_size = 0;
+    for (int step = 1; step <= 8; ++step) {
+        const int batch_size = utils::pad_to(default_batch_size * step / 2, MTL_CORE_BATCH_SIZE);
+        if (batch_size == prev_batch_size) {
+            continue;
+        }
+        prev_batch_size = batch_size;
+        if (!fits(batch_size)) {
+            break;
+        }
+        const float rate =
+                time_batch_size(model_config, weights, in_chunk_size, batch_size, device);
+        spdlog::debug("Auto batch size: {} chunks/s at batch size {}", rate, batch_size);
+        if (rate > best_rate) {
+            best_rate = rate;
+            best_batch_size = batch_size;
+        }
+    }
+    if (best_batch_size == 0) {
+        spdlog::warn("Auto batch size detection failed, using batch size {}", default_batch_size);
+        return default_batch_size;
+    }
+    spdlog::debug("Auto batch size: chose batch size {}", best_batch_size);
+    if (cache_path) {
+        write_cached_value(*cache_path, std::to_string(best_batch_size));
+    }
+    return best_batch_size;
+}
+
+}  // namespace
+
 class MetalCaller {
 public:
-    MetalCaller(const CRFModelConfig &model_config, int chunk_size, int batch_size) {
+    MetalCaller(const CRFModelConfig &model_config,
+                int chunk_size,
+                int batch_size,
+                bool decode_on_gpu)
+            : m_decode_on_gpu(decode_on_gpu) {
         ScopedAutoReleasePool autorelease_pool;
 
         m_model_stride = static_cast<size_t>(model_config.stride);
@@ -555,10 +766,6 @@ public:
         constexpr int n_base = 4;
         m_states = pow(n_base, model_config.state_len);
 
-        constexpr int MTL_CORE_BATCH_SIZE = 48;
-        m_batch_size = (batch_size == 0) ? MTL_CORE_BATCH_SIZE * get_mtl_device_core_count()
-                                         : utils::pad_to(batch_size, MTL_CORE_BATCH_SIZE);
-
         // Chunk size after decimation via convolution stride.
         m_out_chunk_size = chunk_size / model_config.stride;
         // round chunk size down to a multiple of the stride
@@ -567,36 +774,13 @@ public:
         auto state_dict = load_crf_model_weights(
                 model_config.model_path, model_config.out_features.has_value(), model_config.bias);
 
-        // Allocations beyond 4GB can fail, and the linear layer output buffer
-        // hits this limit with batch sizes larger than 384 with typical
-        // chunk sizes.  At the same time, the LSTM layer performance benefits
-        // from large batch sizes.
-        // We therefore run the linear layer via 1 or more kernel runs, each
-        // with an output buffer with a size <= 4GB, with a reduced batch size.
-        // The linear layer kernel requires a batch size that is an integral
-        // multiple of 48.
-        // As things stand, we need an exactly even split of batch elements in
-        // the linear layer output buffers (this could be relaxed).
-        // We therefore need the smallest divisor of batch_size that results in
-        // linear layer output buffers < 4GB, and a linear layer batch size
-        // that is an integral multiple of 48.  Since the LSTM batch size is
-        // already constrained to be an integral multiple of 48, this means the
-        // batch splitting factor must be an exact divisor of the batch_size / 48.
-        constexpr auto kMaxBufferSize = static_cast<int64_t>(1) << 32;
-        const auto complete_linear_out_size =
-                static_cast<int64_t>(m_out_chunk_size) * static_cast<int64_t>(m_batch_size) *
-                static_cast<int64_t>(model_config.outsize) * sizeof(float);
-        const int num_batch_pieces = m_batch_size / MTL_CORE_BATCH_SIZE;
-        for (m_out_split = 1; m_out_split < num_batch_pieces; ++m_out_split) {
-            if (num_batch_pieces % m_out_split == 0 &&
-                complete_linear_out_size / m_out_split < kMaxBufferSize)
-                break;
-        }
-        // If we exited the loop above without breaking, then m_out_split = num_batch_pieces,
-        // which satisfies the divisor criterion, and should mean small enough linear layer
-        // output buffers, given other reasonable parameters.
-        assert(num_batch_pieces % m_out_split == 0);
-        assert(complete_linear_out_size / m_out_split < kMaxBufferSize);
+        // Without a batch size, the fastest is found by timing those the device has room for.
+        m_batch_size = (batch_size == 0) ? auto_metal_batch_size(model_config, state_dict,
+                                                                 m_in_chunk_size, m_device.get())
+                                         : utils::pad_to(batch_size, MTL_CORE_BATCH_SIZE);
+
+        // The linear layer is run in pieces, as described in linear_out_split().
+        m_out_split = linear_out_split(model_config, m_out_chunk_size, m_batch_size);
         assert(m_batch_size % m_out_split == 0);
         m_out_batch_size = m_batch_size / m_out_split;
         assert(m_out_batch_size % MTL_CORE_BATCH_SIZE == 0);
@@ -606,17 +790,11 @@ public:
         m_model->load_state_dict(state_dict);
         m_model->eval();
 
-        m_decode_complete_event = NS::TransferPtr(m_device->newSharedEvent());
         m_bwd_scan_cps = make_cps(m_device.get(), "backward_scan", {});
         m_fwd_scan_cps = make_cps(m_device.get(), "forward_scan", {});
         m_add_softmax_cps = make_cps(m_device.get(), "add_softmax", {});
-
-        m_metal_thread.reset(new std::thread(&MetalCaller::metal_thread_fn, this));
-
-        int num_decode_threads = std::max(1, get_apple_cpu_perf_core_count() - 1);
-        m_decode_threads.reserve(num_decode_threads);
-        for (int i = 0; i < num_decode_threads; ++i) {
-            m_decode_threads.emplace_back(new std::thread(&MetalCaller::decode_thread_fn, this, i));
+        if (m_decode_on_gpu) {
+            m_viterbi_cps = make_cps(m_device.get(), "viterbi", {});
         }
 
         int T = m_out_chunk_size;
@@ -625,10 +803,16 @@ public:
 
         int y = pow(n_base, model_config.state_len);
 
-        for (int i = 0; i < m_out_split; ++i) {
-            m_scores_int8.push_back(torch::empty({T, m_out_batch_size, C}, torch::kInt8));
-            m_posts.push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
-            m_bwd.push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
+        m_score_buffers.resize(kMetalBatchesInFlight);
+        for (auto &buffers : m_score_buffers) {
+            buffers.scores_int8 = torch::empty({T, m_out_batch_size, C}, torch::kInt8);
+            buffers.posts = torch::empty({m_out_batch_size, T + 1, Cs});
+            buffers.bwd = torch::empty({m_out_batch_size, T + 1, Cs});
+            if (m_decode_on_gpu) {
+                buffers.path_states = torch::empty({m_out_batch_size, T}, torch::kInt32);
+                buffers.path_moves = torch::empty({m_out_batch_size, T}, torch::kUInt8);
+            }
+            buffers.decode_complete_event = NS::TransferPtr(m_device->newSharedEvent());
         }
 
         // v3 scores come from a tanh activation whose [-1, 1] range is packed into bytes.
@@ -638,6 +822,16 @@ public:
         // fit into bytes.
         // In both cases beam search applies the same 5/127 factor to scores.
         score_scale = static_cast<float>(5.0 / 127.0);
+
+        // Start the threads once the buffers they use exist.
+        m_metal_thread.reset(new std::thread(&MetalCaller::metal_thread_fn, this));
+
+        // Together with the metal thread, the decode threads take each performance core.
+        int num_decode_threads = std::max(1, get_apple_cpu_perf_core_count() - 1);
+        m_decode_threads.reserve(num_decode_threads);
+        for (int i = 0; i < num_decode_threads; ++i) {
+            m_decode_threads.emplace_back(new std::thread(&MetalCaller::decode_thread_fn, this, i));
+        }
     }
 
     ~MetalCaller() {
@@ -651,6 +845,20 @@ public:
         }
     }
 
+    // Linear layer output and scan results for one piece of a batch.  Each set is guarded by
+    // its own event, so successive pieces can use the sets in turn, and the GPU can run one
+    // piece's linear layer and scans while the CPU is still decoding the previous piece.
+    struct ScoreBuffers {
+        torch::Tensor scores_int8, posts, bwd;
+        // The best path through each chunk, if it is found on the GPU.
+        torch::Tensor path_states, path_moves;
+        // Signalled with a piece's ID once all its chunks are decoded.  A set's pieces are
+        // decoded in order, since each waits for the last to be decoded before it is written.
+        NS::SharedPtr<MTL::SharedEvent> decode_complete_event;
+        // Start at 1, since at event creation ID 0 is deemed to have been signalled.
+        uint64_t next_decode_complete_event_id{1};
+    };
+
     struct NNTask {
         NNTask(torch::Tensor *input_, int num_chunks_, std::vector<DecodedChunk> *out_chunks_)
                 : input(input_), out_chunks(out_chunks_), num_chunks(num_chunks_) {}
@@ -661,10 +869,20 @@ public:
         bool ready{false};
         std::vector<DecodedChunk> *out_chunks;
         int num_chunks;
+        // Chunks whose scores are ready, guarded by m_decode_lock along with
+        // decode_chunks_started.
+        int decode_chunks_ready{0};
         int decode_chunks_started{0};
         int decode_chunks_finished{0};
-        // Event ID to be signalled when decoding for this task is complete, set by metal_thread_fn.
-        uint64_t decode_complete_event_id = static_cast<uint64_t>(0);
+        // Set by metal_thread_fn for each piece of the batch holding chunks, before its chunks
+        // are ready.
+        struct Piece {
+            ScoreBuffers *score_buffers{nullptr};
+            // Event ID to be signalled when decoding for this piece is complete.
+            uint64_t decode_complete_event_id = static_cast<uint64_t>(0);
+            int chunks_finished{0};
+        };
+        std::vector<Piece> pieces;
     };
 
     void call_chunks(torch::Tensor &input, int num_chunks, std::vector<DecodedChunk> &out_chunks) {
@@ -687,11 +905,11 @@ public:
 
     void metal_thread_fn() {
         ScopedAutoReleasePool autorelease_pool;
+        // The GPU idles whenever this thread is descheduled, so keep it on a performance core.
+        utils::set_thread_qos(utils::ThreadQoS::Interactive);
 
-        // Incrementing ID used to prevent the linear layer of run i+1 overwriting the scores of
-        // run i before the CPU has finished decoding all run i's chunks.
-        // Start at 1, since at event creation ID 0 is deemed to have been signalled.
-        auto next_decode_complete_event_id = static_cast<uint64_t>(1);
+        // Pieces of successive batches take the score buffer sets in turn.
+        size_t next_score_buffers = 0;
 
         // For unknown reasons, concurrent access to the GPU from multiple instances of this thread --
         // i.e. with > 1 instance of MetalCaller -- results in errors, usually command buffer error code 1.
@@ -713,70 +931,114 @@ public:
             m_input_queue.pop_back();
             input_lock.unlock();
 
-            // Assign this task a unique decode completion event ID.
-            // This ID will be signalled by the CPU once it has finished relevant decoding work,
-            // allowing the GPU to proceed.
-            task->decode_complete_event_id = next_decode_complete_event_id++;
-
             // TODO: find a more robust way of dealing with Metal kernel launch issues
             for (int try_count = 0; try_count < 5; ++try_count) {
                 std::lock_guard<std::mutex> lock(inter_caller_mutex);
+                if (m_model->forward_lstm(*task->input, try_count)) {
+                    break;
+                }
+                std::this_thread::sleep_for(20ms);
+            }
+
+            // Only the pieces of the batch holding chunks need their scores computed.
+            const int num_pieces =
+                    utils::pad_to(task->num_chunks, m_out_batch_size) / m_out_batch_size;
+            task->pieces.resize(num_pieces);
+            for (int piece_idx = 0; piece_idx < num_pieces; ++piece_idx) {
+                // Assign this piece a unique decode completion event ID for its score buffers.
+                // This ID will be signalled by the CPU once it has finished relevant decoding
+                // work, allowing the GPU to reuse the buffers.
+                auto &score_buffers = m_score_buffers[next_score_buffers];
+                next_score_buffers = (next_score_buffers + 1) % m_score_buffers.size();
+                auto &piece = task->pieces[piece_idx];
+                piece.score_buffers = &score_buffers;
+                piece.decode_complete_event_id = score_buffers.next_decode_complete_event_id++;
+
+                for (int try_count = 0; try_count < 5; ++try_count) {
+                    std::lock_guard<std::mutex> lock(inter_caller_mutex);
+
+                    // The linear layer should not execute until the last piece to use these
+                    // score buffers has been decoded, since they hold its scores and fwd/bwd
+                    // scans.
+                    MTL::CommandBuffer *const cb = m_model->linear_async(
+                            piece_idx, score_buffers.decode_complete_event.get(),
+                            piece.decode_complete_event_id - 1, score_buffers.scores_int8);
+
+                    // The same buffer is used for the forward scan results and the output of
+                    // m_add_softmax_cps.
+                    auto *const scores_int8 = mtl_for_tensor(score_buffers.scores_int8);
+                    auto *const fwd = mtl_for_tensor(score_buffers.posts);
+                    auto *const bwd = mtl_for_tensor(score_buffers.bwd);
+                    // This stage is operating on the split outputs of the linear layer, so
+                    // the effective batch size is m_out_batch_size.
+                    std::vector<int32_t> scan_args_{m_out_chunk_size, m_out_batch_size, m_states};
+                    auto scan_args = create_vec_buffer(m_device.get(), scan_args_);
 
-                // The linear layer should not execute until the previous batch has been decoded,
-                // since the same buffers are used for successive batches' scores, fwd/bwd scans.
-                MTL::CommandBuffer *const cb =
-                        m_model->forward_async(*task->input, m_decode_complete_event.get(),
-                                               task->decode_complete_event_id - 1, m_scores_int8);
-
-                // The same buffer is used for the forward scan results and the output of
-                // m_add_softmax_cps.
-                auto &fwd = m_posts;
-                // This stage is operating on the split outputs of the linear layer, so
-                // the effective batch size is m_out_batch_size.
-                std::vector<int32_t> scan_args_{m_out_chunk_size, m_out_batch_size, m_states};
-                auto scan_args = create_vec_buffer(m_device.get(), scan_args_);
-
-                for (int i = 0; i < m_out_split; ++i) {
                     // TODO: optimise grid size
                     launch_kernel_no_wait(m_fwd_scan_cps.get(), cb,
-                                          {scan_args.get(), mtl_for_tensor(m_scores_int8.at(i)),
-                                           mtl_for_tensor(fwd.at(i))},
-                                          {}, m_out_batch_size, m_states);
+                                          {scan_args.get(), scores_int8, fwd}, {},
+                                          m_out_batch_size, m_states);
 
                     launch_kernel_no_wait(m_bwd_scan_cps.get(), cb,
-                                          {scan_args.get(), mtl_for_tensor(m_scores_int8.at(i)),
-                                           mtl_for_tensor(m_bwd.at(i))},
-                                          {}, m_out_batch_size, m_states);
+                                          {scan_args.get(), scores_int8, bwd}, {},
+                                          m_out_batch_size, m_states);
 
                     launch_kernel_no_wait(m_add_softmax_cps.get(), cb,
-                                          {scan_args.get(), mtl_for_tensor(fwd.at(i)),
-                                           mtl_for_tensor(m_bwd.at(i))},
-                                          {}, m_out_batch_size, m_states);
+                                          {scan_args.get(), fwd, bwd}, {}, m_out_batch_size,
+                                          m_states);
+
+                    if (m_decode_on_gpu) {
+                        // The backward scan isn't needed once the posteriors are computed, so
+                        // its buffer, with 4 bytes per state and timestep, holds the Viterbi
+                        // search's 1 byte back pointers.
+                        const std::vector<int> viterbi_tg_buffer_lens{
+                                static_cast<int>(2 * m_states * sizeof(float))};
+                        launch_kernel_no_wait(
+                                m_viterbi_cps.get(), cb,
+                                {scan_args.get(), scores_int8, bwd,
+                                 mtl_for_tensor(score_buffers.path_states),
+                                 mtl_for_tensor(score_buffers.path_moves)},
+                                viterbi_tg_buffer_lens, m_out_batch_size, m_states);
+                    }
+                    if (finishCommandBuffer("linear/scan/softmax", cb, try_count)) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(20ms);
                 }
-                if (finishCommandBuffer("linear/scan/softmax", cb, try_count)) {
-                    break;
+
+                // Pass the piece's chunks on to decode threads
+                std::unique_lock<std::mutex> decode_lock(m_decode_lock);
+                task->decode_chunks_ready =
+                        std::min(task->num_chunks, (piece_idx + 1) * m_out_batch_size);
+                if (piece_idx == 0) {
+                    m_decode_queue.push_front(task);
                 }
-                std::this_thread::sleep_for(20ms);
+                decode_lock.unlock();
+                m_decode_cv.notify_all();
             }
-
-            // Pass task on to decode threads
-            std::unique_lock<std::mutex> decode_lock(m_decode_lock);
-            m_decode_queue.push_front(task);
-            decode_lock.unlock();
-            m_decode_cv.notify_all();
         }
     }
 
     void decode_thread_fn(int thread_id) {
+        // Score buffers are only reused once decoded, so slow decoding stalls the GPU.
+        utils::set_thread_qos(utils::ThreadQoS::Interactive);
         while (true) {
             std::unique_lock<std::mutex> decode_lock(m_decode_lock);
-            while (m_decode_queue.empty() && !m_terminate_decode.load()) {
+            // Tasks are decoded in order, so wait for the oldest to have chunks ready.
+            const auto no_chunks_ready = [this] {
+                return m_decode_queue.empty() || m_decode_queue.back()->decode_chunks_started ==
+                                                         m_decode_queue.back()->decode_chunks_ready;
+            };
+            while (no_chunks_ready() && !m_terminate_decode.load()) {
                 m_decode_cv.wait_for(decode_lock, 100ms);
             }
 
             if (m_decode_queue.empty() && m_terminate_decode.load()) {
                 return;
             }
+            if (no_chunks_ready()) {
+                continue;
+            }
             NNTask *const task = m_decode_queue.back();
             int chunk_idx = task->decode_chunks_started++;
             // If all chunks have been picked up for decoding, remove task from queue
@@ -785,31 +1047,47 @@ public:
             }
             decode_lock.unlock();
 
-            // Model outputs are split across m_out_split buffers.
-            assert(m_scores_int8.size() == m_out_split);
-            assert(m_bwd.size() == m_out_split);
-            assert(m_posts.size() == m_out_split);
-            const int out_buf_idx = chunk_idx / m_out_batch_size;
-            const int buf_chunk_idx = chunk_idx % m_out_batch_size;
-
-            auto [sequence, qstring, moves] = beam_search_decode(
-                    m_scores_int8.at(out_buf_idx).index({Slice(), buf_chunk_idx}),
-                    m_bwd.at(out_buf_idx)[buf_chunk_idx], m_posts.at(out_buf_idx)[buf_chunk_idx],
-                    m_decoder_options.beam_width, m_decoder_options.beam_cut,
-                    m_decoder_options.blank_score, m_decoder_options.q_shift,
-                    m_decoder_options.q_scale, m_decoder_options.temperature, score_scale);
-
-            (*task->out_chunks)[chunk_idx] = DecodedChunk{sequence, qstring, moves};
+            // Model outputs are split across pieces of m_out_batch_size chunks.
+            const int piece_idx = chunk_idx / m_out_batch_size;
+            const int piece_chunk_idx = chunk_idx % m_out_batch_size;
+            auto &piece = task->pieces.at(piece_idx);
+            const auto &buffers = *piece.score_buffers;
+
+            if (m_decode_on_gpu) {
+                // Only the qscores and sequence are left to find from the path.
+                const auto *const states_ptr =
+                        buffers.path_states[piece_chunk_idx].data_ptr<int32_t>();
+                const auto *const moves_ptr =
+                        buffers.path_moves[piece_chunk_idx].data_ptr<uint8_t>();
+                auto [sequence, qstring, moves] = path_decode(
+                        std::vector<int32_t>(states_ptr, states_ptr + m_out_chunk_size),
+                        std::vector<uint8_t>(moves_ptr, moves_ptr + m_out_chunk_size),
+                        buffers.posts[piece_chunk_idx], m_decoder_options.q_shift,
+                        m_decoder_options.q_scale);
+                (*task->out_chunks)[chunk_idx] = DecodedChunk{sequence, qstring, moves};
+            } else {
+                auto [sequence, qstring, moves] = beam_search_decode(
+                        buffers.scores_int8.index({Slice(), piece_chunk_idx}),
+                        buffers.bwd[piece_chunk_idx], buffers.posts[piece_chunk_idx],
+                        m_decoder_options.beam_width, m_decoder_options.beam_cut,
+                        m_decoder_options.blank_score, m_decoder_options.q_shift,
+                        m_decoder_options.q_scale, m_decoder_options.temperature, score_scale);
+                (*task->out_chunks)[chunk_idx] = DecodedChunk{sequence, qstring, moves};
+            }
 
+            // The task is gone as soon as the thread which called `call_chunks()` sees it is
+            // done, so finish with it before letting go of its lock.
+            std::lock_guard<std::mutex> task_lock(task->mut);
+            const int piece_num_chunks =
+                    std::min(m_out_batch_size, task->num_chunks - piece_idx * m_out_batch_size);
+            if (++piece.chunks_finished == piece_num_chunks) {
+                // Now that the piece's chunks are decoded, signal that the GPU can overwrite its
+                // scores buffer with subsequent work.
+                assert(buffers.decode_complete_event);
+                buffers.decode_complete_event->setSignaledValue(piece.decode_complete_event_id);
+            }
             // Wake the waiting thread which called `call_chunks()` if we're done decoding
-            std::unique_lock<std::mutex> task_lock(task->mut);
-            bool done = ++(task->decode_chunks_finished) == task->num_chunks;
-            task_lock.unlock();
-            if (done) {
-                // Now that all chunks are decoded, signal that the GPU can overwrite the scores
-                // buffer with subsequent work.
-                assert(m_decode_complete_event);
-                m_decode_complete_event->setSignaledValue(task->decode_complete_event_id);
+            if (++(task->decode_chunks_finished) == task->num_chunks) {
                 task->cv.notify_one();
             }
         }
@@ -830,10 +1108,13 @@ public:
     DecoderOptions m_decoder_options;
     nn::MetalModel m_model{nullptr};
     NS::SharedPtr<MTL::Device> m_device;
-    NS::SharedPtr<MTL::ComputePipelineState> m_bwd_scan_cps, m_fwd_scan_cps, m_add_softmax_cps;
-    // Used to signal completion of an NNTask's decoding.
-    NS::SharedPtr<MTL::SharedEvent> m_decode_complete_event;
-    std::vector<torch::Tensor> m_scores_int8, m_posts, m_bwd;
+    NS::SharedPtr<MTL::ComputePipelineState> m_bwd_scan_cps, m_fwd_scan_cps, m_add_softmax_cps,
+            m_viterbi_cps;
+    // Whether chunks' paths are found by a Viterbi search on the GPU, rather than by beam
+    // search on the CPU.
+    bool m_decode_on_gpu{false};
+    // One set per batch in flight.
+    std::vector<ScoreBuffers> m_score_buffers;
     int m_in_chunk_size, m_out_chunk_size, m_batch_size, m_states, m_model_stride;
     // Number of pieces the linear output is split into, for reasons of
     // buffer size constraints.
@@ -847,31 +1128,26 @@ public:
 
 std::shared_ptr<MetalCaller> create_metal_caller(const CRFModelConfig &model_config,
                                                  int chunk_size,
-                                                 int batch_size) {
-    return std::make_shared<MetalCaller>(model_config, chunk_size, batch_size);
+                                                 int batch_size,
+                                                 bool decode_on_gpu) {
+    return std::make_shared<MetalCaller>(model_config, chunk_size, batch_size, decode_on_gpu);
 }
 
 MetalModelRunner::MetalModelRunner(std::shared_ptr<MetalCaller> caller) : m_caller(caller) {
-    // Metal convolution kernels operate with channel ordering (N, T, C).  If m_input
-    // is to be submitted directly then it must also have this arrangement.
-    // Note that this is not the same as other caller implementations, which
+    // Metal convolution kernels operate with channel ordering (N, T, C), and m_input, whose
+    // storage is a shared MTL::Buffer, is submitted to them directly, so it has this
+    // arrangement too.  Note that this is not the same as other caller implementations, which
     // have T innermost.
     m_input = torch::empty(
             {caller->m_batch_size, caller->m_in_chunk_size, caller->m_num_input_features},
             torch::kF16);
 }
 
-void MetalModelRunner::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
-    if (chunk.dim() == 1) {
-        // Input has single feature dimension.
-        assert(m_caller->m_num_input_features == 1);
-        m_input.index_put_({chunk_idx, Ellipsis, 0}, chunk);
-    } else {
-        // Chunks are passed with timestep the innermost dimension, whereas we need
-        // channels innermost.
-        assert(m_caller->m_num_input_features == chunk.size(0));
-        m_input.index_put_({chunk_idx, Ellipsis, Ellipsis}, chunk.transpose(0, 1));
-    }
+void MetalModelRunner::accept_chunks(int first_chunk_idx,
+                                     const std::vector<utils::ChunkSource> &chunks) {
+    // Chunks are written in place with channels innermost, converted to half precision as
+    // they are copied, so there is neither a staging tensor nor a conversion kernel.
+    utils::gather_chunks_channels_last(m_input, first_chunk_idx, chunks);
 }
 
 std::vector<DecodedChunk> MetalModelRunner::call_chunks(int num_chunks) {
@@ -14,14 +14,21 @@ namespace dorado {
 
 class MetalCaller;
 
+// Number of batch pieces a MetalCaller has in flight at once, each decoded on the CPU from its
+// own score buffers while the GPU runs the next.
+constexpr int kMetalBatchesInFlight = 2;
+
+// With decode_on_gpu, each chunk's path is found by a Viterbi search on the GPU, leaving only
+// its qscores to the CPU, rather than by beam search on the CPU.
 std::shared_ptr<MetalCaller> create_metal_caller(const CRFModelConfig& model_config,
                                                  int chunk_size,
-                                                 int batch_size);
+                                                 int batch_size,
+                                                 bool decode_on_gpu = false);
 
 class MetalModelRunner final : public ModelRunnerBase {
 public:
     explicit MetalModelRunner(std::shared_ptr<MetalCaller> caller);
-    void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource>& chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final;
     size_t chunk_size() const final;
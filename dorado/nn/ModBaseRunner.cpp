@@ -1,21 +1,26 @@
 #include "ModBaseRunner.h"
 
 #include "RemoraModel.h"
+#include "modbase/remora_encoder.h"
 #include "modbase/remora_scaler.h"
 #include "modbase/remora_utils.h"
+#include "utils/MotifScanner.h"
 #include "utils/base_mod_utils.h"
 #include "utils/stats.h"
 #include "utils/tensor_utils.h"
+#include "utils/trace.h"
 
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include <ATen/cuda/CUDAEvent.h>
 #include <c10/cuda/CUDAGuard.h>
 #include <c10/cuda/CUDAStream.h>
 #endif
 
-#include <nvtx3/nvtx3.hpp>
+#include <ATen/Parallel.h>
 #include <toml.hpp>
 #include <torch/torch.h>
 
+#include <algorithm>
 #include <chrono>
 
 using namespace std::chrono_literals;
@@ -70,13 +75,72 @@ void ModBaseParams::parse(std::filesystem::path const& model_path, bool all_memb
     }
 }
 
+namespace {
+
+// A batch which isn't full is called at the smallest of these fractions of the batch size which
+// holds it: the whole batch, half of it or a quarter of it.  This saves copying and calling
+// padding, while the models only see a few shapes.
+constexpr int kNumBatchShapes = 3;
+
+int64_t batch_shape_rows(int64_t batch_size, int64_t num_chunks) {
+    int64_t rows = batch_size;
+    for (int i = 1; i < kNumBatchShapes && rows % 2 == 0 && rows / 2 >= num_chunks; ++i) {
+        rows /= 2;
+    }
+    return rows;
+}
+
+// On the CPU, the few channels of each convolution can't keep many threads busy, so a batch is
+// instead split into slices of at least this many chunks which are called in parallel.
+constexpr int64_t kMinCpuSliceRows = 16;
+
+torch::Tensor forward_in_slices(torch::nn::ModuleHolder<torch::nn::AnyModule>& module,
+                                const torch::Tensor& input_sigs,
+                                const torch::Tensor& input_seqs) {
+    const int64_t rows = input_sigs.size(0);
+    const int64_t max_slices = std::max<int64_t>(
+            std::min<int64_t>(at::get_num_threads(), rows / kMinCpuSliceRows), 1);
+    const int64_t slice_rows = (rows + max_slices - 1) / max_slices;
+    const int64_t num_slices = (rows + slice_rows - 1) / slice_rows;
+    if (num_slices <= 1) {
+        return module->forward(input_sigs, input_seqs);
+    }
+
+    // Each slice is called on one thread, since work inside a parallel region runs serially.
+    std::vector<torch::Tensor> scores(num_slices);
+    at::parallel_for(0, num_slices, 1, [&](int64_t begin, int64_t end) {
+        torch::InferenceMode guard;
+        for (int64_t i = begin; i < end; ++i) {
+            const auto start = i * slice_rows;
+            const auto len = std::min(slice_rows, rows - start);
+            scores[i] = module->forward(input_sigs.narrow(0, start, len),
+                                        input_seqs.narrow(0, start, len));
+        }
+    });
+    return torch::cat(scores);
+}
+
+}  // namespace
+
 class ModBaseCaller {
 public:
     struct ModBaseTask {
-        ModBaseTask(torch::Tensor input_sigs_, torch::Tensor input_seqs_, int num_chunks_)
-                : input_sigs(input_sigs_), input_seqs(input_seqs_), num_chunks(num_chunks_) {}
+        ModBaseTask(torch::Tensor input_sigs_,
+                    torch::Tensor input_seqs_,
+                    int num_chunks_,
+                    torch::Tensor output_)
+                : input_sigs(input_sigs_),
+                  input_seqs(input_seqs_),
+                  output(output_),
+                  num_chunks(num_chunks_) {}
         torch::Tensor input_sigs;
         torch::Tensor input_seqs;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        // Recorded on the runner's stream once the inputs have been uploaded.
+        at::cuda::CUDAEvent input_ready;
+#endif
+        // Host buffer the scores are copied back into, if the runner has one.
+        torch::Tensor output;
         std::mutex mut;
         std::condition_variable cv;
         torch::Tensor out;
@@ -95,23 +159,8 @@ public:
         c10::optional<c10::Stream> stream;
 #endif
         int batch_size = 0;
-
-        std::vector<size_t> get_motif_hits(const std::string& seq) const {
-            NVTX3_FUNC_RANGE();
-            std::vector<size_t> context_hits;
-            const auto& motif = params.motif;
-            const auto motif_offset = params.motif_offset;
-            size_t kmer_len = motif.size();
-            size_t search_pos = 0;
-            while (search_pos < seq.size() - kmer_len + 1) {
-                search_pos = seq.find(motif, search_pos);
-                if (search_pos != std::string::npos) {
-                    context_hits.push_back(search_pos + motif_offset);
-                    ++search_pos;
-                }
-            }
-            return context_hits;
-        }
+        // Scores per chunk, found when the model is warmed up on a CUDA device.
+        int64_t num_outputs = 0;
     };
 
     ModBaseCaller(const std::vector<std::filesystem::path>& model_paths,
@@ -156,11 +205,19 @@ public:
                 auto kmer_len =
                         caller_data->params.bases_after + caller_data->params.bases_before + 1;
 
-                // Warmup
-                auto input_sigs = torch::empty({batch_size, 1, sig_len}, m_options);
-                auto input_seqs = torch::empty(
-                        {batch_size, sig_len, RemoraUtils::NUM_BASES * kmer_len}, m_options);
-                caller_data->module_holder->forward(input_sigs, input_seqs);
+                // Warmup, at each of the batch shapes.
+                for (int64_t rows = batch_size;;) {
+                    auto input_sigs = torch::empty({rows, 1, sig_len}, m_options);
+                    auto input_seqs = torch::empty(
+                            {rows, sig_len, RemoraUtils::NUM_BASES * kmer_len}, m_options);
+                    auto scores = caller_data->module_holder->forward(input_sigs, input_seqs);
+                    caller_data->num_outputs = scores.size(1);
+                    const auto next_rows = batch_shape_rows(batch_size, rows / 2);
+                    if (next_rows == rows) {
+                        break;
+                    }
+                    rows = next_rows;
+                }
                 torch::cuda::synchronize(m_options.device().index());
             }
 #endif
@@ -168,6 +225,25 @@ public:
             m_task_threads.push_back(std::make_unique<std::thread>(
                     &ModBaseCaller::modbase_task_thread_fn, this, model_id));
         }
+
+        std::vector<std::string> motifs;
+        for (const auto& caller_data : m_caller_data) {
+            motifs.push_back(caller_data->params.motif);
+        }
+        m_motif_scanner = std::make_unique<utils::MotifScanner>(motifs);
+    }
+
+    // The canonical base of every occurrence of each model's motif in seq.
+    std::vector<std::vector<size_t>> get_motif_hits(const std::string& seq) const {
+        DORADO_TRACE_FUNCTION();
+        auto hits = m_motif_scanner->scan(seq);
+        for (size_t model_id = 0; model_id < hits.size(); ++model_id) {
+            const auto motif_offset = m_caller_data[model_id]->params.motif_offset;
+            for (auto& hit : hits[model_id]) {
+                hit += motif_offset;
+            }
+        }
+        return hits;
     }
 
     ~ModBaseCaller() {
@@ -181,18 +257,29 @@ public:
         }
     }
 
+    // With an upload_stream, the inputs are device tensors the runner is uploading on that
+    // stream, which the model's stream waits for, so that one runner's upload overlaps another's
+    // batch.  The scores of the chunks are then copied back into output, a pinned host buffer,
+    // and its first num_chunks rows returned.  Otherwise the scores of every row are returned.
     torch::Tensor call_chunks(size_t model_id,
-                              torch::Tensor& input_sigs,
-                              torch::Tensor& input_seqs,
-                              int num_chunks) {
-        NVTX3_FUNC_RANGE();
+                              const torch::Tensor& input_sigs,
+                              const torch::Tensor& input_seqs,
+                              int num_chunks,
+                              const torch::Tensor& output,
+                              const c10::optional<c10::Stream>& upload_stream) {
+        DORADO_TRACE_FUNCTION();
         auto& caller_data = m_caller_data[model_id];
 
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
         c10::cuda::OptionalCUDAStreamGuard stream_guard(caller_data->stream);
 #endif
         ModBaseTask task(input_sigs.to(m_options.device()), input_seqs.to(m_options.device()),
-                         num_chunks);
+                         num_chunks, output);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (upload_stream) {
+            task.input_ready.record(c10::cuda::CUDAStream(*upload_stream));
+        }
+#endif
         {
             std::lock_guard<std::mutex> lock(caller_data->input_lock);
             caller_data->input_queue.push_front(&task);
@@ -213,7 +300,7 @@ public:
         const bool has_stream = caller_data->stream.has_value();
 #endif
         while (true) {
-            nvtx3::scoped_range loop{"modbase_task_thread_fn"};
+            DORADO_TRACE_SCOPE("modbase_task_thread_fn");
             torch::InferenceMode guard;
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
             // If caller_data->stream is set, sets the current stream to caller_data->stream, and the current device to
@@ -235,8 +322,26 @@ public:
 
             std::unique_lock<std::mutex> task_lock(task->mut);
             stats::Timer timer;
-            auto scores = caller_data->module_holder->forward(task->input_sigs, task->input_seqs);
-            task->out = scores.to(torch::kCPU);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            if (has_stream) {
+                task->input_ready.block(c10::cuda::CUDAStream(*caller_data->stream));
+            }
+#endif
+            auto scores =
+                    m_options.device().is_cpu()
+                            ? forward_in_slices(caller_data->module_holder, task->input_sigs,
+                                                task->input_seqs)
+                            : caller_data->module_holder->forward(task->input_sigs,
+                                                                  task->input_seqs);
+            if (task->output.defined()) {
+                // Only the chunks' rows are converted, on the device, and copied back.
+                auto output = task->output.narrow(0, 0, task->num_chunks);
+                output.copy_(scores.narrow(0, 0, task->num_chunks).to(torch::kFloat32),
+                             /*non_blocking=*/true);
+                task->out = output;
+            } else {
+                task->out = scores.to(torch::kCPU);
+            }
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
             if (has_stream) {
                 caller_data->stream->synchronize();
@@ -270,6 +375,8 @@ public:
     std::atomic<bool> m_terminate{false};
     std::vector<std::unique_ptr<ModBaseData>> m_caller_data;
     std::vector<std::unique_ptr<std::thread>> m_task_threads;
+    // Finds the motifs of all the models in one pass over a read.
+    std::unique_ptr<utils::MotifScanner> m_motif_scanner;
 
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
@@ -284,6 +391,12 @@ std::shared_ptr<ModBaseCaller> create_modbase_caller(
 }
 
 ModBaseRunner::ModBaseRunner(std::shared_ptr<ModBaseCaller> caller) : m_caller(std::move(caller)) {
+    const auto device = m_caller->m_options.device();
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (device.is_cuda()) {
+        m_stream = c10::cuda::getStreamFromPool(false, device.index());
+    }
+#endif
     auto opts = torch::TensorOptions()
                         .device(torch::kCPU)
                         .pinned_memory(m_caller->m_options.device().is_cuda())
@@ -302,38 +415,248 @@ ModBaseRunner::ModBaseRunner(std::shared_ptr<ModBaseCaller> caller) : m_caller(s
         m_input_seqs.push_back(
                 torch::empty({caller_data->batch_size, sig_len, RemoraUtils::NUM_BASES * kmer_len},
                              seq_input_options));
+        if (device.is_cuda()) {
+            m_device_input_sigs.push_back(torch::empty(
+                    m_input_sigs.back().sizes(), opts.device(device).pinned_memory(false)));
+            m_device_input_seqs.push_back(
+                    torch::empty(m_input_seqs.back().sizes(),
+                                 seq_input_options.device(device).pinned_memory(false)));
+            m_output_scores.push_back(torch::empty(
+                    {caller_data->batch_size, caller_data->num_outputs},
+                    torch::TensorOptions().pinned_memory(true).dtype(torch::kFloat32)));
+        }
+        auto& device_windows = m_device_windows.emplace_back();
+        device_windows.windows.resize(caller_data->batch_size);
+        device_windows.params.resize(caller_data->batch_size * 4);
+        m_signal_padding = std::max(m_signal_padding, sig_len);
     }
 }
 
 void ModBaseRunner::accept_chunk(int model_id,
                                  int chunk_idx,
                                  const torch::Tensor& signal,
-                                 const std::vector<int8_t>& kmers) {
+                                 const RemoraEncoder& encoder,
+                                 size_t context_hit,
+                                 float signal_offset,
+                                 float signal_scale) {
     // As usual, avoid torch indexing because it is glacially slow.
     // GPU base calling uses float16 signals and input tensors.
     // CPU base calling uses float16 signals, float32 input tensors.
     // Both versions take int8 sequence encodings.
 
     auto& input_sigs = m_input_sigs[model_id];
-    auto& input_seqs = m_input_seqs[model_id];
-    assert(signal.size(0) == input_sigs.size(2));
 
-    const auto sig_len = signal.size(0);
-    dorado::utils::copy_tensor_elems(input_sigs, chunk_idx * sig_len, signal, 0, sig_len);
+    // Encode the kmers straight into the input, or write the bases they're encoded from on the
+    // device, which also gives the window of signal to copy.
+    RemoraEncoder::Context context;
+    if (m_kmers_on_device) {
+        auto& input_bases = m_input_bases[model_id];
+        auto& input_base_ends = m_input_base_ends[model_id];
+        context = encoder.get_context_bases(
+                context_hit, &input_bases.data_ptr<int8_t>()[chunk_idx * input_bases.size(1)],
+                &input_base_ends.data_ptr<int16_t>()[chunk_idx * input_base_ends.size(1)]);
+    } else {
+        auto& input_seqs = m_input_seqs[model_id];
+        const auto kmer_elem_count = input_seqs.size(1) * input_seqs.size(2);
+        if (input_seqs.dtype() != torch::kInt8) {
+            throw std::runtime_error("Unsupported input dtype");
+        }
+        assert(encoder.encoded_context_size() == size_t(kmer_elem_count));
+        using SeqInputType = int8_t;
+        SeqInputType* const input_seqs_ptr = input_seqs.data_ptr<SeqInputType>();
+        context = encoder.get_context(context_hit, &input_seqs_ptr[chunk_idx * kmer_elem_count]);
+    }
+
+    // Where the window overhangs the ends of the read it is padded with zeros.
+    const size_t sig_len = input_sigs.size(2);
+    assert(context.lead_samples_needed + context.num_samples + context.tail_samples_needed ==
+           sig_len);
+
+    if (!signal.device().is_cpu()) {
+        // The window is a view of the uploaded signal, whose padding covers the overhang.
+        auto& device_windows = m_device_windows[model_id];
+        const int64_t window_start = m_signal_padding + int64_t(context.first_sample) -
+                                     int64_t(context.lead_samples_needed);
+        device_windows.windows[chunk_idx] = signal.narrow(0, window_start, sig_len);
+        float* const params = &device_windows.params[chunk_idx * 4];
+        params[0] = signal_offset;
+        params[1] = signal_scale;
+        params[2] = float(context.lead_samples_needed);
+        params[3] = float(sig_len - context.tail_samples_needed);
+        ++device_windows.num_windows;
+        return;
+    }
+
+    const size_t sig_offset = chunk_idx * sig_len;
+    const size_t elem_size = input_sigs.element_size();
+    auto* const input_sigs_ptr = reinterpret_cast<std::byte*>(input_sigs.data_ptr());
+    std::memset(&input_sigs_ptr[sig_offset * elem_size], 0,
+                context.lead_samples_needed * elem_size);
+    dorado::utils::copy_tensor_elems(input_sigs, sig_offset + context.lead_samples_needed, signal,
+                                     context.first_sample, context.num_samples);
+    std::memset(&input_sigs_ptr[(sig_offset + sig_len - context.tail_samples_needed) * elem_size],
+                0, context.tail_samples_needed * elem_size);
+}
+
+int64_t ModBaseRunner::batch_rows(int model_id, int num_chunks) const {
+    // The CPU gains nothing from a few batch shapes, so calls just the chunks.
+    return device().is_cpu() ? int64_t(num_chunks)
+                             : batch_shape_rows(m_input_sigs[model_id].size(0), num_chunks);
+}
 
-    const auto kmer_elem_count = input_seqs.size(1) * input_seqs.size(2);
-    if (input_seqs.dtype() != torch::kInt8) {
-        throw std::runtime_error("Unsupported input dtype");
+std::pair<torch::Tensor, torch::Tensor> ModBaseRunner::batch_inputs(int model_id,
+                                                                    int num_chunks,
+                                                                    int64_t rows) {
+    // Views of the start of the inputs, so only the rows called are copied to the device.
+    torch::Tensor input_seqs;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (m_kmers_on_device) {
+        torch::InferenceMode guard;
+        const auto bases = m_device_input_bases[model_id].narrow(0, 0, rows).copy_(
+                m_input_bases[model_id].narrow(0, 0, rows), /*non_blocking=*/true);
+        const auto base_ends = m_device_input_base_ends[model_id].narrow(0, 0, rows).copy_(
+                m_input_base_ends[model_id].narrow(0, 0, rows), /*non_blocking=*/true);
+        // Encoded in the model's dtype, so it doesn't need casting again.
+        input_seqs = expand_kmer_encoding(bases, base_ends, int(m_input_sigs[model_id].size(2)),
+                                          m_caller->m_options.dtype().toScalarType());
+    } else if (m_stream) {
+        input_seqs = m_device_input_seqs[model_id].narrow(0, 0, rows).copy_(
+                m_input_seqs[model_id].narrow(0, 0, rows), /*non_blocking=*/true);
+    }
+#endif
+    if (!input_seqs.defined()) {
+        input_seqs = m_input_seqs[model_id].narrow(0, 0, rows);
+    }
+    auto& device_windows = m_device_windows[model_id];
+    if (device_windows.num_windows == 0) {
+        auto input_sigs = m_input_sigs[model_id].narrow(0, 0, rows);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (m_stream) {
+            input_sigs = m_device_input_sigs[model_id].narrow(0, 0, rows).copy_(
+                    input_sigs, /*non_blocking=*/true);
+        }
+#endif
+        return {input_sigs, input_seqs};
+    }
+    if (device_windows.num_windows != num_chunks) {
+        throw std::logic_error("Modbase batch mixes host and device signal windows.");
+    }
+
+    torch::InferenceMode guard;
+    const auto& options = m_caller->m_options;
+    const auto sig_len = m_input_sigs[model_id].size(2);
+    auto windows = torch::stack(torch::TensorList(device_windows.windows.data(), num_chunks))
+                           .to(torch::kFloat32);
+    auto params =
+            torch::from_blob(device_windows.params.data(), {num_chunks, 4}).to(options.device());
+    // Rescale each window, and zero the samples beyond the ends of the read.
+    auto positions =
+            torch::arange(sig_len, torch::TensorOptions().device(options.device())).unsqueeze(0);
+    auto in_read = (positions >= params.select(1, 2).unsqueeze(1)) &
+                   (positions < params.select(1, 3).unsqueeze(1));
+    auto scaled =
+            (windows * params.select(1, 1).unsqueeze(1) + params.select(1, 0).unsqueeze(1)) *
+            in_read;
+    auto input_sigs = torch::zeros({rows, 1, sig_len}, options);
+    input_sigs.narrow(0, 0, num_chunks).select(1, 0).copy_(scaled);
+    return {input_sigs, input_seqs};
+}
+
+void ModBaseRunner::release_device_windows(int model_id, int num_chunks) {
+    // The gathering has finished with the uploaded signals, which can now be freed.
+    auto& device_windows = m_device_windows[model_id];
+    if (device_windows.num_windows != 0) {
+        std::fill_n(device_windows.windows.begin(), num_chunks, torch::Tensor());
+        device_windows.num_windows = 0;
     }
-    using SeqInputType = int8_t;
-    SeqInputType* const input_seqs_ptr = input_seqs.data_ptr<SeqInputType>();
-    std::memcpy(&input_seqs_ptr[chunk_idx * kmer_elem_count], kmers.data(),
-                kmer_elem_count * sizeof(SeqInputType));
 }
 
 torch::Tensor ModBaseRunner::call_chunks(int model_id, int num_chunks) {
-    return m_caller->call_chunks(model_id, m_input_sigs[model_id], m_input_seqs[model_id],
-                                 num_chunks);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    // Uploads and gathers are queued on the runner's stream, which the model's stream waits for,
+    // and the model's stream is synchronised once the batch is called, so the buffers can be
+    // reused.
+    c10::cuda::OptionalCUDAStreamGuard stream_guard(m_stream);
+#endif
+    const auto [input_sigs, input_seqs] =
+            batch_inputs(model_id, num_chunks, batch_rows(model_id, num_chunks));
+    const auto output = m_stream ? m_output_scores[model_id] : torch::Tensor();
+    auto scores =
+            m_caller->call_chunks(model_id, input_sigs, input_seqs, num_chunks, output, m_stream);
+    release_device_windows(model_id, num_chunks);
+    return scores;
+}
+
+std::vector<torch::Tensor> ModBaseRunner::call_fused_chunks(
+        const std::vector<int>& model_ids,
+        const std::vector<std::vector<int64_t>>& model_rows,
+        int num_chunks) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    c10::cuda::OptionalCUDAStreamGuard stream_guard(m_stream);
+#endif
+    // The whole batch is uploaded, or gathered, into the first model's buffers once.
+    const int first_id = model_ids.front();
+    const auto [input_sigs, input_seqs] =
+            batch_inputs(first_id, num_chunks, batch_rows(first_id, num_chunks));
+
+    std::vector<torch::Tensor> scores(model_ids.size());
+    for (size_t i = 0; i < model_ids.size(); ++i) {
+        const int model_id = model_ids[i];
+        const auto& rows = model_rows[i];
+        if (rows.empty()) {
+            continue;
+        }
+        // Each model's rows are picked out on the device, padded out to one of its batch
+        // shapes with copies of its first row.
+        const int num_model_chunks = int(rows.size());
+        std::vector<int64_t> index(size_t(batch_rows(model_id, num_model_chunks)), rows.front());
+        std::copy(rows.begin(), rows.end(), index.begin());
+        torch::Tensor model_sigs;
+        torch::Tensor model_seqs;
+        {
+            torch::InferenceMode guard;
+            const auto device_index =
+                    torch::from_blob(index.data(), {int64_t(index.size())}, torch::kInt64)
+                            .to(input_sigs.device());
+            model_sigs = input_sigs.index_select(0, device_index);
+            model_seqs = input_seqs.index_select(0, device_index);
+        }
+        const auto output = m_stream ? m_output_scores[model_id] : torch::Tensor();
+        scores[i] = m_caller->call_chunks(model_id, model_sigs, model_seqs, num_model_chunks,
+                                          output, m_stream);
+    }
+    release_device_windows(first_id, num_chunks);
+    return scores;
+}
+
+void ModBaseRunner::encode_kmers_on_device(size_t block_stride) {
+    const auto device = m_caller->m_options.device();
+    if (!device.is_cuda()) {
+        throw std::logic_error("Modbase kmers can only be encoded on a CUDA device.");
+    }
+    m_kmers_on_device = true;
+    const auto pinned_options = torch::TensorOptions().pinned_memory(true);
+    for (size_t model_id = 0; model_id < m_input_sigs.size(); ++model_id) {
+        const auto batch_size = m_input_sigs[model_id].size(0);
+        const auto sig_len = m_input_sigs[model_id].size(2);
+        const auto kmer_len = m_input_seqs[model_id].size(2) / RemoraUtils::NUM_BASES;
+        const auto max_bases =
+                int64_t(RemoraEncoder::max_context_bases(block_stride, size_t(sig_len)));
+        m_input_bases.push_back(torch::empty({batch_size, max_bases + kmer_len - 1},
+                                             pinned_options.dtype(torch::kInt8)));
+        m_input_base_ends.push_back(
+                torch::empty({batch_size, max_bases}, pinned_options.dtype(torch::kInt16)));
+        m_device_input_bases.push_back(
+                torch::empty(m_input_bases.back().sizes(),
+                             torch::TensorOptions().device(device).dtype(torch::kInt8)));
+        m_device_input_base_ends.push_back(
+                torch::empty(m_input_base_ends.back().sizes(),
+                             torch::TensorOptions().device(device).dtype(torch::kInt16)));
+        // The encodings are no longer staged on the host.
+        m_input_seqs[model_id] = torch::empty({0, sig_len, kmer_len * RemoraUtils::NUM_BASES},
+                                              torch::kInt8);
+        m_device_input_seqs[model_id] = torch::Tensor();
+    }
 }
 
 torch::Tensor ModBaseRunner::scale_signal(size_t caller_id,
@@ -347,8 +670,39 @@ torch::Tensor ModBaseRunner::scale_signal(size_t caller_id,
     return signal;
 }
 
-std::vector<size_t> ModBaseRunner::get_motif_hits(size_t caller_id, const std::string& seq) const {
-    return m_caller->m_caller_data[caller_id]->get_motif_hits(seq);
+std::pair<float, float> ModBaseRunner::signal_offset_scale(
+        size_t caller_id,
+        const torch::Tensor& signal,
+        const std::vector<int>& seq_ints,
+        const std::vector<uint64_t>& seq_to_sig_map) const {
+    auto& scaler = m_caller->m_caller_data[caller_id]->scaler;
+    if (scaler) {
+        return scaler->signal_offset_scale(signal, seq_ints, seq_to_sig_map);
+    }
+    return {0.f, 1.f};
+}
+
+torch::Tensor ModBaseRunner::upload_signal(const torch::Tensor& signal) const {
+    auto padded_signal = torch::constant_pad_nd(signal, {m_signal_padding, m_signal_padding});
+    const auto device = m_caller->m_options.device();
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (device.is_cuda()) {
+        // Copy on a stream of its own and wait for it, so the signal is ready for whichever
+        // stream gathers from it.
+        c10::cuda::CUDAStreamGuard stream_guard(
+                c10::cuda::getStreamFromPool(false, device.index()));
+        auto device_signal = padded_signal.to(device);
+        c10::cuda::getCurrentCUDAStream().synchronize();
+        return device_signal;
+    }
+#endif
+    return padded_signal.to(device);
+}
+
+torch::Device ModBaseRunner::device() const { return m_caller->m_options.device(); }
+
+std::vector<std::vector<size_t>> ModBaseRunner::get_motif_hits(const std::string& seq) const {
+    return m_caller->get_motif_hits(seq);
 }
 
 ModBaseParams& ModBaseRunner::caller_params(size_t caller_id) const {
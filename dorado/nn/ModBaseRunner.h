@@ -7,11 +7,13 @@
 #include <atomic>
 #include <filesystem>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace dorado {
 
 class ModBaseCaller;
+class RemoraEncoder;
 
 struct ModBaseParams {
     std::vector<std::string> mod_long_names;  ///< The long names of the modified bases.
@@ -40,16 +42,47 @@ std::shared_ptr<ModBaseCaller> create_modbase_caller(
 class ModBaseRunner {
 public:
     explicit ModBaseRunner(std::shared_ptr<ModBaseCaller> caller);
+    // Writes a chunk into the model's input: the kmer encoding of the context around
+    // context_hit, and the window of the read's signal that the context covers.
+    // A signal from upload_signal() stays on the device, and its window is gathered there and
+    // rescaled by signal_scale and signal_offset when the batch is called.
     void accept_chunk(int model_id,
                       int chunk_idx,
                       const torch::Tensor& signal,
-                      const std::vector<int8_t>& kmers);
+                      const RemoraEncoder& encoder,
+                      size_t context_hit,
+                      float signal_offset = 0.f,
+                      float signal_scale = 1.f);
     torch::Tensor call_chunks(int model_id, int num_chunks);
+    // Calls a batch holding the chunks of several models whose inputs are the same shape, all
+    // accepted into the first model's input.  The batch is uploaded, or its signal windows
+    // gathered, once, and each model is then called in turn on its own rows of the batch,
+    // model_rows, picked out on the device.  Returns each model's scores, in the order of its
+    // rows, or an undefined tensor for a model with none.
+    std::vector<torch::Tensor> call_fused_chunks(
+            const std::vector<int>& model_ids,
+            const std::vector<std::vector<int64_t>>& model_rows,
+            int num_chunks);
+    // From now on, send each chunk's kmers to the CUDA device as the bases they are taken from
+    // and where each base's samples end, and one-hot encode them there, rather than uploading
+    // the encoding.  block_stride is that of the encoders the chunks are accepted with.
+    void encode_kmers_on_device(size_t block_stride);
     torch::Tensor scale_signal(size_t caller_id,
                                torch::Tensor signal,
                                const std::vector<int>& seq_ints,
                                const std::vector<uint64_t>& seq_to_sig_map) const;
-    std::vector<size_t> get_motif_hits(size_t caller_id, const std::string& seq) const;
+    // The offset and scale which scale_signal() applies, as signal * scale + offset.
+    std::pair<float, float> signal_offset_scale(size_t caller_id,
+                                                const torch::Tensor& signal,
+                                                const std::vector<int>& seq_ints,
+                                                const std::vector<uint64_t>& seq_to_sig_map) const;
+    // Copies a read's unscaled signal to the device, padded so that the windows of all its
+    // contexts lie within it, for every model's chunks of the read to be gathered from.
+    torch::Tensor upload_signal(const torch::Tensor& signal) const;
+    torch::Device device() const;
+    // The position of the canonical base of every occurrence of each caller's motif in seq,
+    // found for all the callers in one pass.
+    std::vector<std::vector<size_t>> get_motif_hits(const std::string& seq) const;
     ModBaseParams& caller_params(size_t caller_id) const;
     size_t num_callers() const;
     void terminate();
@@ -57,9 +90,45 @@ public:
     stats::NamedStats sample_stats() const;
 
 private:
+    // Rows a batch of num_chunks of the model's chunks is called with.
+    int64_t batch_rows(int model_id, int num_chunks) const;
+    // The first rows of the model's inputs, with its batch of num_chunks chunks, on the device
+    // the model is called on.  On a CUDA device they are uploaded or gathered on m_stream,
+    // which must be current.
+    std::pair<torch::Tensor, torch::Tensor> batch_inputs(int model_id,
+                                                         int num_chunks,
+                                                         int64_t rows);
+    // Lets go of the uploaded signals the model's batch was gathered from, once it is called.
+    void release_device_windows(int model_id, int num_chunks);
+
     std::shared_ptr<ModBaseCaller> m_caller;
     std::vector<torch::Tensor> m_input_sigs;
     std::vector<torch::Tensor> m_input_seqs;
+    // On a CUDA device, the stream each model's pinned inputs are uploaded on, into device
+    // buffers, while other runners' batches are called, and the pinned buffers each model's
+    // scores are copied back into.
+    c10::optional<c10::Stream> m_stream;
+    std::vector<torch::Tensor> m_device_input_sigs;
+    std::vector<torch::Tensor> m_device_input_seqs;
+    std::vector<torch::Tensor> m_output_scores;
+    // With kmers encoded on the device, each model's chunks' bases and base ends, in pinned
+    // buffers and the device buffers they are uploaded into.
+    bool m_kmers_on_device{false};
+    std::vector<torch::Tensor> m_input_bases;
+    std::vector<torch::Tensor> m_input_base_ends;
+    std::vector<torch::Tensor> m_device_input_bases;
+    std::vector<torch::Tensor> m_device_input_base_ends;
+
+    // Windows of uploaded signals accepted into each model's batch, to be gathered on the device.
+    struct DeviceWindows {
+        std::vector<torch::Tensor> windows;
+        // Per chunk: offset, scale, and the range of the window within the read.
+        std::vector<float> params;
+        int num_windows{0};
+    };
+    std::vector<DeviceWindows> m_device_windows;
+    // Zeros either side of an uploaded signal, enough for the widest context of any model.
+    int64_t m_signal_padding{0};
 
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
@@ -2,8 +2,11 @@
 
 #include "../decode/Decoder.h"
 #include "CRFModel.h"
+#include "utils/numa_utils.h"
 #include "utils/stats.h"
 #include "utils/stitch.h"
+#include "utils/tensor_utils.h"
+#include "utils/trace.h"
 
 #include <spdlog/spdlog.h>
 #include <toml.hpp>
@@ -16,11 +19,15 @@ namespace dorado {
 
 class ModelRunnerBase {
 public:
-    virtual void accept_chunk(int chunk_idx, const torch::Tensor &chunk) = 0;
+    // Copies a chunk from each source into consecutive batch entries from first_chunk_idx.
+    virtual void accept_chunks(int first_chunk_idx,
+                               const std::vector<utils::ChunkSource> &chunks) = 0;
     virtual std::vector<DecodedChunk> call_chunks(int num_chunks) = 0;
     virtual size_t model_stride() const = 0;
     virtual size_t chunk_size() const = 0;
     virtual size_t batch_size() const = 0;
+    // NUMA node local to the runner's device, or -1 if there is none or it isn't known.
+    virtual int numa_node() const { return -1; }
     virtual void terminate() = 0;
     virtual std::string get_name() const = 0;
     virtual stats::NamedStats sample_stats() const = 0;
@@ -31,15 +38,19 @@ using Runner = std::shared_ptr<ModelRunnerBase>;
 template <typename T>
 class ModelRunner final : public ModelRunnerBase {
 public:
+    // With a numa_node, the runner's batch is placed on that node, and it reports the node so
+    // that the thread driving it is bound there.
     ModelRunner(const CRFModelConfig &model_config,
                 const std::string &device,
                 int chunk_size,
-                int batch_size);
-    void accept_chunk(int chunk_idx, const torch::Tensor &chunk) final;
+                int batch_size,
+                int numa_node = -1);
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource> &chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final { return m_model_stride; }
     size_t chunk_size() const final { return m_input.size(2); }
     size_t batch_size() const final { return m_input.size(0); }
+    int numa_node() const final { return m_numa_node; }
     void terminate() final {}
     std::string get_name() const final { return "ModelRunner"; }
     stats::NamedStats sample_stats() const final;
@@ -51,6 +62,7 @@ private:
     DecoderOptions m_decoder_options;
     torch::nn::ModuleHolder<torch::nn::AnyModule> m_module{nullptr};
     size_t m_model_stride;
+    int m_numa_node;
 
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
@@ -62,7 +74,9 @@ template <typename T>
 ModelRunner<T>::ModelRunner(const CRFModelConfig &model_config,
                             const std::string &device,
                             int chunk_size,
-                            int batch_size) {
+                            int batch_size,
+                            int numa_node)
+        : m_numa_node(numa_node) {
     m_model_stride = static_cast<size_t>(model_config.stride);
 
     m_decoder_options = DecoderOptions();
@@ -76,6 +90,8 @@ ModelRunner<T>::ModelRunner(const CRFModelConfig &model_config,
     // adjust chunk size to be a multiple of the stride
     chunk_size -= chunk_size % m_model_stride;
 
+    // Zeroing the batch touches it, placing it on the runner's node.
+    utils::ScopedNumaBinding numa_binding(m_numa_node);
     m_input = torch::zeros({batch_size, 1, chunk_size},
                            torch::TensorOptions().dtype(T::dtype).device(torch::kCPU));
 }
@@ -84,9 +100,19 @@ template <typename T>
 std::vector<DecodedChunk> ModelRunner<T>::call_chunks(int num_chunks) {
     torch::InferenceMode guard;
     dorado::stats::Timer timer;
-    auto scores = m_module->forward(m_input.to(m_options.device_opt().value()));
+    torch::Tensor scores;
+    {
+        DORADO_TRACE_SCOPE("model_forward");
+        // Only the chunks are called, since the scores of the rest of the batch aren't decoded.
+        scores = m_module->forward(
+                m_input.narrow(0, 0, num_chunks).to(m_options.device_opt().value()));
+    }
     const auto forward_ms = timer.GetElapsedMS();
-    auto decoded_chunks = m_decoder->beam_search(scores, num_chunks, m_decoder_options);
+    std::vector<DecodedChunk> decoded_chunks;
+    {
+        DORADO_TRACE_SCOPE("decode");
+        decoded_chunks = m_decoder->beam_search(scores, num_chunks, m_decoder_options);
+    }
     const auto forward_plus_decode_ms = timer.GetElapsedMS();
     ++m_num_batches_called;
     m_model_ms += forward_ms;
@@ -95,8 +121,9 @@ std::vector<DecodedChunk> ModelRunner<T>::call_chunks(int num_chunks) {
 }
 
 template <typename T>
-void ModelRunner<T>::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
-    m_input.index_put_({chunk_idx, 0}, chunk);
+void ModelRunner<T>::accept_chunks(int first_chunk_idx,
+                                   const std::vector<utils::ChunkSource> &chunks) {
+    utils::gather_chunks(m_input, first_chunk_idx, chunks);
 }
 
 template <typename T>
@@ -69,7 +69,8 @@ struct RemoraConvModelImpl : Module {
         sigs = sig_conv2(sigs);
         sigs = sig_conv3(sigs);
 
-        // We are supplied one hot encoded sequences as (batch, signal, kmer_len * base_count) int8.
+        // We are supplied one hot encoded sequences as (batch, signal, kmer_len * base_count) int8,
+        // or already in the weights' dtype if they were encoded on the device.
         // We need (batch, kmer_len * base_count, signal) and a dtype compatible with the float16
         // weights.
         const auto conv_dtype = (seqs.device() == torch::kCPU) ? torch::kFloat32 : torch::kFloat16;
@@ -157,7 +158,8 @@ struct RemoraConvLSTMModelImpl : Module {
         sigs = sig_conv2(sigs);
         sigs = sig_conv3(sigs);
 
-        // We are supplied one hot encoded sequences as (batch, signal, kmer_len * base_count) int8.
+        // We are supplied one hot encoded sequences as (batch, signal, kmer_len * base_count) int8,
+        // or already in the weights' dtype if they were encoded on the device.
         // We need (batch, kmer_len * base_count, signal) and a dtype compatible with the float16
         // weights.
         const auto conv_dtype = (seqs.device() == torch::kCPU) ? torch::kFloat32 : torch::kFloat16;
@@ -234,27 +236,30 @@ TORCH_MODULE(RemoraConvLSTMModel);
 
 ModuleHolder<AnyModule> load_remora_model(const std::filesystem::path& model_path,
                                           torch::TensorOptions options) {
-    auto config = toml::parse(model_path / "config.toml");
-
-    const auto& general_params = toml::find(config, "general");
-    const auto model_type = toml::find<std::string>(general_params, "model");
-
-    const auto& model_params = toml::find(config, "model_params");
-    const auto size = toml::find<int>(model_params, "size");
-    const auto kmer_len = toml::find<int>(model_params, "kmer_len");
-    const auto num_out = toml::find<int>(model_params, "num_out");
-
-    if (model_type == "conv_lstm") {
-        auto model = nn::RemoraConvLSTMModel(size, kmer_len, num_out);
-        return populate_model(model, model_path, options);
-    }
-
-    if (model_type == "conv_only") {
-        auto model = nn::RemoraConvModel(size, kmer_len, num_out);
-        return populate_model(model, model_path, options);
-    }
-
-    throw std::runtime_error("Unknown model type in config file.");
+    const auto key = utils::shared_module_key("remora", model_path, options);
+    return utils::load_shared_module(key, [&]() -> ModuleHolder<AnyModule> {
+        auto config = toml::parse(model_path / "config.toml");
+
+        const auto& general_params = toml::find(config, "general");
+        const auto model_type = toml::find<std::string>(general_params, "model");
+
+        const auto& model_params = toml::find(config, "model_params");
+        const auto size = toml::find<int>(model_params, "size");
+        const auto kmer_len = toml::find<int>(model_params, "kmer_len");
+        const auto num_out = toml::find<int>(model_params, "num_out");
+
+        if (model_type == "conv_lstm") {
+            auto model = nn::RemoraConvLSTMModel(size, kmer_len, num_out);
+            return populate_model(model, model_path, options);
+        }
+
+        if (model_type == "conv_only") {
+            auto model = nn::RemoraConvModel(size, kmer_len, num_out);
+            return populate_model(model, model_path, options);
+        }
+
+        throw std::runtime_error("Unknown model type in config file.");
+    });
 }
 
 }  // namespace dorado
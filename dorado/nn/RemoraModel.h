@@ -6,6 +6,7 @@
 
 namespace dorado {
 
+// Callers loading the same model onto the same device share one module, and its weights.
 torch::nn::ModuleHolder<torch::nn::AnyModule> load_remora_model(
         const std::filesystem::path& model_path,
         torch::TensorOptions options);
@@ -0,0 +1,239 @@
+#include "ReplayRunner.h"
+
+#include "../decode/fast_hash.h"
+
+#include <torch/csrc/jit/serialization/pickle.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace dorado {
+
+namespace {
+
+constexpr uint64_t kKeySeed = 0x7e91a7;
+
+torch::Tensor load_tensor(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open model output recording " + path.string());
+    }
+    const std::vector<char> bytes((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+    return torch::jit::pickle_load(bytes).toTensor();
+}
+
+}  // namespace
+
+ModelOutputRecording::ModelOutputRecording(const fs::path& dir) {
+    const auto keys = load_tensor(dir / "keys.tensor");
+    const auto seq_lengths = load_tensor(dir / "seq_lengths.tensor");
+    const auto num_moves = load_tensor(dir / "num_moves.tensor");
+    const auto seqs = load_tensor(dir / "seqs.tensor");
+    const auto qstrings = load_tensor(dir / "qstrings.tensor");
+    const auto moves = load_tensor(dir / "moves.tensor");
+    const auto runners = load_tensor(dir / "runners.tensor");
+    if (seq_lengths.numel() != keys.numel() || num_moves.numel() != keys.numel() ||
+        seq_lengths.sum().item<int64_t>() != seqs.numel() || qstrings.numel() != seqs.numel() ||
+        num_moves.sum().item<int64_t>() != moves.numel() || runners.size(0) < 1) {
+        throw std::runtime_error("Inconsistent model output recording " + dir.string());
+    }
+
+    m_model_stride = size_t(load_tensor(dir / "stride.tensor").item<int64_t>());
+    for (int64_t i = 0; i < runners.size(0); ++i) {
+        m_runners.push_back({size_t(runners[i][0].item<int64_t>()),
+                             size_t(runners[i][1].item<int64_t>())});
+    }
+
+    const auto* seq_data = reinterpret_cast<const char*>(seqs.data_ptr<uint8_t>());
+    const auto* qstring_data = reinterpret_cast<const char*>(qstrings.data_ptr<uint8_t>());
+    const auto* move_data = moves.data_ptr<uint8_t>();
+    size_t seq_offset = 0;
+    size_t move_offset = 0;
+    const auto* key_data = keys.data_ptr<int64_t>();
+    const auto* seq_length_data = seq_lengths.data_ptr<int64_t>();
+    const auto* num_moves_data = num_moves.data_ptr<int64_t>();
+    for (int64_t i = 0; i < keys.numel(); ++i) {
+        const auto seq_length = size_t(seq_length_data[i]);
+        const auto chunk_moves = size_t(num_moves_data[i]);
+        DecodedChunk chunk;
+        chunk.sequence.assign(seq_data + seq_offset, seq_length);
+        chunk.qstring.assign(qstring_data + seq_offset, seq_length);
+        chunk.moves.assign(move_data + move_offset, move_data + move_offset + chunk_moves);
+        m_chunks.emplace(uint64_t(key_data[i]), std::move(chunk));
+        seq_offset += seq_length;
+        move_offset += chunk_moves;
+    }
+}
+
+void ModelOutputRecording::save(const fs::path& dir) const {
+    std::lock_guard lock(m_mutex);
+    std::vector<int64_t> keys, seq_lengths, num_moves;
+    std::vector<uint8_t> seqs, qstrings, moves;
+    for (const auto& [key, chunk] : m_chunks) {
+        keys.push_back(int64_t(key));
+        seq_lengths.push_back(int64_t(chunk.sequence.size()));
+        num_moves.push_back(int64_t(chunk.moves.size()));
+        seqs.insert(seqs.end(), chunk.sequence.begin(), chunk.sequence.end());
+        qstrings.insert(qstrings.end(), chunk.qstring.begin(), chunk.qstring.end());
+        moves.insert(moves.end(), chunk.moves.begin(), chunk.moves.end());
+    }
+    std::vector<int64_t> runners;
+    for (const auto& shape : m_runners) {
+        runners.push_back(int64_t(shape.chunk_size));
+        runners.push_back(int64_t(shape.batch_size));
+    }
+
+    auto to_tensor = [](auto& values, torch::ScalarType dtype) {
+        return torch::from_blob(values.data(), {int64_t(values.size())}, dtype).clone();
+    };
+    fs::create_directories(dir);
+    utils::serialise_tensor(to_tensor(keys, torch::kInt64), (dir / "keys.tensor").string());
+    utils::serialise_tensor(to_tensor(seq_lengths, torch::kInt64),
+                            (dir / "seq_lengths.tensor").string());
+    utils::serialise_tensor(to_tensor(num_moves, torch::kInt64),
+                            (dir / "num_moves.tensor").string());
+    utils::serialise_tensor(to_tensor(seqs, torch::kUInt8), (dir / "seqs.tensor").string());
+    utils::serialise_tensor(to_tensor(qstrings, torch::kUInt8), (dir / "qstrings.tensor").string());
+    utils::serialise_tensor(to_tensor(moves, torch::kUInt8), (dir / "moves.tensor").string());
+    utils::serialise_tensor(to_tensor(runners, torch::kInt64).view({-1, 2}),
+                            (dir / "runners.tensor").string());
+    utils::serialise_tensor(torch::tensor(int64_t(m_model_stride)),
+                            (dir / "stride.tensor").string());
+}
+
+void ModelOutputRecording::add_runner(const RunnerShape& shape, size_t model_stride) {
+    std::lock_guard lock(m_mutex);
+    m_runners.push_back(shape);
+    m_model_stride = model_stride;
+}
+
+void ModelOutputRecording::add(uint64_t key, DecodedChunk chunk) {
+    std::lock_guard lock(m_mutex);
+    m_chunks.emplace(key, std::move(chunk));
+}
+
+std::optional<DecodedChunk> ModelOutputRecording::find(uint64_t key) const {
+    std::lock_guard lock(m_mutex);
+    auto it = m_chunks.find(key);
+    if (it == m_chunks.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+size_t ModelOutputRecording::size() const {
+    std::lock_guard lock(m_mutex);
+    return m_chunks.size();
+}
+
+std::vector<ModelOutputRecording::RunnerShape> ModelOutputRecording::runners() const {
+    std::lock_guard lock(m_mutex);
+    return m_runners;
+}
+
+size_t ModelOutputRecording::model_stride() const {
+    std::lock_guard lock(m_mutex);
+    return m_model_stride;
+}
+
+uint64_t ModelOutputRecording::chunk_key(const utils::ChunkSource& source, size_t chunk_size) {
+    // Chunks running off the end of their signal are padded from the samples they have, so
+    // those samples determine the chunk.
+    const auto& signal = *source.signal;
+    const int64_t num_samples = signal.size(-1);
+    const int64_t length = std::min(int64_t(chunk_size), num_samples - int64_t(source.offset));
+    const auto samples = signal.narrow(-1, int64_t(source.offset), length).contiguous();
+    uint64_t key = fasthash64(samples.data_ptr(), samples.nbytes(), kKeySeed);
+    key = chainfasthash64(key, chunk_size);
+    return chainfasthash64(key, source.num_decode_steps);
+}
+
+RecordingRunner::RecordingRunner(Runner runner, std::shared_ptr<ModelOutputRecording> recording)
+        : m_runner(std::move(runner)),
+          m_recording(std::move(recording)),
+          m_keys(m_runner->batch_size()) {
+    m_recording->add_runner({m_runner->chunk_size(), m_runner->batch_size()},
+                            m_runner->model_stride());
+}
+
+void RecordingRunner::accept_chunks(int first_chunk_idx,
+                                    const std::vector<utils::ChunkSource>& chunks) {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        m_keys[first_chunk_idx + i] = ModelOutputRecording::chunk_key(chunks[i], chunk_size());
+    }
+    m_runner->accept_chunks(first_chunk_idx, chunks);
+}
+
+std::vector<DecodedChunk> RecordingRunner::call_chunks(int num_chunks) {
+    auto decoded_chunks = m_runner->call_chunks(num_chunks);
+    for (int i = 0; i < num_chunks; ++i) {
+        m_recording->add(m_keys[i], decoded_chunks[i]);
+    }
+    return decoded_chunks;
+}
+
+ReplayRunner::ReplayRunner(std::shared_ptr<const ModelOutputRecording> recording,
+                           const ModelOutputRecording::RunnerShape& shape,
+                           double chunks_per_s)
+        : m_recording(std::move(recording)), m_shape(shape), m_keys(shape.batch_size) {
+    if (chunks_per_s > 0.) {
+        m_batch_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(double(shape.batch_size) / chunks_per_s));
+    }
+}
+
+void ReplayRunner::accept_chunks(int first_chunk_idx,
+                                 const std::vector<utils::ChunkSource>& chunks) {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        m_keys[first_chunk_idx + i] = ModelOutputRecording::chunk_key(chunks[i], chunk_size());
+    }
+}
+
+std::vector<DecodedChunk> ReplayRunner::call_chunks(int num_chunks) {
+    const auto end_time = std::chrono::steady_clock::now() + m_batch_duration;
+    std::vector<DecodedChunk> decoded_chunks;
+    decoded_chunks.reserve(num_chunks);
+    for (int i = 0; i < num_chunks; ++i) {
+        auto chunk = m_recording->find(m_keys[i]);
+        if (!chunk) {
+            throw std::runtime_error(
+                    "Model output recording has no output for a chunk. It must be replayed with "
+                    "the data and settings it was recorded with.");
+        }
+        decoded_chunks.push_back(std::move(*chunk));
+    }
+    std::this_thread::sleep_until(end_time);
+    ++m_num_batches_called;
+    return decoded_chunks;
+}
+
+stats::NamedStats ReplayRunner::sample_stats() const {
+    stats::NamedStats stats;
+    stats["batches_called"] = m_num_batches_called;
+    return stats;
+}
+
+void record_runners(std::vector<Runner>& runners,
+                    const std::shared_ptr<ModelOutputRecording>& recording) {
+    for (auto& runner : runners) {
+        runner = std::make_shared<RecordingRunner>(std::move(runner), recording);
+    }
+}
+
+std::vector<Runner> create_replay_runners(
+        const std::shared_ptr<const ModelOutputRecording>& recording,
+        double chunks_per_s) {
+    std::vector<Runner> runners;
+    for (const auto& shape : recording->runners()) {
+        runners.push_back(std::make_shared<ReplayRunner>(recording, shape, chunks_per_s));
+    }
+    return runners;
+}
+
+}  // namespace dorado
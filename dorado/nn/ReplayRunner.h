@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ModelRunner.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dorado {
+
+// The decoded chunks a dataset's basecall runners produced, keyed by each chunk's input, so
+// that the rest of the pipeline can be run again without the model, e.g. to profile or
+// benchmark the CPU stages on machines without a GPU.  Thread-safe.
+class ModelOutputRecording {
+public:
+    struct RunnerShape {
+        size_t chunk_size;
+        size_t batch_size;
+    };
+
+    ModelOutputRecording() = default;
+    // Loads a recording saved to dir.  Throws if it can't be read.
+    explicit ModelOutputRecording(const std::filesystem::path& dir);
+
+    // Saves the recording to dir, as serialised tensors.
+    void save(const std::filesystem::path& dir) const;
+
+    void add_runner(const RunnerShape& shape, size_t model_stride);
+    void add(uint64_t key, DecodedChunk chunk);
+    std::optional<DecodedChunk> find(uint64_t key) const;
+    size_t size() const;
+
+    // Chunk sizes and batch sizes of the recorded runners, one entry per runner.
+    std::vector<RunnerShape> runners() const;
+    size_t model_stride() const;
+
+    // Key of a chunk of chunk_size samples from the source, decoded as far as the source says.
+    static uint64_t chunk_key(const utils::ChunkSource& source, size_t chunk_size);
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, DecodedChunk> m_chunks;
+    std::vector<RunnerShape> m_runners;
+    size_t m_model_stride{0};
+};
+
+// Calls chunks with another runner, adding the decoded chunks to a recording.
+class RecordingRunner final : public ModelRunnerBase {
+public:
+    RecordingRunner(Runner runner, std::shared_ptr<ModelOutputRecording> recording);
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource>& chunks) final;
+    std::vector<DecodedChunk> call_chunks(int num_chunks) final;
+    size_t model_stride() const final { return m_runner->model_stride(); }
+    size_t chunk_size() const final { return m_runner->chunk_size(); }
+    size_t batch_size() const final { return m_runner->batch_size(); }
+    int numa_node() const final { return m_runner->numa_node(); }
+    void terminate() final { m_runner->terminate(); }
+    std::string get_name() const final { return m_runner->get_name(); }
+    stats::NamedStats sample_stats() const final { return m_runner->sample_stats(); }
+
+private:
+    Runner m_runner;
+    std::shared_ptr<ModelOutputRecording> m_recording;
+    // Key of the chunk in each batch entry.
+    std::vector<uint64_t> m_keys;
+};
+
+// Serves the decoded chunks of a recording back in place of a model.  If chunks_per_s is
+// non-zero, each batch takes as long as a full batch would at that rate, as a stand-in for the
+// device.  Throws if a chunk wasn't recorded.
+class ReplayRunner final : public ModelRunnerBase {
+public:
+    ReplayRunner(std::shared_ptr<const ModelOutputRecording> recording,
+                 const ModelOutputRecording::RunnerShape& shape,
+                 double chunks_per_s);
+    void accept_chunks(int first_chunk_idx, const std::vector<utils::ChunkSource>& chunks) final;
+    std::vector<DecodedChunk> call_chunks(int num_chunks) final;
+    size_t model_stride() const final { return m_recording->model_stride(); }
+    size_t chunk_size() const final { return m_shape.chunk_size; }
+    size_t batch_size() const final { return m_shape.batch_size; }
+    void terminate() final {}
+    std::string get_name() const final { return "ReplayRunner"; }
+    stats::NamedStats sample_stats() const final;
+
+private:
+    std::shared_ptr<const ModelOutputRecording> m_recording;
+    ModelOutputRecording::RunnerShape m_shape;
+    std::chrono::steady_clock::duration m_batch_duration{0};
+    std::vector<uint64_t> m_keys;
+
+    std::atomic<int64_t> m_num_batches_called = 0;
+};
+
+// Wraps each of the runners to record its outputs.
+void record_runners(std::vector<Runner>& runners,
+                    const std::shared_ptr<ModelOutputRecording>& recording);
+// One replay runner for each runner the recording was made with.
+std::vector<Runner> create_replay_runners(
+        const std::shared_ptr<const ModelOutputRecording>& recording,
+        double chunks_per_s);
+
+}  // namespace dorado
@@ -1,6 +1,8 @@
 #include "Runners.h"
 
 #include "decode/CPUDecoder.h"
+#include "utils/numa_utils.h"
+#include "utils/parameters.h"
 
 #if DORADO_GPU_BUILD
 #ifdef __APPLE__
@@ -11,23 +13,78 @@
 #endif
 #endif  // DORADO_GPU_BUILD
 
+#include <algorithm>
+#include <future>
+#include <stdexcept>
 #include <thread>
 
 namespace dorado {
 
+namespace {
+
+// Batch size of CPU runners spilling over GPUs.  Small, so that chunks spilled to the CPU
+// don't hold up their reads for long after the GPUs have called the rest.
+constexpr int kCpuSpillBatchSize = 32;
+
+}  // namespace
+
+std::pair<std::string, size_t> split_cpu_spill_device(const std::string& device) {
+    const auto pos = device.find(",cpu");
+    if (pos == std::string::npos) {
+        return {device, 0};
+    }
+    const auto cpu_part = device.substr(pos + 1);
+    if (cpu_part == "cpu") {
+        return {device.substr(0, pos), std::max(1u, std::thread::hardware_concurrency())};
+    }
+    size_t num_cpu_runners = 0;
+    try {
+        size_t num_chars = 0;
+        if (cpu_part.substr(0, 4) == "cpu:") {
+            num_cpu_runners = std::stoul(cpu_part.substr(4), &num_chars);
+        }
+        if (num_chars != cpu_part.size() - 4) {
+            num_cpu_runners = 0;
+        }
+    } catch (const std::exception&) {
+        num_cpu_runners = 0;
+    }
+    if (num_cpu_runners == 0) {
+        throw std::runtime_error("Invalid CPU runners in device string: " + device);
+    }
+    return {device.substr(0, pos), num_cpu_runners};
+}
+
 std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
         const dorado::CRFModelConfig& model_config,
-        const std::string& device,
+        const std::string& device_list,
         size_t num_runners,
         size_t batch_size,
         size_t chunk_size,
         float memory_fraction,
-        bool guard_gpus) {
+        bool guard_gpus,
+        size_t num_cuda_streams,
+        bool use_cuda_graphs,
+        bool metal_viterbi_decode,
+        size_t overlap,
+        bool use_workspace_arena) {
     std::vector<dorado::Runner> runners;
+    const auto [device, num_cpu_runners] = split_cpu_spill_device(device_list);
 
     // Default is 1 device.  CUDA path may alter this.
     int num_devices = 1;
 
+    const bool auto_chunk_size = chunk_size == 0;
+    const bool cuda_device = device != "cpu" && device != "metal";
+    if (num_cpu_runners != 0 && !cuda_device) {
+        throw std::runtime_error("CPU runners can only be added to CUDA devices: " +
+                                 device_list);
+    }
+    if (auto_chunk_size && !cuda_device) {
+        chunk_size = default_parameters.chunksize;
+        spdlog::debug("- auto chunk size is only supported on CUDA, using {}", chunk_size);
+    }
+
     if (device == "cpu") {
         num_runners = std::thread::hardware_concurrency();
         if (batch_size == 0) {
@@ -36,15 +93,22 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
         spdlog::debug("- CPU calling: set batch size to {}, num_runners to {}", batch_size,
                       num_runners);
 
+        // Spread the runners across the NUMA nodes, so each node's cores call batches held in
+        // its own memory.
+        const int num_numa_nodes = utils::num_numa_nodes();
         for (size_t i = 0; i < num_runners; i++) {
+            const int numa_node = num_numa_nodes > 1 ? int(i % num_numa_nodes) : -1;
             runners.push_back(std::make_shared<dorado::ModelRunner<dorado::CPUDecoder>>(
-                    model_config, device, chunk_size, batch_size));
+                    model_config, device, chunk_size, batch_size, numa_node));
         }
     }
 #if DORADO_GPU_BUILD
 #ifdef __APPLE__
     else if (device == "metal") {
-        auto caller = dorado::create_metal_caller(model_config, chunk_size, batch_size);
+        auto caller = dorado::create_metal_caller(model_config, chunk_size, batch_size,
+                                                  metal_viterbi_decode);
+        // Keep a runner staging its next batch for each batch in flight.
+        num_runners = std::max(num_runners, size_t(kMetalBatchesInFlight + 1));
         for (size_t i = 0; i < num_runners; i++) {
             runners.push_back(std::make_shared<dorado::MetalModelRunner>(caller));
         }
@@ -61,9 +125,16 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
         if (num_devices == 0) {
             throw std::runtime_error("CUDA device requested but no devices found.");
         }
-        for (auto device_string : devices) {
-            auto caller = dorado::create_cuda_caller(model_config, chunk_size, batch_size,
-                                                     device_string, memory_fraction, guard_gpus);
+        // Keep a runner staging its next batch for each batch in flight.
+        num_runners = std::max(num_runners, num_cuda_streams + 1);
+        auto create_caller = [&](const std::string& device_string, size_t device_chunk_size) {
+            return dorado::create_cuda_caller(model_config, int(device_chunk_size), batch_size,
+                                              device_string, memory_fraction, guard_gpus,
+                                              int(num_cuda_streams), use_cuda_graphs,
+                                              int(overlap), use_workspace_arena);
+        };
+        auto add_runners = [&](const std::string& device_string,
+                               const std::shared_ptr<CudaCaller>& caller) {
             for (size_t i = 0; i < num_runners; i++) {
                 runners.push_back(std::make_shared<dorado::CudaModelRunner>(caller));
             }
@@ -71,11 +142,59 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
                 spdlog::debug("- set batch size for {} to {}", device_string,
                               runners.back()->batch_size());
             }
+        };
+
+        size_t num_devices_done = 0;
+        if (chunk_size == 0) {
+            // Every runner must share a chunk size, so the first device's pick is used on
+            // the rest, which can only start once it is made.
+            add_runners(devices.front(), create_caller(devices.front(), 0));
+            chunk_size = runners.back()->chunk_size();
+            spdlog::info("> Auto chunk size: {}", chunk_size);
+            num_devices_done = 1;
+        }
+
+        // Loading the model and picking the batch size take a while on each device, so the
+        // remaining devices are set up concurrently, each on its own thread.
+        std::vector<std::future<std::shared_ptr<CudaCaller>>> callers;
+        for (size_t i = num_devices_done; i < devices.size(); ++i) {
+            callers.push_back(std::async(std::launch::async, create_caller, devices[i],
+                                         chunk_size));
+        }
+        // Every device is waited for, so that one failing doesn't leave the others' threads
+        // running, and the runners are added in device order.
+        std::exception_ptr error;
+        for (size_t i = 0; i < callers.size(); ++i) {
+            try {
+                auto caller = callers[i].get();
+                if (!error) {
+                    add_runners(devices[num_devices_done + i], caller);
+                }
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
 #endif  // __APPLE__
 #endif  // DORADO_GPU_BUILD
 
+    if (num_cpu_runners != 0) {
+        // The CPU runners take the chunk size the GPUs' runners use.
+        spdlog::debug("- adding {} CPU runners with batch size {}", num_cpu_runners,
+                      kCpuSpillBatchSize);
+        const int num_numa_nodes = utils::num_numa_nodes();
+        for (size_t i = 0; i < num_cpu_runners; i++) {
+            const int numa_node = num_numa_nodes > 1 ? int(i % num_numa_nodes) : -1;
+            runners.push_back(std::make_shared<dorado::ModelRunner<dorado::CPUDecoder>>(
+                    model_config, "cpu", chunk_size, kCpuSpillBatchSize, numa_node));
+        }
+    }
+
     auto model_stride = runners.front()->model_stride();
     auto adjusted_chunk_size = runners.front()->chunk_size();
     assert(std::all_of(runners.begin(), runners.end(), [&](auto runner) {
@@ -83,7 +202,7 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
                runner->chunk_size() == adjusted_chunk_size;
     }));
 
-    if (chunk_size != adjusted_chunk_size) {
+    if (!auto_chunk_size && chunk_size != adjusted_chunk_size) {
         spdlog::debug("- adjusted chunk size to match model stride: {} -> {}", chunk_size,
                       adjusted_chunk_size);
         chunk_size = adjusted_chunk_size;
@@ -94,7 +213,7 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
 
 std::vector<std::unique_ptr<dorado::ModBaseRunner>> create_modbase_runners(
         const std::string& remora_models,
-        const std::string& device,
+        const std::string& device_list,
         size_t remora_runners_per_caller,
         size_t remora_batch_size) {
     std::vector<std::filesystem::path> remora_model_list;
@@ -111,6 +230,8 @@ std::vector<std::unique_ptr<dorado::ModBaseRunner>> create_modbase_runners(
     // generate model callers before nodes or it affects the speed calculations
     std::vector<std::unique_ptr<dorado::ModBaseRunner>> remora_runners;
     std::vector<std::string> modbase_devices;
+    // Modified bases are called on the GPUs only, even if CPU runners spill over them.
+    const auto device = split_cpu_spill_device(device_list).first;
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
     if (device != "cpu") {
         modbase_devices = dorado::utils::parse_cuda_device_string(device);
@@ -119,13 +240,31 @@ std::vector<std::unique_ptr<dorado::ModBaseRunner>> create_modbase_runners(
     {
         modbase_devices.push_back(device);
     }
+    // Each device's caller is made on its own thread, as for the basecall runners.
+    std::vector<std::future<std::shared_ptr<ModBaseCaller>>> callers;
+    callers.reserve(modbase_devices.size());
     for (const auto& device_string : modbase_devices) {
-        auto caller =
-                dorado::create_modbase_caller(remora_model_list, remora_batch_size, device_string);
-        for (size_t i = 0; i < remora_runners_per_caller; i++) {
-            remora_runners.push_back(std::make_unique<dorado::ModBaseRunner>(caller));
+        callers.push_back(std::async(std::launch::async, [&, device_string] {
+            return dorado::create_modbase_caller(remora_model_list, remora_batch_size,
+                                                 device_string);
+        }));
+    }
+    std::exception_ptr error;
+    for (auto& caller_future : callers) {
+        try {
+            auto caller = caller_future.get();
+            for (size_t i = 0; i < remora_runners_per_caller; i++) {
+                remora_runners.push_back(std::make_unique<dorado::ModBaseRunner>(caller));
+            }
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
         }
-    };
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
 
     return remora_runners;
 }
@@ -11,6 +11,15 @@
 
 namespace dorado {
 
+// A CUDA device string may end in ",cpu" or ",cpu:<num_runners>", such as "cuda:all,cpu:16",
+// to add CPU runners which spill over the GPUs: BasecallerNode leaves chunks to the faster GPU
+// runners while they are waiting for them.  Splits off that part, returning the rest of the
+// device string and the number of CPU runners, which is 0 without it, or every core for ",cpu".
+std::pair<std::string, size_t> split_cpu_spill_device(const std::string& device);
+
+// A chunk_size of 0 has the CUDA runners time the model to pick one for chunks overlapping by
+// overlap, and other devices use the default chunk size.  use_workspace_arena is passed on to
+// the CUDA callers, and ignored elsewhere.
 std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
         const dorado::CRFModelConfig& model_config,
         const std::string& device,
@@ -18,7 +27,12 @@ std::pair<std::vector<dorado::Runner>, size_t> create_basecall_runners(
         size_t batch_size,
         size_t chunk_size,
         float memory_fraction = 1.f,
-        bool guard_gpus = false);
+        bool guard_gpus = false,
+        size_t num_cuda_streams = 1,
+        bool use_cuda_graphs = false,
+        bool metal_viterbi_decode = false,
+        size_t overlap = 0,
+        bool use_workspace_arena = false);
 
 std::vector<std::unique_ptr<dorado::ModBaseRunner>> create_modbase_runners(
         const std::string& remora_models,
@@ -208,6 +208,87 @@ kernel void add_softmax(
     }
 }
 
+// Finds the most likely path through each chunk's scores, for decoding on the GPU in place
+// of beam search.  One threadgroup handles each chunk, with a thread per state, and the
+// scores of the best paths into the states are kept in threadgroup memory.  The transition
+// taken into each state at each timestep is saved to back_ptrs [N, T, C]: 0 for a stay, or
+// 1 + the base shifted out of the previous state for a step.  The first thread then traces
+// the best path back, writing its state and whether it moved at each timestep.
+kernel void viterbi(
+    device const ScanArgs* const args,
+    device const int8_t* const scores_in,
+    device uint8_t* const back_ptrs,
+    device int32_t* const path_states,
+    device uint8_t* const path_moves,
+    // 2 * C floats, set via MTL::ComputeCommandEncoder.
+    threadgroup float* const path_scores,
+    KERNEL_INDEX_INPUTS)
+{
+    constexpr int kNumBases = 4;
+    constexpr float kFixedStayScore = 2.0f;
+
+    const int T = args->T;
+    const int N = args->N;
+    const int num_states = args->C;
+    const int ts_states = num_states * kNumBases;
+    const int kMsb = num_states / kNumBases;
+    const int chunk = gid;
+
+    device const int8_t* const chunk_in = scores_in + chunk * ts_states;
+    device uint8_t* const chunk_back_ptrs = back_ptrs + chunk * T * num_states;
+    threadgroup float* scores_prev = path_scores;
+    threadgroup float* scores_next = path_scores + num_states;
+
+    const int state = tid;
+    const int step_state_idx_a = state / kNumBases;
+    const int step_trans_idx_a = state * kNumBases;
+    scores_prev[state] = 0.0f;
+    for (int ts = 0; ts < T; ++ts) {
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        device const auto* const ts_in = chunk_in + N * ts_states * ts;
+
+        float best_score = scores_prev[state] + kFixedStayScore;
+        uint8_t best_trans = 0;
+        for (int base = 0; base < kNumBases; ++base) {
+            const float score = scores_prev[step_state_idx_a + base * kMsb] +
+                ScaleByteScore(ts_in[step_trans_idx_a + base]);
+            if (score > best_score) {
+                best_score = score;
+                best_trans = base + 1;
+            }
+        }
+        scores_next[state] = best_score;
+        chunk_back_ptrs[ts * num_states + state] = best_trans;
+
+        threadgroup float* const scores_tmp = scores_prev;
+        scores_prev = scores_next;
+        scores_next = scores_tmp;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup | mem_flags::mem_device);
+    if (tid != 0) {
+        return;
+    }
+
+    int path_state = 0;
+    for (int s = 1; s < num_states; ++s) {
+        if (scores_prev[s] > scores_prev[path_state]) {
+            path_state = s;
+        }
+    }
+    device int32_t* const chunk_states = path_states + chunk * T;
+    device uint8_t* const chunk_moves = path_moves + chunk * T;
+    for (int ts = T - 1; ts >= 0; --ts) {
+        chunk_states[ts] = path_state;
+        const int trans = chunk_back_ptrs[ts * num_states + path_state];
+        chunk_moves[ts] = (trans != 0) ? 1 : 0;
+        if (trans != 0) {
+            path_state = path_state / kNumBases + (trans - 1) * kMsb;
+        }
+    }
+    // Always step in the first timestep, as beam search does.
+    chunk_moves[0] = 1;
+}
+
 struct ConvArgs {
     int in_size;
     int win_size;
@@ -262,18 +343,6 @@ kernel void conv(
 */
 
 
-// Just type conversion
-kernel void float_to_half(
-    device const int* const num_elems,
-    device const float* const in,
-    device half* const out,
-    KERNEL_INDEX_INPUTS)
-{
-    for (int elem = gid * threads + tid; elem < *num_elems; elem += threadgroups * threads) {
-        out[elem] = in[elem];
-    }
-}
-
 struct RowMajor {
     static int inner(int r, int c) { return c; }
     static int outer(int r, int c) { return r; }
@@ -898,7 +967,10 @@ template [[ host_name("reorder_rev_lstm_output_to_linear") ]] kernel void reorde
 // Note: max_total_threads_per_threadgroup is set via ComputePipelineDescriptor,
 // rather than an attribute here, since it depends on the SIMD group count,
 // which varies according to LSTM layer size.
-kernel void lstm(
+// Each SIMD group computes SIMD_TILES_M x LSTM_TILES_N tiles of the gates at a time.  GPUs with
+// larger register files keep a wider block of accumulators without spilling, which halves the
+// number of times the input tiles are loaded.
+template<int LSTM_TILES_N> kernel void lstm(
         device const LstmArgs* const args,
         device ftype* const in_out,
         device const ftype* const weights_buf,
@@ -906,18 +978,18 @@ kernel void lstm(
         // The sizes of these buffers are set via MTL::ComputeCommandEncoder.
         // They depend on the SIMD group count.
         threadgroup ftype (* const simd_res_buf)[2 * TILE_SIZE * TILE_SIZE],
-        threadgroup ftype (* const simd_out_buf)[TILE_SIZE * TILE_SIZE],
+        threadgroup ftype (* const simd_out_buf)[LSTM_TILES_N * 2 * TILE_SIZE],
         KERNEL_INDEX_INPUTS)
 {
     const int chunk_size = args->chunk_size;
     const int batch_tiles = args->batch_tiles;
     const int m_blks = batch_tiles / SIMD_TILES_M;
-    const int n_blks = kLstmLayerSize * 4 / (TILE_SIZE * SIMD_TILES_N);
+    const int n_blks = kLstmLayerSize * 4 / (TILE_SIZE * LSTM_TILES_N);
     const int k_tiles = kLstmLayerSize / TILE_SIZE;
     const int batch_size = batch_tiles * TILE_SIZE;
     const int w_stride = kLstmLayerSize * 4;
-    MatMul<SIMD_TILES_M, SIMD_TILES_N> mm;
-    using MatLayoutLSTM = MatLayoutLSTM<SIMD_TILES_M, SIMD_TILES_N, NO_OFFSET>;
+    MatMul<SIMD_TILES_M, LSTM_TILES_N> mm;
+    using MatLayoutLSTM = MatLayoutLSTM<SIMD_TILES_M, LSTM_TILES_N, NO_OFFSET>;
     device const ftype* const bias = weights_buf + 3 * kLstmLayerSize * w_stride;
 
     const uint t_idx = tid & 31;
@@ -938,9 +1010,9 @@ kernel void lstm(
         const int timestep_in = kLstmReversedInTime ? chunk_size - iter : iter;
         for (int m_blk = gid; m_blk < m_blks; m_blk += threadgroups) {
             for (int n_blk = sid; n_blk < n_blks; n_blk += simdgroups) {
-                mm.load_bias(bias, n_blk * SIMD_TILES_N * TILE_SIZE);
+                mm.load_bias(bias, n_blk * LSTM_TILES_N * TILE_SIZE);
                 auto mat_a = MatLayoutLSTM::tnc_block(in_out, 0, batch_size, kLstmLayerSize, timestep_in, m_blk, 0);
-                TileBlock<RowMajor> mat_b(weights_buf, w_stride, 0, n_blk * SIMD_TILES_N * TILE_SIZE);
+                TileBlock<RowMajor> mat_b(weights_buf, w_stride, 0, n_blk * LSTM_TILES_N * TILE_SIZE);
                 auto mat_c = MatLayoutLSTM::tnc_block(in_out, 0, batch_size, kLstmLayerSize, timestep_in + 1, m_blk, 0);
                 // Surprisingly, executing the second mma starting from 2*k_tiles is faster than
                 // doing `mat_a = MatLayoutLSTM::tnc_block(..., timestep_in+2, ...);` or adding
@@ -951,12 +1023,12 @@ kernel void lstm(
 
                 for (int i = 0; i < SIMD_TILES_M; ++i) {
                     const uint chunk_idx = (m_blk * SIMD_TILES_M + i) * TILE_SIZE + row;
-                    for (int j = 0; j < SIMD_TILES_N; j += 2) {
+                    for (int j = 0; j < LSTM_TILES_N; j += 2) {
                         simdgroup_store(mm.acc(i, j + 0), simd_res_buf[sid], 2 * TILE_SIZE);
                         simdgroup_store(mm.acc(i, j + 1), simd_res_buf[sid] + TILE_SIZE, 2 * TILE_SIZE);
                         simdgroup_barrier(mem_flags::mem_threadgroup);
                         const uint col = j * 2 + col_bits;
-                        const uint out_col = n_blk * SIMD_TILES_N * 2 + col;
+                        const uint out_col = n_blk * LSTM_TILES_N * 2 + col;
                         const uint out_idx = out_col * batch_size + chunk_idx;
                         const float g = tanh_fast(simd_res_buf[sid][rb_idx + 0]);
                         const float i = sigmoid(simd_res_buf[sid][rb_idx + 1]);
@@ -965,13 +1037,13 @@ kernel void lstm(
                         const float state = f * state_buf[out_idx] + i * g;
                         const float h = o * tanh_fast(state);
                         state_buf[out_idx] = state;
-                        simd_out_buf[sid][row * SIMD_TILES_N * 2 + col] = h;
+                        simd_out_buf[sid][row * LSTM_TILES_N * 2 + col] = h;
                     }
                     simdgroup_barrier(mem_flags::mem_threadgroup);
                     simdgroup_ftype8x8 A;
-                    for (int j = 0; j < SIMD_TILES_N / 4; ++j) {
-                        simdgroup_load(A, simd_out_buf[sid], SIMD_TILES_N * 2, ulong2(j * TILE_SIZE, 0));
-                        mat_c.store(A, i, n_blk * (SIMD_TILES_N / 4) + j);
+                    for (int j = 0; j < LSTM_TILES_N / 4; ++j) {
+                        simdgroup_load(A, simd_out_buf[sid], LSTM_TILES_N * 2, ulong2(j * TILE_SIZE, 0));
+                        mat_c.store(A, i, n_blk * (LSTM_TILES_N / 4) + j);
                     }
                 }
             }
@@ -979,6 +1051,16 @@ kernel void lstm(
     }
 }
 
+template [[ host_name("lstm") ]] kernel void lstm<SIMD_TILES_N>(
+        device const LstmArgs*, device ftype*, device const ftype*, device ftype*,
+        threadgroup ftype (* const simd_res_buf)[2 * TILE_SIZE * TILE_SIZE],
+        threadgroup ftype (* const simd_out_buf)[SIMD_TILES_N * 2 * TILE_SIZE], KERNEL_INDEX_INPUTS);
+
+template [[ host_name("lstm_wide") ]] kernel void lstm<2 * SIMD_TILES_N>(
+        device const LstmArgs*, device ftype*, device const ftype*, device ftype*,
+        threadgroup ftype (* const simd_res_buf)[2 * TILE_SIZE * TILE_SIZE],
+        threadgroup ftype (* const simd_out_buf)[2 * SIMD_TILES_N * 2 * TILE_SIZE], KERNEL_INDEX_INPUTS);
+
 struct LinearArgs {
     int in_batch_tiles;
     int in_batch_tile_offset;
@@ -986,7 +1068,7 @@ struct LinearArgs {
     int chunk_size;
 };
 
-template<typename InputMatLayout> kernel void linear(
+template<typename InputMatLayout, int LINEAR_TILES_N> kernel void linear(
         device const LinearArgs* const args,
         device const ftype* const in_buf,
         device const ftype* const weights_buf,
@@ -1001,12 +1083,12 @@ template<typename InputMatLayout> kernel void linear(
     const int in_batch_block_offset = args->in_batch_tile_offset / SIMD_TILES_M;
     const int out_batch_tiles = args->out_batch_tiles;
     const int m_blks = out_batch_tiles / SIMD_TILES_M;
-    const int n_blks = kLinearOutSize / (TILE_SIZE * SIMD_TILES_N);
+    const int n_blks = kLinearOutSize / (TILE_SIZE * LINEAR_TILES_N);
     const int k_tiles = kLinearInSize / TILE_SIZE;
     const int w_stride = kLinearOutSize;
     const int out_stride = kLinearOutSize;
     device const ftype* const bias = weights_buf + kLinearInSize * w_stride;
-    MatMul<SIMD_TILES_M, SIMD_TILES_N> mm;
+    MatMul<SIMD_TILES_M, LINEAR_TILES_N> mm;
 
     for (int ts = gid; ts < chunk_size; ts += threadgroups) {
         auto out_buf_offset = ts * kLinearOutSize * out_batch_tiles * TILE_SIZE;
@@ -1015,18 +1097,18 @@ template<typename InputMatLayout> kernel void linear(
 
         for (int m_blk = 0; m_blk < m_blks; ++m_blk) {
             for (int n_blk = sid; n_blk < n_blks; n_blk += simdgroups) {
-                mm.load_bias(bias, n_blk * SIMD_TILES_N * TILE_SIZE);
+                mm.load_bias(bias, n_blk * LINEAR_TILES_N * TILE_SIZE);
                 auto mat_a = InputMatLayout::tnc_block(in_buf, chunk_size, in_batch_size, kLinearInSize,
                     ts, m_blk + in_batch_block_offset, 0);
-                TileBlock<RowMajor> mat_b(weights_buf, w_stride, 0, n_blk * SIMD_TILES_N * TILE_SIZE);
+                TileBlock<RowMajor> mat_b(weights_buf, w_stride, 0, n_blk * LINEAR_TILES_N * TILE_SIZE);
                 mm.mma(0, k_tiles, mat_a, mat_b);
                 for (int i = 0; i < SIMD_TILES_M; ++i) {
-                    for (int j = 0; j < SIMD_TILES_N; ++j) {
+                    for (int j = 0; j < LINEAR_TILES_N; ++j) {
                         // Store this 8x8 tile to threadgroup memory as ftype.
                         simdgroup_store(mm.acc(i, j), simd_out_buf[sid], TILE_SIZE);
                         
                         const uint tile_i = (m_blk * SIMD_TILES_M + i) * TILE_SIZE;
-                        const uint tile_j = (n_blk * SIMD_TILES_N + j) * TILE_SIZE;
+                        const uint tile_j = (n_blk * LINEAR_TILES_N + j) * TILE_SIZE;
 
                         // Apply tanh activation or clamping, scaling, and type conversion.
                         // Store to the output buffer.
@@ -1054,11 +1136,21 @@ template<typename InputMatLayout> kernel void linear(
 }
 
 template [[ host_name("linear") ]] kernel void linear<
-    MatLayoutRowMajor<SIMD_TILES_M, SIMD_TILES_N>>(
+    MatLayoutRowMajor<SIMD_TILES_M, SIMD_TILES_N>, SIMD_TILES_N>(
         device const LinearArgs*, device const ftype*, device const ftype*, device void* const,
         threadgroup ftype (* const simd_out_buf)[TILE_SIZE * TILE_SIZE], KERNEL_INDEX_INPUTS);
 
 template [[ host_name("linear_from_rev_lstm") ]] kernel void linear<
-    MatLayoutLSTM<SIMD_TILES_M, SIMD_TILES_N, REVERSE_LSTM_OUTPUT>>(
+    MatLayoutLSTM<SIMD_TILES_M, SIMD_TILES_N, REVERSE_LSTM_OUTPUT>, SIMD_TILES_N>(
+        device const LinearArgs*, device const ftype*, device const ftype*, device void* const,
+        threadgroup ftype (* const simd_out_buf)[TILE_SIZE * TILE_SIZE], KERNEL_INDEX_INPUTS);
+
+template [[ host_name("linear_wide") ]] kernel void linear<
+    MatLayoutRowMajor<SIMD_TILES_M, SIMD_TILES_N>, 2 * SIMD_TILES_N>(
+        device const LinearArgs*, device const ftype*, device const ftype*, device void* const,
+        threadgroup ftype (* const simd_out_buf)[TILE_SIZE * TILE_SIZE], KERNEL_INDEX_INPUTS);
+
+template [[ host_name("linear_from_rev_lstm_wide") ]] kernel void linear<
+    MatLayoutLSTM<SIMD_TILES_M, SIMD_TILES_N, REVERSE_LSTM_OUTPUT>, 2 * SIMD_TILES_N>(
         device const LinearArgs*, device const ftype*, device const ftype*, device void* const,
         threadgroup ftype (* const simd_out_buf)[TILE_SIZE * TILE_SIZE], KERNEL_INDEX_INPUTS);
@@ -1,19 +1,43 @@
 #include "AlignerNode.h"
 
+#include "ReadOrderNode.h"
 #include "htslib/sam.h"
 #include "minimap.h"
 //todo: mmpriv.h is a private header from mm2 for the mm_event_identity function.
 //Ask lh3 t  make some of these funcs publicly available?
 #include "mmpriv.h"
 #include "utils/sequence_utils.h"
+#include "utils/trace.h"
 #include "utils/types.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
 
+namespace {
+
+// Appends a tag to a record's aux data, in the BAM encoding bam_aux_append would give it.
+template <typename T>
+void append_tag(std::vector<uint8_t>& tags, const char* tag, char type, const T& value) {
+    tags.insert(tags.end(), {uint8_t(tag[0]), uint8_t(tag[1]), uint8_t(type)});
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    tags.insert(tags.end(), bytes, bytes + sizeof(T));
+}
+
+void append_string_tag(std::vector<uint8_t>& tags, const char* tag, const char* value, size_t len) {
+    tags.insert(tags.end(), {uint8_t(tag[0]), uint8_t(tag[1]), uint8_t('Z')});
+    tags.insert(tags.end(), value, value + len);
+    tags.push_back(0);
+}
+
+}  // namespace
+
 namespace dorado {
 
 Aligner::Aligner(MessageSink& sink,
@@ -21,8 +45,22 @@ Aligner::Aligner(MessageSink& sink,
                  int k,
                  int w,
                  uint64_t index_batch_size,
-                 int threads)
-        : MessageSink(10000), m_sink(sink), m_threads(threads) {
+                 int threads,
+                 const std::string& index_output,
+                 bool keep_input_order,
+                 ReadConversionOptions read_conversion,
+                 bool emit_paf,
+                 std::shared_ptr<utils::BandedAligner> device_extender)
+        : MessageSink(10000),
+          m_sink(sink),
+          m_threads(threads),
+          m_keep_input_order(keep_input_order),
+          m_emit_paf(emit_paf),
+          m_emit_moves(read_conversion.emit_moves),
+          m_pack_moves(read_conversion.pack_moves),
+          m_rna(read_conversion.rna),
+          m_modbase_threshold(static_cast<uint8_t>(
+                  std::min(read_conversion.modbase_threshold_frac * 256.0f, 255.0f))) {
     // Check if reference file exists.
     if (!std::filesystem::exists(filename)) {
         throw std::runtime_error("Aligner reference path does not exist: " + filename);
@@ -42,38 +80,72 @@ Aligner::Aligner(MessageSink& sink,
     m_idx_opt.batch_size = index_batch_size;
     m_idx_opt.mini_batch_size = index_batch_size;
 
-    // Force cigar generation.
-    m_map_opt.flag |= MM_F_CIGAR;
+    // Force cigar generation, unless only the PAF mapping coordinates are wanted.
+    if (!m_emit_paf) {
+        m_map_opt.flag |= MM_F_CIGAR;
+    }
 
     mm_check_opt(&m_idx_opt, &m_map_opt);
 
-    m_index_reader = mm_idx_reader_open(filename.c_str(), &m_idx_opt, 0);
-    m_index = mm_idx_reader_read(m_index_reader, m_threads);
-    auto* split_index = mm_idx_reader_read(m_index_reader, m_threads);
-    if (split_index != nullptr) {
-        mm_idx_destroy(m_index);
-        mm_idx_destroy(split_index);
-        mm_idx_reader_close(m_index_reader);
-        throw std::runtime_error(
-                "Dorado doesn't support split index for alignment. Please re-run with larger index "
-                "size.");
+    const bool is_prebuilt_index = mm_idx_is_idx(filename.c_str()) > 0;
+    const char* dump_filename = nullptr;
+    if (!index_output.empty()) {
+        if (is_prebuilt_index) {
+            spdlog::warn("Not saving index to {}: reference {} is already an index.",
+                         index_output, filename);
+        } else {
+            spdlog::info("> Saving index to {}", index_output);
+            dump_filename = index_output.c_str();
+        }
     }
-    mm_mapopt_update(&m_map_opt, m_index);
 
-    if (m_index->k != m_idx_opt.k || m_index->w != m_idx_opt.w) {
+    // Each part of the index is written to dump_filename as it is built.
+    auto* index_reader = mm_idx_reader_open(filename.c_str(), &m_idx_opt, dump_filename);
+    if (!index_reader) {
+        throw std::runtime_error(dump_filename ? "Failed to open index output: " + index_output
+                                               : "Failed to open aligner reference: " + filename);
+    }
+    int32_t num_seqs = 0;
+    while (auto* index_part = mm_idx_reader_read(index_reader, m_threads)) {
+        m_index_parts.push_back(index_part);
+        m_part_tid_offsets.push_back(num_seqs);
+        num_seqs += index_part->n_seq;
+        if (mm_verbose >= 3) {
+            mm_idx_stat(index_part);
+        }
+    }
+    // Closing the reader also completes the saved index.
+    mm_idx_reader_close(index_reader);
+    if (m_index_parts.empty()) {
+        throw std::runtime_error("Aligner reference contains no sequences: " + filename);
+    }
+    if (m_index_parts.size() > 1) {
+        spdlog::info("> Reference index is split into {} parts, reads are mapped to each in turn.",
+                     m_index_parts.size());
+    }
+    // As with minimap2's split index mode, the options are set from the first part.
+    const auto* first_part = m_index_parts.front();
+    mm_mapopt_update(&m_map_opt, first_part);
+    m_chain_map_opt = m_map_opt;
+    m_chain_map_opt.flag &= ~MM_F_CIGAR;
+    // PAF output has no base-level alignment to extend.
+    if (device_extender && !m_emit_paf) {
+        m_device_extender = std::move(device_extender);
+        spdlog::info("> Extending alignments on {}, with a band of {} bases.",
+                     m_device_extender->device().str(), m_device_extender->band_width());
+    }
+
+    if (first_part->k != m_idx_opt.k || first_part->w != m_idx_opt.w) {
         spdlog::warn(
                 "Indexing parameters mismatch prebuilt index: using paramateres kmer "
                 "size={} and window size={} from prebuilt index.",
-                m_index->k, m_index->w);
-    }
-
-    if (mm_verbose >= 3) {
-        mm_idx_stat(m_index);
+                first_part->k, first_part->w);
     }
 
     for (int i = 0; i < m_threads; i++) {
         m_tbufs.push_back(mm_tbuf_init());
     }
+    m_scratch = std::vector<AlignScratch>(m_threads);
 
     for (size_t i = 0; i < m_threads; i++) {
         m_workers.push_back(
@@ -83,22 +155,31 @@ Aligner::Aligner(MessageSink& sink,
 
 Aligner::~Aligner() {
     terminate();
-    for (auto& m : m_workers) {
-        m->join();
-    }
+    join();
     for (int i = 0; i < m_threads; i++) {
         mm_tbuf_destroy(m_tbufs[i]);
     }
-    mm_idx_reader_close(m_index_reader);
-    mm_idx_destroy(m_index);
+    for (auto* index_part : m_index_parts) {
+        mm_idx_destroy(index_part);
+    }
     // Adding for thread safety in case worker thread throws exception.
     m_sink.terminate();
 }
 
+void Aligner::join() {
+    for (auto& m : m_workers) {
+        if (m->joinable()) {
+            m->join();
+        }
+    }
+}
+
 std::vector<std::pair<char*, uint32_t>> Aligner::get_sequence_records_for_header() {
     std::vector<std::pair<char*, uint32_t>> records;
-    for (int i = 0; i < m_index->n_seq; ++i) {
-        records.push_back(std::make_pair(m_index->seq[i].name, m_index->seq[i].len));
+    for (const auto* index_part : m_index_parts) {
+        for (uint32_t i = 0; i < index_part->n_seq; ++i) {
+            records.push_back(std::make_pair(index_part->seq[i].name, index_part->seq[i].len));
+        }
     }
     return records;
 }
@@ -106,12 +187,53 @@ std::vector<std::pair<char*, uint32_t>> Aligner::get_sequence_records_for_header
 void Aligner::worker_thread(size_t tid) {
     m_active++;  // Track active threads.
 
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        auto read = std::get<BamPtr>(std::move(message));
-        auto records = align(read.get(), m_tbufs[tid]);
-        for (auto& record : records) {
-            m_sink.push_message(std::move(record));
+    // Work on small batches so queue synchronisation is paid once per batch in each
+    // direction, while still spreading records across the worker threads.
+    constexpr size_t kMaxBatchSize = 32;
+    std::vector<Message> messages;
+    while (true) {
+        uint64_t batch_index = 0;
+        {
+            std::unique_lock pop_lock(m_pop_mutex, std::defer_lock);
+            if (m_keep_input_order) {
+                pop_lock.lock();
+            }
+            if (!m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+                break;
+            }
+            batch_index = m_num_batches_popped++;
+        }
+
+        std::vector<Message> aligned;
+        if (m_device_extender) {
+            aligned = align_on_device(messages, m_tbufs[tid], m_scratch[tid]);
+        } else {
+            for (auto& message : messages) {
+                if (m_emit_paf) {
+                    aligned.push_back(
+                            paf_message(std::move(message), m_tbufs[tid], m_scratch[tid]));
+                    continue;
+                }
+                std::vector<BamPtr> records;
+                if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+                    auto& read = std::get<std::shared_ptr<Read>>(message);
+                    records = align(*read, m_tbufs[tid], m_scratch[tid]);
+                    if (read->order_ticket) {
+                        read->order_ticket->finish(records);
+                    }
+                } else {
+                    auto record = std::get<BamPtr>(std::move(message));
+                    records = align(record.get(), m_tbufs[tid], m_scratch[tid]);
+                }
+                for (auto& record : records) {
+                    aligned.push_back(std::move(record));
+                }
+            }
+        }
+        if (m_keep_input_order) {
+            push_in_order(batch_index, std::move(aligned));
+        } else {
+            m_sink.push_messages(std::move(aligned));
         }
     }
 
@@ -122,31 +244,61 @@ void Aligner::worker_thread(size_t tid) {
     }
 }
 
-// Function to add auxiliary tags to the alignment record.
+PafLines Aligner::paf_message(Message&& message, mm_tbuf_t* buf, AlignScratch& scratch) {
+    if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        const auto& read = *std::get<std::shared_ptr<Read>>(message);
+        if (!m_rna) {
+            return map_to_paf(read.read_id, read.seq, buf);
+        }
+        scratch.seq.assign(read.seq.rbegin(), read.seq.rend());
+        return map_to_paf(read.read_id, scratch.seq, buf);
+    }
+    auto record = std::get<BamPtr>(std::move(message));
+    utils::convert_nt16_to_str(bam_get_seq(record.get()), record->core.l_qseq, scratch.seq);
+    return map_to_paf(bam_get_qname(record.get()), scratch.seq, buf);
+}
+
+void Aligner::push_in_order(uint64_t batch_index, std::vector<Message>&& aligned) {
+    std::lock_guard lock(m_reorder_mutex);
+    m_reorder_buffer.emplace(batch_index, std::move(aligned));
+    // Pushing under the lock keeps batches from being interleaved downstream.
+    for (auto it = m_reorder_buffer.begin();
+         it != m_reorder_buffer.end() && it->first == m_next_batch_to_push;
+         it = m_reorder_buffer.erase(it)) {
+        m_sink.push_messages(std::move(it->second));
+        ++m_next_batch_to_push;
+    }
+}
+
+// Function to make the auxiliary tags of the alignment record.
 // These are added to maintain parity with mm2.
-void Aligner::add_tags(bam1_t* record,
-                       const mm_reg1_t* aln,
-                       const std::string& seq,
-                       const mm_tbuf_t* buf) {
+void Aligner::make_tags(AlignScratch& scratch,
+                        const mm_reg1_t* aln,
+                        const std::string& seq,
+                        const mm_idx_t* index,
+                        int rep_len,
+                        bool primary_chain) {
+    auto& tags = scratch.tags;
+    tags.clear();
     if (aln->p) {
         // NM
         int32_t nm = aln->blen - aln->mlen + aln->p->n_ambi;
-        bam_aux_append(record, "NM", 'i', sizeof(nm), (uint8_t*)&nm);
+        append_tag(tags, "NM", 'i', nm);
 
         // ms
         int32_t ms = aln->p->dp_max;
-        bam_aux_append(record, "ms", 'i', sizeof(nm), (uint8_t*)&ms);
+        append_tag(tags, "ms", 'i', ms);
 
         // AS
         int32_t as = aln->p->dp_score;
-        bam_aux_append(record, "AS", 'i', sizeof(nm), (uint8_t*)&as);
+        append_tag(tags, "AS", 'i', as);
 
         // nn
         int32_t nn = aln->p->n_ambi;
-        bam_aux_append(record, "nn", 'i', sizeof(nm), (uint8_t*)&nn);
+        append_tag(tags, "nn", 'i', nn);
 
         if (aln->p->trans_strand == 1 || aln->p->trans_strand == 2) {
-            bam_aux_append(record, "ts", 'A', 2, (uint8_t*)&("?+-?"[aln->p->trans_strand]));
+            append_tag(tags, "ts", 'A', "?+-?"[aln->p->trans_strand]);
         }
     }
 
@@ -154,189 +306,503 @@ void Aligner::add_tags(bam1_t* record,
     if (aln->p) {
         float div;
         div = 1.0 - mm_event_identity(aln);
-        bam_aux_append(record, "de", 'f', sizeof(div), (uint8_t*)&div);
+        append_tag(tags, "de", 'f', div);
     } else if (aln->div >= 0.0f && aln->div <= 1.0f) {
-        bam_aux_append(record, "dv", 'f', sizeof(aln->div), (uint8_t*)&aln->div);
+        append_tag(tags, "dv", 'f', aln->div);
     }
 
     // tp
     char type;
-    if (aln->id == aln->parent) {
+    if (primary_chain) {
         type = aln->inv ? 'I' : 'P';
     } else {
         type = aln->inv ? 'i' : 'S';
     }
-    bam_aux_append(record, "tp", 'A', sizeof(type), (uint8_t*)&type);
+    append_tag(tags, "tp", 'A', type);
 
     // cm
-    bam_aux_append(record, "cm", 'i', sizeof(aln->cnt), (uint8_t*)&aln->cnt);
+    append_tag(tags, "cm", 'i', int32_t(aln->cnt));
 
     // s1
-    bam_aux_append(record, "s1", 'i', sizeof(aln->score), (uint8_t*)&aln->score);
+    append_tag(tags, "s1", 'i', int32_t(aln->score));
 
     // s2
-    if (aln->parent == aln->id) {
-        bam_aux_append(record, "s2", 'i', sizeof(aln->subsc), (uint8_t*)&aln->subsc);
+    if (primary_chain) {
+        append_tag(tags, "s2", 'i', int32_t(aln->subsc));
     }
 
-    // MD
-    char* md = NULL;
-    int max_len = 0;
-    int md_len = mm_gen_MD(NULL, &md, &max_len, m_index, aln, seq.c_str());
+    // MD, into the thread's buffer, which mm_gen_MD grows as needed.
+    int md_len = mm_gen_MD(NULL, &scratch.md, &scratch.md_capacity, index, aln, seq.c_str());
     if (md_len > 0) {
-        bam_aux_append(record, "MD", 'Z', md_len + 1, (uint8_t*)md);
+        append_string_tag(tags, "MD", scratch.md, md_len);
     }
-    free(md);
 
     // zd
     if (aln->split) {
         uint32_t split = uint32_t(aln->split);
-        bam_aux_append(record, "zd", 'i', sizeof(split), (uint8_t*)&split);
+        append_tag(tags, "zd", 'i', split);
     }
 
     // rl
-    bam_aux_append(record, "rl", 'i', sizeof(buf->rep_len), (uint8_t*)&buf->rep_len);
+    append_tag(tags, "rl", 'i', int32_t(rep_len));
+}
+
+std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf, AlignScratch& scratch) {
+    // get the sequence to map from the record
+    utils::convert_nt16_to_str(bam_get_seq(irecord), irecord->core.l_qseq, scratch.seq);
+    return align_sequence(irecord, scratch.seq, buf, scratch);
+}
+
+std::vector<BamPtr> Aligner::align(Read& read, mm_tbuf_t* buf, AlignScratch& scratch) {
+    if (m_rna) {
+        std::reverse(read.seq.begin(), read.seq.end());
+        std::reverse(read.qstring.begin(), read.qstring.end());
+    }
+    auto records = read.extract_sam_lines(m_emit_moves, m_modbase_threshold, m_pack_moves);
+    // Reads that already carry mappings have a record per mapping, which may not hold the
+    // full sequence, so those are aligned from their records.
+    if (records.size() != 1) {
+        std::vector<BamPtr> results;
+        for (auto& record : records) {
+            for (auto& aligned : align(record.get(), buf, scratch)) {
+                results.push_back(std::move(aligned));
+            }
+        }
+        return results;
+    }
+    return align_sequence(records.front().get(), read.seq, buf, scratch);
+}
+
+Aligner::MappedParts Aligner::map_to_parts(const std::string& seq,
+                                           const char* qname,
+                                           mm_tbuf_t* buf,
+                                           const mm_mapopt_t& map_opt) {
+    // Map against each part of the index in turn.
+    MappedParts mapped;
+    auto& part_hits = mapped.parts;
+    part_hits.reserve(m_index_parts.size());
+    for (const auto* index_part : m_index_parts) {
+        int hits = 0;
+        mm_reg1_t* reg =
+                mm_map(index_part, seq.length(), seq.c_str(), &hits, buf, &map_opt, qname);
+        part_hits.push_back({reg, hits, buf->rep_len});
+        mapped.total_hits += hits;
+    }
+
+    // Merge the hits from the index parts.  Each part's hits come back sorted with its best
+    // primary first, so the part with the best scoring primary keeps its primary and
+    // supplementary alignments, and every hit in the other parts is reported as secondary.
+    // As in minimap2, the mapq of the best part's hits is lowered by the ratio of the next best
+    // part's primary score to the best.
+    int best_score = std::numeric_limits<int>::min();
+    int second_best_score = 0;
+    for (size_t part = 0; part < part_hits.size(); ++part) {
+        if (part_hits[part].num_hits == 0) {
+            continue;
+        }
+        const int score = part_hits[part].regs[0].score;
+        if (score > best_score) {
+            second_best_score = best_score;
+            best_score = score;
+            mapped.best_part = part;
+        } else if (score > second_best_score) {
+            second_best_score = score;
+        }
+    }
+    mapped.mapq_scale =
+            best_score > 0 ? 1.f - std::max(second_best_score, 0) / static_cast<float>(best_score)
+                           : 1.f;
+    return mapped;
 }
 
-std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
+PafLines Aligner::map_to_paf(const std::string& qname, const std::string& seq, mm_tbuf_t* buf) {
+    DORADO_TRACE_SCOPE("align");
+    PafLines paf;
+    auto mapped = map_to_parts(seq, qname.c_str(), buf, m_map_opt);
+    paf.mapped = mapped.total_hits != 0;
+    // The columns and tags minimap2 writes without base-level alignment.
+    for (size_t part = 0; part < mapped.parts.size(); ++part) {
+        const auto* index_part = m_index_parts[part];
+        auto* reg = mapped.parts[part].regs;
+        const bool is_best_part = part == mapped.best_part;
+        for (int j = 0; j < mapped.parts[part].num_hits; j++) {
+            const auto* aln = &reg[j];
+            const bool primary_chain = is_best_part && aln->parent == aln->id;
+            const int mapq =
+                    is_best_part ? static_cast<int>(aln->mapq * mapped.mapq_scale + .499f) : 0;
+            char type;
+            if (primary_chain) {
+                type = aln->inv ? 'I' : 'P';
+            } else {
+                type = aln->inv ? 'i' : 'S';
+            }
+            const auto& ref = index_part->seq[aln->rid];
+            paf.lines += fmt::format(
+                    "{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\ttp:A:{}\tcm:i:{}\ts1:i:{}",
+                    qname, seq.size(), aln->qs, aln->qe, "+-"[aln->rev], ref.name, ref.len,
+                    aln->rs, aln->re, aln->mlen, aln->blen, mapq, type, aln->cnt, aln->score);
+            if (primary_chain) {
+                paf.lines += fmt::format("\ts2:i:{}", aln->subsc);
+            }
+            if (aln->div >= 0.0f && aln->div <= 1.0f) {
+                paf.lines += fmt::format("\tdv:f:{:.4f}", aln->div);
+            }
+            paf.lines += fmt::format("\trl:i:{}\n", mapped.parts[part].rep_len);
+            free(aln->p);
+        }
+        free(reg);
+    }
+    return paf;
+}
+
+std::vector<BamPtr> Aligner::align_sequence(bam1_t* irecord,
+                                            const std::string& seq,
+                                            mm_tbuf_t* buf,
+                                            AlignScratch& scratch) {
+    DORADO_TRACE_SCOPE("align");
+    auto mapped = map_to_parts(seq, bam_get_qname(irecord), buf, m_map_opt);
+    return build_records(irecord, seq, mapped, scratch);
+}
+
+std::vector<BamPtr> Aligner::build_records(bam1_t* irecord,
+                                           const std::string& seq,
+                                           MappedParts& mapped,
+                                           AlignScratch& scratch) {
     // some where for the hits
     std::vector<BamPtr> results;
 
-    // get the sequence to map from the record
     auto seqlen = irecord->core.l_qseq;
 
     // get query name.
     std::string_view qname(bam_get_qname(irecord));
 
-    auto bseq = bam_get_seq(irecord);
-    std::string seq = utils::convert_nt16_to_str(bseq, seqlen);
-    // Pre-generate reverse complement sequence.
-    std::string seq_rev = utils::reverse_complement(seq);
+    // The forward strand's packed sequence and quality are taken straight from the input
+    // record, and the reverse strand's are only made if a hit with them is output.
+    const uint8_t* packed_seq = bam_get_seq(irecord);
+    const uint8_t* qual = bam_get_qual(irecord);
+    bool have_reverse_strand = false;
 
-    // Pre-generate reverse of quality string.
-    std::vector<uint8_t> qual;
-    std::vector<uint8_t> qual_rev;
-    if (bam_get_qual(irecord)) {
-        qual = std::vector<uint8_t>(bam_get_qual(irecord), bam_get_qual(irecord) + seqlen);
-        qual_rev = std::vector<uint8_t>(qual.rbegin(), qual.rend());
-    }
-
-    // do the mapping
-    int hits = 0;
-    mm_reg1_t* reg =
-            mm_map(m_index, seq.length(), seq.c_str(), &hits, buf, &m_map_opt, qname.data());
+    auto& part_hits = mapped.parts;
 
     // just return the input record
-    if (hits == 0) {
+    if (mapped.total_hits == 0) {
         results.push_back(BamPtr(bam_dup1(irecord)));
     }
 
-    for (int j = 0; j < hits; j++) {
-        // new output record
-        bam1_t* record = bam_init1();
-
-        // mapping region
-        auto aln = &reg[j];
+    for (size_t part = 0; part < part_hits.size(); ++part) {
+        const auto* index_part = m_index_parts[part];
+        auto* reg = part_hits[part].regs;
+        const bool is_best_part = part == mapped.best_part;
+        for (int j = 0; j < part_hits[part].num_hits; j++) {
+            // new output record
+            bam1_t* record = bam_init1();
 
-        // Set FLAGS
-        uint16_t flag = 0x0;
+            // mapping region
+            auto aln = &reg[j];
+            const bool primary_chain = is_best_part && aln->parent == aln->id;
 
-        if (aln->rev) {
-            flag |= BAM_FREVERSE;
-        }
-        if (aln->parent != aln->id) {
-            flag |= BAM_FSECONDARY;
-        } else if (!aln->sam_pri) {
-            flag |= BAM_FSUPPLEMENTARY;
-        }
+            // Set FLAGS
+            uint16_t flag = 0x0;
 
-        int32_t tid = aln->rid;
-        hts_pos_t pos = aln->rs;
-        uint8_t mapq = aln->mapq;
-
-        // Create CIGAR.
-        // Note: max_bam_cigar_op doesn't need to handled specially when
-        // using htslib since the sam_write1 method already takes care
-        // of moving the CIGAR string to the tags if the length
-        // exceeds 65535.
-        size_t n_cigar = aln->p ? aln->p->n_cigar : 0;
-        std::vector<uint32_t> cigar;
-        if (n_cigar != 0) {
-            uint32_t clip_len[2] = {0};
-            clip_len[0] = aln->rev ? irecord->core.l_qseq - aln->qe : aln->qs;
-            clip_len[1] = aln->rev ? aln->qs : irecord->core.l_qseq - aln->qe;
-
-            if (clip_len[0]) {
-                n_cigar++;
+            if (aln->rev) {
+                flag |= BAM_FREVERSE;
             }
-            if (clip_len[1]) {
-                n_cigar++;
+            if (!primary_chain) {
+                flag |= BAM_FSECONDARY;
+            } else if (!aln->sam_pri) {
+                flag |= BAM_FSUPPLEMENTARY;
             }
-            int offset = clip_len[0] ? 1 : 0;
-
-            cigar.resize(n_cigar);
 
-            // write the left softclip
-            if (clip_len[0]) {
-                auto clip = bam_cigar_gen(clip_len[0], BAM_CSOFT_CLIP);
-                cigar[0] = clip;
+            int32_t tid = m_part_tid_offsets[part] + aln->rid;
+            hts_pos_t pos = aln->rs;
+            uint8_t mapq =
+                    is_best_part ? static_cast<uint8_t>(aln->mapq * mapped.mapq_scale + .499f) : 0;
+
+            // Create CIGAR.
+            // Note: max_bam_cigar_op doesn't need to handled specially when
+            // using htslib since the sam_write1 method already takes care
+            // of moving the CIGAR string to the tags if the length
+            // exceeds 65535.
+            size_t n_cigar = aln->p ? aln->p->n_cigar : 0;
+            auto& cigar = scratch.cigar;
+            if (n_cigar != 0) {
+                uint32_t clip_len[2] = {0};
+                clip_len[0] = aln->rev ? irecord->core.l_qseq - aln->qe : aln->qs;
+                clip_len[1] = aln->rev ? aln->qs : irecord->core.l_qseq - aln->qe;
+
+                if (clip_len[0]) {
+                    n_cigar++;
+                }
+                if (clip_len[1]) {
+                    n_cigar++;
+                }
+                int offset = clip_len[0] ? 1 : 0;
+
+                cigar.resize(n_cigar);
+
+                // write the left softclip
+                if (clip_len[0]) {
+                    auto clip = bam_cigar_gen(clip_len[0], BAM_CSOFT_CLIP);
+                    cigar[0] = clip;
+                }
+
+                // write the cigar
+                memcpy(&cigar[offset], aln->p->cigar, aln->p->n_cigar * sizeof(uint32_t));
+
+                // write the right softclip
+                if (clip_len[1]) {
+                    auto clip = bam_cigar_gen(clip_len[1], BAM_CSOFT_CLIP);
+                    cigar[offset + aln->p->n_cigar] = clip;
+                }
             }
 
-            // write the cigar
-            memcpy(&cigar[offset], aln->p->cigar, aln->p->n_cigar * sizeof(uint32_t));
+            // Add SEQ and QUAL.
+            size_t l_seq = 0;
+            const uint8_t* seq_tmp = nullptr;
+            const uint8_t* qual_tmp = nullptr;
+            if (flag & BAM_FSECONDARY) {
+                // To match minimap2 output behavior, don't emit sequence
+                // or quality info for secondary alignments.
+            } else {
+                l_seq = seq.size();
+                if (aln->rev) {
+                    if (!have_reverse_strand) {
+                        scratch.packed_seq_rev =
+                                utils::PackedSequence::from_nt16(packed_seq, seqlen)
+                                        .reverse_complement();
+                        scratch.qual_rev.assign(std::make_reverse_iterator(qual + seqlen),
+                                                std::make_reverse_iterator(qual));
+                        have_reverse_strand = true;
+                    }
+                    seq_tmp = scratch.packed_seq_rev.data();
+                    qual_tmp = scratch.qual_rev.data();
+                } else {
+                    seq_tmp = packed_seq;
+                    qual_tmp = qual;
+                }
+            }
 
-            // write the right softclip
-            if (clip_len[1]) {
-                auto clip = bam_cigar_gen(clip_len[1], BAM_CSOFT_CLIP);
-                cigar[offset + aln->p->n_cigar] = clip;
+            // The tags are made first so that the record's data is allocated once, at its
+            // final size.
+            make_tags(scratch, aln, seq, index_part, part_hits[part].rep_len, primary_chain);
+            const size_t l_aux_in = bam_get_l_aux(irecord);
+            const size_t l_seq_bytes = (l_seq + 1) / 2;
+
+            // Set properties of the BAM record.
+            // NOTE: Passing bam_get_qname(irecord) + l_qname into bam_set1
+            // was causing the generated string to have some extra
+            // null characters. Not sure why yet. Using string_view
+            // resolved that issue, which is okay to use since it doesn't
+            // copy any data and we know the underlying string is null
+            // terminated.
+            // TODO: See if bam_get_qname(irecord) usage can be fixed.
+            // bam_set1 only encodes ASCII bases, so it is given no SEQ and QUAL, and room for
+            // them to be copied in already packed after it.
+            bam_set1(record, qname.size(), qname.data(), flag, tid, pos, mapq, n_cigar,
+                     n_cigar ? cigar.data() : nullptr, irecord->core.mtid, irecord->core.mpos,
+                     irecord->core.isize, 0, nullptr, nullptr,
+                     l_seq_bytes + l_seq + l_aux_in + scratch.tags.size());
+            record->core.l_qseq = int32_t(l_seq);
+            if (l_seq != 0) {
+                memcpy(bam_get_seq(record), seq_tmp, l_seq_bytes);
+                memcpy(bam_get_qual(record), qual_tmp, l_seq);
             }
+            record->l_data += int(l_seq_bytes + l_seq);
+
+            // Copy over tags from input alignment, then add new tags to match minimap2.
+            uint8_t* aux = bam_get_aux(record);
+            memcpy(aux, bam_get_aux(irecord), l_aux_in);
+            memcpy(aux + l_aux_in, scratch.tags.data(), scratch.tags.size());
+            record->l_data += int(l_aux_in + scratch.tags.size());
+
+            free(aln->p);
+            results.push_back(BamPtr(record));
         }
+        free(reg);
+    }
+
+    return results;
+}
 
-        // Add SEQ and QUAL.
-        size_t l_seq = 0;
-        char* seq_tmp = nullptr;
-        unsigned char* qual_tmp = nullptr;
-        if (flag & BAM_FSECONDARY) {
-            // To match minimap2 output behavior, don't emit sequence
-            // or quality info for secondary alignments.
+std::vector<Message> Aligner::align_on_device(std::vector<Message>& messages,
+                                              mm_tbuf_t* buf,
+                                              AlignScratch& scratch) {
+    DORADO_TRACE_SCOPE("align_on_device");
+    // The records to align, each with the index of the message it came from.
+    struct Input {
+        BamPtr record;
+        std::string seq;
+        size_t message;
+        MappedParts mapped;
+        // Index of the first of its hits' alignments.
+        size_t first_hit{0};
+    };
+    std::vector<Input> inputs;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        auto& message = messages[i];
+        if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+            auto& read = *std::get<std::shared_ptr<Read>>(message);
+            if (m_rna) {
+                std::reverse(read.seq.begin(), read.seq.end());
+                std::reverse(read.qstring.begin(), read.qstring.end());
+            }
+            auto records = read.extract_sam_lines(m_emit_moves, m_modbase_threshold, m_pack_moves);
+            // As in align(Read&), reads with several records are aligned from their records.
+            if (records.size() == 1) {
+                inputs.push_back({std::move(records.front()), read.seq, i});
+                continue;
+            }
+            for (auto& record : records) {
+                inputs.push_back({std::move(record), std::string(), i});
+            }
         } else {
-            l_seq = seq.size();
-            if (aln->rev) {
-                seq_tmp = seq_rev.data();
-                qual_tmp = qual_rev.empty() ? nullptr : qual_rev.data();
-            } else {
-                seq_tmp = seq.data();
-                qual_tmp = qual.empty() ? nullptr : qual.data();
+            inputs.push_back({std::get<BamPtr>(std::move(message)), std::string(), i});
+        }
+    }
+
+    // Map every record, then align the query and reference ranges of all their hits as one
+    // batch.  The ranges are copied out first, so views of them stay valid.
+    std::vector<std::string> ranges;
+    std::vector<uint8_t> ref_codes;
+    for (auto& input : inputs) {
+        auto* record = input.record.get();
+        if (input.seq.empty()) {
+            utils::convert_nt16_to_str(bam_get_seq(record), record->core.l_qseq, input.seq);
+        }
+        input.mapped = map_to_parts(input.seq, bam_get_qname(record), buf, m_chain_map_opt);
+        input.first_hit = ranges.size() / 2;
+        bool have_reverse_strand = false;
+        for (size_t part = 0; part < input.mapped.parts.size(); ++part) {
+            const auto& hits = input.mapped.parts[part];
+            for (int j = 0; j < hits.num_hits; ++j) {
+                const auto& aln = hits.regs[j];
+                // Reverse strand hits align the reverse complement of the query, as minimap2's
+                // extension does.
+                if (aln.rev) {
+                    if (!have_reverse_strand) {
+                        utils::reverse_complement(input.seq, scratch.seq_rev);
+                        have_reverse_strand = true;
+                    }
+                    ranges.emplace_back(scratch.seq_rev, input.seq.size() - aln.qe,
+                                        aln.qe - aln.qs);
+                } else {
+                    ranges.emplace_back(input.seq, aln.qs, aln.qe - aln.qs);
+                }
+                ref_codes.resize(aln.re - aln.rs);
+                mm_idx_getseq(m_index_parts[part], aln.rid, aln.rs, aln.re, ref_codes.data());
+                auto& ref = ranges.emplace_back(ref_codes.size(), 'N');
+                for (size_t k = 0; k < ref_codes.size(); ++k) {
+                    ref[k] = "ACGTN"[std::min<uint8_t>(ref_codes[k], 4)];
+                }
             }
         }
+    }
+    std::vector<utils::BandedAligner::SequencePair> pairs(ranges.size() / 2);
+    for (size_t k = 0; k < pairs.size(); ++k) {
+        pairs[k] = {ranges[2 * k], ranges[2 * k + 1]};
+    }
+    std::vector<utils::BandedAlignment> alignments;
+    if (!pairs.empty()) {
+        alignments = m_device_extender->align(pairs);
+    }
 
-        // Set properties of the BAM record.
-        // NOTE: Passing bam_get_qname(irecord) + l_qname into bam_set1
-        // was causing the generated string to have some extra
-        // null characters. Not sure why yet. Using string_view
-        // resolved that issue, which is okay to use since it doesn't
-        // copy any data and we know the underlying string is null
-        // terminated.
-        // TODO: See if bam_get_qname(irecord) usage can be fixed.
-        bam_set1(record, qname.size(), qname.data(), flag, tid, pos, mapq, n_cigar,
-                 cigar.empty() ? nullptr : cigar.data(), irecord->core.mtid, irecord->core.mpos,
-                 irecord->core.isize, l_seq, seq_tmp, (char*)qual_tmp, bam_get_l_aux(irecord));
+    std::vector<std::vector<BamPtr>> message_records(messages.size());
+    for (auto& input : inputs) {
+        const auto* first = alignments.data() + input.first_hit;
+        const auto* last = first + input.mapped.total_hits;
+        const bool in_band = std::all_of(
+                first, last, [](const auto& alignment) { return alignment.edit_distance >= 0; });
+        std::vector<BamPtr> records;
+        if (in_band) {
+            set_extension(input.mapped, first, scratch.cigar);
+            m_num_device_extended_hits += input.mapped.total_hits;
+            records = build_records(input.record.get(), input.seq, input.mapped, scratch);
+        } else {
+            // A hit ran along the edge of the band, so the record is aligned by minimap2.
+            for (auto& hits : input.mapped.parts) {
+                for (int j = 0; j < hits.num_hits; ++j) {
+                    free(hits.regs[j].p);
+                }
+                free(hits.regs);
+            }
+            ++m_num_device_fallback_records;
+            records = align_sequence(input.record.get(), input.seq, buf, scratch);
+        }
+        auto& output = message_records[input.message];
+        std::move(records.begin(), records.end(), std::back_inserter(output));
+    }
 
-        // Copy over tags from input alignment.
-        memcpy(bam_get_aux(record), bam_get_aux(irecord), bam_get_l_aux(irecord));
-        record->l_data += bam_get_l_aux(irecord);
+    std::vector<Message> aligned;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        auto& records = message_records[i];
+        if (std::holds_alternative<std::shared_ptr<Read>>(messages[i])) {
+            auto& read = std::get<std::shared_ptr<Read>>(messages[i]);
+            if (read->order_ticket) {
+                read->order_ticket->finish(records);
+            }
+        }
+        for (auto& record : records) {
+            aligned.push_back(std::move(record));
+        }
+    }
+    return aligned;
+}
 
-        // Add new tags to match minimap2.
-        add_tags(record, aln, seq, buf);
+void Aligner::set_extension(MappedParts& mapped,
+                            const utils::BandedAlignment* alignments,
+                            std::vector<uint32_t>& cigar) {
+    using utils::BandedAligner;
+    for (auto& hits : mapped.parts) {
+        for (int j = 0; j < hits.num_hits; ++j) {
+            auto& aln = hits.regs[j];
+            const auto& path = (alignments++)->path;
+            // Matches and mismatches are both M, and the path is scored with minimap2's
+            // affine gap penalties.
+            cigar.clear();
+            int32_t matches = 0;
+            int32_t score = 0;
+            for (const auto op : path) {
+                const uint32_t cigar_op = op == BandedAligner::kInsertion  ? BAM_CINS
+                                          : op == BandedAligner::kDeletion ? BAM_CDEL
+                                                                           : BAM_CMATCH;
+                const bool extends_op = !cigar.empty() && bam_cigar_op(cigar.back()) == cigar_op;
+                if (op == BandedAligner::kMatch) {
+                    ++matches;
+                    score += m_map_opt.a;
+                } else if (op == BandedAligner::kMismatch) {
+                    score -= m_map_opt.b;
+                } else {
+                    score -= extends_op ? m_map_opt.e : m_map_opt.q + m_map_opt.e;
+                }
+                if (extends_op) {
+                    cigar.back() += 1 << BAM_CIGAR_SHIFT;
+                } else {
+                    cigar.push_back(bam_cigar_gen(1, cigar_op));
+                }
+            }
 
-        free(aln->p);
-        results.push_back(BamPtr(record));
+            auto* extra = static_cast<mm_extra_t*>(
+                    calloc(1, sizeof(mm_extra_t) + cigar.size() * sizeof(uint32_t)));
+            extra->capacity = static_cast<uint32_t>(cigar.size());
+            extra->dp_score = score;
+            extra->dp_max = score;
+            extra->n_cigar = static_cast<uint32_t>(cigar.size());
+            memcpy(extra->cigar, cigar.data(), cigar.size() * sizeof(uint32_t));
+            free(aln.p);
+            aln.p = extra;
+            aln.blen = static_cast<int32_t>(path.size());
+            aln.mlen = matches;
+        }
     }
-
-    free(reg);
-    return results;
 }
 
-stats::NamedStats Aligner::sample_stats() const { return stats::from_obj(m_work_queue); }
+stats::NamedStats Aligner::sample_stats() const {
+    auto stats = stats::from_obj(m_work_queue);
+    if (m_device_extender) {
+        stats["device_extended_hits"] = m_num_device_extended_hits;
+        stats["device_fallback_records"] = m_num_device_fallback_records;
+    }
+    return stats;
+}
 
 }  // namespace dorado
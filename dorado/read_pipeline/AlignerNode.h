@@ -2,28 +2,88 @@
 #include "htslib/sam.h"
 #include "minimap.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/BandedAligner.h"
+#include "utils/PackedSequence.h"
 #include "utils/stats.h"
 #include "utils/types.h"
 
 #include <atomic>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace dorado {
 
 using sq_t = std::vector<std::pair<char*, uint32_t>>;
 
+// How reads passed to the aligner are converted to records, as in ReadToBamType.
+struct ReadConversionOptions {
+    bool emit_moves{false};
+    bool rna{false};
+    float modbase_threshold_frac{0.f};
+    bool pack_moves{false};
+};
+
 class Aligner : public MessageSink {
 public:
+    // Buffers each worker thread reuses for every record it aligns, so that building the
+    // output records doesn't allocate temporaries per record.
+    struct AlignScratch {
+        AlignScratch() = default;
+        ~AlignScratch() { free(md); }
+        AlignScratch(const AlignScratch&) = delete;
+        AlignScratch& operator=(const AlignScratch&) = delete;
+
+        std::string seq;
+        // Only filled in for records with a reverse strand hit.
+        std::string seq_rev;
+        utils::PackedSequence packed_seq_rev;
+        std::vector<uint8_t> qual_rev;
+        std::vector<uint32_t> cigar;
+        // The tags added to the current output record, in BAM aux format.
+        std::vector<uint8_t> tags;
+        // MD string buffer, grown as needed by mm_gen_MD.
+        char* md{nullptr};
+        int md_capacity{0};
+    };
+
+    // |filename| is either a reference to index or a prebuilt minimap2 .mmi index, which is
+    // loaded as is.  If |index_output| is given, an index built from a reference is also
+    // written there, so that later runs can load it instead of indexing again.
+    // Records are aligned in batches by each thread, so their output order depends on thread
+    // timing unless |keep_input_order| is set, in which case batches are passed on in the
+    // order they were received.
+    // Both unaligned BAM records and called reads are accepted.  Reads are converted with
+    // |read_conversion| and aligned using their sequence directly, so pipelines don't need a
+    // ReadToBamType node in front of the aligner.
+    // If |emit_paf| is set, each input is passed on as a PafLines message of its alignments
+    // instead, and no base-level alignment is done, so there is no CIGAR or MD.
+    // If |device_extender| is given, minimap2 only seeds and chains, and each batch's hits are
+    // aligned base by base on its device instead.  The alignments are global over the chained
+    // query and reference ranges, so their ends and gap placement can differ from minimap2's
+    // extension, and AS/ms are scored from the edit path.  Records with a hit the band can't
+    // hold are aligned by minimap2 as usual.
     Aligner(MessageSink& read_sink,
             const std::string& filename,
             int k,
             int w,
             uint64_t index_batch_size,
-            int threads);
+            int threads,
+            const std::string& index_output = "",
+            bool keep_input_order = false,
+            ReadConversionOptions read_conversion = {},
+            bool emit_paf = false,
+            std::shared_ptr<utils::BandedAligner> device_extender = nullptr);
     ~Aligner();
+    void join() override;
     std::string get_name() const override { return "Aligner"; }
     stats::NamedStats sample_stats() const override;
-    std::vector<BamPtr> align(bam1_t* record, mm_tbuf_t* buf);
+    std::vector<BamPtr> align(bam1_t* record, mm_tbuf_t* buf, AlignScratch& scratch);
+    // Aligns a called read, returning its records as in ReadToBamType if it is unmapped.
+    std::vector<BamPtr> align(Read& read, mm_tbuf_t* buf, AlignScratch& scratch);
     sq_t get_sequence_records_for_header();
 
 private:
@@ -31,14 +91,86 @@ private:
     size_t m_threads{1};
     std::atomic<size_t> m_active{0};
     std::vector<mm_tbuf_t*> m_tbufs;
+    std::vector<AlignScratch> m_scratch;
     std::vector<std::unique_ptr<std::thread>> m_workers;
     void worker_thread(size_t tid);
-    void add_tags(bam1_t*, const mm_reg1_t*, const std::string&, const mm_tbuf_t*);
+    // The hits of a sequence in each part of the index, with the part whose primary is
+    // reported and the factor its hits' mapq is scaled by.  The caller frees the hits.
+    struct PartHits {
+        mm_reg1_t* regs;
+        int num_hits;
+        int rep_len;
+    };
+    struct MappedParts {
+        std::vector<PartHits> parts;
+        int total_hits{0};
+        size_t best_part{0};
+        float mapq_scale{1.f};
+    };
+    MappedParts map_to_parts(const std::string& seq,
+                             const char* qname,
+                             mm_tbuf_t* buf,
+                             const mm_mapopt_t& map_opt);
+    // Maps the sequence, as minimap2 does for PAF output without base-level alignment.
+    PafLines map_to_paf(const std::string& qname, const std::string& seq, mm_tbuf_t* buf);
+    // The PAF lines of a called read or BAM record.
+    PafLines paf_message(Message&& message, mm_tbuf_t* buf, AlignScratch& scratch);
+    // Aligns the record, whose sequence is |seq|.
+    std::vector<BamPtr> align_sequence(bam1_t* record,
+                                       const std::string& seq,
+                                       mm_tbuf_t* buf,
+                                       AlignScratch& scratch);
+    // Builds the output records of the record's hits, freeing them.
+    std::vector<BamPtr> build_records(bam1_t* record,
+                                      const std::string& seq,
+                                      MappedParts& mapped,
+                                      AlignScratch& scratch);
+    // Aligns a batch of inputs with their hits extended on m_device_extender, returning the
+    // aligned records in input order.
+    std::vector<Message> align_on_device(std::vector<Message>& messages,
+                                         mm_tbuf_t* buf,
+                                         AlignScratch& scratch);
+    // Gives each hit of |mapped| the CIGAR and scores of its edit path.
+    void set_extension(MappedParts& mapped,
+                       const utils::BandedAlignment* alignments,
+                       std::vector<uint32_t>& cigar);
+    // Passes on the aligned records of the given input batch once all earlier batches have
+    // been passed on.
+    void push_in_order(uint64_t batch_index, std::vector<Message>&& aligned);
+    // Writes the alignment's tags into scratch.tags.
+    void make_tags(AlignScratch& scratch,
+                   const mm_reg1_t*,
+                   const std::string&,
+                   const mm_idx_t* index,
+                   int rep_len,
+                   bool primary_chain);
 
     mm_idxopt_t m_idx_opt;
     mm_mapopt_t m_map_opt;
-    mm_idx_t* m_index{nullptr};
-    mm_idx_reader_t* m_index_reader{nullptr};
+    // m_map_opt without base-level alignment, for mapping whose hits are extended on the device.
+    mm_mapopt_t m_chain_map_opt;
+    std::shared_ptr<utils::BandedAligner> m_device_extender;
+    std::atomic<size_t> m_num_device_extended_hits{0};
+    std::atomic<size_t> m_num_device_fallback_records{0};
+    // The parts of the index, which is split when the reference is larger than the index batch
+    // size.  Reads are mapped against every part.
+    std::vector<mm_idx_t*> m_index_parts;
+    // Offset of each part's reference sequences in the output header.
+    std::vector<int32_t> m_part_tid_offsets;
+
+    bool m_keep_input_order{false};
+    bool m_emit_paf{false};
+    bool m_emit_moves{false};
+    bool m_pack_moves{false};
+    bool m_rna{false};
+    uint8_t m_modbase_threshold{0};
+    // Serialises popping so batch indices follow input order.
+    std::mutex m_pop_mutex;
+    uint64_t m_num_batches_popped{0};
+    // Aligned batches waiting for earlier batches.  There is at most one per worker thread.
+    std::mutex m_reorder_mutex;
+    std::map<uint64_t, std::vector<Message>> m_reorder_buffer;
+    uint64_t m_next_batch_to_push{0};
 };
 
 }  // namespace dorado
@@ -0,0 +1,129 @@
+#include "ArrowWriterNode.h"
+
+#include "utils/base_mod_utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace dorado {
+
+using Column = utils::ArrowStreamWriter::Column;
+using Type = utils::ArrowStreamWriter::Type;
+
+std::vector<Column> ArrowWriterNode::make_columns() {
+    // append_row() fills them in this order.
+    return {
+            {"read_id", Type::Utf8},
+            {"parent_read_id", Type::Utf8},
+            {"run_id", Type::Utf8},
+            {"model_name", Type::Utf8},
+            {"channel", Type::Int32},
+            {"mux", Type::UInt32},
+            {"read_number", Type::Int32},
+            {"start_time", Type::Utf8},
+            {"start_sample", Type::UInt64},
+            {"num_samples", Type::UInt64},
+            {"num_trimmed_samples", Type::UInt64},
+            {"sample_rate", Type::UInt64},
+            {"shift", Type::Float32},
+            {"scale", Type::Float32},
+            {"mean_qscore", Type::Float32},
+            {"seq", Type::Utf8},
+            {"qstring", Type::Utf8},
+            {"model_stride", Type::Int32},
+            {"moves", Type::UInt8List},
+            {"barcode", Type::Utf8},
+            // As Read::base_mod_probs, with the modified bases' alphabet, empty if no modbase
+            // models ran.
+            {"modbase_alphabet", Type::Utf8},
+            {"modbase_positions", Type::UInt32List},
+            {"modbase_probs", Type::UInt8List},
+    };
+}
+
+void ArrowWriterNode::append_row(const Read& read, std::vector<Column>& columns) {
+    size_t i = 0;
+    columns[i++].append(read.read_id);
+    columns[i++].append(read.parent_read_id);
+    columns[i++].append(read.run_id);
+    columns[i++].append(read.model_name);
+    columns[i++].append(int32_t(read.attributes.channel_number));
+    columns[i++].append(uint32_t(read.attributes.mux));
+    columns[i++].append(int32_t(read.attributes.read_number));
+    columns[i++].append(read.attributes.start_time);
+    columns[i++].append(uint64_t(read.start_sample));
+    columns[i++].append(uint64_t(read.get_num_raw_samples() + read.num_trimmed_samples));
+    columns[i++].append(uint64_t(read.num_trimmed_samples));
+    columns[i++].append(uint64_t(read.sample_rate));
+    columns[i++].append(float(read.shift));
+    columns[i++].append(float(read.scale));
+    columns[i++].append(read.mean_qscore());
+    columns[i++].append(read.seq);
+    columns[i++].append(read.qstring);
+    columns[i++].append(int32_t(read.model_stride));
+    columns[i++].append(read.moves);
+    columns[i++].append(read.barcode);
+    columns[i++].append(read.base_mod_info ? read.base_mod_info->alphabet : std::string());
+    columns[i++].append(read.base_mod_positions);
+    columns[i++].append(read.base_mod_probs);
+}
+
+void ArrowWriterNode::write_batch() {
+    const auto num_rows = m_columns.front().num_rows();
+    if (num_rows == 0) {
+        return;
+    }
+    m_writer->write_batch(m_columns);
+    fflush(m_file);
+    m_num_rows_written += num_rows;
+    ++m_num_batches_written;
+}
+
+void ArrowWriterNode::process_message(Message&& message) {
+    if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        append_row(*std::get<std::shared_ptr<Read>>(message), m_columns);
+        if (m_columns.front().num_rows() >= m_rows_per_batch) {
+            write_batch();
+        }
+    }
+    m_sink.push_message(std::move(message));
+}
+
+ArrowWriterNode::ArrowWriterNode(MessageSink& sink,
+                                 const std::string& filename,
+                                 size_t rows_per_batch)
+        : MessageSink(1000),
+          m_sink(sink),
+          m_rows_per_batch(std::max(rows_per_batch, size_t(1))),
+          m_columns(make_columns()) {
+    m_file = fopen(filename.c_str(), "wb");
+    if (!m_file) {
+        throw std::runtime_error("Could not open Arrow output file: " + filename);
+    }
+    m_writer = std::make_unique<utils::ArrowStreamWriter>(m_file, m_columns);
+    fflush(m_file);
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); }, 1,
+                          [this] {
+                              write_batch();
+                              m_writer->finish();
+                              m_sink.terminate();
+                          });
+}
+
+ArrowWriterNode::~ArrowWriterNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+    fclose(m_file);
+}
+
+void ArrowWriterNode::join() { join_pool_processing(); }
+
+stats::NamedStats ArrowWriterNode::sample_stats() const {
+    stats::NamedStats stats = stats::from_obj(m_work_queue);
+    stats["rows_written"] = m_num_rows_written;
+    stats["batches_written"] = m_num_batches_written;
+    return stats;
+}
+
+}  // namespace dorado
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/ArrowStreamWriter.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+/// Class to write the called reads as an Arrow IPC stream as they pass on to the sink, so that
+/// analyses can map or stream the calls column by column instead of parsing BAM or FASTQ.
+/// The file can be a named pipe, or in shared memory such as /dev/shm.  Each record batch holds
+/// up to rows_per_batch reads, and the stream is flushed after each one.
+class ArrowWriterNode : public MessageSink {
+public:
+    ArrowWriterNode(MessageSink& sink, const std::string& filename, size_t rows_per_batch = 1000);
+    ~ArrowWriterNode();
+    void join() override;
+    std::string get_name() const override { return "ArrowWriterNode"; }
+    stats::NamedStats sample_stats() const override;
+
+    // The columns written for each read, in order, with no rows.
+    static std::vector<utils::ArrowStreamWriter::Column> make_columns();
+    // Appends the row of a read to columns made by make_columns().
+    static void append_row(const Read& read,
+                           std::vector<utils::ArrowStreamWriter::Column>& columns);
+
+private:
+    // Adds the row of a read, on the shared CPU thread pool, one read at a time.
+    void process_message(Message&& message);
+    void write_batch();
+
+    MessageSink& m_sink;
+    FILE* m_file{nullptr};
+    const size_t m_rows_per_batch;
+    std::vector<utils::ArrowStreamWriter::Column> m_columns;
+    std::unique_ptr<utils::ArrowStreamWriter> m_writer;
+    std::atomic<int64_t> m_num_rows_written{0};
+    std::atomic<int64_t> m_num_batches_written{0};
+};
+
+}  // namespace dorado
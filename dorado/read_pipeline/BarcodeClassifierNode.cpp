@@ -0,0 +1,141 @@
+#include "BarcodeClassifierNode.h"
+
+#include "utils/sequence_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <limits>
+#include <string_view>
+
+namespace dorado {
+
+BarcodeClassifierNode::BarcodeClassifierNode(MessageSink& sink,
+                                             BarcodeClassifierSettings settings,
+                                             int num_worker_threads,
+                                             size_t max_reads)
+        : MessageSink(max_reads), m_sink(sink), m_settings(std::move(settings)) {
+    const auto names = barcode_names(m_settings.kits);
+    for (const auto& kit : m_settings.kits) {
+        for (const auto& barcode : kit.barcodes) {
+            m_matchers.push_back(
+                    {names[m_matchers.size()],
+                     utils::PatternMatcher(kit.front_flank + barcode.second + kit.rear_flank)});
+        }
+    }
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                          num_worker_threads, [this] { m_sink.terminate(); });
+}
+
+BarcodeClassifierNode::~BarcodeClassifierNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+}
+
+void BarcodeClassifierNode::join() { join_pool_processing(); }
+
+std::vector<std::string> BarcodeClassifierNode::barcode_names(
+        const std::vector<utils::BarcodeKit>& kits) {
+    std::vector<std::string> names;
+    for (const auto& kit : kits) {
+        for (const auto& barcode : kit.barcodes) {
+            names.push_back(kit.name + "_" + barcode.first);
+        }
+    }
+    return names;
+}
+
+bool BarcodeClassifierNode::classify(Read& read) const {
+    read.barcode = kUnclassified;
+    if (read.seq.empty() || m_matchers.empty()) {
+        return false;
+    }
+
+    // The rear window is reverse complemented, so that both ends are matched by the same
+    // pattern, and each matcher scores both windows in one batch.
+    const size_t window = std::min(m_settings.search_window, read.seq.size());
+    const std::string_view front(read.seq.data(), window);
+    const std::string rear_rc =
+            utils::reverse_complement(read.seq.substr(read.seq.size() - window));
+    const std::vector<std::string_view> windows{front, rear_rc};
+
+    constexpr int kNoMatch = std::numeric_limits<int>::max();
+    const BarcodeMatcher* best = nullptr;
+    int best_score = kNoMatch;
+    int runner_up_score = kNoMatch;
+    std::optional<int> best_front, best_rear;
+    for (const auto& barcode : m_matchers) {
+        const auto distances = barcode.matcher.edit_distances(windows, m_settings.max_edits);
+        int score = kNoMatch;
+        if (m_settings.require_both_ends) {
+            if (distances[0] && distances[1]) {
+                score = std::max(*distances[0], *distances[1]);
+            }
+        } else if (distances[0] || distances[1]) {
+            score = std::min(distances[0].value_or(kNoMatch), distances[1].value_or(kNoMatch));
+        }
+        if (score < best_score) {
+            runner_up_score = best_score;
+            best_score = score;
+            best = &barcode;
+            best_front = distances[0];
+            best_rear = distances[1];
+        } else if (score < runner_up_score) {
+            runner_up_score = score;
+        }
+    }
+
+    if (!best || (runner_up_score != kNoMatch &&
+                  runner_up_score - best_score < m_settings.min_edit_gap)) {
+        return false;
+    }
+    read.barcode = best->name;
+
+    if (m_settings.trim) {
+        // Everything up to the end of the front match, and from the start of the rear match,
+        // which is the end of its match in the reverse complemented window.
+        size_t num_front = 0;
+        size_t num_rear = 0;
+        if (best_front) {
+            if (auto match = best->matcher.find_best_match(front, m_settings.max_edits)) {
+                num_front = match->second;
+            }
+        }
+        if (best_rear) {
+            if (auto match = best->matcher.find_best_match(rear_rc, m_settings.max_edits)) {
+                num_rear = match->second;
+            }
+        }
+        if (num_front + num_rear < read.seq.size()) {
+            read.trim_bases(num_front, num_rear);
+        } else {
+            spdlog::trace("Barcode matches cover all of read {}, so it isn't trimmed",
+                          read.read_id);
+        }
+    }
+    return true;
+}
+
+void BarcodeClassifierNode::process_message(Message&& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        m_sink.push_message(std::move(message));
+        return;
+    }
+    auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+    if (classify(*read)) {
+        ++m_num_classified;
+    } else {
+        ++m_num_unclassified;
+    }
+    m_sink.push_message(std::move(read));
+}
+
+stats::NamedStats BarcodeClassifierNode::sample_stats() const {
+    stats::NamedStats stats = stats::from_obj(m_work_queue);
+    stats["reads_classified"] = m_num_classified;
+    stats["reads_unclassified"] = m_num_unclassified;
+    return stats;
+}
+
+}  // namespace dorado
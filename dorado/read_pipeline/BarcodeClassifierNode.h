@@ -0,0 +1,71 @@
+#pragma once
+#include "ReadPipeline.h"
+
+#include <utils/PatternMatcher.h>
+#include <utils/barcode_kits.h>
+#include <utils/stats.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+struct BarcodeClassifierSettings {
+    std::vector<utils::BarcodeKit> kits;
+    // Bases at each end of the read searched for a barcode.
+    size_t search_window = 150;
+    // Highest edit distance of a barcode, with its flanks, to be matched.
+    int max_edits = 9;
+    // How much lower the best barcode's edit distance must be than that of any other.
+    int min_edit_gap = 2;
+    // Whether the barcode must be found at both ends, rather than at either.
+    bool require_both_ends = false;
+    // Whether the matched barcodes and everything outside them are trimmed from the read.
+    bool trim = false;
+};
+
+/// Classifies basecalled reads by the barcode at their ends, setting Read::barcode to
+/// <kit>_<barcode>, or "unclassified" if no barcode is a clear best match.
+class BarcodeClassifierNode : public MessageSink {
+public:
+    static constexpr const char* kUnclassified = "unclassified";
+
+    BarcodeClassifierNode(MessageSink& sink,
+                          BarcodeClassifierSettings settings,
+                          int num_worker_threads,
+                          size_t max_reads = 1000);
+    ~BarcodeClassifierNode();
+    void join() override;
+    std::string get_name() const override { return "BarcodeClassifierNode"; }
+    stats::NamedStats sample_stats() const override;
+
+    // The barcode names which may be assigned, in the order of the kits and their barcodes.
+    static std::vector<std::string> barcode_names(const std::vector<utils::BarcodeKit>& kits);
+
+    // Classifies, and if enabled trims, the read.  Returns whether a barcode was assigned.
+    bool classify(Read& read) const;
+
+private:
+    // The whole front arrangement of flanks and barcode, which the rear of a read matches
+    // when reverse complemented.
+    struct BarcodeMatcher {
+        std::string name;
+        utils::PatternMatcher matcher;
+    };
+
+    // Classifies a read, on the shared CPU thread pool.
+    void process_message(Message&& message);
+
+    MessageSink& m_sink;
+    const BarcodeClassifierSettings m_settings;
+    std::vector<BarcodeMatcher> m_matchers;
+
+    std::atomic<int64_t> m_num_classified{0};
+    std::atomic<int64_t> m_num_unclassified{0};
+};
+
+}  // namespace dorado
@@ -1,8 +1,9 @@
 #include "BaseSpaceDuplexCallerNode.h"
 
 #include "3rdparty/edlib/edlib/include/edlib.h"
-#include "cxxpool.h"
+#include "utils/alignment_utils.h"
 #include "utils/duplex_utils.h"
+#include "utils/log_utils.h"
 #include "utils/sequence_utils.h"
 
 #include <spdlog/spdlog.h>
@@ -11,19 +12,21 @@
 
 using namespace std::chrono_literals;
 namespace {
-// Given two sequences, their quality scores, and alignments, computes a consensus sequence
-std::pair<std::vector<char>, std::vector<char>> compute_basespace_consensus(
-        int alignment_start_position,
-        int alignment_end_position,
-        std::vector<uint8_t> target_quality_scores,
-        int target_cursor,
-        std::vector<uint8_t> query_quality_scores,
-        int query_cursor,
-        const std::string_view target_sequence,
-        const std::string_view query_sequence,
-        unsigned char* alignment) {
-    std::vector<char> consensus;
-    std::vector<char> quality_scores_phred;
+// Given two sequences, their quality scores, and alignments, computes a consensus sequence and
+// its quality scores, into consensus and quality_scores_phred.
+void compute_basespace_consensus(int alignment_start_position,
+                                 int alignment_end_position,
+                                 const std::vector<uint8_t>& target_quality_scores,
+                                 int target_cursor,
+                                 const std::vector<uint8_t>& query_quality_scores,
+                                 int query_cursor,
+                                 const std::string_view target_sequence,
+                                 const std::string_view query_sequence,
+                                 unsigned char* alignment,
+                                 std::vector<char>& consensus,
+                                 std::vector<char>& quality_scores_phred) {
+    consensus.clear();
+    quality_scores_phred.clear();
 
     // Loop over each alignment position, within given alignment boundaries
     for (int i = alignment_start_position;
@@ -56,45 +59,110 @@ std::pair<std::vector<char>, std::vector<char>> compute_basespace_consensus(
             query_cursor++;
         }
     }
-    return std::make_pair(consensus, quality_scores_phred);
 }
 }  // namespace
 
 namespace dorado {
 
 void BaseSpaceDuplexCallerNode::worker_thread() {
-    cxxpool::thread_pool pool{m_num_worker_threads};
-    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < m_num_worker_threads; ++i) {
+        m_basespace_worker_threads.emplace_back(
+                &BaseSpaceDuplexCallerNode::basespace_worker_thread, this);
+    }
 
-    for (auto key : m_template_complement_map) {
-        futures.push_back(pool.push([key, this] { return basespace(key.first, key.second); }));
+    if (!m_aligner) {
+        for (const auto& key : m_template_complement_map) {
+            if (!m_pairs_to_call.try_push({key.first, key.second, nullptr})) {
+                break;
+            }
+        }
+    } else {
+        // Align the pairs in batches, and queue each aligned pair for the workers.  The
+        // sequences aligned are views of the reads, and of their reverse complements here.
+        std::vector<PairToCall> batch;
+        std::vector<std::string> complement_reverse_complements;
+        std::vector<utils::BandedAligner::SequencePair> sequences;
+        const auto align_batch = [&] {
+            auto alignments = std::make_shared<std::vector<utils::BandedAlignment>>(
+                    m_aligner->align(sequences));
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].batch_alignments = alignments;
+                batch[i].alignment_index = i;
+            }
+            complement_reverse_complements.clear();
+            sequences.clear();
+            return m_pairs_to_call.try_push_batch(std::move(batch));
+        };
+        complement_reverse_complements.reserve(m_alignment_batch_size);
+        for (const auto& key : m_template_complement_map) {
+            const auto template_read_it = m_reads.find(key.first);
+            const auto complement_read_it = m_reads.find(key.second);
+            if (template_read_it == m_reads.end() || complement_read_it == m_reads.end()) {
+                // Let basespace() report the missing read.
+                if (!m_pairs_to_call.try_push({key.first, key.second, nullptr})) {
+                    break;
+                }
+                continue;
+            }
+            batch.push_back({key.first, key.second, nullptr});
+            const auto& complement_sequence_reverse_complement =
+                    complement_reverse_complements.emplace_back(
+                            utils::reverse_complement(complement_read_it->second->seq));
+            sequences.emplace_back(template_read_it->second->seq,
+                                   complement_sequence_reverse_complement);
+            if (batch.size() == m_alignment_batch_size && !align_batch()) {
+                break;
+            }
+        }
+        if (!batch.empty()) {
+            align_batch();
+        }
     }
-    for (auto& v : futures) {
-        v.get();
+
+    // Let the workers finish the pairs still queued.
+    m_pairs_to_call.terminate();
+    for (auto& worker : m_basespace_worker_threads) {
+        worker.join();
     }
 
     // Notify the sink that the Node has terminated
     m_sink.terminate();
 }
 
-void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
-                                          std::string complement_read_id) {
-    EdlibAlignConfig align_config = edlibDefaultAlignConfig();
-    align_config.task = EDLIB_TASK_PATH;
+void BaseSpaceDuplexCallerNode::basespace_worker_thread() {
+    BasespaceScratch scratch;
+    scratch.align_config = edlibDefaultAlignConfig();
+    scratch.align_config.task = EDLIB_TASK_PATH;
+
+    PairToCall pair;
+    while (m_pairs_to_call.try_pop(pair)) {
+        auto* alignment = pair.batch_alignments
+                                  ? &(*pair.batch_alignments)[pair.alignment_index]
+                                  : nullptr;
+        basespace(pair.template_read_id, pair.complement_read_id, alignment, scratch);
+        // Let go of the batch's alignments once its last pair is called.
+        pair.batch_alignments.reset();
+    }
+}
 
+void BaseSpaceDuplexCallerNode::basespace(const std::string& template_read_id,
+                                          const std::string& complement_read_id,
+                                          utils::BandedAlignment* alignment,
+                                          BasespaceScratch& scratch) {
     std::string_view template_sequence;
     std::shared_ptr<Read> template_read;
-    std::vector<uint8_t> template_quality_scores;
+    auto& template_quality_scores = scratch.template_quality_scores;
     auto template_read_it = m_reads.find(template_read_id);
     if (template_read_it == m_reads.end()) {
-        spdlog::debug("Template Read ID={} is present in pairs file but read was not found",
-                      template_read_id);
+        DORADO_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                            "Template Read ID={} is present in pairs file but read was not found",
+                            template_read_id);
         return;
     } else {
         template_read = template_read_it->second;
         template_sequence = template_read->seq;
-        template_quality_scores =
-                std::vector<uint8_t>(template_read->qstring.begin(), template_read->qstring.end());
+        template_quality_scores.assign(template_read->qstring.begin(),
+                                       template_read->qstring.end());
     }
 
     // For basespace, a q score filter is run over the quality scores.
@@ -102,8 +170,9 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
 
     auto complement_read_it = m_reads.find(complement_read_id);
     if (complement_read_it == m_reads.end()) {
-        spdlog::debug("Complement ID={} paired with Template ID={} was not found",
-                      complement_read_id, template_read_id);
+        DORADO_LOG_EVERY_MS(spdlog::level::debug, 1000,
+                            "Complement ID={} paired with Template ID={} was not found",
+                            complement_read_id, template_read_id);
         return;
     }
 
@@ -113,10 +182,9 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
 
     // We have both sequences and can perform the consensus
     auto complement_read = complement_read_it->second;
-    auto complement_quality_scores_reverse =
-            std::vector<uint8_t>(complement_read->qstring.begin(), complement_read->qstring.end());
-    std::reverse(complement_quality_scores_reverse.begin(),
-                 complement_quality_scores_reverse.end());
+    auto& complement_quality_scores_reverse = scratch.complement_quality_scores_reverse;
+    complement_quality_scores_reverse.assign(complement_read->qstring.rbegin(),
+                                             complement_read->qstring.rend());
 
     // For basespace, a q score filter is run over the quality scores.
     utils::preprocess_quality_scores(complement_quality_scores_reverse);
@@ -125,10 +193,15 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
     auto complement_sequence_reverse_complement =
             dorado::utils::reverse_complement(complement_read->seq);
 
+    // Use the batch's alignment of the pair if there is one, and else align it here.
+    const bool use_alignment = alignment && alignment->edit_distance >= 0;
     EdlibAlignResult result =
-            edlibAlign(template_sequence.data(), template_sequence.size(),
-                       complement_sequence_reverse_complement.data(),
-                       complement_sequence_reverse_complement.size(), align_config);
+            use_alignment
+                    ? utils::as_edlib_result(*alignment)
+                    : edlibAlign(template_sequence.data(), template_sequence.size(),
+                                 complement_sequence_reverse_complement.data(),
+                                 complement_sequence_reverse_complement.size(),
+                                 scratch.align_config);
 
     // Now - we have to do the actual basespace alignment itself
     int query_cursor = 0;
@@ -158,10 +231,13 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
             ((end_alignment_position - start_alignment_position) > kMinTrimmedAlignmentLength);
 
     if (consensus_possible) {
-        auto [consensus, quality_scores_phred] = compute_basespace_consensus(
-                start_alignment_position, end_alignment_position, template_quality_scores,
-                target_cursor, complement_quality_scores_reverse, query_cursor, template_sequence,
-                complement_sequence_reverse_complement, result.alignment);
+        auto& consensus = scratch.consensus;
+        auto& quality_scores_phred = scratch.quality_scores_phred;
+        compute_basespace_consensus(start_alignment_position, end_alignment_position,
+                                    template_quality_scores, target_cursor,
+                                    complement_quality_scores_reverse, query_cursor,
+                                    template_sequence, complement_sequence_reverse_complement,
+                                    result.alignment, consensus, quality_scores_phred);
 
         auto duplex_read = std::make_shared<Read>();
         duplex_read->seq = std::string(consensus.begin(), consensus.end());
@@ -171,30 +247,44 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
         duplex_read->read_id = template_read->read_id + ";" + complement_read->read_id;
         duplex_read->read_tag = template_read->read_tag;
 
-        m_sink.push_message(duplex_read);
+        m_sink.push_message(std::move(duplex_read));
+    }
+    if (!use_alignment) {
+        edlibFreeAlignResult(result);
     }
-    edlibFreeAlignResult(result);
 }
 
 BaseSpaceDuplexCallerNode::BaseSpaceDuplexCallerNode(
         MessageSink& sink,
         std::map<std::string, std::string> template_complement_map,
         read_map reads,
-        size_t threads)
+        size_t threads,
+        std::shared_ptr<utils::BandedAligner> aligner,
+        size_t alignment_batch_size)
         : MessageSink(1000),
           m_sink(sink),
           m_template_complement_map(std::move(template_complement_map)),
           m_reads(std::move(reads)),
-          m_num_worker_threads(threads) {
+          m_num_worker_threads(std::max(threads, size_t(1))),
+          m_aligner(std::move(aligner)),
+          m_alignment_batch_size(std::max(alignment_batch_size, size_t(1))),
+          m_pairs_to_call(m_aligner ? std::max(4 * m_num_worker_threads, m_alignment_batch_size)
+                                    : 4 * m_num_worker_threads) {
     m_worker_thread =
             std::make_unique<std::thread>(&BaseSpaceDuplexCallerNode::worker_thread, this);
 }
 
 BaseSpaceDuplexCallerNode::~BaseSpaceDuplexCallerNode() {
     terminate();
-    m_worker_thread->join();
+    join();
     // Notify the sink that the Node has terminated
     m_sink.terminate();
 }
 
+void BaseSpaceDuplexCallerNode::join() {
+    if (m_worker_thread->joinable()) {
+        m_worker_thread->join();
+    }
+}
+
 }  // namespace dorado
@@ -1,28 +1,72 @@
 #pragma once
 #include "HtsReader.h"
 #include "ReadPipeline.h"
+#include "3rdparty/edlib/edlib/include/edlib.h"
+#include "utils/AsyncQueue.h"
+#include "utils/BandedAligner.h"
 #include "utils/bam_utils.h"
 
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 namespace dorado {
 // Duplex caller node receives a map of template_id to complement_id (typically generated from a pairs file),
 // and a map of `read_id` to `dorado::Read` object. It then performs duplex calling and pushes `dorado::Read`
 // objects to its output queue.
+// Pairs are handed to the worker threads through a bounded queue, and each duplex read is pushed
+// as soon as it is called.
+// With an aligner, pairs are aligned in batches of alignment_batch_size before their consensus
+// is found, rather than one by one with edlib.
 class BaseSpaceDuplexCallerNode : public MessageSink {
 public:
     BaseSpaceDuplexCallerNode(MessageSink& sink,
                               std::map<std::string, std::string> template_complement_map,
                               read_map reads,
-                              size_t threads);
+                              size_t threads,
+                              std::shared_ptr<utils::BandedAligner> aligner = nullptr,
+                              size_t alignment_batch_size = 1024);
     ~BaseSpaceDuplexCallerNode();
+    void join() override;
 
 private:
+    // A pair waiting for a worker, along with its alignment if its batch was aligned.
+    struct PairToCall {
+        std::string template_read_id;
+        std::string complement_read_id;
+        std::shared_ptr<std::vector<utils::BandedAlignment>> batch_alignments;
+        size_t alignment_index{0};
+    };
+
+    // Buffers each worker reuses from one pair to the next.
+    struct BasespaceScratch {
+        EdlibAlignConfig align_config;
+        std::vector<uint8_t> template_quality_scores;
+        std::vector<uint8_t> complement_quality_scores_reverse;
+        std::vector<char> consensus;
+        std::vector<char> quality_scores_phred;
+    };
+
+    // Queues the pairs for the basespace workers, then waits for them to finish.
     void worker_thread();
-    void basespace(std::string template_read_id, std::string complement_read_id);
+    void basespace_worker_thread();
+    // Finds the consensus of a pair, from its alignment if given one which is valid.
+    void basespace(const std::string& template_read_id,
+                   const std::string& complement_read_id,
+                   utils::BandedAlignment* alignment,
+                   BasespaceScratch& scratch);
     MessageSink&
             m_sink;  // MessageSink to consume Duplex Called Reads. This will typically be a writer node
     size_t m_num_worker_threads{1};
     std::unique_ptr<std::thread> m_worker_thread;
     std::map<std::string, std::string> m_template_complement_map;
     read_map m_reads;
+    std::shared_ptr<utils::BandedAligner> m_aligner;
+    size_t m_alignment_batch_size;
+    // Holds enough pairs to keep the workers busy, and with an aligner, a batch of them while
+    // the next batch is aligned.
+    AsyncQueue<PairToCall> m_pairs_to_call;
+    std::vector<std::thread> m_basespace_worker_threads;
 };
 }  // namespace dorado
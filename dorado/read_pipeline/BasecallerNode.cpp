@@ -1,11 +1,18 @@
 #include "BasecallerNode.h"
 
 #include "../decode/CPUDecoder.h"
+#include "TargetMapper.h"
+#include "utils/BasecallCache.h"
+#include "utils/ThreadPool.h"
+#include "utils/numa_utils.h"
 #include "utils/stats.h"
 #include "utils/stitch.h"
+#include "utils/thread_qos.h"
+#include "utils/trace.h"
 
-#include <nvtx3/nvtx3.hpp>
+#include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <memory>
@@ -15,178 +22,725 @@
 #endif
 
 using namespace std::chrono_literals;
-using namespace torch::indexing;
 
 namespace dorado {
 
+namespace {
+
+// Output steps decoded past the last one a chunk keeps, so that the beam search has settled
+// by the time it reaches the stitching point.
+constexpr size_t kDecodeMarginSteps = 16;
+
+// Reads of at least this many chunks, around 300k samples at the usual chunk size, are
+// stitched as their chunks are called, so that ultra-long reads don't hold every chunk's calls.
+constexpr size_t kStreamingStitchMinChunks = 32;
+
+uint64_t signal_hash(const Read &read) {
+    const auto signal = read.raw_data.contiguous();
+    return utils::BasecallCache::signal_hash(signal.data_ptr(), signal.nbytes());
+}
+
+}  // namespace
+
+bool RecallSelection::selects(const Read &read) const {
+    return read.seq.size() >= min_length && read.mean_qscore() < max_mean_qscore;
+}
+
 void BasecallerNode::input_worker_thread() {
     Message message;
 
-    // Allow 5 batches per model runner on the chunks_in queue
-    size_t max_chunks_in = 0;
-    // Allows optimal batch size to be used for every GPU
-    for (auto &runner : m_model_runners) {
-        max_chunks_in += runner->batch_size() * 5;
-    }
-
-    while (m_work_queue.try_pop(message)) {
+    while (true) {
+        if (m_packed_chunk) {
+            // A partly packed chunk is queued as soon as no more reads are waiting, rather
+            // than held for reads which may be slow to come.
+            const auto status = m_work_queue.try_pop_nowait(message);
+            if (status == QueueStatus::Empty) {
+                push_packed_chunk();
+                continue;
+            }
+            if (status == QueueStatus::Terminated) {
+                break;
+            }
+        } else if (!m_work_queue.try_pop(message)) {
+            break;
+        }
         if (std::holds_alternative<CandidatePairRejectedMessage>(message)) {
             m_sink.push_message(std::move(message));
             continue;
         }
 
         // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
         // If a read has already been basecalled, just send it to the sink without basecalling again
-        // TODO: This is necessary because some reads (e.g failed Stereo Encoding) will be passed
-        // to the basecaller node having already been called. This should be fixed in the future with
-        // support for graphs of nodes rather than linear pipelines.
+        // Pipelines built with a PipelineDescriptor can route such reads (e.g failed Stereo
+        // Encoding) around this node with a MessageRouterNode, avoiding the extra queue hop.
         if (!read->seq.empty()) {
-            m_sink.push_message(read);
+            if (!m_recall_selection || !m_recall_selection->selects(*read)) {
+                if (m_release_raw_data) {
+                    read->release_raw_data();
+                }
+                m_sink.push_message(std::move(read));
+                continue;
+            }
+            read->clear_basecall();
+            ++m_num_reads_recalled;
+        }
+        if (m_basecall_cache && take_cached_call(*read)) {
+            push_called_read(std::move(read));
+            continue;
+        }
+        // Chunk up the read.
+        size_t raw_size =
+                read->raw_data.sizes()[read->raw_data.sizes().size() - 1];  // Time dimension.
+        if (packs_read(*read, raw_size)) {
+            add_to_packed_chunk(std::move(read), raw_size);
             continue;
         }
+        // Reads that fit in a single smaller chunk go to the smallest chunk size they fit in,
+        // so they aren't padded out to the full chunk size.  Everything else uses the largest.
+        const size_t bucket = std::distance(
+                m_bucket_chunk_sizes.begin(),
+                std::lower_bound(m_bucket_chunk_sizes.begin(), m_bucket_chunk_sizes.end() - 1,
+                                 raw_size));
+        const size_t chunk_size = m_bucket_chunk_sizes[bucket];
+        auto &chunks_in = m_chunks_in[bucket];
+
+        // Work out where the read's chunks start.
+        size_t offset = 0;
+        size_t signal_chunk_step = chunk_size - m_overlap;
+        std::vector<size_t> chunk_offsets{offset};
+        auto last_chunk_offset = raw_size - chunk_size;
+        auto misalignment = last_chunk_offset % m_model_stride;
+        if (misalignment != 0) {
+            // move last chunk start to the next stride boundary. we'll zero pad any excess samples required.
+            last_chunk_offset += m_model_stride - misalignment;
+        }
+        while (offset + chunk_size < raw_size) {
+            offset = std::min(offset + signal_chunk_step, last_chunk_offset);
+            chunk_offsets.push_back(offset);
+        }
+        const size_t read_bytes = working_read_bytes(*read, chunk_offsets.size(), chunk_size);
+        const auto decode_steps =
+                m_decode_kept_steps_only
+                        ? chunk_decode_steps(chunk_offsets, chunk_size, raw_size)
+                        : std::vector<size_t>(chunk_offsets.size(), 0);
+
         // Now that we have acquired a read, wait until we can push to chunks_in
-        while (true) {
-            std::unique_lock<std::mutex> chunk_lock(m_chunks_in_mutex);
-            // A new condition was added to the condition variable which adjusts the predicate
-            // to check for number of working reads. This is to deal with some degenerate cases during
-            // duplex basecalling wherein the due to GPU contention between simplex and duplex stages
-            // reads are not fully called, leading to a build up of working reads. These partial
-            // reads were causing a growth in memory which sometimes led to a crash on some systems.
-            // This change below more effectively puts a ceiling on the host memory usage.
-            // Keeping the condition a function of the current sink size (empmirically at 5k reads this
-            // caps memory around 30GB).
-            m_chunks_in_has_space_cv.wait_for(chunk_lock, 10ms, [this, &max_chunks_in] {
-                auto under_read_limit =
-                        m_in_duplex_pipeline ? (m_working_reads.size() < 5 * m_max_reads) : true;
-                return (m_chunks_in.size() < max_chunks_in) && under_read_limit;
-            });
+        auto chunk_lock = wait_for_chunks_in_space(bucket, read_bytes);
+
+        // Allocate all of the read's chunks together.  Each chunk pointer shares ownership
+        // of the whole block, which lives until the read is stitched.
+        auto chunk_block = std::make_shared<std::vector<Chunk>>();
+        chunk_block->reserve(chunk_offsets.size());
+        std::vector<std::shared_ptr<Chunk>> read_chunks;
+        read_chunks.reserve(chunk_offsets.size());
+        for (size_t chunk_in_read_idx = 0; chunk_in_read_idx < chunk_offsets.size();
+             ++chunk_in_read_idx) {
+            auto &chunk = chunk_block->emplace_back(read.get(), chunk_offsets[chunk_in_read_idx],
+                                                    chunk_in_read_idx, chunk_size);
+            chunk.num_decode_steps = decode_steps[chunk_in_read_idx];
+            read_chunks.emplace_back(chunk_block, &chunk);
+        }
+        // With targeted calling, only the read's prefix is called until it is mapped.
+        DeferredChunks deferred{bucket, {}};
+        if (m_targeted_calling && read_chunks.size() > m_targeted_calling->prefix_chunks) {
+            const auto prefix_end =
+                    read_chunks.begin() + ptrdiff_t(m_targeted_calling->prefix_chunks);
+            deferred.chunks.assign(std::make_move_iterator(prefix_end),
+                                   std::make_move_iterator(read_chunks.end()));
+            read_chunks.erase(prefix_end, read_chunks.end());
+            ++m_num_undecided_reads;
+        }
+        read->num_chunks = read_chunks.size();
+        read->called_chunks.resize(read->num_chunks);
+        read->num_chunks_called.store(0);
+        // Reads whose prefix is mapped first are stitched twice, so aren't streamed.
+        std::unique_ptr<StreamingStitch> streaming_stitch;
+        if (deferred.chunks.empty() && !m_targeted_calling &&
+            chunk_offsets.size() >= kStreamingStitchMinChunks) {
+            streaming_stitch =
+                    std::make_unique<StreamingStitch>(std::move(chunk_offsets), raw_size);
+            ++m_num_reads_streamed;
+        }
 
-            if (m_chunks_in.size() >= max_chunks_in) {
-                continue;
+        // Put the read in the working list before any of its chunks can be called.
+        {
+            std::lock_guard working_reads_lock(m_working_reads_mutex);
+            if (!deferred.chunks.empty()) {
+                m_deferred_chunks.emplace(read.get(), std::move(deferred));
+            }
+            if (streaming_stitch) {
+                m_streaming_stitches.emplace(read.get(), std::move(streaming_stitch));
             }
+            start_client_read(*read);
+            m_working_reads.emplace(read.get(), std::move(read));
+            ++m_working_reads_size;
+            m_working_reads_bytes += read_bytes;
+        }
 
-            // Chunk up the read and put the chunks into the pending chunk list.
-            size_t raw_size =
-                    read->raw_data.sizes()[read->raw_data.sizes().size() - 1];  // Time dimension.
+        chunks_in.push_read_chunks(std::move(read_chunks));
+        chunk_lock.unlock();
+        notify_chunks_added();
+    }
+    if (m_packed_chunk) {
+        push_packed_chunk();
+    }
 
-            size_t offset = 0;
-            size_t chunk_in_read_idx = 0;
-            size_t signal_chunk_step = m_chunk_size - m_overlap;
-            m_chunks_in.push_back(
-                    std::make_shared<Chunk>(read, offset, chunk_in_read_idx++, m_chunk_size));
-            read->num_chunks = 1;
-            auto last_chunk_offset = raw_size - m_chunk_size;
-            auto misalignment = last_chunk_offset % m_model_stride;
-            if (misalignment != 0) {
-                // move last chunk start to the next stride boundary. we'll zero pad any excess samples required.
-                last_chunk_offset += m_model_stride - misalignment;
-            }
-            while (offset + m_chunk_size < raw_size) {
-                offset = std::min(offset + signal_chunk_step, last_chunk_offset);
-                m_chunks_in.push_back(
-                        std::make_shared<Chunk>(read, offset, chunk_in_read_idx++, m_chunk_size));
-                read->num_chunks++;
-            }
-            read->called_chunks.resize(read->num_chunks);
-            read->num_chunks_called.store(0);
-            chunk_lock.unlock();
+    // Notify the basecaller threads that it is safe to gracefully terminate the basecaller
+    m_terminate_basecaller.store(true);
+    m_chunks_added_cv.notify_all();
+}
 
-            // Put the read in the working list
-            {
-                std::lock_guard working_reads_lock(m_working_reads_mutex);
-                m_working_reads.push_back(std::move(read));
-                ++m_working_reads_size;
-            }
+std::unique_lock<std::mutex> BasecallerNode::wait_for_chunks_in_space(size_t bucket,
+                                                                     size_t read_bytes) {
+    // A new condition was added to the condition variable which adjusts the predicate
+    // to check for number of working reads. This is to deal with some degenerate cases during
+    // duplex basecalling wherein the due to GPU contention between simplex and duplex stages
+    // reads are not fully called, leading to a build up of working reads. These partial
+    // reads were causing a growth in memory which sometimes led to a crash on some systems.
+    // This change below more effectively puts a ceiling on the host memory usage.
+    // Keeping the condition a function of the current sink size (empmirically at 5k reads this
+    // caps memory around 30GB).
+    // With a byte limit on the working reads, it replaces the read count limit.  A read
+    // is always let in when there are no others, however large it is.
+    const auto has_space = [this, bucket, read_bytes] {
+        if (m_chunks_in[bucket].size() >= m_max_chunks_in[bucket]) {
+            return false;
+        }
+        if (m_max_working_reads_bytes != 0) {
+            return m_working_reads_size == 0 ||
+                   m_working_reads_bytes + read_bytes <= m_max_working_reads_bytes;
+        }
+        return m_in_duplex_pipeline ? (size_t(m_working_reads_size) < 5 * m_max_reads) : true;
+    };
+    // The working reads are freed without the lock held, so the wait wakes to check again.
+    std::unique_lock<std::mutex> chunk_lock(m_chunks_in_mutex);
+    while (!m_chunks_in_has_space_cv.wait_for(chunk_lock, 10ms, has_space)) {
+    }
+    return chunk_lock;
+}
+
+void BasecallerNode::notify_chunks_added() {
+    if (m_bucket_chunk_sizes.size() == 1 && m_model_runners.size() == 1) {
+        m_chunks_added_cv.notify_one();
+    } else {
+        // Only workers for this chunk size can take the chunks, and slower workers
+        // may leave them to faster ones.
+        m_chunks_added_cv.notify_all();
+    }
+}
 
-            m_chunks_added_cv.notify_one();
+size_t BasecallerNode::packed_read_size(size_t raw_size) const {
+    // Each read starts on a step boundary, so its steps are its own.
+    return (raw_size + m_model_stride - 1) / m_model_stride * m_model_stride;
+}
+
+bool BasecallerNode::packs_read(const Read &read, size_t raw_size) const {
+    // Only reads which leave room in a chunk for another as long are packed.  Stereo encoded
+    // signals have several channels, and are left alone.
+    return m_pack_short_reads && read.raw_data.dim() == 1 && raw_size > 0 &&
+           2 * (packed_read_size(raw_size) + m_overlap) <= m_bucket_chunk_sizes.back();
+}
 
-            break;  // Go back to watching the input reads
+void BasecallerNode::add_to_packed_chunk(std::shared_ptr<Read> read, size_t raw_size) {
+    const size_t chunk_size = m_bucket_chunk_sizes.back();
+    const size_t read_size = packed_read_size(raw_size);
+    if (m_packed_chunk) {
+        // The reads are kept apart by the chunk overlap, so that each read's ends are called
+        // with as much context as a chunk's are.
+        const size_t offset = packed_read_size(m_packed_end + m_overlap);
+        if (offset + read_size > chunk_size) {
+            push_packed_chunk();
+        } else {
+            m_packed_end = offset;
         }
     }
+    if (!m_packed_chunk) {
+        m_packed_chunk = std::make_shared<Chunk>(nullptr, 0, 0, chunk_size);
+        m_packed_end = 0;
+    }
+    m_packed_chunk->packed_chunks.push_back(std::make_shared<Chunk>(read.get(), 0, 0, read_size));
+    m_packed_chunk->packed_offsets.push_back(m_packed_end);
+    m_packed_end += read_size;
+    m_packed_reads.push_back(std::move(read));
+}
 
-    // Notify the basecaller threads that it is safe to gracefully terminate the basecaller
-    m_terminate_basecaller.store(true);
-    m_chunks_added_cv.notify_all();
+void BasecallerNode::push_packed_chunk() {
+    auto packed_chunk = std::move(m_packed_chunk);
+    auto reads = std::move(m_packed_reads);
+    m_packed_reads.clear();
+    const size_t chunk_size = packed_chunk->raw_chunk_size;
+    const size_t bucket = m_bucket_chunk_sizes.size() - 1;
+
+    // The gaps and the end of the chunk are zeros, rather than repeats of the signal.
+    packed_chunk->packed_signal =
+            torch::zeros({int64_t(chunk_size)}, reads.front()->raw_data.options());
+    size_t read_bytes = 0;
+    for (size_t i = 0; i < reads.size(); ++i) {
+        const auto &signal = reads[i]->raw_data;
+        packed_chunk->packed_signal
+                .narrow(0, int64_t(packed_chunk->packed_offsets[i]), signal.size(0))
+                .copy_(signal);
+        read_bytes +=
+                working_read_bytes(*reads[i], 1, packed_chunk->packed_chunks[i]->raw_chunk_size);
+    }
+    if (m_decode_kept_steps_only) {
+        // Nothing past the last read is worth decoding.
+        packed_chunk->num_decode_steps = std::min(
+                chunk_size / m_model_stride, m_packed_end / m_model_stride + kDecodeMarginSteps);
+    }
+
+    auto chunk_lock = wait_for_chunks_in_space(bucket, read_bytes);
+    {
+        std::lock_guard working_reads_lock(m_working_reads_mutex);
+        for (auto &read : reads) {
+            read->num_chunks = 1;
+            read->called_chunks.resize(1);
+            read->num_chunks_called.store(0);
+            auto *const read_ptr = read.get();
+            start_client_read(*read);
+            m_working_reads.emplace(read_ptr, std::move(read));
+            ++m_working_reads_size;
+        }
+        m_working_reads_bytes += read_bytes;
+    }
+    m_num_packed_reads += int64_t(packed_chunk->packed_chunks.size());
+    ++m_num_packed_chunks;
+    m_chunks_in[bucket].push_read_chunks({std::move(packed_chunk)});
+    chunk_lock.unlock();
+    notify_chunks_added();
 }
 
 void BasecallerNode::basecall_current_batch(int worker_id) {
-    NVTX3_FUNC_RANGE();
+    DORADO_TRACE_FUNCTION();
     auto model_runner = m_model_runners[worker_id];
     dorado::stats::Timer timer;
-    auto decode_results = model_runner->call_chunks(m_batched_chunks[worker_id].size());
-    m_call_chunks_ms += timer.GetElapsedMS();
+    const auto num_chunks = m_batched_chunks[worker_id].size();
+    auto decode_results = model_runner->call_chunks(num_chunks);
+    const auto call_ms = timer.GetElapsedMS();
+    m_call_chunks_ms += call_ms;
+    if (!m_batch_timeouts.empty()) {
+        m_batch_timeouts[worker_id]->batch_called(call_ms);
+    }
+    if (num_chunks == model_runner->batch_size()) {
+        std::lock_guard chunks_lock(m_chunks_in_mutex);
+        update_runner_throughput(worker_id, call_ms);
+    } else {
+        ++m_num_partial_batches_called;
+    }
 
     for (size_t i = 0; i < m_batched_chunks[worker_id].size(); i++) {
-        m_batched_chunks[worker_id][i]->seq = decode_results[i].sequence;
-        m_batched_chunks[worker_id][i]->qstring = decode_results[i].qstring;
-        m_batched_chunks[worker_id][i]->moves = decode_results[i].moves;
+        m_batched_chunks[worker_id][i]->seq = std::move(decode_results[i].sequence);
+        m_batched_chunks[worker_id][i]->qstring = std::move(decode_results[i].qstring);
+        m_batched_chunks[worker_id][i]->moves = std::move(decode_results[i].moves);
     }
 
-    // We need to assign each chunk back to the read it came from
-    for (auto &complete_chunk : m_batched_chunks[worker_id]) {
-        std::shared_ptr<Read> source_read = complete_chunk->source_read.lock();
-        source_read->called_chunks[complete_chunk->idx_in_read] = complete_chunk;
-        ++source_read->num_chunks_called;
+    // We need to assign each chunk back to the read it came from, and hand on the reads
+    // whose last chunk this was.
+    bool reads_completed = false;
+    auto complete_chunk = [this, &reads_completed](std::shared_ptr<Chunk> chunk) {
+        // The working reads hold the read until this, its last chunk, is recorded.
+        Read *const source_read = chunk->source_read;
+        add_called_chunk(*source_read, std::move(chunk));
+        if (++source_read->num_chunks_called == source_read->num_chunks) {
+            std::lock_guard working_reads_lock(m_working_reads_mutex);
+            auto it = m_working_reads.find(source_read);
+            m_completed_reads.push_back(std::move(it->second));
+            m_working_reads.erase(it);
+            reads_completed = true;
+        }
+    };
+    for (auto &called_chunk : m_batched_chunks[worker_id]) {
+        if (called_chunk->packed_chunks.empty()) {
+            complete_chunk(called_chunk);
+            continue;
+        }
+        // A packed chunk's call is split between the reads it holds.
+        utils::unpack_chunk(*called_chunk, int(m_model_stride));
+        for (auto &packed_chunk : called_chunk->packed_chunks) {
+            complete_chunk(std::move(packed_chunk));
+        }
+    }
+    if (reads_completed) {
+        m_reads_completed_cv.notify_one();
     }
     m_batched_chunks[worker_id].clear();
     ++m_num_batches_called;
 }
 
+void BasecallerNode::add_called_chunk(Read &read, std::shared_ptr<Chunk> chunk) {
+    const size_t chunk_idx = chunk->idx_in_read;
+    StreamingStitch *stream = nullptr;
+    {
+        std::lock_guard working_reads_lock(m_working_reads_mutex);
+        auto it = m_streaming_stitches.find(&read);
+        if (it != m_streaming_stitches.end()) {
+            stream = it->second.get();
+        }
+    }
+    if (!stream) {
+        read.called_chunks[chunk_idx] = std::move(chunk);
+        return;
+    }
+
+    // Every chunk is recorded under the lock, so whichever worker records the last of a run
+    // of called chunks stitches them all.
+    std::lock_guard stream_lock(stream->mutex);
+    read.called_chunks[chunk_idx] = std::move(chunk);
+    auto &stitcher = stream->stitcher;
+    for (size_t idx = stitcher.num_appended();
+         idx < read.num_chunks && read.called_chunks[idx] != nullptr; ++idx) {
+        std::optional<size_t> next_chunk_offset;
+        if (idx + 1 < read.num_chunks) {
+            next_chunk_offset = stream->chunk_offsets[idx + 1];
+        }
+        auto &called_chunk = *read.called_chunks[idx];
+        stitcher.append(called_chunk, next_chunk_offset);
+        // The chunk itself is kept, for its size, but its calls are no longer needed.
+        called_chunk.seq = std::string();
+        called_chunk.qstring = std::string();
+        called_chunk.moves = std::vector<uint8_t>();
+    }
+}
+
+size_t BasecallerNode::num_chunks_available(int worker_id) const {
+    const auto bucket = m_runner_buckets[worker_id];
+    const auto &chunks_in = m_chunks_in[bucket];
+    const double chunks_per_s = m_runner_chunks_per_s[worker_id];
+    if (chunks_in.empty() || chunks_per_s == 0.) {
+        return chunks_in.size();
+    }
+    // Chunks wanted by waiting runners this much faster are left to them.
+    constexpr double kFasterRunnerRatio = 1.25;
+    size_t chunks_wanted_by_faster = 0;
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        if (m_worker_waiting[i] && m_runner_buckets[i] == bucket &&
+            m_runner_chunks_per_s[i] > kFasterRunnerRatio * chunks_per_s) {
+            // A waiting worker's batch isn't changing under us.
+            chunks_wanted_by_faster +=
+                    m_model_runners[i]->batch_size() - m_batched_chunks[i].size();
+        }
+    }
+    return chunks_in.size() - std::min(chunks_in.size(), chunks_wanted_by_faster);
+}
+
+void BasecallerNode::update_runner_throughput(int worker_id, int64_t call_ms) {
+    // Batches are weighted exponentially, so the measurement follows changes in device load.
+    constexpr double kNewBatchWeight = 0.2;
+    const double batch_chunks_per_s =
+            1000. * m_model_runners[worker_id]->batch_size() / std::max(call_ms, int64_t(1));
+    auto &chunks_per_s = m_runner_chunks_per_s[worker_id];
+    chunks_per_s = chunks_per_s == 0.
+                           ? batch_chunks_per_s
+                           : (1. - kNewBatchWeight) * chunks_per_s +
+                                     kNewBatchWeight * batch_chunks_per_s;
+
+    const auto bucket = m_runner_buckets[worker_id];
+    double fastest_chunks_per_s = 0.;
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        if (m_runner_buckets[i] == bucket) {
+            fastest_chunks_per_s = std::max(fastest_chunks_per_s, m_runner_chunks_per_s[i]);
+        }
+    }
+    size_t max_chunks_in = 0;
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        if (m_runner_buckets[i] != bucket) {
+            continue;
+        }
+        // Unmeasured runners keep the full allowance, and every runner at least one batch.
+        const size_t batch_size = m_model_runners[i]->batch_size();
+        const double chunks_per_s = m_runner_chunks_per_s[i];
+        const double relative_throughput =
+                chunks_per_s == 0. ? 1. : chunks_per_s / fastest_chunks_per_s;
+        max_chunks_in += std::max(batch_size, size_t(5 * batch_size * relative_throughput));
+    }
+    m_max_chunks_in[bucket] = max_chunks_in;
+}
+
+std::vector<size_t> BasecallerNode::chunk_decode_steps(const std::vector<size_t> &chunk_offsets,
+                                                      size_t chunk_size,
+                                                      size_t raw_size) const {
+    const size_t num_steps = chunk_size / m_model_stride;
+    std::vector<size_t> decode_steps;
+    decode_steps.reserve(chunk_offsets.size());
+    for (size_t i = 0; i < chunk_offsets.size(); ++i) {
+        size_t kept_steps;
+        if (i + 1 < chunk_offsets.size()) {
+            // Stitching keeps the front half of the overlap with the next chunk, rounded down.
+            const size_t overlap = chunk_offsets[i] + chunk_size - chunk_offsets[i + 1];
+            kept_steps = num_steps - (overlap / m_model_stride) / 2;
+        } else {
+            // The last chunk is kept up to the end of the read.
+            const size_t read_samples = std::min(chunk_size, raw_size - chunk_offsets[i]);
+            kept_steps = (read_samples + m_model_stride - 1) / m_model_stride;
+        }
+        decode_steps.push_back(std::min(num_steps, kept_steps + kDecodeMarginSteps));
+    }
+    return decode_steps;
+}
+
+size_t BasecallerNode::working_read_bytes(const Read &read,
+                                          size_t num_chunks,
+                                          size_t chunk_size) const {
+    // Each called chunk holds a move per output step, and at most a base and a qscore for each.
+    const size_t called_chunk_bytes = sizeof(Chunk) + 3 * (chunk_size / m_model_stride);
+    return read.raw_data.nbytes() + num_chunks * called_chunk_bytes;
+}
+
+bool BasecallerNode::terminating() const {
+    return m_terminate_basecaller.load() && m_num_undecided_reads == 0;
+}
+
 void BasecallerNode::working_reads_manager() {
     while (true) {
-        nvtx3::scoped_range loop{"working_reads_manager"};
-
-        std::deque<std::shared_ptr<Read>> completed_reads;
+        std::vector<std::shared_ptr<Read>> completed_reads;
+        std::vector<std::pair<std::shared_ptr<Read>, DeferredChunks>> completed_prefixes;
         {
-            std::lock_guard working_reads_lock(m_working_reads_mutex);
-            if (m_terminate_manager.load() && m_working_reads.empty()) {
+            std::unique_lock working_reads_lock(m_working_reads_mutex);
+            m_reads_completed_cv.wait(working_reads_lock, [this] {
+                return !m_completed_reads.empty() ||
+                       (m_terminate_manager.load() && m_working_reads.empty());
+            });
+            if (m_completed_reads.empty()) {
                 break;
             }
-            for (auto read_iter = m_working_reads.begin(); read_iter != m_working_reads.end();) {
-                if ((*read_iter)->num_chunks_called.load() == (*read_iter)->num_chunks) {
-                    (*read_iter)->model_name =
-                            m_model_name;  // Before sending read to sink, assign its model name
-                    completed_reads.push_back(*read_iter);
-                    read_iter = m_working_reads.erase(read_iter);
-                    --m_working_reads_size;
-                } else {
-                    read_iter++;
+            completed_reads.swap(m_completed_reads);
+            // Reads whose prefix has been called are still working until they are mapped.
+            if (!m_deferred_chunks.empty()) {
+                for (auto &read : completed_reads) {
+                    auto it = m_deferred_chunks.find(read.get());
+                    if (it != m_deferred_chunks.end()) {
+                        completed_prefixes.emplace_back(std::move(read), std::move(it->second));
+                        m_deferred_chunks.erase(it);
+                    }
                 }
+                completed_reads.erase(
+                        std::remove(completed_reads.begin(), completed_reads.end(), nullptr),
+                        completed_reads.end());
             }
         }
-
-        if (completed_reads.empty()) {
-            std::this_thread::sleep_for(10ms);
-        } else {
-            m_chunks_in_has_space_cv.notify_one();
+        DORADO_TRACE_SCOPE("working_reads_manager");
+
+        for (const auto &read : completed_reads) {
+            // Before sending read to sink, assign its model name
+            read->model_name = m_model_name;
+            m_working_reads_bytes -= working_read_bytes(
+                    *read, read->num_chunks, read->called_chunks.front()->raw_chunk_size);
+            --m_working_reads_size;
         }
+        m_chunks_in_has_space_cv.notify_one();
 
+        // Long reads take a while to stitch, so reads are stitched in parallel on the shared
+        // pool, rather than one after another here.
+        auto &pool = utils::ThreadPool::shared();
+        const int max_reads_stitching = 2 * static_cast<int>(pool.num_threads());
+        auto submit_stitching = [this, &pool, max_reads_stitching](auto task) {
+            {
+                std::unique_lock lock(m_stitching_mutex);
+                m_stitching_cv.wait(lock, [this, max_reads_stitching] {
+                    return m_num_reads_stitching < max_reads_stitching;
+                });
+                ++m_num_reads_stitching;
+            }
+            pool.submit([this, task = std::move(task)]() mutable {
+                task();
+                std::lock_guard lock(m_stitching_mutex);
+                --m_num_reads_stitching;
+                // Notify while holding the mutex, since the node can be destroyed once the
+                // count reaches 0.
+                m_stitching_cv.notify_all();
+            });
+        };
         for (auto &read : completed_reads) {
-            utils::stitch_chunks(read);
-            ++m_called_reads_pushed;
-            m_num_bases_processed += read->seq.length();
-            m_num_samples_processed += read->raw_data.size(0);
-            m_sink.push_message(std::move(read));
+            submit_stitching([this, read = std::move(read)]() mutable {
+                stitch_and_push(std::move(read));
+            });
+        }
+        for (auto &prefix : completed_prefixes) {
+            submit_stitching([this, read = std::move(prefix.first),
+                              deferred = std::move(prefix.second)]() mutable {
+                stitch_and_map_prefix(std::move(read), std::move(deferred));
+            });
         }
     }
 
+    {
+        std::unique_lock lock(m_stitching_mutex);
+        m_stitching_cv.wait(lock, [this] { return m_num_reads_stitching == 0; });
+    }
     m_sink.terminate();
 }
 
+void BasecallerNode::stitch_and_push(std::shared_ptr<Read> read) {
+    {
+        DORADO_TRACE_SCOPE("stitch");
+        std::unique_ptr<StreamingStitch> stream;
+        {
+            std::lock_guard working_reads_lock(m_working_reads_mutex);
+            auto it = m_streaming_stitches.find(read.get());
+            if (it != m_streaming_stitches.end()) {
+                stream = std::move(it->second);
+                m_streaming_stitches.erase(it);
+            }
+        }
+        if (stream) {
+            // Every chunk was stitched as it was called.
+            stream->stitcher.finish(*read);
+        } else {
+            utils::stitch_chunks(read);
+        }
+    }
+    if (m_basecall_cache) {
+        m_basecall_cache->insert(signal_hash(*read), size_t(read->raw_data.size(0)),
+                                 {read->seq, read->qstring, read->moves, read->model_stride});
+    }
+    push_called_read(std::move(read));
+}
+
+bool BasecallerNode::take_cached_call(Read &read) {
+    auto call = m_basecall_cache->find(signal_hash(read), size_t(read.raw_data.size(0)));
+    if (!call) {
+        return false;
+    }
+    read.seq = std::move(call->seq);
+    read.qstring = std::move(call->qstring);
+    read.moves = std::move(call->moves);
+    read.model_stride = call->model_stride;
+    read.model_name = m_model_name;
+    ++m_num_reads_from_cache;
+    return true;
+}
+
+void BasecallerNode::stitch_and_map_prefix(std::shared_ptr<Read> read, DeferredChunks deferred) {
+    bool on_target = false;
+    {
+        DORADO_TRACE_SCOPE("map_prefix");
+        utils::stitch_chunks(read);
+        on_target = m_targeted_calling->mapper->is_on_target(read->seq);
+    }
+
+    if (on_target) {
+        // The rest of the read is called, and the whole read stitched as usual.
+        ++m_num_reads_on_target;
+        read->clear_basecall();
+        read->num_chunks += deferred.chunks.size();
+        read->called_chunks.resize(read->num_chunks);
+        {
+            std::lock_guard working_reads_lock(m_working_reads_mutex);
+            m_working_reads.emplace(read.get(), read);
+        }
+        {
+            std::lock_guard chunks_lock(m_chunks_in_mutex);
+            m_chunks_in[deferred.bucket].push_read_chunks(std::move(deferred.chunks));
+            --m_num_undecided_reads;
+        }
+        m_chunks_added_cv.notify_all();
+        return;
+    }
+
+    ++m_num_reads_off_target;
+    const auto &last_chunk = read->called_chunks.back();
+    m_working_reads_bytes -= working_read_bytes(
+            *read, read->num_chunks + deferred.chunks.size(), last_chunk->raw_chunk_size);
+    --m_working_reads_size;
+    read->model_name = m_model_name;
+    // The signal the prefix's moves don't cover is cut off, so the read is self-consistent.
+    const int64_t prefix_samples = int64_t(last_chunk->input_offset + last_chunk->raw_chunk_size);
+    read->raw_data = read->raw_data.narrow(0, 0, prefix_samples);
+    deferred.chunks.clear();
+    push_called_read(std::move(read));
+    {
+        std::lock_guard chunks_lock(m_chunks_in_mutex);
+        --m_num_undecided_reads;
+    }
+    m_chunks_added_cv.notify_all();
+    m_chunks_in_has_space_cv.notify_one();
+}
+
+void BasecallerNode::push_called_read(std::shared_ptr<Read> read) {
+    // The chunks aren't needed once stitched, so free them before the read moves on.
+    read->called_chunks.clear();
+    ++m_called_reads_pushed;
+    m_num_bases_processed += read->seq.length();
+    m_num_samples_processed += read->raw_data.size(0);
+    if (read->client_id >= 0) {
+        record_client_read(*read);
+    }
+    if (m_release_raw_data) {
+        read->release_raw_data();
+    }
+    m_sink.push_message(std::move(read));
+}
+
+void BasecallerNode::start_client_read(const Read &read) {
+    if (read.client_id >= 0) {
+        m_client_read_starts.emplace(&read, std::chrono::steady_clock::now());
+    }
+}
+
+void BasecallerNode::record_client_read(const Read &read) {
+    std::optional<std::chrono::steady_clock::time_point> start;
+    {
+        std::lock_guard working_reads_lock(m_working_reads_mutex);
+        auto it = m_client_read_starts.find(&read);
+        if (it != m_client_read_starts.end()) {
+            start = it->second;
+            m_client_read_starts.erase(it);
+        }
+    }
+    std::lock_guard stats_lock(m_client_stats_mutex);
+    auto &client_stats = m_client_stats[read.client_id];
+    ++client_stats.reads_called;
+    client_stats.samples_called += read.raw_data.size(0);
+    // Reads passed on without being called, such as those with a cached call, were never
+    // working.
+    if (start) {
+        const double latency_ms = std::chrono::duration<double, std::milli>(
+                                          std::chrono::steady_clock::now() - *start)
+                                          .count();
+        ++client_stats.reads_timed;
+        client_stats.total_latency_ms += latency_ms;
+        client_stats.max_latency_ms = std::max(client_stats.max_latency_ms, latency_ms);
+    }
+}
+
+void BasecallerNode::set_client_weight(int32_t client_id, size_t weight) {
+    std::lock_guard chunks_lock(m_chunks_in_mutex);
+    for (auto &chunks_in : m_chunks_in) {
+        chunks_in.set_client_weight(client_id, weight);
+    }
+}
+
 void BasecallerNode::basecall_worker_thread(int worker_id) {
 #if defined(__APPLE__) && !defined(__x86_64__)
     // Model execution creates GPU-related autorelease objects.
     utils::ScopedAutoReleasePool autorelease_pool;
 #endif
+    // Chunks are gathered into the runner's staging buffers, which live on its device's node.
+    utils::bind_thread_to_numa_node(m_model_runners[worker_id]->numa_node());
+    utils::set_thread_qos(utils::ThreadQoS::Interactive);
     auto last_chunk_reserve_time = std::chrono::system_clock::now();
     int batch_size = m_model_runners[worker_id]->batch_size();
+    auto &chunks_in = m_chunks_in[m_runner_buckets[worker_id]];
+    auto *const batch_timeout =
+            m_batch_timeouts.empty() ? nullptr : m_batch_timeouts[worker_id].get();
     while (true) {
         std::unique_lock<std::mutex> chunks_lock(m_chunks_in_mutex);
-        if (!m_chunks_added_cv.wait_until(
-                    chunks_lock,
-                    last_chunk_reserve_time + std::chrono::milliseconds(m_batch_timeout_ms),
-                    [this] { return !m_chunks_in.empty() || m_terminate_basecaller.load(); })) {
+        auto deadline = last_chunk_reserve_time + std::chrono::milliseconds(m_batch_timeout_ms);
+        if (batch_timeout) {
+            deadline = std::chrono::system_clock::now() +
+                       std::chrono::milliseconds(batch_timeout->wait_ms(
+                               m_batched_chunks[worker_id].size(), size_t(batch_size),
+                               AdaptiveBatchTimeout::Clock::now()));
+        }
+        m_worker_waiting[worker_id] = true;
+        const bool woken = m_chunks_added_cv.wait_until(
+                chunks_lock, deadline,
+                [this, worker_id] {
+                    return num_chunks_available(worker_id) != 0 || terminating();
+                });
+        m_worker_waiting[worker_id] = false;
+        if (!woken) {
             // timeout without new chunks or termination call
             chunks_lock.unlock();
             if (!m_batched_chunks[worker_id].empty()) {
@@ -198,7 +752,7 @@ void BasecallerNode::basecall_worker_thread(int worker_id) {
             continue;
         }
 
-        if (m_chunks_in.empty() && m_terminate_basecaller.load()) {
+        if (chunks_in.empty() && terminating()) {
             // no remaining chunks and we've been told to terminate
             // call the remaining batch
             chunks_lock.unlock();  // Not strictly necessary
@@ -208,6 +762,8 @@ void BasecallerNode::basecall_worker_thread(int worker_id) {
 
             // Reduce the count of active runner threads.  If this was the last active
             // thread also send termination signal to sink
+            spdlog::debug("> {} runner {} called {:.1f} chunks/s", m_node_name, worker_id,
+                          m_runner_chunks_per_s[worker_id]);
             int num_remaining_runners = --m_num_active_model_runners;
             if (num_remaining_runners == 0) {
                 // runners can share a caller, so shutdown when all runners are done
@@ -215,58 +771,49 @@ void BasecallerNode::basecall_worker_thread(int worker_id) {
                 for (auto &runner : m_model_runners) {
                     runner->terminate();
                 }
-                m_terminate_manager.store(true);
+                {
+                    std::lock_guard working_reads_lock(m_working_reads_mutex);
+                    m_terminate_manager.store(true);
+                }
+                m_reads_completed_cv.notify_one();
             }
             return;
         }
 
-        // There's chunks to get_scores, so let's add them to our input tensor
-        while (m_batched_chunks[worker_id].size() != batch_size && !m_chunks_in.empty()) {
-            std::shared_ptr<Chunk> chunk = m_chunks_in.front();
-            m_chunks_in.pop_front();
-            chunks_lock.unlock();
-            m_chunks_in_has_space_cv.notify_one();
-
-            // Copy the chunk into the input tensor
-            std::shared_ptr<Read> source_read = chunk->source_read.lock();
-
-            auto input_slice = source_read->raw_data.index(
-                    {Ellipsis, Slice(chunk->input_offset, chunk->input_offset + m_chunk_size)});
-            size_t slice_size;
-            if (input_slice.ndimension() == 1) {
-                slice_size = input_slice.size(0);
-            } else {
-                slice_size = input_slice.sizes()[1];
-            }
-
-            // repeat-pad any non-full chunks
-            // Stereo and Simplex encoding need to be treated differently
-            if (slice_size != m_chunk_size) {
-                if (input_slice.ndimension() == 1) {
-                    auto [n, overhang] = std::div((int)m_chunk_size, (int)slice_size);
-                    input_slice = torch::concat(
-                            {input_slice.repeat({n}),
-                             input_slice.index({Ellipsis, torch::indexing::Slice(0, overhang)})});
-                } else if (input_slice.ndimension() == 2) {
-                    auto [n, overhang] = std::div((int)m_chunk_size, (int)slice_size);
-                    input_slice = torch::concat(
-                            {input_slice.repeat({1, n}),
-                             input_slice.index({Ellipsis, torch::indexing::Slice(0, overhang)})},
-                            1);
-                }
-            }
-
-            // Insert the chunk in the input tensor
-            m_model_runners[worker_id]->accept_chunk(
-                    static_cast<int>(m_batched_chunks[worker_id].size()), input_slice);
-
-            m_batched_chunks[worker_id].push_back(chunk);
-            chunks_lock.lock();
-
-            last_chunk_reserve_time = std::chrono::system_clock::now();
+        // There's chunks to get_scores, so take as many as will fit in the batch
+        auto &batched_chunks = m_batched_chunks[worker_id];
+        const size_t first_new_chunk = batched_chunks.size();
+        // Once terminating, the remaining chunks go to whichever workers are left.
+        size_t chunks_available = m_terminate_basecaller.load() ? chunks_in.size()
+                                                                 : num_chunks_available(worker_id);
+        while (batched_chunks.size() != batch_size && chunks_available != 0) {
+            batched_chunks.push_back(chunks_in.pop());
+            --chunks_available;
         }
-
         chunks_lock.unlock();
+        m_chunks_in_has_space_cv.notify_one();
+
+        // Copy the new chunks into the input tensor in one pass.  The reads are working until
+        // their chunks have been called, so their signals outlive the copy.
+        std::vector<utils::ChunkSource> chunk_sources;
+        chunk_sources.reserve(batched_chunks.size() - first_new_chunk);
+        for (size_t i = first_new_chunk; i < batched_chunks.size(); ++i) {
+            const auto &chunk = batched_chunks[i];
+            if (!chunk->packed_chunks.empty()) {
+                // The chunk holds its own signal.
+                chunk_sources.push_back({&chunk->packed_signal, 0, chunk->num_decode_steps});
+                continue;
+            }
+            chunk_sources.push_back({&chunk->source_read->raw_data, chunk->input_offset,
+                                     chunk->num_decode_steps});
+        }
+        m_model_runners[worker_id]->accept_chunks(static_cast<int>(first_new_chunk),
+                                                  chunk_sources);
+        last_chunk_reserve_time = std::chrono::system_clock::now();
+        if (batch_timeout) {
+            batch_timeout->chunks_added(batched_chunks.size() - first_new_chunk,
+                                        AdaptiveBatchTimeout::Clock::now());
+        }
 
         if (m_batched_chunks[worker_id].size() == batch_size) {
             // Input tensor is full, let's get_scores.
@@ -282,11 +829,19 @@ BasecallerNode::BasecallerNode(MessageSink &sink,
                                std::string model_name,
                                size_t max_reads,
                                const std::string &node_name,
-                               bool in_duplex_pipeline)
+                               bool in_duplex_pipeline,
+                               ChunkSchedulingPolicy chunk_scheduling,
+                               bool release_raw_data,
+                               size_t max_working_reads_bytes,
+                               bool decode_kept_steps_only,
+                               std::optional<RecallSelection> recall_selection,
+                               std::optional<TargetedCalling> targeted_calling,
+                               std::shared_ptr<utils::BasecallCache> basecall_cache,
+                               int adaptive_latency_target_ms,
+                               bool pack_short_reads)
         : MessageSink(max_reads),
           m_sink(sink),
           m_model_runners(std::move(model_runners)),
-          m_chunk_size(m_model_runners.front()->chunk_size()),
           m_overlap(overlap),
           m_model_stride(m_model_runners.front()->model_stride()),
           m_terminate_basecaller(false),
@@ -294,10 +849,54 @@ BasecallerNode::BasecallerNode(MessageSink &sink,
           m_model_name(std::move(model_name)),
           m_max_reads(max_reads),
           m_in_duplex_pipeline(in_duplex_pipeline),
+          m_release_raw_data(release_raw_data),
+          m_max_working_reads_bytes(max_working_reads_bytes),
+          m_decode_kept_steps_only(decode_kept_steps_only),
+          m_recall_selection(std::move(recall_selection)),
+          m_targeted_calling(std::move(targeted_calling)),
+          m_basecall_cache(std::move(basecall_cache)),
+          m_pack_short_reads(pack_short_reads),
           m_node_name(node_name) {
+    // Group the runners by chunk size.
+    for (const auto &runner : m_model_runners) {
+        m_bucket_chunk_sizes.push_back(runner->chunk_size());
+    }
+    std::sort(m_bucket_chunk_sizes.begin(), m_bucket_chunk_sizes.end());
+    m_bucket_chunk_sizes.erase(
+            std::unique(m_bucket_chunk_sizes.begin(), m_bucket_chunk_sizes.end()),
+            m_bucket_chunk_sizes.end());
+    for (const auto &runner : m_model_runners) {
+        m_runner_buckets.push_back(std::distance(
+                m_bucket_chunk_sizes.begin(),
+                std::lower_bound(m_bucket_chunk_sizes.begin(), m_bucket_chunk_sizes.end(),
+                                 runner->chunk_size())));
+    }
+    m_chunks_in.reserve(m_bucket_chunk_sizes.size());
+    for (size_t i = 0; i < m_bucket_chunk_sizes.size(); ++i) {
+        m_chunks_in.emplace_back(chunk_scheduling);
+    }
+    // Allow 5 batches per model runner on each chunk size's chunks_in queue, until the
+    // runners' throughputs are known.
+    m_max_chunks_in.resize(m_bucket_chunk_sizes.size(), 0);
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        m_max_chunks_in[m_runner_buckets[i]] += m_model_runners[i]->batch_size() * 5;
+    }
+    for (size_t i = 0; i + 1 < m_bucket_chunk_sizes.size(); ++i) {
+        spdlog::debug("> {} calling short reads with chunk size {}", m_node_name,
+                      m_bucket_chunk_sizes[i]);
+    }
+
     // Setup worker state
     size_t const num_workers = m_model_runners.size();
     m_batched_chunks.resize(num_workers);
+    m_runner_chunks_per_s.resize(num_workers, 0.);
+    m_worker_waiting.resize(num_workers, false);
+    if (adaptive_latency_target_ms > 0) {
+        for (size_t i = 0; i < num_workers; ++i) {
+            m_batch_timeouts.push_back(
+                    std::make_unique<AdaptiveBatchTimeout>(adaptive_latency_target_ms));
+        }
+    }
     m_basecall_workers.resize(num_workers);
     m_num_active_model_runners = num_workers;
 
@@ -313,6 +912,14 @@ BasecallerNode::BasecallerNode(MessageSink &sink,
 
 BasecallerNode::~BasecallerNode() {
     terminate();
+    join();
+}
+
+void BasecallerNode::join() {
+    if (!m_working_reads_manager->joinable()) {
+        // Already joined.
+        return;
+    }
     m_input_worker->join();
     for (auto &t : m_basecall_workers) {
         t.join();
@@ -331,10 +938,41 @@ stats::NamedStats BasecallerNode::sample_stats() const {
     stats["partial_batches_called"] = m_num_partial_batches_called;
     stats["call_chunks_ms"] = m_call_chunks_ms;
     stats["called_reads_pushed"] = m_called_reads_pushed;
+    stats["reads_recalled"] = m_num_reads_recalled;
+    stats["reads_on_target"] = m_num_reads_on_target;
+    stats["reads_off_target"] = m_num_reads_off_target;
+    stats["reads_from_cache"] = m_num_reads_from_cache;
+    stats["reads_streamed"] = m_num_reads_streamed;
+    stats["reads_packed"] = m_num_packed_reads;
+    stats["packed_chunks"] = m_num_packed_chunks;
     stats["working_reads_items"] = m_working_reads_size;
+    stats["working_reads_bytes"] = m_working_reads_bytes;
     stats["bases_processed"] = m_num_bases_processed;
     stats["samples_processed"] = m_num_samples_processed;
+    for (size_t i = 0; i < m_batch_timeouts.size(); ++i) {
+        stats["runner_" + std::to_string(i) + "_batch_timeout_ms"] =
+                double(m_batch_timeouts[i]->timeout_ms());
+    }
+    {
+        std::lock_guard stats_lock(m_client_stats_mutex);
+        for (const auto &[client_id, client_stats] : m_client_stats) {
+            const auto prefix = "client_" + std::to_string(client_id) + "_";
+            stats[prefix + "reads_called"] = double(client_stats.reads_called);
+            stats[prefix + "samples_called"] = double(client_stats.samples_called);
+            stats[prefix + "mean_latency_ms"] =
+                    client_stats.reads_timed > 0
+                            ? client_stats.total_latency_ms / double(client_stats.reads_timed)
+                            : 0.;
+            stats[prefix + "max_latency_ms"] = client_stats.max_latency_ms;
+        }
+    }
     return stats;
 }
 
+void BasecallerNode::register_counters(stats::CounterRegistry &registry) const {
+    registry.add(get_name() + ".bases_processed", m_num_bases_processed);
+    registry.add(get_name() + ".samples_processed", m_num_samples_processed);
+    registry.add(get_name() + ".called_reads_pushed", m_called_reads_pushed);
+}
+
 }  // namespace dorado
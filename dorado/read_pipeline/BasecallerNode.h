@@ -1,17 +1,73 @@
 #pragma once
 
 #include "../nn/ModelRunner.h"
+#include "BatchTimeout.h"
+#include "ChunkQueue.h"
 #include "ReadPipeline.h"
 #include "utils/stats.h"
+#include "utils/stitch.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 namespace dorado {
 
+// Which of the reads an earlier basecaller has called are called again, e.g. with a larger
+// model: those of at least min_length bases whose mean qscore is below max_mean_qscore.
+struct RecallSelection {
+    size_t min_length{0};
+    float max_mean_qscore{std::numeric_limits<float>::max()};
+
+    bool selects(const Read& read) const;
+};
+
+class TargetMapper;
+namespace utils {
+class BasecallCache;
+}
+
+// Calls only the first prefix_chunks chunks of each read at first, and the rest of the read
+// only if the mapper finds that prefix on target.  Off-target reads are passed on truncated
+// to the prefix, with the signal after it cut off.
+struct TargetedCalling {
+    std::shared_ptr<const TargetMapper> mapper;
+    size_t prefix_chunks{2};
+};
+
 class BasecallerNode : public MessageSink {
 public:
-    // Chunk size and overlap are in raw samples
+    // Chunk size and overlap are in raw samples.
+    // Runners may have different chunk sizes, in which case reads that fit in a single chunk
+    // of one of the smaller sizes are called by the runners with that size, and all other
+    // reads by the runners with the largest chunk size.
+    // |chunk_scheduling| sets the order in which pending chunks of different reads are called.
+    // If |release_raw_data| is set, the signal of each read is freed once it has been called,
+    // for pipelines where no downstream node needs it.
+    // If |max_working_reads_bytes| is non-zero, no more reads are taken once the reads being
+    // called hold that many bytes of signal and called chunks, rather than limiting their number.
+    // If |decode_kept_steps_only| is set, runners which can are told to decode each chunk only
+    // up to a small margin past the last step stitching keeps, skipping the rest of its
+    // overlap with the next chunk, or the padding past the end of the read.
+    // Reads which have already been called are passed on, unless |recall_selection| is given
+    // and selects them, in which case their basecall is cleared and they are called again.
+    // If |basecall_cache| is given, reads whose signal it has calls for take the cached call
+    // rather than being called, and the calls of other reads are added to it.  It must only
+    // hold calls made with this node's model and settings.
+    // If |adaptive_latency_target_ms| is non-zero, partial batches are called when an
+    // AdaptiveBatchTimeout with that target chooses, rather than after |batch_timeout_ms|
+    // without new chunks.
+    // If |pack_short_reads| is set, reads short enough that several fit in a chunk of the
+    // largest size are packed into shared chunks, separated by the overlap, rather than each
+    // taking a chunk padded out past its end.  Each read is given the part of the call its
+    // own samples span.
     BasecallerNode(MessageSink& sink,
                    std::vector<Runner> model_runners,
                    size_t overlap,
@@ -19,10 +75,25 @@ public:
                    std::string model_name = "",
                    size_t max_reads = 1000,
                    const std::string& node_name = "BasecallerNode",
-                   bool in_duplex_pipeline = false);
+                   bool in_duplex_pipeline = false,
+                   ChunkSchedulingPolicy chunk_scheduling = ChunkSchedulingPolicy::FIFO,
+                   bool release_raw_data = false,
+                   size_t max_working_reads_bytes = 0,
+                   bool decode_kept_steps_only = false,
+                   std::optional<RecallSelection> recall_selection = std::nullopt,
+                   std::optional<TargetedCalling> targeted_calling = std::nullopt,
+                   std::shared_ptr<utils::BasecallCache> basecall_cache = nullptr,
+                   int adaptive_latency_target_ms = 0,
+                   bool pack_short_reads = false);
     ~BasecallerNode();
+    void join() override;
     std::string get_name() const override { return m_node_name; }
     stats::NamedStats sample_stats() const override;
+    void register_counters(stats::CounterRegistry& registry) const override;
+    // Sets how many chunks of the client's reads are taken for each chunk of another client's,
+    // while both have chunks waiting.  Clients have a weight of 1 until it is set, and setting
+    // it back to 1 forgets the client.
+    void set_client_weight(int32_t client_id, size_t weight);
 
 private:
     // Consume reads from input queue
@@ -33,24 +104,109 @@ private:
     void basecall_current_batch(int worker_id);
     // Construct complete reads
     void working_reads_manager();
+    // The chunks of a read held back until its prefix is found to be on target.
+    struct DeferredChunks {
+        size_t bucket;
+        std::vector<std::shared_ptr<Chunk>> chunks;
+    };
+    // A read with enough chunks is stitched as its chunks are called, in order, rather than
+    // once they all have been, so that each chunk's calls are freed as soon as it is stitched.
+    struct StreamingStitch {
+        StreamingStitch(std::vector<size_t> offsets, size_t raw_size)
+                : chunk_offsets(std::move(offsets)), stitcher(chunk_offsets.size(), raw_size) {}
+        // Guards the read's called chunks and the stitcher.
+        std::mutex mutex;
+        std::vector<size_t> chunk_offsets;
+        utils::ChunkStitcher stitcher;
+    };
+    // Records a called chunk of its read, stitching it and any called chunks after it if the
+    // read is streamed.
+    void add_called_chunk(Read& read, std::shared_ptr<Chunk> chunk);
+    // Stitches a called read's chunks and passes it on.  Runs on the shared thread pool.
+    void stitch_and_push(std::shared_ptr<Read> read);
+    // Stitches a read's called prefix and maps it, queueing the deferred chunks of an
+    // on-target read, or passing an off-target read on truncated.  Runs on the shared pool.
+    void stitch_and_map_prefix(std::shared_ptr<Read> read, DeferredChunks deferred);
+    // Passes on a stitched read.
+    void push_called_read(std::shared_ptr<Read> read);
+    // Notes when a client's read is made working, so its latency can be measured.  Must be
+    // called with m_working_reads_mutex held.
+    void start_client_read(const Read& read);
+    // Counts a client's called read in its stats.
+    void record_client_read(const Read& read);
+    // Gives the read its cached call, if the cache has one.  Returns whether it did.
+    bool take_cached_call(Read& read);
+    // Whether the workers can finish once the chunk queues are empty: the input is done, and
+    // no prefix is waiting to be mapped.  Must be called with m_chunks_in_mutex held.
+    bool terminating() const;
+    // Number of chunks in a worker's queue it can take, leaving those wanted by waiting runners
+    // of the same chunk size which are measurably faster. Must be called with m_chunks_in_mutex
+    // held.
+    size_t num_chunks_available(int worker_id) const;
+    // Folds a full batch's call time into the runner's measured throughput, and resizes its
+    // queue's limit to match. Must be called with m_chunks_in_mutex held.
+    void update_runner_throughput(int worker_id, int64_t call_ms);
+    // Waits until a read holding read_bytes can be made working and its chunks queued for the
+    // given bucket, returning the m_chunks_in_mutex lock.
+    std::unique_lock<std::mutex> wait_for_chunks_in_space(size_t bucket, size_t read_bytes);
+    // Wakes the workers which may take newly queued chunks.
+    void notify_chunks_added();
+    // Samples a read of raw_size takes in a packed chunk, rounded up to a whole step.
+    size_t packed_read_size(size_t raw_size) const;
+    // Whether a read is short enough to be packed with others.
+    bool packs_read(const Read& read, size_t raw_size) const;
+    // Adds a read to the chunk being packed, queueing that chunk first if the read won't fit.
+    void add_to_packed_chunk(std::shared_ptr<Read> read, size_t raw_size);
+    // Makes the packed reads working, and queues the chunk holding them.
+    void push_packed_chunk();
+    // Bytes a working read is accounted as holding: its signal, and its chunks once called.
+    size_t working_read_bytes(const Read& read, size_t num_chunks, size_t chunk_size) const;
+    // Output steps worth decoding of each of the chunks starting at chunk_offsets in a read of
+    // raw_size samples.
+    std::vector<size_t> chunk_decode_steps(const std::vector<size_t>& chunk_offsets,
+                                           size_t chunk_size,
+                                           size_t raw_size) const;
 
     MessageSink& m_sink;
     // Vector of model runners (each with their own GPU access etc)
     std::vector<Runner> m_model_runners;
-    // Chunk length
-    size_t m_chunk_size;
+    // Distinct runner chunk lengths, ascending.
+    std::vector<size_t> m_bucket_chunk_sizes;
+    // Index into m_bucket_chunk_sizes of each runner's chunk length.
+    std::vector<size_t> m_runner_buckets;
     // Minimum overlap between two adjacent chunks in a read. Overlap is used to reduce edge effects and improve accuracy.
     size_t m_overlap;
     // Stride of the model in the runners
     size_t m_model_stride;
     // Time in milliseconds before partial batches are called.
     int m_batch_timeout_ms;
+    // Each worker's partial batch timeout, if they are adaptive.
+    std::vector<std::unique_ptr<AdaptiveBatchTimeout>> m_batch_timeouts;
     // model_name
     std::string m_model_name;
     // max reads
     size_t m_max_reads;
     // is this node part of a duplex pipeline?
     bool m_in_duplex_pipeline;
+    // Free the signal of called reads before passing them on?
+    bool m_release_raw_data;
+    // Most bytes the working reads may hold, or 0 for no limit.
+    size_t m_max_working_reads_bytes;
+    // Decode chunks only as far as the steps which are kept?
+    bool m_decode_kept_steps_only;
+    // Which called reads are called again, if any.
+    std::optional<RecallSelection> m_recall_selection;
+    // Whether only on-target reads are called in full.
+    std::optional<TargetedCalling> m_targeted_calling;
+    // Calls made before, if they are cached.
+    std::shared_ptr<utils::BasecallCache> m_basecall_cache;
+    // Pack short reads together into chunks?
+    bool m_pack_short_reads;
+    // The chunk short reads are being packed into, if any, the reads in it, and where the last
+    // of them ends.  Only used by the input worker.
+    std::shared_ptr<Chunk> m_packed_chunk;
+    std::vector<std::shared_ptr<Read>> m_packed_reads;
+    size_t m_packed_end{0};
 
     // Model runners which have not terminated.
     std::atomic<int> m_num_active_model_runners{0};
@@ -68,12 +224,42 @@ private:
     std::mutex m_chunks_in_mutex;
     // Signalled when chunks are added to m_chunks_in
     std::condition_variable m_chunks_added_cv;
-    // Gets filled with chunks from the input reads
-    std::deque<std::shared_ptr<Chunk>> m_chunks_in;
+    // Gets filled with chunks from the input reads, one list per chunk length
+    std::vector<ChunkQueue> m_chunks_in;
+    // Most chunks each of m_chunks_in holds. Each runner is allowed 5 batches, scaled down by
+    // its throughput relative to the fastest runner of its chunk size, once they are measured.
+    std::vector<size_t> m_max_chunks_in;
+    // Chunks each runner calls per second, averaged over its recent full batches, or 0 until
+    // it has called one. Runners of the same chunk size on slower devices leave chunks to
+    // faster ones waiting for them, rather than holding chunks a faster device would finish first.
+    std::vector<double> m_runner_chunks_per_s;
+    // Whether each worker is waiting for chunks.
+    std::vector<bool> m_worker_waiting;
+    // Reads whose prefix is being called or mapped, which may still queue chunks.  Guarded by
+    // m_chunks_in_mutex.
+    size_t m_num_undecided_reads{0};
 
     std::mutex m_working_reads_mutex;
-    // Reads removed from input queue and being basecalled.
-    std::deque<std::shared_ptr<Read>> m_working_reads;
+    // Reads removed from input queue and being basecalled, which their chunks point back to.
+    std::unordered_map<const Read*, std::shared_ptr<Read>> m_working_reads;
+    // Reads whose last chunk has been called, moved from m_working_reads by the worker which
+    // called it, for the working reads manager to stitch.
+    std::vector<std::shared_ptr<Read>> m_completed_reads;
+    // Signalled when reads are completed, or when the manager is to terminate.
+    std::condition_variable m_reads_completed_cv;
+    // Chunks held back from the working reads whose prefixes are being called.
+    std::unordered_map<const Read*, DeferredChunks> m_deferred_chunks;
+    // The working reads which are stitched as their chunks are called.
+    std::unordered_map<const Read*, std::unique_ptr<StreamingStitch>> m_streaming_stitches;
+    // When each working read of a client, rather than standalone reads with a client_id of -1,
+    // was made working.
+    std::unordered_map<const Read*, std::chrono::steady_clock::time_point> m_client_read_starts;
+
+    // Number of called reads being stitched on the thread pool, which the working reads
+    // manager bounds, and waits to reach 0 before terminating the sink.
+    std::mutex m_stitching_mutex;
+    std::condition_variable m_stitching_cv;
+    int m_num_reads_stitching{0};
 
     // If we go multi-threaded, there will be one of these batches per thread
     std::vector<std::deque<std::shared_ptr<Chunk>>> m_batched_chunks;
@@ -95,9 +281,29 @@ private:
     std::atomic<int64_t> m_num_partial_batches_called = 0;
     std::atomic<int64_t> m_call_chunks_ms = 0;
     std::atomic<int64_t> m_called_reads_pushed = 0;
+    std::atomic<int64_t> m_num_reads_recalled = 0;
+    std::atomic<int64_t> m_num_reads_on_target = 0;
+    std::atomic<int64_t> m_num_reads_off_target = 0;
+    std::atomic<int64_t> m_num_reads_from_cache = 0;
+    std::atomic<int64_t> m_num_reads_streamed = 0;
+    std::atomic<int64_t> m_num_packed_reads = 0;
+    std::atomic<int64_t> m_num_packed_chunks = 0;
     std::atomic<int64_t> m_working_reads_size = 0;
+    std::atomic<int64_t> m_working_reads_bytes = 0;
     std::atomic<int64_t> m_num_bases_processed = 0;
     std::atomic<int64_t> m_num_samples_processed = 0;
+    // Reads passed on for each client, and how long those which were called took from being
+    // made working to being passed on.
+    struct ClientStats {
+        int64_t reads_called{0};
+        int64_t samples_called{0};
+        // Reads which were called, rather than passed on, and their latencies.
+        int64_t reads_timed{0};
+        double total_latency_ms{0.};
+        double max_latency_ms{0.};
+    };
+    mutable std::mutex m_client_stats_mutex;
+    std::map<int32_t, ClientStats> m_client_stats;
 };
 
 }  // namespace dorado
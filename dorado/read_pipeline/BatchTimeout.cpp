@@ -0,0 +1,74 @@
+#include "BatchTimeout.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dorado {
+
+namespace {
+
+// Weight of each new measurement, so the estimates follow changes in load.
+constexpr double kNewSampleWeight = 0.2;
+
+double elapsed_ms(AdaptiveBatchTimeout::Clock::time_point from,
+                  AdaptiveBatchTimeout::Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}  // namespace
+
+AdaptiveBatchTimeout::AdaptiveBatchTimeout(int latency_target_ms)
+        : m_latency_target_ms(std::max(latency_target_ms, 1)),
+          m_timeout_ms(m_latency_target_ms) {}
+
+void AdaptiveBatchTimeout::chunks_added(size_t num_chunks, Clock::time_point now) {
+    if (num_chunks == 0) {
+        return;
+    }
+    if (m_last_arrival) {
+        const double interval_ms = elapsed_ms(*m_last_arrival, now) / double(num_chunks);
+        m_chunk_interval_ms = m_chunk_interval_ms < 0.
+                                      ? interval_ms
+                                      : (1. - kNewSampleWeight) * m_chunk_interval_ms +
+                                                kNewSampleWeight * interval_ms;
+    }
+    m_last_arrival = now;
+    if (!m_first_batched) {
+        m_first_batched = now;
+    }
+}
+
+void AdaptiveBatchTimeout::batch_called(int64_t call_ms) {
+    m_call_ms = m_call_ms == 0. ? double(call_ms)
+                                : (1. - kNewSampleWeight) * m_call_ms +
+                                          kNewSampleWeight * double(call_ms);
+    m_first_batched.reset();
+}
+
+int64_t AdaptiveBatchTimeout::wait_ms(size_t num_batched,
+                                      size_t batch_size,
+                                      Clock::time_point now) {
+    if (num_batched == 0 || !m_first_batched) {
+        // There is nothing to call, so this is just how often the worker wakes.
+        return m_latency_target_ms;
+    }
+    const double age_ms = elapsed_ms(*m_first_batched, now);
+    const double call_allowance_ms = std::min(m_call_ms, m_latency_target_ms / 2.);
+    double wait = m_latency_target_ms - call_allowance_ms - age_ms;
+    if (wait > 0. && num_batched < batch_size && m_chunk_interval_ms >= 0.) {
+        // Having waited longer than the usual gap since the last chunk, the arrivals are taken
+        // to have slowed, and another as long a wait is expected.
+        const double since_last_ms = elapsed_ms(*m_last_arrival, now);
+        const double next_chunk_ms = since_last_ms < m_chunk_interval_ms
+                                             ? m_chunk_interval_ms - since_last_ms
+                                             : since_last_ms;
+        if (next_chunk_ms > wait) {
+            wait = 0.;
+        }
+    }
+    wait = std::max(std::ceil(wait), 0.);
+    m_timeout_ms.store(int64_t(age_ms + wait));
+    return int64_t(wait);
+}
+
+}  // namespace dorado
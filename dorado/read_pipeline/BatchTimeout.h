@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace dorado {
+
+// Chooses how long a basecall worker waits for more chunks before calling a partial batch.
+// A fixed timeout calls a partial batch once no chunk has arrived for that long, which adds
+// latency under light load, and calls many small batches under bursty load.  This instead
+// tracks the rate chunks arrive at and how long the runner takes to call a batch.  A partial
+// batch is held until its oldest chunk would miss the latency target, allowing for the call
+// itself, so it fills as far as the target allows.  It is called sooner if no further chunk is
+// expected before then, since waiting would then only add latency.
+// Not thread safe, apart from timeout_ms().
+class AdaptiveBatchTimeout {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // |latency_target_ms| is how long the first chunk of a batch may wait for its batch to be
+    // called and finish.  At most half of it is set aside for the call, so that runners which
+    // call slower than the target still fill their batches for the rest.
+    explicit AdaptiveBatchTimeout(int latency_target_ms);
+
+    // Records that |num_chunks| chunks were added to the batch at |now|.
+    void chunks_added(size_t num_chunks, Clock::time_point now);
+    // Records that the batch was called, taking |call_ms|, leaving it empty.
+    void batch_called(int64_t call_ms);
+    // How long from |now| to wait for more chunks before calling a batch holding
+    // |num_batched| of |batch_size| chunks.
+    int64_t wait_ms(size_t num_batched, size_t batch_size, Clock::time_point now);
+    // The longest the current or last partial batch was allowed to wait from its first chunk.
+    int64_t timeout_ms() const { return m_timeout_ms.load(); }
+
+private:
+    const int m_latency_target_ms;
+    // Exponentially weighted means of the gap between chunk arrivals, per chunk, and of the
+    // time taken to call a batch.  The interval is negative until measured.
+    double m_chunk_interval_ms{-1.};
+    double m_call_ms{0.};
+    std::optional<Clock::time_point> m_last_arrival;
+    // When the oldest chunk of the batch arrived, if it holds any.
+    std::optional<Clock::time_point> m_first_batched;
+    std::atomic<int64_t> m_timeout_ms;
+};
+
+}  // namespace dorado
@@ -0,0 +1,140 @@
+#include "ChunkQueue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+
+namespace dorado {
+
+ChunkSchedulingPolicy parse_chunk_scheduling_policy(const std::string& name) {
+    if (name == "fifo") {
+        return ChunkSchedulingPolicy::FIFO;
+    } else if (name == "shortest") {
+        return ChunkSchedulingPolicy::ShortestRemainingFirst;
+    } else if (name == "round_robin") {
+        return ChunkSchedulingPolicy::RoundRobin;
+    }
+    throw std::runtime_error("Unknown chunk scheduling policy: " + name);
+}
+
+namespace {
+
+// The client of a chunk's read, or of the first read packed into it.
+int32_t chunk_client_id(const Chunk& chunk) {
+    if (chunk.source_read) {
+        return chunk.source_read->client_id;
+    }
+    return chunk.packed_chunks.empty() ? -1 : chunk_client_id(*chunk.packed_chunks.front());
+}
+
+}  // namespace
+
+void ChunkQueue::push_read_chunks(std::vector<std::shared_ptr<Chunk>> chunks) {
+    if (chunks.empty()) {
+        return;
+    }
+    m_size += chunks.size();
+    const int32_t client_id = chunk_client_id(*chunks.front());
+    auto [it, inserted] = m_clients.try_emplace(client_id);
+    if (inserted) {
+        // The client waits for its turn behind the clients already queued.
+        m_client_turns.push_back(client_id);
+    }
+    it->second.push(m_policy, m_aging_chunks, std::move(chunks));
+}
+
+std::shared_ptr<Chunk> ChunkQueue::pop() {
+    assert(!empty());
+    --m_size;
+    const int32_t client_id = m_client_turns.front();
+    if (m_turn_chunks_left == 0) {
+        auto weight = m_client_weights.find(client_id);
+        m_turn_chunks_left = weight == m_client_weights.end() ? 1 : weight->second;
+    }
+    auto client = m_clients.find(client_id);
+    auto chunk = client->second.pop(m_policy, m_aging_chunks);
+    --m_turn_chunks_left;
+    if (client->second.size == 0) {
+        // A client which runs out of chunks gives up the rest of its turn.
+        m_clients.erase(client);
+        m_client_turns.pop_front();
+        m_turn_chunks_left = 0;
+    } else if (m_turn_chunks_left == 0) {
+        m_client_turns.pop_front();
+        m_client_turns.push_back(client_id);
+    }
+    return chunk;
+}
+
+void ChunkQueue::set_client_weight(int32_t client_id, size_t weight) {
+    if (weight == 1) {
+        m_client_weights.erase(client_id);
+    } else {
+        m_client_weights[client_id] = std::max(weight, size_t(1));
+    }
+}
+
+void ChunkQueue::ClientChunks::push(ChunkSchedulingPolicy policy,
+                                    size_t aging_chunks,
+                                    std::vector<std::shared_ptr<Chunk>> read_chunks) {
+    size += read_chunks.size();
+    switch (policy) {
+    case ChunkSchedulingPolicy::FIFO:
+        chunks.insert(chunks.end(), std::make_move_iterator(read_chunks.begin()),
+                      std::make_move_iterator(read_chunks.end()));
+        break;
+    case ChunkSchedulingPolicy::RoundRobin:
+        reads.emplace_back(std::make_move_iterator(read_chunks.begin()),
+                           std::make_move_iterator(read_chunks.end()));
+        break;
+    case ChunkSchedulingPolicy::ShortestRemainingFirst: {
+        // Reads keep their arrival order when their priorities are equal, since multimap
+        // inserts at the upper bound of equal keys.
+        const uint64_t priority = read_chunks.size() * aging_chunks + num_popped;
+        reads_by_priority.emplace(priority,
+                                  ReadChunks(std::make_move_iterator(read_chunks.begin()),
+                                             std::make_move_iterator(read_chunks.end())));
+        break;
+    }
+    }
+}
+
+std::shared_ptr<Chunk> ChunkQueue::ClientChunks::pop(ChunkSchedulingPolicy policy,
+                                                     size_t aging_chunks) {
+    --size;
+    ++num_popped;
+    std::shared_ptr<Chunk> chunk;
+    switch (policy) {
+    case ChunkSchedulingPolicy::FIFO:
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        break;
+    case ChunkSchedulingPolicy::RoundRobin: {
+        auto& read_chunks = reads.front();
+        chunk = std::move(read_chunks.front());
+        read_chunks.pop_front();
+        if (!read_chunks.empty()) {
+            reads.push_back(std::move(read_chunks));
+        }
+        reads.pop_front();
+        break;
+    }
+    case ChunkSchedulingPolicy::ShortestRemainingFirst: {
+        // Re-key the read by its new remaining count, which keeps it at the front.  Its age
+        // is unchanged, since it was queued at the same point.
+        auto node = reads_by_priority.extract(reads_by_priority.begin());
+        auto& read_chunks = node.mapped();
+        chunk = std::move(read_chunks.front());
+        read_chunks.pop_front();
+        if (!read_chunks.empty()) {
+            node.key() -= aging_chunks;
+            reads_by_priority.insert(reads_by_priority.begin(), std::move(node));
+        }
+        break;
+    }
+    }
+    return chunk;
+}
+
+}  // namespace dorado
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ReadPipeline.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+// Order in which chunks of different reads are handed out for basecalling.
+enum class ChunkSchedulingPolicy {
+    // Chunks in the order their reads arrived.  A long read holds up every read behind it.
+    FIFO,
+    // Chunks of the read with the fewest chunks left to call first, so short reads finish
+    // (and leave the working set) as soon as possible.  Reads age as they wait, so a long read
+    // isn't starved by a steady stream of short ones: see ChunkQueue.
+    ShortestRemainingFirst,
+    // One chunk from each read in turn, so every read makes progress at the same rate.
+    RoundRobin,
+};
+
+// Parses "fifo", "shortest" or "round_robin".  Throws std::runtime_error otherwise.
+ChunkSchedulingPolicy parse_chunk_scheduling_policy(const std::string& name);
+
+// Pending chunks awaiting basecalling, handed out according to a ChunkSchedulingPolicy.
+// Chunks of different clients, as given by their reads' client_id, are queued separately and
+// handed out by deficit round robin: each client with chunks pending takes its weight in
+// chunks in turn, so one client's large job can't hold up the others.  The policy orders
+// each client's chunks.  Not thread safe.
+//
+// With ShortestRemainingFirst, a read's priority is its remaining chunks less its age, where
+// its age is the number of its client's chunks handed out since it was queued, divided by
+// aging_chunks.  A read queued behind one with n fewer chunks left therefore goes first once
+// it has waited n * aging_chunks chunks, however many shorter reads have arrived since.
+class ChunkQueue {
+public:
+    static constexpr size_t kDefaultAgingChunks = 16;
+
+    explicit ChunkQueue(ChunkSchedulingPolicy policy = ChunkSchedulingPolicy::FIFO,
+                        size_t aging_chunks = kDefaultAgingChunks)
+            : m_policy(policy), m_aging_chunks(std::max(aging_chunks, size_t(1))) {}
+
+    // Adds all the chunks of a read, in order.
+    void push_read_chunks(std::vector<std::shared_ptr<Chunk>> chunks);
+    // Removes and returns the next chunk to call.  Must not be called when empty.
+    std::shared_ptr<Chunk> pop();
+
+    // Sets how many chunks the client takes in its turn.  Clients have a weight of 1 until it
+    // is set, and setting it back to 1 forgets the client.
+    void set_client_weight(int32_t client_id, size_t weight);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    using ReadChunks = std::deque<std::shared_ptr<Chunk>>;
+
+    // The pending chunks of one client, in the order of the policy.
+    struct ClientChunks {
+        void push(ChunkSchedulingPolicy policy,
+                  size_t aging_chunks,
+                  std::vector<std::shared_ptr<Chunk>> chunks);
+        std::shared_ptr<Chunk> pop(ChunkSchedulingPolicy policy, size_t aging_chunks);
+
+        size_t size = 0;
+        // Chunks handed out so far, by which reads' waits are measured.
+        uint64_t num_popped = 0;
+        // FIFO: every pending chunk.
+        ReadChunks chunks;
+        // RoundRobin: pending chunks per read, in the order reads will next be visited.
+        std::deque<ReadChunks> reads;
+        // ShortestRemainingFirst: pending chunks per read, keyed by remaining chunks times
+        // aging_chunks, plus num_popped when the read was queued, lowest first.
+        std::multimap<uint64_t, ReadChunks> reads_by_priority;
+    };
+
+    const ChunkSchedulingPolicy m_policy;
+    const size_t m_aging_chunks;
+    size_t m_size = 0;
+    // Clients with chunks pending.
+    std::map<int32_t, ClientChunks> m_clients;
+    // Clients with chunks pending in the order of their turns, the first taking its turn.
+    std::deque<int32_t> m_client_turns;
+    // Chunks the first client in m_client_turns has left to take in its turn.
+    size_t m_turn_chunks_left = 0;
+    // Weights which have been set to other than 1.
+    std::map<int32_t, size_t> m_client_weights;
+};
+
+}  // namespace dorado
@@ -0,0 +1,133 @@
+#include "ClientRouterNode.h"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+int32_t message_client_id(const dorado::Message& message) {
+    if (std::holds_alternative<std::shared_ptr<dorado::Read>>(message)) {
+        return std::get<std::shared_ptr<dorado::Read>>(message)->client_id;
+    }
+    return -1;
+}
+
+}  // namespace
+
+namespace dorado {
+
+ClientRouterNode::ClientRouterNode(std::string node_name)
+        // Messages are never queued on the router itself.
+        : MessageSink(1), m_node_name(std::move(node_name)) {}
+
+void ClientRouterNode::add_client(int32_t client_id, MessageSink& sink) {
+    std::lock_guard lock(m_clients_mutex);
+    if (!m_clients.emplace(client_id, Client{&sink}).second) {
+        throw std::runtime_error("Client " + std::to_string(client_id) +
+                                 " is already registered");
+    }
+}
+
+size_t ClientRouterNode::remove_client(int32_t client_id) {
+    std::lock_guard lock(m_clients_mutex);
+    auto it = m_clients.find(client_id);
+    if (it == m_clients.end()) {
+        return 0;
+    }
+    const size_t num_reads_routed = it->second.num_reads_routed;
+    m_clients.erase(it);
+    return num_reads_routed;
+}
+
+bool ClientRouterNode::wait_for_reads(int32_t client_id, size_t num_reads) {
+    std::unique_lock lock(m_clients_mutex);
+    bool arrived = false;
+    m_reads_routed_cv.wait(lock, [&] {
+        auto it = m_clients.find(client_id);
+        arrived = it != m_clients.end() && it->second.num_reads_routed >= num_reads;
+        return arrived || m_terminated;
+    });
+    return arrived;
+}
+
+MessageSink* ClientRouterNode::find_sink(const Message& message) {
+    const int32_t client_id = message_client_id(message);
+    std::lock_guard lock(m_clients_mutex);
+    auto it = m_clients.find(client_id);
+    if (it == m_clients.end()) {
+        return nullptr;
+    }
+    return it->second.sink;
+}
+
+void ClientRouterNode::count_routed(int32_t client_id, size_t num_reads) {
+    m_num_routed += num_reads;
+    {
+        std::lock_guard lock(m_clients_mutex);
+        auto it = m_clients.find(client_id);
+        if (it != m_clients.end()) {
+            it->second.num_reads_routed += num_reads;
+        }
+    }
+    m_reads_routed_cv.notify_all();
+}
+
+void ClientRouterNode::push_message(Message&& message) {
+    // A client is only removed once all of its reads have been counted, so the sink is still
+    // registered while its reads are being pushed to it.
+    auto sink = find_sink(message);
+    if (!sink) {
+        spdlog::warn("Dropping message for unknown client {}", message_client_id(message));
+        ++m_num_dropped;
+        return;
+    }
+    const int32_t client_id = message_client_id(message);
+    sink->push_message(std::move(message));
+    count_routed(client_id, 1);
+}
+
+void ClientRouterNode::push_messages(std::vector<Message>&& messages) {
+    // Batches usually come from a single client, so keep runs of the same client together.
+    size_t begin = 0;
+    while (begin < messages.size()) {
+        const int32_t client_id = message_client_id(messages[begin]);
+        size_t end = begin + 1;
+        while (end < messages.size() && message_client_id(messages[end]) == client_id) {
+            ++end;
+        }
+        if (end - begin == 1) {
+            push_message(std::move(messages[begin]));
+        } else if (auto sink = find_sink(messages[begin])) {
+            std::vector<Message> run(std::make_move_iterator(messages.begin() + begin),
+                                     std::make_move_iterator(messages.begin() + end));
+            sink->push_messages(std::move(run));
+            count_routed(client_id, end - begin);
+        } else {
+            spdlog::warn("Dropping {} messages for unknown client {}", end - begin, client_id);
+            m_num_dropped += end - begin;
+        }
+        begin = end;
+    }
+}
+
+void ClientRouterNode::terminate() {
+    MessageSink::terminate();
+    {
+        std::lock_guard lock(m_clients_mutex);
+        m_terminated = true;
+    }
+    m_reads_routed_cv.notify_all();
+}
+
+stats::NamedStats ClientRouterNode::sample_stats() const {
+    stats::NamedStats stats;
+    stats["messages_routed"] = m_num_routed.load();
+    stats["messages_dropped"] = m_num_dropped.load();
+    std::lock_guard lock(m_clients_mutex);
+    stats["clients"] = double(m_clients.size());
+    return stats;
+}
+
+}  // namespace dorado
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace dorado {
+
+/// Sends each read to the sink registered for its Read::client_id, so that reads from several
+/// clients can share one basecalling pipeline and still end up back with the client that
+/// submitted them.  Like MessageRouterNode, routing happens inline on the pushing thread.
+class ClientRouterNode : public MessageSink {
+public:
+    explicit ClientRouterNode(std::string node_name = "ClientRouterNode");
+
+    // Reads for client_id are sent to sink until the client is removed.  Throws if client_id
+    // is already registered.
+    void add_client(int32_t client_id, MessageSink& sink);
+    // Stops routing to the client's sink, and returns how many reads were sent to it.
+    // Reads which arrive for the client after this are dropped.
+    size_t remove_client(int32_t client_id);
+    // Blocks until num_reads reads have been sent to the client's sink, or the node is
+    // terminated.  Returns whether all the reads arrived.
+    bool wait_for_reads(int32_t client_id, size_t num_reads);
+
+    void push_message(Message&& message) override;
+    void push_messages(std::vector<Message>&& messages) override;
+    // Wakes any wait_for_reads callers.  Client sinks belong to their clients, so they are
+    // not terminated here.
+    void terminate() override;
+
+    std::string get_name() const override { return m_node_name; }
+    stats::NamedStats sample_stats() const override;
+
+private:
+    struct Client {
+        MessageSink* sink;
+        size_t num_reads_routed{0};
+    };
+
+    // Returns the sink for the message, or nullptr if it should be dropped.
+    MessageSink* find_sink(const Message& message);
+    void count_routed(int32_t client_id, size_t num_reads);
+
+    std::string m_node_name;
+    mutable std::mutex m_clients_mutex;
+    std::condition_variable m_reads_routed_cv;
+    std::unordered_map<int32_t, Client> m_clients;
+    bool m_terminated{false};
+
+    // Performance monitoring stats.
+    std::atomic<int64_t> m_num_routed{0};
+    std::atomic<int64_t> m_num_dropped{0};
+};
+
+}  // namespace dorado
@@ -1,20 +1,24 @@
 #include "DuplexSplitNode.h"
 
-#include "utils/alignment_utils.h"
 #include "utils/duplex_utils.h"
 #include "utils/read_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/simd.h"
 #include "utils/time_utils.h"
 #include "utils/uuid_utils.h"
 
 #include <openssl/sha.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <iomanip>
 #include <optional>
 #include <string>
+#include <string_view>
 
 namespace {
 
@@ -45,41 +49,96 @@ PosRanges merge_ranges(const PosRanges& ranges, size_t merge_dist) {
     return merged;
 }
 
-std::vector<std::pair<size_t, size_t>> detect_pore_signal(const torch::Tensor& signal,
-                                                          float threshold,
-                                                          size_t cluster_dist,
-                                                          size_t ignore_prefix) {
-    std::vector<std::pair<size_t, size_t>> ans;
-    auto pore_a = signal.accessor<float, 1>();
-    int64_t cl_start = -1;
-    int64_t cl_end = -1;
+// Float16 values compare as these keys do as signed integers, with both zeros equal.
+inline int16_t half_order_key(uint16_t bits) {
+    const auto magnitude = static_cast<int16_t>(bits & 0x7fff);
+    return (bits & 0x8000) ? -magnitude : magnitude;
+}
+// Keys above this are NaNs.
+constexpr int16_t kHalfInfinityKey = 0x7c00;
 
-    for (size_t i = ignore_prefix; i < pore_a.size(0); i++) {
-        if (pore_a[i] > threshold) {
-            //check if we need to start new cluster
-            if (cl_end == -1 || i > cl_end + cluster_dist) {
-                //report previous cluster
-                if (cl_end != -1) {
-                    assert(cl_start != -1);
-                    ans.push_back({cl_start, cl_end});
-                }
-                cl_start = i;
-            }
-            cl_end = i + 1;
+float half_key_to_float(int key) {
+    const auto bits = static_cast<uint16_t>(key >= 0 ? key : (0x8000 | -key));
+    return static_cast<float>(c10::Half(bits, c10::Half::from_bits()));
+}
+
+// Largest key with a value no greater than threshold, so that a float16 value is greater than
+// threshold exactly when its key is greater than this.
+int16_t half_threshold_key(float threshold) {
+    int lo = -kHalfInfinityKey;
+    int hi = kHalfInfinityKey;
+    while (lo < hi) {
+        const int mid = lo + (hi - lo + 1) / 2;
+        if (half_key_to_float(mid) <= threshold) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
         }
     }
-    //report last cluster
-    if (cl_end != -1) {
-        assert(cl_start != -1);
-        assert(cl_start < pore_a.size(0) && cl_end <= pore_a.size(0));
-        ans.push_back(std::pair{cl_start, cl_end});
+    return static_cast<int16_t>(lo);
+}
+
+// Appends the indices of the float16 samples whose keys exceed threshold_key.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void find_samples_above(const uint16_t* samples,
+                        size_t num_samples,
+                        int16_t threshold_key,
+                        std::vector<size_t>& indices) {
+    for (size_t i = 0; i < num_samples; ++i) {
+        const int16_t key = half_order_key(samples[i]);
+        if (key > threshold_key && key <= kHalfInfinityKey) {
+            indices.push_back(i);
+        }
     }
+}
 
-    return ans;
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2"))) void find_samples_above(const uint16_t* samples,
+                                                        size_t num_samples,
+                                                        int16_t threshold_key,
+                                                        std::vector<size_t>& indices) {
+    const __m256i kThresholdKey = _mm256_set1_epi16(threshold_key);
+    const __m256i kInfinityKey = _mm256_set1_epi16(kHalfInfinityKey);
+    const __m256i kMagnitudeMask = _mm256_set1_epi16(0x7fff);
+    size_t i = 0;
+    for (; i + 16 <= num_samples; i += 16) {
+        const __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+        // As half_order_key(): negate the magnitude of negative values.
+        const __m256i sign = _mm256_srai_epi16(bits, 15);
+        const __m256i magnitude = _mm256_and_si256(bits, kMagnitudeMask);
+        const __m256i key = _mm256_sub_epi16(_mm256_xor_si256(magnitude, sign), sign);
+        const __m256i above = _mm256_andnot_si256(_mm256_cmpgt_epi16(key, kInfinityKey),
+                                                  _mm256_cmpgt_epi16(key, kThresholdKey));
+        // Each sample sets 2 bits of the mask.  Most blocks have none above the threshold.
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(above));
+        while (mask != 0) {
+            const int bit = __builtin_ctz(mask);
+            indices.push_back(i + bit / 2);
+            mask &= ~(uint32_t(3) << bit);
+        }
+    }
+    for (; i < num_samples; ++i) {
+        const int16_t key = half_order_key(samples[i]);
+        if (key > threshold_key && key <= kHalfInfinityKey) {
+            indices.push_back(i);
+        }
+    }
+}
+#endif
+
+// Largest key of a float16 sample which isn't pore signal at pore_thr pA.
+int16_t pore_threshold_key(const Read& read, float pore_thr) {
+    //pA formula before scaling:
+    //pA = read->scaling * (raw + read->offset);
+    //pA formula after scaling:
+    //pA = read->scale * raw + read->shift
+    return half_threshold_key((pore_thr - read.shift) / read.scale);
 }
 
 //[start, end)
-std::optional<PosRange> find_best_adapter_match(const std::string& adapter,
+std::optional<PosRange> find_best_adapter_match(const utils::PatternMatcher& adapter_matcher,
                                                 const std::string& seq,
                                                 int dist_thr,
                                                 PosRange subrange) {
@@ -90,30 +149,24 @@ std::optional<PosRange> find_best_adapter_match(const std::string& adapter,
     if (span == 0)
         return std::nullopt;
 
-    auto edlib_cfg = edlibNewAlignConfig(dist_thr, EDLIB_MODE_HW, EDLIB_TASK_LOC, NULL, 0);
-
-    auto edlib_result =
-            edlibAlign(adapter.c_str(), adapter.size(), seq.c_str() + shift, span, edlib_cfg);
-    assert(edlib_result.status == EDLIB_STATUS_OK);
-    std::optional<PosRange> res = std::nullopt;
-    if (edlib_result.status == EDLIB_STATUS_OK && edlib_result.editDistance != -1) {
-        assert(edlib_result.editDistance <= dist_thr);
-        res = {edlib_result.startLocations[0] + shift, edlib_result.endLocations[0] + shift + 1};
+    auto match = adapter_matcher.find_best_match(std::string_view(seq).substr(shift, span),
+                                                 dist_thr);
+    if (!match) {
+        return std::nullopt;
     }
-    edlibFreeAlignResult(edlib_result);
-    return res;
+    return PosRange{match->first + shift, match->second + shift};
 }
 
 //currently just finds a single best match
 //TODO efficiently find more matches
-std::vector<PosRange> find_adapter_matches(const std::string& adapter,
+std::vector<PosRange> find_adapter_matches(const utils::PatternMatcher& adapter_matcher,
                                            const std::string& seq,
                                            int dist_thr,
                                            uint64_t ignore_prefix) {
     std::vector<PosRange> answer;
     if (ignore_prefix < seq.size()) {
-        if (auto best_match =
-                    find_best_adapter_match(adapter, seq, dist_thr, {ignore_prefix, seq.size()})) {
+        if (auto best_match = find_best_adapter_match(adapter_matcher, seq, dist_thr,
+                                                      {ignore_prefix, seq.size()})) {
             answer.push_back(*best_match);
         }
     }
@@ -129,17 +182,9 @@ bool check_rc_match(const std::string& seq, PosRange templ_r, PosRange compl_r,
     auto rc_compl = dorado::utils::reverse_complement(
             seq.substr(compl_r.first, compl_r.second - compl_r.first));
 
-    auto edlib_cfg = edlibNewAlignConfig(dist_thr, EDLIB_MODE_HW, EDLIB_TASK_DISTANCE, NULL, 0);
-
-    auto edlib_result = edlibAlign(seq.c_str() + templ_r.first, templ_r.second - templ_r.first,
-                                   rc_compl.c_str(), rc_compl.size(), edlib_cfg);
-    assert(edlib_result.status == EDLIB_STATUS_OK);
-
-    bool match = (edlib_result.status == EDLIB_STATUS_OK) && (edlib_result.editDistance != -1);
-    assert(!match || edlib_result.editDistance <= dist_thr);
-
-    edlibFreeAlignResult(edlib_result);
-    return match;
+    const utils::PatternMatcher templ_matcher(
+            seq.substr(templ_r.first, templ_r.second - templ_r.first));
+    return templ_matcher.edit_distance(rc_compl, dist_thr).has_value();
 }
 
 //TODO end_reason access?
@@ -199,41 +244,95 @@ std::shared_ptr<Read> subread(const Read& read, PosRange seq_range, PosRange sig
 
 namespace dorado {
 
-DuplexSplitNode::ExtRead::ExtRead(std::shared_ptr<Read> r)
-        : read(std::move(r)),
-          data_as_float32(read->raw_data.to(torch::kFloat)),
-          move_sums(utils::move_cum_sums(read->moves)) {
-    assert(!move_sums.empty());
-    assert(move_sums.back() == read->seq.length());
+uint64_t DuplexSplitNode::ExtRead::cum_sum(size_t i) const {
+    // The read's moves start with the move of its first base.
+    return context->move_table.cum_sum(signal_offset / read->model_stride + i) - base_offset;
+}
+
+uint64_t DuplexSplitNode::ExtRead::seq_to_sig(size_t i) const {
+    return context->seq_to_sig_map[base_offset + i] - signal_offset;
+}
+
+DuplexSplitNode::SplitContext DuplexSplitNode::make_split_context(const Read& read) const {
+    const auto& move_table = read.move_table();
+    assert(move_table.num_timesteps() > 0);
+    assert(move_table.num_moves() == read.seq.length());
+    SplitContext context{move_table,
+                         move_table.to_sig_map(read.model_stride, read.raw_data.size(0)),
+                         {}};
+
+    const auto& signal = read.raw_data;
+    assert(signal.dtype() == torch::kFloat16 && signal.is_contiguous());
+    const auto* samples = reinterpret_cast<const uint16_t*>(signal.data_ptr<c10::Half>());
+    const size_t num_samples = signal.size(0);
+    const int16_t threshold_key = std::min(pore_threshold_key(read, m_settings.pore_thr),
+                                           pore_threshold_key(read, m_settings.relaxed_pore_thr));
+
+    //the signal is scanned in blocks, so only a block's worth of indices is held at once
+    constexpr size_t kBlockSize = 4096;
+    std::vector<size_t> block_indices;
+    for (size_t block_start = m_settings.expect_pore_prefix; block_start < num_samples;
+         block_start += kBlockSize) {
+        block_indices.clear();
+        find_samples_above(samples + block_start, std::min(kBlockSize, num_samples - block_start),
+                           threshold_key, block_indices);
+        for (const size_t block_index : block_indices) {
+            const size_t i = block_start + block_index;
+            context.pore_samples.push_back({i, half_order_key(samples[i])});
+        }
+    }
+    return context;
 }
 
 PosRanges DuplexSplitNode::possible_pore_regions(const DuplexSplitNode::ExtRead& read,
                                                  float pore_thr) const {
     PosRanges pore_regions;
-
-    //pA formula before scaling:
-    //pA = read->scaling * (raw + read->offset);
-    //pA formula after scaling:
-    //pA = read->scale * raw + read->shift
     spdlog::trace("Analyzing signal in read {}", read.read->read_id);
 
-    auto pore_sample_ranges = detect_pore_signal(
-            read.data_as_float32, (pore_thr - read.read->shift) / read.read->scale,
-            m_settings.pore_cl_dist, m_settings.expect_pore_prefix);
+    //clusters of the read's pore samples above the threshold, past its expected prefix
+    const auto& pore_samples = read.context->pore_samples;
+    const int16_t threshold_key = pore_threshold_key(*read.read, pore_thr);
+    const uint64_t signal_end = read.signal_offset + read.read->raw_data.size(0);
+    auto sample = std::lower_bound(pore_samples.begin(), pore_samples.end(),
+                                   read.signal_offset + m_settings.expect_pore_prefix,
+                                   [](const PoreSample& s, uint64_t i) { return s.index < i; });
+    std::vector<std::pair<size_t, size_t>> pore_sample_ranges;
+    int64_t cl_start = -1;
+    int64_t cl_end = -1;
+    for (; sample != pore_samples.end() && sample->index < signal_end; ++sample) {
+        if (sample->key <= threshold_key) {
+            continue;
+        }
+        const size_t i = sample->index - read.signal_offset;
+        //check if we need to start new cluster
+        if (cl_end == -1 || i > cl_end + m_settings.pore_cl_dist) {
+            //report previous cluster
+            if (cl_end != -1) {
+                pore_sample_ranges.push_back({cl_start, cl_end});
+            }
+            cl_start = i;
+        }
+        cl_end = i + 1;
+    }
+    //report last cluster
+    if (cl_end != -1) {
+        pore_sample_ranges.push_back({cl_start, cl_end});
+    }
 
     for (auto pore_sample_range : pore_sample_ranges) {
         auto move_start = pore_sample_range.first / read.read->model_stride;
         auto move_end = pore_sample_range.second / read.read->model_stride;
         assert(move_end >= move_start);
-        //NB move_start can get to move_sums.size(), because of the stride rounding?
-        if (move_start >= read.move_sums.size() || move_end >= read.move_sums.size() ||
-            read.move_sums[move_start] == 0) {
+        //NB move_start can get to the number of timesteps, because of the stride rounding?
+        const auto num_timesteps = read.read->moves.size();
+        if (move_start >= num_timesteps || move_end >= num_timesteps ||
+            read.cum_sum(move_start) == 0) {
             //either at very end of the signal or basecalls have not started yet
             continue;
         }
-        auto start_pos = read.move_sums[move_start] - 1;
+        auto start_pos = read.cum_sum(move_start) - 1;
         //NB. adding adapter length
-        auto end_pos = read.move_sums[move_end];
+        auto end_pos = read.cum_sum(move_end);
         assert(end_pos > start_pos);
         pore_regions.push_back({start_pos, end_pos});
     }
@@ -241,12 +340,28 @@ PosRanges DuplexSplitNode::possible_pore_regions(const DuplexSplitNode::ExtRead&
     return pore_regions;
 }
 
-bool DuplexSplitNode::check_nearby_adapter(const Read& read, PosRange r, int adapter_edist) const {
-    return find_best_adapter_match(m_settings.adapter, read.seq, adapter_edist,
-                                   //including spacer region in search
-                                   {r.first, std::min(r.second + m_settings.pore_adapter_range,
-                                                      (uint64_t)read.seq.size())})
-            .has_value();
+PosRanges DuplexSplitNode::filter_nearby_adapter(const Read& read,
+                                                 const PosRanges& ranges,
+                                                 int adapter_edist) const {
+    //all regions are searched in one batch
+    std::vector<std::string_view> search_regions;
+    search_regions.reserve(ranges.size());
+    for (auto r : ranges) {
+        //including spacer region in search
+        const auto search_end =
+                std::min(r.second + m_settings.pore_adapter_range, (uint64_t)read.seq.size());
+        assert(r.first <= search_end);
+        search_regions.push_back(std::string_view(read.seq).substr(r.first, search_end - r.first));
+    }
+    const auto distances = m_adapter_matcher.edit_distances(search_regions, adapter_edist);
+
+    PosRanges filtered;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (distances[i]) {
+            filtered.push_back(ranges[i]);
+        }
+    }
+    return filtered;
 }
 
 //r is potential spacer region
@@ -269,7 +384,7 @@ std::optional<DuplexSplitNode::PosRange> DuplexSplitNode::identify_extra_middle_
 
     spdlog::trace("Searching for adapter match");
     if (auto adapter_match = find_best_adapter_match(
-                m_settings.adapter, read.seq, m_settings.relaxed_adapter_edist,
+                m_adapter_matcher, read.seq, m_settings.relaxed_adapter_edist,
                 {r_l / 2 - search_span / 2, r_l / 2 + search_span / 2})) {
         auto adapter_start = adapter_match->first;
         spdlog::trace("Checking middle match & start/end match");
@@ -283,35 +398,37 @@ std::optional<DuplexSplitNode::PosRange> DuplexSplitNode::identify_extra_middle_
     return std::nullopt;
 }
 
-std::vector<std::shared_ptr<Read>> DuplexSplitNode::subreads(
-        std::shared_ptr<Read> read,
+std::vector<DuplexSplitNode::ExtRead> DuplexSplitNode::subreads(
+        const ExtRead& read,
         const std::vector<PosRange>& spacers) const {
     if (spacers.empty()) {
         return {read};
     }
 
-    std::vector<std::shared_ptr<Read>> subreads;
+    std::vector<ExtRead> subreads;
     subreads.reserve(spacers.size() + 1);
 
-    const auto stride = read->model_stride;
-    const auto seq_to_sig_map =
-            utils::moves_to_map(read->moves, stride, read->raw_data.size(0), read->seq.size() + 1);
+    const auto stride = read.read->model_stride;
+    const uint64_t raw_size = read.read->raw_data.size(0);
 
     //TODO maybe simplify by adding begin/end stubs?
     uint64_t start_pos = 0;
-    uint64_t signal_start = seq_to_sig_map[0];
+    uint64_t signal_start = read.seq_to_sig(0);
+    const auto add_subread = [&](uint64_t end_pos, uint64_t signal_end) {
+        subreads.push_back({subread(*read.read, {start_pos, end_pos}, {signal_start, signal_end}),
+                            read.context, read.base_offset + start_pos,
+                            read.signal_offset + signal_start});
+    };
     for (auto r : spacers) {
-        if (start_pos < r.first && signal_start / stride < seq_to_sig_map[r.first] / stride) {
-            subreads.push_back(
-                    subread(*read, {start_pos, r.first}, {signal_start, seq_to_sig_map[r.first]}));
+        if (start_pos < r.first && signal_start / stride < read.seq_to_sig(r.first) / stride) {
+            add_subread(r.first, read.seq_to_sig(r.first));
         }
         start_pos = r.second;
-        signal_start = seq_to_sig_map[r.second];
+        signal_start = read.seq_to_sig(r.second);
     }
-    assert(read->raw_data.size(0) == seq_to_sig_map[read->seq.size()]);
-    if (start_pos < read->seq.size() && signal_start / stride < read->raw_data.size(0) / stride) {
-        subreads.push_back(subread(*read, {start_pos, read->seq.size()},
-                                   {signal_start, read->raw_data.size(0)}));
+    assert(raw_size == read.seq_to_sig(read.read->seq.size()));
+    if (start_pos < read.read->seq.size() && signal_start / stride < raw_size / stride) {
+        add_subread(read.read->seq.size(), raw_size);
     }
 
     return subreads;
@@ -322,10 +439,9 @@ DuplexSplitNode::build_split_finders() const {
     std::vector<std::pair<std::string, SplitFinderF>> split_finders;
     split_finders.push_back(
             {"PORE_ADAPTER", [&](const ExtRead& read) {
-                 return filter_ranges(
-                         possible_pore_regions(read, m_settings.pore_thr), [&](PosRange r) {
-                             return check_nearby_adapter(*read.read, r, m_settings.adapter_edist);
-                         });
+                 return filter_nearby_adapter(*read.read,
+                                              possible_pore_regions(read, m_settings.pore_thr),
+                                              m_settings.adapter_edist);
              }});
 
     if (!m_settings.simplex_mode) {
@@ -343,21 +459,22 @@ DuplexSplitNode::build_split_finders() const {
         split_finders.push_back(
                 {"PORE_ALL", [&](const ExtRead& read) {
                      return merge_ranges(
-                             filter_ranges(possible_pore_regions(read, m_settings.relaxed_pore_thr),
+                             filter_ranges(filter_nearby_adapter(
+                                                   *read.read,
+                                                   possible_pore_regions(
+                                                           read, m_settings.relaxed_pore_thr),
+                                                   m_settings.relaxed_adapter_edist),
                                            [&](PosRange r) {
-                                               return check_nearby_adapter(
-                                                              *read.read, r,
-                                                              m_settings.relaxed_adapter_edist) &&
-                                                      check_flank_match(
-                                                              *read.read, r,
-                                                              m_settings.relaxed_flank_edist);
+                                               return check_flank_match(
+                                                       *read.read, r,
+                                                       m_settings.relaxed_flank_edist);
                                            }),
                              m_settings.end_flank + m_settings.start_flank);
                  }});
 
         split_finders.push_back(
                 {"ADAPTER_FLANK", [&](const ExtRead& read) {
-                     return filter_ranges(find_adapter_matches(m_settings.adapter, read.read->seq,
+                     return filter_ranges(find_adapter_matches(m_adapter_matcher, read.read->seq,
                                                                m_settings.adapter_edist,
                                                                m_settings.expect_adapter_prefix),
                                           [&](PosRange r) {
@@ -392,7 +509,9 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
         return std::vector<std::shared_ptr<Read>>{std::move(init_read)};
     }
 
-    std::vector<ExtRead> to_split{ExtRead(init_read)};
+    // Subreads share the read's move table, signal positions and pore samples.
+    const auto context = make_split_context(*init_read);
+    std::vector<ExtRead> to_split{ExtRead{init_read, &context}};
     for (const auto& [description, split_f] : m_split_finders) {
         spdlog::trace("Running {}", description);
         std::vector<ExtRead> split_round_result;
@@ -404,8 +523,8 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
             if (spacers.empty()) {
                 split_round_result.push_back(std::move(r));
             } else {
-                for (auto sr : subreads(r.read, spacers)) {
-                    split_round_result.emplace_back(sr);
+                for (auto& sr : subreads(r, spacers)) {
+                    split_round_result.push_back(std::move(sr));
                 }
             }
         }
@@ -429,28 +548,17 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
     return split_result;
 }
 
-void DuplexSplitNode::worker_thread() {
-    m_active++;  // Track active threads.
-    Message message;
-
-    while (m_work_queue.try_pop(message)) {
-        if (!m_settings.enabled) {
-            m_sink.push_message(std::move(message));
-        } else {
-            // If this message isn't a read, we'll get a bad_variant_access exception.
-            auto init_read = std::get<std::shared_ptr<Read>>(message);
-            for (auto& subread : split(init_read)) {
-                //TODO correctly process end_reason when we have them
-                m_sink.push_message(std::move(subread));
-            }
+void DuplexSplitNode::process_message(Message&& message) {
+    if (!m_settings.enabled) {
+        m_sink.push_message(std::move(message));
+    } else {
+        // If this message isn't a read, we'll get a bad_variant_access exception.
+        auto init_read = std::get<std::shared_ptr<Read>>(std::move(message));
+        for (auto& subread : split(init_read)) {
+            //TODO correctly process end_reason when we have them
+            m_sink.push_message(std::move(subread));
         }
     }
-
-    int num_active = --m_active;
-    if (num_active == 0) {
-        terminate();
-        m_sink.terminate();
-    }
 }
 
 DuplexSplitNode::DuplexSplitNode(MessageSink& sink,
@@ -460,26 +568,24 @@ DuplexSplitNode::DuplexSplitNode(MessageSink& sink,
         : MessageSink(max_reads),
           m_sink(sink),
           m_settings(std::move(settings)),
-          m_num_worker_threads(num_worker_threads) {
+          m_adapter_matcher(m_settings.adapter) {
     m_split_finders = build_split_finders();
-    for (int i = 0; i < m_num_worker_threads; i++) {
-        worker_threads.push_back(
-                std::make_unique<std::thread>(&DuplexSplitNode::worker_thread, this));
-    }
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                          num_worker_threads, [this] { m_sink.terminate(); });
 }
 
 DuplexSplitNode::~DuplexSplitNode() {
     terminate();
 
-    // Wait for all the Node's worker threads to terminate
-    for (auto& t : worker_threads) {
-        t->join();
-    }
+    // Wait for all of the Node's messages to be processed
+    join();
 
     // Notify the sink that the Node has terminated
     m_sink.terminate();
 }
 
+void DuplexSplitNode::join() { join_pool_processing(); }
+
 stats::NamedStats DuplexSplitNode::sample_stats() const { return stats::from_obj(m_work_queue); }
 
 }  // namespace dorado
@@ -1,6 +1,8 @@
 #pragma once
 #include "ReadPipeline.h"
 
+#include <utils/MoveTable.h>
+#include <utils/PatternMatcher.h>
 #include <utils/stats.h>
 
 #include <cstdint>
@@ -53,41 +55,66 @@ public:
                     int num_worker_threads = 5,
                     size_t max_reads = 1000);
     ~DuplexSplitNode();
+    void join() override;
     std::string get_name() const override { return "DuplexSplitNode"; }
     stats::NamedStats sample_stats() const override;
 
     std::vector<std::shared_ptr<Read>> split(std::shared_ptr<Read> init_read) const;
 
 private:
-    //TODO consider precomputing and reusing ranges with high signal
+    // A sample which may be pore signal, with its value as a half_order_key().
+    struct PoreSample {
+        uint64_t index;
+        int16_t key;
+    };
+
+    // What is found once for the read being split, and shared by every subread of it, each
+    // of which is a span of its bases, moves and signal.
+    struct SplitContext {
+        // The read's move table.  The read outlives the split.
+        const utils::MoveTable& move_table;
+        // The signal position of each base's first timestep, followed by the signal length.
+        std::vector<uint64_t> seq_to_sig_map;
+        // The samples past expect_pore_prefix above the lowest of the pore thresholds, in
+        // order, which each finder's threshold then picks from.
+        std::vector<PoreSample> pore_samples;
+    };
+
     struct ExtRead {
         std::shared_ptr<Read> read;
-        torch::Tensor data_as_float32;
-        std::vector<uint64_t> move_sums;
-
-        explicit ExtRead(std::shared_ptr<Read> r);
+        const SplitContext* context;
+        // Where the read starts in the read being split.
+        uint64_t base_offset{0};
+        uint64_t signal_offset{0};
+
+        // As move_table().cum_sum(i) of the read.
+        uint64_t cum_sum(size_t i) const;
+        // As move_table().to_sig_map() of the read, for base i.
+        uint64_t seq_to_sig(size_t i) const;
     };
 
     typedef std::function<PosRanges(const ExtRead&)> SplitFinderF;
 
     std::vector<PosRange> possible_pore_regions(const ExtRead& read, float pore_thr) const;
-    bool check_nearby_adapter(const Read& read, PosRange r, int adapter_edist) const;
+    // Ranges followed closely by an adapter match.
+    PosRanges filter_nearby_adapter(const Read& read,
+                                    const PosRanges& ranges,
+                                    int adapter_edist) const;
     bool check_flank_match(const Read& read, PosRange r, int dist_thr) const;
     std::optional<PosRange> identify_extra_middle_split(const Read& read) const;
 
-    std::vector<std::shared_ptr<Read>> subreads(std::shared_ptr<Read> read,
-                                                const PosRanges& spacers) const;
+    SplitContext make_split_context(const Read& read) const;
+    std::vector<ExtRead> subreads(const ExtRead& read, const PosRanges& spacers) const;
 
     std::vector<std::pair<std::string, SplitFinderF>> build_split_finders() const;
 
-    void worker_thread();  // Worker thread performs splitting asynchronously.
-    MessageSink& m_sink;   // MessageSink to consume scaled reads.
+    // Performs splitting, on the shared CPU thread pool.
+    void process_message(Message&& message);
+    MessageSink& m_sink;  // MessageSink to consume scaled reads.
 
     const DuplexSplitSettings m_settings;
+    const utils::PatternMatcher m_adapter_matcher;
     std::vector<std::pair<std::string, SplitFinderF>> m_split_finders;
-    std::atomic<size_t> m_active{0};
-    const int m_num_worker_threads;
-    std::vector<std::unique_ptr<std::thread>> worker_threads;
 };
 
 }  // namespace dorado
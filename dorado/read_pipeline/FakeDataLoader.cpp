@@ -1,25 +1,154 @@
 #include "FakeDataLoader.h"
 
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/sequence_utils.h"
+#include "utils/time_utils.h"
 
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <numeric>
+#include <thread>
+#include <utility>
 
 namespace dorado {
 
+namespace {
+
+// Calibration of the fake signal's integer samples, as for a MinION.
+constexpr float kDigitisation = 8192.f;
+constexpr float kRangePa = 1500.f;
+// When the fake run started, as a unix time.
+constexpr uint64_t kRunStartTimeMs = 1700000000000;
+// Gap between a template and its complement, well within the duplex pairing limit.
+constexpr uint32_t kComplementGapMs = 20;
+
+}  // namespace
+
+FakeDataLoader::FakeDataLoader(MessageSink& read_sink, FakeReadSettings settings)
+        : m_read_sink(read_sink),
+          m_settings(std::move(settings)),
+          m_rng(m_settings.seed),
+          m_channel_times_ms(std::max(m_settings.num_channels, 1), kRunStartTimeMs),
+          m_channel_read_numbers(std::max(m_settings.num_channels, 1), 0) {}
+
 void FakeDataLoader::load_reads(const int num_reads) {
+    std::normal_distribution<double> log_length_spread(0., 1.);
+    std::bernoulli_distribution has_complement(m_settings.duplex_fraction);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto pace = [this, start](int64_t read_index) {
+        if (m_settings.reads_per_s > 0.) {
+            std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(read_index /
+                                                                  m_settings.reads_per_s)));
+        }
+    };
+
     for (int i = 0; i < num_reads; ++i) {
-        std::shared_ptr<Read> fake_read = std::make_shared<Read>();
+        const size_t num_samples = std::max(
+                m_settings.min_read_samples,
+                size_t(double(m_settings.median_read_samples) *
+                       std::exp(m_settings.read_samples_sigma * log_length_spread(m_rng))));
+        const int channel = int(m_num_reads % m_channel_times_ms.size());
+        auto& channel_time_ms = m_channel_times_ms[channel];
+        auto read = make_read(num_samples, channel, channel_time_ms);
+        if (m_settings.basecalled) {
+            add_basecall(*read);
+        }
+        channel_time_ms = read->get_end_time_ms() + m_settings.read_gap_ms;
 
-        constexpr int64_t read_size = 40000;
-        fake_read->raw_data = torch::randint(0, 10000, {read_size}, torch::kInt16);
-        fake_read->read_id = "Placeholder-read-id";
+        std::shared_ptr<Read> complement;
+        if (has_complement(m_rng) && i + 1 < num_reads) {
+            complement = make_complement(*read, read->get_end_time_ms() + kComplementGapMs);
+            channel_time_ms = complement->get_end_time_ms() + m_settings.read_gap_ms;
+        }
 
-        m_read_sink.push_message(fake_read);
+        pace(i);
+        m_read_sink.push_message(std::move(read));
+        if (complement) {
+            pace(++i);
+            m_read_sink.push_message(std::move(complement));
+        }
+        ++m_num_reads;
     }
 }
 
-FakeDataLoader::FakeDataLoader(MessageSink& read_sink) : m_read_sink(read_sink) {}
+std::shared_ptr<Read> FakeDataLoader::make_read(size_t num_samples,
+                                                int channel,
+                                                uint64_t start_time_ms) {
+    auto read = std::make_shared<Read>();
+    read->read_id = "fake_read_" + std::to_string(m_num_reads_made++);
+    read->run_id = "fake_run";
+    read->flowcell_id = "FAKE00001";
+    read->sample_rate = m_settings.sample_rate;
+    read->digitisation = kDigitisation;
+    read->range = kRangePa;
+    read->scaling = kRangePa / kDigitisation;
+    read->offset = 0.f;
+    read->num_trimmed_samples = 0;
+    read->is_duplex = false;
+    read->start_time_ms = start_time_ms;
+    read->start_sample = start_time_ms * m_settings.sample_rate / 1000;
+    read->end_sample = read->start_sample + num_samples;
+    read->attributes.mux = 1;
+    read->attributes.channel_number = channel + 1;
+    read->attributes.read_number = m_channel_read_numbers[channel]++;
+    read->attributes.start_time = utils::get_string_timestamp_from_unix_time(start_time_ms);
+    read->attributes.num_samples = num_samples;
+
+    std::normal_distribution<float> current(m_settings.mean_current_pa / read->scaling,
+                                            m_settings.current_stdev_pa / read->scaling);
+    read->raw_data = torch::empty({int64_t(num_samples)}, torch::kInt16);
+    auto* samples = read->raw_data.data_ptr<int16_t>();
+    std::generate(samples, samples + num_samples, [this, &current] {
+        return static_cast<int16_t>(std::clamp(current(m_rng), -32768.f, 32767.f));
+    });
+    return read;
+}
+
+void FakeDataLoader::add_basecall(Read& read) {
+    std::bernoulli_distribution move(m_settings.move_probability);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::normal_distribution<float> qscore(20.f, 5.f);
+    constexpr char kBases[] = "ACGT";
+
+    read.model_stride = m_settings.model_stride;
+    read.moves.resize(read.raw_data.size(0) / m_settings.model_stride);
+    std::generate(read.moves.begin(), read.moves.end(),
+                  [this, &move] { return static_cast<uint8_t>(move(m_rng)); });
+    if (!read.moves.empty()) {
+        read.moves[0] = 1;
+    }
+    const auto num_bases = std::accumulate(read.moves.begin(), read.moves.end(), size_t(0));
+    read.seq.resize(num_bases);
+    std::generate(read.seq.begin(), read.seq.end(), [&] { return kBases[base(m_rng)]; });
+    read.qstring.resize(num_bases);
+    std::generate(read.qstring.begin(), read.qstring.end(), [&] {
+        return static_cast<char>(33 + std::clamp(int(qscore(m_rng)), 1, 50));
+    });
+    read.model_name = "fake_model";
+}
+
+std::shared_ptr<Read> FakeDataLoader::make_complement(const Read& read, uint64_t start_time_ms) {
+    const int channel = read.attributes.channel_number - 1;
+    auto complement = make_read(read.raw_data.size(0), channel, start_time_ms);
+    if (m_settings.basecalled) {
+        // The moves are reversed so that the reverse complement basecall still fits them,
+        // starting with a base.
+        complement->seq = utils::reverse_complement(read.seq);
+        complement->qstring.assign(read.qstring.rbegin(), read.qstring.rend());
+        const auto last_move = std::find(read.moves.rbegin(), read.moves.rend(), 1);
+        complement->moves.assign(last_move, read.moves.rend());
+        complement->moves.resize(read.moves.size(), 0);
+        complement->model_stride = read.model_stride;
+        complement->model_name = read.model_name;
+    }
+    return complement;
+}
 
 }  // namespace dorado
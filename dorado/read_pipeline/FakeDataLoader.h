@@ -1,17 +1,69 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
 namespace dorado {
 
 class MessageSink;
+class Read;
+
+// Shape of the reads FakeDataLoader makes.
+struct FakeReadSettings {
+    // Read lengths in samples are log-normally distributed with median median_read_samples,
+    // and read_samples_sigma the standard deviation of their log, or all the same if it is 0.
+    size_t median_read_samples{40000};
+    float read_samples_sigma{0.f};
+    size_t min_read_samples{1000};
+    // Reads loaded per second, or 0 for as fast as the sink takes them.
+    double reads_per_s{0.};
+    // Reads are spread over the channels in turn, each following the last on its channel
+    // after read_gap_ms.
+    int num_channels{512};
+    uint32_t read_gap_ms{500};
+    // Fraction of reads followed on their channel by their complement, for duplex pairing: a
+    // read of the same length, whose basecall is the reverse complement of the template's.
+    float duplex_fraction{0.f};
+    // Gaussian signal, in pA.
+    float mean_current_pa{90.f};
+    float current_stdev_pa{15.f};
+    uint64_t sample_rate{4000};
+    // Whether reads come with a random basecall, as if from a model with model_stride whose
+    // moves are each a base with move_probability, for loading nodes after the basecaller.
+    bool basecalled{false};
+    int model_stride{5};
+    float move_probability{0.4f};
+    uint32_t seed{42};
+};
 
-// Supplies a stream of reads with random signals for testing purposes.
+// Supplies a stream of reads with random signals, e.g. to test or load the pipeline without
+// data or models.
 class FakeDataLoader {
 public:
-    FakeDataLoader(MessageSink& read_sink);
+    FakeDataLoader(MessageSink& read_sink, FakeReadSettings settings = {});
     void load_reads(int num_reads);
 
 private:
+    // A read of num_samples starting at start_time_ms on the channel, without a basecall.
+    std::shared_ptr<Read> make_read(size_t num_samples, int channel, uint64_t start_time_ms);
+    // Gives the read a random basecall spanning its signal.
+    void add_basecall(Read& read);
+    // The read's complement, which follows it on its channel.
+    std::shared_ptr<Read> make_complement(const Read& read, uint64_t start_time_ms);
+
     MessageSink& m_read_sink;
+    const FakeReadSettings m_settings;
+    std::mt19937 m_rng;
+    // Per channel, when its next read may start, and the number of reads it has had.
+    std::vector<uint64_t> m_channel_times_ms;
+    std::vector<int32_t> m_channel_read_numbers;
+    // Templates loaded, which are spread over the channels, and reads made.
+    int64_t m_num_reads{0};
+    int64_t m_num_reads_made{0};
 };
 
 }  // namespace dorado
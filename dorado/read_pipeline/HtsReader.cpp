@@ -1,12 +1,17 @@
 #include "HtsReader.h"
 
+#include "cxxpool.h"
+#include "htslib/hfile.h"
 #include "htslib/sam.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/MoveTable.h"
 #include "utils/types.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <filesystem>
+#include <future>
 #include <set>
 #include <stdexcept>
 #include <string>
@@ -15,6 +20,13 @@
 
 namespace dorado {
 
+namespace {
+
+// Records read at a time, and pushed to a sink in one go.
+constexpr size_t kReadBatchSize = 256;
+
+}  // namespace
+
 HtsReader::HtsReader(const std::string& filename) {
     m_file = hts_open(filename.c_str(), "r");
     if (!m_file) {
@@ -27,16 +39,39 @@ HtsReader::HtsReader(const std::string& filename) {
     }
     is_aligned = header->n_targets > 0;
     record.reset(bam_init1());
+    std::error_code error;
+    if (std::filesystem::is_regular_file(filename, error)) {
+        m_read_ahead = std::make_unique<utils::FileReadAhead>(std::vector<std::string>{filename});
+    }
 }
 
 HtsReader::~HtsReader() {
     hts_free(format);
     sam_hdr_destroy(header);
     record.reset();
+    m_read_ahead.reset();
     hts_close(m_file);
 }
 
-bool HtsReader::read() { return sam_read1(m_file, header, record.get()) >= 0; }
+bool HtsReader::read() {
+    if (++m_num_records_read % kReadBatchSize == 0) {
+        update_read_ahead();
+    }
+    return sam_read1(m_file, header, record.get()) >= 0;
+}
+
+void HtsReader::update_read_ahead() {
+    hFILE* hfile = m_read_ahead ? hts_hfile(m_file) : nullptr;
+    if (hfile) {
+        m_read_ahead->set_read_position(0, uint64_t(htell(hfile)));
+    }
+}
+
+void HtsReader::set_decompression_threads(int threads) {
+    if (threads > 1 && hts_set_threads(m_file, threads) < 0) {
+        throw std::runtime_error("Could not enable multi threading for HTS decompression.");
+    }
+}
 
 bool HtsReader::has_tag(std::string tagname) {
     uint8_t* tag = bam_aux_get(record.get(), tagname.c_str());
@@ -44,55 +79,165 @@ bool HtsReader::has_tag(std::string tagname) {
 }
 
 void HtsReader::read(MessageSink& read_sink, int max_reads) {
+    std::vector<Message> batch;
+    batch.reserve(kReadBatchSize);
     int num_reads = 0;
-    while (this->read()) {
-        read_sink.push_message(BamPtr(bam_dup1(record.get())));
-        if (++num_reads >= max_reads) {
+    while (max_reads < 0 || num_reads < max_reads) {
+        BamPtr next_record(bam_init1());
+        if (sam_read1(m_file, header, next_record.get()) < 0) {
             break;
         }
-        if (num_reads % 50000 == 0) {
+        batch.emplace_back(std::move(next_record));
+        if (batch.size() == kReadBatchSize) {
+            update_read_ahead();
+            read_sink.push_messages(std::move(batch));
+            batch.clear();
+            batch.reserve(kReadBatchSize);
+        }
+        if (++num_reads % 50000 == 0) {
             spdlog::debug("Processed {} reads", num_reads);
         }
     }
+    if (!batch.empty()) {
+        read_sink.push_messages(std::move(batch));
+    }
     spdlog::debug("Total reads processed: {}", num_reads);
     read_sink.terminate();
 }
 
-read_map read_bam(const std::string& filename, const std::unordered_set<std::string>& read_ids) {
-    HtsReader reader(filename);
+namespace {
 
-    read_map reads;
+std::shared_ptr<Read> record_to_read(bam1_t* record) {
+    const uint8_t* qstring = bam_get_qual(record);
+    const uint8_t* sequence = bam_get_seq(record);
+    const int seqlen = record->core.l_qseq;
 
-    while (reader.read()) {
-        std::string read_id = bam_get_qname(reader.record);
+    auto read = std::make_shared<Read>();
+    read->read_id = bam_get_qname(record);
+    read->seq.resize(seqlen);
+    read->qstring.resize(seqlen);
+    for (int i = 0; i < seqlen; i++) {
+        read->qstring[i] = static_cast<char>(qstring[i] + 33);
+        read->seq[i] = seq_nt16_str[bam_seqi(sequence, i)];
+    }
+    return read;
+}
 
-        if (read_ids.find(read_id) == read_ids.end()) {
-            continue;
+// As record_to_read, also taking the move table and trimmed samples from the mv, or packed mp,
+// and ts tags.
+std::shared_ptr<Read> record_to_simplex_read(bam1_t* record) {
+    auto read = record_to_read(record);
+    if (const uint8_t* packed_moves = bam_aux_get(record, "mp")) {
+        // The stride and the unused bits of the last byte come before the moves.
+        const uint32_t num_entries = bam_auxB_len(packed_moves);
+        const auto unused_bits = num_entries >= 2 ? bam_auxB2i(packed_moves, 1) : -1;
+        if (unused_bits < 0 || unused_bits > 7 || (num_entries == 2 && unused_bits > 0)) {
+            throw std::runtime_error("Read " + read->read_id + " has a malformed mp tag");
+        }
+        read->model_stride = static_cast<int>(bam_auxB2i(packed_moves, 0));
+        std::vector<uint8_t> packed(num_entries - 2);
+        for (uint32_t i = 2; i < num_entries; ++i) {
+            packed[i - 2] = static_cast<uint8_t>(bam_auxB2i(packed_moves, i));
+        }
+        read->moves = utils::unpack_move_bits(packed, packed.size() * 8 - size_t(unused_bits));
+    } else {
+        const uint8_t* moves = bam_aux_get(record, "mv");
+        if (!moves || bam_auxB_len(moves) == 0) {
+            throw std::runtime_error("Read " + read->read_id +
+                                     " has no move table, so wasn't basecalled with --emit-moves");
         }
+        // The table starts with the stride of the model.
+        const uint32_t num_entries = bam_auxB_len(moves);
+        read->model_stride = static_cast<int>(bam_auxB2i(moves, 0));
+        read->moves.resize(num_entries - 1);
+        for (uint32_t i = 1; i < num_entries; ++i) {
+            read->moves[i - 1] = static_cast<uint8_t>(bam_auxB2i(moves, i));
+        }
+    }
+    const uint8_t* trimmed_samples = bam_aux_get(record, "ts");
+    read->num_trimmed_samples = trimmed_samples ? bam_aux2i(trimmed_samples) : 0;
+    return read;
+}
 
-        uint8_t* qstring = bam_get_qual(reader.record);
-        uint8_t* sequence = bam_get_seq(reader.record);
+// Converts the records of the file for which wanted(record) is true with convert, on threads.
+template <typename Wanted, typename Convert>
+read_map read_records(const std::string& filename,
+                      const Wanted& wanted,
+                      const Convert& convert,
+                      int threads) {
+    HtsReader reader(filename);
+    reader.set_decompression_threads(threads);
 
-        uint32_t seqlen = reader.record->core.l_qseq;
-        std::vector<uint8_t> qualities(seqlen);
-        std::vector<char> nucleotides(seqlen);
+    // Batches of records are decoded into the same records each time, and the wanted ones
+    // converted to reads on the pool.
+    cxxpool::thread_pool pool{static_cast<size_t>(std::max(threads, 1))};
+    std::vector<BamPtr> batch(kReadBatchSize);
+    for (auto& batch_record : batch) {
+        batch_record.reset(bam_init1());
+    }
+    std::vector<std::shared_ptr<Read>> converted(kReadBatchSize);
+    std::vector<std::future<void>> futures;
 
-        // Todo - there is a better way to do this.
-        for (int i = 0; i < seqlen; i++) {
-            qualities[i] = qstring[i] + 33;
-            nucleotides[i] = seq_nt16_str[bam_seqi(sequence, i)];
+    read_map reads;
+    bool more_records = true;
+    while (more_records) {
+        size_t num_records = 0;
+        while (num_records < batch.size() && (more_records = reader.read())) {
+            if (wanted(reader.record.get())) {
+                std::swap(reader.record, batch[num_records++]);
+            }
         }
 
-        auto tmp_read = std::make_shared<Read>();
-        tmp_read->read_id = read_id;
-        tmp_read->seq = std::string(nucleotides.begin(), nucleotides.end());
-        tmp_read->qstring = std::string(qualities.begin(), qualities.end());
-        reads[read_id] = tmp_read;
+        const size_t kRecordsPerTask = 64;
+        for (size_t begin = 0; begin < num_records; begin += kRecordsPerTask) {
+            const size_t end = std::min(begin + kRecordsPerTask, num_records);
+            futures.push_back(pool.push([&, begin, end] {
+                for (size_t i = begin; i < end; ++i) {
+                    converted[i] = convert(batch[i].get());
+                }
+            }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+        futures.clear();
+        for (size_t i = 0; i < num_records; ++i) {
+            auto read_id = converted[i]->read_id;
+            reads[std::move(read_id)] = std::move(converted[i]);
+        }
     }
 
     return reads;
 }
 
+}  // namespace
+
+read_map read_bam(const std::string& filename,
+                  const std::unordered_set<std::string>& read_ids,
+                  int threads) {
+    return read_records(
+            filename,
+            [&read_ids](const bam1_t* record) {
+                return read_ids.find(bam_get_qname(record)) != read_ids.end();
+            },
+            record_to_read, threads);
+}
+
+read_map read_simplex_bam(const std::string& filename,
+                          const std::optional<std::unordered_set<std::string>>& read_ids,
+                          int threads) {
+    return read_records(
+            filename,
+            [&read_ids](const bam1_t* record) {
+                // Secondary and supplementary alignments repeat their primary's read.
+                if (record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
+                    return false;
+                }
+                return !read_ids || read_ids->find(bam_get_qname(record)) != read_ids->end();
+            },
+            record_to_simplex_read, threads);
+}
+
 std::unordered_set<std::string> fetch_read_ids(const std::string& filename) {
     if (filename.empty()) {
         return {};
@@ -1,10 +1,12 @@
 #pragma once
 #include "htslib/sam.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/FileReadAhead.h"
 #include "utils/stats.h"
 #include "utils/types.h"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -18,10 +20,15 @@ public:
     HtsReader(const std::string& filename);
     ~HtsReader();
     bool read();
+    // Pushes the records to the sink, in batches, then terminates it.  Each record is decoded
+    // straight into one of its own, rather than copied out of record.  A negative max_reads
+    // reads them all.
     void read(MessageSink& read_sink, int max_reads = -1);
     template <typename T>
     T get_tag(std::string tagname);
     bool has_tag(std::string tagname);
+    // Decompresses BGZF blocks on a pool of this many threads, ahead of read().
+    void set_decompression_threads(int threads);
 
     char* format{nullptr};
     bool is_aligned{false};
@@ -29,7 +36,13 @@ public:
     sam_hdr_t* header{nullptr};
 
 private:
+    // Tells the read-ahead, if any, how far through the file reading has got.
+    void update_read_ahead();
+
     htsFile* m_file{nullptr};
+    // Reads the file ahead of htslib, which reads it as it decodes it.
+    std::unique_ptr<utils::FileReadAhead> m_read_ahead;
+    size_t m_num_records_read{0};
 };
 
 template <typename T>
@@ -59,14 +72,31 @@ T HtsReader::get_tag(std::string tagname) {
  * corresponding Read objects. The Read objects contain the read ID, sequence,
  * and quality string.
  *
+ * Records are decompressed, and converted to Read objects, on the given number of threads.
+ *
  * @param filename The input BAM file path as a string.
  * @param read_ids A set of read_ids to filter on.
+ * @param threads Number of threads to decode with.
  * @return A map with read IDs as keys and shared pointers to Read objects as values.
  *
  * @note The caller is responsible for managing the memory of the returned map.
  * @note The input BAM file must be properly formatted and readable.
  */
-read_map read_bam(const std::string& filename, const std::unordered_set<std::string>& read_ids);
+read_map read_bam(const std::string& filename,
+                  const std::unordered_set<std::string>& read_ids,
+                  int threads = 1);
+
+/**
+ * @brief Reads the simplex basecalls of a `dorado basecaller --emit-moves` run, for stereo
+ * calling them without basecalling them again.
+ *
+ * As read_bam, but each Read also has the moves, model stride and trimmed samples of its record,
+ * from the mv, or bit packed mp, and ts tags.  Only primary records are read, and all of them if read_ids isn't
+ * given.  Throws if a record has no move table.
+ */
+read_map read_simplex_bam(const std::string& filename,
+                          const std::optional<std::unordered_set<std::string>>& read_ids,
+                          int threads = 1);
 
 /**
  * @brief Reads an HTS file format (SAM/BAM/FASTX/etc) and returns a set of read ids.
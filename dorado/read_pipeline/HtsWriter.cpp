@@ -1,46 +1,175 @@
 #include "HtsWriter.h"
 
 #include "htslib/bgzf.h"
+#include "htslib/hfile.h"
 #include "htslib/kroundup.h"
 #include "htslib/sam.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/ObjectStore.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_qos.h"
+#include "utils/trace.h"
 
 #include <indicators/progress_bar.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
 #include <stdexcept>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 namespace dorado {
 
-HtsWriter::HtsWriter(const std::string& filename, OutputMode mode, size_t threads, size_t num_reads)
-        : MessageSink(10000), m_num_reads_expected(num_reads) {
+namespace {
+
+// Reads written between flushes of the output when recording progress, trading off the work
+// lost when a run is interrupted against the cost of flushing.
+constexpr size_t kProgressFlushInterval = 10000;
+
+// CRAM slices are bounded by bases rather than htslib's default of 10000 records, since reads
+// are long.  This keeps the slice each encoding thread holds in the tens of MB, while still
+// giving the codecs plenty of each data series to work with.
+constexpr int kCramBasesPerSlice = 20'000'000;
+
+// BAI indexes can't hold positions beyond 2^29, so longer references need a CSI index.
+bool needs_csi_index(const sam_hdr_t* header) {
+    constexpr hts_pos_t kMaxBaiLength = hts_pos_t(1) << 29;
+    for (int tid = 0; tid < sam_hdr_nref(header); ++tid) {
+        if (sam_hdr_tid2len(header, tid) > kMaxBaiLength) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+HtsWriter::HtsWriter(const std::string& filename,
+                     OutputMode mode,
+                     size_t threads,
+                     size_t num_reads,
+                     const std::string& progress_file,
+                     std::string node_name,
+                     size_t sort_memory_bytes,
+                     utils::ProgressJournal* progress_journal,
+                     int compression_level,
+                     const std::string& reference)
+        : MessageSink(10000),
+          m_node_name(std::move(node_name)),
+          m_filename(filename),
+          m_mode(mode),
+          m_num_reads_expected(num_reads),
+          m_progress_journal(progress_journal),
+          m_sort_memory_bytes(sort_memory_bytes) {
+    if (m_sort_memory_bytes > 0) {
+        if (is_fastq(mode) || mode == UBAM_STREAM) {
+            throw std::runtime_error("Only SAM, BAM and CRAM output can be sorted.");
+        }
+        // Sorted records are only written once they have all arrived.
+        if (!progress_file.empty() || progress_journal) {
+            throw std::runtime_error("Progress can't be recorded when sorting output.");
+        }
+    }
+    if (compression_level != -1 && (compression_level < 1 || compression_level > 9)) {
+        throw std::runtime_error("Compression level must be between 1 and 9, not " +
+                                 std::to_string(compression_level));
+    }
+    std::string open_mode;
     switch (mode) {
     case FASTQ:
-        m_file = hts_open(filename.c_str(), "wf");
+        open_mode = "wf";
+        break;
+    case FASTQ_GZ:
+        open_mode = "wfz";
         break;
     case BAM:
-        m_file = hts_open(filename.c_str(), "wb");
+        open_mode = "wb";
         break;
     case SAM:
-        m_file = hts_open(filename.c_str(), "w");
+        open_mode = "w";
         break;
     case UBAM:
-        m_file = hts_open(filename.c_str(), "wb0");
+        open_mode = "wb0";
+        break;
+    case UBAM_STREAM:
+        break;
+    case CRAM:
+        if (reference.empty()) {
+            throw std::runtime_error("CRAM output needs a reference.");
+        }
+        open_mode = "wc";
         break;
     default:
         throw std::runtime_error("Unknown output mode selected: " + std::to_string(mode));
     }
-    if (!m_file) {
+    // htslib takes the level as a digit of the mode.
+    if ((mode == BAM || mode == FASTQ_GZ || mode == CRAM) && compression_level != -1) {
+        open_mode += char('0' + compression_level);
+    }
+    if (utils::is_object_store_url(filename)) {
+        if (mode == UBAM_STREAM) {
+            throw std::runtime_error("Streamed BAM output can't be uploaded to " + filename);
+        }
+        // There is no local file to sync for the journal.
+        if (progress_journal) {
+            throw std::runtime_error("Progress can't be journalled when uploading output.");
+        }
+        // htslib writes to a pipe, which the uploader cuts into parts as it is written.
+        m_upload = std::make_unique<utils::ObjectUploader>(filename);
+        if (hFILE* hfile = hdopen(m_upload->open_pipe(), "w")) {
+            m_file = hts_hopen(hfile, filename.c_str(), open_mode.c_str());
+            if (!m_file) {
+                hclose_abruptly(hfile);
+            }
+        }
+    } else if (mode == UBAM_STREAM) {
+        m_stream = std::make_unique<utils::BamStreamWriter>(filename);
+    } else {
+        m_file = hts_open(filename.c_str(), open_mode.c_str());
+    }
+    if (!m_file && !m_stream) {
         throw std::runtime_error("Could not open file: " + filename);
     }
-    if (m_file->format.compression == bgzf) {
+    if (m_file && mode == CRAM) {
+        if (hts_set_fai_filename(m_file, reference.c_str()) < 0) {
+            throw std::runtime_error("Could not load CRAM reference: " + reference);
+        }
+        if (hts_set_opt(m_file, CRAM_OPT_BASES_PER_SLICE, kCramBasesPerSlice) < 0) {
+            throw std::runtime_error("Could not set CRAM slice size.");
+        }
+        // As with SAM, containers queued on the pool aren't written by a flush, so they are
+        // only encoded on threads when progress isn't recorded.
+        if (threads > 1 && progress_file.empty() && !progress_journal &&
+            hts_set_threads(m_file, threads) < 0) {
+            throw std::runtime_error("Could not enable multi threading for CRAM generation.");
+        }
+    } else if (m_file && m_file->format.compression == bgzf) {
+        spdlog::debug("> {} compresses with {}", m_node_name,
+                      (hts_features() & HTS_FEATURE_LIBDEFLATE) ? "libdeflate" : "zlib");
         auto res = bgzf_mt(m_file->fp.bgzf, threads, 128);
         if (res < 0) {
             throw std::runtime_error("Could not enable multi threading for BAM generation.");
         }
+    } else if (m_file && m_file->format.format == sam && threads > 1 && progress_file.empty() &&
+               !progress_journal) {
+        // Text formatting, not compression, dominates SAM output, especially with move tables
+        // and modbase tags.  With threads htslib formats records on its pool and writes them
+        // out in order.  Records queued on the pool aren't written by a flush, so this isn't
+        // used when recording progress.
+        auto res = hts_set_threads(m_file, threads);
+        if (res < 0) {
+            throw std::runtime_error("Could not enable multi threading for SAM generation.");
+        }
+    }
+
+    if (!progress_file.empty()) {
+        m_progress_file = std::make_unique<utils::ProgressFileWriter>(progress_file);
     }
 
     m_worker = std::make_unique<std::thread>(std::thread(&HtsWriter::worker_thread, this));
@@ -49,11 +178,20 @@ HtsWriter::HtsWriter(const std::string& filename, OutputMode mode, size_t thread
 HtsWriter::~HtsWriter() {
     // Adding for thread safety in case worker thread throws exception.
     terminate();
-    if (m_worker->joinable()) {
-        join();
-    }
+    join();
     sam_hdr_destroy(header);
-    hts_close(m_file);
+    m_stream.reset();
+    if (m_file) {
+        hts_close(m_file);
+    }
+    if (m_upload) {
+        // The pipe is closed, so this only waits for the last parts.
+        try {
+            m_upload->finish();
+        } catch (const std::exception& e) {
+            spdlog::error("{}", e.what());
+        }
+    }
 }
 
 HtsWriter::OutputMode HtsWriter::get_output_mode(std::string mode) {
@@ -63,36 +201,139 @@ HtsWriter::OutputMode HtsWriter::get_output_mode(std::string mode) {
         return BAM;
     } else if (mode == "fastq") {
         return FASTQ;
+    } else if (mode == "fastq.gz") {
+        return FASTQ_GZ;
+    } else if (mode == "cram") {
+        return CRAM;
     }
     throw std::runtime_error("Unknown output mode: " + mode);
 }
 
-void HtsWriter::join() { m_worker->join(); }
+void HtsWriter::join() {
+    if (m_worker->joinable()) {
+        m_worker->join();
+    }
+}
 
 void HtsWriter::worker_thread() {
+    utils::set_thread_qos(utils::ThreadQoS::Utility);
     size_t write_count = 0;
 
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        auto aln = std::get<BamPtr>(std::move(message));
-        write(aln.get());
-        std::string read_id = bam_get_qname(aln.get());
-        aln.reset();  // Free the bam alignment that's already written
+    // Pull whatever records are queued in one go, so the writer only synchronises with
+    // upstream nodes once per batch.
+    constexpr size_t kMaxBatchSize = 1000;
+    std::vector<Message> messages;
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        for (auto& message : messages) {
+            auto aln = std::get<BamPtr>(std::move(message));
+            std::string read_id = bam_get_qname(aln.get());
+            if (m_sorter) {
+                count_record(aln.get());
+                m_sorter->add(std::move(aln));
+            } else {
+                write(aln.get());
+            }
+            if (m_progress_file && !(aln->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY))) {
+                if (auto parsed_id = utils::parse_read_id(bam_get_qname(aln.get()))) {
+                    m_unflushed_read_ids.push_back(*parsed_id);
+                }
+            }
+            if (m_progress_journal) {
+                // Records arrive in load order, so every read before this one is written.
+                m_journal_end_order = std::max(m_journal_end_order, uint64_t(aln->id));
+                ++m_records_since_checkpoint;
+            }
+            aln.reset();  // Free the bam alignment that's already written
 
-        // For the purpose of estimating write count, we ignore duplex reads
-        // these can be identified by a semicolon in their ID.
-        // TODO: This is a hack, we should have a better way of identifying duplex reads.
-        bool ignore_read_id = read_id.find(';') != std::string::npos;
+            // For the purpose of estimating write count, we ignore duplex reads
+            // these can be identified by a semicolon in their ID.
+            // TODO: This is a hack, we should have a better way of identifying duplex reads.
+            bool ignore_read_id = read_id.find(';') != std::string::npos;
 
-        if (!ignore_read_id) {
-            m_processed_read_ids.insert(std::move(read_id));
+            if (!ignore_read_id && m_processed_read_ids.insert(std::move(read_id)).second) {
+                ++m_num_unique_simplex_reads_written;
+            }
         }
+        if (m_unflushed_read_ids.size() >= kProgressFlushInterval ||
+            m_records_since_checkpoint >= kProgressFlushInterval) {
+            flush_progress(m_journal_end_order);
+        }
+    }
+    if (m_progress_file || m_progress_journal) {
+        // Every read has been written.
+        flush_progress(std::numeric_limits<uint64_t>::max());
+    }
+    if (m_sorter) {
+        write_sorted();
     }
     spdlog::debug("Written {} records.", write_count);
 }
 
+void HtsWriter::write_sorted() {
+    DORADO_TRACE_FUNCTION();
+    // The index is built from the offsets of the records as they are written, rather than by
+    // reading the file back afterwards.
+    const bool index = m_filename != "-" && (m_mode == BAM || m_mode == UBAM || m_mode == CRAM);
+    const int min_shift = m_mode != CRAM && needs_csi_index(header) ? 14 : 0;
+    const std::string index_extension = m_mode == CRAM ? ".crai" : min_shift > 0 ? ".csi" : ".bai";
+    // An uploaded output's index is built locally, and uploaded after it.
+    std::string index_path = m_filename + index_extension;
+    if (m_upload) {
+        index_path = (std::filesystem::temp_directory_path() /
+                      ("dorado_index." + std::to_string(std::random_device{}()) + index_extension))
+                             .string();
+    }
+    if (index) {
+        if (sam_idx_init(m_file, header, min_shift, index_path.c_str()) < 0) {
+            throw std::runtime_error("Failed to start index " + index_path);
+        }
+    }
+
+    spdlog::debug("Merging {} sorted runs", m_sorter->num_runs());
+    m_sorter->merge([this](bam1_t* record) { write_to_output(record); });
+    m_sorter.reset();
+
+    if (index && sam_idx_save(m_file) < 0) {
+        throw std::runtime_error("Failed to write the index of " + m_filename);
+    }
+    if (index && m_upload) {
+        std::string data;
+        {
+            std::ifstream file(index_path, std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        std::filesystem::remove(index_path);
+        utils::ObjectUploader index_upload(m_filename + index_extension);
+        index_upload.write(data.data(), data.size());
+        index_upload.finish();
+    }
+}
+
+void HtsWriter::flush_progress(uint64_t journal_end_order) {
+    // A BGZF flush finishes the block being written, so the output ends with a whole block.
+    if (m_stream) {
+        m_stream->flush();
+    } else if (hts_flush(m_file) < 0) {
+        throw std::runtime_error("Failed to flush output");
+    }
+    if (m_progress_file) {
+        m_progress_file->append(m_unflushed_read_ids);
+        m_unflushed_read_ids.clear();
+    }
+    if (m_progress_journal) {
+        m_progress_journal->checkpoint(journal_end_order, utils::sync_output_file(m_filename));
+        m_records_since_checkpoint = 0;
+    }
+}
+
 int HtsWriter::write(bam1_t* record) {
-    // track stats
+    DORADO_TRACE_SCOPE("write");
+    count_record(record);
+    write_to_output(record);
+    return 0;
+}
+
+void HtsWriter::count_record(const bam1_t* record) {
     total++;
     if (record->core.flag & BAM_FUNMAP) {
         unmapped++;
@@ -104,17 +345,45 @@ int HtsWriter::write(bam1_t* record) {
         supplementary++;
     }
     primary = total - secondary - supplementary - unmapped;
+}
 
+void HtsWriter::write_to_output(bam1_t* record) {
+    if (m_stream) {
+        m_stream->write(record);
+        return;
+    }
     auto res = sam_write1(m_file, header, record);
     if (res < 0) {
         throw std::runtime_error("Failed to write SAM record, error code " + std::to_string(res));
     }
-    return res;
 }
 
 int HtsWriter::write_header(const sam_hdr_t* hdr) {
     if (hdr) {
         header = sam_hdr_dup(hdr);
+        if (m_sort_memory_bytes > 0) {
+            const int res = sam_hdr_count_lines(header, "HD") > 0
+                                    ? sam_hdr_update_hd(header, "SO", "coordinate")
+                                    : sam_hdr_add_line(header, "HD", "VN", SAM_FORMAT_VERSION,
+                                                       "SO", "coordinate", NULL);
+            if (res < 0) {
+                throw std::runtime_error("Failed to mark the header as sorted");
+            }
+            // Runs are spilled next to the output, or to the temporary directory for stdout
+            // and uploads.
+            const auto temp_prefix =
+                    m_filename == "-" || m_upload
+                            ? (std::filesystem::temp_directory_path() /
+                               ("dorado_sort." + std::to_string(std::random_device{}())))
+                                      .string()
+                            : m_filename + ".sort";
+            m_sorter = std::make_unique<utils::BamSorter>(header, temp_prefix,
+                                                          m_sort_memory_bytes);
+        }
+        if (m_stream) {
+            m_stream->write_header(header);
+            return 0;
+        }
         return sam_hdr_write(m_file, header);
     }
     return 0;
@@ -122,8 +391,12 @@ int HtsWriter::write_header(const sam_hdr_t* hdr) {
 
 stats::NamedStats HtsWriter::sample_stats() const {
     auto stats = stats::from_obj(m_work_queue);
-    stats["unique_simplex_reads_written"] = m_processed_read_ids.size();
+    stats["unique_simplex_reads_written"] = m_num_unique_simplex_reads_written;
     return stats;
 }
 
+void HtsWriter::register_counters(stats::CounterRegistry& registry) const {
+    registry.add(get_name() + ".unique_simplex_reads_written", m_num_unique_simplex_reads_written);
+}
+
 }  // namespace dorado
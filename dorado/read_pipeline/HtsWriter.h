@@ -1,6 +1,10 @@
 #pragma once
 #include "htslib/sam.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/BamSorter.h"
+#include "utils/BamStreamWriter.h"
+#include "utils/ObjectStore.h"
+#include "utils/resume_utils.h"
 #include "utils/stats.h"
 
 #ifdef WIN32
@@ -9,6 +13,8 @@
 #include <indicators/block_progress_bar.hpp>
 #endif
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -21,17 +27,52 @@ public:
         BAM,
         SAM,
         FASTQ,
+        // FASTQ compressed with BGZF, which gzip can read, on the same worker threads as BAM.
+        FASTQ_GZ,
+        // Uncompressed BAM, serialised by utils::BamStreamWriter rather than by htslib.
+        UBAM_STREAM,
+        // CRAM, whose sequences are encoded against the reference the records are aligned to.
+        CRAM,
     };
 
-    HtsWriter(const std::string& filename, OutputMode mode, size_t threads, size_t num_reads);
+    // If |progress_file| is given, the IDs of the reads written are appended to it, as
+    // described in utils/resume_utils.h.  IDs are only recorded once their records have been
+    // flushed to the output.
+    // Writers of the shards of an output are given their own names, starting "HtsWriter", so
+    // their stats are kept apart.
+    // If |sort_memory_bytes| is non-zero, SAM, BAM and CRAM output is sorted by coordinate,
+    // with up to that much held in memory and the rest spilled to sorted runs next to the
+    // output, which are merged once every record has arrived.  A sorted BAM file is indexed as
+    // it is written, with a BAI index, or a CSI index if any reference is too long for BAI, and
+    // a sorted CRAM file with a CRAI index.
+    // If |progress_journal| is given, the output is synced to disk and checkpointed in it
+    // periodically.  Records must then arrive in the order of their reads' tickets.
+    // An s3:// or gs:// |filename| is uploaded as it is written, as described in
+    // utils/ObjectStore.h, and completed once the writer is destroyed.
+    // |compression_level| is the BGZF level, from 1 (fastest) to 9, of BAM and FASTQ_GZ output,
+    // or -1 for htslib's default.  htslib compresses with libdeflate if it was built with it.
+    // CRAM output needs the FASTA |reference| the records are aligned to, which is indexed
+    // alongside it if it isn't already.
+    HtsWriter(const std::string& filename,
+              OutputMode mode,
+              size_t threads,
+              size_t num_reads,
+              const std::string& progress_file = "",
+              std::string node_name = "HtsWriter",
+              size_t sort_memory_bytes = 0,
+              utils::ProgressJournal* progress_journal = nullptr,
+              int compression_level = -1,
+              const std::string& reference = "");
     ~HtsWriter();
-    std::string get_name() const override { return "HtsWriter"; }
+    std::string get_name() const override { return m_node_name; }
     stats::NamedStats sample_stats() const override;
+    void register_counters(stats::CounterRegistry& registry) const override;
     int write_header(const sam_hdr_t* header);
     int write(bam1_t* record);
-    void join();
+    void join() override;
 
     static OutputMode get_output_mode(std::string mode);
+    static bool is_fastq(OutputMode mode) { return mode == FASTQ || mode == FASTQ_GZ; }
 
     size_t total{0};
     size_t primary{0};
@@ -41,12 +82,41 @@ public:
     sam_hdr_t* header{nullptr};
 
 private:
+    std::string m_node_name;
+    std::string m_filename;
+    OutputMode m_mode;
     htsFile* m_file{nullptr};
+    std::unique_ptr<utils::BamStreamWriter> m_stream;
+    // Set when the output is uploaded to an object store.
+    std::unique_ptr<utils::ObjectUploader> m_upload;
     std::unique_ptr<std::thread> m_worker;
     void worker_thread();
     int write_hdr_sq(char* name, uint32_t length);
+    // Counts the record in the stats.
+    void count_record(const bam1_t* record);
+    void write_to_output(bam1_t* record);
+    // Writes the sorted records once they have all arrived, indexing them as they are written.
+    void write_sorted();
+    // Flushes the output, then records the reads written since the last flush, and
+    // checkpoints the journal with the reads before journal_end_order written.
+    void flush_progress(uint64_t journal_end_order);
     size_t m_num_reads_expected;
     std::unordered_set<std::string> m_processed_read_ids;
+    // The size of m_processed_read_ids, for the stats.
+    std::atomic<int64_t> m_num_unique_simplex_reads_written{0};
+
+    std::unique_ptr<utils::ProgressFileWriter> m_progress_file;
+    // Reads written but not yet known to have been flushed.
+    std::vector<ReadID> m_unflushed_read_ids;
+
+    utils::ProgressJournal* m_progress_journal;
+    // The order of the latest read written, all of whose predecessors have been written too.
+    uint64_t m_journal_end_order{0};
+    size_t m_records_since_checkpoint{0};
+
+    size_t m_sort_memory_bytes;
+    // Created along with the header, when sorting.
+    std::unique_ptr<utils::BamSorter> m_sorter;
 };
 
 }  // namespace dorado
@@ -0,0 +1,88 @@
+#include "MessageRouterNode.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+namespace dorado {
+
+MessageRouterNode::MessageRouterNode(std::vector<std::reference_wrapper<MessageSink>> sinks,
+                                     RouteFn route,
+                                     std::string node_name)
+        // Messages are never queued on the router itself.
+        : MessageSink(1),
+          m_sinks(std::move(sinks)),
+          m_route(std::move(route)),
+          m_node_name(std::move(node_name)),
+          m_num_routed(std::make_unique<std::atomic<int64_t>[]>(m_sinks.size())) {
+    if (m_sinks.empty()) {
+        throw std::runtime_error("MessageRouterNode requires at least one sink");
+    }
+}
+
+void MessageRouterNode::push_message(Message&& message) {
+    const size_t sink_idx = m_route(message);
+    assert(sink_idx < m_sinks.size());
+    ++m_num_routed[sink_idx];
+    m_sinks[sink_idx].get().push_message(std::move(message));
+}
+
+void MessageRouterNode::push_messages(std::vector<Message>&& messages) {
+    // Keep batches together per destination so sinks still see batched pushes.
+    std::vector<std::vector<Message>> routed(m_sinks.size());
+    for (auto& message : messages) {
+        const size_t sink_idx = m_route(message);
+        assert(sink_idx < m_sinks.size());
+        routed[sink_idx].push_back(std::move(message));
+    }
+    for (size_t i = 0; i < m_sinks.size(); ++i) {
+        if (!routed[i].empty()) {
+            m_num_routed[i] += routed[i].size();
+            m_sinks[i].get().push_messages(std::move(routed[i]));
+        }
+    }
+}
+
+void MessageRouterNode::terminate() {
+    MessageSink::terminate();
+    if (!m_terminated.exchange(true)) {
+        for (auto& sink : m_sinks) {
+            sink.get().terminate();
+        }
+    }
+}
+
+stats::NamedStats MessageRouterNode::sample_stats() const {
+    stats::NamedStats stats;
+    for (size_t i = 0; i < m_sinks.size(); ++i) {
+        stats["messages_routed_" + std::to_string(i)] = m_num_routed[i].load();
+    }
+    return stats;
+}
+
+size_t MessageRouterNode::route_uncalled_reads(const Message& message) {
+    if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        const auto& read = std::get<std::shared_ptr<Read>>(message);
+        return read->seq.empty() ? 0 : 1;
+    }
+    return 1;
+}
+
+MessageRouterNode::RouteFn MessageRouterNode::route_by_sample_rate(
+        std::vector<uint16_t> sample_rates) {
+    return [sample_rates = std::move(sample_rates)](const Message& message) -> size_t {
+        if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+            return 0;
+        }
+        const auto sample_rate = int64_t(std::get<std::shared_ptr<Read>>(message)->sample_rate);
+        auto distance = [sample_rate](uint16_t rate) { return std::abs(sample_rate - rate); };
+        auto closest = std::min_element(
+                sample_rates.begin(), sample_rates.end(),
+                [&distance](uint16_t a, uint16_t b) { return distance(a) < distance(b); });
+        return closest == sample_rates.end() ? 0 : size_t(closest - sample_rates.begin());
+    };
+}
+
+}  // namespace dorado
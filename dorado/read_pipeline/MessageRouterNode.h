@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+/// Sends each message to one of several sinks, according to a routing function.
+/// Routing happens inline on the pushing thread, so a router adds no queue hop or
+/// worker threads to the pipeline -- it simply lets a producer feed different
+/// consumers depending on the message.
+class MessageRouterNode : public MessageSink {
+public:
+    // Returns the index into the router's sinks that the message should be sent to.
+    using RouteFn = std::function<size_t(const Message&)>;
+
+    MessageRouterNode(std::vector<std::reference_wrapper<MessageSink>> sinks,
+                      RouteFn route,
+                      std::string node_name = "MessageRouterNode");
+
+    void push_message(Message&& message) override;
+    void push_messages(std::vector<Message>&& messages) override;
+    // Passes termination on to every sink, once.
+    void terminate() override;
+
+    std::string get_name() const override { return m_node_name; }
+    stats::NamedStats sample_stats() const override;
+
+    // Routes Reads which have yet to be basecalled to sink 0, and everything else to sink 1.
+    static size_t route_uncalled_reads(const Message& message);
+    // Routes each Read to the sink whose sample rate, from sample_rates, is closest to the
+    // read's own, and everything else to sink 0.
+    static RouteFn route_by_sample_rate(std::vector<uint16_t> sample_rates);
+
+private:
+    std::vector<std::reference_wrapper<MessageSink>> m_sinks;
+    RouteFn m_route;
+    std::string m_node_name;
+    std::atomic<bool> m_terminated{false};
+
+    // Performance monitoring stats.
+    std::unique_ptr<std::atomic<int64_t>[]> m_num_routed;
+};
+
+}  // namespace dorado
@@ -3,44 +3,112 @@
 #include "modbase/remora_encoder.h"
 #include "modbase/remora_utils.h"
 #include "nn/ModBaseRunner.h"
+#include "utils/MoveTable.h"
 #include "utils/base_mod_utils.h"
 #include "utils/math_utils.h"
 #include "utils/sequence_utils.h"
 #include "utils/stats.h"
 #include "utils/tensor_utils.h"
+#include "utils/thread_qos.h"
+#include "utils/trace.h"
 
-#include <nvtx3/nvtx3.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <cstring>
+#include <tuple>
 using namespace std::chrono_literals;
 
 namespace dorado {
 
-constexpr auto FORCE_TIMEOUT = 100ms;
-
 ModBaseCallerNode::ModBaseCallerNode(MessageSink& sink,
                                      std::vector<std::unique_ptr<ModBaseRunner>> model_runners,
                                      size_t remora_threads,
                                      size_t block_stride,
                                      size_t batch_size,
-                                     size_t max_reads)
+                                     size_t max_reads,
+                                     bool release_raw_data,
+                                     bool gather_signal_on_device,
+                                     int batch_timeout_ms,
+                                     bool encode_kmers_on_device,
+                                     bool fuse_compatible_models)
         : MessageSink(max_reads),
           m_sink(sink),
           m_batch_size(batch_size),
+          m_batch_timeout_ms(batch_timeout_ms),
           m_block_stride(block_stride),
+          m_release_raw_data(release_raw_data),
           m_runners(std::move(model_runners)) {
     init_modbase_info();
 
+    m_gather_signal_on_device = gather_signal_on_device && m_runners[0]->device().is_cuda();
+    if (gather_signal_on_device && !m_gather_signal_on_device) {
+        spdlog::warn("Modbase signal can only be gathered on a CUDA device, ignoring.");
+    }
+    m_runner_device_slots.resize(m_runners.size(), 0);
+    if (m_gather_signal_on_device) {
+        m_num_device_slots = 0;
+        for (size_t worker_id = 0; worker_id < m_runners.size(); ++worker_id) {
+            const auto device = m_runners[worker_id]->device();
+            size_t slot = 0;
+            while (slot < m_num_device_slots &&
+                   m_runners[m_device_slot_runners[slot]]->device() != device) {
+                ++slot;
+            }
+            if (slot == m_num_device_slots) {
+                m_device_slot_runners.push_back(worker_id);
+                ++m_num_device_slots;
+            }
+            m_runner_device_slots[worker_id] = slot;
+        }
+    }
+
+    // Only the bases of each chunk's kmers are uploaded, and encoded on the device.
+    if (encode_kmers_on_device) {
+        if (m_runners[0]->device().is_cuda()) {
+            for (auto& runner : m_runners) {
+                runner->encode_kmers_on_device(m_block_stride);
+            }
+        } else {
+            spdlog::warn("Modbase kmers can only be encoded on a CUDA device, ignoring.");
+        }
+    }
+
+    // Models fused together take the same kmer encoding, and windows of the same length.
+    const auto& runner = m_runners[0];
+    for (size_t caller_id = 0; caller_id < runner->num_callers(); ++caller_id) {
+        const auto& params = runner->caller_params(caller_id);
+        size_t group_id = 0;
+        for (; fuse_compatible_models && group_id < m_caller_groups.size(); ++group_id) {
+            const auto& other_params = runner->caller_params(m_caller_groups[group_id].front());
+            if (other_params.bases_before == params.bases_before &&
+                other_params.bases_after == params.bases_after &&
+                other_params.context_before + other_params.context_after ==
+                        params.context_before + params.context_after) {
+                break;
+            }
+        }
+        if (group_id == m_caller_groups.size()) {
+            m_caller_groups.emplace_back();
+        }
+        m_caller_groups[group_id].push_back(caller_id);
+        m_caller_group_ids.push_back(group_id);
+    }
+    if (m_caller_groups.size() < runner->num_callers()) {
+        spdlog::debug("> Calling {} modbase models in {} fused groups", runner->num_callers(),
+                      m_caller_groups.size());
+    }
+
     m_output_worker = std::make_unique<std::thread>(&ModBaseCallerNode::output_worker_thread, this);
 
-    m_chunk_queues.resize(m_runners[0]->num_callers());
+    m_chunk_queues.resize(m_num_device_slots * m_caller_groups.size());
 
     for (size_t worker_id = 0; worker_id < m_runners.size(); ++worker_id) {
-        for (size_t model_id = 0; model_id < m_runners[worker_id]->num_callers(); ++model_id) {
+        for (size_t group_id = 0; group_id < m_caller_groups.size(); ++group_id) {
             std::unique_ptr<std::thread> t = std::make_unique<std::thread>(
-                    &ModBaseCallerNode::modbasecall_worker_thread, this, worker_id, model_id);
+                    &ModBaseCallerNode::modbasecall_worker_thread, this, worker_id, group_id);
             m_runner_workers.push_back(std::move(t));
             ++m_num_active_runner_workers;
         }
@@ -56,6 +124,14 @@ ModBaseCallerNode::ModBaseCallerNode(MessageSink& sink,
 
 ModBaseCallerNode::~ModBaseCallerNode() {
     terminate();
+    join();
+}
+
+void ModBaseCallerNode::join() {
+    if (!m_output_worker->joinable()) {
+        // Already joined.
+        return;
+    }
     for (auto& t : m_input_worker) {
         t->join();
     }
@@ -136,16 +212,23 @@ void ModBaseCallerNode::init_modbase_info() {
 }
 
 void ModBaseCallerNode::input_worker_thread() {
+    utils::set_thread_qos(utils::ThreadQoS::UserInitiated);
     Message message;
     while (m_work_queue.try_pop(message)) {
-        nvtx3::scoped_range range{"modbase_input_worker_thread"};
+        DORADO_TRACE_SCOPE("modbase_input_worker_thread");
         // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+        // The read's chunks all go to the runners of one device, in turn.
+        const size_t num_groups = m_caller_groups.size();
+        const size_t device_slot =
+                m_num_device_slots == 1 ? 0 : m_next_device_slot++ % m_num_device_slots;
+        const auto slot_chunk_queues = m_chunk_queues.begin() + device_slot * num_groups;
 
-        const size_t max_chunks_in = m_batch_size * 5;  // size per queue: one queue per caller
-        auto chunk_queues_available = [this, &max_chunks_in] {
+        const size_t max_chunks_in = m_batch_size * 5;  // size per queue: one queue per group
+        auto chunk_queues_available = [&slot_chunk_queues, &max_chunks_in, num_groups] {
             return std::all_of(
-                    std::begin(m_chunk_queues), std::end(m_chunk_queues),
+                    slot_chunk_queues, slot_chunk_queues + num_groups,
                     [&max_chunks_in](const auto& queue) { return queue.size() < max_chunks_in; });
         };
 
@@ -155,64 +238,114 @@ void ModBaseCallerNode::input_worker_thread() {
             chunk_lock.unlock();
 
             stats::Timer timer;
+            // all runners have the same set of callers, so we only need to use the first one
+            const auto motif_hits = m_runners[0]->get_motif_hits(read->seq);
             {
-                nvtx3::scoped_range range{"base_mod_probs_init"};
-                // initialize base_mod_probs _before_ we start handing out chunks
-                read->base_mod_probs.resize(read->seq.size() * m_num_states, 0);
-                for (size_t i = 0; i < read->seq.size(); ++i) {
+                DORADO_TRACE_SCOPE("base_mod_probs_init");
+                // initialize base_mod_probs _before_ we start handing out chunks.  Only the
+                // bases some caller has a context hit at get a row.
+                auto& positions = read->base_mod_positions;
+                positions.clear();
+                for (const auto& hits : motif_hits) {
+                    positions.insert(positions.end(), hits.begin(), hits.end());
+                }
+                std::sort(positions.begin(), positions.end());
+                positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+                read->base_mod_probs.assign(positions.size() * m_num_states, 0);
+                for (size_t row = 0; row < positions.size(); ++row) {
                     // Initialize for what corresponds to 100% canonical base for each position.
-                    int base_id = RemoraUtils::BASE_IDS[read->seq[i]];
+                    int base_id = RemoraUtils::BASE_IDS[read->seq[positions[row]]];
                     if (base_id < 0) {
                         throw std::runtime_error("Invalid character in sequence.");
                     }
-                    read->base_mod_probs[i * m_num_states + m_base_prob_offsets[base_id]] = 1.0f;
+                    read->base_mod_probs[row * m_num_states + m_base_prob_offsets[base_id]] = 1.0f;
                 }
             }
             read->base_mod_info = m_base_mod_info;
 
             std::vector<int> sequence_ints = utils::sequence_to_ints(read->seq);
-            std::vector<uint64_t> seq_to_sig_map = utils::moves_to_map(
-                    read->moves, m_block_stride, read->raw_data.size(0), read->seq.size() + 1);
+            std::vector<uint64_t> seq_to_sig_map =
+                    read->move_table().to_sig_map(m_block_stride, read->raw_data.size(0));
 
+            // The read is complete once the chunk of each caller's every context hit has been
+            // scored, which may happen before the last caller's chunks are queued.
             read->num_modbase_chunks = 0;
+            for (const auto& hits : motif_hits) {
+                read->num_modbase_chunks += hits.size();
+            }
             read->num_modbase_chunks_called = 0;
+            if (read->num_modbase_chunks != 0) {
+                // Put the read in the working list before any of its chunks can be called.
+                std::lock_guard working_reads_lock(m_working_reads_mutex);
+                m_working_reads.emplace(read.get(), read);
+                m_working_reads_bytes += read->memory_bytes();
+            }
 
-            // all runners have the same set of callers, so we only need to use the first one
             auto& runner = m_runners[0];
+            // Every caller's chunks are gathered from the one copy of the read's signal.
+            torch::Tensor device_signal;
+            if (m_gather_signal_on_device) {
+                auto& uploader = m_runners[m_device_slot_runners[device_slot]];
+                device_signal = uploader->upload_signal(read->raw_data);
+            }
+            // Callers whose kmers and contexts are the same size share the read's encoder.
+            std::vector<std::shared_ptr<const RemoraEncoder>> encoders(runner->num_callers());
             for (size_t caller_id = 0; caller_id < runner->num_callers(); ++caller_id) {
-                nvtx3::scoped_range range{"generate_chunks"};
-                auto& chunk_queue = m_chunk_queues[caller_id];
-
-                // scale signal based on model parameters
-                auto scaled_signal = runner->scale_signal(caller_id, read->raw_data, sequence_ints,
-                                                          seq_to_sig_map);
+                DORADO_TRACE_SCOPE("generate_chunks");
+                auto& chunk_queue = slot_chunk_queues[m_caller_group_ids[caller_id]];
+
+                // scale signal based on model parameters, or on the device as it's gathered
+                torch::Tensor scaled_signal;
+                float signal_offset = 0.f;
+                float signal_scale = 1.f;
+                if (m_gather_signal_on_device) {
+                    scaled_signal = device_signal;
+                    std::tie(signal_offset, signal_scale) = runner->signal_offset_scale(
+                            caller_id, read->raw_data, sequence_ints, seq_to_sig_map);
+                } else {
+                    scaled_signal = runner->scale_signal(caller_id, read->raw_data, sequence_ints,
+                                                         seq_to_sig_map)
+                                            .contiguous();
+                }
 
                 auto& params = runner->caller_params(caller_id);
-                auto context_samples = (params.context_before + params.context_after);
-                // One-hot encodes the kmer at each signal step for input into the network
-                RemoraEncoder encoder(m_block_stride, context_samples, params.bases_before,
-                                      params.bases_after);
-                encoder.init(sequence_ints, seq_to_sig_map);
+                for (size_t other_id = 0; other_id < caller_id && !encoders[caller_id];
+                     ++other_id) {
+                    const auto& other_params = runner->caller_params(other_id);
+                    if (other_params.bases_before == params.bases_before &&
+                        other_params.bases_after == params.bases_after &&
+                        other_params.context_before + other_params.context_after ==
+                                params.context_before + params.context_after) {
+                        encoders[caller_id] = encoders[other_id];
+                    }
+                }
+                if (!encoders[caller_id]) {
+                    auto context_samples = (params.context_before + params.context_after);
+                    // One-hot encodes the kmer at each signal step for input into the network
+                    auto encoder = std::make_shared<RemoraEncoder>(
+                            m_block_stride, context_samples, params.bases_before,
+                            params.bases_after);
+                    encoder->init(sequence_ints, seq_to_sig_map);
+                    encoders[caller_id] = std::move(encoder);
+                }
 
-                auto context_hits = runner->get_motif_hits(caller_id, read->seq);
+                const auto& context_hits = motif_hits[caller_id];
                 m_num_context_hits += static_cast<int64_t>(context_hits.size());
+                // Allocate all of the read's chunks for this caller together, rather than one
+                // allocation per context hit.  Each chunk pointer shares ownership of the block.
+                auto chunk_block = std::make_shared<std::vector<RemoraChunk>>();
+                chunk_block->reserve(context_hits.size());
                 std::vector<std::shared_ptr<RemoraChunk>> reads_to_enqueue;
                 reads_to_enqueue.reserve(context_hits.size());
+                // The signal window and kmer encoding of each hit are written into the
+                // runner's input when its chunk is batched, so none are copied out here.
                 for (auto context_hit : context_hits) {
-                    nvtx3::scoped_range range{"create_chunk"};
-                    auto slice = encoder.get_context(context_hit);
-                    // signal
-                    auto input_signal = scaled_signal.index({torch::indexing::Slice(
-                            slice.first_sample, slice.first_sample + slice.num_samples)});
-                    if (slice.lead_samples_needed != 0 || slice.tail_samples_needed != 0) {
-                        input_signal = torch::constant_pad_nd(input_signal,
-                                                              {(int64_t)slice.lead_samples_needed,
-                                                               (int64_t)slice.tail_samples_needed});
-                    }
-                    reads_to_enqueue.push_back(std::make_shared<RemoraChunk>(
-                            read, input_signal, std::move(slice.data), context_hit));
-
-                    ++read->num_modbase_chunks;
+                    auto& chunk = chunk_block->emplace_back(read.get(), scaled_signal,
+                                                            encoders[caller_id], context_hit);
+                    chunk.signal_offset = signal_offset;
+                    chunk.signal_scale = signal_scale;
+                    chunk.caller_id = caller_id;
+                    reads_to_enqueue.emplace_back(chunk_block, &chunk);
                 }
                 chunk_lock.lock();
                 chunk_queue.insert(chunk_queue.end(), reads_to_enqueue.begin(),
@@ -223,13 +356,12 @@ void ModBaseCallerNode::input_worker_thread() {
             }
             m_chunk_generation_ms += timer.GetElapsedMS();
 
-            if (read->num_modbase_chunks != 0) {
-                // Put the read in the working list
-                std::scoped_lock<std::mutex> working_reads_lock(m_working_reads_mutex);
-                m_working_reads.push_back(read);
-            } else {
+            if (read->num_modbase_chunks == 0) {
                 // No modbases to call, pass directly to next node
-                m_sink.push_message(read);
+                if (m_release_raw_data) {
+                    read->release_raw_data();
+                }
+                m_sink.push_message(std::move(read));
                 ++m_num_non_mod_base_reads_pushed;
             }
             break;
@@ -243,28 +375,32 @@ void ModBaseCallerNode::input_worker_thread() {
     }
 }
 
-void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t caller_id) {
+void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t group_id) {
+    utils::set_thread_qos(utils::ThreadQoS::Interactive);
     auto& runner = m_runners[worker_id];
-    auto& chunk_queue = m_chunk_queues[caller_id];
+    auto& chunk_queue =
+            m_chunk_queues[m_runner_device_slots[worker_id] * m_caller_groups.size() + group_id];
+    // The group's chunks are all accepted into the input of its first caller.
+    const auto input_caller_id = int(m_caller_groups[group_id].front());
 
     auto batched_chunks = std::vector<std::shared_ptr<RemoraChunk>>{};
-    auto last_chunk_reserve_time = std::chrono::system_clock::now();
+    // A batch is called once it is full, or once its first chunk has waited m_batch_timeout_ms,
+    // so that chunks of sparse motifs or of the last reads aren't held up.
+    const auto batch_timeout = std::chrono::milliseconds(m_batch_timeout_ms);
+    auto batch_deadline = std::chrono::steady_clock::now() + batch_timeout;
+    auto chunks_available = [&chunk_queue, this] {
+        return !chunk_queue.empty() || m_terminate_runners.load();
+    };
 
     while (true) {
-        nvtx3::scoped_range range{"modbasecall_worker_thread"};
+        DORADO_TRACE_SCOPE("modbasecall_worker_thread");
         std::unique_lock<std::mutex> chunks_lock(m_chunk_queues_mutex);
-        if (!m_chunks_added_cv.wait_until(
-                    chunks_lock, last_chunk_reserve_time + FORCE_TIMEOUT, [&chunk_queue, this] {
-                        return !chunk_queue.empty() || m_terminate_runners.load();
-                    })) {
-            // timeout without new chunks or termination call
+        if (batched_chunks.empty()) {
+            m_chunks_added_cv.wait(chunks_lock, chunks_available);
+        } else if (!m_chunks_added_cv.wait_until(chunks_lock, batch_deadline, chunks_available)) {
+            // The deadline passed without new chunks or termination call
             chunks_lock.unlock();
-            if (!batched_chunks.empty()) {
-                call_current_batch(worker_id, caller_id, batched_chunks);
-            }
-
-            // reset wait period
-            last_chunk_reserve_time = std::chrono::system_clock::now();
+            call_current_batch(worker_id, group_id, batched_chunks);
             continue;
         }
 
@@ -273,7 +409,7 @@ void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t calle
             // call the remaining batch
             chunks_lock.unlock();  // Not strictly necessary
             if (!batched_chunks.empty()) {
-                call_current_batch(worker_id, caller_id, batched_chunks);
+                call_current_batch(worker_id, group_id, batched_chunks);
             }
 
             // Reduce the count of active runner threads.  If this was the last active
@@ -285,8 +421,11 @@ void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t calle
                 for (auto& runner : m_runners) {
                     runner->terminate();
                 }
-                m_terminate_output.store(true);
-                m_processed_chunks_cv.notify_one();
+                {
+                    std::lock_guard working_reads_lock(m_working_reads_mutex);
+                    m_terminate_output.store(true);
+                }
+                m_reads_completed_cv.notify_one();
             }
             return;
         }
@@ -299,13 +438,15 @@ void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t calle
         // significantly.  This matters because slack time in this thread currently
         // gates Remora model GPU throughput on fast systems.
         size_t previous_chunk_count = batched_chunks.size();
+        if (previous_chunk_count == 0) {
+            batch_deadline = std::chrono::steady_clock::now() + batch_timeout;
+        }
         {
-            nvtx3::scoped_range range{"push_chunks"};
+            DORADO_TRACE_SCOPE("push_chunks");
             while (batched_chunks.size() != m_batch_size && !chunk_queue.empty()) {
                 std::shared_ptr<RemoraChunk> chunk = chunk_queue.front();
                 chunk_queue.pop_front();
                 batched_chunks.push_back(chunk);
-                last_chunk_reserve_time = std::chrono::system_clock::now();
             }
         }
         // Relinquish the chunk queue mutex, allowing other chunk queue
@@ -317,93 +458,136 @@ void ModBaseCallerNode::modbasecall_worker_thread(size_t worker_id, size_t calle
         for (size_t chunk_idx = previous_chunk_count; chunk_idx < batched_chunks.size();
              ++chunk_idx) {
             const auto& chunk = batched_chunks[chunk_idx];
-            runner->accept_chunk(caller_id, chunk_idx, chunk->signal, chunk->encoded_kmers);
+            runner->accept_chunk(input_caller_id, chunk_idx, chunk->signal, *chunk->encoder,
+                                 chunk->context_hit, chunk->signal_offset, chunk->signal_scale);
+            // The inputs have been copied, and the chunk's block stays alive until the block's
+            // last chunk is scored, so let go of the read's signal and encoder now.
+            chunk->signal = torch::Tensor();
+            chunk->encoder.reset();
         }
 
-        if (batched_chunks.size() == m_batch_size) {
-            // Input tensor is full, let's get_scores.
-            call_current_batch(worker_id, caller_id, batched_chunks);
+        if (batched_chunks.size() == m_batch_size ||
+            std::chrono::steady_clock::now() >= batch_deadline) {
+            // Input tensor is full, or has waited long enough, let's get_scores.
+            call_current_batch(worker_id, group_id, batched_chunks);
         }
     }
 }
 
 void ModBaseCallerNode::call_current_batch(
         size_t worker_id,
-        size_t caller_id,
+        size_t group_id,
         std::vector<std::shared_ptr<RemoraChunk>>& batched_chunks) {
-    nvtx3::scoped_range loop{"call_current_batch"};
+    DORADO_TRACE_SCOPE("call_current_batch");
+
+    // Each chunk's scores are a row of its caller's results: the row of the chunk in the batch,
+    // or with fused models, among the chunks of its caller.
+    const auto& group = m_caller_groups[group_id];
+    std::vector<size_t> group_members(batched_chunks.size(), 0);
+    std::vector<std::vector<int64_t>> member_rows(group.size());
+    std::vector<size_t> result_rows(batched_chunks.size());
+    for (size_t i = 0; i < batched_chunks.size(); ++i) {
+        const auto member = size_t(std::find(group.begin(), group.end(),
+                                             batched_chunks[i]->caller_id) -
+                                   group.begin());
+        group_members[i] = member;
+        result_rows[i] = member_rows[member].size();
+        member_rows[member].push_back(int64_t(i));
+    }
 
     dorado::stats::Timer timer;
-    auto results = m_runners[worker_id]->call_chunks(caller_id, batched_chunks.size());
+    std::vector<torch::Tensor> results;
+    if (group.size() == 1) {
+        results.push_back(
+                m_runners[worker_id]->call_chunks(int(group.front()), batched_chunks.size()));
+    } else {
+        results = m_runners[worker_id]->call_fused_chunks(
+                std::vector<int>(group.begin(), group.end()), member_rows,
+                int(batched_chunks.size()));
+        ++m_num_fused_batches_called;
+    }
     m_call_chunks_ms += timer.GetElapsedMS();
 
     // Convert results to float32 with one call and address via a raw pointer,
     // to avoid huge libtorch indexing overhead.
-    auto results_f32 = results.to(torch::kFloat32);
-    assert(results_f32.is_contiguous());
-    const auto* const results_f32_ptr = results_f32.data_ptr<float>();
-
-    std::unique_lock processed_chunks_lock(m_processed_chunks_mutex);
-    auto row_size = results.size(1);
+    std::vector<torch::Tensor> results_f32(results.size());
+    for (size_t member = 0; member < results.size(); ++member) {
+        if (results[member].defined()) {
+            results_f32[member] = results[member].to(torch::kFloat32);
+            assert(results_f32[member].is_contiguous());
+        }
+    }
 
-    // Put results into chunk
+    // Scatter each chunk's scores into its read.  Each caller writes the rows' probabilities
+    // of its own canonical base, so runners can fill in the same read at once.
+    std::vector<Read*> completed_reads;
     for (size_t i = 0; i < batched_chunks.size(); ++i) {
-        auto& chunk = batched_chunks[i];
-        chunk->scores.resize(row_size);
-        std::memcpy(chunk->scores.data(), &results_f32_ptr[i * row_size], row_size * sizeof(float));
-        m_processed_chunks.push_back(chunk);
+        const auto& chunk = batched_chunks[i];
+        Read* const source_read = chunk->source_read;
+        const auto& positions = source_read->base_mod_positions;
+        const size_t result_pos = chunk->context_hit;
+        const size_t row = size_t(
+                std::lower_bound(positions.begin(), positions.end(), uint32_t(result_pos)) -
+                positions.begin());
+        assert(row < positions.size() && positions[row] == result_pos);
+        const size_t offset =
+                m_base_prob_offsets[RemoraUtils::BASE_IDS[source_read->seq[result_pos]]];
+        const auto& chunk_results = results_f32[group_members[i]];
+        const auto row_size = chunk_results.size(1);
+        const float* const scores =
+                &chunk_results.data_ptr<float>()[result_rows[i] * size_t(row_size)];
+        auto* const probs = &source_read->base_mod_probs[m_num_states * row + offset];
+        for (int64_t j = 0; j < row_size; ++j) {
+            probs[j] = uint8_t(std::min(std::floor(scores[j] * 256), 255.0f));
+        }
+        if (++source_read->num_modbase_chunks_called == source_read->num_modbase_chunks) {
+            completed_reads.push_back(source_read);
+        }
     }
 
-    processed_chunks_lock.unlock();
-    m_processed_chunks_cv.notify_one();
+    // Hand the reads whose last chunk this was to the output worker.
+    if (!completed_reads.empty()) {
+        {
+            std::lock_guard working_reads_lock(m_working_reads_mutex);
+            for (Read* read : completed_reads) {
+                auto it = m_working_reads.find(read);
+                m_working_reads_bytes -= read->memory_bytes();
+                m_completed_reads.push_back(std::move(it->second));
+                m_working_reads.erase(it);
+            }
+        }
+        m_reads_completed_cv.notify_one();
+    }
 
+    if (batched_chunks.size() < m_batch_size) {
+        ++m_num_partial_batches_called;
+    }
     batched_chunks.clear();
     ++m_num_batches_called;
 }
 
 void ModBaseCallerNode::output_worker_thread() {
     while (true) {
-        nvtx3::scoped_range range{"modbase_output_worker_thread"};
-        // Wait until we are provided with a read
-        std::unique_lock processed_chunks_lock(m_processed_chunks_mutex);
-        m_processed_chunks_cv.wait(processed_chunks_lock, [this] {
-            return !m_processed_chunks.empty() || m_terminate_output.load();
-        });
-        if (m_terminate_output.load() && m_processed_chunks.empty()) {
-            m_sink.terminate();
-            return;
-        }
-
-        for (const auto& chunk : m_processed_chunks) {
-            auto source_read = chunk->source_read.lock();
-            int64_t result_pos = chunk->context_hit;
-            int64_t offset =
-                    m_base_prob_offsets[RemoraUtils::BASE_IDS[source_read->seq[result_pos]]];
-            for (size_t i = 0; i < chunk->scores.size(); ++i) {
-                source_read->base_mod_probs[m_num_states * result_pos + offset + i] =
-                        uint8_t(std::min(std::floor(chunk->scores[i] * 256), 255.0f));
-            }
-            source_read->num_modbase_chunks_called += 1;
-        }
-
-        m_processed_chunks.clear();
-        processed_chunks_lock.unlock();
-
-        // Now move any completed reads to the output queue
+        // Wait until reads are completed
         std::vector<std::shared_ptr<Read>> completed_reads;
-        std::unique_lock<std::mutex> working_reads_lock(m_working_reads_mutex);
-        for (auto read_iter = m_working_reads.begin(); read_iter != m_working_reads.end();) {
-            if ((*read_iter)->num_modbase_chunks_called.load() ==
-                (*read_iter)->num_modbase_chunks) {
-                completed_reads.push_back(*read_iter);
-                read_iter = m_working_reads.erase(read_iter);
-            } else {
-                ++read_iter;
+        {
+            std::unique_lock working_reads_lock(m_working_reads_mutex);
+            m_reads_completed_cv.wait(working_reads_lock, [this] {
+                return !m_completed_reads.empty() || m_terminate_output.load();
+            });
+            if (m_completed_reads.empty()) {
+                m_sink.terminate();
+                return;
             }
+            completed_reads.swap(m_completed_reads);
         }
-        working_reads_lock.unlock();
+
+        DORADO_TRACE_SCOPE("modbase_output_worker_thread");
         for (auto& read : completed_reads) {
-            m_sink.push_message(read);
+            if (m_release_raw_data) {
+                read->release_raw_data();
+            }
+            m_sink.push_message(std::move(read));
             ++m_num_mod_base_reads_pushed;
         }
     }
@@ -417,12 +601,14 @@ std::unordered_map<std::string, double> ModBaseCallerNode::sample_stats() const
     }
     stats["batches_called"] = m_num_batches_called;
     stats["partial_batches_called"] = m_num_partial_batches_called;
+    stats["fused_batches_called"] = m_num_fused_batches_called;
     stats["input_chunks_sleeps"] = m_num_input_chunks_sleeps;
     stats["call_chunks_ms"] = m_call_chunks_ms;
     stats["context_hits"] = m_num_context_hits;
     stats["mod_base_reads_pushed"] = m_num_mod_base_reads_pushed;
     stats["non_mod_base_reads_pushed"] = m_num_non_mod_base_reads_pushed;
     stats["chunk_generation_ms"] = m_chunk_generation_ms;
+    stats["working_reads_bytes"] = m_working_reads_bytes;
     return stats;
 }
 
@@ -6,6 +6,7 @@
 #include <deque>
 #include <functional>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace dorado {
@@ -21,8 +22,14 @@ public:
                       size_t remora_threads,
                       size_t block_stride,
                       size_t batch_size,
-                      size_t max_reads = 1000);
+                      size_t max_reads = 1000,
+                      bool release_raw_data = false,
+                      bool gather_signal_on_device = false,
+                      int batch_timeout_ms = 100,
+                      bool encode_kmers_on_device = false,
+                      bool fuse_compatible_models = false);
     ~ModBaseCallerNode();
+    void join() override;
     std::string get_name() const override { return "ModBaseCallerNode"; }
     stats::NamedStats sample_stats() const override;
 
@@ -50,41 +57,63 @@ private:
     // Worker threads, scales and chunks reads for runners and enqueues them
     void input_worker_thread();
 
-    // Worker threads, performs the GPU calls to the modbase models
-    void modbasecall_worker_thread(size_t worker_id, size_t caller_id);
+    // Worker threads, performs the GPU calls to the modbase models of a caller group
+    void modbasecall_worker_thread(size_t worker_id, size_t group_id);
 
-    // Called by modbasecall_worker_thread, calls the model and enqueues the results
+    // Called by modbasecall_worker_thread, calls the models and writes the results into the reads
     void call_current_batch(size_t worker_id,
-                            size_t caller_id,
+                            size_t group_id,
                             std::vector<std::shared_ptr<RemoraChunk>>& batched_chunks);
 
-    // Worker thread, processes chunk results back into the reads
+    // Worker thread, passes on the reads whose chunks have all been scored
     void output_worker_thread();
 
     MessageSink& m_sink;
     size_t m_batch_size;
+    // How long a batch which isn't full waits for more chunks before it is called anyway.
+    int m_batch_timeout_ms;
     size_t m_block_stride;
+    // Free the signal of reads once their modbases have been called?
+    bool m_release_raw_data;
+    // Upload each read's signal to a GPU once, and gather its chunks' signal windows there,
+    // rather than copying every window to the GPU separately?
+    bool m_gather_signal_on_device{false};
+    // With the signal gathered on the device, each read's chunks go to the runners of one
+    // device, through that device's chunk queues.  Otherwise there is one set of queues.
+    size_t m_num_device_slots{1};
+    std::vector<size_t> m_runner_device_slots;
+    // Index of a runner on each device, for uploading signal.
+    std::vector<size_t> m_device_slot_runners;
+    std::atomic<size_t> m_next_device_slot{0};
 
     std::vector<std::unique_ptr<ModBaseRunner>> m_runners;
+    // The callers whose chunks are batched and called together, and the group of each caller.
+    // Each caller is a group of its own, unless models whose inputs are the same shape are
+    // fused, in which case their chunks share batches, which are uploaded once and called
+    // model by model.
+    std::vector<std::vector<size_t>> m_caller_groups;
+    std::vector<size_t> m_caller_group_ids;
 
     std::unique_ptr<std::thread> m_output_worker;
     std::vector<std::unique_ptr<std::thread>> m_runner_workers;
     std::vector<std::unique_ptr<std::thread>> m_input_worker;
 
-    std::deque<std::shared_ptr<RemoraChunk>> m_processed_chunks;
+    // One queue per caller group, for each device slot.
     std::vector<std::deque<std::shared_ptr<RemoraChunk>>> m_chunk_queues;
 
     std::mutex m_working_reads_mutex;
-    // Reads removed from input queue and being modbasecalled.
-    std::deque<std::shared_ptr<Read>> m_working_reads;
+    // Reads removed from input queue and being modbasecalled, which their chunks point back to.
+    std::unordered_map<const Read*, std::shared_ptr<Read>> m_working_reads;
+    // Reads whose last chunk has been scored, moved from m_working_reads by the runner worker
+    // which scored it, for the output worker to pass on.
+    std::vector<std::shared_ptr<Read>> m_completed_reads;
+    // Signalled when reads are completed, or when the output worker is to terminate.
+    std::condition_variable m_reads_completed_cv;
 
     std::mutex m_chunk_queues_mutex;
     std::condition_variable m_chunk_queues_cv;
     std::condition_variable m_chunks_added_cv;
 
-    std::mutex m_processed_chunks_mutex;
-    std::condition_variable m_processed_chunks_cv;
-
     std::atomic<int> m_num_active_runner_workers{0};
     std::atomic<int> m_num_active_input_worker{0};
 
@@ -99,12 +128,14 @@ private:
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_batches_called = 0;
     std::atomic<int64_t> m_num_partial_batches_called = 0;
+    std::atomic<int64_t> m_num_fused_batches_called = 0;
     std::atomic<int64_t> m_num_input_chunks_sleeps = 0;
     std::atomic<int64_t> m_call_chunks_ms = 0;
     std::atomic<int64_t> m_num_context_hits = 0;
     std::atomic<int64_t> m_num_mod_base_reads_pushed = 0;
     std::atomic<int64_t> m_num_non_mod_base_reads_pushed = 0;
     std::atomic<int64_t> m_chunk_generation_ms = 0;
+    std::atomic<int64_t> m_working_reads_bytes = 0;
 };
 
 }  // namespace dorado
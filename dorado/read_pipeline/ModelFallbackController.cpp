@@ -0,0 +1,87 @@
+#include "ModelFallbackController.h"
+
+#include <spdlog/spdlog.h>
+
+#include <utility>
+
+namespace dorado {
+
+namespace {
+
+// Weight of each new measurement of the main model's rate.
+constexpr double kRateSmoothing = 0.25;
+
+}  // namespace
+
+ModelFallbackController::ModelFallbackController(double max_backlog_s,
+                                                 std::chrono::milliseconds update_interval)
+        : m_max_backlog_s(max_backlog_s), m_update_interval(update_interval) {}
+
+void ModelFallbackController::set_reads_called_source(std::function<int64_t()> reads_called) {
+    std::lock_guard lock(m_mutex);
+    m_reads_called = std::move(reads_called);
+}
+
+size_t ModelFallbackController::route_read(std::chrono::steady_clock::time_point now) {
+    std::lock_guard lock(m_mutex);
+    if (m_reads_called && now - m_last_update >= m_update_interval) {
+        update(now);
+    }
+    if (m_using_fallback) {
+        ++m_reads_to_fallback;
+        return 1;
+    }
+    ++m_reads_to_main;
+    return 0;
+}
+
+void ModelFallbackController::update(std::chrono::steady_clock::time_point now) {
+    const int64_t reads_called = m_reads_called();
+    if (m_last_update != std::chrono::steady_clock::time_point{}) {
+        const double elapsed_s = std::chrono::duration<double>(now - m_last_update).count();
+        const double rate = double(reads_called - m_last_reads_called) / elapsed_s;
+        // The model is still warming up until it has called something.
+        if (m_reads_per_s > 0) {
+            m_reads_per_s += kRateSmoothing * (rate - m_reads_per_s);
+        } else if (rate > 0) {
+            m_reads_per_s = rate;
+        }
+    }
+    m_last_update = now;
+    m_last_reads_called = reads_called;
+    if (m_reads_per_s <= 0) {
+        return;
+    }
+
+    m_backlog_s = double(m_reads_to_main - reads_called) / m_reads_per_s;
+    if (!m_using_fallback && m_backlog_s > m_max_backlog_s) {
+        m_using_fallback = true;
+        ++m_num_switches;
+        spdlog::info("> Calling new reads with the fallback model, with a backlog of {:.0f}s",
+                     m_backlog_s);
+    } else if (m_using_fallback && m_backlog_s < m_max_backlog_s / 2) {
+        m_using_fallback = false;
+        ++m_num_switches;
+        spdlog::info("> Calling new reads with the main model again, with a backlog of {:.0f}s",
+                     m_backlog_s);
+    }
+}
+
+bool ModelFallbackController::using_fallback() const {
+    std::lock_guard lock(m_mutex);
+    return m_using_fallback;
+}
+
+stats::NamedStats ModelFallbackController::sample_stats() const {
+    std::lock_guard lock(m_mutex);
+    stats::NamedStats stats;
+    stats["reads_to_main"] = double(m_reads_to_main);
+    stats["reads_to_fallback"] = double(m_reads_to_fallback);
+    stats["backlog_s"] = m_backlog_s;
+    stats["main_reads_per_s"] = m_reads_per_s;
+    stats["using_fallback"] = m_using_fallback;
+    stats["switches"] = double(m_num_switches);
+    return stats;
+}
+
+}  // namespace dorado
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "utils/stats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace dorado {
+
+/// Decides which of two models each new read is called with, so that live basecalling keeps
+/// up with acquisition.  Reads go to the main model until its backlog, the reads sent to it
+/// which it hasn't called yet, would take more than max_backlog_s to call at its recent rate,
+/// and then to the faster fallback model until the main model's backlog has halved.
+class ModelFallbackController {
+public:
+    // The main model's rate is re-measured every update_interval.
+    ModelFallbackController(double max_backlog_s,
+                            std::chrono::milliseconds update_interval = std::chrono::seconds(1));
+
+    // How many reads the main model has called so far, such as its BasecallerNode's counter.
+    // Until it is set, every read goes to the main model.
+    void set_reads_called_source(std::function<int64_t()> reads_called);
+
+    // Returns 0 if the next read should go to the main model, or 1 for the fallback model.
+    size_t route_read(
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    bool using_fallback() const;
+
+    std::string get_name() const { return "ModelFallbackController"; }
+    stats::NamedStats sample_stats() const;
+
+private:
+    // Re-measures the main model's rate, and switches models if its backlog calls for it.
+    // Called with the mutex held.
+    void update(std::chrono::steady_clock::time_point now);
+
+    const double m_max_backlog_s;
+    const std::chrono::milliseconds m_update_interval;
+
+    mutable std::mutex m_mutex;
+    std::function<int64_t()> m_reads_called;
+    int64_t m_reads_to_main{0};
+    int64_t m_reads_to_fallback{0};
+    // As of the last update.
+    std::chrono::steady_clock::time_point m_last_update;
+    int64_t m_last_reads_called{0};
+    double m_backlog_s{0};
+    int64_t m_num_switches{0};
+    // Smoothed over updates, in reads per second.  0 until the main model has called a read.
+    double m_reads_per_s{0};
+    bool m_using_fallback{false};
+};
+
+}  // namespace dorado
@@ -22,8 +22,14 @@ NullNode::NullNode() : MessageSink(1000) {
 
 NullNode::~NullNode() {
     terminate();
+    join();
+}
+
+void NullNode::join() {
     for (auto& m : m_workers) {
-        m->join();
+        if (m->joinable()) {
+            m->join();
+        }
     }
 }
 
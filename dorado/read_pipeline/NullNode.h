@@ -9,6 +9,7 @@ public:
     // NullNode has no sink - input messages go nowhere
     NullNode();
     ~NullNode();
+    void join() override;
 
 private:
     void worker_thread();
@@ -0,0 +1,130 @@
+#include "OutputShards.h"
+
+#include "htslib/sam.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+namespace dorado {
+
+namespace {
+
+// FNV-1a, which unlike std::hash gives the same shards on every platform.
+uint64_t fnv1a_hash(std::string_view value) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : value) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}  // namespace
+
+OutputShardPolicy parse_output_shard_policy(const std::string& name) {
+    OutputShardPolicy policy;
+    if (name == "read_id") {
+        policy.key = OutputShardPolicy::Key::ReadId;
+    } else if (name == "read_group") {
+        policy.key = OutputShardPolicy::Key::ReadGroup;
+    } else if (name == "barcode") {
+        policy.key = OutputShardPolicy::Key::Barcode;
+    } else if (name.rfind("channel", 0) == 0 &&
+               (name.size() == 7 || (name.size() > 8 && name[7] == ':'))) {
+        policy.key = OutputShardPolicy::Key::Channel;
+        if (name.size() > 7) {
+            try {
+                policy.max_channel = std::stoi(name.substr(8));
+            } catch (const std::exception&) {
+                policy.max_channel = 0;
+            }
+            if (policy.max_channel <= 0) {
+                throw std::runtime_error("Invalid maximum channel in output shard policy: " +
+                                         name);
+            }
+        }
+    } else {
+        throw std::runtime_error("Unknown output shard policy: " + name);
+    }
+    return policy;
+}
+
+std::string output_shard_filename(const std::string& prefix,
+                                  size_t shard,
+                                  HtsWriter::OutputMode mode) {
+    char index[24];
+    std::snprintf(index, sizeof(index), "%03zu", shard);
+    const char* extension = mode == HtsWriter::OutputMode::SAM        ? "sam"
+                            : mode == HtsWriter::OutputMode::FASTQ    ? "fastq"
+                            : mode == HtsWriter::OutputMode::FASTQ_GZ ? "fastq.gz"
+                            : mode == HtsWriter::OutputMode::CRAM     ? "cram"
+                                                                      : "bam";
+    return prefix + "_" + index + "." + extension;
+}
+
+MessageRouterNode::RouteFn make_output_shard_route(
+        const OutputShardPolicy& policy,
+        size_t num_shards,
+        const std::vector<std::string>& read_group_ids,
+        const std::vector<std::string>& barcode_names) {
+    if (num_shards == 0) {
+        throw std::runtime_error("Sharded output needs at least one shard");
+    }
+    std::unordered_map<std::string, size_t> read_group_shards;
+    for (size_t i = 0; i < read_group_ids.size(); ++i) {
+        read_group_shards.emplace(read_group_ids[i], i % num_shards);
+    }
+
+    std::unordered_map<std::string, size_t> barcode_shards;
+    for (size_t i = 0; i < barcode_names.size(); ++i) {
+        barcode_shards.emplace(barcode_names[i], (i + 1) % num_shards);
+    }
+
+    return [policy, num_shards, read_group_shards = std::move(read_group_shards),
+            barcode_shards = std::move(barcode_shards)](const Message& message) -> size_t {
+        if (!std::holds_alternative<BamPtr>(message)) {
+            return 0;
+        }
+        bam1_t* record = std::get<BamPtr>(message).get();
+        switch (policy.key) {
+        case OutputShardPolicy::Key::ReadId:
+            return fnv1a_hash(bam_get_qname(record)) % num_shards;
+        case OutputShardPolicy::Key::ReadGroup: {
+            uint8_t* tag = bam_aux_get(record, "RG");
+            const char* read_group = tag ? bam_aux2Z(tag) : nullptr;
+            if (!read_group) {
+                return 0;
+            }
+            auto it = read_group_shards.find(read_group);
+            return it != read_group_shards.end() ? it->second
+                                                 : fnv1a_hash(read_group) % num_shards;
+        }
+        case OutputShardPolicy::Key::Channel: {
+            uint8_t* tag = bam_aux_get(record, "ch");
+            if (!tag) {
+                return 0;
+            }
+            const int64_t channel = std::clamp<int64_t>(bam_aux2i(tag), 1, policy.max_channel);
+            return static_cast<size_t>((channel - 1) * static_cast<int64_t>(num_shards) /
+                                       policy.max_channel);
+        }
+        case OutputShardPolicy::Key::Barcode: {
+            uint8_t* tag = bam_aux_get(record, "BC");
+            const char* barcode = tag ? bam_aux2Z(tag) : nullptr;
+            if (!barcode) {
+                return 0;
+            }
+            auto it = barcode_shards.find(barcode);
+            return it != barcode_shards.end() ? it->second : 0;
+        }
+        }
+        return 0;
+    };
+}
+
+}  // namespace dorado
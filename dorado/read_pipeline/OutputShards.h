@@ -0,0 +1,45 @@
+#pragma once
+
+#include "HtsWriter.h"
+#include "MessageRouterNode.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+/// How records are divided between the files of a sharded output, each of which has its own
+/// HtsWriter, fed by a MessageRouterNode.
+struct OutputShardPolicy {
+    enum class Key {
+        ReadId,     // By a hash of the read ID, so that shards are balanced.
+        ReadGroup,  // By read group, so that each run and model is in a single shard.
+        Channel,    // By equal ranges of channels 1 to max_channel.
+        Barcode,    // By barcode classification, so that each barcode is in a single shard.
+    };
+    Key key{Key::ReadId};
+    int max_channel{3000};
+};
+
+// Parses "read_id", "read_group", "channel[:max_channel]" or "barcode".  Throws std::runtime_error
+// otherwise.
+OutputShardPolicy parse_output_shard_policy(const std::string& name);
+
+// The file of a shard, <prefix>_<shard>.<bam|sam|fastq|cram>, with the shard zero-padded to 3 digits.
+std::string output_shard_filename(const std::string& prefix,
+                                  size_t shard,
+                                  HtsWriter::OutputMode mode);
+
+// Returns the route of each record to its shard.  Read groups are given shards in the order of
+// read_group_ids, and any other read group by a hash of its ID.  Barcodes are given shards
+// from 1 in the order of barcode_names, so that with one more shard than barcodes each has its
+// own file, and unclassified reads go to shard 0.  Records missing the key's tag, and messages
+// which aren't records, go to shard 0.
+MessageRouterNode::RouteFn make_output_shard_route(
+        const OutputShardPolicy& policy,
+        size_t num_shards,
+        const std::vector<std::string>& read_group_ids,
+        const std::vector<std::string>& barcode_names = {});
+
+}  // namespace dorado
@@ -0,0 +1,70 @@
+#include "PafWriter.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace dorado {
+
+PafWriter::PafWriter(const std::string& filename) : MessageSink(10000) {
+    if (filename == "-") {
+        m_file = stdout;
+    } else {
+        m_file = fopen(filename.c_str(), "w");
+        if (!m_file) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        m_close_file = true;
+    }
+    m_worker = std::make_unique<std::thread>(&PafWriter::worker_thread, this);
+}
+
+PafWriter::~PafWriter() {
+    terminate();
+    join();
+    if (m_close_file) {
+        fclose(m_file);
+    }
+}
+
+void PafWriter::join() {
+    if (m_worker->joinable()) {
+        m_worker->join();
+    }
+    fflush(m_file);
+}
+
+void PafWriter::worker_thread() {
+    constexpr size_t kMaxBatchSize = 1000;
+    std::vector<Message> messages;
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        for (auto& message : messages) {
+            if (!std::holds_alternative<PafLines>(message)) {
+                continue;
+            }
+            const auto& paf = std::get<PafLines>(message);
+            fwrite(paf.lines.data(), 1, paf.lines.size(), m_file);
+            const auto num_lines = std::count(paf.lines.begin(), paf.lines.end(), '\n');
+            total += num_lines;
+            m_num_lines_written += num_lines;
+            if (!paf.mapped) {
+                ++unmapped;
+            }
+            ++m_num_reads_written;
+        }
+    }
+}
+
+stats::NamedStats PafWriter::sample_stats() const {
+    auto stats = stats::from_obj(m_work_queue);
+    stats["reads_written"] = m_num_reads_written;
+    stats["lines_written"] = m_num_lines_written;
+    return stats;
+}
+
+void PafWriter::register_counters(stats::CounterRegistry& registry) const {
+    // Each read is written once, so the progress bar can follow it as it does HtsWriter's.
+    registry.add(get_name() + ".unique_simplex_reads_written", m_num_reads_written);
+}
+
+}  // namespace dorado
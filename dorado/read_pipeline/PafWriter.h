@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace dorado {
+
+// Writes the PafLines messages made by an Aligner with PAF output to a file, or to stdout
+// for "-".  Other messages are dropped.
+class PafWriter : public MessageSink {
+public:
+    explicit PafWriter(const std::string& filename);
+    ~PafWriter();
+    std::string get_name() const override { return "PafWriter"; }
+    stats::NamedStats sample_stats() const override;
+    void register_counters(stats::CounterRegistry& registry) const override;
+    void join() override;
+
+    // Alignments and reads written, as with HtsWriter once it has been joined.
+    size_t total{0};
+    size_t unmapped{0};
+
+private:
+    void worker_thread();
+
+    FILE* m_file{nullptr};
+    bool m_close_file{false};
+    std::atomic<int64_t> m_num_reads_written{0};
+    std::atomic<int64_t> m_num_lines_written{0};
+    std::unique_ptr<std::thread> m_worker;
+};
+
+}  // namespace dorado
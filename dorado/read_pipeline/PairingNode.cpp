@@ -1,82 +1,110 @@
 #include "PairingNode.h"
-namespace {
-bool is_within_time_and_length_criteria(const std::shared_ptr<dorado::Read>& read1,
-                                        const std::shared_ptr<dorado::Read>& read2) {
-    int max_time_delta_ms = 5000;
-    float min_seq_len_ratio = 0.95f;
+
+#include "utils/sequence_utils.h"
+#include "utils/uuid_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace dorado {
+
+bool PairingNode::is_candidate_pair(const std::shared_ptr<Read>& read1,
+                                    const std::shared_ptr<Read>& read2) {
     int delta = read2->start_time_ms - read1->get_end_time_ms();
     int seq_len1 = read1->seq.length();
     int seq_len2 = read2->seq.length();
     float len_ratio = static_cast<float>(std::min(seq_len1, seq_len2)) /
                       static_cast<float>(std::max(seq_len1, seq_len2));
-    return (delta >= 0) && (delta < max_time_delta_ms) && (len_ratio >= min_seq_len_ratio);
-}
-}  // namespace
+    if ((delta < 0) || (delta >= m_pairing_params.max_time_delta_ms) ||
+        (len_ratio < m_pairing_params.min_seq_len_ratio)) {
+        return false;
+    }
 
-namespace dorado {
+    if (m_pairing_params.min_shared_minimizer_frac > 0.f &&
+        utils::shared_minimizer_fraction(read1->seq, utils::reverse_complement(read2->seq),
+                                         m_pairing_params.minimizer_kmer_size,
+                                         m_pairing_params.minimizer_window_size) <
+                m_pairing_params.min_shared_minimizer_frac) {
+        ++m_num_minimizer_rejected_pairs;
+        return false;
+    }
+    return true;
+}
 
 void PairingNode::pair_list_worker_thread() {
     Message message;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
 
-        bool read_is_template = false;
-        bool partner_found = false;
-        std::string partner_id;
-
-        // Check if read is a template with corresponding complement
-        std::unique_lock<std::mutex> tc_lock(m_tc_map_mutex);
+        const auto read_id = utils::parse_read_id(read->read_id);
+        if (!read_id) {
+            continue;
+        }
 
-        auto it = m_template_complement_map.find(read->read_id);
-        if (it != m_template_complement_map.end()) {
-            partner_id = it->second;
-            tc_lock.unlock();
+        // The pair table isn't changed after construction, so can be read without locking.
+        bool read_is_template = false;
+        ReadID partner_id;
+        if (auto complement_id = m_pairs->complement_of(*read_id)) {
+            partner_id = *complement_id;
             read_is_template = true;
-            partner_found = true;
+        } else if (auto template_id = m_pairs->template_of(*read_id)) {
+            partner_id = *template_id;
         } else {
-            {
-                std::lock_guard<std::mutex> ct_lock(m_ct_map_mutex);
-                auto it = m_complement_template_map.find(read->read_id);
-                if (it != m_complement_template_map.end()) {
-                    partner_id = it->second;
-                    partner_found = true;
-                }
-            }
+            continue;
         }
 
-        if (partner_found) {
-            std::unique_lock<std::mutex> read_cache_lock(m_read_cache_mutex);
-            if (read_cache.find(partner_id) == read_cache.end()) {
+        // Both reads of a pair are cached in the shard of the template.
+        auto& shard = m_read_cache_shards[ReadIDHash()(read_is_template ? *read_id : partner_id) %
+                                          m_read_cache_shards.size()];
+        std::shared_ptr<Read> partner_read;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto partner_read_itr = shard.reads.find(partner_id);
+            if (partner_read_itr == shard.reads.end()) {
                 // Partner is not in the read cache
-                read_cache[read->read_id] = read;
-                read_cache_lock.unlock();
-            } else {
-                auto partner_read_itr = read_cache.find(partner_id);
-                auto partner_read = partner_read_itr->second;
-                read_cache.erase(partner_read_itr);
-                read_cache_lock.unlock();
-
-                std::shared_ptr<Read> template_read;
-                std::shared_ptr<Read> complement_read;
-
-                if (read_is_template) {
-                    template_read = read;
-                    complement_read = partner_read;
-                } else {
-                    complement_read = read;
-                    template_read = partner_read;
-                }
+                const int channel = read->attributes.channel_number;
+                auto& latest_start_ms = shard.channel_latest_start_ms[channel];
+                latest_start_ms = std::max(latest_start_ms, read->start_time_ms);
 
-                ReadPair read_pair;
-                read_pair.read_1 = template_read;
-                read_pair.read_2 = complement_read;
-
-                ++template_read->num_duplex_candidate_pairs;
+                // Drop reads from this channel whose partner is now too late to arrive.
+                // Unpaired reads aren't passed on in this mode.
+                auto& channel_reads = shard.channel_reads[channel];
+                while (!channel_reads.empty()) {
+                    const auto& oldest = channel_reads.front();
+                    auto oldest_itr = shard.reads.find(oldest.read_id);
+                    if (oldest_itr != shard.reads.end()) {
+                        if (oldest.end_time_ms + kCacheWindowMs >= latest_start_ms) {
+                            break;
+                        }
+                        m_cached_reads_bytes -= oldest_itr->second->memory_bytes();
+                        shard.reads.erase(oldest_itr);
+                        --m_num_cached_reads;
+                        ++m_num_evicted_reads;
+                    }
+                    channel_reads.pop_front();
+                }
 
-                m_sink.push_message(std::make_shared<ReadPair>(read_pair));
+                if (shard.reads.insert({*read_id, read}).second) {
+                    channel_reads.push_back({*read_id, read->get_end_time_ms()});
+                    ++m_num_cached_reads;
+                    m_cached_reads_bytes += read->memory_bytes();
+                }
+                continue;
             }
+            partner_read = std::move(partner_read_itr->second);
+            shard.reads.erase(partner_read_itr);
+            --m_num_cached_reads;
+            m_cached_reads_bytes -= partner_read->memory_bytes();
         }
+
+        ReadPair read_pair;
+        read_pair.read_1 = read_is_template ? read : partner_read;
+        read_pair.read_2 = read_is_template ? partner_read : read;
+        ++read_pair.read_1->num_duplex_candidate_pairs;
+        m_sink.push_message(std::make_shared<ReadPair>(read_pair));
     }
     if (--m_num_worker_threads == 0) {
         m_sink.terminate();
@@ -84,10 +112,17 @@ void PairingNode::pair_list_worker_thread() {
 }
 
 void PairingNode::pair_generating_worker_thread() {
+    auto compare_reads_by_time = [](const std::shared_ptr<Read>& read1,
+                                    const std::shared_ptr<Read>& read2) {
+        return read1->attributes.start_time < read2->attributes.start_time;
+    };
+
     Message message;
+    // Pairs found and reads evicted, which are pushed once the shard is unlocked.
+    std::vector<Message> output;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
 
         int channel = read->attributes.channel_number;
         int mux = read->attributes.mux;
@@ -95,96 +130,118 @@ void PairingNode::pair_generating_worker_thread() {
         std::string flowcell_id = read->flowcell_id;
         int32_t client_id = read->client_id;
 
-        int max_num_keys = 10;
-        std::unique_lock<std::mutex> lock(m_pairing_mtx);
-        UniquePoreIdentifierKey key = std::make_tuple(channel, mux, run_id, flowcell_id, client_id);
-        auto found = channel_mux_read_map.find(key);
-        // Check if the key is already in the list
-        if (found == channel_mux_read_map.end()) {
-            // Key is not in the dequeue
+        // Reads can only pair with reads from the same pore, so each channel's state is kept
+        // in one shard and reads from different channels are paired in parallel.
+        auto& shard = m_pore_shards[static_cast<size_t>(channel) % m_pore_shards.size()];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            UniquePoreIdentifierKey key =
+                    std::make_tuple(channel, mux, run_id, flowcell_id, client_id);
+            auto found = shard.channel_mux_read_map.find(key);
+            // Check if the key is already in the list
+            if (found == shard.channel_mux_read_map.end()) {
+                // Key is not in the dequeue
 
-            if (m_working_channel_mux_keys.size() >= max_num_keys) {
-                // Remove the oldest key (front of the list)
-                auto oldest_key = m_working_channel_mux_keys.front();
-                m_working_channel_mux_keys.pop_front();
+                if (shard.working_channel_mux_keys.size() >= kMaxNumKeysPerShard) {
+                    // Remove the oldest key (front of the list)
+                    auto oldest_key = shard.working_channel_mux_keys.front();
+                    shard.working_channel_mux_keys.pop_front();
 
-                auto oldest_key_it = channel_mux_read_map.find(oldest_key);
+                    auto oldest_key_it = shard.channel_mux_read_map.find(oldest_key);
 
-                // Remove the oldest key from the map
-                for (auto read_ptr : oldest_key_it->second) {
-                    m_sink.push_message(read_ptr);
+                    // Remove the oldest key from the map
+                    m_num_cached_reads -= static_cast<int64_t>(oldest_key_it->second.size());
+                    for (auto& read_ptr : oldest_key_it->second) {
+                        m_cached_reads_bytes -= read_ptr->memory_bytes();
+                        output.push_back(std::move(read_ptr));
+                    }
+                    shard.channel_mux_read_map.erase(oldest_key_it);
+                    assert(shard.channel_mux_read_map.size() ==
+                           shard.working_channel_mux_keys.size());
                 }
-                channel_mux_read_map.erase(oldest_key);
-                assert(channel_mux_read_map.size() == m_working_channel_mux_keys.size());
-            }
-            // Add the new key to the end of the list
-            m_working_channel_mux_keys.push_back(key);
-        }
-
-        auto compare_reads_by_time = [](const std::shared_ptr<Read>& read1,
-                                        const std::shared_ptr<Read>& read2) {
-            return read1->attributes.start_time < read2->attributes.start_time;
-        };
-
-        if (channel_mux_read_map.count(key)) {
-            auto later_read =
-                    std::lower_bound(channel_mux_read_map[key].begin(),
-                                     channel_mux_read_map[key].end(), read, compare_reads_by_time);
+                // Add the new key to the end of the list
+                shard.working_channel_mux_keys.push_back(key);
+                shard.channel_mux_read_map[key].push_back(read);
+                ++m_num_cached_reads;
+                m_cached_reads_bytes += read->memory_bytes();
+            } else {
+                auto& reads = found->second;
+                auto later_read =
+                        std::lower_bound(reads.begin(), reads.end(), read, compare_reads_by_time);
 
-            if (later_read != channel_mux_read_map[key].begin()) {
-                auto earlier_read = std::prev(later_read);
+                if (later_read != reads.begin()) {
+                    auto earlier_read = std::prev(later_read);
 
-                if (is_within_time_and_length_criteria(*earlier_read, read)) {
-                    ReadPair pair = {*earlier_read, read};
-                    ++(*earlier_read)->num_duplex_candidate_pairs;
-                    m_sink.push_message(std::make_shared<ReadPair>(pair));
+                    if (is_candidate_pair(*earlier_read, read)) {
+                        ReadPair pair = {*earlier_read, read};
+                        ++(*earlier_read)->num_duplex_candidate_pairs;
+                        output.push_back(std::make_shared<ReadPair>(pair));
+                    }
                 }
-            }
 
-            if (later_read != channel_mux_read_map[key].end()) {
-                if (is_within_time_and_length_criteria(read, *later_read)) {
-                    ReadPair pair = {read, *later_read};
-                    ++read->num_duplex_candidate_pairs;
-                    m_sink.push_message(std::make_shared<ReadPair>(pair));
+                if (later_read != reads.end()) {
+                    if (is_candidate_pair(read, *later_read)) {
+                        ReadPair pair = {read, *later_read};
+                        ++read->num_duplex_candidate_pairs;
+                        output.push_back(std::make_shared<ReadPair>(pair));
+                    }
                 }
-            }
 
-            channel_mux_read_map[key].insert(later_read, read);
+                reads.insert(later_read, read);
+                ++m_num_cached_reads;
+                m_cached_reads_bytes += read->memory_bytes();
 
-        } else {
-            channel_mux_read_map[key].push_back(read);
+                // Pass on reads which ended too long before the pore's latest read to pair with
+                // any read still to come.
+                const uint64_t latest_start_ms = reads.back()->start_time_ms;
+                while (reads.size() > 1 &&
+                       reads.front()->get_end_time_ms() + kCacheWindowMs < latest_start_ms) {
+                    m_cached_reads_bytes -= reads.front()->memory_bytes();
+                    output.push_back(std::move(reads.front()));
+                    reads.pop_front();
+                    --m_num_cached_reads;
+                    ++m_num_evicted_reads;
+                }
+            }
+        }
+        if (!output.empty()) {
+            m_sink.push_messages(std::move(output));
+            output.clear();
         }
     }
     if (--m_num_worker_threads == 0) {
-        std::unique_lock<std::mutex> lock(m_pairing_mtx);
-        // There are still reads in channel_mux_read_map. Push them to the sink.
+        // There are still reads in the shards. Push them to the sink.
         // Last thread alive is responsible for cleaning up the cache.
-        for (const auto& kv : channel_mux_read_map) {
-            // kv is a std::pair<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>>
-            const auto& reads_list = kv.second;
-
-            for (const auto& read_ptr : reads_list) {
-                // Push each read message
-                m_sink.push_message(read_ptr);
+        for (auto& shard : m_pore_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto& kv : shard.channel_mux_read_map) {
+                // kv is a std::pair<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>>
+                for (auto& read_ptr : kv.second) {
+                    // Push each read message
+                    m_sink.push_message(std::move(read_ptr));
+                }
             }
+            shard.channel_mux_read_map.clear();
+            shard.working_channel_mux_keys.clear();
         }
+        m_num_cached_reads = 0;
+        m_cached_reads_bytes = 0;
 
         m_sink.terminate();
     }
 }
 
 PairingNode::PairingNode(MessageSink& sink,
-                         std::optional<std::map<std::string, std::string>> template_complement_map,
+                         std::shared_ptr<const utils::PairTable> pairs,
                          int num_worker_threads,
-                         size_t max_reads)
-        : MessageSink(max_reads), m_sink(sink), m_num_worker_threads(num_worker_threads) {
-    if (template_complement_map.has_value()) {
-        m_template_complement_map = template_complement_map.value();
-        // Set up the complement-template_map
-        for (auto& key : m_template_complement_map) {
-            m_complement_template_map[key.second] = key.first;
-        }
-
+                         size_t max_reads,
+                         DuplexPairingParameters pairing_params)
+        : MessageSink(max_reads),
+          m_sink(sink),
+          m_pairs(std::move(pairs)),
+          m_num_worker_threads(num_worker_threads),
+          m_pairing_params(pairing_params) {
+    if (m_pairs) {
         for (size_t i = 0; i < m_num_worker_threads; i++) {
             m_workers.push_back(std::make_unique<std::thread>(
                     std::thread(&PairingNode::pair_list_worker_thread, this)));
@@ -199,13 +256,23 @@ PairingNode::PairingNode(MessageSink& sink,
 
 PairingNode::~PairingNode() {
     terminate();
+    join();
+}
+
+void PairingNode::join() {
     for (auto& m : m_workers) {
-        m->join();
+        if (m->joinable()) {
+            m->join();
+        }
     }
 }
 
 stats::NamedStats PairingNode::sample_stats() const {
     stats::NamedStats stats = m_work_queue.sample_stats();
+    stats["cached_reads"] = m_num_cached_reads.load();
+    stats["cached_reads_bytes"] = m_cached_reads_bytes.load();
+    stats["evicted_reads"] = m_num_evicted_reads.load();
+    stats["minimizer_rejected_pairs"] = m_num_minimizer_rejected_pairs.load();
     return stats;
 }
 
@@ -1,11 +1,16 @@
 #pragma once
 
 #include "ReadPipeline.h"
+#include "utils/PairTable.h"
+#include "utils/ReadIDMap.h"
 #include "utils/stats.h"
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -14,19 +19,41 @@
 
 namespace dorado {
 
+// Criteria which consecutive reads from a pore must meet to be passed on as a duplex candidate
+// pair, when pairs are generated rather than taken from a pairs list.
+struct DuplexPairingParameters {
+    // The complement must start within this long of the end of the template.
+    int max_time_delta_ms = 5000;
+    // Minimum ratio of the shorter read's length to the longer read's.
+    float min_seq_len_ratio = 0.95f;
+    // Minimum fraction of minimizers the template shares with the reverse complement of the
+    // complement.  This cheaply rejects reads from different molecules before they reach the
+    // stereo model.  0 disables the check.
+    float min_shared_minimizer_frac = 0.02f;
+    int minimizer_kmer_size = 15;
+    int minimizer_window_size = 10;
+};
+
+// Pairs reads from the pairs list if one is given, and otherwise generates candidate pairs from
+// consecutive reads of each pore.
 class PairingNode : public MessageSink {
 public:
     PairingNode(MessageSink& sink,
-                std::optional<std::map<std::string, std::string>> = std::nullopt,
+                std::shared_ptr<const utils::PairTable> pairs = nullptr,
                 int num_worker_threads = 2,
-                size_t max_reads = 1000);
+                size_t max_reads = 1000,
+                DuplexPairingParameters pairing_params = {});
     ~PairingNode();
+    void join() override;
     std::string get_name() const override { return "PairingNode"; }
     stats::NamedStats sample_stats() const override;
 
 private:
     void pair_list_worker_thread();
     void pair_generating_worker_thread();
+    // Whether read2 could be the complement of read1, which precedes it on the same pore.
+    bool is_candidate_pair(const std::shared_ptr<Read>& read1,
+                           const std::shared_ptr<Read>& read2);
 
     // A key for a unique Pore, Duplex reads must have the same UniquePoreIdentifierKey
     // The values are channel, mux, run_id, flowcell_id, client_id
@@ -34,22 +61,55 @@ private:
 
     std::vector<std::unique_ptr<std::thread>> m_workers;
     MessageSink& m_sink;
-    std::map<std::string, std::string> m_template_complement_map;
-    std::map<std::string, std::string> m_complement_template_map;
-
-    std::mutex m_tc_map_mutex;
-    std::mutex m_ct_map_mutex;
-    std::mutex m_read_cache_mutex;
+    // Pairs from the pairs list, which may be shared with other nodes.
+    std::shared_ptr<const utils::PairTable> m_pairs;
 
     std::atomic<int> m_num_worker_threads;
+    const DuplexPairingParameters m_pairing_params;
+
+    // Pairing state is split into shards, each with its own lock, so that worker threads only
+    // contend when they handle reads from the same shard.
+    static constexpr size_t kNumShards = 64;
+
+    // Reads are only kept while a partner could still arrive, i.e. until a read from the same
+    // channel starts this long after they end.  This is well beyond the pairing window, since
+    // reads reach the node out of order once they have been basecalled.
+    static constexpr uint64_t kCacheWindowMs = 5 * 60 * 1000;
 
-    std::map<std::string, std::shared_ptr<Read>> read_cache;
+    // A cached read, in the order its channel's reads arrived.
+    struct CachedReadEntry {
+        ReadID read_id;
+        uint64_t end_time_ms;
+    };
 
-    std::map<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>> channel_mux_read_map;
+    // Reads from the pairs list waiting for their partner, sharded by template read ID.
+    struct ReadCacheShard {
+        std::mutex mutex;
+        ReadIDMap<std::shared_ptr<Read>> reads;
+        // Cached reads of each channel in arrival order, including reads which have since been
+        // paired and are skipped when they reach the front.
+        std::map<int, std::deque<CachedReadEntry>> channel_reads;
+        // Latest start time of a read from each channel.
+        std::map<int, uint64_t> channel_latest_start_ms;
+    };
+    std::array<ReadCacheShard, kNumShards> m_read_cache_shards;
 
-    std::deque<UniquePoreIdentifierKey> m_working_channel_mux_keys;
+    // Recent reads from each pore, sharded by channel.  Each shard keeps the reads of its most
+    // recently seen pores, and passes on the reads of older ones, as well as reads which are
+    // outside kCacheWindowMs of the pore's latest read.
+    static constexpr size_t kMaxNumKeysPerShard = 10;
+    struct PoreShard {
+        std::mutex mutex;
+        std::map<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>> channel_mux_read_map;
+        std::deque<UniquePoreIdentifierKey> working_channel_mux_keys;
+    };
+    std::array<PoreShard, kNumShards> m_pore_shards;
 
-    std::mutex m_pairing_mtx;
+    // Performance monitoring stats.
+    std::atomic<int64_t> m_num_cached_reads{0};
+    std::atomic<int64_t> m_cached_reads_bytes{0};
+    std::atomic<int64_t> m_num_evicted_reads{0};
+    std::atomic<int64_t> m_num_minimizer_rejected_pairs{0};
 };
 
 }  // namespace dorado
@@ -0,0 +1,123 @@
+#include "Pipeline.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace dorado {
+
+// Stands in for a node with several producers, one FanInSink per producer.  Messages are
+// forwarded straight to the node, and the node is only terminated once every producer
+// has terminated its FanInSink.
+class Pipeline::FanInSink : public MessageSink {
+public:
+    FanInSink(MessageSink& sink, std::shared_ptr<std::atomic<int>> num_active_producers)
+            : MessageSink(1),
+              m_sink(sink),
+              m_num_active_producers(std::move(num_active_producers)) {}
+
+    void push_message(Message&& message) override { m_sink.push_message(std::move(message)); }
+    void push_messages(std::vector<Message>&& messages) override {
+        m_sink.push_messages(std::move(messages));
+    }
+    void terminate() override {
+        // Producers commonly terminate their sink more than once, so only count the first.
+        if (!m_terminated.exchange(true) && --(*m_num_active_producers) == 0) {
+            m_sink.terminate();
+        }
+    }
+
+private:
+    MessageSink& m_sink;
+    std::shared_ptr<std::atomic<int>> m_num_active_producers;
+    std::atomic<bool> m_terminated{false};
+};
+
+std::unique_ptr<Pipeline> Pipeline::create(PipelineDescriptor&& descriptor) {
+    auto& node_descriptors = descriptor.m_nodes;
+    std::unique_ptr<Pipeline> pipeline(new Pipeline());
+
+    // Count the producers feeding each node.
+    std::vector<int> num_producers(node_descriptors.size(), 0);
+    for (const auto& node_descriptor : node_descriptors) {
+        for (auto sink : node_descriptor.sinks) {
+            ++num_producers[sink];
+        }
+    }
+    std::vector<std::shared_ptr<std::atomic<int>>> active_producers(node_descriptors.size());
+    for (size_t i = 0; i < node_descriptors.size(); ++i) {
+        if (num_producers[i] == 0) {
+            pipeline->m_input_nodes.push_back(i);
+        } else if (num_producers[i] > 1) {
+            active_producers[i] = std::make_shared<std::atomic<int>>(num_producers[i]);
+        }
+    }
+
+    // Sinks always precede the nodes that feed them, so constructing in order is safe.
+    for (auto& node_descriptor : node_descriptors) {
+        PipelineDescriptor::SinkList sinks;
+        for (auto sink : node_descriptor.sinks) {
+            auto& sink_node = *pipeline->m_nodes.at(sink);
+            if (active_producers[sink]) {
+                pipeline->m_fan_in_sinks.push_back(
+                        std::make_unique<FanInSink>(sink_node, active_producers[sink]));
+                sinks.emplace_back(*pipeline->m_fan_in_sinks.back());
+            } else {
+                sinks.emplace_back(sink_node);
+            }
+        }
+        pipeline->m_nodes.push_back(node_descriptor.factory(sinks));
+    }
+
+    // Most recently added inputs first, so they're terminated in source order.
+    std::reverse(pipeline->m_input_nodes.begin(), pipeline->m_input_nodes.end());
+    return pipeline;
+}
+
+void Pipeline::terminate() {
+    if (m_terminated) {
+        return;
+    }
+    m_terminated = true;
+
+    // Inputs are normally terminated by whatever was feeding them, but make sure.
+    for (auto handle : m_input_nodes) {
+        m_nodes[handle]->terminate();
+    }
+    // Every node is constructed after its sinks, so reverse construction order visits
+    // producers before consumers.  Each node terminates its sinks as it finishes.
+    for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it) {
+        (*it)->join();
+    }
+    spdlog::debug("> Pipeline terminated");
+}
+
+Pipeline::~Pipeline() {
+    terminate();
+    // Producers before consumers, as with hand-wired pipelines.
+    while (!m_nodes.empty()) {
+        m_nodes.pop_back();
+    }
+}
+
+std::vector<stats::StatsReporter> Pipeline::get_stats_reporters() const {
+    std::vector<stats::StatsReporter> reporters;
+    for (const auto& node : m_nodes) {
+        if (!node->get_name().empty()) {
+            reporters.push_back(stats::make_stats_reporter(*node));
+        }
+    }
+    return reporters;
+}
+
+void Pipeline::register_counters(stats::CounterRegistry& registry) const {
+    for (const auto& node : m_nodes) {
+        if (!node->get_name().empty()) {
+            node->register_counters(registry);
+        }
+    }
+}
+
+}  // namespace dorado
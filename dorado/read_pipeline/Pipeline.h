@@ -0,0 +1,140 @@
+#pragma once
+
+#include "MessageRouterNode.h"
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dorado {
+
+// Identifies a node within a PipelineDescriptor / Pipeline.
+using NodeHandle = size_t;
+
+/// Describes a directed acyclic graph of pipeline nodes, which Pipeline::create
+/// turns into running nodes.
+/// Nodes construct their sinks' references up front, so a node's sinks must have been
+/// added to the descriptor before the node itself -- i.e. nodes are added from the
+/// output end of the pipeline towards its inputs.
+class PipelineDescriptor {
+public:
+    using SinkList = std::vector<std::reference_wrapper<MessageSink>>;
+    // For handles of optional nodes which weren't added.
+    static constexpr NodeHandle InvalidNodeHandle = std::numeric_limits<NodeHandle>::max();
+
+    // Adds a node of type T.  If T is constructed as T(MessageSink& sink, args...) it must
+    // be given exactly one sink.  Otherwise, it is constructed as T(SinkList sinks, args...).
+    // Nodes with no sinks, such as NullNode, are constructed as T(args...).
+    // Arguments are stored until the pipeline is created, so pass std::ref() for
+    // anything that must be passed by reference.
+    template <class T, class... Args>
+    NodeHandle add_node(std::vector<NodeHandle> sinks, Args&&... args) {
+        check_sinks(sinks);
+        auto stored_args = std::make_shared<std::tuple<std::decay_t<Args>...>>(
+                std::forward<Args>(args)...);
+        NodeFactory factory = [stored_args](SinkList& sink_refs) -> std::unique_ptr<MessageSink> {
+            return std::apply(
+                    [&sink_refs](auto&... unpacked) -> std::unique_ptr<MessageSink> {
+                        if constexpr (std::is_constructible_v<T, MessageSink&,
+                                                              decltype(std::move(unpacked))...>) {
+                            if (sink_refs.size() != 1) {
+                                throw std::runtime_error("Node requires exactly one sink");
+                            }
+                            return std::make_unique<T>(sink_refs.front().get(),
+                                                       std::move(unpacked)...);
+                        } else if constexpr (std::is_constructible_v<
+                                                     T, SinkList,
+                                                     decltype(std::move(unpacked))...>) {
+                            return std::make_unique<T>(sink_refs, std::move(unpacked)...);
+                        } else {
+                            if (!sink_refs.empty()) {
+                                throw std::runtime_error("Node takes no sinks");
+                            }
+                            return std::make_unique<T>(std::move(unpacked)...);
+                        }
+                    },
+                    *stored_args);
+        };
+        m_nodes.push_back({std::move(factory), std::move(sinks)});
+        return m_nodes.size() - 1;
+    }
+
+    // Adds a MessageRouterNode sending each message to the sink chosen by route.
+    NodeHandle add_router(std::vector<NodeHandle> sinks,
+                          MessageRouterNode::RouteFn route,
+                          std::string node_name = "MessageRouterNode") {
+        return add_node<MessageRouterNode>(std::move(sinks), std::move(route),
+                                           std::move(node_name));
+    }
+
+private:
+    friend class Pipeline;
+
+    using NodeFactory = std::function<std::unique_ptr<MessageSink>(SinkList&)>;
+    struct NodeDescriptor {
+        NodeFactory factory;
+        std::vector<NodeHandle> sinks;
+    };
+
+    void check_sinks(const std::vector<NodeHandle>& sinks) const {
+        for (auto sink : sinks) {
+            if (sink >= m_nodes.size()) {
+                throw std::runtime_error("Pipeline node sinks must be added before the node");
+            }
+        }
+    }
+
+    std::vector<NodeDescriptor> m_nodes;
+};
+
+/// Owns running pipeline nodes built from a PipelineDescriptor, and handles the
+/// ordering of their shutdown.
+/// Nodes with more than one producer are fed through per-producer proxies, so the
+/// node is only terminated once all of its producers have terminated it.
+class Pipeline {
+public:
+    static std::unique_ptr<Pipeline> create(PipelineDescriptor&& descriptor);
+    // Terminates the pipeline if that hasn't been done already, then destroys the
+    // nodes, inputs first.
+    ~Pipeline();
+
+    // Returns the node with the given handle, e.g. to hand an input node to a DataLoader.
+    MessageSink& get_node(NodeHandle handle) { return *m_nodes.at(handle); }
+    template <class T>
+    T& get_node(NodeHandle handle) {
+        return dynamic_cast<T&>(get_node(handle));
+    }
+
+    // Terminates the pipeline's input nodes, then waits for each node to drain, inputs
+    // first.  Once this returns every message has reached the end of the pipeline and
+    // all node stats are final, though the nodes are still alive.
+    void terminate();
+
+    // Stats reporters for every named node, for use with StatsSampler.  The pipeline
+    // must outlive the sampler.
+    std::vector<stats::StatsReporter> get_stats_reporters() const;
+    // Adds every named node's counters to registry.  The pipeline must outlive its readers.
+    void register_counters(stats::CounterRegistry& registry) const;
+
+private:
+    class FanInSink;
+
+    Pipeline() = default;
+
+    // Nodes in construction order, which is sinks first.
+    std::vector<std::unique_ptr<MessageSink>> m_nodes;
+    // Handles of nodes no other node in the pipeline feeds.
+    std::vector<NodeHandle> m_input_nodes;
+    std::vector<std::unique_ptr<FanInSink>> m_fan_in_sinks;
+    bool m_terminated = false;
+};
+
+}  // namespace dorado
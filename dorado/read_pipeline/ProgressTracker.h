@@ -13,9 +13,12 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace dorado {
 
@@ -51,32 +54,90 @@ public:
                 spdlog::info("> Basecalled @ Samples/s: {}", samples_sec.str());
             }
         }
+        for (const auto& warning_source : m_warning_sources) {
+            for (const auto& warning : warning_source()) {
+                spdlog::warn("> {}", warning);
+            }
+        }
+    }
+
+    // Adds a source of warnings about the run, such as the GPUs being throttled, for
+    // summarize() to log.
+    void add_warning_source(std::function<std::vector<std::string>()> warning_source) {
+        m_warning_sources.push_back(std::move(warning_source));
+    }
+
+    // Logs the highest number of bytes each node held at once, sorted by node and stat.
+    void summarize_peak_memory(const stats::PeakTracker& peaks) const {
+        const auto peak_stats = peaks.peaks();
+        std::vector<std::pair<std::string, double>> sorted_peaks(peak_stats.begin(),
+                                                                 peak_stats.end());
+        std::sort(sorted_peaks.begin(), sorted_peaks.end());
+        double total_bytes = 0;
+        for (const auto& [name, bytes] : sorted_peaks) {
+            spdlog::info("> Peak {}: {:.1f} MB", name, bytes / 1e6);
+            total_bytes += bytes;
+        }
+        if (!sorted_peaks.empty()) {
+            spdlog::info("> Sum of peaks: {:.1f} MB", total_bytes / 1e6);
+        }
+    }
+
+    // Looks up the counters the progress bar reads, which must all have been registered.
+    void set_counters(const stats::CounterRegistry& counters) {
+        m_counters = &counters;
+        m_written_counters.clear();
+        m_filtered_counters.clear();
+        m_bases_counters.clear();
+        m_samples_counters.clear();
+        auto ends_with = [](const std::string& name, const std::string& suffix) {
+            return name.size() > suffix.size() &&
+                   name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        for (stats::CounterRegistry::Handle handle = 0; handle < counters.size(); ++handle) {
+            const auto& name = counters.name(handle);
+            // Summed over the writers of every shard of the output.
+            if (name.rfind("HtsWriter", 0) == 0 &&
+                ends_with(name, ".unique_simplex_reads_written")) {
+                m_written_counters.push_back(handle);
+            } else if (name == "ReadFilterNode.reads_filtered" ||
+                       name == "SignalFilterNode.reads_filtered") {
+                m_filtered_counters.push_back(handle);
+            } else if (name == "BasecallerNode.bases_processed" ||
+                       (m_duplex && name == "StereoBasecallerNode.bases_processed")) {
+                m_bases_counters.push_back(handle);
+            } else if (name == "BasecallerNode.samples_processed" ||
+                       (m_duplex && name == "StereoBasecallerNode.samples_processed")) {
+                m_samples_counters.push_back(handle);
+            }
+        }
     }
 
-    void update_progress_bar(const stats::NamedStats& stats) {
+    // Reads the counters passed to set_counters.  This is called on every stats sample, so
+    // only loads the registered counters rather than sampling every node's stats.
+    void update_progress_bar() {
         // Instead of capturing end time when summarizer is called,
         // which suffers from delays due to sampler and pipeline termination
         // costs, store it whenever stats are updated.
         m_end_time = std::chrono::system_clock::now();
+        if (!m_counters) {
+            return;
+        }
 
-        auto fetch_stat = [&stats](const std::string& name) {
-            auto res = stats.find(name);
-            if (res != stats.end()) {
-                return res->second;
+        auto sum = [this](const std::vector<stats::CounterRegistry::Handle>& handles) {
+            double total = 0;
+            for (const auto handle : handles) {
+                total += m_counters->value(handle);
             }
-            return 0.;
+            return total;
         };
 
-        m_num_reads_written = fetch_stat("HtsWriter.unique_simplex_reads_written");
+        m_num_reads_written = sum(m_written_counters);
 
         if (m_num_reads_expected != 0) {
-            m_num_reads_filtered = fetch_stat("ReadFilterNode.reads_filtered");
-            m_num_bases_processed = fetch_stat("BasecallerNode.bases_processed");
-            m_num_samples_processed = fetch_stat("BasecallerNode.samples_processed");
-            if (m_duplex) {
-                m_num_bases_processed += fetch_stat("StereoBasecallerNode.bases_processed");
-                m_num_samples_processed += fetch_stat("StereoBasecallerNode.samples_processed");
-            }
+            m_num_reads_filtered = sum(m_filtered_counters);
+            m_num_bases_processed = sum(m_bases_counters);
+            m_num_samples_processed = sum(m_samples_counters);
 
             // don't output progress bar if stderr is not a tty
             if (!utils::is_fd_tty(stderr)) {
@@ -120,6 +181,14 @@ private:
 
     bool m_duplex;
 
+    const stats::CounterRegistry* m_counters = nullptr;
+    std::vector<stats::CounterRegistry::Handle> m_written_counters;
+    std::vector<stats::CounterRegistry::Handle> m_filtered_counters;
+    std::vector<stats::CounterRegistry::Handle> m_bases_counters;
+    std::vector<stats::CounterRegistry::Handle> m_samples_counters;
+
+    std::vector<std::function<std::vector<std::string>()>> m_warning_sources;
+
 #ifdef WIN32
     indicators::ProgressBar m_progress_bar {
 #else
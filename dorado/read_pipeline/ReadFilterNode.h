@@ -7,7 +7,6 @@
 #include <cstdint>
 #include <memory>
 #include <string>
-#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -22,22 +21,23 @@ public:
                    size_t min_qscore,
                    size_t min_read_length,
                    const std::unordered_set<std::string>& read_ids_to_filter,
-                   size_t num_worker_threads);
+                   size_t num_worker_threads,
+                   std::string node_name = "ReadFilterNode");
     ~ReadFilterNode();
-    std::string get_name() const override { return "ReadFilterNode"; }
+    void join() override;
+    std::string get_name() const override { return m_node_name; }
     stats::NamedStats sample_stats() const override;
+    void register_counters(stats::CounterRegistry& registry) const override;
 
 private:
     MessageSink& m_sink;
-    void worker_thread();
-
-    // Async worker for writing.
-    std::vector<std::unique_ptr<std::thread>> m_workers;
-    std::atomic<size_t> m_active_threads;
+    // Filters a read, on the shared CPU thread pool.
+    void process_message(Message&& message);
 
     size_t m_min_qscore;
     size_t m_min_read_length;
     std::unordered_set<std::string> m_read_ids_to_filter;
+    std::string m_node_name;
     std::atomic<int64_t> m_num_reads_filtered;
 };
 
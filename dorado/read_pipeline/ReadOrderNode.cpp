@@ -0,0 +1,188 @@
+#include "ReadOrderNode.h"
+
+#include "htslib/sam.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace dorado {
+
+// The reads which have been issued tickets but not yet written, which are shared with the
+// tickets since those can outlive the node.
+class ReadOrderState {
+public:
+    ReadOrderState(MessageSink& sink, size_t window) : m_sink(sink), m_window(window) {}
+
+    // Waits until there is room in the window, and returns the next order, or 0, for which
+    // nothing is held back, once the reads have been flushed.
+    uint64_t issue() {
+        std::unique_lock lock(m_mutex);
+        m_window_cv.wait(lock, [this] { return m_pending.size() < m_window || m_flushed; });
+        if (m_flushed) {
+            return 0;
+        }
+        m_pending.emplace_back();
+        return m_next + m_pending.size() - 1;
+    }
+
+    // Holds record until it can be written, unless it isn't one with an order issued, in
+    // which case it is left for the caller and false returned.
+    bool try_add(BamPtr& record) {
+        std::lock_guard lock(m_mutex);
+        const uint64_t order = record->id;
+        if (order < m_next || order - m_next >= m_pending.size()) {
+            return false;
+        }
+        m_pending[order - m_next].records.push_back(std::move(record));
+        release_ready();
+        return true;
+    }
+
+    void finish(uint64_t order, size_t num_records) {
+        std::lock_guard lock(m_mutex);
+        if (order < m_next || order - m_next >= m_pending.size()) {
+            return;
+        }
+        auto& read = m_pending[order - m_next];
+        read.finished = true;
+        read.num_records = num_records;
+        release_ready();
+    }
+
+    // Writes whatever is still held, in order, once no more records can arrive.
+    void flush() {
+        std::lock_guard lock(m_mutex);
+        size_t num_unfinished = 0;
+        for (auto& read : m_pending) {
+            if (!read.finished || read.records.size() < read.num_records) {
+                ++num_unfinished;
+            }
+            for (auto& record : read.records) {
+                m_sink.push_message(std::move(record));
+            }
+        }
+        if (num_unfinished > 0) {
+            spdlog::warn("{} reads were not finished before their records were written",
+                         num_unfinished);
+        }
+        m_next += m_pending.size();
+        m_pending.clear();
+        m_flushed = true;
+        m_window_cv.notify_all();
+    }
+
+    stats::NamedStats sample_stats() const {
+        std::lock_guard lock(m_mutex);
+        stats::NamedStats stats;
+        stats["reads_written"] = static_cast<double>(m_next - 1);
+        stats["reads_pending"] = static_cast<double>(m_pending.size());
+        return stats;
+    }
+
+private:
+    struct PendingRead {
+        bool finished = false;
+        size_t num_records = 0;
+        std::vector<BamPtr> records;
+    };
+
+    // Writes the records of the reads at the front which are finished and all arrived.
+    void release_ready() {
+        bool released = false;
+        while (!m_pending.empty() && m_pending.front().finished &&
+               m_pending.front().records.size() >= m_pending.front().num_records) {
+            for (auto& record : m_pending.front().records) {
+                m_sink.push_message(std::move(record));
+            }
+            m_pending.pop_front();
+            ++m_next;
+            released = true;
+        }
+        if (released) {
+            m_window_cv.notify_all();
+        }
+    }
+
+    MessageSink& m_sink;
+    const size_t m_window;
+    // Held while pushing, so records are pushed in order whichever thread releases them.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_window_cv;
+    // Reads m_next onwards, in order.
+    std::deque<PendingRead> m_pending;
+    // Orders start at 1 since records not converted from a read with a ticket have an id of 0.
+    uint64_t m_next = 1;
+    bool m_flushed = false;
+};
+
+ReadOrderTicket::ReadOrderTicket(std::shared_ptr<ReadOrderState> state, uint64_t order)
+        : m_state(std::move(state)), m_order(order) {}
+
+ReadOrderTicket::~ReadOrderTicket() { finish(0); }
+
+void ReadOrderTicket::finish(std::vector<BamPtr>& records) {
+    for (auto& record : records) {
+        record->id = m_order;
+    }
+    finish(records.size());
+}
+
+void ReadOrderTicket::finish(size_t num_records) {
+    if (m_finished.exchange(true) || m_order == 0) {
+        return;
+    }
+    m_state->finish(m_order, num_records);
+}
+
+ReadOrderNode::ReadOrderNode(MessageSink& sink, size_t window, size_t max_messages)
+        : MessageSink(max_messages),
+          m_sink(sink),
+          m_state(std::make_shared<ReadOrderState>(sink, std::max(window, size_t(1)))) {
+    m_worker = std::make_unique<std::thread>(&ReadOrderNode::worker_thread, this);
+}
+
+ReadOrderNode::~ReadOrderNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+}
+
+void ReadOrderNode::join() {
+    if (m_worker && m_worker->joinable()) {
+        m_worker->join();
+    }
+}
+
+std::shared_ptr<ReadOrderTicket> ReadOrderNode::issue_ticket() {
+    return std::make_shared<ReadOrderTicket>(m_state, m_state->issue());
+}
+
+void ReadOrderNode::worker_thread() {
+    Message message;
+    while (m_work_queue.try_pop(message)) {
+        if (std::holds_alternative<BamPtr>(message)) {
+            auto& record = std::get<BamPtr>(message);
+            if (m_state->try_add(record)) {
+                continue;
+            }
+        }
+        m_sink.push_message(std::move(message));
+    }
+    // Nothing more is coming, so nothing more would be released.
+    m_state->flush();
+    m_sink.terminate();
+}
+
+stats::NamedStats ReadOrderNode::sample_stats() const {
+    auto stats = stats::from_obj(m_work_queue);
+    for (const auto& [name, value] : m_state->sample_stats()) {
+        stats[name] = value;
+    }
+    return stats;
+}
+
+}  // namespace dorado
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+class ReadOrderState;
+
+// Issued by ReadOrderNode for each read as it is loaded, and carried by the read as
+// Read::order_ticket.  Whichever node converts the read to records hands them to finish();
+// a read which is dropped instead is finished, with no records, when its ticket is destroyed.
+class ReadOrderTicket {
+public:
+    ReadOrderTicket(std::shared_ptr<ReadOrderState> state, uint64_t order);
+    ~ReadOrderTicket();
+    ReadOrderTicket(const ReadOrderTicket&) = delete;
+    ReadOrderTicket& operator=(const ReadOrderTicket&) = delete;
+
+    // Marks records as the read's output, all of which must then be pushed on towards the
+    // ReadOrderNode.  Only the first call counts.
+    void finish(std::vector<BamPtr>& records);
+
+    // The read's place in the load order, which is 0 once the reads have been flushed.
+    uint64_t order() const { return m_order; }
+
+private:
+    void finish(size_t num_records);
+
+    std::shared_ptr<ReadOrderState> m_state;
+    uint64_t m_order;
+    std::atomic<bool> m_finished{false};
+};
+
+// Writes records out in the order their reads were loaded, so that the output is the same
+// from run to run however the nodes before it interleave their reads, without sorting it.
+// Records are held back until those of every earlier read have been written, and the
+// loader waits to issue a ticket while window reads are loaded ahead of the oldest read
+// which hasn't been written, which bounds how many are held.  Records not converted from a
+// read with a ticket, such as those of a resumed run, go straight through.
+class ReadOrderNode : public MessageSink {
+public:
+    ReadOrderNode(MessageSink& sink, size_t window, size_t max_messages = 1000);
+    ~ReadOrderNode();
+    std::string get_name() const override { return "ReadOrderNode"; }
+    stats::NamedStats sample_stats() const override;
+    void join() override;
+
+    // The ticket for the next read loaded, waiting until it is within the window.
+    std::shared_ptr<ReadOrderTicket> issue_ticket();
+
+private:
+    void worker_thread();
+
+    MessageSink& m_sink;
+    std::shared_ptr<ReadOrderState> m_state;
+    std::unique_ptr<std::thread> m_worker;
+};
+
+}  // namespace dorado
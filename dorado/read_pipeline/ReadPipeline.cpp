@@ -1,14 +1,18 @@
 #include "ReadPipeline.h"
 
 #include "htslib/sam.h"
+#include "utils/MoveTable.h"
 #include "utils/base_mod_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/trace.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <thread>
 
 using namespace std::chrono_literals;
 
@@ -42,6 +46,30 @@ bool get_modbase_channel_name(std::string &channel_name, const std::string &mod_
     spdlog::error("Unknown modified base abbreviation: {}", mod_abbreviation);
     return false;
 }
+
+// Bytes taken in a record by an aux tag with a payload of payload_size bytes, which
+// follows the two character tag name and the type.
+constexpr size_t aux_tag_size(size_t payload_size) { return 3 + payload_size; }
+
+// Bytes taken by the payload of a B-array tag, which starts with the element type and count.
+constexpr size_t array_payload_size(size_t count) { return 1 + sizeof(uint32_t) + count; }
+
+// Appends a B-array tag of byte sized elements, whose payload has had array_payload_size(count)
+// bytes allocated with the elements already written after the header.  Appending directly
+// avoids the search of the existing tags done by bam_aux_update_array.
+void append_byte_array_tag(bam1_t *aln,
+                           const char tag[2],
+                           char type,
+                           std::vector<uint8_t> &payload) {
+    const uint32_t count = static_cast<uint32_t>(payload.size() - array_payload_size(0));
+    payload[0] = static_cast<uint8_t>(type);
+    // Counts are little endian in BAM.
+    for (int i = 0; i < 4; ++i) {
+        payload[1 + i] = static_cast<uint8_t>(count >> (8 * i));
+    }
+    bam_aux_append(aln, tag, 'B', payload.size(), payload.data());
+}
+
 }  // namespace
 
 namespace dorado {
@@ -53,14 +81,154 @@ std::string Read::generate_read_group() const {
     return "";
 }
 
-void Read::generate_read_tags(bam1_t *aln, bool emit_moves) const {
-    int qs = static_cast<int>(std::round(utils::mean_qscore_from_qstring(qstring)));
+void Read::release_raw_data() {
+    m_num_released_samples = get_num_raw_samples();
+    raw_data = torch::Tensor();
+}
+
+uint64_t Read::get_num_raw_samples() const {
+    return raw_data.defined() ? raw_data.size(0) : m_num_released_samples;
+}
+
+size_t Read::memory_bytes() const {
+    size_t bytes = sizeof(Read) + (raw_data.defined() ? raw_data.nbytes() : 0) + seq.size() +
+                   qstring.size() + moves.size() + base_mod_probs.size() +
+                   base_mod_positions.size() * sizeof(uint32_t);
+    for (const auto &chunk : called_chunks) {
+        if (chunk) {
+            bytes += sizeof(Chunk) + chunk->seq.size() + chunk->qstring.size() +
+                     chunk->moves.size();
+        }
+    }
+    return bytes;
+}
+
+void Read::trim_bases(size_t num_front, size_t num_rear) {
+    if (num_front + num_rear >= seq.size()) {
+        throw std::runtime_error("Cannot trim every base of read " + read_id);
+    }
+    const size_t num_bases = seq.size();
+    const size_t num_kept = num_bases - num_front - num_rear;
+    if (!base_mod_positions.empty()) {
+        const size_t probs_per_base = base_mod_probs.size() / base_mod_positions.size();
+        const auto first = std::lower_bound(base_mod_positions.begin(), base_mod_positions.end(),
+                                            uint32_t(num_front));
+        const auto last =
+                std::lower_bound(first, base_mod_positions.end(), uint32_t(num_front + num_kept));
+        const size_t first_row = size_t(first - base_mod_positions.begin());
+        const size_t last_row = size_t(last - base_mod_positions.begin());
+        base_mod_probs.erase(base_mod_probs.begin() + last_row * probs_per_base,
+                             base_mod_probs.end());
+        base_mod_probs.erase(base_mod_probs.begin(),
+                             base_mod_probs.begin() + first_row * probs_per_base);
+        base_mod_positions.erase(last, base_mod_positions.end());
+        base_mod_positions.erase(base_mod_positions.begin(),
+                                 base_mod_positions.begin() + first_row);
+        for (auto& pos : base_mod_positions) {
+            pos -= uint32_t(num_front);
+        }
+    }
+    if (!moves.empty()) {
+        // Moves from the one starting the first kept base up to the one starting the first base
+        // trimmed from the rear.
+        size_t front_move = 0;
+        size_t rear_move = moves.size();
+        size_t bases_started = 0;
+        for (size_t i = 0; i < moves.size(); ++i) {
+            if (!moves[i]) {
+                continue;
+            }
+            if (bases_started == num_front) {
+                front_move = i;
+            }
+            if (bases_started == num_front + num_kept) {
+                rear_move = i;
+                break;
+            }
+            ++bases_started;
+        }
+        moves.erase(moves.begin() + rear_move, moves.end());
+        moves.erase(moves.begin(), moves.begin() + front_move);
+
+        const uint64_t front_samples =
+                std::min<uint64_t>(front_move * model_stride, get_num_raw_samples());
+        if (raw_data.defined()) {
+            raw_data = raw_data.index({torch::indexing::Slice(int64_t(front_samples), {})});
+        } else {
+            m_num_released_samples -= front_samples;
+        }
+        num_trimmed_samples += front_samples;
+    }
+    seq = seq.substr(num_front, num_kept);
+    qstring = qstring.substr(num_front, num_kept);
+    m_mean_qscore.reset();
+    m_move_table.reset();
+}
+
+void Read::clear_basecall() {
+    seq.clear();
+    qstring.clear();
+    moves.clear();
+    m_mean_qscore.reset();
+    m_move_table.reset();
+}
+
+const utils::MoveTable &Read::move_table() const {
+    if (!m_move_table) {
+        m_move_table = std::make_shared<const utils::MoveTable>(moves);
+    }
+    return *m_move_table;
+}
+
+float Read::mean_qscore() const {
+    if (!m_mean_qscore) {
+        m_mean_qscore = utils::mean_qscore_from_qstring(qstring);
+    }
+    return *m_mean_qscore;
+}
+
+size_t Read::read_tags_size(bool emit_moves,
+                            bool pack_moves,
+                            const std::string &read_group) const {
+    // qs, du, ns, ts, mx, ch, rn, sm, sd and dx all have 4 byte values.
+    size_t size = 10 * aux_tag_size(4);
+    size += aux_tag_size(attributes.start_time.length() + 1);
+    size += aux_tag_size(attributes.fast5_filename.length() + 1);
+    size += aux_tag_size(sizeof("quantile"));
+    if (!read_group.empty()) {
+        size += aux_tag_size(read_group.length() + 1);
+    }
+    if (!barcode.empty()) {
+        size += aux_tag_size(barcode.length() + 1);
+    }
+    if (emit_moves && pack_moves) {
+        size += aux_tag_size(array_payload_size((moves.size() + 7) / 8 + 2));
+    } else if (emit_moves) {
+        size += aux_tag_size(array_payload_size(moves.size() + 1));
+    }
+    return size;
+}
+
+size_t Read::duplex_read_tags_size(const std::string &read_group) const {
+    // qs and dx have 4 byte values.
+    size_t size = 2 * aux_tag_size(4);
+    if (!read_group.empty()) {
+        size += aux_tag_size(read_group.length() + 1);
+    }
+    return size;
+}
+
+void Read::generate_read_tags(bam1_t *aln,
+                              bool emit_moves,
+                              bool pack_moves,
+                              const std::string &read_group) const {
+    int qs = static_cast<int>(std::round(mean_qscore()));
     bam_aux_append(aln, "qs", 'i', sizeof(qs), (uint8_t *)&qs);
 
-    float du = (float)(raw_data.size(0) + num_trimmed_samples) / (float)sample_rate;
+    float du = (float)(get_num_raw_samples() + num_trimmed_samples) / (float)sample_rate;
     bam_aux_append(aln, "du", 'f', sizeof(du), (uint8_t *)&du);
 
-    int ns = raw_data.size(0) + num_trimmed_samples;
+    int ns = get_num_raw_samples() + num_trimmed_samples;
     bam_aux_append(aln, "ns", 'i', sizeof(ns), (uint8_t *)&ns);
 
     int ts = num_trimmed_samples;
@@ -93,36 +261,47 @@ void Read::generate_read_tags(bam1_t *aln, bool emit_moves) const {
     uint32_t duplex = 0;
     bam_aux_append(aln, "dx", 'i', sizeof(duplex), (uint8_t *)&duplex);
 
-    auto rg = generate_read_group();
-    if (!rg.empty()) {
-        bam_aux_append(aln, "RG", 'Z', rg.length() + 1, (uint8_t *)rg.c_str());
+    if (!read_group.empty()) {
+        bam_aux_append(aln, "RG", 'Z', read_group.length() + 1, (uint8_t *)read_group.c_str());
     }
 
-    if (emit_moves) {
-        std::vector<uint8_t> m(moves.size() + 1, 0);
-        m[0] = model_stride;
-
-        for (size_t idx = 0; idx < moves.size(); idx++) {
-            m[idx + 1] = static_cast<uint8_t>(moves[idx]);
-        }
+    if (!barcode.empty()) {
+        bam_aux_append(aln, "BC", 'Z', barcode.length() + 1, (uint8_t *)barcode.c_str());
+    }
 
-        bam_aux_update_array(aln, "mv", 'c', m.size(), (uint8_t *)m.data());
+    if (emit_moves && pack_moves) {
+        const auto packed = utils::pack_move_bits(moves);
+        std::vector<uint8_t> m(array_payload_size(packed.size() + 2), 0);
+        auto *const values = &m[array_payload_size(0)];
+        values[0] = model_stride;
+        values[1] = static_cast<uint8_t>(packed.size() * 8 - moves.size());
+        std::copy(packed.begin(), packed.end(), values + 2);
+
+        append_byte_array_tag(aln, "mp", 'C', m);
+    } else if (emit_moves) {
+        std::vector<uint8_t> m(array_payload_size(moves.size() + 1), 0);
+        auto *const values = &m[array_payload_size(0)];
+        values[0] = model_stride;
+        std::copy(moves.begin(), moves.end(), values + 1);
+
+        append_byte_array_tag(aln, "mv", 'c', m);
     }
 }
 
-void Read::generate_duplex_read_tags(bam1_t *aln) const {
-    int qs = static_cast<int>(std::round(utils::mean_qscore_from_qstring(qstring)));
+void Read::generate_duplex_read_tags(bam1_t *aln, const std::string &read_group) const {
+    int qs = static_cast<int>(std::round(mean_qscore()));
     bam_aux_append(aln, "qs", 'i', sizeof(qs), (uint8_t *)&qs);
     uint32_t duplex = 1;
     bam_aux_append(aln, "dx", 'i', sizeof(duplex), (uint8_t *)&duplex);
 
-    auto rg = generate_read_group();
-    if (!rg.empty()) {
-        bam_aux_append(aln, "RG", 'Z', rg.length() + 1, (uint8_t *)rg.c_str());
+    if (!read_group.empty()) {
+        bam_aux_append(aln, "RG", 'Z', read_group.length() + 1, (uint8_t *)read_group.c_str());
     }
 }
 
-std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves, uint8_t modbase_threshold) const {
+std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves,
+                                            uint8_t modbase_threshold,
+                                            bool pack_moves) const {
     if (read_id.empty()) {
         throw std::runtime_error("Empty read_name string provided");
     }
@@ -150,15 +329,33 @@ std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves, uint8_t modbase_thr
         std::transform(qstring.begin(), qstring.end(), std::back_inserter(qscore),
                        [](char c) { return (uint8_t)(c)-33; });
 
+        // All of the aux tags are sized up front so that bam_set1 allocates the record once,
+        // rather than each bam_aux_append growing it in turn.
+        const auto read_group = generate_read_group();
+        std::string modbase_string;
+        std::vector<uint8_t> modbase_probs;
+        const bool has_modbase_tags =
+                generate_modbase_tags(modbase_string, modbase_probs, modbase_threshold);
+        size_t aux_size = is_duplex ? duplex_read_tags_size(read_group)
+                                    : read_tags_size(emit_moves, pack_moves, read_group);
+        if (has_modbase_tags) {
+            aux_size += aux_tag_size(modbase_string.length() + 1);
+            aux_size += aux_tag_size(modbase_probs.size());
+        }
+
         bam_set1(aln, read_id.length(), read_id.c_str(), flags, -1, leftmost_pos, map_q, 0, nullptr,
-                 -1, next_pos, 0, seq.length(), seq.c_str(), (char *)qscore.data(), 0);
+                 -1, next_pos, 0, seq.length(), seq.c_str(), (char *)qscore.data(), aux_size);
 
         if (is_duplex) {
-            generate_duplex_read_tags(aln);
+            generate_duplex_read_tags(aln, read_group);
         } else {
-            generate_read_tags(aln, emit_moves);
+            generate_read_tags(aln, emit_moves, pack_moves, read_group);
+        }
+        if (has_modbase_tags) {
+            bam_aux_append(aln, "MM", 'Z', modbase_string.length() + 1,
+                           (uint8_t *)modbase_string.c_str());
+            append_byte_array_tag(aln, "ML", 'C', modbase_probs);
         }
-        generate_modbase_string(aln, modbase_threshold);
         alns.push_back(BamPtr(aln));
     }
 
@@ -174,89 +371,278 @@ uint64_t Read::get_end_time_ms() {
            ((end_sample - start_sample) * 1000) / sample_rate;  //TODO get rid of the trimmed thing?
 }
 
-void Read::generate_modbase_string(bam1_t *aln, uint8_t threshold) const {
+bool Read::generate_modbase_tags(std::string &modbase_string,
+                                 std::vector<uint8_t> &modbase_prob,
+                                 uint8_t threshold) const {
     if (!base_mod_info) {
-        return;
+        return false;
     }
 
     const size_t num_channels = base_mod_info->alphabet.size();
     const std::string cardinal_bases = "ACGT";
-    char current_cardinal = 0;
-    if (seq.length() * num_channels != base_mod_probs.size()) {
+    if (base_mod_positions.size() * num_channels != base_mod_probs.size()) {
         throw std::runtime_error(
-                "Mismatch between base_mod_probs size and sequence length * num channels in "
-                "modbase_alphabet!");
+                "Mismatch between base_mod_probs size and the number of called bases * num "
+                "channels in modbase_alphabet!");
     }
 
     std::istringstream mod_name_stream(base_mod_info->long_names);
-    std::string modbase_string = "";
-    std::vector<uint8_t> modbase_prob;
+    modbase_string.clear();
+    // ML is written as a B-array, so leave room for its header ahead of the probabilities.
+    modbase_prob.assign(array_payload_size(0), 0);
 
-    // Create a mask indicating which bases are modified.
-    std::map<char, bool> base_has_context = {
-            {'A', false}, {'C', false}, {'G', false}, {'T', false}};
     utils::BaseModContext context_handler;
     if (!base_mod_info->context.empty()) {
         if (!context_handler.decode(base_mod_info->context)) {
             throw std::runtime_error("Invalid base modification context string.");
         }
-        for (auto base : cardinal_bases) {
-            if (context_handler.motif(base).size() > 1) {
-                // If the context is just the single base, then this is equivalent to no context.
-                base_has_context[base] = true;
-            }
-        }
     }
-    auto modbase_mask = context_handler.get_sequence_mask(seq);
-    context_handler.update_mask(modbase_mask, seq, base_mod_info->alphabet, base_mod_probs,
-                                threshold);
+    const auto context_positions = context_handler.get_context_positions(seq);
+
+    // A base written to the tags: the number of bases of the same kind skipped since the
+    // previous one, and its row of probabilities, or -1 if it wasn't called.
+    struct TagBase {
+        size_t skipped;
+        int64_t row;
+    };
+    std::vector<TagBase> tag_bases;
 
     // Iterate over the provided alphabet and find all the channels we need to write out
+    char current_cardinal = 0;
+    size_t cardinal_channel = 0;
+    bool has_context = false;
     for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++) {
         if (cardinal_bases.find(base_mod_info->alphabet[channel_idx]) != std::string::npos) {
             // A cardinal base
             current_cardinal = base_mod_info->alphabet[channel_idx];
-        } else {
-            // A modification on the previous cardinal base
-            std::string modbase_name;
-            mod_name_stream >> modbase_name;
-            std::string bam_name;
-            if (!get_modbase_channel_name(bam_name, modbase_name)) {
-                return;
-            }
+            cardinal_channel = channel_idx;
+            // The bases written are the same for each of its modifications, so are only found
+            // when the first modification is reached.
+            tag_bases.clear();
+            continue;
+        }
 
-            // Write out the results we found
-            modbase_string += std::string(1, current_cardinal) + "+" + bam_name;
-            modbase_string += base_has_context[current_cardinal] ? "?" : ".";
-            int skipped_bases = 0;
-            for (size_t base_idx = 0; base_idx < seq.size(); base_idx++) {
-                if (seq[base_idx] == current_cardinal) {
-                    if (modbase_mask[base_idx] == 1) {
-                        modbase_string += "," + std::to_string(skipped_bases);
-                        skipped_bases = 0;
-                        modbase_prob.push_back(
-                                base_mod_probs[base_idx * num_channels + channel_idx]);
-                    } else {
-                        // Skip this base
-                        skipped_bases++;
+        // A modification on the previous cardinal base
+        std::string modbase_name;
+        mod_name_stream >> modbase_name;
+        std::string bam_name;
+        if (!get_modbase_channel_name(bam_name, modbase_name)) {
+            return false;
+        }
+
+        if (channel_idx == cardinal_channel + 1) {
+            const auto &context_bases = context_positions[utils::base_to_int(current_cardinal)];
+            const auto &motif = context_handler.motif(current_cardinal);
+            // If the context is just the single base, then this is equivalent to no context,
+            // though only bases with a context have their mask set by it.
+            has_context = motif.size() > 1;
+            size_t prev_end = 0;
+            auto add_base = [&](size_t pos, int64_t row) {
+                const auto skipped = size_t(
+                        std::count(seq.begin() + prev_end, seq.begin() + pos, current_cardinal));
+                tag_bases.push_back({skipped, row});
+                prev_end = pos + 1;
+            };
+            // Whether a modification of the base reached the threshold in row.
+            auto is_called = [&](size_t row) {
+                for (size_t c = cardinal_channel + 1;
+                     c < num_channels &&
+                     cardinal_bases.find(base_mod_info->alphabet[c]) == std::string::npos;
+                     ++c) {
+                    if (base_mod_probs[row * num_channels + c] >= threshold) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            size_t row = 0;
+            if (!motif.empty()) {
+                // Every base in context, whatever its probabilities.
+                for (const auto pos : context_bases) {
+                    while (row < base_mod_positions.size() && base_mod_positions[row] < pos) {
+                        ++row;
+                    }
+                    const bool called =
+                            row < base_mod_positions.size() && base_mod_positions[row] == pos;
+                    add_base(pos, called ? int64_t(row) : -1);
+                }
+            } else if (threshold == 0) {
+                // Every base of this kind, as all reach the threshold.
+                for (size_t pos = 0; pos < seq.size(); ++pos) {
+                    if (seq[pos] != current_cardinal) {
+                        continue;
+                    }
+                    while (row < base_mod_positions.size() && base_mod_positions[row] < pos) {
+                        ++row;
+                    }
+                    const bool called =
+                            row < base_mod_positions.size() && base_mod_positions[row] == pos;
+                    add_base(pos, called ? int64_t(row) : -1);
+                }
+            } else {
+                // Only called bases can reach a nonzero threshold.
+                for (; row < base_mod_positions.size(); ++row) {
+                    const size_t pos = base_mod_positions[row];
+                    if (seq[pos] == current_cardinal && is_called(row)) {
+                        add_base(pos, int64_t(row));
                     }
                 }
             }
-            modbase_string += ";";
         }
+
+        // Write out the results we found
+        modbase_string += std::string(1, current_cardinal) + "+" + bam_name;
+        modbase_string += has_context ? "?" : ".";
+        for (const auto &tag_base : tag_bases) {
+            modbase_string += "," + std::to_string(tag_base.skipped);
+            modbase_prob.push_back(tag_base.row < 0
+                                           ? 0
+                                           : base_mod_probs[tag_base.row * num_channels +
+                                                            channel_idx]);
+        }
+        modbase_string += ";";
     }
 
-    bam_aux_append(aln, "MM", 'Z', modbase_string.length() + 1, (uint8_t *)modbase_string.c_str());
-    bam_aux_update_array(aln, "ML", 'C', modbase_prob.size(), (uint8_t *)modbase_prob.data());
+    return true;
 }
 
 void MessageSink::push_message(Message &&message) {
-    const bool success = m_work_queue.try_push(std::move(message));
-    // try_push will fail if the sink has been told to terminate.
-    // We do not expect to be pushing reads from this source if that is the case.
+    if (m_pool_processing) {
+        push_to_pool_node(message);
+    } else {
+        const bool success = m_work_queue.try_push(std::move(message));
+        // try_push will fail if the sink has been told to terminate.
+        // We do not expect to be pushing reads from this source if that is the case.
+        assert(success);
+    }
+}
+
+void MessageSink::push_messages(std::vector<Message> &&messages) {
+    if (m_pool_processing) {
+        for (auto &message : messages) {
+            push_to_pool_node(message);
+        }
+        messages.clear();
+        return;
+    }
+    const bool success = m_work_queue.try_push_batch(std::move(messages));
+    // As with push_message, we do not expect to be pushing to a terminated sink.
     assert(success);
 }
 
+void MessageSink::push_to_pool_node(Message &message) {
+    for (;;) {
+        const auto status = m_work_queue.try_push_nowait(message);
+        if (status != QueueStatus::Full) {
+            // As with push_message, we do not expect to be pushing to a terminated sink.
+            assert(status == QueueStatus::Success);
+            break;
+        }
+        // Rather than wait for the node's tasks to make room, which they might never do if
+        // every pool thread is waiting on a full queue, make room by processing a message here.
+        Message queued_message;
+        if (m_work_queue.try_pop_nowait(queued_message) == QueueStatus::Success) {
+            DORADO_TRACE_SCOPE(m_pool_processing->trace_name);
+            m_pool_processing->process_message(std::move(queued_message));
+        } else {
+            // Another thread has claimed the last slot but not yet written it.
+            std::this_thread::yield();
+        }
+    }
+    schedule_pool_task();
+}
+
+void MessageSink::terminate() {
+    m_work_queue.terminate();
+    // A pool task has to see the termination to finish the node.
+    schedule_pool_task();
+}
+
+void MessageSink::start_pool_processing(std::function<void(Message &&)> process_message,
+                                        int max_concurrency,
+                                        std::function<void()> on_finished) {
+    m_pool_processing = std::make_unique<PoolProcessing>();
+    m_pool_processing->pool = &utils::ThreadPool::shared();
+    m_pool_processing->process_message = std::move(process_message);
+    m_pool_processing->on_finished = std::move(on_finished);
+    m_pool_processing->max_tasks = std::max(max_concurrency, 1);
+    // Called from the derived node's constructor, so this is the derived node's name.
+    const auto name = get_name();
+    m_pool_processing->trace_name = name.empty() ? "process_message" : utils::trace::intern(name);
+}
+
+void MessageSink::join_pool_processing() {
+    if (!m_pool_processing) {
+        return;
+    }
+    std::unique_lock lock(m_pool_processing->mutex);
+    m_pool_processing->finished_cv.wait(lock, [this] { return m_pool_processing->finished; });
+}
+
+void MessageSink::schedule_pool_task() {
+    if (!m_pool_processing) {
+        return;
+    }
+    auto &state = *m_pool_processing;
+    {
+        std::lock_guard lock(state.mutex);
+        if (state.drained) {
+            return;
+        }
+        if (state.num_tasks >= state.max_tasks) {
+            // A running task may have just found the queue empty, so make sure it looks again
+            // before exiting.
+            state.rescan = true;
+            return;
+        }
+        ++state.num_tasks;
+    }
+    state.pool->submit([this] { run_pool_task(); });
+}
+
+void MessageSink::run_pool_task() {
+    auto &state = *m_pool_processing;
+    Message message;
+    size_t num_processed = 0;
+    for (;;) {
+        const auto status = m_work_queue.try_pop_nowait(message);
+        if (status == QueueStatus::Success) {
+            {
+                DORADO_TRACE_SCOPE(state.trace_name);
+                state.process_message(std::move(message));
+            }
+            if (++num_processed == kMessagesPerPoolTask) {
+                // Give the thread back, so that other nodes' tasks get a turn.
+                state.pool->submit([this] { run_pool_task(); });
+                return;
+            }
+            continue;
+        }
+
+        std::unique_lock lock(state.mutex);
+        if (status == QueueStatus::Empty && state.rescan) {
+            state.rescan = false;
+            continue;
+        }
+        if (status == QueueStatus::Terminated) {
+            state.drained = true;
+        }
+        const bool finish = --state.num_tasks == 0 && state.drained;
+        lock.unlock();
+
+        if (finish) {
+            state.on_finished();
+            lock.lock();
+            state.finished = true;
+            // Notify while holding the mutex, since the node can be destroyed as soon as
+            // join_pool_processing() returns.
+            state.finished_cv.notify_all();
+        }
+        return;
+    }
+}
+
 MessageSink::MessageSink(size_t max_messages) : m_work_queue(max_messages) {}
 
 }  // namespace dorado
@@ -1,13 +1,18 @@
 #pragma once
 #include "utils/AsyncQueue.h"
+#include "utils/ThreadPool.h"
 #include "utils/stats.h"
 #include "utils/types.h"
 
 #include <torch/torch.h>
 
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <variant>
@@ -17,28 +22,38 @@ namespace dorado {
 
 namespace utils {
 struct BaseModInfo;
+class MoveTable;
 }
 
 class Read;
+class ReadOrderTicket;
 
 struct Chunk {
-    Chunk(std::shared_ptr<Read> const& read,
-          size_t offset,
-          size_t chunk_in_read_idx,
-          size_t chunk_size)
+    Chunk(Read* read, size_t offset, size_t chunk_in_read_idx, size_t chunk_size)
             : source_read(read),
               input_offset(offset),
               idx_in_read(chunk_in_read_idx),
               raw_chunk_size(chunk_size) {}
 
-    std::weak_ptr<Read> source_read;
-    size_t input_offset;    // Where does this chunk start in the input raw read data
-    size_t idx_in_read;     // Just for tracking that the chunks don't go out of order
-    size_t raw_chunk_size;  // Just for knowing the original chunk size
+    // The read the chunk was cut from.  Chunks don't own their read: whoever queues a read's
+    // chunks must keep the read alive until every one of them has been called, as the
+    // BasecallerNode's working reads do.
+    Read* source_read;
+    size_t input_offset;         // Where does this chunk start in the input raw read data
+    size_t idx_in_read;          // Just for tracking that the chunks don't go out of order
+    size_t raw_chunk_size;       // Just for knowing the original chunk size
+    size_t num_decode_steps{0};  // Output steps worth decoding, or 0 for all of them.
 
     std::string seq;
     std::string qstring;
     std::vector<uint8_t> moves;  // For stitching.
+
+    // A chunk may instead hold several short reads, one after another with a gap between them,
+    // in which case it has no source read, and its signal is packed_signal.  packed_chunks are
+    // the reads' own chunks, and packed_offsets where each read starts in the packed signal.
+    std::vector<std::shared_ptr<Chunk>> packed_chunks;
+    std::vector<size_t> packed_offsets;
+    torch::Tensor packed_signal;
 };
 
 // Class representing a read, including raw data
@@ -86,12 +101,17 @@ public:
     std::string seq;                      // Read basecall
     std::string qstring;                  // Read Qstring (Phred)
     std::vector<uint8_t> moves;           // Move table
-    std::vector<uint8_t> base_mod_probs;  // Modified base probabilities
+    // Modified base probabilities, stored only for the bases which were called: a row of
+    // base_mod_info->alphabet.size() probabilities for each of base_mod_positions, the
+    // increasing positions in seq of those bases.  Bases not called have no modifications.
+    std::vector<uint8_t> base_mod_probs;
+    std::vector<uint32_t> base_mod_positions;
     std::string run_id;                   // Run ID - used in read group
     std::string flowcell_id;              // Flowcell ID - used in read group
     std::string model_name;               // Read group
 
     std::string parent_read_id;  // Origin read ID for all its subreads. Empty for nonsplit reads.
+    std::string barcode;  // Barcode classification, written as the BC tag. Empty if not classified.
 
     std::shared_ptr<const utils::BaseModInfo>
             base_mod_info;  // Modified base settings of the models that ran on this read
@@ -100,7 +120,33 @@ public:
 
     Attributes attributes;
     std::vector<Mapping> mappings;
-    std::vector<BamPtr> extract_sam_lines(bool emit_moves, uint8_t modbase_threshold = 0) const;
+    // With pack_moves, an emitted move table is written bit packed in the mp tag, as described
+    // in utils/MoveTable.h, instead of in the mv tag.
+    std::vector<BamPtr> extract_sam_lines(bool emit_moves,
+                                          uint8_t modbase_threshold = 0,
+                                          bool pack_moves = false) const;
+
+    // Frees raw_data once no downstream node needs the signal. The sample count is kept
+    // so that the output tags are unchanged.
+    void release_raw_data();
+    // Number of samples in raw_data, also valid after it has been released.
+    uint64_t get_num_raw_samples() const;
+    // Bytes of memory the read holds in its signal, basecall, modbase probabilities and
+    // called chunks, for nodes to account for the reads they hold.  Must not be called while
+    // another thread changes the read.
+    size_t memory_bytes() const;
+    // Removes bases from either end of the basecall, along with their qscores, modbase
+    // probabilities and moves.  The signal of the bases trimmed from the front is counted as
+    // trimmed samples, so that ts, ns and du stay consistent with the moves.
+    void trim_bases(size_t num_front, size_t num_rear);
+    // Clears the basecall, its qscores and moves, so that the read can be called again.
+    void clear_basecall();
+    // Packed move table of moves, built the first time it is asked for and shared by every
+    // later stage, so moves mustn't change after that other than through trim_bases().
+    const utils::MoveTable& move_table() const;
+    // Mean qscore of qstring, computed the first time it is asked for, so qstring mustn't
+    // change after that.
+    float mean_qscore() const;
 
     uint64_t start_sample;
     uint64_t end_sample;
@@ -116,12 +162,29 @@ public:
     uint64_t read_tag{0};
     // The id of the client to which this read belongs. -1 in standalone mode
     int32_t client_id{-1};
+    // Set as the read is loaded if its records are to be written in the order reads were
+    // loaded, by a ReadOrderNode.
+    std::shared_ptr<ReadOrderTicket> order_ticket;
 
 private:
-    void generate_duplex_read_tags(bam1_t*) const;
-    void generate_read_tags(bam1_t* aln, bool emit_moves) const;
-    void generate_modbase_string(bam1_t* aln, uint8_t threshold = 0) const;
+    // Bytes of aux data written by generate_read_tags / generate_duplex_read_tags.
+    size_t read_tags_size(bool emit_moves, bool pack_moves, const std::string& read_group) const;
+    size_t duplex_read_tags_size(const std::string& read_group) const;
+    void generate_duplex_read_tags(bam1_t*, const std::string& read_group) const;
+    void generate_read_tags(bam1_t* aln,
+                            bool emit_moves,
+                            bool pack_moves,
+                            const std::string& read_group) const;
+    // Fills in the MM string and the ML B-array payload, returning false if there are no
+    // modbase tags to write.
+    bool generate_modbase_tags(std::string& modbase_string,
+                               std::vector<uint8_t>& modbase_prob,
+                               uint8_t threshold = 0) const;
     std::string generate_read_group() const;
+
+    uint64_t m_num_released_samples{0};
+    mutable std::optional<float> m_mean_qscore;
+    mutable std::shared_ptr<const utils::MoveTable> m_move_table;
 };
 
 // A pair of reads for Duplex calling
@@ -131,7 +194,19 @@ public:
     std::shared_ptr<Read> read_2;
 };
 
-class CandidatePairRejectedMessage {};
+class CandidatePairRejectedMessage {
+public:
+    // read_tag of the rejected pair's template read.
+    uint64_t read_tag{0};
+};
+
+// The PAF lines of a read's alignments, written by the aligner in place of BAM records when only
+// the mapping coordinates are wanted.
+struct PafLines {
+    std::string lines;
+    // False if the read has no alignments, and so no lines.
+    bool mapped{false};
+};
 
 // The Message type is a std::variant that can hold different types of message objects.
 // It is currently able to store:
@@ -139,11 +214,13 @@ class CandidatePairRejectedMessage {};
 // - a BamPtr object, which represents a raw BAM alignment record
 // - a std::shared_ptr<ReadPair> object, which represents a pair of reads for duplex calling
 // - a std::shared_ptr<CandidatePairRejectedMessage> object, which informs downstream processing that a candidate pair has been rejected
+// - a PafLines object, which holds a read's alignments as PAF
 // To add more message types, simply add them to the list of types in the std::variant.
 using Message = std::variant<std::shared_ptr<Read>,
                              BamPtr,
                              std::shared_ptr<ReadPair>,
-                             CandidatePairRejectedMessage>;
+                             CandidatePairRejectedMessage,
+                             PafLines>;
 
 // Base class for an object which consumes messages.
 // MessageSink is a node within a pipeline.
@@ -157,20 +234,79 @@ public:
     MessageSink(size_t max_messages);
     virtual ~MessageSink() = default;
     // Pushed messages must be rvalues: the sink takes ownership.
-    void push_message(
-            Message&&
-                    message);  // Push a message into message sink.  This can block if the sink's queue is full.
-    void terminate() { m_work_queue.terminate(); }
+    // Push a message into message sink.  This can block if the sink's queue is full.
+    // A node processed on the shared CPU pool instead makes room by having the pushing thread
+    // process one of its queued messages.
+    virtual void push_message(Message&& message);
+    // Push several messages at once, paying the queue synchronisation cost once per
+    // batch rather than once per message.  This can block if the sink's queue is full.
+    virtual void push_messages(std::vector<Message>&& messages);
+    // Tells the node that no more messages will be pushed.
+    virtual void terminate();
+    // Waits for the node's worker threads to exit, which they do once the node has been
+    // terminated and its queue drained.  Once this returns the node's stats are final.
+    // Nodes with worker threads must override this such that it can be called more than once.
+    virtual void join() {}
 
     // StatsSampler will ignore nodes with an empty name.
     virtual std::string get_name() const { return std::string(""); }
     virtual stats::NamedStats sample_stats() const {
         return std::unordered_map<std::string, double>();
     }
+    // Adds the counters readers poll most often, named as in sample_stats() and prefixed by
+    // get_name(), so they can be read without sampling all of the node's stats.
+    virtual void register_counters(stats::CounterRegistry& registry) const {}
 
 protected:
+    // Processes the node's messages with tasks on the shared CPU thread pool, instead of
+    // worker threads of the node's own, so that idle threads go to whichever node is backed
+    // up.  At most max_concurrency messages are processed at once.  on_finished is called
+    // once the node has been terminated and all of its messages processed.
+    void start_pool_processing(std::function<void(Message&&)> process_message,
+                               int max_concurrency,
+                               std::function<void()> on_finished);
+    // Waits for on_finished to have returned.  Can be called more than once.
+    void join_pool_processing();
+
     // Queue of work items for this node.
-    AsyncQueue<Message> m_work_queue;
+    // Nodes typically have several worker threads popping from this queue, so use the
+    // lock-free backend to keep them from serialising on a mutex.
+    AsyncQueue<Message, LockFreeQueuePolicy> m_work_queue;
+
+private:
+    // Each task processes at most this many messages before giving its thread back.
+    static constexpr size_t kMessagesPerPoolTask = 16;
+
+    struct PoolProcessing {
+        utils::ThreadPool* pool = nullptr;
+        std::function<void(Message&&)> process_message;
+        std::function<void()> on_finished;
+        int max_tasks = 0;
+        // The node's name, for tracing each message processed.
+        const char* trace_name = nullptr;
+
+        // Guards the task counts and flags.
+        std::mutex mutex;
+        std::condition_variable finished_cv;
+        // Tasks submitted or running.
+        int num_tasks = 0;
+        // Set when a task was wanted while at the limit, so that a running task which has
+        // found the queue empty checks it again.
+        bool rescan = false;
+        // Set once the queue has drained after termination, so no more tasks are started.
+        bool drained = false;
+        // Set once on_finished has returned.
+        bool finished = false;
+    };
+
+    // Pushes to a node processed on the pool.
+    void push_to_pool_node(Message& message);
+    // Starts another task if there are queued messages, or termination to handle, and fewer
+    // than the maximum number of tasks.
+    void schedule_pool_task();
+    void run_pool_task();
+
+    std::unique_ptr<PoolProcessing> m_pool_processing;
 };
 
 }  // namespace dorado
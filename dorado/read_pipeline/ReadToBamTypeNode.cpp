@@ -1,5 +1,7 @@
 #include "ReadToBamTypeNode.h"
 
+#include "ReadOrderNode.h"
+
 #include <spdlog/spdlog.h>
 
 #include <chrono>
@@ -12,14 +14,17 @@ void ReadToBamType::worker_thread() {
     Message message;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
 
         if (m_rna) {
             std::reverse(read->seq.begin(), read->seq.end());
             std::reverse(read->qstring.begin(), read->qstring.end());
         }
 
-        auto alns = read->extract_sam_lines(m_emit_moves, m_modbase_threshold);
+        auto alns = read->extract_sam_lines(m_emit_moves, m_modbase_threshold, m_pack_moves);
+        if (read->order_ticket) {
+            read->order_ticket->finish(alns);
+        }
         for (auto& aln : alns) {
             m_sink.push_message(std::move(aln));
         }
@@ -36,10 +41,12 @@ ReadToBamType::ReadToBamType(MessageSink& sink,
                              bool rna,
                              size_t num_worker_threads,
                              float modbase_threshold_frac,
-                             size_t max_reads)
+                             size_t max_reads,
+                             bool pack_moves)
         : MessageSink(max_reads),
           m_sink(sink),
           m_emit_moves(emit_moves),
+          m_pack_moves(pack_moves),
           m_rna(rna),
           m_modbase_threshold(
                   static_cast<uint8_t>(std::min(modbase_threshold_frac * 256.0f, 255.0f))),
@@ -52,10 +59,16 @@ ReadToBamType::ReadToBamType(MessageSink& sink,
 
 ReadToBamType::~ReadToBamType() {
     terminate();
+    join();
+    m_sink.terminate();
+}
+
+void ReadToBamType::join() {
     for (auto& m : m_workers) {
-        m->join();
+        if (m->joinable()) {
+            m->join();
+        }
     }
-    m_sink.terminate();
 }
 
 }  // namespace dorado
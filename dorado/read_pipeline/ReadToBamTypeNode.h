@@ -18,8 +18,10 @@ public:
                   bool rna,
                   size_t num_worker_threads,
                   float modbase_threshold_frac = 0,
-                  size_t max_reads = 1000);
+                  size_t max_reads = 1000,
+                  bool pack_moves = false);
     ~ReadToBamType();
+    void join() override;
 
 private:
     MessageSink& m_sink;
@@ -30,6 +32,7 @@ private:
     std::atomic<size_t> m_active_threads;
 
     bool m_emit_moves;
+    bool m_pack_moves;
     bool m_rna;
     uint8_t m_modbase_threshold;
 };
@@ -34,12 +34,14 @@ void ResumeLoaderNode::copy_completed_reads() {
     auto reader = std::make_unique<HtsReader>(m_resume_file);
 
     // Iterate over all reads and write to sink.
+    size_t num_records = 0;
     try {
         while (reader->read()) {
-            std::string read_id = bam_get_qname(reader->record);
-            m_processed_read_ids.insert(read_id);
+            if (auto read_id = utils::parse_read_id(bam_get_qname(reader->record))) {
+                m_processed_read_ids.insert(*read_id);
+            }
             m_sink.push_message(BamPtr(bam_dup1(reader->record.get())));
-            if (m_processed_read_ids.size() % 100 == 0) {
+            if (++num_records % 100 == 0) {
                 bar.tick();
             }
         }
@@ -54,8 +56,4 @@ void ResumeLoaderNode::copy_completed_reads() {
     hts_set_log_level(initial_hts_log_level);
 }
 
-std::unordered_set<std::string> ResumeLoaderNode::get_processed_read_ids() const {
-    return m_processed_read_ids;
-}
-
 }  // namespace dorado
@@ -1,9 +1,9 @@
 #pragma once
 
 #include "ReadPipeline.h"
+#include "utils/uuid_utils.h"
 
 #include <string>
-#include <unordered_set>
 
 namespace dorado {
 
@@ -15,13 +15,15 @@ public:
     ResumeLoaderNode(MessageSink& sink, const std::string& resume_file);
     ~ResumeLoaderNode() = default;
     void copy_completed_reads();
-    std::unordered_set<std::string> get_processed_read_ids() const;
+    // IDs of the reads found in the resume file.  Reads whose IDs aren't UUIDs, such as duplex
+    // reads, can't be loaded again so are left out.
+    const ReadIDSet& get_processed_read_ids() const { return m_processed_read_ids; }
 
 private:
     MessageSink& m_sink;
     std::string m_resume_file;
 
-    std::unordered_set<std::string> m_processed_read_ids;
+    ReadIDSet m_processed_read_ids;
 };
 
 }  // namespace dorado
@@ -1,10 +1,18 @@
 #include "ScalerNode.h"
 
+#include "utils/SignalBufferPool.h"
 #include "utils/tensor_utils.h"
 #include "utils/trim.h"
 
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include <c10/cuda/CUDAGuard.h>
+#include <c10/cuda/CUDAStream.h>
+#endif
+#include <spdlog/spdlog.h>
+
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <utility>
 
 using namespace std::chrono_literals;
@@ -14,75 +22,185 @@ namespace dorado {
 
 std::pair<float, float> ScalerNode::normalisation(torch::Tensor& x) {
     // Calculate shift and scale factors for normalisation.
-    auto quantiles = dorado::utils::quantile_counting(
-            x, torch::tensor({m_scaling_params.quantile_a, m_scaling_params.quantile_b}));
-    float q_a = quantiles[0].item<float>();
-    float q_b = quantiles[1].item<float>();
+    // Raw pointer access avoids torch op overhead for what is a single pass over the signal.
+    const float q[2] = {m_scaling_params.quantile_a, m_scaling_params.quantile_b};
+    float quantiles[2];
+    dorado::utils::quantile_counting(x.data_ptr<int16_t>(), x.size(0), q, 2, quantiles);
+    float q_a = quantiles[0];
+    float q_b = quantiles[1];
     float shift = std::max(10.0f, m_scaling_params.shift_multiplier * (q_a + q_b));
     float scale = std::max(1.0f, m_scaling_params.scale_multiplier * (q_b - q_a));
     return {shift, scale};
 }
 
-void ScalerNode::worker_thread() {
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
-
-        const auto [shift, scale] = normalisation(read->raw_data);
-        // raw_data comes from DataLoader with dtype int16.  We send it on as float16 after
-        // shifting/scaling in float32 form.
-        read->raw_data = ((read->raw_data.to(torch::kFloat) - shift) / scale).to(torch::kFloat16);
+std::vector<std::pair<float, float>> ScalerNode::normalise_on_device(
+        const std::vector<std::shared_ptr<Read>>& reads) {
+    std::vector<int64_t> lengths;
+    lengths.reserve(reads.size());
+    int64_t num_samples = 0;
+    for (const auto& read : reads) {
+        lengths.push_back(read->raw_data.size(0));
+        num_samples += lengths.back();
+    }
 
-        // move the shift and scale into pA.
-        read->scale = read->scaling * scale;
-        read->shift = read->scaling * (shift + read->offset);
+    // The signals are uploaded as int16 in one copy, and converted on the device.
+    if (!m_pinned_samples.defined() || m_pinned_samples.size(0) < num_samples) {
+        m_pinned_samples = torch::empty(
+                {num_samples}, torch::TensorOptions().dtype(torch::kInt16).pinned_memory(true));
+    }
+    int64_t offset = 0;
+    auto* const pinned = m_pinned_samples.data_ptr<int16_t>();
+    for (const auto& read : reads) {
+        const auto signal = read->raw_data.contiguous();
+        std::memcpy(pinned + offset, signal.data_ptr<int16_t>(), signal.nbytes());
+        offset += signal.size(0);
+    }
 
-        // 8000 value may be changed in future. Currently this is found to work well.
-        int max_samples = std::min(8000, static_cast<int>(read->raw_data.size(0) / 2));
-        int trim_start =
-                utils::trim(read->raw_data.index({Slice(torch::indexing::None, max_samples)}));
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    // A stream of its own keeps the copies from waiting on the basecall runners' work.
+    c10::cuda::CUDAStreamGuard stream_guard(
+            c10::cuda::getStreamFromPool(false, m_device->index()));
+#endif
+    const auto samples = m_pinned_samples.narrow(0, 0, num_samples).to(*m_device, true);
+    const auto quantiles = utils::segment_quantiles(
+            samples, lengths, {m_scaling_params.quantile_a, m_scaling_params.quantile_b});
+    const auto q_a = quantiles.select(1, 0);
+    const auto q_b = quantiles.select(1, 1);
+    const auto shifts = (m_scaling_params.shift_multiplier * (q_a + q_b)).clamp_min(10.f);
+    const auto scales = (m_scaling_params.scale_multiplier * (q_b - q_a)).clamp_min(1.f);
+
+    // Computed in float32 and rounded to float16, as scale_i16_to_f16 does.
+    const auto lengths_device = torch::tensor(lengths, torch::kInt64).to(*m_device);
+    const auto scaled = ((samples.to(torch::kFloat32) -
+                          torch::repeat_interleave(shifts, lengths_device)) /
+                         torch::repeat_interleave(scales, lengths_device))
+                                .to(torch::kFloat16);
+
+    const auto shifts_scales = torch::stack({shifts, scales}, 1).cpu();
+    const auto* const shift_scale = shifts_scales.data_ptr<float>();
+    std::vector<std::pair<float, float>> result;
+    result.reserve(reads.size());
+    offset = 0;
+    for (size_t i = 0; i < reads.size(); ++i) {
+        auto normalised = SignalBufferPool::shared().allocate(lengths[i], torch::kFloat16);
+        normalised.copy_(scaled.narrow(0, offset, lengths[i]));
+        reads[i]->raw_data = std::move(normalised);
+        result.emplace_back(shift_scale[2 * i], shift_scale[2 * i + 1]);
+        offset += lengths[i];
+    }
+    return result;
+}
 
-        read->raw_data = read->raw_data.index({Slice(trim_start, torch::indexing::None)});
-        read->num_trimmed_samples = trim_start;
+void ScalerNode::trim_and_push(std::shared_ptr<Read> read, float shift, float scale) {
+    // move the shift and scale into pA.
+    read->scale = read->scaling * scale;
+    read->shift = read->scaling * (shift + read->offset);
 
-        // Pass the read to the next node
-        m_sink.push_message(read);
+    // 8000 value may be changed in future. Currently this is found to work well.
+    int max_samples = std::min(8000, static_cast<int>(read->raw_data.size(0) / 2));
+    int trim_start = utils::trim(read->raw_data.index({Slice(torch::indexing::None, max_samples)}));
+    if (m_trim_adapter_tail) {
+        trim_start = utils::trim_adapter_tail(read->raw_data, trim_start);
     }
 
-    int num_worker_threads = --m_num_worker_threads;
-    if (num_worker_threads == 0) {
-        m_sink.terminate();
+    read->raw_data = read->raw_data.index({Slice(trim_start, torch::indexing::None)});
+    read->num_trimmed_samples = trim_start;
+
+    // Pass the read to the next node
+    m_sink.push_message(std::move(read));
+}
+
+void ScalerNode::process_message(Message&& message) {
+    // If this message isn't a read, we'll get a bad_variant_access exception.
+    auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+    const auto [shift, scale] = normalisation(read->raw_data);
+    // raw_data comes from DataLoader with dtype int16.  We send it on as float16 after
+    // shifting/scaling in float32 form.
+    read->raw_data = utils::scale_i16_to_f16(read->raw_data, shift, scale);
+
+    trim_and_push(std::move(read), shift, scale);
+}
+
+void ScalerNode::device_worker_thread() {
+    // Whatever has queued up since the last batch is normalised together.
+    std::vector<Message> messages;
+    std::vector<std::shared_ptr<Read>> reads;
+    while (m_work_queue.try_pop_batch(messages, m_device_batch_size)) {
+        reads.clear();
+        for (auto& message : messages) {
+            // If this message isn't a read, we'll get a bad_variant_access exception.
+            reads.push_back(std::get<std::shared_ptr<Read>>(std::move(message)));
+        }
+        const auto shifts_scales = normalise_on_device(reads);
+        ++m_num_device_batches;
+        m_num_device_reads += reads.size();
+        for (size_t i = 0; i < reads.size(); ++i) {
+            trim_and_push(std::move(reads[i]), shifts_scales[i].first, shifts_scales[i].second);
+        }
     }
+    m_sink.terminate();
 }
 
 ScalerNode::ScalerNode(MessageSink& sink,
                        const SignalNormalisationParams& config,
                        int num_worker_threads,
-                       size_t max_reads)
+                       size_t max_reads,
+                       bool trim_adapter_tail,
+                       std::string node_name,
+                       const std::string& device,
+                       size_t device_batch_size)
         : MessageSink(max_reads),
           m_sink(sink),
           m_scaling_params(config),
-          m_num_worker_threads(num_worker_threads) {
-    for (int i = 0; i < m_num_worker_threads; i++) {
-        std::unique_ptr<std::thread> scaler_worker_thread =
-                std::make_unique<std::thread>(&ScalerNode::worker_thread, this);
-        worker_threads.push_back(std::move(scaler_worker_thread));
+          m_trim_adapter_tail(trim_adapter_tail),
+          m_node_name(std::move(node_name)),
+          m_device_batch_size(std::max<size_t>(device_batch_size, 1)) {
+    if (!device.empty()) {
+        const torch::Device scale_device(device);
+        if (scale_device.is_cuda()) {
+            m_device = scale_device;
+        } else {
+            spdlog::warn("Reads can only be normalised on a CUDA device, not {}, ignoring.",
+                         device);
+        }
+    }
+    if (m_device) {
+        m_device_worker =
+                std::make_unique<std::thread>(&ScalerNode::device_worker_thread, this);
+    } else {
+        start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                              num_worker_threads, [this] { m_sink.terminate(); });
     }
 }
 
 ScalerNode::~ScalerNode() {
     terminate();
 
-    // Wait for all the Scaler Node's worker threads to terminate
-    for (auto& t : worker_threads) {
-        t->join();
-    }
+    // Wait for all of the Scaler Node's messages to be processed
+    join();
 
     // Notify the sink that the Scaler Node has terminated
     m_sink.terminate();
 }
 
-stats::NamedStats ScalerNode::sample_stats() const { return stats::from_obj(m_work_queue); }
+void ScalerNode::join() {
+    if (m_device_worker) {
+        if (m_device_worker->joinable()) {
+            m_device_worker->join();
+        }
+        return;
+    }
+    join_pool_processing();
+}
+
+stats::NamedStats ScalerNode::sample_stats() const {
+    auto stats = stats::from_obj(m_work_queue);
+    if (m_device) {
+        stats["device_batches"] = double(m_num_device_batches.load());
+        stats["device_reads"] = double(m_num_device_reads.load());
+    }
+    return stats;
+}
 
 }  // namespace dorado
@@ -4,6 +4,8 @@
 #include "utils/stats.h"
 
 #include <atomic>
+#include <memory>
+#include <optional>
 #include <string>
 #include <thread>
 #include <vector>
@@ -12,22 +14,51 @@ namespace dorado {
 
 class ScalerNode : public MessageSink {
 public:
+    // At most num_worker_threads of the shared CPU pool's threads work on the node at once.
+    // If trim_adapter_tail, the adapter and a polyA/T tail after it are also trimmed from the
+    // start of the signal, so they aren't basecalled.
+    // If device is a CUDA device, reads are instead normalised there by a worker thread of the
+    // node's own, in batches of up to device_batch_size, leaving only trimming on the CPU.
     ScalerNode(MessageSink& sink,
                const SignalNormalisationParams& config,
                int num_worker_threads = 5,
-               size_t max_reads = 1000);
+               size_t max_reads = 1000,
+               bool trim_adapter_tail = false,
+               std::string node_name = "ScalerNode",
+               const std::string& device = "",
+               size_t device_batch_size = 64);
     ~ScalerNode();
-    std::string get_name() const override { return "ScalerNode"; }
+    void join() override;
+    std::string get_name() const override { return m_node_name; }
     stats::NamedStats sample_stats() const override;
 
 private:
-    void worker_thread();  // Worker thread performs scaling and trimming asynchronously.
+    // Performs scaling and trimming, on the shared CPU thread pool.
+    void process_message(Message&& message);
+    // Normalises batches of reads on m_device, and trims them.
+    void device_worker_thread();
+    // Replaces each read's int16 signal with its normalised float16 signal, scaled on m_device.
+    // Returns each read's shift and scale.
+    std::vector<std::pair<float, float>> normalise_on_device(
+            const std::vector<std::shared_ptr<Read>>& reads);
+    // Records the read's shift and scale, trims its normalised signal and passes it on.
+    void trim_and_push(std::shared_ptr<Read> read, float shift, float scale);
+
     MessageSink&
             m_sink;  // MessageSink to consume scaled reads. Typically this will be a Basecaller Node.
-    std::vector<std::unique_ptr<std::thread>> worker_threads;
-    std::atomic<int> m_num_worker_threads;
 
     SignalNormalisationParams m_scaling_params;
+    const bool m_trim_adapter_tail;
+    const std::string m_node_name;
+
+    // Set if reads are normalised on a GPU.
+    std::optional<torch::Device> m_device;
+    const size_t m_device_batch_size;
+    std::unique_ptr<std::thread> m_device_worker;
+    // Reads' signals are gathered here before they are copied to the device.
+    torch::Tensor m_pinned_samples;
+    std::atomic<size_t> m_num_device_batches{0};
+    std::atomic<size_t> m_num_device_reads{0};
 
     std::pair<float, float> normalisation(torch::Tensor& x);
 };
@@ -0,0 +1,91 @@
+#include "SignalFilterNode.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dorado {
+
+namespace {
+
+// Standard deviation of the raw int16 samples, in a single pass.
+float signal_stdev(const torch::Tensor& raw_data) {
+    const auto* samples = raw_data.data_ptr<int16_t>();
+    const int64_t num_samples = raw_data.size(0);
+    if (num_samples == 0) {
+        return 0.f;
+    }
+    int64_t sum = 0;
+    int64_t sum_squares = 0;
+    for (int64_t i = 0; i < num_samples; ++i) {
+        sum += samples[i];
+        sum_squares += int64_t(samples[i]) * samples[i];
+    }
+    const double mean = double(sum) / num_samples;
+    const double variance = double(sum_squares) / num_samples - mean * mean;
+    return float(std::sqrt(std::max(variance, 0.)));
+}
+
+}  // namespace
+
+void SignalFilterNode::process_message(Message&& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        m_sink.push_message(std::move(message));
+        return;
+    }
+    auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+    const auto num_samples = read->raw_data.size(0);
+    const double min_samples =
+            double(m_min_read_length) * read->sample_rate / m_max_bases_per_second;
+    if (num_samples < min_samples) {
+        ++m_num_short_reads_filtered;
+        ++m_num_reads_filtered;
+        return;
+    }
+    // Scaling converts the raw integers to pA, about the read's offset.
+    if (m_min_signal_stdev_pa > 0.f &&
+        read->scaling * signal_stdev(read->raw_data) < m_min_signal_stdev_pa) {
+        ++m_num_flat_reads_filtered;
+        ++m_num_reads_filtered;
+        return;
+    }
+
+    m_sink.push_message(std::move(read));
+}
+
+SignalFilterNode::SignalFilterNode(MessageSink& sink,
+                                   size_t min_read_length,
+                                   float max_bases_per_second,
+                                   float min_signal_stdev_pa,
+                                   int num_worker_threads,
+                                   size_t max_reads)
+        : MessageSink(max_reads),
+          m_sink(sink),
+          m_min_read_length(min_read_length),
+          m_max_bases_per_second(max_bases_per_second),
+          m_min_signal_stdev_pa(min_signal_stdev_pa) {
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                          num_worker_threads, [this] { m_sink.terminate(); });
+}
+
+SignalFilterNode::~SignalFilterNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+}
+
+void SignalFilterNode::join() { join_pool_processing(); }
+
+stats::NamedStats SignalFilterNode::sample_stats() const {
+    stats::NamedStats stats = stats::from_obj(m_work_queue);
+    stats["reads_filtered"] = m_num_reads_filtered;
+    stats["short_reads_filtered"] = m_num_short_reads_filtered;
+    stats["flat_reads_filtered"] = m_num_flat_reads_filtered;
+    return stats;
+}
+
+void SignalFilterNode::register_counters(stats::CounterRegistry& registry) const {
+    registry.add(get_name() + ".reads_filtered", m_num_reads_filtered);
+}
+
+}  // namespace dorado
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace dorado {
+
+/// Class to drop reads before they are basecalled, on cheap statistics of their raw signal,
+/// where they would be filtered out after basecalling anyway.
+/// Reads are dropped when they have too few samples to give min_read_length bases, even at
+/// max_bases_per_second, or when their signal's standard deviation is below
+/// min_signal_stdev_pa, as for a blocked pore.  A min_signal_stdev_pa of 0 disables the latter.
+/// Expects reads straight from the data loader, with int16 raw data.
+class SignalFilterNode : public MessageSink {
+public:
+    SignalFilterNode(MessageSink& sink,
+                     size_t min_read_length,
+                     float max_bases_per_second,
+                     float min_signal_stdev_pa,
+                     int num_worker_threads,
+                     size_t max_reads = 1000);
+    ~SignalFilterNode();
+    void join() override;
+    std::string get_name() const override { return "SignalFilterNode"; }
+    stats::NamedStats sample_stats() const override;
+    void register_counters(stats::CounterRegistry& registry) const override;
+
+private:
+    // Filters a read, on the shared CPU thread pool.
+    void process_message(Message&& message);
+
+    MessageSink& m_sink;
+    size_t m_min_read_length;
+    float m_max_bases_per_second;
+    float m_min_signal_stdev_pa;
+
+    std::atomic<int64_t> m_num_reads_filtered{0};
+    std::atomic<int64_t> m_num_short_reads_filtered{0};
+    std::atomic<int64_t> m_num_flat_reads_filtered{0};
+};
+
+}  // namespace dorado
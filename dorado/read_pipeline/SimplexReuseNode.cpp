@@ -0,0 +1,81 @@
+#include "SimplexReuseNode.h"
+
+namespace dorado {
+
+void SimplexReuseNode::process_message(Message&& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        m_sink.push_message(std::move(message));
+        return;
+    }
+    auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+    auto simplex_it = m_simplex_reads.find(read->read_id);
+    if (simplex_it == m_simplex_reads.end()) {
+        ++m_num_reads_missing;
+        return;
+    }
+    auto& simplex = *simplex_it->second;
+
+    // The earlier run may have trimmed more of the start, as when bases were trimmed after
+    // basecalling, but its moves can't cover signal it had that this read doesn't.
+    if (simplex.model_stride != m_model_stride ||
+        simplex.num_trimmed_samples < read->num_trimmed_samples) {
+        ++m_num_reads_mismatched;
+        return;
+    }
+    const auto num_samples = uint64_t(read->raw_data.size(0));
+    const auto extra_trimmed = simplex.num_trimmed_samples - read->num_trimmed_samples;
+    // The last move may cover a partial stride.
+    if (extra_trimmed >= num_samples || simplex.moves.empty() ||
+        (simplex.moves.size() - 1) * m_model_stride >= num_samples - extra_trimmed) {
+        ++m_num_reads_mismatched;
+        return;
+    }
+    if (extra_trimmed > 0) {
+        read->raw_data =
+                read->raw_data.index({torch::indexing::Slice(int64_t(extra_trimmed), {})});
+        read->num_trimmed_samples = simplex.num_trimmed_samples;
+    }
+
+    // Each read is only loaded once, so its basecall can be moved out.
+    read->seq = std::move(simplex.seq);
+    read->qstring = std::move(simplex.qstring);
+    read->moves = std::move(simplex.moves);
+    read->model_stride = m_model_stride;
+    read->model_name = m_model_name;
+    ++m_num_reads_reused;
+    m_sink.push_message(std::move(read));
+}
+
+SimplexReuseNode::SimplexReuseNode(MessageSink& sink,
+                                   read_map simplex_reads,
+                                   int model_stride,
+                                   std::string model_name,
+                                   int num_worker_threads,
+                                   size_t max_reads)
+        : MessageSink(max_reads),
+          m_sink(sink),
+          m_simplex_reads(std::move(simplex_reads)),
+          m_model_stride(model_stride),
+          m_model_name(std::move(model_name)) {
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                          num_worker_threads, [this] { m_sink.terminate(); });
+}
+
+SimplexReuseNode::~SimplexReuseNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+}
+
+void SimplexReuseNode::join() { join_pool_processing(); }
+
+stats::NamedStats SimplexReuseNode::sample_stats() const {
+    stats::NamedStats stats = stats::from_obj(m_work_queue);
+    stats["reads_reused"] = m_num_reads_reused;
+    stats["reads_missing"] = m_num_reads_missing;
+    stats["reads_mismatched"] = m_num_reads_mismatched;
+    return stats;
+}
+
+}  // namespace dorado
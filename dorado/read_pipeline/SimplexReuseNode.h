@@ -0,0 +1,47 @@
+#pragma once
+
+#include "HtsReader.h"
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace dorado {
+
+/// Class to give reads the simplex basecalls of an earlier basecaller run, as read by
+/// read_simplex_bam, in place of basecalling them again, so that a duplex run only has to call
+/// the pairs.
+/// Expects scaled reads, whose signal is trimmed further if the earlier run trimmed more of it,
+/// so that the move table lines up with it.  Reads without a basecall, or whose basecall
+/// doesn't fit their signal, as for a different model, are dropped.
+class SimplexReuseNode : public MessageSink {
+public:
+    SimplexReuseNode(MessageSink& sink,
+                     read_map simplex_reads,
+                     int model_stride,
+                     std::string model_name,
+                     int num_worker_threads,
+                     size_t max_reads = 1000);
+    ~SimplexReuseNode();
+    void join() override;
+    std::string get_name() const override { return "SimplexReuseNode"; }
+    stats::NamedStats sample_stats() const override;
+
+private:
+    // Attaches a read's basecall, on the shared CPU thread pool.
+    void process_message(Message&& message);
+
+    MessageSink& m_sink;
+    // Only read by the workers, each of which takes the basecall of different reads.
+    read_map m_simplex_reads;
+    int m_model_stride;
+    std::string m_model_name;
+
+    std::atomic<int64_t> m_num_reads_reused{0};
+    std::atomic<int64_t> m_num_reads_missing{0};
+    std::atomic<int64_t> m_num_reads_mismatched{0};
+};
+
+}  // namespace dorado
@@ -1,28 +1,76 @@
 #include "StereoDuplexEncoderNode.h"
 
 #include "3rdparty/edlib/edlib/include/edlib.h"
+#include "utils/alignment_utils.h"
 #include "utils/duplex_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/simd.h"
 
 #include <algorithm>
 #include <array>
-#include <cstring>
+#include <cstdint>
+#include <limits>
 #include <vector>
 
-using namespace torch::indexing;
+namespace {
+
+// Buffers reused by the pool thread for each pair it encodes.
+struct EncoderScratch {
+    std::vector<int> template_base_starts;
+    std::vector<int> complement_move_indices;
+    std::vector<int> complement_base_starts;
+};
+thread_local EncoderScratch t_scratch;
+
+// Appends the indices of the set entries of the move table.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void find_moves(const uint8_t* moves, size_t num_moves, std::vector<int>& indices) {
+    for (size_t i = 0; i < num_moves; ++i) {
+        if (moves[i]) {
+            indices.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2"))) void find_moves(const uint8_t* moves,
+                                                size_t num_moves,
+                                                std::vector<int>& indices) {
+    const __m256i kZero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= num_moves; i += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(moves + i));
+        uint32_t mask = ~static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, kZero)));
+        while (mask != 0) {
+            indices.push_back(static_cast<int>(i) + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < num_moves; ++i) {
+        if (moves[i]) {
+            indices.push_back(static_cast<int>(i));
+        }
+    }
+}
+#endif
+
+float min_sample(const c10::Half* samples, int num_samples) {
+    float min_value = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < num_samples; ++i) {
+        min_value = std::min(min_value, static_cast<float>(samples[i]));
+    }
+    return min_value;
+}
+
+}  // namespace
 
 namespace dorado {
 std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
         std::shared_ptr<dorado::Read> template_read,
         std::shared_ptr<dorado::Read> complement_read) {
-    // We rely on the incoming read raw data being of type float16 to allow direct memcpy
-    // of tensor elements.
-    assert(template_read->raw_data.dtype() == torch::kFloat16);
-    assert(complement_read->raw_data.dtype() == torch::kFloat16);
-    using SampleType = c10::Half;
-
-    std::shared_ptr<dorado::Read> read = std::make_shared<dorado::Read>();  // Return read
-
     // We align the reverse complement of the complement read to the template read.
     const auto complement_sequence_reverse_complement =
             dorado::utils::reverse_complement(complement_read->seq);
@@ -36,6 +84,27 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
                        complement_sequence_reverse_complement.data(),
                        complement_sequence_reverse_complement.size(), align_config);
 
+    auto read = stereo_encode(template_read, complement_read,
+                              complement_sequence_reverse_complement, result);
+    edlibFreeAlignResult(result);
+    return read;
+}
+
+std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
+        const std::shared_ptr<dorado::Read>& template_read,
+        const std::shared_ptr<dorado::Read>& complement_read,
+        const std::string& complement_sequence_reverse_complement,
+        const EdlibAlignResult& result) {
+    // We rely on the incoming read raw data being contiguous float16 to allow direct copies
+    // of tensor elements.
+    assert(template_read->raw_data.dtype() == torch::kFloat16 &&
+           template_read->raw_data.is_contiguous());
+    assert(complement_read->raw_data.dtype() == torch::kFloat16 &&
+           complement_read->raw_data.is_contiguous());
+    using SampleType = c10::Half;
+
+    std::shared_ptr<dorado::Read> read = std::make_shared<dorado::Read>();  // Return read
+
     int query_cursor = 0;
     int target_cursor = result.startLocations[0];
     float alignment_error_rate = (float)result.editDistance / (float)result.alignmentLength;
@@ -58,20 +127,94 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
 
     if (!consensus_possible) {
         // There wasn't a good enough match -- return early with an empty read.
-        edlibFreeAlignResult(result);
         ++m_num_discarded_pairs;
         return read;
     }
 
     // Edlib doesn't provide named constants for alignment array entries, so do it here.
-    static constexpr unsigned char kAlignMatch = 0;
     static constexpr unsigned char kAlignInsertionToTarget = 1;
     static constexpr unsigned char kAlignInsertionToQuery = 2;
-    static constexpr unsigned char kAlignMismatch = 3;
 
-    // Move along the alignment, filling out the stereo-encoded tensor
-    const int max_size = template_read->raw_data.size(0) + complement_read->raw_data.size(0);
-    const auto opts = torch::TensorOptions().dtype(torch::kFloat16).device(torch::kCPU);
+    auto& scratch = t_scratch;
+
+    // Sample offsets at which each template base starts.
+    const int template_num_samples = static_cast<int>(template_read->raw_data.size(0));
+    auto& template_base_starts = scratch.template_base_starts;
+    template_base_starts.clear();
+    find_moves(template_read->moves.data(), template_read->moves.size(), template_base_starts);
+    for (auto& start : template_base_starts) {
+        start = std::min(start * m_input_signal_stride, template_num_samples);
+    }
+
+    // Offsets into the reversed complement signal at which each base of its reverse complement
+    // starts.  A base starting at sample s of the complement ends where the next one starts,
+    // which is sample (moves length - s) of the reversed signal.  The reversed signal is always
+    // treated as starting a base at its first sample.
+    const int complement_num_samples = static_cast<int>(complement_read->raw_data.size(0));
+    const int complement_moves_length =
+            std::max(static_cast<int>(complement_read->moves.size()) * m_input_signal_stride,
+                     complement_num_samples);
+    auto& complement_move_indices = scratch.complement_move_indices;
+    complement_move_indices.clear();
+    find_moves(complement_read->moves.data(), complement_read->moves.size(),
+               complement_move_indices);
+    auto& complement_base_starts = scratch.complement_base_starts;
+    complement_base_starts.clear();
+    complement_base_starts.push_back(0);
+    for (auto it = complement_move_indices.rbegin(); it != complement_move_indices.rend(); ++it) {
+        if (*it > 0) {
+            const int start = complement_moves_length - *it * m_input_signal_stride;
+            complement_base_starts.push_back(std::min(start, complement_num_samples));
+        }
+    }
+    // Unless the complement's first move is set, its reversed signal has an extra leading base.
+    const int complement_base_offset =
+            (!complement_read->moves.empty() && complement_read->moves[0]) ? 0 : 1;
+
+    // Calls segment_fn(alignment_index, template_samples, complement_samples, target_cursor,
+    // query_cursor) for each alignment position, with the [begin, end) ranges of the samples
+    // of the bases it consumes, and the cursors at those bases.
+    const auto for_each_segment = [&](auto segment_fn) {
+        const auto base_samples = [](const std::vector<int>& base_starts, int base,
+                                     int num_samples) {
+            const int num_bases = static_cast<int>(base_starts.size());
+            const int begin = base < num_bases ? base_starts[base] : num_samples;
+            const int end = base + 1 < num_bases ? base_starts[base + 1] : num_samples;
+            return std::make_pair(begin, std::max(begin, end));
+        };
+        int target = target_cursor;
+        int query = query_cursor;
+        for (int i = start_alignment_position; i < end_alignment_position; i++) {
+            std::pair<int, int> template_samples{0, 0};
+            std::pair<int, int> complement_samples{0, 0};
+            // If there is *not* an insertion to the query, the position consumes a template base.
+            if (result.alignment[i] != kAlignInsertionToQuery) {
+                template_samples =
+                        base_samples(template_base_starts, target, template_num_samples);
+            }
+            // If there is *not* an insertion to the target, it consumes a complement base.
+            if (result.alignment[i] != kAlignInsertionToTarget) {
+                complement_samples = base_samples(complement_base_starts,
+                                                  query + complement_base_offset,
+                                                  complement_num_samples);
+            }
+            segment_fn(i, template_samples, complement_samples, target, query);
+            if (result.alignment[i] != kAlignInsertionToQuery) {
+                ++target;
+            }
+            if (result.alignment[i] != kAlignInsertionToTarget) {
+                ++query;
+            }
+        }
+    };
+
+    // Size the output exactly, so that it needs neither trimming nor zero-filling up front.
+    int stereo_length = 0;
+    for_each_segment([&](int, std::pair<int, int> template_samples,
+                         std::pair<int, int> complement_samples, int, int) {
+        stereo_length += std::max(template_samples.second - template_samples.first,
+                                  complement_samples.second - complement_samples.first);
+    });
 
     static constexpr int kNumFeatures = 13;
     // Indices of features in the first dimension of the output tensor.
@@ -82,174 +225,83 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
     static constexpr int kFeatureMoveTable = 10;
     static constexpr int kFeatureTemplateQScore = 11;
     static constexpr int kFeatureComplementQScore = 12;
-    auto tmp = torch::zeros({kNumFeatures, max_size}, opts);
-
-    int template_signal_cursor = 0;
-    int complement_signal_cursor = 0;
-
-    std::vector<uint8_t> template_moves_expanded;
-    for (int i = 0; i < template_read->moves.size(); i++) {
-        template_moves_expanded.push_back(template_read->moves[i]);
-        for (int j = 0; j < m_input_signal_stride - 1; j++) {
-            template_moves_expanded.push_back(0);
-        }
-    }
-
-    int extra_padding = template_read->raw_data.size(0) - template_moves_expanded.size();
-    for (int i = 0; i < extra_padding; i++) {
-        template_moves_expanded.push_back(0);
-    }
-
-    int template_moves_seen = template_moves_expanded[template_signal_cursor];
-    while (template_moves_seen < target_cursor + 1) {
-        template_signal_cursor++;
-        template_moves_seen += template_moves_expanded[template_signal_cursor];
-    }
-
-    std::vector<uint8_t> complement_moves_expanded;
-    for (int i = 0; i < complement_read->moves.size(); i++) {
-        complement_moves_expanded.push_back(complement_read->moves[i]);
-        for (int j = 0; j < m_input_signal_stride - 1; j++) {
-            complement_moves_expanded.push_back(0);
-        }
-    }
-
-    extra_padding = complement_read->raw_data.size(0) - complement_moves_expanded.size();
-    for (int i = 0; i < extra_padding; i++) {
-        complement_moves_expanded.push_back(0);
-    }
-    complement_moves_expanded.push_back(1);
-    std::reverse(complement_moves_expanded.begin(), complement_moves_expanded.end());
-    complement_moves_expanded.pop_back();
-
-    auto complement_signal = complement_read->raw_data;
-    complement_signal = torch::flip(complement_read->raw_data, 0);
-
-    int complement_moves_seen = complement_read->moves[complement_signal_cursor];
-    while (complement_moves_seen < query_cursor + 1) {
-        complement_signal_cursor++;
-        complement_moves_seen += complement_moves_expanded[complement_signal_cursor];
-    }
-
-    const float pad_value = 0.8 * std::min(torch::min(complement_signal).item<float>(),
-                                           torch::min(template_read->raw_data).item<float>());
-
-    // Start with all signal feature entries equal to the padding value.
-    tmp.index({torch::indexing::Slice(None, 2)}) = pad_value;
+    const auto opts = torch::TensorOptions().dtype(torch::kFloat16).device(torch::kCPU);
+    auto stereo_features = torch::empty({kNumFeatures, stereo_length}, opts);
 
     // libtorch indexing calls go on a carefree romp through various heap
     // allocations/deallocations and object constructions/destructions, and so are
-    // glacially slow.  We therefore work with raw pointers within the main loop.
+    // glacially slow.  We therefore work with raw pointers throughout.
     const auto* const template_raw_data_ptr =
-            static_cast<SampleType*>(template_read->raw_data.data_ptr());
-    const auto* const flipped_complement_raw_data_ptr =
-            static_cast<SampleType*>(complement_signal.data_ptr());
+            static_cast<const SampleType*>(template_read->raw_data.data_ptr());
+    const auto* const complement_raw_data_ptr =
+            static_cast<const SampleType*>(complement_read->raw_data.data_ptr());
 
     std::array<SampleType*, kNumFeatures> feature_ptrs;
+    auto* const stereo_features_ptr = static_cast<SampleType*>(stereo_features.data_ptr());
     for (int feature_idx = 0; feature_idx < kNumFeatures; ++feature_idx) {
-        auto& feature_ptr = feature_ptrs[feature_idx];
-        feature_ptr = static_cast<SampleType*>(tmp[feature_idx].data_ptr());
+        feature_ptrs[feature_idx] = stereo_features_ptr + size_t(feature_idx) * stereo_length;
     }
+    // The features after the signals are zero wherever they aren't set below.
+    std::fill_n(feature_ptrs[kFeatureTemplateFirstNucleotide],
+                size_t(kNumFeatures - kFeatureTemplateFirstNucleotide) * stereo_length,
+                static_cast<SampleType>(0.0f));
+
+    // Signal feature entries not covered by a read's samples are padded.
+    const float pad_value =
+            0.8 * std::min(min_sample(complement_raw_data_ptr, complement_num_samples),
+                           min_sample(template_raw_data_ptr, template_num_samples));
+    const auto pad_sample = static_cast<SampleType>(pad_value);
+
+    // Converts Q scores from char to SampleType, with appropriate scale/offset.
+    const auto convert_q_score = [](char q_in) {
+        return static_cast<SampleType>(static_cast<float>(q_in - 33) / 90.0f);
+    };
 
     int stereo_global_cursor = 0;  // Index into the stereo-encoded signal
-    for (int i = start_alignment_position; i < end_alignment_position; i++) {
-        // We move along every alignment position. For every position we need to add signal and padding.
-        // Let us add the respective nucleotides and q-scores
-        int template_segment_length = 0;    // index into this segment in signal-space
-        int complement_segment_length = 0;  // index into this segment in signal-space
-
-        // If there is *not* an insertion to the query, add the nucleotide from the target cursor
-        if (result.alignment[i] != kAlignInsertionToQuery) {
-            // TODO -- these memcpys could be merged
-            std::memcpy(&feature_ptrs[kFeatureTemplateSignal]
-                                     [stereo_global_cursor + template_segment_length],
-                        &template_raw_data_ptr[template_signal_cursor], sizeof(SampleType));
-            template_segment_length++;
-            template_signal_cursor++;
-            auto max_signal_length = template_moves_expanded.size();
-
-            // We are relying on strings of 0s ended in a 1.  It would be more efficient
-            // in any case to store run length data above.
-            // We're also assuming uint8_t is an alias for char (not guaranteed in principle).
-            const auto* const start_ptr = &template_moves_expanded[template_signal_cursor];
-            auto* const next_move_ptr =
-                    static_cast<const uint8_t*>(std::memchr(start_ptr, 1, max_signal_length));
-            const size_t sample_count =
-                    next_move_ptr ? (next_move_ptr - start_ptr) : max_signal_length;
-
-            // Assumes contiguity of successive elements.
-            std::memcpy(&feature_ptrs[kFeatureTemplateSignal]
-                                     [stereo_global_cursor + template_segment_length],
-                        &template_raw_data_ptr[template_signal_cursor],
-                        sample_count * sizeof(SampleType));
-
-            template_signal_cursor += sample_count;
-            template_segment_length += sample_count;
-        }
-
-        // If there is *not* an insertion to the target, add the nucleotide from the query cursor
-        if (result.alignment[i] != kAlignInsertionToTarget) {
-            std::memcpy(&feature_ptrs[kFeatureComplementSignal]
-                                     [stereo_global_cursor + complement_segment_length],
-                        &flipped_complement_raw_data_ptr[complement_signal_cursor],
-                        sizeof(SampleType));
-
-            complement_segment_length++;
-            complement_signal_cursor++;
-            auto max_signal_length = complement_moves_expanded.size();
-
-            // See comments above.
-            const auto* const start_ptr = &complement_moves_expanded[complement_signal_cursor];
-            auto* const next_move_ptr =
-                    static_cast<const uint8_t*>(std::memchr(start_ptr, 1, max_signal_length));
-            const size_t sample_count =
-                    next_move_ptr ? (next_move_ptr - start_ptr) : max_signal_length;
-
-            std::memcpy(&feature_ptrs[kFeatureComplementSignal]
-                                     [stereo_global_cursor + complement_segment_length],
-                        &flipped_complement_raw_data_ptr[complement_signal_cursor],
-                        sample_count * sizeof(SampleType));
-
-            complement_signal_cursor += sample_count;
-            complement_segment_length += sample_count;
-        }
-
+    for_each_segment([&](int i, std::pair<int, int> template_samples,
+                         std::pair<int, int> complement_samples, int target, int query) {
+        const int template_segment_length = template_samples.second - template_samples.first;
+        const int complement_segment_length =
+                complement_samples.second - complement_samples.first;
         const int total_segment_length =
                 std::max(template_segment_length, complement_segment_length);
         const int start_ts = stereo_global_cursor;
 
-        // Converts Q scores from char to SampleType, with appropriate scale/offset.
-        const auto convert_q_score = [](char q_in) {
-            return static_cast<SampleType>(static_cast<float>(q_in - 33) / 90.0f);
-        };
+        // Add the signal of the bases consumed, and padding.
+        auto* const template_signal = &feature_ptrs[kFeatureTemplateSignal][start_ts];
+        std::copy_n(&template_raw_data_ptr[template_samples.first], template_segment_length,
+                    template_signal);
+        std::fill(template_signal + template_segment_length,
+                  template_signal + total_segment_length, pad_sample);
+
+        // The complement signal is read in reverse.
+        auto* const complement_signal = &feature_ptrs[kFeatureComplementSignal][start_ts];
+        const auto* const complement_segment_end =
+                complement_raw_data_ptr + complement_num_samples - complement_samples.first;
+        std::reverse_copy(complement_segment_end - complement_segment_length,
+                          complement_segment_end, complement_signal);
+        std::fill(complement_signal + complement_segment_length,
+                  complement_signal + total_segment_length, pad_sample);
 
         // Now, add the nucleotides and q scores
         if (result.alignment[i] != kAlignInsertionToQuery) {
-            const char nucleotide = template_read->seq[target_cursor];
+            const char nucleotide = template_read->seq[target];
             const auto nucleotide_feature_idx =
                     kFeatureTemplateFirstNucleotide + dorado::utils::base_to_int(nucleotide);
             std::fill_n(&feature_ptrs[nucleotide_feature_idx][start_ts], total_segment_length,
                         static_cast<SampleType>(1.0f));
             std::fill_n(&feature_ptrs[kFeatureTemplateQScore][start_ts], total_segment_length,
-                        convert_q_score(template_read->qstring[target_cursor]));
-
-            // Anything but a query insertion causes the target cursor to advance.
-            ++target_cursor;
+                        convert_q_score(template_read->qstring[target]));
         }
 
-        // Now, add the nucleotides and q scores
         if (result.alignment[i] != kAlignInsertionToTarget) {
-            const char nucleotide = complement_sequence_reverse_complement.at(query_cursor);
+            const char nucleotide = complement_sequence_reverse_complement.at(query);
             const auto nucleotide_feature_idx =
                     kFeatureComplementFirstNucleotide + dorado::utils::base_to_int(nucleotide);
-
             std::fill_n(&feature_ptrs[nucleotide_feature_idx][start_ts], total_segment_length,
                         static_cast<SampleType>(1.0f));
             std::fill_n(&feature_ptrs[kFeatureComplementQScore][start_ts], total_segment_length,
-                        convert_q_score(complement_read->qstring.rbegin()[query_cursor]));
-
-            // Anything but a target insertion causes the query cursor to advance.
-            ++query_cursor;
+                        convert_q_score(complement_read->qstring.rbegin()[query]));
         }
 
         feature_ptrs[kFeatureMoveTable][stereo_global_cursor] =
@@ -257,75 +309,178 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
 
         // Update the global cursor
         stereo_global_cursor += total_segment_length;
-    }
-
-    tmp = tmp.index(
-            {torch::indexing::Slice(None), torch::indexing::Slice(None, stereo_global_cursor)});
+    });
 
     read->read_id = template_read->read_id + ";" + complement_read->read_id;
     read->read_tag = template_read->read_tag;
-    read->raw_data = tmp;  // use the encoded signal
+    read->raw_data = stereo_features;  // use the encoded signal
     read->is_duplex = true;
     read->run_id = template_read->run_id;
 
-    edlibFreeAlignResult(result);
-
     return read;
 }
 
-void StereoDuplexEncoderNode::worker_thread() {
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        if (std::holds_alternative<std::shared_ptr<ReadPair>>(message)) {
-            auto read_pair = std::get<std::shared_ptr<ReadPair>>(message);
-            std::shared_ptr<Read> stereo_encoded_read =
-                    stereo_encode(read_pair->read_1, read_pair->read_2);
-
-            if (stereo_encoded_read->raw_data.ndimension() ==
-                2) {  // 2 dims for stereo encoding, 1 for simplex
-                m_sink.push_message(
-                        stereo_encoded_read);  // Stereo-encoded read created, send it to sink
-            } else {
-                // announce to downstream that we rejected a candidate pair
-                --read_pair->read_1->num_duplex_candidate_pairs;
-                m_sink.push_message(CandidatePairRejectedMessage{});
+void StereoDuplexEncoderNode::push_encoded_pair(const ReadPair& read_pair,
+                                                std::shared_ptr<Read> stereo_encoded_read) {
+    if (stereo_encoded_read->raw_data.ndimension() ==
+        2) {  // 2 dims for stereo encoding, 1 for simplex
+        m_sink.push_message(
+                std::move(stereo_encoded_read));  // Stereo-encoded read created, send it to sink
+    } else {
+        // announce to downstream that we rejected a candidate pair
+        --read_pair.read_1->num_duplex_candidate_pairs;
+        m_sink.push_message(CandidatePairRejectedMessage{read_pair.read_1->read_tag});
+    }
+}
+
+void StereoDuplexEncoderNode::process_message(Message&& message) {
+    if (std::holds_alternative<std::shared_ptr<ReadPair>>(message)) {
+        auto read_pair = std::get<std::shared_ptr<ReadPair>>(std::move(message));
+        if (m_aligner) {
+            // The pair is encoded once its batch has been aligned.
+            std::unique_lock lock(m_pairs_to_align_mutex);
+            const size_t max_pairs_queued = kMaxAlignmentBatchesQueued * m_alignment_batch_size;
+            m_pairs_to_align_space_cv.wait(
+                    lock, [&] { return m_pairs_to_align.size() < max_pairs_queued; });
+            m_pairs_to_align.push_back(std::move(read_pair));
+            if (m_pairs_to_align.size() >= m_alignment_batch_size) {
+                m_pairs_to_align_cv.notify_one();
+            }
+            return;
+        }
+        push_encoded_pair(*read_pair, stereo_encode(read_pair->read_1, read_pair->read_2));
+    } else if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+        m_sink.push_message(std::move(read));
+    }
+}
+
+void StereoDuplexEncoderNode::alignment_worker_thread() {
+    std::vector<std::shared_ptr<ReadPair>> batch;
+    bool terminating = false;
+    while (!terminating) {
+        {
+            // As the basecaller does with chunks, wait for a full batch, or else for the timeout.
+            std::unique_lock lock(m_pairs_to_align_mutex);
+            m_pairs_to_align_cv.wait_for(
+                    lock, std::chrono::milliseconds(m_alignment_batch_timeout_ms), [this] {
+                        return m_pairs_to_align.size() >= m_alignment_batch_size ||
+                               m_terminate_aligner;
+                    });
+            while (batch.size() < m_alignment_batch_size && !m_pairs_to_align.empty()) {
+                batch.push_back(std::move(m_pairs_to_align.front()));
+                m_pairs_to_align.pop_front();
             }
-        } else if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
-            auto read = std::get<std::shared_ptr<Read>>(message);
-            m_sink.push_message(read);
+            terminating = m_terminate_aligner && m_pairs_to_align.empty();
+        }
+        m_pairs_to_align_space_cv.notify_all();
+        if (!batch.empty()) {
+            align_batch(batch);
+            batch.clear();
         }
     }
 
-    int num_worker_threads = --m_num_worker_threads;
-    if (num_worker_threads == 0) {
-        m_sink.terminate();
+    // Every pair has been aligned, so the node is finished once their encoding is.
+    std::unique_lock lock(m_encoding_mutex);
+    m_encoding_cv.wait(lock, [this] { return m_num_pairs_encoding == 0; });
+    lock.unlock();
+    m_sink.terminate();
+}
+
+void StereoDuplexEncoderNode::align_batch(std::vector<std::shared_ptr<ReadPair>>& batch) {
+    std::vector<std::string> complement_reverse_complements;
+    std::vector<utils::BandedAligner::SequencePair> sequences;
+    complement_reverse_complements.reserve(batch.size());
+    sequences.reserve(batch.size());
+    for (const auto& read_pair : batch) {
+        const auto& complement_sequence_reverse_complement =
+                complement_reverse_complements.emplace_back(
+                        utils::reverse_complement(read_pair->read_2->seq));
+        sequences.emplace_back(read_pair->read_1->seq, complement_sequence_reverse_complement);
+    }
+    auto alignments = m_aligner->align(sequences);
+    ++m_num_alignment_batches;
+
+    {
+        std::lock_guard lock(m_encoding_mutex);
+        m_num_pairs_encoding += static_cast<int>(batch.size());
+    }
+    auto& pool = utils::ThreadPool::shared();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        pool.submit([this, read_pair = std::move(batch[i]),
+                     complement_sequence_reverse_complement =
+                             std::move(complement_reverse_complements[i]),
+                     alignment = std::move(alignments[i])]() mutable {
+            std::shared_ptr<Read> stereo_encoded_read;
+            if (alignment.edit_distance >= 0) {
+                stereo_encoded_read = stereo_encode(read_pair->read_1, read_pair->read_2,
+                                                    complement_sequence_reverse_complement,
+                                                    utils::as_edlib_result(alignment));
+            } else {
+                // The band was too narrow for this pair, so align it on the CPU instead.
+                ++m_num_alignment_fallbacks;
+                stereo_encoded_read = stereo_encode(read_pair->read_1, read_pair->read_2);
+            }
+            push_encoded_pair(*read_pair, std::move(stereo_encoded_read));
+
+            std::lock_guard lock(m_encoding_mutex);
+            --m_num_pairs_encoding;
+            // Notify while holding the mutex, since the node can be destroyed once the count
+            // reaches 0.
+            m_encoding_cv.notify_all();
+        });
     }
 }
 
-StereoDuplexEncoderNode::StereoDuplexEncoderNode(MessageSink& sink, int input_signal_stride)
+StereoDuplexEncoderNode::StereoDuplexEncoderNode(MessageSink& sink,
+                                                 int input_signal_stride,
+                                                 std::shared_ptr<utils::BandedAligner> aligner,
+                                                 size_t alignment_batch_size,
+                                                 int alignment_batch_timeout_ms)
         : MessageSink(1000),
           m_sink(sink),
-          m_num_worker_threads(std::thread::hardware_concurrency()),
-          m_input_signal_stride(input_signal_stride) {
-    for (int i = 0; i < m_num_worker_threads; i++) {
-        std::unique_ptr<std::thread> stereo_encoder_worker_thread =
-                std::make_unique<std::thread>(&StereoDuplexEncoderNode::worker_thread, this);
-        worker_threads.push_back(std::move(stereo_encoder_worker_thread));
+          m_input_signal_stride(input_signal_stride),
+          m_aligner(std::move(aligner)),
+          m_alignment_batch_size(std::max(alignment_batch_size, size_t(1))),
+          m_alignment_batch_timeout_ms(alignment_batch_timeout_ms) {
+    if (m_aligner) {
+        m_alignment_thread = std::thread(&StereoDuplexEncoderNode::alignment_worker_thread, this);
     }
+    // Encoding can use every thread of the pool when the other nodes are idle.
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); },
+                          static_cast<int>(utils::ThreadPool::shared().num_threads()), [this] {
+                              if (!m_aligner) {
+                                  m_sink.terminate();
+                                  return;
+                              }
+                              // The alignment thread terminates the sink after the last batch.
+                              std::lock_guard lock(m_pairs_to_align_mutex);
+                              m_terminate_aligner = true;
+                              m_pairs_to_align_cv.notify_one();
+                          });
 }
 
 StereoDuplexEncoderNode::~StereoDuplexEncoderNode() {
     terminate();
-    for (auto& t : worker_threads) {
-        t->join();
-    }
+    join();
 
     m_sink.terminate();
 }
 
+void StereoDuplexEncoderNode::join() {
+    join_pool_processing();
+    if (m_alignment_thread.joinable()) {
+        m_alignment_thread.join();
+    }
+}
+
 stats::NamedStats StereoDuplexEncoderNode::sample_stats() const {
     stats::NamedStats stats = m_work_queue.sample_stats();
     stats["discarded_pairs"] = m_num_discarded_pairs;
+    if (m_aligner) {
+        stats["alignment_batches"] = m_num_alignment_batches;
+        stats["alignment_fallbacks"] = m_num_alignment_fallbacks;
+    }
     return stats;
 }
 
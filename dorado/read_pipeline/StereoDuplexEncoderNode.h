@@ -1,38 +1,82 @@
 #pragma once
+#include "3rdparty/edlib/edlib/include/edlib.h"
 #include "ReadPipeline.h"
+#include "utils/BandedAligner.h"
 #include "utils/stats.h"
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace dorado {
 
 class StereoDuplexEncoderNode : public MessageSink {
 public:
-    StereoDuplexEncoderNode(MessageSink &sink, int input_signal_stride);
+    // With an aligner, pairs are gathered into batches of alignment_batch_size, or fewer if no
+    // more arrive within alignment_batch_timeout_ms, and each batch is aligned in one go before
+    // its pairs are encoded.  Otherwise each pair is aligned with edlib as it is encoded.
+    StereoDuplexEncoderNode(MessageSink &sink,
+                            int input_signal_stride,
+                            std::shared_ptr<utils::BandedAligner> aligner = nullptr,
+                            size_t alignment_batch_size = 1024,
+                            int alignment_batch_timeout_ms = 100);
 
     std::shared_ptr<dorado::Read> stereo_encode(std::shared_ptr<dorado::Read> template_read,
                                                 std::shared_ptr<dorado::Read> complement_read);
 
     ~StereoDuplexEncoderNode();
+    void join() override;
     std::string get_name() const override { return "StereoDuplexEncoderNode"; }
     stats::NamedStats sample_stats() const override;
 
 private:
-    // Consume reads from input queue
-    void worker_thread();
-    MessageSink &m_sink;
+    // Encodes a read pair given the alignment of its template to its complement's reverse
+    // complement.
+    std::shared_ptr<dorado::Read> stereo_encode(
+            const std::shared_ptr<dorado::Read> &template_read,
+            const std::shared_ptr<dorado::Read> &complement_read,
+            const std::string &complement_sequence_reverse_complement,
+            const EdlibAlignResult &result);
+    // Sends on the encoded read, or tells downstream that the pair was rejected.
+    void push_encoded_pair(const ReadPair &read_pair, std::shared_ptr<Read> stereo_encoded_read);
 
-    std::vector<std::unique_ptr<std::thread>> worker_threads;
-    std::atomic<int> m_num_worker_threads;
+    // Encodes a read pair, on the shared CPU thread pool.
+    void process_message(Message &&message);
+    MessageSink &m_sink;
 
     // The stride which was used to simplex call the data
     int m_input_signal_stride;
 
+    // Batched alignment.  Pairs wait in m_pairs_to_align for the alignment thread, which
+    // submits the encoding of each aligned pair to the thread pool.
+    void alignment_worker_thread();
+    void align_batch(std::vector<std::shared_ptr<ReadPair>> &batch);
+    // Pairs queued beyond this many batches hold up the pool threads adding them.
+    static constexpr size_t kMaxAlignmentBatchesQueued = 4;
+    std::shared_ptr<utils::BandedAligner> m_aligner;
+    const size_t m_alignment_batch_size;
+    const int m_alignment_batch_timeout_ms;
+    std::mutex m_pairs_to_align_mutex;
+    std::condition_variable m_pairs_to_align_cv;
+    std::condition_variable m_pairs_to_align_space_cv;
+    std::deque<std::shared_ptr<ReadPair>> m_pairs_to_align;
+    bool m_terminate_aligner{false};
+    std::thread m_alignment_thread;
+    // Aligned pairs whose encoding hasn't finished.
+    std::mutex m_encoding_mutex;
+    std::condition_variable m_encoding_cv;
+    int m_num_pairs_encoding{0};
+
     // Performance monitoring stats.
     std::atomic<int64_t> m_num_discarded_pairs = 0;
+    std::atomic<int64_t> m_num_alignment_batches = 0;
+    std::atomic<int64_t> m_num_alignment_fallbacks = 0;
 };
 
-}  // namespace dorado
\ No newline at end of file
+}  // namespace dorado
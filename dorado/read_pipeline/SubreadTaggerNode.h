@@ -1,10 +1,10 @@
 #pragma once
 #include "ReadPipeline.h"
 
+#include <array>
 #include <atomic>
-#include <list>
 #include <mutex>
-#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace dorado {
@@ -13,20 +13,40 @@ class SubreadTaggerNode : public MessageSink {
 public:
     SubreadTaggerNode(MessageSink& sink, int num_worker_threads = 1, size_t max_reads = 1000);
     ~SubreadTaggerNode();
+    void join() override;
+    std::string get_name() const override { return "SubreadTaggerNode"; }
+    stats::NamedStats sample_stats() const override;
 
 private:
-    void worker_thread();
+    // The subreads of an input read, and the duplex reads called from them, until all of them
+    // have arrived.
+    struct SubreadGroup {
+        std::vector<std::shared_ptr<Read>> subreads;
+        std::vector<std::shared_ptr<Read>> duplex_reads;
+    };
+
+    // Groups are keyed by read_tag, and spread across shards with a lock each, so that
+    // messages for different groups rarely wait for each other.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, SubreadGroup> groups;
+    };
+    static constexpr size_t kNumShards = 64;
+
+    // Groups subreads with their duplex reads, on the shared CPU thread pool.
+    void process_message(Message&& message);
+
+    // If every subread of the group, and a duplex read or a rejection for each of its
+    // candidate pairs, has arrived, moves its reads to completed_reads and returns true.
+    static bool take_if_complete(SubreadGroup& group,
+                                 std::vector<std::shared_ptr<Read>>& completed_reads);
 
     MessageSink& m_sink;
-    std::vector<std::unique_ptr<std::thread>> worker_threads;
-    std::atomic<int> m_num_worker_threads;
+    std::array<Shard, kNumShards> m_shards;
 
-    std::mutex m_subread_groups_mutex;
-    std::unordered_map<uint64_t, std::vector<std::shared_ptr<Read>>> m_subread_groups;
-
-    std::mutex m_duplex_reads_mutex;
-    std::list<std::shared_ptr<Read>> m_duplex_reads;
-    std::list<std::vector<std::shared_ptr<Read>>> m_full_subread_groups;
+    // Performance monitoring stats.
+    std::atomic<int64_t> m_num_grouped_reads{0};
+    std::atomic<int64_t> m_grouped_reads_bytes{0};
 };
 
 }  // namespace dorado
@@ -0,0 +1,73 @@
+#include "SummaryWriterNode.h"
+
+#include "utils/summary_utils.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace dorado {
+
+void SummaryWriterNode::append_row(const Read& read, std::string& row) {
+    // As generated for the read's record by Read::generate_read_tags, and converted by
+    // `dorado summary`, so that the rows are the same.
+    const int num_samples = read.get_num_raw_samples() + read.num_trimmed_samples;
+    const int trim_samples = read.num_trimmed_samples;
+    const float duration = (float)num_samples / (float)read.sample_rate;
+    const int mean_qscore = static_cast<int>(std::round(read.mean_qscore()));
+
+    float sample_rate = num_samples / duration;
+    float template_duration = (num_samples - trim_samples) / sample_rate;
+    double start_time =
+            (static_cast<int64_t>(read.start_time_ms) -
+             static_cast<int64_t>(read.run_acquisition_start_time_ms)) /
+            1e3;
+    auto template_start_time = start_time + (duration - template_duration);
+
+    utils::SummaryRowWriter writer(row, "\t");
+    writer.first(read.attributes.fast5_filename)
+            << read.read_id << read.run_id << read.attributes.channel_number
+            << static_cast<int>(read.attributes.mux) << start_time << duration
+            << template_start_time << template_duration << static_cast<int>(read.seq.size())
+            << mean_qscore;
+    row.push_back('\n');
+}
+
+void SummaryWriterNode::process_message(Message&& message) {
+    if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        m_row.clear();
+        append_row(*std::get<std::shared_ptr<Read>>(message), m_row);
+        m_file.write(m_row.data(), m_row.size());
+        ++m_num_rows_written;
+    }
+    m_sink.push_message(std::move(message));
+}
+
+SummaryWriterNode::SummaryWriterNode(MessageSink& sink, const std::string& filename)
+        : MessageSink(1000), m_sink(sink), m_file(filename) {
+    if (!m_file) {
+        throw std::runtime_error("Could not open summary file: " + filename);
+    }
+    const auto header = utils::summary_header(false, "\t");
+    m_file.write(header.data(), header.size());
+    start_pool_processing([this](Message&& message) { process_message(std::move(message)); }, 1,
+                          [this] {
+                              m_file.flush();
+                              m_sink.terminate();
+                          });
+}
+
+SummaryWriterNode::~SummaryWriterNode() {
+    terminate();
+    join();
+    m_sink.terminate();
+}
+
+void SummaryWriterNode::join() { join_pool_processing(); }
+
+stats::NamedStats SummaryWriterNode::sample_stats() const {
+    stats::NamedStats stats = stats::from_obj(m_work_queue);
+    stats["rows_written"] = m_num_rows_written;
+    return stats;
+}
+
+}  // namespace dorado
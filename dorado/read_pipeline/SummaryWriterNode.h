@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace dorado {
+
+/// Class to write a sequencing summary row for each read as it passes on to the sink, so
+/// that the summary doesn't need a second pass over the output with `dorado summary`.
+/// Rows have the columns `dorado summary` writes for unaligned reads, separated by tabs.
+class SummaryWriterNode : public MessageSink {
+public:
+    SummaryWriterNode(MessageSink& sink, const std::string& filename);
+    ~SummaryWriterNode();
+    void join() override;
+    std::string get_name() const override { return "SummaryWriterNode"; }
+    stats::NamedStats sample_stats() const override;
+
+    // Appends the summary row of a read, ending in a newline.
+    static void append_row(const Read& read, std::string& row);
+
+private:
+    // Writes the row of a read, on the shared CPU thread pool, one read at a time.
+    void process_message(Message&& message);
+
+    MessageSink& m_sink;
+    std::ofstream m_file;
+    std::string m_row;
+    std::atomic<int64_t> m_num_rows_written{0};
+};
+
+}  // namespace dorado
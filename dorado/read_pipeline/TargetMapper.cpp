@@ -0,0 +1,125 @@
+#include "TargetMapper.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace dorado {
+
+TargetMapper::TargetMapper(const std::string& reference,
+                           const std::string& bed_file,
+                           int k,
+                           int w,
+                           uint64_t index_batch_size,
+                           int min_mapq,
+                           int threads)
+        : m_min_mapq(min_mapq) {
+    if (!std::filesystem::exists(reference)) {
+        throw std::runtime_error("Target reference path does not exist: " + reference);
+    }
+    mm_set_opt(0, &m_idx_opt, &m_map_opt);
+    mm_set_opt("map-ont", &m_idx_opt, &m_map_opt);
+    m_idx_opt.k = k;
+    m_idx_opt.w = w;
+    m_idx_opt.batch_size = index_batch_size;
+    m_idx_opt.mini_batch_size = index_batch_size;
+    // Unlike the aligner, no CIGAR is generated, since only where reads map is needed.
+    mm_check_opt(&m_idx_opt, &m_map_opt);
+
+    auto* index_reader = mm_idx_reader_open(reference.c_str(), &m_idx_opt, nullptr);
+    if (!index_reader) {
+        throw std::runtime_error("Failed to open target reference: " + reference);
+    }
+    while (auto* index_part = mm_idx_reader_read(index_reader, threads)) {
+        m_index_parts.push_back(index_part);
+    }
+    mm_idx_reader_close(index_reader);
+    if (m_index_parts.empty()) {
+        throw std::runtime_error("Target reference contains no sequences: " + reference);
+    }
+    mm_mapopt_update(&m_map_opt, m_index_parts.front());
+
+    if (bed_file.empty()) {
+        return;
+    }
+    std::ifstream bed(bed_file);
+    if (!bed) {
+        throw std::runtime_error("Failed to open target BED file: " + bed_file);
+    }
+    std::string line;
+    while (std::getline(bed, line)) {
+        if (line.empty() || line[0] == '#' || line.rfind("track", 0) == 0 ||
+            line.rfind("browser", 0) == 0) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string contig;
+        int64_t start = 0;
+        int64_t end = 0;
+        if (!(fields >> contig >> start >> end) || start < 0 || end < start) {
+            throw std::runtime_error("Invalid line in target BED file " + bed_file + ": " + line);
+        }
+        m_targets[contig].emplace_back(int32_t(start), int32_t(end));
+    }
+    if (m_targets.empty()) {
+        throw std::runtime_error("Target BED file has no regions: " + bed_file);
+    }
+    size_t num_regions = 0;
+    for (auto& [contig, regions] : m_targets) {
+        std::sort(regions.begin(), regions.end());
+        num_regions += regions.size();
+    }
+    spdlog::info("> Loaded {} target regions from {}", num_regions, bed_file);
+}
+
+TargetMapper::~TargetMapper() {
+    for (auto* index_part : m_index_parts) {
+        mm_idx_destroy(index_part);
+    }
+}
+
+bool TargetMapper::overlaps_target(const std::string& contig, int32_t start, int32_t end) const {
+    if (m_targets.empty()) {
+        return true;
+    }
+    auto it = m_targets.find(contig);
+    if (it == m_targets.end()) {
+        return false;
+    }
+    // The regions which start before the mapping ends, of which any may reach into it.
+    const auto& regions = it->second;
+    const auto last = std::lower_bound(regions.begin(), regions.end(), std::make_pair(end, 0));
+    return std::any_of(regions.begin(), last,
+                       [start](const auto& region) { return region.second > start; });
+}
+
+bool TargetMapper::is_on_target(const std::string& seq) const {
+    std::unique_ptr<mm_tbuf_t, void (*)(mm_tbuf_t*)> buf(mm_tbuf_init(), mm_tbuf_destroy);
+    bool on_target = false;
+    for (const auto* index_part : m_index_parts) {
+        int num_regs = 0;
+        mm_reg1_t* regs = mm_map(index_part, int(seq.size()), seq.c_str(), &num_regs, buf.get(),
+                                 &m_map_opt, nullptr);
+        for (int i = 0; i < num_regs; ++i) {
+            const auto& reg = regs[i];
+            if (!on_target && reg.id == reg.parent && int(reg.mapq) >= m_min_mapq) {
+                on_target = overlaps_target(index_part->seq[reg.rid].name, reg.rs, reg.re);
+            }
+            std::free(reg.p);
+        }
+        std::free(regs);
+        if (on_target) {
+            break;
+        }
+    }
+    return on_target;
+}
+
+}  // namespace dorado
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "minimap.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dorado {
+
+// Decides whether a read is on target by mapping part of its sequence to a reference, for
+// calling only on-target reads in full.  Either every mapping to the reference is on target,
+// or only those overlapping a region of a BED file.  Thread-safe.
+class TargetMapper {
+public:
+    // |reference| is a reference to index, or a prebuilt minimap2 index.  If |bed_file| is
+    // given, its regions are the targets.  Mappings of lower quality than |min_mapq| are
+    // ignored.
+    TargetMapper(const std::string& reference,
+                 const std::string& bed_file,
+                 int k,
+                 int w,
+                 uint64_t index_batch_size,
+                 int min_mapq,
+                 int threads);
+    ~TargetMapper();
+    TargetMapper(const TargetMapper&) = delete;
+    TargetMapper& operator=(const TargetMapper&) = delete;
+
+    // Whether the primary mapping of seq is on target.  Sequences which don't map aren't.
+    bool is_on_target(const std::string& seq) const;
+
+private:
+    bool overlaps_target(const std::string& contig, int32_t start, int32_t end) const;
+
+    mm_idxopt_t m_idx_opt;
+    mm_mapopt_t m_map_opt;
+    std::vector<mm_idx_t*> m_index_parts;
+    int m_min_mapq;
+    // Target regions of each contig, as sorted [start, end) ranges.  Empty for no BED file.
+    std::unordered_map<std::string, std::vector<std::pair<int32_t, int32_t>>> m_targets;
+};
+
+}  // namespace dorado
@@ -0,0 +1,400 @@
+#include "ArrowStreamWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace dorado::utils {
+
+namespace {
+
+// Builds a flatbuffer, the encoding of Arrow's message metadata, front to back.  Each table is
+// written before the objects it refers to, since offsets must point forwards, and its offsets
+// are filled in once they have been written.  Scalars are written little endian, as is the
+// host, which is what the stream's schema declares.
+class FlatBufferWriter {
+public:
+    // Writes an object, returning its position in the buffer.
+    using Object = std::function<uint32_t(FlatBufferWriter&)>;
+
+    struct Field {
+        uint16_t id;
+        // Size of the field in bytes: 1, 2, 4 or 8.
+        size_t size;
+        // A scalar field's value.
+        uint64_t value;
+        // An offset field's object instead.
+        Object object;
+    };
+
+    static Field scalar(uint16_t id, size_t size, uint64_t value) { return {id, size, value, {}}; }
+    static Field offset(uint16_t id, Object object) { return {id, 4, 0, std::move(object)}; }
+
+    // The flatbuffer of root, padded to 8 bytes.
+    static std::vector<uint8_t> build(const Object& root) {
+        FlatBufferWriter writer;
+        writer.m_buf.resize(sizeof(uint32_t));
+        writer.set_offset(0, root(writer));
+        writer.align(8);
+        return std::move(writer.m_buf);
+    }
+
+    uint32_t table(const std::vector<Field>& fields) {
+        size_t num_slots = 0;
+        for (const auto& field : fields) {
+            num_slots = std::max(num_slots, size_t(field.id) + 1);
+        }
+        // Where each field is in the table, after the offset to its vtable, or 0 if absent.
+        std::vector<uint16_t> slots(num_slots, 0);
+        size_t table_size = sizeof(int32_t);
+        for (const auto& field : fields) {
+            table_size = (table_size + field.size - 1) / field.size * field.size;
+            slots[field.id] = uint16_t(table_size);
+            table_size += field.size;
+        }
+
+        align(2);
+        const auto vtable_pos = m_buf.size();
+        put<uint16_t>(uint16_t(sizeof(uint16_t) * (2 + num_slots)));
+        put<uint16_t>(uint16_t(table_size));
+        for (auto slot : slots) {
+            put<uint16_t>(slot);
+        }
+        align(8);
+        const auto table_pos = m_buf.size();
+        put<int32_t>(int32_t(table_pos - vtable_pos));
+        m_buf.resize(table_pos + table_size);
+        for (const auto& field : fields) {
+            if (!field.object) {
+                std::memcpy(&m_buf[table_pos + slots[field.id]], &field.value, field.size);
+            }
+        }
+        for (const auto& field : fields) {
+            if (field.object) {
+                set_offset(table_pos + slots[field.id], field.object(*this));
+            }
+        }
+        return uint32_t(table_pos);
+    }
+
+    uint32_t string(std::string_view value) {
+        align(4);
+        const auto pos = m_buf.size();
+        put<uint32_t>(uint32_t(value.size()));
+        m_buf.insert(m_buf.end(), value.begin(), value.end());
+        m_buf.push_back(0);
+        return uint32_t(pos);
+    }
+
+    uint32_t table_vector(const std::vector<Object>& tables) {
+        align(4);
+        const auto pos = m_buf.size();
+        put<uint32_t>(uint32_t(tables.size()));
+        const auto offsets_pos = m_buf.size();
+        m_buf.resize(offsets_pos + sizeof(uint32_t) * tables.size());
+        for (size_t i = 0; i < tables.size(); ++i) {
+            set_offset(offsets_pos + sizeof(uint32_t) * i, tables[i](*this));
+        }
+        return uint32_t(pos);
+    }
+
+    // A vector of structs made of int64s, given as the int64s of every struct in turn.
+    uint32_t int64_struct_vector(const std::vector<int64_t>& values, size_t struct_size) {
+        // The values must be 8 byte aligned, and the length comes just before them.
+        while ((m_buf.size() + sizeof(uint32_t)) % 8 != 0) {
+            m_buf.push_back(0);
+        }
+        const auto pos = m_buf.size();
+        put<uint32_t>(uint32_t(values.size() / struct_size));
+        for (auto value : values) {
+            put<int64_t>(value);
+        }
+        return uint32_t(pos);
+    }
+
+private:
+    template <typename T>
+    void put(T value) {
+        const auto pos = m_buf.size();
+        m_buf.resize(pos + sizeof(T));
+        std::memcpy(&m_buf[pos], &value, sizeof(T));
+    }
+
+    void set_offset(size_t pos, uint32_t target) {
+        const auto offset = uint32_t(target - pos);
+        std::memcpy(&m_buf[pos], &offset, sizeof(offset));
+    }
+
+    void align(size_t alignment) {
+        while (m_buf.size() % alignment != 0) {
+            m_buf.push_back(0);
+        }
+    }
+
+    std::vector<uint8_t> m_buf;
+};
+
+using Field = FlatBufferWriter::Field;
+using Object = FlatBufferWriter::Object;
+
+// Values of the flatbuffer enums and unions in Arrow's Schema.fbs and Message.fbs.
+constexpr uint64_t kMetadataVersionV5 = 4;
+constexpr uint64_t kMessageHeaderSchema = 1;
+constexpr uint64_t kMessageHeaderRecordBatch = 3;
+constexpr uint64_t kTypeInt = 2;
+constexpr uint64_t kTypeFloatingPoint = 3;
+constexpr uint64_t kTypeUtf8 = 5;
+constexpr uint64_t kTypeList = 12;
+constexpr uint64_t kPrecisionSingle = 1;
+
+constexpr uint32_t kContinuation = 0xFFFFFFFF;
+
+bool is_variable_width(ArrowStreamWriter::Type type) {
+    return type == ArrowStreamWriter::Type::Utf8 || type == ArrowStreamWriter::Type::UInt8List ||
+           type == ArrowStreamWriter::Type::UInt32List;
+}
+
+Object int_type(uint64_t bit_width, bool is_signed) {
+    return [=](FlatBufferWriter& fb) {
+        return fb.table({FlatBufferWriter::scalar(0, 4, bit_width),
+                         FlatBufferWriter::scalar(1, 1, is_signed)});
+    };
+}
+
+// A Field table.  List columns have a single child, the field of their items.
+Object field(const std::string& name, ArrowStreamWriter::Type type) {
+    using Type = ArrowStreamWriter::Type;
+    uint64_t type_id = kTypeInt;
+    Object type_table;
+    std::vector<Object> children;
+    switch (type) {
+    case Type::UInt8:
+        type_table = int_type(8, false);
+        break;
+    case Type::Int32:
+        type_table = int_type(32, true);
+        break;
+    case Type::UInt32:
+        type_table = int_type(32, false);
+        break;
+    case Type::UInt64:
+        type_table = int_type(64, false);
+        break;
+    case Type::Float32:
+        type_id = kTypeFloatingPoint;
+        type_table = [](FlatBufferWriter& fb) {
+            return fb.table({FlatBufferWriter::scalar(0, 2, kPrecisionSingle)});
+        };
+        break;
+    case Type::Utf8:
+    case Type::UInt8List:
+    case Type::UInt32List:
+        type_id = type == Type::Utf8 ? kTypeUtf8 : kTypeList;
+        type_table = [](FlatBufferWriter& fb) { return fb.table({}); };
+        if (type != Type::Utf8) {
+            children.push_back(field("item", type == Type::UInt8List ? Type::UInt8 : Type::UInt32));
+        }
+        break;
+    }
+    return [=](FlatBufferWriter& fb) {
+        return fb.table({
+                FlatBufferWriter::offset(0, [&](FlatBufferWriter& w) { return w.string(name); }),
+                FlatBufferWriter::scalar(1, 1, false),  // nullable
+                FlatBufferWriter::scalar(2, 1, type_id),
+                FlatBufferWriter::offset(3, type_table),
+                // Readers need the children, even when there are none.
+                FlatBufferWriter::offset(5,
+                                         [&](FlatBufferWriter& w) {
+                                             return w.table_vector(children);
+                                         }),
+        });
+    };
+}
+
+std::vector<uint8_t> message(uint64_t header_type, const Object& header, size_t body_length) {
+    return FlatBufferWriter::build([&](FlatBufferWriter& fb) {
+        return fb.table({
+                FlatBufferWriter::scalar(0, 2, kMetadataVersionV5),
+                FlatBufferWriter::scalar(1, 1, header_type),
+                FlatBufferWriter::offset(2, header),
+                FlatBufferWriter::scalar(3, 8, body_length),
+        });
+    });
+}
+
+}  // namespace
+
+ArrowStreamWriter::Column::Column(std::string name, Type type)
+        : m_name(std::move(name)), m_type(type) {
+    if (is_variable_width(m_type)) {
+        m_offsets.push_back(0);
+    }
+}
+
+void ArrowStreamWriter::Column::append(uint8_t value) {
+    append_fixed(&value, sizeof(value), Type::UInt8);
+}
+
+void ArrowStreamWriter::Column::append(int32_t value) {
+    append_fixed(&value, sizeof(value), Type::Int32);
+}
+
+void ArrowStreamWriter::Column::append(uint32_t value) {
+    append_fixed(&value, sizeof(value), Type::UInt32);
+}
+
+void ArrowStreamWriter::Column::append(uint64_t value) {
+    append_fixed(&value, sizeof(value), Type::UInt64);
+}
+
+void ArrowStreamWriter::Column::append(float value) {
+    append_fixed(&value, sizeof(value), Type::Float32);
+}
+
+void ArrowStreamWriter::Column::append(std::string_view value) {
+    append_variable(value.data(), value.size(), 1, Type::Utf8);
+}
+
+void ArrowStreamWriter::Column::append(const std::vector<uint8_t>& values) {
+    append_variable(values.data(), values.size(), sizeof(uint8_t), Type::UInt8List);
+}
+
+void ArrowStreamWriter::Column::append(const std::vector<uint32_t>& values) {
+    append_variable(values.data(), values.size(), sizeof(uint32_t), Type::UInt32List);
+}
+
+void ArrowStreamWriter::Column::append_fixed(const void* value, size_t size, Type type) {
+    if (type != m_type) {
+        throw std::runtime_error("Wrong type of value for Arrow column " + m_name);
+    }
+    const auto* bytes = static_cast<const uint8_t*>(value);
+    m_values.insert(m_values.end(), bytes, bytes + size);
+    ++m_num_rows;
+}
+
+void ArrowStreamWriter::Column::append_variable(const void* values,
+                                                size_t num_values,
+                                                size_t size,
+                                                Type type) {
+    if (type != m_type) {
+        throw std::runtime_error("Wrong type of value for Arrow column " + m_name);
+    }
+    // Offsets are 32 bit, so a batch's values must fit in them.
+    const size_t end = size_t(m_offsets.back()) + num_values;
+    if (end > size_t(std::numeric_limits<int32_t>::max())) {
+        throw std::runtime_error("Too many values in a batch of Arrow column " + m_name);
+    }
+    const auto* bytes = static_cast<const uint8_t*>(values);
+    m_values.insert(m_values.end(), bytes, bytes + num_values * size);
+    m_offsets.push_back(int32_t(end));
+    ++m_num_rows;
+}
+
+void ArrowStreamWriter::Column::clear() {
+    m_num_rows = 0;
+    m_values.clear();
+    if (is_variable_width(m_type)) {
+        m_offsets.assign(1, 0);
+    }
+}
+
+ArrowStreamWriter::ArrowStreamWriter(FILE* file, const std::vector<Column>& columns)
+        : m_file(file) {
+    std::vector<Object> fields;
+    for (const auto& column : columns) {
+        m_types.push_back(column.type());
+        fields.push_back(field(column.name(), column.type()));
+    }
+    const auto schema = [&](FlatBufferWriter& fb) {
+        return fb.table({FlatBufferWriter::offset(
+                1, [&](FlatBufferWriter& w) { return w.table_vector(fields); })});
+    };
+    write_message(message(kMessageHeaderSchema, schema, 0), {});
+}
+
+void ArrowStreamWriter::write_batch(std::vector<Column>& columns) {
+    if (m_finished || columns.size() != m_types.size()) {
+        throw std::runtime_error("Arrow batch doesn't match the stream's schema");
+    }
+    const auto num_rows = columns.empty() ? 0 : columns.front().num_rows();
+
+    // The body is every column's buffers, each padded to 8 bytes, and the metadata their
+    // positions, along with the length of each column and of each list's items.
+    std::vector<uint8_t> body;
+    std::vector<int64_t> nodes;
+    std::vector<int64_t> buffers;
+    const auto add_node = [&](size_t length) {
+        nodes.push_back(int64_t(length));
+        nodes.push_back(0);  // null_count
+    };
+    const auto add_buffer = [&](const void* data, size_t size) {
+        buffers.push_back(int64_t(body.size()));
+        buffers.push_back(int64_t(size));
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        body.insert(body.end(), bytes, bytes + size);
+        body.resize((body.size() + 7) / 8 * 8);
+    };
+    for (size_t i = 0; i < columns.size(); ++i) {
+        const auto& column = columns[i];
+        if (column.type() != m_types[i] || column.num_rows() != num_rows) {
+            throw std::runtime_error("Arrow batch doesn't match the stream's schema");
+        }
+        add_node(num_rows);
+        // With no nulls, the validity bitmap can be left out.
+        add_buffer(nullptr, 0);
+        if (column.type() == Type::Utf8) {
+            add_buffer(column.m_offsets.data(), sizeof(int32_t) * column.m_offsets.size());
+            add_buffer(column.m_values.data(), column.m_values.size());
+        } else if (is_variable_width(column.type())) {
+            add_buffer(column.m_offsets.data(), sizeof(int32_t) * column.m_offsets.size());
+            add_node(size_t(column.m_offsets.back()));
+            add_buffer(nullptr, 0);
+            add_buffer(column.m_values.data(), column.m_values.size());
+        } else {
+            add_buffer(column.m_values.data(), column.m_values.size());
+        }
+    }
+
+    const auto record_batch = [&](FlatBufferWriter& fb) {
+        return fb.table({
+                FlatBufferWriter::scalar(0, 8, num_rows),
+                FlatBufferWriter::offset(
+                        1, [&](FlatBufferWriter& w) { return w.int64_struct_vector(nodes, 2); }),
+                FlatBufferWriter::offset(
+                        2, [&](FlatBufferWriter& w) { return w.int64_struct_vector(buffers, 2); }),
+        });
+    };
+    write_message(message(kMessageHeaderRecordBatch, record_batch, body.size()), body);
+    ++m_num_batches_written;
+    for (auto& column : columns) {
+        column.clear();
+    }
+}
+
+void ArrowStreamWriter::finish() {
+    if (m_finished) {
+        return;
+    }
+    const uint32_t end_of_stream[] = {kContinuation, 0};
+    write(end_of_stream, sizeof(end_of_stream));
+    fflush(m_file);
+    m_finished = true;
+}
+
+void ArrowStreamWriter::write_message(const std::vector<uint8_t>& metadata,
+                                      const std::vector<uint8_t>& body) {
+    const uint32_t prefix[] = {kContinuation, uint32_t(metadata.size())};
+    write(prefix, sizeof(prefix));
+    write(metadata.data(), metadata.size());
+    write(body.data(), body.size());
+}
+
+void ArrowStreamWriter::write(const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, m_file) != size) {
+        throw std::runtime_error("Failed to write Arrow stream");
+    }
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dorado::utils {
+
+// Writes rows as an Arrow IPC stream (https://arrow.apache.org/docs/format/Columnar.html), a
+// schema message followed by record batches, which Arrow readers can use in place, with no
+// parsing.  Only the few column types dorado writes are supported, and no column has nulls.
+class ArrowStreamWriter {
+public:
+    enum class Type { UInt8, Int32, UInt32, UInt64, Float32, Utf8, UInt8List, UInt32List };
+
+    // One column of the record batch being built.
+    class Column {
+    public:
+        Column(std::string name, Type type);
+
+        const std::string& name() const { return m_name; }
+        Type type() const { return m_type; }
+        size_t num_rows() const { return m_num_rows; }
+
+        // Appends a value to a fixed width column, which must be of the matching type.
+        void append(uint8_t value);
+        void append(int32_t value);
+        void append(uint32_t value);
+        void append(uint64_t value);
+        void append(float value);
+        // Appends a string to a Utf8 column.
+        void append(std::string_view value);
+        // Appends a list to a UInt8List or UInt32List column.
+        void append(const std::vector<uint8_t>& values);
+        void append(const std::vector<uint32_t>& values);
+
+    private:
+        friend class ArrowStreamWriter;
+
+        void append_fixed(const void* value, size_t size, Type type);
+        void append_variable(const void* values, size_t num_values, size_t size, Type type);
+        void clear();
+
+        std::string m_name;
+        Type m_type;
+        size_t m_num_rows{0};
+        // Values, or for Utf8 and lists the bytes of every row's values.
+        std::vector<uint8_t> m_values;
+        // For Utf8 and lists, where each row's values start in m_values, in values, and the end.
+        std::vector<int32_t> m_offsets;
+    };
+
+    // Writes the schema of columns, which the columns of each batch must then match.  The
+    // file is not closed by the writer.
+    ArrowStreamWriter(FILE* file, const std::vector<Column>& columns);
+
+    // Writes the rows of columns as a record batch, and clears the columns for the next.
+    void write_batch(std::vector<Column>& columns);
+    // Writes the end of stream marker.  Nothing can be written afterwards.
+    void finish();
+
+    size_t num_batches_written() const { return m_num_batches_written; }
+
+private:
+    // Writes an encapsulated message: its metadata, padded to 8 bytes, and then its body.
+    void write_message(const std::vector<uint8_t>& metadata, const std::vector<uint8_t>& body);
+    void write(const void* data, size_t size);
+
+    FILE* m_file;
+    std::vector<Type> m_types;
+    size_t m_num_batches_written{0};
+    bool m_finished{false};
+};
+
+}  // namespace dorado::utils
@@ -1,17 +1,49 @@
 #pragma once
 
+#include "stats.h"
+#include "trace.h"
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <queue>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
+
+// Backend policies for AsyncQueue.
+// LockingQueuePolicy guards all queue state with a single mutex.  It is cheap when
+// uncontended and is the default.
+struct LockingQueuePolicy {};
+// LockFreeQueuePolicy uses a bounded ring buffer in which producers and consumers
+// claim slots with atomic operations, so concurrent pushes and pops do not serialise
+// on a mutex.  Threads only sleep when the queue is empty (for pops) or full (for pushes).
+struct LockFreeQueuePolicy {};
+
+// Outcome of the non-blocking queue operations.
+enum class QueueStatus { Success, Empty, Full, Terminated };
 
 // Asynchronous queue for producer/consumer use.
 // Items must be movable.
+template <class Item, class Policy = LockingQueuePolicy>
+class AsyncQueue;
+
 template <class Item>
-class AsyncQueue {
+class AsyncQueue<Item, LockingQueuePolicy> {
+    using Clock = dorado::stats::QueueLatencies::Clock;
+    struct Entry {
+        Item item;
+        Clock::time_point enqueue_time;
+    };
+
     // Guards the entire structure.  Should be held while adding/removing items,
     // or interacting with m_terminate.
     // Used for not-empty and not-full CV waits.
@@ -21,8 +53,8 @@ class AsyncQueue {
     std::condition_variable m_not_full_cv;
     // Signalled when an item has been added, and the queue therefore is not empty.
     std::condition_variable m_not_empty_cv;
-    // Holds the items.
-    std::queue<Item> m_items;
+    // Holds the items, along with when they were pushed.
+    std::queue<Entry> m_items;
     // Number of items that can be added before further additions block, pending
     // consumption of items.
     size_t m_capacity = 0;
@@ -32,6 +64,20 @@ class AsyncQueue {
     // Stats for monitoring queue usage.
     int64_t m_num_pushes = 0;
     int64_t m_num_pops = 0;
+    dorado::stats::QueueLatencies m_latencies;
+
+    // Waits on cv until pred holds, tracing the wait as name, if there is one to trace.
+    template <class Pred>
+    static void wait(std::unique_lock<std::mutex>& lock,
+                     std::condition_variable& cv,
+                     const char* name,
+                     Pred pred) {
+        if (pred()) {
+            return;
+        }
+        DORADO_TRACE_SCOPE(name);
+        cv.wait(lock, pred);
+    }
 
 public:
     // Attempts to push items beyond capacity will block.
@@ -52,13 +98,14 @@ public:
         std::unique_lock lock(m_mutex);
 
         // Ensure there is space for the new item, given our limit on capacity.
-        m_not_full_cv.wait(lock, [this] { return m_items.size() < m_capacity || m_terminate; });
+        wait(lock, m_not_full_cv, "queue_wait_push",
+             [this] { return m_items.size() < m_capacity || m_terminate; });
 
         // We hold the mutex, and either there is space in the queue, or we have been
         // asked to terminate.
         if (m_terminate)
             return false;
-        m_items.push(std::move(item));
+        m_items.push({std::move(item), Clock::now()});
         ++m_num_pushes;
 
         // Inform a waiting thread that there is now an item available.
@@ -72,18 +119,23 @@ public:
     // If the queue is empty, and we are terminating, returns false.
     // Otherwise we block if the queue is empty.
     bool try_pop(Item& item) {
+        m_latencies.start_pop();
         std::unique_lock lock(m_mutex);
         // Wait until either an item is added, or we're asked to terminate.
-        m_not_empty_cv.wait(lock, [this] { return !m_items.empty() || m_terminate; });
+        wait(lock, m_not_empty_cv, "queue_wait_pop",
+             [this] { return !m_items.empty() || m_terminate; });
 
         // Termination takes effect once all items have been popped from the queue.
         if (m_terminate && m_items.empty()) {
             return false;
         }
 
-        item = std::move(m_items.front());
+        const auto now = Clock::now();
+        item = std::move(m_items.front().item);
+        m_latencies.record_wait(m_items.front().enqueue_time, now);
         m_items.pop();
         ++m_num_pops;
+        m_latencies.end_pop(now);
 
         // Inform a waiting thread that the queue is not full.
         lock.unlock();
@@ -92,6 +144,103 @@ public:
         return true;
     }
 
+    // Attempts to add all of the given items to the queue, taking the lock once for as
+    // many items as there is space for, rather than once per item.
+    // If the queue is full, this method blocks until there is space or
+    // terminate() is called.
+    // If all items were added, true is returned.
+    // If Terminate() was called, items not yet added are dropped and false is returned.
+    bool try_push_batch(std::vector<Item>&& items) {
+        size_t num_pushed = 0;
+        std::unique_lock lock(m_mutex);
+        while (num_pushed < items.size()) {
+            wait(lock, m_not_full_cv, "queue_wait_push",
+                 [this] { return m_items.size() < m_capacity || m_terminate; });
+            if (m_terminate)
+                return false;
+
+            const size_t batch_end =
+                    std::min(items.size(), num_pushed + (m_capacity - m_items.size()));
+            m_num_pushes += batch_end - num_pushed;
+            const auto now = Clock::now();
+            for (; num_pushed < batch_end; ++num_pushed) {
+                m_items.push({std::move(items[num_pushed]), now});
+            }
+
+            // Several items may have been added, so wake every waiting consumer.
+            lock.unlock();
+            m_not_empty_cv.notify_all();
+            lock.lock();
+        }
+        items.clear();
+        return true;
+    }
+
+    // Replaces the contents of items with up to max_items from the front of the queue,
+    // returning true on success.
+    // If the queue is empty, and we are terminating, returns false.
+    // Otherwise we block until at least one item is available.
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items) {
+        items.clear();
+        m_latencies.start_pop();
+        std::unique_lock lock(m_mutex);
+        wait(lock, m_not_empty_cv, "queue_wait_pop",
+             [this] { return !m_items.empty() || m_terminate; });
+
+        if (m_terminate && m_items.empty()) {
+            return false;
+        }
+
+        const auto now = Clock::now();
+        const size_t num_items = std::min(max_items, m_items.size());
+        items.reserve(num_items);
+        for (size_t i = 0; i < num_items; ++i) {
+            items.push_back(std::move(m_items.front().item));
+            m_latencies.record_wait(m_items.front().enqueue_time, now);
+            m_items.pop();
+        }
+        m_num_pops += num_items;
+        m_latencies.end_pop(now);
+
+        lock.unlock();
+        m_not_full_cv.notify_all();
+
+        return true;
+    }
+
+    // Adds the item if there is space, without blocking.  The item is left in place unless
+    // QueueStatus::Success is returned.
+    QueueStatus try_push_nowait(Item& item) {
+        std::unique_lock lock(m_mutex);
+        if (m_terminate)
+            return QueueStatus::Terminated;
+        if (m_items.size() >= m_capacity)
+            return QueueStatus::Full;
+        m_items.push({std::move(item), Clock::now()});
+        ++m_num_pushes;
+        lock.unlock();
+        m_not_empty_cv.notify_one();
+        return QueueStatus::Success;
+    }
+
+    // Obtains the next item if there is one, without blocking.  Returns
+    // QueueStatus::Terminated once terminate() has been called and the queue has drained.
+    QueueStatus try_pop_nowait(Item& item) {
+        m_latencies.start_pop();
+        std::unique_lock lock(m_mutex);
+        if (m_items.empty())
+            return m_terminate ? QueueStatus::Terminated : QueueStatus::Empty;
+        const auto now = Clock::now();
+        item = std::move(m_items.front().item);
+        m_latencies.record_wait(m_items.front().enqueue_time, now);
+        m_items.pop();
+        ++m_num_pops;
+        m_latencies.end_pop(now);
+        lock.unlock();
+        m_not_full_cv.notify_one();
+        return QueueStatus::Success;
+    }
+
     // Tells the queue to terminate any CV waits.
     void terminate() {
         {
@@ -115,6 +264,329 @@ public:
         stats["items"] = m_items.size();
         stats["pushes"] = m_num_pushes;
         stats["pops"] = m_num_pops;
+        m_latencies.add_stats(stats);
+        return stats;
+    }
+};
+
+// Lock-free bounded multi-producer/multi-consumer queue, after Dmitry Vyukov's design.
+// Each slot carries a sequence number which tells producers and consumers whether it is
+// free to write or ready to read, so the fast paths are a CAS on the head/tail position
+// plus a release store.  A mutex and CVs are only touched by threads that have found the
+// queue empty or full, and by the threads that need to wake them.
+template <class Item>
+class AsyncQueue<Item, LockFreeQueuePolicy> {
+    using Clock = dorado::stats::QueueLatencies::Clock;
+
+    struct Slot {
+        // Equal to the push position when the slot is free, and the push position + 1
+        // when it holds an item ready to be popped.
+        std::atomic<uint64_t> sequence;
+        std::aligned_storage_t<sizeof(Item), alignof(Item)> storage;
+        // Published along with the item by the release store to sequence.
+        Clock::time_point enqueue_time;
+
+        Item* item() { return std::launder(reinterpret_cast<Item*>(&storage)); }
+    };
+
+    using Status = QueueStatus;
+
+    // Set in m_push_pos by terminate(), which atomically stops further pushes from
+    // claiming slots.  Pops can therefore tell exactly when the last item has gone.
+    static constexpr uint64_t kTerminateBit = uint64_t(1) << 63;
+    // Keep the positions on separate cache lines so producers and consumers don't
+    // invalidate each other's lines on every operation.
+    static constexpr size_t kCacheLineSize = 64;
+
+    // Ring buffer of m_num_slots slots.  A single slot can't tell an unpopped item from
+    // a free slot on the next lap, since both have sequence pos + 1, so there are at least
+    // two and pushes beyond capacity are refused explicitly.
+    std::unique_ptr<Slot[]> m_slots;
+    const size_t m_num_slots;
+    // Number of items that can be added before further additions block, pending
+    // consumption of items.
+    const size_t m_capacity;
+    // Total number of slots claimed by producers, plus kTerminateBit once terminating.
+    alignas(kCacheLineSize) std::atomic<uint64_t> m_push_pos{0};
+    // Total number of slots claimed by consumers.
+    alignas(kCacheLineSize) std::atomic<uint64_t> m_pop_pos{0};
+    // Slow path state, only used when a thread has to sleep.
+    alignas(kCacheLineSize) std::mutex m_wait_mutex;
+    // Signalled when an item has been consumed and a producer is waiting.
+    std::condition_variable m_not_full_cv;
+    // Signalled when an item has been added and a consumer is waiting.
+    std::condition_variable m_not_empty_cv;
+    // Number of threads sleeping (or about to sleep) on each CV.  Checked by the
+    // fast paths to decide whether a notification is needed.
+    std::atomic<int> m_num_push_waiters{0};
+    std::atomic<int> m_num_pop_waiters{0};
+    dorado::stats::QueueLatencies m_latencies;
+
+    bool is_terminating() const { return m_push_pos.load() & kTerminateBit; }
+
+    // Number of slots claimed by producers but not yet claimed by consumers.  Includes
+    // items that are still being written or read.
+    uint64_t num_claimed() const {
+        const uint64_t pop_pos = m_pop_pos.load();
+        const uint64_t push_pos = m_push_pos.load() & ~kTerminateBit;
+        return push_pos > pop_pos ? push_pos - pop_pos : 0;
+    }
+
+    Status push_once(Item& item, Clock::time_point now) {
+        uint64_t pos = m_push_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            if (pos & kTerminateBit)
+                return Status::Terminated;
+            slot = &m_slots[pos % m_num_slots];
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<int64_t>(sequence - pos);
+            if (diff == 0) {
+                if (m_num_slots != m_capacity && pos - m_pop_pos.load() >= m_capacity)
+                    return Status::Full;
+                if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return Status::Full;
+            } else {
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&slot->storage) Item(std::move(item));
+        slot->enqueue_time = now;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return Status::Success;
+    }
+
+    Status pop_once(Item& item, Clock::time_point& enqueue_time) {
+        uint64_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &m_slots[pos % m_num_slots];
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<int64_t>(sequence - (pos + 1));
+            if (diff == 0) {
+                if (m_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return Status::Empty;
+            } else {
+                pos = m_pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+        Item* const stored = slot->item();
+        item = std::move(*stored);
+        stored->~Item();
+        enqueue_time = slot->enqueue_time;
+        slot->sequence.store(pos + m_num_slots, std::memory_order_release);
+        return Status::Success;
+    }
+
+    // Wakes a sleeping thread, or all of them if notify_all is set.  The fence pairs with
+    // the waiter count increment in wait_on(), so either we see the waiter or it sees
+    // our update.
+    void notify(std::atomic<int>& num_waiters, std::condition_variable& cv, bool notify_all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (num_waiters.load(std::memory_order_relaxed) > 0) {
+            // Taking the mutex ensures a waiter that has checked the predicate is
+            // actually inside wait() before we notify it.
+            { std::lock_guard lock(m_wait_mutex); }
+            if (notify_all) {
+                cv.notify_all();
+            } else {
+                cv.notify_one();
+            }
+        }
+    }
+
+    // Waits for space in the queue for another item.  Returns false if terminating.
+    bool wait_for_space() {
+        if (num_claimed() < m_capacity) {
+            // A consumer has claimed a slot but hasn't released it yet.
+            std::this_thread::yield();
+        } else {
+            wait_on(m_num_push_waiters, m_not_full_cv, "queue_wait_push",
+                    [this] { return num_claimed() < m_capacity || is_terminating(); });
+        }
+        return !is_terminating();
+    }
+
+    // Waits for an item to be available.  Returns false once terminating and drained.
+    bool wait_for_item() {
+        if (num_claimed() > 0) {
+            // A producer has claimed a slot but hasn't finished writing to it.
+            std::this_thread::yield();
+            return true;
+        }
+        // Once terminating no new slots can be claimed, so an empty queue stays empty.
+        if (is_terminating())
+            return false;
+        wait_on(m_num_pop_waiters, m_not_empty_cv, "queue_wait_pop",
+                [this] { return num_claimed() > 0 || is_terminating(); });
+        return true;
+    }
+
+    template <class Pred>
+    void wait_on(std::atomic<int>& num_waiters,
+                 std::condition_variable& cv,
+                 const char* trace_name,
+                 Pred pred) {
+        DORADO_TRACE_SCOPE(trace_name);
+        std::unique_lock lock(m_wait_mutex);
+        num_waiters.fetch_add(1);
+        cv.wait(lock, pred);
+        num_waiters.fetch_sub(1);
+    }
+
+public:
+    // Attempts to push items beyond capacity will block.
+    AsyncQueue(size_t capacity)
+            : m_slots(std::make_unique<Slot[]>(std::max(capacity, size_t(2)))),
+              m_num_slots(std::max(capacity, size_t(2))),
+              m_capacity(std::max(capacity, size_t(1))) {
+        for (size_t i = 0; i < m_num_slots; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~AsyncQueue() {
+        // Ensure CV waits terminate before destruction.
+        terminate();
+        // Destroy any items which were never popped.
+        const uint64_t push_pos = m_push_pos.load() & ~kTerminateBit;
+        for (uint64_t pos = m_pop_pos.load(); pos < push_pos; ++pos) {
+            m_slots[pos % m_num_slots].item()->~Item();
+        }
+    }
+
+    // Same semantics as the locking implementation: blocks while the queue is full,
+    // and fails once terminate() has been called.
+    bool try_push(Item&& item) {
+        for (;;) {
+            const auto status = push_once(item, Clock::now());
+            if (status == Status::Success) {
+                notify(m_num_pop_waiters, m_not_empty_cv, false);
+                return true;
+            }
+            if (status == Status::Terminated || !wait_for_space())
+                return false;
+        }
+    }
+
+    // Same semantics as the locking implementation: blocks while the queue is empty,
+    // and fails once terminate() has been called and the queue has drained.
+    bool try_pop(Item& item) {
+        m_latencies.start_pop();
+        Clock::time_point enqueue_time;
+        for (;;) {
+            if (pop_once(item, enqueue_time) == Status::Success) {
+                const auto now = Clock::now();
+                m_latencies.record_wait(enqueue_time, now);
+                m_latencies.end_pop(now);
+                notify(m_num_push_waiters, m_not_full_cv, false);
+                return true;
+            }
+            if (!wait_for_item())
+                return false;
+        }
+    }
+
+    // As the locking implementation, but consumers are woken once per batch rather
+    // than once per item.
+    bool try_push_batch(std::vector<Item>&& items) {
+        size_t num_pushed = 0;
+        const auto now = Clock::now();
+        while (num_pushed < items.size()) {
+            const auto status = push_once(items[num_pushed], now);
+            if (status == Status::Success) {
+                ++num_pushed;
+                continue;
+            }
+            // Let consumers make room before we wait for it.
+            if (num_pushed > 0) {
+                notify(m_num_pop_waiters, m_not_empty_cv, true);
+            }
+            if (status == Status::Terminated || !wait_for_space())
+                return false;
+        }
+        if (num_pushed > 0) {
+            notify(m_num_pop_waiters, m_not_empty_cv, num_pushed > 1);
+        }
+        items.clear();
+        return true;
+    }
+
+    // As the locking implementation: blocks until at least one item is available, then
+    // takes up to max_items without further waiting.
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items) {
+        items.clear();
+        m_latencies.start_pop();
+        Item item;
+        Clock::time_point enqueue_time;
+        std::vector<Clock::time_point> enqueue_times;
+        while (items.size() < max_items) {
+            if (pop_once(item, enqueue_time) == Status::Success) {
+                items.push_back(std::move(item));
+                enqueue_times.push_back(enqueue_time);
+            } else if (!items.empty() || !wait_for_item()) {
+                break;
+            }
+        }
+        if (!items.empty()) {
+            notify(m_num_push_waiters, m_not_full_cv, items.size() > 1);
+            const auto now = Clock::now();
+            for (const auto& time : enqueue_times) {
+                m_latencies.record_wait(time, now);
+            }
+            m_latencies.end_pop(now);
+        }
+        return !items.empty();
+    }
+
+    // As the locking implementation.
+    QueueStatus try_push_nowait(Item& item) {
+        const auto status = push_once(item, Clock::now());
+        if (status == Status::Success) {
+            notify(m_num_pop_waiters, m_not_empty_cv, false);
+        }
+        return status;
+    }
+
+    // As the locking implementation.  An item whose slot has been claimed by a producer
+    // but not yet written counts as present, so Empty may be returned briefly even while
+    // terminating.
+    QueueStatus try_pop_nowait(Item& item) {
+        m_latencies.start_pop();
+        Clock::time_point enqueue_time;
+        if (pop_once(item, enqueue_time) == Status::Success) {
+            const auto now = Clock::now();
+            m_latencies.record_wait(enqueue_time, now);
+            m_latencies.end_pop(now);
+            notify(m_num_push_waiters, m_not_full_cv, false);
+            return Status::Success;
+        }
+        return is_terminating() && num_claimed() == 0 ? Status::Terminated : Status::Empty;
+    }
+
+    // Tells the queue to terminate any CV waits.
+    void terminate() {
+        m_push_pos.fetch_or(kTerminateBit);
+        {
+            // Any thread that has checked its wait predicate is now inside wait().
+            std::lock_guard lock(m_wait_mutex);
+        }
+        m_not_full_cv.notify_all();
+        m_not_empty_cv.notify_all();
+    }
+
+    std::string get_name() const { return "queue"; }
+
+    std::unordered_map<std::string, double> sample_stats() const {
+        std::unordered_map<std::string, double> stats;
+        stats["items"] = num_claimed();
+        stats["pushes"] = m_push_pos.load() & ~kTerminateBit;
+        stats["pops"] = m_pop_pos.load();
+        m_latencies.add_stats(stats);
         return stats;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,176 @@
+#include "BamSorter.h"
+
+#include "htslib/sam.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+// Memory held by a record, counting its data at the size htslib allocated.
+size_t record_bytes(const bam1_t* record) { return sizeof(bam1_t) + record->m_data; }
+
+void sort_records(std::vector<dorado::BamPtr>& records) {
+    std::stable_sort(records.begin(), records.end(), [](const auto& lhs, const auto& rhs) {
+        return dorado::utils::coordinate_less(lhs.get(), rhs.get());
+    });
+}
+
+// A run being merged, or the records still held, which are merged last.
+struct MergeSource {
+    std::unique_ptr<htsFile, decltype(&hts_close)> file{nullptr, hts_close};
+    std::unique_ptr<sam_hdr_t, decltype(&sam_hdr_destroy)> header{nullptr, sam_hdr_destroy};
+    std::vector<dorado::BamPtr>* records = nullptr;
+    size_t next_record = 0;
+    dorado::BamPtr current;
+
+    // Moves on to the next record, returning false once there are none.
+    bool next() {
+        if (records) {
+            if (next_record == records->size()) {
+                current.reset();
+                return false;
+            }
+            current = std::move((*records)[next_record++]);
+            return true;
+        }
+        if (!current) {
+            current.reset(bam_init1());
+        }
+        const int res = sam_read1(file.get(), header.get(), current.get());
+        if (res < -1) {
+            throw std::runtime_error("Failed to read a sorted run back");
+        }
+        if (res == -1) {
+            current.reset();
+            return false;
+        }
+        return true;
+    }
+};
+
+}  // namespace
+
+namespace dorado::utils {
+
+bool coordinate_less(const bam1_t* lhs, const bam1_t* rhs) {
+    // As an unsigned value the tid of unmapped records, -1, is the largest.
+    const auto lhs_tid = static_cast<uint32_t>(lhs->core.tid);
+    const auto rhs_tid = static_cast<uint32_t>(rhs->core.tid);
+    if (lhs_tid != rhs_tid) {
+        return lhs_tid < rhs_tid;
+    }
+    if (lhs->core.pos != rhs->core.pos) {
+        return lhs->core.pos < rhs->core.pos;
+    }
+    return bam_is_rev(lhs) < bam_is_rev(rhs);
+}
+
+BamSorter::BamSorter(const sam_hdr_t* header, std::string temp_prefix, size_t max_memory_bytes)
+        : m_header(sam_hdr_dup(header)),
+          m_temp_prefix(std::move(temp_prefix)),
+          m_max_memory_bytes(max_memory_bytes) {
+    if (!m_header) {
+        throw std::runtime_error("Sorting output needs a header");
+    }
+}
+
+BamSorter::~BamSorter() {
+    for (const auto& path : m_run_paths) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    sam_hdr_destroy(m_header);
+}
+
+void BamSorter::add(BamPtr record) {
+    m_memory_bytes += record_bytes(record.get());
+    m_records.push_back(std::move(record));
+    if (m_memory_bytes >= m_max_memory_bytes) {
+        spill();
+    }
+}
+
+void BamSorter::spill() {
+    sort_records(m_records);
+    const auto path = std::filesystem::path(m_temp_prefix + "." +
+                                            std::to_string(m_run_paths.size()) + ".bam");
+    // Runs are only read back once, so they are compressed as quickly as possible.
+    std::unique_ptr<htsFile, decltype(&hts_close)> file(hts_open(path.string().c_str(), "wb1"),
+                                                        hts_close);
+    if (!file) {
+        throw std::runtime_error("Could not open sorted run " + path.string());
+    }
+    m_run_paths.push_back(path);
+    if (sam_hdr_write(file.get(), m_header) < 0) {
+        throw std::runtime_error("Failed to write sorted run " + path.string());
+    }
+    for (const auto& record : m_records) {
+        if (sam_write1(file.get(), m_header, record.get()) < 0) {
+            throw std::runtime_error("Failed to write sorted run " + path.string());
+        }
+    }
+    if (hts_close(file.release()) < 0) {
+        throw std::runtime_error("Failed to write sorted run " + path.string());
+    }
+    spdlog::debug("Spilled {} records to sorted run {}", m_records.size(), path.string());
+    m_records.clear();
+    m_memory_bytes = 0;
+}
+
+void BamSorter::merge(const std::function<void(bam1_t*)>& write) {
+    sort_records(m_records);
+
+    std::vector<MergeSource> sources(m_run_paths.size() + 1);
+    for (size_t i = 0; i < m_run_paths.size(); ++i) {
+        auto& source = sources[i];
+        source.file.reset(hts_open(m_run_paths[i].string().c_str(), "rb"));
+        if (!source.file) {
+            throw std::runtime_error("Could not open sorted run " + m_run_paths[i].string());
+        }
+        source.header.reset(sam_hdr_read(source.file.get()));
+        if (!source.header) {
+            throw std::runtime_error("Failed to read sorted run " + m_run_paths[i].string());
+        }
+    }
+    // The records still held were added after those in every run.
+    sources.back().records = &m_records;
+
+    // Equal records are taken from the earliest source, which keeps them in the order added.
+    auto later = [&sources](size_t lhs, size_t rhs) {
+        const auto* lhs_record = sources[lhs].current.get();
+        const auto* rhs_record = sources[rhs].current.get();
+        if (coordinate_less(rhs_record, lhs_record)) {
+            return true;
+        }
+        return !coordinate_less(lhs_record, rhs_record) && lhs > rhs;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i].next()) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        const size_t i = heap.top();
+        heap.pop();
+        write(sources[i].current.get());
+        if (sources[i].next()) {
+            heap.push(i);
+        }
+    }
+
+    m_records.clear();
+    m_memory_bytes = 0;
+    sources.clear();
+    for (const auto& path : m_run_paths) {
+        std::filesystem::remove(path);
+    }
+    m_run_paths.clear();
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct sam_hdr_t;
+
+namespace dorado::utils {
+
+// Orders records as samtools sort does by coordinate: by reference, with unmapped records
+// last, then by position and then by strand.
+bool coordinate_less(const bam1_t* lhs, const bam1_t* rhs);
+
+// Sorts records by coordinate as they are added, holding up to max_memory_bytes of them and
+// spilling the rest to temporary files as sorted runs, which are merged as the records are
+// written, so that sorted output doesn't need another pass over the whole file.  Records which
+// compare equal keep the order they were added in.
+class BamSorter {
+public:
+    // Runs are written to files whose names start with temp_prefix.
+    BamSorter(const sam_hdr_t* header, std::string temp_prefix, size_t max_memory_bytes);
+    ~BamSorter();
+    BamSorter(const BamSorter&) = delete;
+    BamSorter& operator=(const BamSorter&) = delete;
+
+    void add(BamPtr record);
+    // Passes every record added to write, in order, then removes the runs.
+    void merge(const std::function<void(bam1_t*)>& write);
+
+    size_t num_runs() const { return m_run_paths.size(); }
+
+private:
+    // Sorts the records held and writes them out as a run.
+    void spill();
+
+    sam_hdr_t* m_header;
+    std::string m_temp_prefix;
+    size_t m_max_memory_bytes;
+    std::vector<BamPtr> m_records;
+    size_t m_memory_bytes = 0;
+    std::vector<std::filesystem::path> m_run_paths;
+};
+
+}  // namespace dorado::utils
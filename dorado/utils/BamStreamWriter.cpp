@@ -0,0 +1,281 @@
+#include "BamStreamWriter.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace dorado::utils {
+
+namespace {
+
+// Payload of each BGZF block, as htslib uses, so that a block of stored data fits the format's
+// 64KiB limit with room for its framing.
+constexpr size_t kBlockPayloadSize = 0xff00;
+constexpr size_t kBlockHeaderSize = 18;
+constexpr size_t kStoredHeaderSize = 5;
+constexpr size_t kBlockFooterSize = 8;
+constexpr size_t kMaxBlockSize =
+        kBlockHeaderSize + kStoredHeaderSize + kBlockPayloadSize + kBlockFooterSize;
+
+constexpr uint8_t kEofBlock[28] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+                                   0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+                                   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// CRC-32 of each block's payload, as gzip requires, by slicing-by-8.
+using Crc32Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+Crc32Tables make_crc32_tables() {
+    Crc32Tables tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t table = 1; table < tables.size(); ++table) {
+            const uint32_t prev = tables[table - 1][i];
+            tables[table][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+        }
+    }
+    return tables;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    static const Crc32Tables tables = make_crc32_tables();
+    uint32_t crc = 0xffffffffu;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+              tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^ tables[3][high & 0xff] ^
+              tables[2][(high >> 8) & 0xff] ^ tables[1][(high >> 16) & 0xff] ^
+              tables[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xff];
+    }
+    return crc ^ 0xffffffffu;
+}
+
+void append_u16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+    append_u16(out, static_cast<uint16_t>(value));
+    append_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+}  // namespace
+
+BamStreamWriter::BamStreamWriter(const std::string& filename, size_t buffer_size)
+        : m_buffer_size(std::max(buffer_size, kMaxBlockSize)) {
+    const uint16_t endian_check = 1;
+    if (*reinterpret_cast<const uint8_t*>(&endian_check) != 1) {
+        throw std::runtime_error("Streamed BAM output needs a little-endian host");
+    }
+    if (filename == "-") {
+        m_fd = fileno(stdout);
+#ifdef _WIN32
+        _setmode(m_fd, _O_BINARY);
+#endif
+    } else {
+#ifdef _WIN32
+        m_fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        m_owns_fd = true;
+    }
+    if (m_fd < 0) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    m_block.reserve(kBlockPayloadSize);
+    m_buffer.reserve(m_buffer_size);
+}
+
+BamStreamWriter::~BamStreamWriter() {
+    try {
+        close();
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to close BAM stream: {}", e.what());
+    }
+}
+
+void BamStreamWriter::write_header(const sam_hdr_t* header) {
+    // sam_hdr_str() builds the text of a header which has been modified, so needs a copy of a
+    // const one.
+    sam_hdr_t* hdr = sam_hdr_dup(header);
+    if (!hdr) {
+        throw std::runtime_error("Failed to copy BAM header");
+    }
+    const char* text = sam_hdr_str(hdr);
+    const uint32_t text_length = text ? static_cast<uint32_t>(std::strlen(text)) : 0;
+    append("BAM\1", 4);
+    append(&text_length, 4);
+    append(text, text_length);
+    const int32_t num_refs = sam_hdr_nref(hdr);
+    append(&num_refs, 4);
+    for (int32_t tid = 0; tid < num_refs; ++tid) {
+        const char* name = sam_hdr_tid2name(hdr, tid);
+        const uint32_t name_length = static_cast<uint32_t>(std::strlen(name)) + 1;
+        const uint32_t ref_length = static_cast<uint32_t>(sam_hdr_tid2len(hdr, tid));
+        append(&name_length, 4);
+        append(name, name_length);
+        append(&ref_length, 4);
+    }
+    sam_hdr_destroy(hdr);
+    // Records start in a block of their own, as htslib writes them.
+    end_block();
+}
+
+void BamStreamWriter::write(const bam1_t* record) {
+    // Serialised as bam_write1() does, including moving CIGARs with more operations than the
+    // BAM format's limit to a CG tag behind a placeholder.
+    const bam1_core_t& core = record->core;
+    const bool long_cigar = core.n_cigar > 0xffff;
+    const uint32_t qname_length = core.l_qname - core.l_extranul;
+    const uint32_t block_length = record->l_data - core.l_extranul + 32 + (long_cigar ? 16 : 0);
+
+    // Start the record in a new block if it won't fit in the current one.
+    if (m_block.size() + 4 + block_length > kBlockPayloadSize) {
+        end_block();
+    }
+
+    uint32_t fields[9];
+    fields[0] = block_length;
+    fields[1] = static_cast<uint32_t>(core.tid);
+    fields[2] = static_cast<uint32_t>(core.pos);
+    fields[3] = static_cast<uint32_t>(core.bin) << 16 | static_cast<uint32_t>(core.qual) << 8 |
+                qname_length;
+    fields[4] = static_cast<uint32_t>(core.flag) << 16 | (long_cigar ? 2 : core.n_cigar);
+    fields[5] = static_cast<uint32_t>(core.l_qseq);
+    fields[6] = static_cast<uint32_t>(core.mtid);
+    fields[7] = static_cast<uint32_t>(core.mpos);
+    fields[8] = static_cast<uint32_t>(core.isize);
+    append(fields, sizeof(fields));
+    append(record->data, qname_length);
+
+    if (!long_cigar) {
+        append(record->data + core.l_qname, record->l_data - core.l_qname);
+        return;
+    }
+
+    const uint32_t* cigar = bam_get_cigar(record);
+    const hts_pos_t ref_length = bam_cigar2rlen(core.n_cigar, cigar);
+    if (ref_length >= (1 << 28)) {
+        throw std::runtime_error("Record's reference length is too long for a BAM CG tag");
+    }
+    const uint32_t placeholder[2] = {
+            static_cast<uint32_t>(core.l_qseq) << 4 | BAM_CSOFT_CLIP,
+            static_cast<uint32_t>(ref_length) << 4 | BAM_CREF_SKIP,
+    };
+    const size_t cigar_start = reinterpret_cast<const uint8_t*>(cigar) - record->data;
+    const size_t cigar_end = cigar_start + core.n_cigar * 4;
+    append(placeholder, sizeof(placeholder));
+    append(record->data + cigar_end, record->l_data - cigar_end);
+    append("CGBI", 4);
+    append(&core.n_cigar, 4);
+    append(cigar, core.n_cigar * 4);
+}
+
+void BamStreamWriter::flush() {
+    end_block();
+    write_out();
+}
+
+void BamStreamWriter::close() {
+    if (m_fd < 0) {
+        return;
+    }
+    end_block();
+    m_buffer.insert(m_buffer.end(), std::begin(kEofBlock), std::end(kEofBlock));
+    write_out();
+    if (m_owns_fd) {
+#ifdef _WIN32
+        _close(m_fd);
+#else
+        ::close(m_fd);
+#endif
+    }
+    m_fd = -1;
+}
+
+void BamStreamWriter::append(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const size_t count = std::min(size, kBlockPayloadSize - m_block.size());
+        m_block.insert(m_block.end(), bytes, bytes + count);
+        bytes += count;
+        size -= count;
+        if (m_block.size() == kBlockPayloadSize) {
+            end_block();
+        }
+    }
+}
+
+void BamStreamWriter::end_block() {
+    if (m_block.empty()) {
+        return;
+    }
+    if (m_buffer.size() + kMaxBlockSize > m_buffer_size) {
+        write_out();
+    }
+
+    // A gzip member with the BGZF extra field giving its size, holding a single stored deflate
+    // block.
+    const auto payload_size = static_cast<uint16_t>(m_block.size());
+    const size_t block_size =
+            kBlockHeaderSize + kStoredHeaderSize + payload_size + kBlockFooterSize;
+    const uint8_t header[] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+                              0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00};
+    m_buffer.insert(m_buffer.end(), std::begin(header), std::end(header));
+    append_u16(m_buffer, static_cast<uint16_t>(block_size - 1));
+    m_buffer.push_back(0x01);  // Final block, stored.
+    append_u16(m_buffer, payload_size);
+    append_u16(m_buffer, static_cast<uint16_t>(~payload_size));
+    m_buffer.insert(m_buffer.end(), m_block.begin(), m_block.end());
+    append_u32(m_buffer, crc32(m_block.data(), m_block.size()));
+    append_u32(m_buffer, payload_size);
+    m_block.clear();
+}
+
+void BamStreamWriter::write_out() {
+    const uint8_t* data = m_buffer.data();
+    size_t remaining = m_buffer.size();
+    while (remaining > 0) {
+#ifdef _WIN32
+        const auto written = _write(m_fd, data, static_cast<unsigned int>(remaining));
+#else
+        const auto written = ::write(m_fd, data, remaining);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Failed to write BAM stream: ") +
+                                     std::strerror(errno));
+        }
+        data += written;
+        remaining -= written;
+    }
+    m_buffer.clear();
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "htslib/sam.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+/// Writes uncompressed BAM, serialising records itself into BGZF blocks of stored (uncompressed)
+/// data, and writing out a large buffer of blocks at a time.  Readers see the same stream as
+/// htslib writes in "wb0" mode, without htslib's per-record I/O, which is what limits writing
+/// to a pipe with fast models.
+/// Expects a little-endian host, as BAM is.  Not thread safe.
+class BamStreamWriter {
+public:
+    // Writes to filename, or to stdout if it is "-".
+    explicit BamStreamWriter(const std::string& filename, size_t buffer_size = 4 << 20);
+    // Closes the stream, logging rather than throwing any error.
+    ~BamStreamWriter();
+
+    void write_header(const sam_hdr_t* header);
+    void write(const bam1_t* record);
+    // Ends the current block and writes out everything buffered.
+    void flush();
+    // Flushes, then writes the BGZF end of file marker and closes the file.
+    void close();
+
+private:
+    // Appends to the payload of the current block, ending blocks as they fill up.
+    void append(const void* data, size_t size);
+    void end_block();
+    void write_out();
+
+    int m_fd{-1};
+    bool m_owns_fd{false};
+    size_t m_buffer_size;
+    // Payload of the block being filled.
+    std::vector<uint8_t> m_block;
+    // Finished blocks waiting to be written.
+    std::vector<uint8_t> m_buffer;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,206 @@
+#include "BandedAligner.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace {
+
+// Larger than any edit distance, with headroom so that adding to it can't overflow.
+constexpr int32_t kInfinity = 1 << 29;
+
+// Which neighbour each cell's best score came from.
+constexpr uint8_t kFromDiagonal = 0;
+constexpr uint8_t kFromAbove = 1;  // The previous query base, i.e. an insertion.
+constexpr uint8_t kFromLeft = 2;   // The previous target base, i.e. a deletion.
+
+// Padding which matches no base, and differs between the sequences so that padding doesn't
+// match padding either.
+constexpr uint8_t kQueryPad = 0;
+constexpr uint8_t kTargetPad = 1;
+
+// Target position of the first cell of the band in the given query row.  The band is centred
+// on the diagonal from (0, 0) to (query_length, target_length), so the last cell of the
+// alignment is always at band position band_width.
+int64_t band_begin(int64_t row, int64_t query_length, int64_t target_length, int band_width) {
+    return row * target_length / std::max(query_length, int64_t(1)) - band_width;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+BandedAligner::BandedAligner(torch::Device device, int band_width, int64_t max_batch_cells)
+        : m_device(device),
+          m_band_width(std::max(band_width, 1)),
+          m_max_batch_cells(max_batch_cells) {}
+
+std::vector<BandedAlignment> BandedAligner::align(const std::vector<SequencePair>& pairs) const {
+    std::vector<BandedAlignment> results(pairs.size());
+    const int64_t band_size = 2 * m_band_width + 1;
+    size_t batch_begin = 0;
+    while (batch_begin < pairs.size()) {
+        // Take pairs while the traceback for all of them, as long as the longest query, fits.
+        size_t batch_end = batch_begin;
+        int64_t max_rows = 0;
+        while (batch_end < pairs.size()) {
+            const int64_t rows =
+                    std::max(max_rows, static_cast<int64_t>(pairs[batch_end].first.size()) + 1);
+            const auto num_pairs = static_cast<int64_t>(batch_end - batch_begin + 1);
+            if (batch_end > batch_begin && rows * num_pairs * band_size > m_max_batch_cells) {
+                break;
+            }
+            max_rows = rows;
+            ++batch_end;
+        }
+        align_batch(&pairs[batch_begin], batch_end - batch_begin, &results[batch_begin]);
+        batch_begin = batch_end;
+    }
+    return results;
+}
+
+void BandedAligner::align_batch(const SequencePair* pairs,
+                                size_t num_pairs,
+                                BandedAlignment* results) const {
+    const auto batch_size = static_cast<int64_t>(num_pairs);
+    const int64_t band_size = 2 * m_band_width + 1;
+    int64_t max_query_length = 1;
+    int64_t max_target_length = 1;
+    for (size_t i = 0; i < num_pairs; ++i) {
+        max_query_length = std::max(max_query_length, int64_t(pairs[i].first.size()));
+        max_target_length = std::max(max_target_length, int64_t(pairs[i].second.size()));
+    }
+
+    // Targets are offset by the band size, so that every band position indexes them.
+    const int64_t target_offset = band_size;
+    auto queries = torch::full({batch_size, max_query_length}, kQueryPad, torch::kUInt8);
+    auto targets = torch::full({batch_size, max_target_length + 2 * target_offset}, kTargetPad,
+                               torch::kUInt8);
+    auto query_lengths = torch::empty({batch_size, 1}, torch::kInt64);
+    auto target_lengths = torch::empty({batch_size, 1}, torch::kInt64);
+    auto* const query_ptr = queries.data_ptr<uint8_t>();
+    auto* const target_ptr = targets.data_ptr<uint8_t>();
+    auto* const query_length_ptr = query_lengths.data_ptr<int64_t>();
+    auto* const target_length_ptr = target_lengths.data_ptr<int64_t>();
+    for (size_t i = 0; i < num_pairs; ++i) {
+        const auto& [query, target] = pairs[i];
+        std::copy(query.begin(), query.end(), query_ptr + i * queries.size(1));
+        std::copy(target.begin(), target.end(), target_ptr + i * targets.size(1) + target_offset);
+        // Empty sequences are aligned on the host, below, so give them any length here.
+        query_length_ptr[i] = std::max(int64_t(query.size()), int64_t(1));
+        target_length_ptr[i] = std::max(int64_t(target.size()), int64_t(1));
+    }
+    queries = queries.to(m_device);
+    targets = targets.to(m_device);
+    query_lengths = query_lengths.to(m_device);
+    target_lengths = target_lengths.to(m_device);
+
+    const auto options = torch::TensorOptions().device(m_device);
+    const auto band_positions = torch::arange(band_size, options.dtype(torch::kInt64)).unsqueeze(0);
+    const auto band_positions_int = band_positions.to(torch::kInt32);
+
+    // Row 0: the score of each target prefix is its length.
+    auto begins = torch::full({batch_size, 1}, -m_band_width, options.dtype(torch::kInt64));
+    auto columns = begins + band_positions;
+    auto in_target = (columns >= 0) & (columns <= target_lengths);
+    auto scores = columns.to(torch::kInt32).masked_fill(~in_target, kInfinity);
+
+    auto directions = torch::empty({max_query_length + 1, batch_size, band_size},
+                                   options.dtype(torch::kUInt8));
+    directions[0].fill_(kFromLeft);
+    auto distances = torch::full({batch_size}, kInfinity, options.dtype(torch::kInt32));
+
+    for (int64_t row = 1; row <= max_query_length; ++row) {
+        const auto previous_begins = begins;
+        begins = torch::div(target_lengths * row, query_lengths, "floor") - m_band_width;
+        columns = begins + band_positions;
+        in_target = (columns >= 0) & (columns <= target_lengths);
+
+        // Band positions in the previous row of the cells above and diagonally before.
+        const auto above = band_positions + (begins - previous_begins);
+        const auto diagonal = above - 1;
+        const auto previous_scores = [&](const torch::Tensor& positions) {
+            const auto in_band = (positions >= 0) & (positions < band_size);
+            return scores.gather(1, positions.clamp(0, band_size - 1))
+                    .masked_fill(~in_band, kInfinity);
+        };
+
+        const auto query_bases = queries.select(1, row - 1).unsqueeze(1);
+        const auto target_bases =
+                targets.gather(1, (columns - 1 + target_offset).clamp(0, targets.size(1) - 1));
+        const auto from_diagonal =
+                previous_scores(diagonal) + (target_bases != query_bases).to(torch::kInt32);
+        const auto from_above = previous_scores(above) + 1;
+        const auto best = torch::minimum(from_diagonal, from_above).masked_fill(~in_target,
+                                                                                kInfinity);
+        auto direction = (from_above < from_diagonal).to(torch::kUInt8);
+
+        // Runs of deletions along the row: each cell's score is the lowest of any cell before
+        // it in the row plus the distance between them.
+        const auto with_deletions =
+                std::get<0>(torch::cummin(best - band_positions_int, 1)) + band_positions_int;
+        direction.masked_fill_(with_deletions < best, kFromLeft);
+        scores = with_deletions.clamp_max(kInfinity).masked_fill(~in_target, kInfinity);
+        directions[row].copy_(direction);
+
+        distances = torch::where(query_lengths.squeeze(1) == row, scores.select(1, m_band_width),
+                                 distances);
+    }
+
+    // Trace back from the end of both sequences on the host.
+    const auto host_directions = directions.to(torch::kCPU);
+    const auto host_distances = distances.to(torch::kCPU);
+    const auto* const direction_ptr = host_directions.data_ptr<uint8_t>();
+    const auto* const distance_ptr = host_distances.data_ptr<int32_t>();
+
+    for (size_t pair = 0; pair < num_pairs; ++pair) {
+        const auto& [query, target] = pairs[pair];
+        auto& result = results[pair];
+        const auto query_length = static_cast<int64_t>(query.size());
+        const auto target_length = static_cast<int64_t>(target.size());
+        result.target_start = 0;
+        result.target_end = static_cast<int>(target_length) - 1;
+        if (query_length == 0 || target_length == 0) {
+            result.edit_distance = static_cast<int>(std::max(query_length, target_length));
+            result.path.assign(query_length, kInsertion);
+            result.path.insert(result.path.end(), target_length, kDeletion);
+            continue;
+        }
+        if (distance_ptr[pair] >= kInfinity) {
+            continue;
+        }
+
+        result.path.reserve(query_length + target_length);
+        bool at_band_edge = false;
+        int64_t row = query_length;
+        int64_t column = target_length;
+        while ((row > 0 || column > 0) && !at_band_edge) {
+            const int64_t position =
+                    column - band_begin(row, query_length, target_length, m_band_width);
+            // A path along the edge of the band might have been better outside it.
+            at_band_edge = position <= 0 || position >= band_size - 1;
+            const auto from = row == 0 ? kFromLeft
+                                       : direction_ptr[(row * batch_size + pair) * band_size +
+                                                       std::clamp(position, int64_t(0),
+                                                                  band_size - 1)];
+            if (from == kFromDiagonal && column > 0) {
+                --row;
+                --column;
+                result.path.push_back(query[row] == target[column] ? kMatch : kMismatch);
+            } else if (from == kFromAbove || column == 0) {
+                --row;
+                result.path.push_back(kInsertion);
+            } else {
+                --column;
+                result.path.push_back(kDeletion);
+            }
+        }
+        if (at_band_edge) {
+            result.path.clear();
+            continue;
+        }
+        std::reverse(result.path.begin(), result.path.end());
+        result.edit_distance = distance_ptr[pair];
+    }
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// Global alignment of a query to a target, as edlibAlign() finds with EDLIB_MODE_NW and
+// EDLIB_TASK_PATH, though of equally good paths it may pick a different one.
+struct BandedAlignment {
+    // Edit distance of the best path within the band, or -1, with no path, if that path runs
+    // along the edge of the band, as then the band is likely too narrow for the pair.
+    int edit_distance{-1};
+    // Alignment operations in edlib's encoding, from the start of both sequences to their ends.
+    std::vector<unsigned char> path;
+    // First and last target positions aligned, as edlib reports them.
+    int target_start{0};
+    int target_end{-1};
+};
+
+// Aligns batches of sequence pairs by banded edit distance, with the dynamic programming run as
+// tensor operations so that on a GPU all the pairs of a batch advance one query base per step.
+// The band follows the diagonal from the start of both sequences to their ends, so it suits
+// pairs which are expected to match end to end, such as duplex template reads and the reverse
+// complements of their complements.
+class BandedAligner {
+public:
+    // band_width is how many target positions either side of the diagonal are considered.
+    // max_batch_cells limits the traceback kept for a batch, in bytes on the device and on the
+    // host: pairs which together need more rows than fit are aligned in separate batches.
+    BandedAligner(torch::Device device,
+                  int band_width,
+                  int64_t max_batch_cells = int64_t(1) << 30);
+
+    // Query and target.
+    using SequencePair = std::pair<std::string_view, std::string_view>;
+
+    std::vector<BandedAlignment> align(const std::vector<SequencePair>& pairs) const;
+
+    const torch::Device& device() const { return m_device; }
+    int band_width() const { return m_band_width; }
+
+    // edlib's alignment operations.
+    static constexpr unsigned char kMatch = 0;
+    static constexpr unsigned char kInsertion = 1;  // A query base with no target base.
+    static constexpr unsigned char kDeletion = 2;   // A target base with no query base.
+    static constexpr unsigned char kMismatch = 3;
+
+private:
+    void align_batch(const SequencePair* pairs, size_t num_pairs, BandedAlignment* results) const;
+
+    const torch::Device m_device;
+    const int m_band_width;
+    const int64_t m_max_batch_cells;
+};
+
+}  // namespace dorado::utils
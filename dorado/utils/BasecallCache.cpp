@@ -0,0 +1,174 @@
+#include "BasecallCache.h"
+
+#include "../decode/fast_hash.h"
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace dorado::utils {
+
+namespace {
+
+constexpr std::array<char, 8> kMagic = {'D', 'O', 'R', 'A', 'D', 'O', 'B', '1'};
+constexpr uint64_t kHashSeed = 0x5ca1ab1e;
+
+// Each record is a header of the key and the call's sizes, then the call's sequence, qstring
+// and moves.
+struct RecordHeader {
+    uint64_t signal_hash;
+    uint64_t num_samples;
+    uint32_t seq_length;
+    uint32_t num_moves;
+    int32_t model_stride;
+};
+constexpr size_t kRecordHeaderBytes = 8 + 8 + 4 + 4 + 4;
+
+std::array<char, kRecordHeaderBytes> encode_header(const RecordHeader& header) {
+    std::array<char, kRecordHeaderBytes> bytes;
+    std::memcpy(bytes.data(), &header.signal_hash, 8);
+    std::memcpy(bytes.data() + 8, &header.num_samples, 8);
+    std::memcpy(bytes.data() + 16, &header.seq_length, 4);
+    std::memcpy(bytes.data() + 20, &header.num_moves, 4);
+    std::memcpy(bytes.data() + 24, &header.model_stride, 4);
+    return bytes;
+}
+
+bool read_header(std::istream& stream, RecordHeader& header) {
+    std::array<char, kRecordHeaderBytes> bytes;
+    if (!stream.read(bytes.data(), bytes.size())) {
+        return false;
+    }
+    std::memcpy(&header.signal_hash, bytes.data(), 8);
+    std::memcpy(&header.num_samples, bytes.data() + 8, 8);
+    std::memcpy(&header.seq_length, bytes.data() + 16, 4);
+    std::memcpy(&header.num_moves, bytes.data() + 20, 4);
+    std::memcpy(&header.model_stride, bytes.data() + 24, 4);
+    return true;
+}
+
+uint64_t record_bytes(const RecordHeader& header) {
+    return kRecordHeaderBytes + 2 * uint64_t(header.seq_length) + header.num_moves;
+}
+
+}  // namespace
+
+BasecallCache::BasecallCache(const fs::path& path) : m_path(path) {
+    if (!fs::exists(m_path) || fs::file_size(m_path) == 0) {
+        if (m_path.has_parent_path()) {
+            fs::create_directories(m_path.parent_path());
+        }
+        std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+        file.write(kMagic.data(), kMagic.size());
+        if (!file) {
+            throw std::runtime_error("Failed to create basecall cache " + m_path.string());
+        }
+    }
+    load_index();
+
+    m_file.open(m_path, std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
+    if (!m_file) {
+        throw std::runtime_error("Failed to open basecall cache " + m_path.string());
+    }
+    spdlog::debug("> Opened basecall cache {} with {} calls", m_path.string(), m_index.size());
+}
+
+void BasecallCache::load_index() {
+    std::ifstream file(m_path, std::ios::binary);
+    std::array<char, kMagic.size()> magic;
+    if (!file.read(magic.data(), magic.size()) || magic != kMagic) {
+        throw std::runtime_error(m_path.string() + " is not a basecall cache");
+    }
+
+    const uint64_t file_size = fs::file_size(m_path);
+    uint64_t offset = kMagic.size();
+    RecordHeader header;
+    while (read_header(file, header) && offset + record_bytes(header) <= file_size) {
+        m_index.emplace(Key{header.signal_hash, header.num_samples}, offset);
+        offset += record_bytes(header);
+        file.seekg(std::streamoff(offset));
+    }
+    file.close();
+
+    if (offset != file_size) {
+        spdlog::debug("Dropping {} bytes of partial record from basecall cache {}",
+                      file_size - offset, m_path.string());
+        fs::resize_file(m_path, offset);
+    }
+}
+
+std::optional<BasecallCache::Call> BasecallCache::find(uint64_t signal_hash, size_t num_samples) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_index.find(Key{signal_hash, num_samples});
+    if (it == m_index.end()) {
+        return std::nullopt;
+    }
+
+    m_file.clear();
+    m_file.seekg(std::streamoff(it->second));
+    RecordHeader header;
+    if (!read_header(m_file, header)) {
+        return std::nullopt;
+    }
+    Call call;
+    call.seq.resize(header.seq_length);
+    call.qstring.resize(header.seq_length);
+    call.moves.resize(header.num_moves);
+    call.model_stride = header.model_stride;
+    m_file.read(call.seq.data(), call.seq.size());
+    m_file.read(call.qstring.data(), call.qstring.size());
+    m_file.read(reinterpret_cast<char*>(call.moves.data()), call.moves.size());
+    if (!m_file) {
+        spdlog::debug("Failed to read call from basecall cache {}", m_path.string());
+        m_file.clear();
+        return std::nullopt;
+    }
+    return call;
+}
+
+void BasecallCache::insert(uint64_t signal_hash, size_t num_samples, const Call& call) {
+    const RecordHeader header{signal_hash, num_samples, uint32_t(call.seq.size()),
+                              uint32_t(call.moves.size()), int32_t(call.model_stride)};
+    // The record is written in one piece, so that a failed write leaves at most a partial
+    // record at the end of the file.
+    std::string record;
+    record.reserve(record_bytes(header));
+    const auto header_bytes = encode_header(header);
+    record.append(header_bytes.data(), header_bytes.size());
+    record.append(call.seq);
+    record.append(call.qstring);
+    record.append(reinterpret_cast<const char*>(call.moves.data()), call.moves.size());
+
+    std::lock_guard lock(m_mutex);
+    const Key key{signal_hash, num_samples};
+    if (m_index.count(key) != 0) {
+        return;
+    }
+    m_file.clear();
+    m_file.seekp(0, std::ios::end);
+    const auto offset = m_file.tellp();
+    m_file.write(record.data(), record.size());
+    m_file.flush();
+    if (!m_file) {
+        // The cache is only an optimisation.
+        spdlog::debug("Failed to write call to basecall cache {}", m_path.string());
+        m_file.clear();
+        return;
+    }
+    m_index.emplace(key, uint64_t(offset));
+}
+
+size_t BasecallCache::size() const {
+    std::lock_guard lock(m_mutex);
+    return m_index.size();
+}
+
+uint64_t BasecallCache::signal_hash(const void* buf, size_t len) {
+    return fasthash64(buf, len, kHashSeed);
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado::utils {
+
+// Persistent store of stitched basecalls, so that rerunning the same model over the same
+// signal, e.g. when a run is repeated with different downstream settings, skips calling reads
+// already called.  Each cache file holds the calls of one model and set of calling settings,
+// keyed by a hash of each read's signal and its length.  Calls are appended as they are made,
+// and the file is indexed when it is opened, so an interrupted run keeps the calls it made.
+// Thread-safe.
+class BasecallCache {
+public:
+    struct Call {
+        std::string seq;
+        std::string qstring;
+        std::vector<uint8_t> moves;
+        int model_stride{0};
+    };
+
+    // Opens, or creates, the cache file at path.  Throws if it can't be opened.
+    explicit BasecallCache(const std::filesystem::path& path);
+
+    // The cached call of the signal with the given hash and number of samples, if there is one.
+    std::optional<Call> find(uint64_t signal_hash, size_t num_samples);
+    // Adds a call to the cache.  Calls already cached aren't added again.
+    void insert(uint64_t signal_hash, size_t num_samples, const Call& call);
+
+    // Number of calls in the cache.
+    size_t size() const;
+
+    // Hash of the signal data in buf, for keying its call.
+    static uint64_t signal_hash(const void* buf, size_t len);
+
+private:
+    struct Key {
+        uint64_t signal_hash;
+        uint64_t num_samples;
+        bool operator==(const Key& other) const {
+            return signal_hash == other.signal_hash && num_samples == other.num_samples;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return size_t(key.signal_hash); }
+    };
+
+    // Indexes the records already in the file, dropping any partial record at the end
+    // left by an interrupted run.
+    void load_index();
+
+    const std::filesystem::path m_path;
+    mutable std::mutex m_mutex;
+    std::fstream m_file;
+    // Offset in the file of each cached call's record.
+    std::unordered_map<Key, uint64_t, KeyHash> m_index;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,376 @@
+#include "FileReadAhead.h"
+
+#include "thread_qos.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace dorado::utils {
+
+namespace {
+
+// Reads are this large, and this many are kept in flight, which is deep enough to keep an
+// NVMe array streaming at several GB/s.
+constexpr uint32_t kReadBytes = 2 << 20;
+constexpr unsigned kQueueDepth = 32;
+
+// Reads into buffers, returning them as they complete.
+class ReadQueue {
+public:
+    virtual ~ReadQueue() = default;
+    // Starts reading len bytes at offset into the buffer, which is returned with the tag.
+    virtual void submit(int fd, char* buffer, uint32_t len, uint64_t offset, uint64_t tag) = 0;
+    // The tag of a completed read, and the bytes read or a negative errno.
+    virtual std::pair<uint64_t, int64_t> wait() = 0;
+};
+
+#ifndef _WIN32
+
+// Reads one at a time when waited for.
+class SyncReadQueue : public ReadQueue {
+public:
+    void submit(int fd, char* buffer, uint32_t len, uint64_t offset, uint64_t tag) override {
+        m_reads.push_back({fd, buffer, len, offset, tag});
+    }
+
+    std::pair<uint64_t, int64_t> wait() override {
+        const auto read = m_reads.front();
+        m_reads.pop_front();
+        const auto result = pread(read.fd, read.buffer, read.len, off_t(read.offset));
+        return {read.tag, result < 0 ? -int64_t(errno) : int64_t(result)};
+    }
+
+private:
+    struct Read {
+        int fd;
+        char* buffer;
+        uint32_t len;
+        uint64_t offset;
+        uint64_t tag;
+    };
+    std::deque<Read> m_reads;
+};
+
+#endif  // _WIN32
+
+#ifdef __linux__
+
+// Reads through an io_uring, set up with the raw system calls so as not to need liburing.
+// It is only used from one thread, and never has more reads in flight than its entries.
+class IoUringReadQueue : public ReadQueue {
+public:
+    // Returns nullptr if the kernel doesn't support io_uring reads, or doesn't allow them.
+    static std::unique_ptr<IoUringReadQueue> create(unsigned entries) {
+        io_uring_params params{};
+        const int ring_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0) {
+            return nullptr;
+        }
+        std::unique_ptr<IoUringReadQueue> queue(new IoUringReadQueue(ring_fd));
+        // IORING_OP_READ came with IORING_FEAT_RW_CUR_POS, in 5.6.
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || !queue->map_rings(params)) {
+            return nullptr;
+        }
+        return queue;
+    }
+
+    ~IoUringReadQueue() override {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq_ring && m_cq_ring != m_sq_ring) {
+            munmap(m_cq_ring, m_cq_ring_size);
+        }
+        if (m_sq_ring) {
+            munmap(m_sq_ring, m_sq_ring_size);
+        }
+        close(m_ring_fd);
+    }
+
+    void submit(int fd, char* buffer, uint32_t len, uint64_t offset, uint64_t tag) override {
+        const unsigned tail = *m_sq_tail;
+        const unsigned index = tail & *m_sq_mask;
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++m_num_unsubmitted;
+    }
+
+    std::pair<uint64_t, int64_t> wait() override {
+        while (true) {
+            const unsigned head = *m_cq_head;
+            if (m_num_unsubmitted == 0 && head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+                const std::pair<uint64_t, int64_t> result{cqe.user_data, cqe.res};
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                return result;
+            }
+            // Submits the queued reads, if any, and waits for one to complete.
+            const auto submitted = syscall(__NR_io_uring_enter, m_ring_fd, m_num_unsubmitted, 1,
+                                           IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("io_uring_enter failed: ") +
+                                         std::strerror(errno));
+            }
+            m_num_unsubmitted -= unsigned(submitted);
+        }
+    }
+
+private:
+    explicit IoUringReadQueue(int ring_fd) : m_ring_fd(ring_fd) {}
+
+    bool map_rings(const io_uring_params& params) {
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+        auto map = [this](size_t size, off_t offset) -> char* {
+            void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              m_ring_fd, offset);
+            return ring == MAP_FAILED ? nullptr : static_cast<char*>(ring);
+        };
+        m_sq_ring = map(m_sq_ring_size, IORING_OFF_SQ_RING);
+        if (!m_sq_ring) {
+            return false;
+        }
+        m_cq_ring = single_mmap ? m_sq_ring : map(m_cq_ring_size, IORING_OFF_CQ_RING);
+        if (!m_cq_ring) {
+            return false;
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = reinterpret_cast<io_uring_sqe*>(map(m_sqes_size, IORING_OFF_SQES));
+        if (!m_sqes) {
+            return false;
+        }
+
+        m_sq_tail = reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.tail);
+        m_sq_mask = reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(m_sq_ring + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.tail);
+        m_cq_mask = reinterpret_cast<unsigned*>(m_cq_ring + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(m_cq_ring + params.cq_off.cqes);
+        return true;
+    }
+
+    const int m_ring_fd;
+    char* m_sq_ring{nullptr};
+    char* m_cq_ring{nullptr};
+    io_uring_sqe* m_sqes{nullptr};
+    size_t m_sq_ring_size{0};
+    size_t m_cq_ring_size{0};
+    size_t m_sqes_size{0};
+
+    unsigned* m_sq_tail{nullptr};
+    unsigned* m_sq_mask{nullptr};
+    unsigned* m_sq_array{nullptr};
+    unsigned* m_cq_head{nullptr};
+    unsigned* m_cq_tail{nullptr};
+    unsigned* m_cq_mask{nullptr};
+    io_uring_cqe* m_cqes{nullptr};
+    // Reads queued since the last io_uring_enter.
+    unsigned m_num_unsubmitted{0};
+};
+
+#endif  // __linux__
+
+}  // namespace
+
+FileReadAhead::FileReadAhead(std::vector<std::string> paths, uint64_t window_bytes)
+        : m_paths(std::move(paths)), m_window_bytes(window_bytes) {
+    m_file_starts.reserve(m_paths.size() + 1);
+    uint64_t start = 0;
+    for (const auto& path : m_paths) {
+        m_file_starts.push_back(start);
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        start += error ? 0 : uint64_t(size);
+    }
+    m_file_starts.push_back(start);
+#ifndef _WIN32
+    m_thread = std::thread(&FileReadAhead::run, this);
+#endif
+}
+
+FileReadAhead::~FileReadAhead() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void FileReadAhead::set_read_position(size_t file_index, uint64_t offset) {
+    const auto position = linear_offset(file_index, offset);
+    {
+        std::lock_guard lock(m_mutex);
+        if (position <= m_read_position) {
+            return;
+        }
+        m_read_position = position;
+    }
+    m_cv.notify_one();
+}
+
+uint64_t FileReadAhead::file_size(size_t file_index) const {
+    return m_file_starts[file_index + 1] - m_file_starts[file_index];
+}
+
+uint64_t FileReadAhead::linear_offset(size_t file_index, uint64_t offset) const {
+    if (file_index >= m_paths.size()) {
+        return m_file_starts.back();
+    }
+    return m_file_starts[file_index] + std::min(offset, file_size(file_index));
+}
+
+void FileReadAhead::run() {
+#ifndef _WIN32
+    set_thread_qos(ThreadQoS::Utility);
+    std::unique_ptr<ReadQueue> queue;
+#ifdef __linux__
+    queue = IoUringReadQueue::create(kQueueDepth);
+#endif
+    if (!queue) {
+        spdlog::debug("io_uring unavailable, reading input ahead synchronously");
+        queue = std::make_unique<SyncReadQueue>();
+    }
+
+    std::vector<std::unique_ptr<char[]>> buffers;
+    std::vector<uint64_t> free_buffers;
+    // File each buffer's read is from.
+    std::vector<size_t> buffer_files(kQueueDepth);
+    for (unsigned i = 0; i < kQueueDepth; ++i) {
+        // Left uninitialised, as they are only ever written to.
+        buffers.emplace_back(new char[kReadBytes]);
+        free_buffers.push_back(i);
+    }
+    std::vector<int> fds(m_paths.size(), -1);
+    std::vector<unsigned> file_reads_in_flight(m_paths.size(), 0);
+    auto close_file = [&](size_t file_index) {
+        if (fds[file_index] >= 0 && file_reads_in_flight[file_index] == 0) {
+            close(fds[file_index]);
+            fds[file_index] = -1;
+        }
+    };
+
+    // Where the next read starts.
+    size_t file_index = 0;
+    uint64_t offset = 0;
+    bool stop = false;
+    while (true) {
+        while (!stop && !free_buffers.empty() && file_index < m_paths.size()) {
+            {
+                std::unique_lock lock(m_mutex);
+                if (free_buffers.size() == kQueueDepth) {
+                    // Nothing is in flight, so this waits for the consumer or to stop.
+                    m_cv.wait(lock, [&] {
+                        return m_stop ||
+                               linear_offset(file_index, offset) < m_read_position + m_window_bytes;
+                    });
+                }
+                stop = m_stop;
+                if (m_read_position > linear_offset(file_index, offset)) {
+                    // The consumer is ahead, so there's no use reading what it has read.
+                    const auto next_file = std::upper_bound(m_file_starts.begin(),
+                                                            m_file_starts.end() - 1,
+                                                            m_read_position) -
+                                           m_file_starts.begin() - 1;
+                    if (size_t(next_file) != file_index) {
+                        close_file(file_index);
+                        file_index = size_t(next_file);
+                    }
+                    offset = m_read_position - m_file_starts[file_index];
+                }
+                if (stop ||
+                    linear_offset(file_index, offset) >= m_read_position + m_window_bytes) {
+                    break;
+                }
+            }
+            if (file_index == m_paths.size()) {
+                break;
+            }
+            if (offset >= file_size(file_index)) {
+                close_file(file_index);
+                ++file_index;
+                offset = 0;
+                continue;
+            }
+            if (fds[file_index] < 0) {
+                fds[file_index] = open(m_paths[file_index].c_str(), O_RDONLY);
+                if (fds[file_index] < 0) {
+                    ++file_index;
+                    offset = 0;
+                    continue;
+                }
+            }
+
+            const auto len =
+                    uint32_t(std::min<uint64_t>(kReadBytes, file_size(file_index) - offset));
+            const auto buffer = free_buffers.back();
+            free_buffers.pop_back();
+            buffer_files[buffer] = file_index;
+            ++file_reads_in_flight[file_index];
+            queue->submit(fds[file_index], buffers[buffer].get(), len, offset, buffer);
+            offset += len;
+        }
+
+        if (free_buffers.size() == kQueueDepth) {
+            // Nothing is in flight, so everything has been read or it's time to stop.
+            if (stop || file_index == m_paths.size()) {
+                break;
+            }
+            continue;
+        }
+        const auto [buffer, result] = queue->wait();
+        free_buffers.push_back(buffer);
+        const auto buffer_file = buffer_files[buffer];
+        --file_reads_in_flight[buffer_file];
+        if (result > 0) {
+            m_bytes_read += uint64_t(result);
+        } else if (result < 0) {
+            spdlog::debug("Reading ahead in {} failed: {}", m_paths[buffer_file],
+                          std::strerror(int(-result)));
+        }
+        if (buffer_file != file_index) {
+            close_file(buffer_file);
+        }
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        close_file(i);
+    }
+#endif  // _WIN32
+}
+
+}  // namespace dorado::utils
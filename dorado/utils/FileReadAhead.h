@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+// Reads a list of files ahead of their consumer, in large reads kept many deep in flight, so
+// that they are in the page cache by the time the consumer's own small, synchronous reads of
+// them arrive, and fast NVMe arrays are kept busy.  On Linux the reads are issued through
+// io_uring, and elsewhere, or on kernels without it, one at a time on the read-ahead thread.
+// What is read is discarded.
+class FileReadAhead {
+public:
+    static constexpr uint64_t kDefaultWindowBytes = uint64_t(1) << 30;
+
+    // Reads through the files in order, at most window_bytes ahead of the consumer's position.
+    // Files which can't be opened are skipped, for the consumer to report.
+    FileReadAhead(std::vector<std::string> paths, uint64_t window_bytes = kDefaultWindowBytes);
+    ~FileReadAhead();
+
+    // Where the consumer has read up to.  Reading ahead skips forward to it if it is behind.
+    void set_read_position(size_t file_index, uint64_t offset);
+    // Size of the file when reading ahead started, or 0 if it couldn't be found.
+    uint64_t file_size(size_t file_index) const;
+    uint64_t bytes_read() const { return m_bytes_read; }
+
+private:
+    // Offset of the position in the files taken end to end.
+    uint64_t linear_offset(size_t file_index, uint64_t offset) const;
+    void run();
+
+    const std::vector<std::string> m_paths;
+    // Offsets of the starts of the files and of the end of the last, when taken end to end.
+    std::vector<uint64_t> m_file_starts;
+    const uint64_t m_window_bytes;
+    std::atomic<uint64_t> m_bytes_read{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    uint64_t m_read_position{0};
+    bool m_stop{false};
+    std::thread m_thread;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,342 @@
+#include "GpuMonitor.h"
+
+#include "cuda_utils.h"
+
+#include <cuda_runtime.h>
+#include <nvml.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace dorado::utils {
+
+namespace {
+
+// NVML's PCIe throughput queries each take ~20ms, so the devices are polled on a thread of
+// their own, less often than the stats sampler reads them.
+constexpr auto kPollPeriod = std::chrono::seconds(1);
+// A PCIe link slows down when its device is idle, so is only checked while the device is at
+// least this busy.
+constexpr unsigned int kBusyUtilisationPct = 50;
+
+constexpr unsigned long long kPowerThrottleReasons =
+        nvmlClocksThrottleReasonSwPowerCap | nvmlClocksThrottleReasonHwPowerBrakeSlowdown;
+constexpr unsigned long long kThermalThrottleReasons =
+        nvmlClocksThrottleReasonSwThermalSlowdown | nvmlClocksThrottleReasonHwThermalSlowdown;
+
+}  // namespace
+
+// The NVML functions the monitor uses, looked up in the driver's library.
+class NvmlLibrary {
+public:
+    static std::unique_ptr<NvmlLibrary> load() {
+        std::unique_ptr<NvmlLibrary> nvml(new NvmlLibrary());
+#ifdef _WIN32
+        nvml->m_handle = LoadLibraryA("nvml.dll");
+#else
+        nvml->m_handle = dlopen("libnvidia-ml.so.1", RTLD_NOW | RTLD_LOCAL);
+#endif
+        if (!nvml->m_handle || !nvml->resolve_all()) {
+            return nullptr;
+        }
+        if (nvml->init() != NVML_SUCCESS) {
+            return nullptr;
+        }
+        nvml->m_initialised = true;
+        return nvml;
+    }
+
+    ~NvmlLibrary() {
+        if (m_initialised) {
+            shutdown();
+        }
+        if (m_handle) {
+#ifdef _WIN32
+            FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+            dlclose(m_handle);
+#endif
+        }
+    }
+
+    nvmlReturn_t (*init)();
+    nvmlReturn_t (*shutdown)();
+    nvmlReturn_t (*get_handle_by_pci_bus_id)(const char*, nvmlDevice_t*);
+    nvmlReturn_t (*get_clock_info)(nvmlDevice_t, nvmlClockType_t, unsigned int*);
+    nvmlReturn_t (*get_power_usage)(nvmlDevice_t, unsigned int*);
+    nvmlReturn_t (*get_temperature)(nvmlDevice_t, nvmlTemperatureSensors_t, unsigned int*);
+    nvmlReturn_t (*get_utilization_rates)(nvmlDevice_t, nvmlUtilization_t*);
+    nvmlReturn_t (*get_pcie_throughput)(nvmlDevice_t, nvmlPcieUtilCounter_t, unsigned int*);
+    nvmlReturn_t (*get_curr_pcie_link_generation)(nvmlDevice_t, unsigned int*);
+    nvmlReturn_t (*get_curr_pcie_link_width)(nvmlDevice_t, unsigned int*);
+    nvmlReturn_t (*get_max_pcie_link_generation)(nvmlDevice_t, unsigned int*);
+    nvmlReturn_t (*get_max_pcie_link_width)(nvmlDevice_t, unsigned int*);
+    nvmlReturn_t (*get_throttle_reasons)(nvmlDevice_t, unsigned long long*);
+
+private:
+    NvmlLibrary() = default;
+
+    template <class Function>
+    bool resolve(Function& function, const char* name) {
+#ifdef _WIN32
+        function =
+                reinterpret_cast<Function>(GetProcAddress(static_cast<HMODULE>(m_handle), name));
+#else
+        function = reinterpret_cast<Function>(dlsym(m_handle, name));
+#endif
+        if (!function) {
+            spdlog::debug("NVML has no {}", name);
+        }
+        return function != nullptr;
+    }
+
+    bool resolve_all() {
+        return resolve(init, "nvmlInit_v2") && resolve(shutdown, "nvmlShutdown") &&
+               resolve(get_handle_by_pci_bus_id, "nvmlDeviceGetHandleByPciBusId_v2") &&
+               resolve(get_clock_info, "nvmlDeviceGetClockInfo") &&
+               resolve(get_power_usage, "nvmlDeviceGetPowerUsage") &&
+               resolve(get_temperature, "nvmlDeviceGetTemperature") &&
+               resolve(get_utilization_rates, "nvmlDeviceGetUtilizationRates") &&
+               resolve(get_pcie_throughput, "nvmlDeviceGetPcieThroughput") &&
+               resolve(get_curr_pcie_link_generation, "nvmlDeviceGetCurrPcieLinkGeneration") &&
+               resolve(get_curr_pcie_link_width, "nvmlDeviceGetCurrPcieLinkWidth") &&
+               resolve(get_max_pcie_link_generation, "nvmlDeviceGetMaxPcieLinkGeneration") &&
+               resolve(get_max_pcie_link_width, "nvmlDeviceGetMaxPcieLinkWidth") &&
+               resolve(get_throttle_reasons, "nvmlDeviceGetCurrentClocksThrottleReasons");
+    }
+
+    void* m_handle{nullptr};
+    bool m_initialised{false};
+};
+
+struct GpuMonitor::Device {
+    int cuda_index;
+    nvmlDevice_t handle;
+    unsigned int max_link_generation{0};
+    unsigned int max_link_width{0};
+
+    // Updated by the polling thread, under the monitor's mutex.
+    stats::NamedStats latest;
+    int64_t num_samples{0};
+    int64_t num_power_throttled{0};
+    int64_t num_thermal_throttled{0};
+    int64_t num_hw_slowdown{0};
+    int64_t num_busy{0};
+    int64_t num_busy_link_degraded{0};
+    unsigned int min_busy_link_generation{0};
+    unsigned int min_busy_link_width{0};
+};
+
+// Polls the devices until the monitor is destroyed.
+class GpuMonitor::Poller {
+public:
+    explicit Poller(GpuMonitor& monitor) : m_monitor(monitor), m_thread([this] { run(); }) {}
+    ~Poller() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_terminate = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+private:
+    void run() {
+        std::unique_lock lock(m_mutex);
+        while (!m_terminate) {
+            lock.unlock();
+            m_monitor.poll();
+            lock.lock();
+            m_cv.wait_for(lock, kPollPeriod, [this] { return m_terminate; });
+        }
+    }
+
+    GpuMonitor& m_monitor;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_terminate{false};
+    std::thread m_thread;
+};
+
+std::unique_ptr<GpuMonitor> GpuMonitor::create(const std::vector<int>& cuda_device_indices) {
+    auto nvml = NvmlLibrary::load();
+    if (!nvml) {
+        spdlog::debug("NVML is unavailable, so GPU telemetry won't be sampled");
+        return nullptr;
+    }
+
+    std::vector<std::unique_ptr<Device>> devices;
+    for (const int cuda_index : cuda_device_indices) {
+        // CUDA and NVML may number the devices differently, so they are matched by PCIe
+        // location.
+        std::array<char, 32> pci_bus_id{};
+        nvmlDevice_t handle;
+        if (cudaDeviceGetPCIBusId(pci_bus_id.data(), int(pci_bus_id.size()), cuda_index) !=
+                    cudaSuccess ||
+            nvml->get_handle_by_pci_bus_id(pci_bus_id.data(), &handle) != NVML_SUCCESS) {
+            spdlog::debug("NVML doesn't know cuda:{}, so GPU telemetry won't be sampled",
+                          cuda_index);
+            return nullptr;
+        }
+        auto device = std::make_unique<Device>();
+        device->cuda_index = cuda_index;
+        device->handle = handle;
+        nvml->get_max_pcie_link_generation(handle, &device->max_link_generation);
+        nvml->get_max_pcie_link_width(handle, &device->max_link_width);
+        devices.push_back(std::move(device));
+    }
+    return std::unique_ptr<GpuMonitor>(new GpuMonitor(std::move(nvml), std::move(devices)));
+}
+
+std::unique_ptr<GpuMonitor> GpuMonitor::create(const std::string& device) {
+    std::vector<int> cuda_device_indices;
+    for (const auto& cuda_device : parse_cuda_device_string(device)) {
+        cuda_device_indices.push_back(torch::Device(cuda_device).index());
+    }
+    if (cuda_device_indices.empty()) {
+        return nullptr;
+    }
+    return create(cuda_device_indices);
+}
+
+GpuMonitor::GpuMonitor(std::unique_ptr<NvmlLibrary> nvml,
+                       std::vector<std::unique_ptr<Device>> devices)
+        : m_nvml(std::move(nvml)), m_devices(std::move(devices)) {
+    m_poller = std::make_unique<Poller>(*this);
+}
+
+GpuMonitor::~GpuMonitor() = default;
+
+void GpuMonitor::poll() {
+    for (auto& device : m_devices) {
+        const auto handle = device->handle;
+        stats::NamedStats sample;
+        unsigned int value = 0;
+        if (m_nvml->get_clock_info(handle, NVML_CLOCK_SM, &value) == NVML_SUCCESS) {
+            sample["sm_clock_mhz"] = value;
+        }
+        if (m_nvml->get_clock_info(handle, NVML_CLOCK_MEM, &value) == NVML_SUCCESS) {
+            sample["mem_clock_mhz"] = value;
+        }
+        if (m_nvml->get_power_usage(handle, &value) == NVML_SUCCESS) {
+            sample["power_w"] = value / 1000.;
+        }
+        if (m_nvml->get_temperature(handle, NVML_TEMPERATURE_GPU, &value) == NVML_SUCCESS) {
+            sample["temperature_c"] = value;
+        }
+        nvmlUtilization_t utilisation{};
+        const bool have_utilisation =
+                m_nvml->get_utilization_rates(handle, &utilisation) == NVML_SUCCESS;
+        if (have_utilisation) {
+            sample["gpu_utilisation_pct"] = utilisation.gpu;
+            sample["mem_utilisation_pct"] = utilisation.memory;
+        }
+        // Throughput is reported in KB/s.
+        if (m_nvml->get_pcie_throughput(handle, NVML_PCIE_UTIL_TX_BYTES, &value) ==
+            NVML_SUCCESS) {
+            sample["pcie_tx_mb_per_s"] = value / 1000.;
+        }
+        if (m_nvml->get_pcie_throughput(handle, NVML_PCIE_UTIL_RX_BYTES, &value) ==
+            NVML_SUCCESS) {
+            sample["pcie_rx_mb_per_s"] = value / 1000.;
+        }
+        unsigned int link_generation = 0;
+        unsigned int link_width = 0;
+        const bool have_link =
+                m_nvml->get_curr_pcie_link_generation(handle, &link_generation) ==
+                        NVML_SUCCESS &&
+                m_nvml->get_curr_pcie_link_width(handle, &link_width) == NVML_SUCCESS;
+        if (have_link) {
+            sample["pcie_link_generation"] = link_generation;
+            sample["pcie_link_width"] = link_width;
+        }
+        unsigned long long throttle_reasons = 0;
+        const bool have_throttle_reasons =
+                m_nvml->get_throttle_reasons(handle, &throttle_reasons) == NVML_SUCCESS;
+
+        std::lock_guard lock(m_mutex);
+        ++device->num_samples;
+        if (have_throttle_reasons) {
+            device->num_power_throttled += (throttle_reasons & kPowerThrottleReasons) != 0;
+            device->num_thermal_throttled += (throttle_reasons & kThermalThrottleReasons) != 0;
+            device->num_hw_slowdown +=
+                    (throttle_reasons & nvmlClocksThrottleReasonHwSlowdown) != 0;
+        }
+        if (have_utilisation && have_link && utilisation.gpu >= kBusyUtilisationPct) {
+            if (device->num_busy++ == 0) {
+                device->min_busy_link_generation = link_generation;
+                device->min_busy_link_width = link_width;
+            }
+            device->min_busy_link_generation =
+                    std::min(device->min_busy_link_generation, link_generation);
+            device->min_busy_link_width = std::min(device->min_busy_link_width, link_width);
+            device->num_busy_link_degraded += link_generation < device->max_link_generation ||
+                                              link_width < device->max_link_width;
+        }
+        sample["power_throttled_samples"] = double(device->num_power_throttled);
+        sample["thermal_throttled_samples"] = double(device->num_thermal_throttled);
+        sample["hw_slowdown_samples"] = double(device->num_hw_slowdown);
+        sample["pcie_link_degraded_samples"] = double(device->num_busy_link_degraded);
+        device->latest = std::move(sample);
+    }
+}
+
+stats::NamedStats GpuMonitor::sample_stats() const {
+    stats::NamedStats stats;
+    std::lock_guard lock(m_mutex);
+    for (const auto& device : m_devices) {
+        const auto prefix = "cuda" + std::to_string(device->cuda_index) + ".";
+        for (const auto& [name, value] : device->latest) {
+            stats[prefix + name] = value;
+        }
+    }
+    return stats;
+}
+
+std::vector<std::string> GpuMonitor::throttling_warnings() const {
+    std::vector<std::string> warnings;
+    std::lock_guard lock(m_mutex);
+    for (const auto& device : m_devices) {
+        if (device->num_samples == 0) {
+            continue;
+        }
+        const auto name = "cuda:" + std::to_string(device->cuda_index);
+        auto percent = [](int64_t count, int64_t total) {
+            return std::to_string(int(std::lround(100. * count / total))) + "%";
+        };
+        auto add_throttling = [&](int64_t num_throttled, const std::string& cause) {
+            if (num_throttled > 0) {
+                warnings.push_back(name + " was throttled by " + cause + " for " +
+                                   percent(num_throttled, device->num_samples) + " of the run");
+            }
+        };
+        add_throttling(device->num_power_throttled, "its power limit");
+        add_throttling(device->num_thermal_throttled, "its temperature");
+        add_throttling(device->num_hw_slowdown, "a hardware slowdown");
+        if (device->num_busy_link_degraded > 0) {
+            auto link = [](unsigned int generation, unsigned int width) {
+                return "Gen" + std::to_string(generation) + " x" + std::to_string(width);
+            };
+            warnings.push_back(
+                    name + "'s PCIe link ran at " +
+                    link(device->min_busy_link_generation, device->min_busy_link_width) +
+                    ", below its " + link(device->max_link_generation, device->max_link_width) +
+                    ", for " + percent(device->num_busy_link_degraded, device->num_busy) +
+                    " of the time it was busy");
+        }
+    }
+    return warnings;
+}
+
+}  // namespace dorado::utils
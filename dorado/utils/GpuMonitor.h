@@ -0,0 +1,53 @@
+#pragma once
+
+#include "stats.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+class NvmlLibrary;
+
+// Samples each CUDA device's clocks, power draw, temperature, utilisation and PCIe traffic
+// through NVML, as a stats reporter, so that throughput drops can be matched to thermal or
+// power throttling or to a PCIe link running below its best.  NVML is loaded when the monitor
+// is created, so dorado still runs on machines without it.
+class GpuMonitor {
+public:
+    // Monitors the CUDA devices with the given indices, or returns nullptr if NVML can't be
+    // loaded or doesn't know the devices.
+    static std::unique_ptr<GpuMonitor> create(const std::vector<int>& cuda_device_indices);
+    // As above, for the devices of a device string such as "cuda:0,1" or "cuda:all", or nullptr
+    // if it names no CUDA devices.
+    static std::unique_ptr<GpuMonitor> create(const std::string& device);
+    ~GpuMonitor();
+
+    std::string get_name() const { return "GpuMonitor"; }
+    // The latest values polled for each device, prefixed by cuda<index>, with running counts of
+    // the polls at which it was throttled.
+    stats::NamedStats sample_stats() const;
+
+    // A line for each device which was throttled, or whose PCIe link was slower than it can
+    // be while the device was busy, in the samples taken so far.
+    std::vector<std::string> throttling_warnings() const;
+
+private:
+    struct Device;
+    class Poller;
+
+    GpuMonitor(std::unique_ptr<NvmlLibrary> nvml, std::vector<std::unique_ptr<Device>> devices);
+    // Queries every device, on the poller's thread.
+    void poll();
+
+    std::unique_ptr<NvmlLibrary> m_nvml;
+    std::vector<std::unique_ptr<Device>> m_devices;
+    // Guards each device's latest values and sample counts.
+    mutable std::mutex m_mutex;
+    // Declared last, so that it stops polling before anything else is destroyed.
+    std::unique_ptr<Poller> m_poller;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,139 @@
+#include "MotifScanner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Index of the lowest set bit, which must exist.
+inline int lowest_bit64(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// The bases, as bits A=1, C=2, G=4, T=8, which an IUPAC code stands for, or 0 if it isn't one.
+uint8_t iupac_bases(char code) {
+    switch (code) {
+    case 'A':
+        return 1;
+    case 'C':
+        return 2;
+    case 'G':
+        return 4;
+    case 'T':
+    case 'U':
+        return 8;
+    case 'R':
+        return 1 | 4;
+    case 'Y':
+        return 2 | 8;
+    case 'S':
+        return 2 | 4;
+    case 'W':
+        return 1 | 8;
+    case 'K':
+        return 4 | 8;
+    case 'M':
+        return 1 | 2;
+    case 'B':
+        return 2 | 4 | 8;
+    case 'D':
+        return 1 | 4 | 8;
+    case 'H':
+        return 1 | 2 | 8;
+    case 'V':
+        return 1 | 2 | 4;
+    case 'N':
+        return 1 | 2 | 4 | 8;
+    default:
+        return 0;
+    }
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+MotifScanner::MotifScanner(const std::vector<std::string>& motifs) {
+    std::vector<std::string> unique_motifs;
+    for (const auto& motif : motifs) {
+        if (motif.empty() || motif.size() > 64) {
+            throw std::runtime_error("Motifs must be between 1 and 64 bases long: '" + motif +
+                                     "'");
+        }
+        auto it = std::find(unique_motifs.begin(), unique_motifs.end(), motif);
+        m_unique_index.push_back(size_t(it - unique_motifs.begin()));
+        if (it == unique_motifs.end()) {
+            unique_motifs.push_back(motif);
+        }
+    }
+
+    // Motifs fill each word in turn, a new word starting when the next doesn't fit.
+    constexpr char kBases[] = "ACGT";
+    size_t next_bit = 64;
+    for (size_t m = 0; m < unique_motifs.size(); ++m) {
+        const auto& motif = unique_motifs[m];
+        if (next_bit + motif.size() > 64) {
+            m_words.emplace_back();
+            next_bit = 0;
+        }
+        auto& word = m_words.back();
+        for (size_t i = 0; i < motif.size(); ++i) {
+            const uint8_t bases = iupac_bases(char(std::toupper(motif[i])));
+            if (bases == 0) {
+                throw std::runtime_error("Invalid base in motif '" + motif + "'");
+            }
+            const uint64_t bit = uint64_t(1) << (next_bit + i);
+            for (int b = 0; b < 4; ++b) {
+                if (bases & (1 << b)) {
+                    word.masks[uint8_t(kBases[b])] |= bit;
+                    word.masks[uint8_t(std::tolower(kBases[b]))] |= bit;
+                }
+            }
+        }
+        word.starts |= uint64_t(1) << next_bit;
+        word.ends |= uint64_t(1) << (next_bit + motif.size() - 1);
+        word.end_motif[next_bit + motif.size() - 1] = uint16_t(m);
+        m_unique_lengths.push_back(motif.size());
+        next_bit += motif.size();
+    }
+}
+
+std::vector<std::vector<size_t>> MotifScanner::scan(std::string_view sequence) const {
+    std::vector<std::vector<size_t>> unique_hits(m_unique_lengths.size());
+    const auto* chars = reinterpret_cast<const uint8_t*>(sequence.data());
+    for (const auto& word : m_words) {
+        // Bit b of state is set if the motif position it stands for, and all those before it
+        // in the motif, match the sequence ending at i.  The shift carries each motif's last
+        // bit into the next motif's first, which starts is or'd into anyway.
+        uint64_t state = 0;
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            state = ((state << 1) | word.starts) & word.masks[chars[i]];
+            uint64_t matches = state & word.ends;
+            while (matches) {
+                const int bit = lowest_bit64(matches);
+                const auto motif = word.end_motif[bit];
+                unique_hits[motif].push_back(i + 1 - m_unique_lengths[motif]);
+                matches &= matches - 1;
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> hits(m_unique_index.size());
+    for (size_t m = 0; m < hits.size(); ++m) {
+        hits[m] = unique_hits[m_unique_index[m]];
+    }
+    return hits;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dorado::utils {
+
+// Finds every occurrence of several motifs, which may contain IUPAC codes such as H in CHG,
+// in one pass over a sequence.  The motifs are packed side by side into 64 bit words and
+// matched together bit-parallel (shift-and), so each base costs a table lookup, a shift and
+// an and per word, however many motifs there are.  Identical motifs are only matched once.
+class MotifScanner {
+public:
+    // Motifs must be non-empty and at most 64 bases long.  Throws otherwise.
+    explicit MotifScanner(const std::vector<std::string>& motifs);
+
+    size_t num_motifs() const { return m_unique_index.size(); }
+
+    // The start of every, possibly overlapping, occurrence of each motif in sequence, in
+    // increasing order.  Bases other than A, C, G and T (either case) match no motif position.
+    std::vector<std::vector<size_t>> scan(std::string_view sequence) const;
+
+private:
+    struct Word {
+        // Bit b of masks[c] is set if character c may be at the position within its motif
+        // that bit b stands for.
+        std::array<uint64_t, 256> masks{};
+        // The bits for the first and last position of each motif.
+        uint64_t starts = 0;
+        uint64_t ends = 0;
+        // The unique motif ending at each bit.
+        std::array<uint16_t, 64> end_motif{};
+    };
+
+    std::vector<Word> m_words;
+    std::vector<size_t> m_unique_lengths;
+    // Index into the unique motifs of each motif.
+    std::vector<size_t> m_unique_index;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,135 @@
+#include "MoveTable.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+inline int popcount64(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// Index of the lowest set bit, which must exist.
+inline int lowest_bit64(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// Packs 64 moves per word, setting the bits of nonzero bytes.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void pack_moves(const uint8_t* moves, size_t num_moves, uint64_t* words) {
+    for (size_t i = 0; i < num_moves; ++i) {
+        if (moves[i]) {
+            words[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Each 32 moves are compared to zero at once and packed with a movemask.
+__attribute__((target("avx2"))) void pack_moves(const uint8_t* moves,
+                                                size_t num_moves,
+                                                uint64_t* words) {
+    const __m256i kZero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 64 <= num_moves; i += 64) {
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(moves + i));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(moves + i + 32));
+        const uint32_t low_zeros =
+                static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, kZero)));
+        const uint32_t high_zeros =
+                static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, kZero)));
+        words[i / 64] = ~((uint64_t(high_zeros) << 32) | low_zeros);
+    }
+    for (; i < num_moves; ++i) {
+        if (moves[i]) {
+            words[i / 64] |= uint64_t(1) << (i % 64);
+        }
+    }
+}
+#endif
+
+}  // namespace
+
+namespace dorado::utils {
+
+MoveTable::MoveTable(const std::vector<uint8_t>& moves)
+        : m_num_timesteps(moves.size()), m_words((moves.size() + 63) / 64, 0) {
+    pack_moves(moves.data(), moves.size(), m_words.data());
+    m_word_prefix.resize(m_words.size() + 1);
+    m_word_prefix[0] = 0;
+    for (size_t w = 0; w < m_words.size(); ++w) {
+        m_word_prefix[w + 1] = m_word_prefix[w] + popcount64(m_words[w]);
+    }
+}
+
+uint64_t MoveTable::cum_sum(size_t i) const {
+    assert(i < m_num_timesteps);
+    const size_t bit = i % 64;
+    const uint64_t through_bit = bit == 63 ? ~uint64_t(0) : (uint64_t(2) << bit) - 1;
+    return m_word_prefix[i / 64] + popcount64(m_words[i / 64] & through_bit);
+}
+
+std::vector<uint64_t> MoveTable::cum_sums() const {
+    std::vector<uint64_t> sums(m_num_timesteps);
+    for (size_t w = 0; w < m_words.size(); ++w) {
+        uint64_t sum = m_word_prefix[w];
+        const uint64_t word = m_words[w];
+        const size_t end = std::min(m_num_timesteps, (w + 1) * 64);
+        for (size_t i = w * 64; i < end; ++i) {
+            sum += (word >> (i % 64)) & 1;
+            sums[i] = sum;
+        }
+    }
+    return sums;
+}
+
+std::vector<uint64_t> MoveTable::to_sig_map(size_t block_stride, size_t signal_len) const {
+    std::vector<uint64_t> seq_to_sig_map;
+    seq_to_sig_map.reserve(num_moves() + 1);
+    for (size_t w = 0; w < m_words.size(); ++w) {
+        for (uint64_t word = m_words[w]; word; word &= word - 1) {
+            seq_to_sig_map.push_back((w * 64 + lowest_bit64(word)) * block_stride);
+        }
+    }
+    seq_to_sig_map.push_back(signal_len);
+    return seq_to_sig_map;
+}
+
+std::vector<uint8_t> pack_move_bits(const std::vector<uint8_t>& moves) {
+    std::vector<uint8_t> packed((moves.size() + 7) / 8, 0);
+    for (size_t i = 0; i < moves.size(); ++i) {
+        if (moves[i]) {
+            packed[i / 8] |= uint8_t(1) << (i % 8);
+        }
+    }
+    return packed;
+}
+
+std::vector<uint8_t> unpack_move_bits(const std::vector<uint8_t>& packed, size_t num_timesteps) {
+    assert(num_timesteps <= packed.size() * 8);
+    std::vector<uint8_t> moves(num_timesteps);
+    for (size_t i = 0; i < num_timesteps; ++i) {
+        moves[i] = (packed[i / 8] >> (i % 8)) & 1;
+    }
+    return moves;
+}
+
+}  // namespace dorado::utils
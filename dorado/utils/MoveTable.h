@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dorado::utils {
+
+// A move table packed one timestep per bit, with the number of moves before each 64 timestep
+// word, so that cumulative sums and the signal position of each base are found from popcounts
+// and bit scans rather than by walking a byte per timestep.
+class MoveTable {
+public:
+    MoveTable() = default;
+    // Any nonzero value is a move.
+    explicit MoveTable(const std::vector<uint8_t>& moves);
+
+    size_t num_timesteps() const { return m_num_timesteps; }
+    size_t num_moves() const { return m_word_prefix.empty() ? 0 : m_word_prefix.back(); }
+    bool is_move(size_t i) const { return (m_words[i / 64] >> (i % 64)) & 1; }
+
+    // The number of moves in timesteps [0, i], as move_cum_sums(moves)[i].
+    uint64_t cum_sum(size_t i) const;
+
+    // As move_cum_sums(moves).
+    std::vector<uint64_t> cum_sums() const;
+
+    // As moves_to_map(moves, block_stride, signal_len): the signal position of each base's
+    // first timestep, followed by signal_len.
+    std::vector<uint64_t> to_sig_map(size_t block_stride, size_t signal_len) const;
+
+private:
+    size_t m_num_timesteps = 0;
+    std::vector<uint64_t> m_words;
+    // Moves before each word, and the total.
+    std::vector<uint64_t> m_word_prefix;
+};
+
+// Move tables written with --pack-moves are held in the mp tag rather than mv, as a B:C array
+// of the model stride, the number of unused bits at the end of the last byte, then the moves
+// one timestep per bit, starting from the least significant bit of the first byte.  That is an
+// eighth of the size of mv, which has a byte per timestep.
+
+// The bytes of moves packed one timestep per bit, as in the mp tag.  Any nonzero value is a
+// move.
+std::vector<uint8_t> pack_move_bits(const std::vector<uint8_t>& moves);
+// The first num_timesteps moves of packed, as 0s and 1s.
+std::vector<uint8_t> unpack_move_bits(const std::vector<uint8_t>& packed, size_t num_timesteps);
+
+}  // namespace dorado::utils
@@ -0,0 +1,801 @@
+#include "ObjectStore.h"
+
+#include "cache_utils.h"
+
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <httplib.h>
+
+namespace dorado::utils {
+
+namespace {
+
+// Objects are downloaded in ranges of this size, each a request of its own, so that one
+// object is fetched over several connections at once.
+constexpr uint64_t kRangeBytes = 16 << 20;
+// Attempts at each range, or each part of an upload, before the object is given up on.
+constexpr int kMaxRangeAttempts = 3;
+constexpr int kMaxPartAttempts = 3;
+// Limits of S3 multipart uploads.  Parts double in size every kPartsPerDoubling, so that an
+// upload of 8 MiB parts can grow to nearly 500 GiB.
+constexpr size_t kMinPartBytes = size_t(5) << 20;
+constexpr size_t kMaxParts = 10000;
+constexpr size_t kPartsPerDoubling = 2000;
+
+const std::string kS3Scheme = "s3://";
+const std::string kGcsScheme = "gs://";
+
+std::string getenv_or(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return value && *value ? std::string(value) : fallback;
+}
+
+std::string to_hex(const unsigned char* data, size_t size) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        hex += kDigits[data[i] >> 4];
+        hex += kDigits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+std::string sha256_hex(const std::string& data) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest);
+    return to_hex(digest, sizeof(digest));
+}
+
+std::string hmac_sha256(const std::string& key, const std::string& data) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    HMAC(EVP_sha256(), key.data(), int(key.size()),
+         reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest, &size);
+    return std::string(reinterpret_cast<const char*>(digest), size);
+}
+
+// Percent-encodes everything but the unreserved characters, and '/' unless encode_slash, as
+// signature v4 requires.
+std::string uri_encode(const std::string& value, bool encode_slash) {
+    std::string encoded;
+    for (const unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ||
+            (c == '/' && !encode_slash)) {
+            encoded += char(c);
+        } else {
+            char escape[4];
+            std::snprintf(escape, sizeof(escape), "%%%02X", c);
+            encoded += escape;
+        }
+    }
+    return encoded;
+}
+
+std::string xml_unescape(std::string value) {
+    const std::pair<std::string, std::string> kEntities[] = {
+            {"&quot;", "\""}, {"&apos;", "'"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&amp;", "&"}};
+    for (const auto& [entity, character] : kEntities) {
+        for (auto pos = value.find(entity); pos != std::string::npos;
+             pos = value.find(entity, pos + character.size())) {
+            value.replace(pos, entity.size(), character);
+        }
+    }
+    return value;
+}
+
+// The unescaped text of the first <tag> element in xml[begin, end), or an empty string.
+std::string xml_value(const std::string& xml,
+                      const std::string& tag,
+                      size_t begin = 0,
+                      size_t end = std::string::npos) {
+    const std::string open = "<" + tag + ">";
+    const auto start = xml.find(open, begin);
+    if (start == std::string::npos || start >= end) {
+        return {};
+    }
+    const auto value_start = start + open.size();
+    const auto stop = xml.find("</" + tag + ">", value_start);
+    if (stop == std::string::npos || stop > end) {
+        return {};
+    }
+    return xml_unescape(xml.substr(value_start, stop - value_start));
+}
+
+httplib::Headers make_headers(std::vector<std::pair<std::string, std::string>> headers) {
+    httplib::Headers result;
+    for (auto& header : headers) {
+        result.emplace(std::move(header));
+    }
+    return result;
+}
+
+std::string describe_failure(const httplib::Result& response) {
+    if (!response) {
+        return "no response";
+    }
+    auto description = "HTTP status " + std::to_string(response->status);
+    const auto message = xml_value(response->body, "Message");
+    return message.empty() ? description : description + " " + message;
+}
+
+// Splits "scheme://host[:port]" into its scheme and host.
+std::pair<std::string, std::string> split_endpoint(const std::string& endpoint) {
+    const auto separator = endpoint.find("://");
+    if (separator == std::string::npos) {
+        return {"https", endpoint};
+    }
+    auto host = endpoint.substr(separator + 3);
+    if (!host.empty() && host.back() == '/') {
+        host.pop_back();
+    }
+    return {endpoint.substr(0, separator), host};
+}
+
+}  // namespace
+
+bool is_object_store_url(const std::string& path) {
+    return path.rfind(kS3Scheme, 0) == 0 || path.rfind(kGcsScheme, 0) == 0;
+}
+
+struct ObjectStoreClient::Connection {
+    explicit Connection(const std::string& scheme_host_port) : client(scheme_host_port) {
+        client.set_connection_timeout(30);
+        client.set_read_timeout(60);
+        client.set_keep_alive(true);
+    }
+    httplib::Client client;
+};
+
+ObjectStoreClient::ObjectStoreClient(const std::string& url) {
+    if (!is_object_store_url(url)) {
+        throw std::runtime_error("Not an object store URL: " + url);
+    }
+    const bool gcs = url.rfind(kGcsScheme, 0) == 0;
+    m_url_scheme = gcs ? kGcsScheme : kS3Scheme;
+    const auto location = url.substr(m_url_scheme.size());
+    const auto slash = location.find('/');
+    m_bucket = location.substr(0, slash);
+    m_prefix = slash == std::string::npos ? "" : location.substr(slash + 1);
+    if (m_bucket.empty()) {
+        throw std::runtime_error("No bucket in object store URL: " + url);
+    }
+
+    m_access_key = getenv_or("AWS_ACCESS_KEY_ID", "");
+    m_secret_key = getenv_or("AWS_SECRET_ACCESS_KEY", "");
+    m_session_token = getenv_or("AWS_SESSION_TOKEN", "");
+    if (gcs) {
+        std::tie(m_scheme, m_host) = split_endpoint("https://storage.googleapis.com");
+        m_region = "auto";
+        m_path_style = true;
+    } else {
+        m_region = getenv_or("AWS_REGION", getenv_or("AWS_DEFAULT_REGION", "us-east-1"));
+        if (const auto endpoint = getenv_or("AWS_ENDPOINT_URL", ""); !endpoint.empty()) {
+            // Other stores, such as MinIO, don't have buckets in their host names.
+            std::tie(m_scheme, m_host) = split_endpoint(endpoint);
+            m_path_style = true;
+        } else {
+            m_scheme = "https";
+            m_host = m_bucket + ".s3." + m_region + ".amazonaws.com";
+        }
+    }
+    m_connection = std::make_unique<Connection>(m_scheme + "://" + m_host);
+}
+
+ObjectStoreClient::~ObjectStoreClient() = default;
+
+std::string ObjectStoreClient::object_url(const std::string& key) const {
+    return m_url_scheme + m_bucket + "/" + key;
+}
+
+std::string ObjectStoreClient::object_path(const std::string& key) const {
+    return (m_path_style ? "/" + uri_encode(m_bucket, true) : "") + "/" + uri_encode(key, false);
+}
+
+std::vector<std::pair<std::string, std::string>> ObjectStoreClient::signed_headers(
+        const std::string& method,
+        const std::string& path,
+        const std::string& canonical_query) const {
+    // Over HTTPS, S3 doesn't need the payload hashed.
+    const std::string payload_hash = "UNSIGNED-PAYLOAD";
+    std::vector<std::pair<std::string, std::string>> headers{
+            {"x-amz-content-sha256", payload_hash}};
+    if (m_access_key.empty()) {
+        return headers;
+    }
+
+    const std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char timestamp[17];
+    std::strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &utc);
+    const std::string amz_date = timestamp;
+    const std::string date = amz_date.substr(0, 8);
+    headers.emplace_back("x-amz-date", amz_date);
+    if (!m_session_token.empty()) {
+        headers.emplace_back("x-amz-security-token", m_session_token);
+    }
+
+    // Headers are signed in name order, with the host httplib adds.
+    std::map<std::string, std::string> canonical_headers{{"host", m_host}};
+    for (const auto& [name, value] : headers) {
+        canonical_headers[name] = value;
+    }
+    std::string header_lines;
+    std::string signed_header_names;
+    for (const auto& [name, value] : canonical_headers) {
+        header_lines += name + ":" + value + "\n";
+        signed_header_names += (signed_header_names.empty() ? "" : ";") + name;
+    }
+    const std::string canonical_request = method + "\n" + path + "\n" + canonical_query +
+                                          "\n" + header_lines + "\n" + signed_header_names +
+                                          "\n" + payload_hash;
+
+    const std::string scope = date + "/" + m_region + "/s3/aws4_request";
+    const std::string string_to_sign = "AWS4-HMAC-SHA256\n" + amz_date + "\n" + scope + "\n" +
+                                       sha256_hex(canonical_request);
+    auto key = hmac_sha256("AWS4" + m_secret_key, date);
+    key = hmac_sha256(key, m_region);
+    key = hmac_sha256(key, "s3");
+    key = hmac_sha256(key, "aws4_request");
+    const auto signature = hmac_sha256(key, string_to_sign);
+    headers.emplace_back(
+            "Authorization",
+            "AWS4-HMAC-SHA256 Credential=" + m_access_key + "/" + scope +
+                    ", SignedHeaders=" + signed_header_names + ", Signature=" +
+                    to_hex(reinterpret_cast<const unsigned char*>(signature.data()),
+                           signature.size()));
+    return headers;
+}
+
+std::vector<ObjectInfo> ObjectStoreClient::list_objects() {
+    const std::string path = m_path_style ? "/" + uri_encode(m_bucket, true) : "/";
+    std::vector<ObjectInfo> objects;
+    std::string continuation_token;
+    while (true) {
+        // The query is canonical as it is: its parameters are in name order, and encoded.
+        std::string query;
+        if (!continuation_token.empty()) {
+            query += "continuation-token=" + uri_encode(continuation_token, true) + "&";
+        }
+        query += "list-type=2&prefix=" + uri_encode(m_prefix, true);
+
+        auto response = m_connection->client.Get((path + "?" + query).c_str(),
+                                                 make_headers(signed_headers("GET", path, query)));
+        if (!response || response->status != 200) {
+            throw std::runtime_error("Failed to list " + object_url(m_prefix) + ": " +
+                                     describe_failure(response));
+        }
+
+        const auto& body = response->body;
+        for (auto begin = body.find("<Contents>"); begin != std::string::npos;
+             begin = body.find("<Contents>", begin + 1)) {
+            const auto end = body.find("</Contents>", begin);
+            ObjectInfo object;
+            object.key = xml_value(body, "Key", begin, end);
+            object.size = std::strtoull(xml_value(body, "Size", begin, end).c_str(), nullptr, 10);
+            object.etag = xml_value(body, "ETag", begin, end);
+            object.etag.erase(std::remove(object.etag.begin(), object.etag.end(), '"'),
+                              object.etag.end());
+            objects.push_back(std::move(object));
+        }
+        continuation_token = xml_value(body, "NextContinuationToken");
+        if (xml_value(body, "IsTruncated") != "true" || continuation_token.empty()) {
+            break;
+        }
+    }
+    return objects;
+}
+
+bool ObjectStoreClient::get_range(const std::string& key,
+                                  uint64_t begin,
+                                  uint64_t length,
+                                  const std::function<bool(const char* data, size_t size)>& write) {
+    const auto path = object_path(key);
+    auto headers = make_headers(signed_headers("GET", path, ""));
+    headers.emplace("Range", "bytes=" + std::to_string(begin) + "-" +
+                                     std::to_string(begin + length - 1));
+
+    int status = 0;
+    uint64_t received = 0;
+    auto response = m_connection->client.Get(
+            path.c_str(), headers,
+            [&status](const httplib::Response& response) {
+                // Anything but the range would be written in the wrong place.
+                status = response.status;
+                return response.status == 206;
+            },
+            [&](const char* data, size_t size) {
+                received += size;
+                return received <= length && write(data, size);
+            });
+    if (status != 0 && status != 206) {
+        spdlog::debug("Fetching {} failed with HTTP status {}", object_url(key), status);
+    }
+    return response && status == 206 && received == length;
+}
+
+void ObjectStoreClient::put_object(const std::string& key, const char* data, size_t size) {
+    const auto path = object_path(key);
+    auto response = m_connection->client.Put(path.c_str(),
+                                             make_headers(signed_headers("PUT", path, "")), data,
+                                             size, "application/octet-stream");
+    if (!response || response->status != 200) {
+        throw std::runtime_error("Failed to upload " + object_url(key) + ": " +
+                                 describe_failure(response));
+    }
+}
+
+std::string ObjectStoreClient::start_upload(const std::string& key) {
+    const auto path = object_path(key);
+    const std::string query = "uploads=";
+    auto response = m_connection->client.Post((path + "?" + query).c_str(),
+                                              make_headers(signed_headers("POST", path, query)),
+                                              "", "application/octet-stream");
+    const auto upload_id = response ? xml_value(response->body, "UploadId") : "";
+    if (!response || response->status != 200 || upload_id.empty()) {
+        throw std::runtime_error("Failed to start uploading " + object_url(key) + ": " +
+                                 describe_failure(response));
+    }
+    return upload_id;
+}
+
+std::string ObjectStoreClient::upload_part(const std::string& key,
+                                           const std::string& upload_id,
+                                           size_t part_number,
+                                           const char* data,
+                                           size_t size) {
+    const auto path = object_path(key);
+    const auto query = "partNumber=" + std::to_string(part_number) +
+                       "&uploadId=" + uri_encode(upload_id, true);
+    auto response = m_connection->client.Put((path + "?" + query).c_str(),
+                                             make_headers(signed_headers("PUT", path, query)),
+                                             data, size, "application/octet-stream");
+    if (!response || response->status != 200) {
+        spdlog::debug("Uploading part {} of {} failed: {}", part_number, object_url(key),
+                      describe_failure(response));
+        return {};
+    }
+    return response->get_header_value("ETag");
+}
+
+void ObjectStoreClient::complete_upload(const std::string& key,
+                                        const std::string& upload_id,
+                                        const std::vector<std::string>& part_etags) {
+    std::string body = "<CompleteMultipartUpload>";
+    for (size_t i = 0; i < part_etags.size(); ++i) {
+        body += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" +
+                part_etags[i] + "</ETag></Part>";
+    }
+    body += "</CompleteMultipartUpload>";
+
+    const auto path = object_path(key);
+    const auto query = "uploadId=" + uri_encode(upload_id, true);
+    auto response = m_connection->client.Post((path + "?" + query).c_str(),
+                                              make_headers(signed_headers("POST", path, query)),
+                                              body, "application/xml");
+    // Completing can fail after the response has started, with an error in a 200 response.
+    if (!response || response->status != 200 ||
+        response->body.find("<Error>") != std::string::npos) {
+        throw std::runtime_error("Failed to complete uploading " + object_url(key) + ": " +
+                                 describe_failure(response));
+    }
+}
+
+void ObjectStoreClient::abort_upload(const std::string& key, const std::string& upload_id) {
+    const auto path = object_path(key);
+    const auto query = "uploadId=" + uri_encode(upload_id, true);
+    auto response = m_connection->client.Delete(
+            (path + "?" + query).c_str(), make_headers(signed_headers("DELETE", path, query)));
+    if (!response || (response->status != 204 && response->status != 200)) {
+        spdlog::warn("Failed to abort uploading {}, whose parts may need removing: {}",
+                     object_url(key), describe_failure(response));
+    }
+}
+
+ObjectUploader::ObjectUploader(const std::string& url,
+                               size_t part_bytes,
+                               size_t max_parts_buffered)
+        : m_url(url),
+          m_client(url),
+          m_part_bytes(std::max(part_bytes, kMinPartBytes)),
+          m_max_parts_buffered(std::max<size_t>(max_parts_buffered, 1)) {
+    if (m_client.prefix().empty()) {
+        throw std::runtime_error("No object to upload to in " + url);
+    }
+    // A thread per buffered part, so that all of them can be uploading at once.
+    for (size_t i = 0; i < m_max_parts_buffered; ++i) {
+        m_threads.emplace_back(&ObjectUploader::upload_parts, this);
+    }
+}
+
+ObjectUploader::~ObjectUploader() {
+    if (m_pipe_thread.joinable()) {
+        m_pipe_thread.join();
+    }
+    if (!m_finished) {
+        abort();
+    }
+}
+
+size_t ObjectUploader::next_part_bytes() const {
+    return m_part_bytes << std::min<size_t>(m_num_parts / kPartsPerDoubling, 16);
+}
+
+void ObjectUploader::write(const char* data, size_t size) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_error.empty()) {
+            throw std::runtime_error(m_error);
+        }
+    }
+    m_buffer.append(data, size);
+    m_bytes_written += size;
+    size_t part_bytes = next_part_bytes();
+    while (m_buffer.size() >= part_bytes) {
+        std::string part(m_buffer, 0, part_bytes);
+        m_buffer.erase(0, part_bytes);
+        submit_part(std::move(part));
+        part_bytes = next_part_bytes();
+    }
+}
+
+void ObjectUploader::submit_part(std::string data) {
+    if (m_upload_id.empty()) {
+        m_upload_id = m_client.start_upload(m_client.prefix());
+    }
+    if (++m_num_parts > kMaxParts) {
+        throw std::runtime_error("Too many parts in the upload of " + m_url);
+    }
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this] {
+        return m_num_parts_buffered < m_max_parts_buffered || !m_error.empty();
+    });
+    if (!m_error.empty()) {
+        throw std::runtime_error(m_error);
+    }
+    m_part_etags.resize(m_num_parts);
+    m_pending_parts.push_back({m_num_parts, std::move(data)});
+    ++m_num_parts_buffered;
+    m_cv.notify_all();
+}
+
+void ObjectUploader::upload_parts() {
+    ObjectStoreClient client(m_url);
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this] { return m_stop || !m_pending_parts.empty(); });
+        if (m_stop) {
+            return;
+        }
+        auto part = std::move(m_pending_parts.front());
+        m_pending_parts.pop_front();
+        const auto upload_id = m_upload_id;
+        const bool failed = !m_error.empty();
+        lock.unlock();
+
+        std::string etag;
+        for (int attempt = 0; attempt < kMaxPartAttempts && etag.empty() && !failed; ++attempt) {
+            etag = client.upload_part(client.prefix(), upload_id, part.number, part.data.data(),
+                                      part.data.size());
+        }
+
+        lock.lock();
+        if (etag.empty() && m_error.empty()) {
+            m_error = "Failed to upload part " + std::to_string(part.number) + " of " + m_url;
+        }
+        m_part_etags[part.number - 1] = std::move(etag);
+        --m_num_parts_buffered;
+        m_cv.notify_all();
+    }
+}
+
+int ObjectUploader::open_pipe() {
+    int fds[2];
+#ifdef _WIN32
+    const int result = _pipe(fds, 1 << 20, _O_BINARY);
+#else
+    const int result = pipe(fds);
+#endif
+    if (result != 0) {
+        throw std::runtime_error("Failed to create a pipe to upload " + m_url + " from");
+    }
+    m_pipe_thread = std::thread(&ObjectUploader::pump_pipe, this, fds[0]);
+    return fds[1];
+}
+
+void ObjectUploader::pump_pipe(int fd) {
+    std::vector<char> buffer(1 << 20);
+    bool failed = false;
+    while (true) {
+#ifdef _WIN32
+        const auto size = _read(fd, buffer.data(), unsigned(buffer.size()));
+#else
+        const auto size = read(fd, buffer.data(), buffer.size());
+#endif
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            break;
+        }
+        // After a failure the rest is only drained, so that the writer isn't left blocked.
+        if (!failed) {
+            try {
+                write(buffer.data(), size_t(size));
+            } catch (const std::exception& e) {
+                failed = true;
+                std::lock_guard lock(m_mutex);
+                if (m_error.empty()) {
+                    m_error = e.what();
+                }
+            }
+        }
+    }
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+void ObjectUploader::finish() {
+    if (m_pipe_thread.joinable()) {
+        m_pipe_thread.join();
+    }
+    try {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_error.empty()) {
+                throw std::runtime_error(m_error);
+            }
+        }
+        if (m_upload_id.empty()) {
+            m_client.put_object(m_client.prefix(), m_buffer.data(), m_buffer.size());
+        } else {
+            if (!m_buffer.empty()) {
+                submit_part(std::move(m_buffer));
+                m_buffer.clear();
+            }
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_num_parts_buffered == 0; });
+                if (!m_error.empty()) {
+                    throw std::runtime_error(m_error);
+                }
+            }
+            m_client.complete_upload(m_client.prefix(), m_upload_id, m_part_etags);
+        }
+    } catch (...) {
+        abort();
+        m_finished = true;
+        throw;
+    }
+    m_upload_id.clear();
+    abort();
+    m_finished = true;
+}
+
+void ObjectUploader::abort() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    if (!m_upload_id.empty()) {
+        m_client.abort_upload(m_client.prefix(), m_upload_id);
+        m_upload_id.clear();
+    }
+}
+
+struct ObjectPrefetcher::Object {
+    ObjectInfo info;
+    std::filesystem::path path;
+    // Ranges still being downloaded, and whether staging the object has finished, whether or
+    // not it succeeded.
+    size_t ranges_left{0};
+    bool done{false};
+    bool failed{false};
+
+    std::filesystem::path part_path() const { return path.string() + ".part"; }
+};
+
+std::filesystem::path ObjectPrefetcher::staged_path(const std::filesystem::path& staging_dir,
+                                                    const std::string& object_url,
+                                                    const ObjectInfo& object) {
+    const auto extension = std::filesystem::path(object.key).extension().string();
+    return staging_dir / cache_file_name({object_url, object.etag, std::to_string(object.size)},
+                                         extension);
+}
+
+ObjectPrefetcher::ObjectPrefetcher(std::string url,
+                                   std::vector<ObjectInfo> objects,
+                                   std::filesystem::path staging_dir,
+                                   uint64_t window_bytes,
+                                   size_t num_connections)
+        : m_url(std::move(url)),
+          m_staging_dir(std::move(staging_dir)),
+          m_window_bytes(window_bytes) {
+    std::filesystem::create_directories(m_staging_dir);
+    const ObjectStoreClient client(m_url);
+    m_objects.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        m_objects[i].path = staged_path(m_staging_dir, client.object_url(objects[i].key),
+                                        objects[i]);
+        m_objects[i].info = std::move(objects[i]);
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        admit_objects();
+    }
+    for (size_t i = 0; i < std::max<size_t>(num_connections, 1); ++i) {
+        m_threads.emplace_back(&ObjectPrefetcher::download_ranges, this);
+    }
+}
+
+ObjectPrefetcher::~ObjectPrefetcher() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    // Staged objects are kept for a later run, but partial ones are of no use.
+    for (size_t i = 0; i < m_next_admitted_index; ++i) {
+        std::error_code error;
+        std::filesystem::remove(m_objects[i].part_path(), error);
+    }
+}
+
+void ObjectPrefetcher::admit_objects() {
+    while (m_next_admitted_index < m_objects.size()) {
+        const auto index = m_next_admitted_index;
+        auto& object = m_objects[index];
+        // The next object to return is always admitted, however large, so that loading can
+        // go on.
+        if (index > m_next_index && m_staged_bytes + object.info.size > m_window_bytes) {
+            break;
+        }
+        ++m_next_admitted_index;
+        m_staged_bytes += object.info.size;
+
+        std::error_code error;
+        if (std::filesystem::file_size(object.path, error) == object.info.size && !error) {
+            object.done = true;
+            continue;
+        }
+        const auto part_path = object.part_path();
+        { std::ofstream create(part_path, std::ios::binary | std::ios::trunc); }
+        std::filesystem::resize_file(part_path, object.info.size, error);
+        if (error) {
+            spdlog::error("Failed to stage {} at {}: {}", object.info.key, part_path.string(),
+                          error.message());
+            object.done = object.failed = true;
+            continue;
+        }
+        if (object.info.size == 0) {
+            std::filesystem::rename(part_path, object.path, error);
+            object.done = true;
+            object.failed = bool(error);
+            continue;
+        }
+        for (uint64_t begin = 0; begin < object.info.size; begin += kRangeBytes) {
+            m_pending_ranges.push_back(
+                    {index, begin, std::min(kRangeBytes, object.info.size - begin)});
+            ++object.ranges_left;
+        }
+    }
+    m_cv.notify_all();
+}
+
+void ObjectPrefetcher::download_ranges() {
+    ObjectStoreClient client(m_url);
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this] { return m_stop || !m_pending_ranges.empty(); });
+        if (m_stop) {
+            return;
+        }
+        const auto range = m_pending_ranges.front();
+        m_pending_ranges.pop_front();
+        auto& object = m_objects[range.object_index];
+        const auto key = object.info.key;
+        const auto part_path = object.part_path();
+        bool downloaded = object.failed;
+        lock.unlock();
+
+        for (int attempt = 0; attempt < kMaxRangeAttempts && !downloaded; ++attempt) {
+            std::fstream file(part_path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(range.begin);
+            downloaded = file && client.get_range(key, range.begin, range.length,
+                                                  [&](const char* data, size_t size) {
+                                                      file.write(data, size);
+                                                      m_bytes_downloaded += size;
+                                                      return bool(file);
+                                                  });
+            file.close();
+            downloaded = downloaded && file;
+        }
+
+        lock.lock();
+        if (!downloaded && !object.failed) {
+            spdlog::error("Failed to download {}", client.object_url(key));
+            object.failed = true;
+        }
+        if (--object.ranges_left == 0) {
+            if (!object.failed) {
+                std::error_code error;
+                std::filesystem::rename(part_path, object.path, error);
+                object.failed = bool(error);
+            }
+            object.done = true;
+            m_cv.notify_all();
+        }
+    }
+}
+
+std::optional<std::filesystem::path> ObjectPrefetcher::next() {
+    std::unique_lock lock(m_mutex);
+    while (m_next_index < m_objects.size()) {
+        admit_objects();
+        auto& object = m_objects[m_next_index];
+        m_cv.wait(lock, [&object] { return object.done; });
+        ++m_next_index;
+        if (object.failed) {
+            std::error_code error;
+            std::filesystem::remove(object.part_path(), error);
+            m_staged_bytes -= object.info.size;
+            continue;
+        }
+        admit_objects();
+        return object.path;
+    }
+    return std::nullopt;
+}
+
+void ObjectPrefetcher::release(const std::filesystem::path& path) {
+    std::lock_guard lock(m_mutex);
+    for (size_t i = m_next_index; i-- > 0;) {
+        if (m_objects[i].path == path) {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            m_staged_bytes -= m_objects[i].info.size;
+            break;
+        }
+    }
+    admit_objects();
+}
+
+}  // namespace dorado::utils
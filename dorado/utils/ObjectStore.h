@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+// Whether path is an object store URL, s3://bucket/prefix or gs://bucket/prefix, rather than
+// a local path.
+bool is_object_store_url(const std::string& path);
+
+// An object in a bucket.
+struct ObjectInfo {
+    std::string key;
+    uint64_t size{0};
+    std::string etag;
+};
+
+// Lists and reads objects through the S3 REST API, signing requests with AWS signature v4.
+// Credentials come from AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_SESSION_TOKEN, and
+// requests are unsigned without them, as for public buckets.  The region comes from AWS_REGION
+// or AWS_DEFAULT_REGION, and AWS_ENDPOINT_URL replaces the AWS endpoint, e.g. for an S3
+// compatible store.  gs:// buckets are read through Google Cloud Storage's S3 compatible API,
+// with HMAC keys in the same variables.  Each client holds one connection, so isn't thread
+// safe.
+class ObjectStoreClient {
+public:
+    // Throws if url isn't an object store URL.
+    explicit ObjectStoreClient(const std::string& url);
+    ~ObjectStoreClient();
+
+    // The bucket's objects under the URL's prefix, in key order.  Throws on failure.
+    std::vector<ObjectInfo> list_objects();
+    const std::string& prefix() const { return m_prefix; }
+    // Passes bytes [begin, begin + length) of the object to write, as they arrive, and returns
+    // whether they all arrived.
+    bool get_range(const std::string& key,
+                   uint64_t begin,
+                   uint64_t length,
+                   const std::function<bool(const char* data, size_t size)>& write);
+
+    // Uploads the object in one request.  Throws on failure.
+    void put_object(const std::string& key, const char* data, size_t size);
+    // Multipart uploads, which are kept apart by their IDs.  Parts are numbered from 1, and
+    // all but the last must be at least 5 MiB.  upload_part returns the part's ETag, or an
+    // empty string on failure, and the others throw on failure, except abort_upload, which
+    // only logs it.
+    std::string start_upload(const std::string& key);
+    std::string upload_part(const std::string& key,
+                            const std::string& upload_id,
+                            size_t part_number,
+                            const char* data,
+                            size_t size);
+    void complete_upload(const std::string& key,
+                         const std::string& upload_id,
+                         const std::vector<std::string>& part_etags);
+    void abort_upload(const std::string& key, const std::string& upload_id);
+
+    // The URL of the object.
+    std::string object_url(const std::string& key) const;
+
+private:
+    struct Connection;
+
+    // Headers, including the signature, for a request of path with canonical_query.
+    std::vector<std::pair<std::string, std::string>> signed_headers(
+            const std::string& method,
+            const std::string& path,
+            const std::string& canonical_query) const;
+    // Path of the object's key, including the bucket if it isn't in the host name.
+    std::string object_path(const std::string& key) const;
+
+    // Of the URL, s3:// or gs://, and of the endpoint.
+    std::string m_url_scheme;
+    std::string m_scheme;
+    std::string m_bucket;
+    std::string m_prefix;
+    std::string m_host;
+    bool m_path_style{false};
+    std::string m_region;
+    std::string m_access_key;
+    std::string m_secret_key;
+    std::string m_session_token;
+    std::unique_ptr<Connection> m_connection;
+};
+
+// Uploads an object as it is written, without staging it locally: the data is cut into parts
+// which are uploaded over several connections at once, as a multipart upload, with at most
+// max_parts_buffered parts held in memory, blocking the writer while they are.  An object too
+// small for a part is uploaded in one request when finished.  The parts grow as the upload
+// does, to keep within the store's limit of 10000 parts.  An upload which isn't finished,
+// or which fails, is aborted, so that no partial object is left behind.
+class ObjectUploader {
+public:
+    static constexpr size_t kDefaultPartBytes = size_t(8) << 20;
+    static constexpr size_t kDefaultMaxPartsBuffered = 4;
+
+    explicit ObjectUploader(const std::string& url,
+                            size_t part_bytes = kDefaultPartBytes,
+                            size_t max_parts_buffered = kDefaultMaxPartsBuffered);
+    ~ObjectUploader();
+
+    // Throws if a part has failed to upload.
+    void write(const char* data, size_t size);
+    // Returns a file descriptor the object's data can be written to instead of write(), such
+    // as for htslib to write a file to.  finish() waits for it to be closed.
+    int open_pipe();
+    // Uploads the rest of the object, and completes it.  Throws on failure.
+    void finish();
+
+    uint64_t bytes_written() const { return m_bytes_written; }
+
+private:
+    struct Part {
+        size_t number;
+        std::string data;
+    };
+
+    // Size of the part after those uploaded so far.
+    size_t next_part_bytes() const;
+    // Queues the part for upload, waiting for room.
+    void submit_part(std::string data);
+    void upload_parts();
+    void pump_pipe(int fd);
+    void abort();
+
+    const std::string m_url;
+    ObjectStoreClient m_client;
+    const size_t m_part_bytes;
+    const size_t m_max_parts_buffered;
+    // Data not yet in a part.
+    std::string m_buffer;
+    std::string m_upload_id;
+    size_t m_num_parts{0};
+    std::atomic<uint64_t> m_bytes_written{0};
+    bool m_finished{false};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Part> m_pending_parts;
+    size_t m_num_parts_buffered{0};
+    std::vector<std::string> m_part_etags;
+    // Why the upload failed, if it has.
+    std::string m_error;
+    bool m_stop{false};
+    std::vector<std::thread> m_threads;
+    std::thread m_pipe_thread;
+};
+
+// Downloads objects into a local staging directory ahead of their use, each in ranges fetched
+// over several connections at once, so that loading reads from one object overlaps with
+// downloading the next.  Objects are staged in order, with no more than window_bytes of them
+// on disk at once, and each is removed again once released.  Objects already staged, such as
+// the first one after its metadata was read, aren't downloaded again.
+class ObjectPrefetcher {
+public:
+    static constexpr uint64_t kDefaultWindowBytes = uint64_t(16) << 30;
+    static constexpr size_t kDefaultNumConnections = 16;
+
+    ObjectPrefetcher(std::string url,
+                     std::vector<ObjectInfo> objects,
+                     std::filesystem::path staging_dir,
+                     uint64_t window_bytes = kDefaultWindowBytes,
+                     size_t num_connections = kDefaultNumConnections);
+    ~ObjectPrefetcher();
+
+    // Waits for the next object to be staged, and returns its local path, or std::nullopt once
+    // all objects have been returned.  Objects which can't be downloaded are logged and
+    // skipped.
+    std::optional<std::filesystem::path> next();
+    // Removes the object last returned by next(), making room for more.
+    void release(const std::filesystem::path& path);
+
+    // Where the object at object_url is staged.  The name changes with the object's ETag, so a
+    // replaced object is downloaded again.
+    static std::filesystem::path staged_path(const std::filesystem::path& staging_dir,
+                                             const std::string& object_url,
+                                             const ObjectInfo& object);
+
+    // Bytes downloaded so far.
+    uint64_t bytes_downloaded() const { return m_bytes_downloaded; }
+
+private:
+    struct Object;
+    struct Range {
+        size_t object_index;
+        uint64_t begin;
+        uint64_t length;
+    };
+
+    // Starts staging objects until the window is full, unless they are staged already.  Called
+    // with the mutex held.
+    void admit_objects();
+    // Downloads pending ranges until stopped, on each of the threads.
+    void download_ranges();
+
+    const std::string m_url;
+    const std::filesystem::path m_staging_dir;
+    const uint64_t m_window_bytes;
+    std::vector<Object> m_objects;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // The next object to return, and to start staging.
+    size_t m_next_index{0};
+    size_t m_next_admitted_index{0};
+    // Size of the objects staged or being staged, which haven't been released.
+    uint64_t m_staged_bytes{0};
+    // Ranges of the admitted objects still to download, in order.
+    std::deque<Range> m_pending_ranges;
+    bool m_stop{false};
+    std::atomic<uint64_t> m_bytes_downloaded{0};
+    std::vector<std::thread> m_threads;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,204 @@
+#include "PackedSequence.h"
+
+#include "simd.h"
+
+#include <array>
+#include <cassert>
+
+namespace {
+
+constexpr char kNt16Chars[] = "=ACMGRSVTWYHKDBN";
+
+// Code of each character, as htslib's seq_nt16_table, with N for anything unrecognised.
+constexpr auto kCharCodes = [] {
+    std::array<uint8_t, 256> codes{};
+    for (auto& code : codes) {
+        code = 15;
+    }
+    for (uint8_t code = 0; code < 16; ++code) {
+        const char c = kNt16Chars[code];
+        codes[static_cast<uint8_t>(c)] = code;
+        if (c >= 'A' && c <= 'Z') {
+            codes[static_cast<uint8_t>(c - 'A' + 'a')] = code;
+        }
+    }
+    codes['U'] = codes['u'] = 8;
+    return codes;
+}();
+
+// The complement of an nt16 code has its bits reversed, since A, C, G and T are bits 0 to 3.
+constexpr uint8_t complement_code(uint8_t code) {
+    return static_cast<uint8_t>(((code & 1) << 3) | ((code & 2) << 1) | ((code & 4) >> 1) |
+                                ((code & 8) >> 3));
+}
+
+// Each byte with both codes complemented and swapped, so that reversing the order of the
+// bytes reverse complements an even number of bases.
+constexpr auto kReverseComplementBytes = [] {
+    std::array<uint8_t, 256> bytes{};
+    for (int b = 0; b < 256; ++b) {
+        bytes[b] =
+                static_cast<uint8_t>((complement_code(b & 0xf) << 4) | complement_code(b >> 4));
+    }
+    return bytes;
+}();
+
+// 2 bit code of each nt16 code, or 4 for those which aren't a single base.
+constexpr auto kTwoBitCodes = [] {
+    std::array<uint8_t, 16> codes{};
+    for (auto& code : codes) {
+        code = 4;
+    }
+    codes[1] = 0;
+    codes[2] = 1;
+    codes[4] = 2;
+    codes[8] = 3;
+    return codes;
+}();
+
+// Writes the bytes of packed in reverse order, each through kReverseComplementBytes.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void reverse_complement_bytes(const uint8_t* packed, size_t num_bytes, uint8_t* out) {
+    for (size_t i = 0; i < num_bytes; ++i) {
+        out[i] = kReverseComplementBytes[packed[num_bytes - 1 - i]];
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// As reverse_complement_impl() in sequence_utils.cpp, but complementing both nibbles of each
+// byte with PSHUFB lookups, so 64 bases are handled per iteration.
+__attribute__((target("avx2"))) void reverse_complement_bytes(const uint8_t* packed,
+                                                              size_t num_bytes,
+                                                              uint8_t* out) {
+    // The complement of a low nibble moved to the high nibble, and of a high nibble moved to
+    // the low nibble.
+    alignas(32) uint8_t to_high[32];
+    alignas(32) uint8_t to_low[32];
+    for (uint8_t code = 0; code < 16; ++code) {
+        to_high[code] = to_high[code + 16] = static_cast<uint8_t>(complement_code(code) << 4);
+        to_low[code] = to_low[code + 16] = complement_code(code);
+    }
+    const __m256i kToHigh = _mm256_load_si256(reinterpret_cast<const __m256i*>(to_high));
+    const __m256i kToLow = _mm256_load_si256(reinterpret_cast<const __m256i*>(to_low));
+    const __m256i kLowNibbles = _mm256_set1_epi8(0x0f);
+    const __m256i kByteReverseTable =
+            _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5,
+                            6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    static constexpr size_t kUnroll = 32;
+
+    size_t i = 0;
+    for (; i + kUnroll <= num_bytes; i += kUnroll) {
+        const __m256i bytes = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(packed + num_bytes - kUnroll - i));
+        const __m256i low = _mm256_and_si256(bytes, kLowNibbles);
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), kLowNibbles);
+        const __m256i complemented = _mm256_or_si256(_mm256_shuffle_epi8(kToHigh, low),
+                                                     _mm256_shuffle_epi8(kToLow, high));
+        const __m256i reversed_lanes = _mm256_shuffle_epi8(complemented, kByteReverseTable);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         _mm256_extracti128_si256(reversed_lanes, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 16),
+                         _mm256_castsi256_si128(reversed_lanes));
+    }
+    for (; i < num_bytes; ++i) {
+        out[i] = kReverseComplementBytes[packed[num_bytes - 1 - i]];
+    }
+}
+#endif
+
+}  // namespace
+
+namespace dorado::utils {
+
+PackedSequence::PackedSequence(std::string_view sequence)
+        : m_num_bases(sequence.size()), m_packed((sequence.size() + 1) / 2, 0) {
+    const auto* chars = reinterpret_cast<const uint8_t*>(sequence.data());
+    size_t i = 0;
+    for (; i + 1 < m_num_bases; i += 2) {
+        m_packed[i / 2] =
+                static_cast<uint8_t>((kCharCodes[chars[i]] << 4) | kCharCodes[chars[i + 1]]);
+    }
+    if (i < m_num_bases) {
+        m_packed[i / 2] = static_cast<uint8_t>(kCharCodes[chars[i]] << 4);
+    }
+}
+
+PackedSequence PackedSequence::from_nt16(const uint8_t* packed, size_t num_bases) {
+    PackedSequence sequence;
+    sequence.m_num_bases = num_bases;
+    sequence.m_packed.assign(packed, packed + (num_bases + 1) / 2);
+    if (num_bases % 2 != 0) {
+        sequence.m_packed.back() &= 0xf0;
+    }
+    return sequence;
+}
+
+char PackedSequence::base(size_t i) const { return kNt16Chars[code(i)]; }
+
+std::string PackedSequence::to_string() const {
+    return unpack_nt16(m_packed.data(), m_num_bases);
+}
+
+PackedSequence PackedSequence::reverse_complement() const {
+    PackedSequence result;
+    result.m_num_bases = m_num_bases;
+    result.m_packed.resize(m_packed.size());
+    if (m_packed.empty()) {
+        return result;
+    }
+    reverse_complement_bytes(m_packed.data(), m_packed.size(), result.m_packed.data());
+    if (m_num_bases % 2 != 0) {
+        // The padding nibble is now first, so every base moves back by a nibble.
+        auto& packed = result.m_packed;
+        for (size_t i = 0; i + 1 < packed.size(); ++i) {
+            packed[i] = static_cast<uint8_t>((packed[i] << 4) | (packed[i + 1] >> 4));
+        }
+        packed.back() = static_cast<uint8_t>(packed.back() << 4);
+    }
+    return result;
+}
+
+std::optional<uint64_t> PackedSequence::kmer(size_t pos, int k) const {
+    assert(k > 0 && k <= 32 && pos + k <= m_num_bases);
+    uint64_t kmer = 0;
+    for (size_t i = pos; i < pos + k; ++i) {
+        const uint8_t two_bit = kTwoBitCodes[code(i)];
+        if (two_bit > 3) {
+            return std::nullopt;
+        }
+        kmer = (kmer << 2) | two_bit;
+    }
+    return kmer;
+}
+
+std::string unpack_nt16(const uint8_t* packed, size_t num_bases) {
+    std::string sequence;
+    unpack_nt16(packed, num_bases, sequence);
+    return sequence;
+}
+
+void unpack_nt16(const uint8_t* packed, size_t num_bases, std::string& sequence) {
+    // Both bases of a byte are looked up at once.
+    static const auto kBytePairs = [] {
+        std::array<std::array<char, 2>, 256> pairs{};
+        for (int b = 0; b < 256; ++b) {
+            pairs[b] = {kNt16Chars[b >> 4], kNt16Chars[b & 0xf]};
+        }
+        return pairs;
+    }();
+
+    sequence.resize(num_bases);
+    size_t i = 0;
+    for (; i + 1 < num_bases; i += 2) {
+        const auto& pair = kBytePairs[packed[i / 2]];
+        sequence[i] = pair[0];
+        sequence[i + 1] = pair[1];
+    }
+    if (i < num_bases) {
+        sequence[i] = kBytePairs[packed[i / 2]][0];
+    }
+}
+
+}  // namespace dorado::utils
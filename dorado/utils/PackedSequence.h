@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dorado::utils {
+
+// A nucleotide sequence packed two bases per byte in BAM's nt16 encoding, the first base of
+// each pair in the high nibble, so that it can be copied straight into or out of a record's
+// SEQ field without converting each base.  Characters other than IUPAC codes are stored as N.
+class PackedSequence {
+public:
+    PackedSequence() = default;
+    explicit PackedSequence(std::string_view sequence);
+
+    // Copies num_bases packed bases, such as those from bam_get_seq().
+    static PackedSequence from_nt16(const uint8_t* packed, size_t num_bases);
+
+    size_t size() const { return m_num_bases; }
+    bool empty() const { return m_num_bases == 0; }
+
+    // The nt16 code and the character of base i.
+    uint8_t code(size_t i) const { return (m_packed[i / 2] >> ((~i & 1) * 4)) & 0xf; }
+    char base(size_t i) const;
+
+    // The packed bytes, with the low nibble of the last byte 0 for an odd number of bases, as
+    // BAM expects.
+    const uint8_t* data() const { return m_packed.data(); }
+    size_t num_bytes() const { return m_packed.size(); }
+
+    std::string to_string() const;
+
+    // The reverse complement, computed on the packed bytes.
+    PackedSequence reverse_complement() const;
+
+    // The k-mer at pos in 2 bits per base (A=0, C=1, G=2, T=3), the first base in the highest
+    // bits, or nullopt if it contains other codes.  k must be at most 32.
+    std::optional<uint64_t> kmer(size_t pos, int k) const;
+
+private:
+    size_t m_num_bases = 0;
+    std::vector<uint8_t> m_packed;
+};
+
+// Decodes num_bases nt16 bases, packed as in a BAM record, two at a time.
+std::string unpack_nt16(const uint8_t* packed, size_t num_bases);
+// As above, into sequence, so that its buffer can be reused.
+void unpack_nt16(const uint8_t* packed, size_t num_bases, std::string& sequence);
+
+}  // namespace dorado::utils
@@ -0,0 +1,97 @@
+#include "PairTable.h"
+
+#include "uuid_utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace dorado::utils {
+
+namespace {
+
+bool key_less(const PairTable::Pair& a, const PairTable::Pair& b) { return a.first < b.first; }
+
+// Sorts pairs on their first ID, keeping only the last listed of those sharing one.
+void sort_keeping_last(std::vector<PairTable::Pair>& pairs) {
+    std::stable_sort(pairs.begin(), pairs.end(), key_less);
+    size_t num_kept = 0;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (i + 1 == pairs.size() || pairs[i + 1].first != pairs[i].first) {
+            pairs[num_kept++] = pairs[i];
+        }
+    }
+    pairs.resize(num_kept);
+    pairs.shrink_to_fit();
+}
+
+std::optional<ReadID> find_partner(const std::vector<PairTable::Pair>& pairs, const ReadID& id) {
+    auto it = std::lower_bound(pairs.begin(), pairs.end(), PairTable::Pair{id, ReadID{}},
+                               key_less);
+    if (it == pairs.end() || it->first != id) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+}  // namespace
+
+PairTable::PairTable(std::vector<Pair> pairs) : m_by_template(std::move(pairs)) {
+    sort_keeping_last(m_by_template);
+    m_by_complement.reserve(m_by_template.size());
+    for (const auto& [template_id, complement_id] : m_by_template) {
+        m_by_complement.emplace_back(complement_id, template_id);
+    }
+    sort_keeping_last(m_by_complement);
+}
+
+PairTable PairTable::read(std::istream& in) {
+    std::vector<Pair> pairs;
+    size_t num_skipped_lines = 0;
+    // The line buffer is reused, and the IDs parsed in place, so reading allocates nothing but
+    // the table itself.
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view fields(line);
+        while (!fields.empty() && std::isspace(static_cast<unsigned char>(fields.back()))) {
+            fields.remove_suffix(1);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+        const auto delim_pos = fields.find(' ');
+        const auto template_id = parse_read_id(fields.substr(0, delim_pos));
+        const auto complement_id = delim_pos == std::string_view::npos
+                                           ? std::nullopt
+                                           : parse_read_id(fields.substr(delim_pos + 1));
+        if (!template_id || !complement_id) {
+            ++num_skipped_lines;
+            continue;
+        }
+        pairs.emplace_back(*template_id, *complement_id);
+    }
+    PairTable table(std::move(pairs));
+    table.m_num_skipped_lines = num_skipped_lines;
+    return table;
+}
+
+PairTable PairTable::load(const std::filesystem::path& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw std::runtime_error("Pairs file does not exist.");
+    }
+    return read(in);
+}
+
+std::optional<ReadID> PairTable::complement_of(const ReadID& template_id) const {
+    return find_partner(m_by_template, template_id);
+}
+
+std::optional<ReadID> PairTable::template_of(const ReadID& complement_id) const {
+    return find_partner(m_by_complement, complement_id);
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ReadIDMap.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// The template/complement pairs of a duplex pairs list, held as two arrays of binary read IDs
+// sorted for binary search, so that the tens of millions of pairs in a list cost 64 bytes each
+// rather than several string and node allocations.  Nothing changes it once built, so one table
+// can be shared by every thread that looks up pairs.
+class PairTable {
+public:
+    // A template ID and its complement's ID.
+    using Pair = std::pair<ReadID, ReadID>;
+
+    PairTable() = default;
+    // Of pairs sharing a template, or a complement, the last is kept.
+    explicit PairTable(std::vector<Pair> pairs);
+
+    // Reads a pairs list of "<template id> <complement id>" lines.  Lines whose IDs aren't UUIDs
+    // are skipped, since their reads can't be loaded from read files.
+    static PairTable read(std::istream& in);
+    // Throws if the file can't be opened.
+    static PairTable load(const std::filesystem::path& path);
+
+    size_t size() const { return m_by_template.size(); }
+    bool empty() const { return m_by_template.empty(); }
+    // Lines read which weren't a pair of UUIDs.
+    size_t num_skipped_lines() const { return m_num_skipped_lines; }
+
+    std::optional<ReadID> complement_of(const ReadID& template_id) const;
+    std::optional<ReadID> template_of(const ReadID& complement_id) const;
+
+    // The pairs, in template ID order.
+    const std::vector<Pair>& pairs() const { return m_by_template; }
+
+private:
+    std::vector<Pair> m_by_template;
+    // Each pair the other way round, as (complement, template), in complement ID order.
+    std::vector<Pair> m_by_complement;
+    size_t m_num_skipped_lines = 0;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,249 @@
+#include "PatternMatcher.h"
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t kHighBit = uint64_t(1) << 63;
+
+// Advances one block of the pattern by a column of the text, as in edlib's calculateBlock().
+// pv and mv hold the block's positive and negative vertical score changes, eq the pattern
+// bases matching the text character, and hin the score change along the row above the block.
+// Returns the score change along the row whose bit is set in high_bit.
+inline int advance_block(uint64_t& pv, uint64_t& mv, uint64_t eq, uint64_t high_bit, int hin) {
+    const uint64_t xv = eq | mv;
+    if (hin < 0) {
+        eq |= 1;
+    }
+    const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+    const int hout = (ph & high_bit) ? 1 : ((mh & high_bit) ? -1 : 0);
+    ph <<= 1;
+    mh <<= 1;
+    if (hin < 0) {
+        mh |= 1;
+    } else if (hin > 0) {
+        ph |= 1;
+    }
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+    return hout;
+}
+
+// Lowest infix score of a pattern of up to 64 bases against each of the texts, or INT_MAX for
+// empty texts.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void single_block_best_scores(const uint64_t* peq,
+                              const uint8_t* char_codes,
+                              int pattern_len,
+                              const std::vector<std::string_view>& texts,
+                              std::vector<int>& best_scores) {
+    const uint64_t high_bit = uint64_t(1) << (pattern_len - 1);
+    best_scores.assign(texts.size(), std::numeric_limits<int>::max());
+    for (size_t t = 0; t < texts.size(); ++t) {
+        uint64_t pv = ~uint64_t(0);
+        uint64_t mv = 0;
+        int score = pattern_len;
+        for (const char c : texts[t]) {
+            score += advance_block(pv, mv, peq[char_codes[static_cast<uint8_t>(c)]], high_bit, 0);
+            best_scores[t] = std::min(best_scores[t], score);
+        }
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Runs a text in each 64 bit lane, so 4 candidate windows are matched at once.
+__attribute__((target("avx2"))) void single_block_best_scores(
+        const uint64_t* peq,
+        const uint8_t* char_codes,
+        int pattern_len,
+        const std::vector<std::string_view>& texts,
+        std::vector<int>& best_scores) {
+    constexpr size_t kNumLanes = 4;
+    const __m256i kOnes = _mm256_set1_epi64x(-1);
+    const __m256i kOne = _mm256_set1_epi64x(1);
+    const __m128i kHighBitShift = _mm_cvtsi32_si128(pattern_len - 1);
+
+    best_scores.assign(texts.size(), std::numeric_limits<int>::max());
+    for (size_t first = 0; first < texts.size(); first += kNumLanes) {
+        const size_t num_lanes = std::min(kNumLanes, texts.size() - first);
+        // Unused lanes have empty texts, so are never updated.
+        alignas(32) int64_t lengths[kNumLanes] = {};
+        size_t max_length = 0;
+        for (size_t lane = 0; lane < num_lanes; ++lane) {
+            lengths[lane] = static_cast<int64_t>(texts[first + lane].size());
+            max_length = std::max(max_length, texts[first + lane].size());
+        }
+        const __m256i length_vec = _mm256_load_si256(reinterpret_cast<const __m256i*>(lengths));
+
+        __m256i pv = kOnes;
+        __m256i mv = _mm256_setzero_si256();
+        __m256i score = _mm256_set1_epi64x(pattern_len);
+        __m256i best = _mm256_set1_epi64x(std::numeric_limits<int>::max());
+        alignas(32) uint64_t eq_lanes[kNumLanes] = {};
+        for (size_t j = 0; j < max_length; ++j) {
+            for (size_t lane = 0; lane < num_lanes; ++lane) {
+                const auto& text = texts[first + lane];
+                eq_lanes[lane] =
+                        j < text.size() ? peq[char_codes[static_cast<uint8_t>(text[j])]] : 0;
+            }
+            const __m256i eq = _mm256_load_si256(reinterpret_cast<const __m256i*>(eq_lanes));
+
+            // As advance_block(), with hin of 0.
+            const __m256i xv = _mm256_or_si256(eq, mv);
+            const __m256i xh = _mm256_or_si256(
+                    _mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(eq, pv), pv), pv), eq);
+            __m256i ph = _mm256_or_si256(mv, _mm256_xor_si256(_mm256_or_si256(xh, pv), kOnes));
+            __m256i mh = _mm256_and_si256(pv, xh);
+            score = _mm256_add_epi64(
+                    score, _mm256_and_si256(_mm256_srl_epi64(ph, kHighBitShift), kOne));
+            score = _mm256_sub_epi64(
+                    score, _mm256_and_si256(_mm256_srl_epi64(mh, kHighBitShift), kOne));
+            ph = _mm256_slli_epi64(ph, 1);
+            mh = _mm256_slli_epi64(mh, 1);
+            pv = _mm256_or_si256(mh, _mm256_xor_si256(_mm256_or_si256(xv, ph), kOnes));
+            mv = _mm256_and_si256(ph, xv);
+
+            const __m256i active =
+                    _mm256_cmpgt_epi64(length_vec, _mm256_set1_epi64x(static_cast<int64_t>(j)));
+            const __m256i improved = _mm256_and_si256(active, _mm256_cmpgt_epi64(best, score));
+            best = _mm256_blendv_epi8(best, score, improved);
+        }
+
+        alignas(32) int64_t best_lanes[kNumLanes];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(best_lanes), best);
+        for (size_t lane = 0; lane < num_lanes; ++lane) {
+            best_scores[first + lane] = static_cast<int>(best_lanes[lane]);
+        }
+    }
+}
+#endif
+
+}  // namespace
+
+namespace dorado::utils {
+
+PatternMatcher::MatchVectors::MatchVectors(const std::string& pattern)
+        : num_blocks((pattern.size() + kWordSize - 1) / kWordSize) {
+    char_codes.fill(kNoMatch);
+    uint8_t num_codes = 1;
+    for (const char c : pattern) {
+        auto& code = char_codes[static_cast<uint8_t>(c)];
+        if (code == kNoMatch) {
+            code = num_codes++;
+        }
+    }
+    peq.assign(num_codes * num_blocks, 0);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        peq[char_codes[static_cast<uint8_t>(pattern[i])] * num_blocks + i / kWordSize] |=
+                uint64_t(1) << (i % kWordSize);
+    }
+}
+
+PatternMatcher::PatternMatcher(std::string pattern)
+        : m_pattern(std::move(pattern)),
+          m_forward(m_pattern),
+          m_reverse(std::string(m_pattern.rbegin(), m_pattern.rend())) {
+    if (m_pattern.empty()) {
+        throw std::runtime_error("PatternMatcher: pattern must not be empty");
+    }
+}
+
+PatternMatcher::ScanResult PatternMatcher::scan(const MatchVectors& vectors,
+                                                std::string_view text,
+                                                bool infix,
+                                                bool reversed) const {
+    const size_t num_blocks = vectors.num_blocks;
+    const uint64_t last_high_bit = uint64_t(1) << ((m_pattern.size() - 1) % kWordSize);
+    // The score change along the top row: none if the match can start anywhere, and otherwise
+    // each skipped text character costs one.
+    const int top_hin = infix ? 0 : 1;
+
+    ScanResult result{std::numeric_limits<int>::max(), 0, 0};
+    auto record_score = [&result](int score, size_t pos) {
+        if (score < result.best_score) {
+            result = {score, pos, pos};
+        } else if (score == result.best_score) {
+            result.last_best_pos = pos;
+        }
+    };
+
+    int score = static_cast<int>(m_pattern.size());
+    if (num_blocks == 1) {
+        uint64_t pv = ~uint64_t(0);
+        uint64_t mv = 0;
+        for (size_t j = 0; j < text.size(); ++j) {
+            const char c = reversed ? text[text.size() - 1 - j] : text[j];
+            score += advance_block(pv, mv, *vectors.get(c), last_high_bit, top_hin);
+            record_score(score, j);
+        }
+    } else {
+        std::vector<uint64_t> pv(num_blocks, ~uint64_t(0));
+        std::vector<uint64_t> mv(num_blocks, 0);
+        for (size_t j = 0; j < text.size(); ++j) {
+            const char c = reversed ? text[text.size() - 1 - j] : text[j];
+            const uint64_t* eq = vectors.get(c);
+            int h = top_hin;
+            for (size_t b = 0; b < num_blocks; ++b) {
+                h = advance_block(pv[b], mv[b], eq[b],
+                                  b + 1 == num_blocks ? last_high_bit : kHighBit, h);
+            }
+            score += h;
+            record_score(score, j);
+        }
+    }
+    return result;
+}
+
+std::optional<int> PatternMatcher::edit_distance(std::string_view text, int max_edits) const {
+    const auto result = scan(m_forward, text, true, false);
+    if (result.best_score > max_edits) {
+        return std::nullopt;
+    }
+    return result.best_score;
+}
+
+std::vector<std::optional<int>> PatternMatcher::edit_distances(
+        const std::vector<std::string_view>& texts,
+        int max_edits) const {
+    std::vector<std::optional<int>> distances(texts.size());
+    if (m_forward.num_blocks == 1) {
+        std::vector<int> best_scores;
+        single_block_best_scores(m_forward.peq.data(), m_forward.char_codes.data(),
+                                 static_cast<int>(m_pattern.size()), texts, best_scores);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            if (best_scores[i] <= max_edits) {
+                distances[i] = best_scores[i];
+            }
+        }
+    } else {
+        for (size_t i = 0; i < texts.size(); ++i) {
+            distances[i] = edit_distance(texts[i], max_edits);
+        }
+    }
+    return distances;
+}
+
+std::optional<std::pair<size_t, size_t>> PatternMatcher::find_best_match(std::string_view text,
+                                                                         int max_edits) const {
+    const auto forward = scan(m_forward, text, true, false);
+    if (forward.best_score > max_edits) {
+        return std::nullopt;
+    }
+    // As edlib does, the start is found by matching the reversed pattern to the text read
+    // backwards from the end of the match, and taking the furthest position with the same score.
+    const size_t end = forward.first_best_pos + 1;
+    const auto reverse = scan(m_reverse, text.substr(0, end), false, true);
+    assert(reverse.best_score == forward.best_score);
+    return std::make_pair(end - 1 - reverse.last_best_pos, end);
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// Finds approximate matches of a fixed pattern, such as an adapter or barcode, anywhere in a
+// text, using Myers' bit-vector edit distance algorithm.  Results are the same as edlib's infix
+// (EDLIB_MODE_HW) alignment with the pattern as the query, except that empty texts never match.
+// The pattern's match vectors are built once, so a matcher is meant to be kept and reused for
+// every text searched, and searching doesn't allocate for patterns of up to 64 bases.
+class PatternMatcher {
+public:
+    explicit PatternMatcher(std::string pattern);
+
+    const std::string& pattern() const { return m_pattern; }
+
+    // The lowest edit distance between the pattern and any substring of the text, if it is at
+    // most max_edits.
+    std::optional<int> edit_distance(std::string_view text, int max_edits) const;
+
+    // As edit_distance(), for each of the texts.  Patterns of up to 64 bases are matched against
+    // several texts at once where SIMD is available, so many candidate windows should be passed
+    // in one call.
+    std::vector<std::optional<int>> edit_distances(const std::vector<std::string_view>& texts,
+                                                   int max_edits) const;
+
+    // Location [start, end) of the best match in the text, if its edit distance is at most
+    // max_edits.  As with edlib, this is the best match which ends first, and of those ending
+    // there, the longest.
+    std::optional<std::pair<size_t, size_t>> find_best_match(std::string_view text,
+                                                             int max_edits) const;
+
+private:
+    static constexpr int kWordSize = 64;
+
+    // The pattern is split into blocks of 64 bases, each handled in one word.
+    struct MatchVectors {
+        size_t num_blocks;
+        // Code of each character, with kNoMatch for those not in the pattern.
+        std::array<uint8_t, 256> char_codes;
+        // For each code, num_blocks words in which bit i is set if pattern base i has that code.
+        std::vector<uint64_t> peq;
+
+        explicit MatchVectors(const std::string& pattern);
+        const uint64_t* get(char c) const {
+            return &peq[char_codes[static_cast<uint8_t>(c)] * num_blocks];
+        }
+    };
+    static constexpr uint8_t kNoMatch = 0;
+
+    // Scores the whole pattern against the text up to each position, reading the text backwards
+    // if reversed is set.  In infix mode the match may start anywhere in the text, and otherwise
+    // it must start at the beginning.  Returns the lowest score, and the first and last text
+    // positions achieving it, counted in the order the text is read.
+    struct ScanResult {
+        int best_score;
+        size_t first_best_pos;
+        size_t last_best_pos;
+    };
+    ScanResult scan(const MatchVectors& vectors,
+                    std::string_view text,
+                    bool infix,
+                    bool reversed) const;
+
+    std::string m_pattern;
+    MatchVectors m_forward;
+    MatchVectors m_reverse;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "decode/fast_hash.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dorado {
+
+constexpr size_t POD5_READ_ID_SIZE = 16;
+// A read ID in the binary form stored in POD5 files.
+using ReadID = std::array<uint8_t, POD5_READ_ID_SIZE>;
+
+struct ReadIDHash {
+    size_t operator()(const ReadID& read_id) const {
+        return static_cast<size_t>(fasthash64(read_id.data(), read_id.size(), 0));
+    }
+};
+
+// Hash map keyed on read IDs, for the tens of millions of reads in pairs lists and resume sets.
+// Entries are stored inline in one open addressed table with linear probing, so each costs its
+// key, value and a byte, rather than a node allocation holding a 36 character string.
+// As with std::unordered_map, inserting may invalidate iterators, and erasing invalidates them.
+template <typename Value>
+class ReadIDMap {
+public:
+    using value_type = std::pair<ReadID, Value>;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ReadIDMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+        using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+        using Map = std::conditional_t<IsConst, const ReadIDMap, ReadIDMap>;
+
+        Iterator(Map* map, size_t index) : m_map(map), m_index(index) { skip_unused(); }
+        // Lets iterators be converted to const iterators.
+        operator Iterator<true>() const { return Iterator<true>(m_map, m_index); }
+
+        reference operator*() const { return m_map->m_entries[m_index]; }
+        pointer operator->() const { return &m_map->m_entries[m_index]; }
+        Iterator& operator++() {
+            ++m_index;
+            skip_unused();
+            return *this;
+        }
+        Iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        friend class ReadIDMap;
+        void skip_unused() {
+            while (m_index < m_map->m_used.size() && !m_map->m_used[m_index]) {
+                ++m_index;
+            }
+        }
+
+        Map* m_map;
+        size_t m_index;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_used.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_used.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    void clear() {
+        m_entries.clear();
+        m_used.clear();
+        m_size = 0;
+    }
+
+    // Makes room for num_entries without the table being resized.
+    void reserve(size_t num_entries) {
+        size_t capacity = kMinCapacity;
+        while (exceeds_load(num_entries, capacity)) {
+            capacity *= 2;
+        }
+        if (capacity > m_used.size()) {
+            rehash(capacity);
+        }
+    }
+
+    iterator find(const ReadID& key) { return iterator(this, find_index(key)); }
+    const_iterator find(const ReadID& key) const { return const_iterator(this, find_index(key)); }
+    size_t count(const ReadID& key) const { return find_index(key) != m_used.size() ? 1 : 0; }
+
+    // Inserts the entry if the key isn't already present.  Returns the key's entry, and
+    // whether it was inserted.
+    std::pair<iterator, bool> insert(value_type entry) {
+        if (exceeds_load(m_size + 1, m_used.size())) {
+            rehash(m_used.empty() ? kMinCapacity : m_used.size() * 2);
+        }
+        size_t index = home_index(entry.first);
+        while (m_used[index]) {
+            if (m_entries[index].first == entry.first) {
+                return {iterator(this, index), false};
+            }
+            index = next_index(index);
+        }
+        m_entries[index] = std::move(entry);
+        m_used[index] = 1;
+        ++m_size;
+        return {iterator(this, index), true};
+    }
+
+    Value& operator[](const ReadID& key) { return insert({key, Value{}}).first->second; }
+
+    void erase(const_iterator it) { erase_index(it.m_index); }
+    size_t erase(const ReadID& key) {
+        const size_t index = find_index(key);
+        if (index == m_used.size()) {
+            return 0;
+        }
+        erase_index(index);
+        return 1;
+    }
+
+private:
+    // Capacities are powers of 2, so slots are found by masking.
+    static constexpr size_t kMinCapacity = 16;
+    static bool exceeds_load(size_t num_entries, size_t capacity) {
+        // Linear probing stays fast up to around 3/4 full.
+        return num_entries * 4 > capacity * 3;
+    }
+
+    size_t home_index(const ReadID& key) const { return ReadIDHash()(key) & (m_used.size() - 1); }
+    size_t next_index(size_t index) const { return (index + 1) & (m_used.size() - 1); }
+
+    // Returns the slot holding the key, or the capacity if it isn't present.
+    size_t find_index(const ReadID& key) const {
+        if (m_size == 0) {
+            return m_used.size();
+        }
+        for (size_t index = home_index(key); m_used[index]; index = next_index(index)) {
+            if (m_entries[index].first == key) {
+                return index;
+            }
+        }
+        return m_used.size();
+    }
+
+    void erase_index(size_t index) {
+        // Later entries in the probe sequence are shifted back into the gap, so that lookups
+        // never need to probe past removed entries.
+        size_t gap = index;
+        for (size_t next = next_index(gap); m_used[next]; next = next_index(next)) {
+            const size_t home = home_index(m_entries[next].first);
+            // The entry can fill the gap unless its home slot is cyclically after the gap,
+            // i.e. in (gap, next].
+            const bool home_after_gap =
+                    gap <= next ? (gap < home && home <= next) : (gap < home || home <= next);
+            if (!home_after_gap) {
+                m_entries[gap] = std::move(m_entries[next]);
+                gap = next;
+            }
+        }
+        m_entries[gap] = value_type{};
+        m_used[gap] = 0;
+        --m_size;
+    }
+
+    void rehash(size_t capacity) {
+        auto entries = std::move(m_entries);
+        auto used = std::move(m_used);
+        m_entries = std::vector<value_type>(capacity);
+        m_used = std::vector<uint8_t>(capacity, 0);
+        m_size = 0;
+        for (size_t i = 0; i < used.size(); ++i) {
+            if (used[i]) {
+                size_t index = home_index(entries[i].first);
+                while (m_used[index]) {
+                    index = next_index(index);
+                }
+                m_entries[index] = std::move(entries[i]);
+                m_used[index] = 1;
+                ++m_size;
+            }
+        }
+    }
+
+    std::vector<value_type> m_entries;
+    std::vector<uint8_t> m_used;
+    size_t m_size{0};
+};
+
+// Set of read IDs, stored as for ReadIDMap.
+class ReadIDSet {
+    struct Empty {};
+    using Map = ReadIDMap<Empty>;
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ReadID;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ReadID*;
+        using reference = const ReadID&;
+
+        explicit const_iterator(Map::const_iterator it) : m_it(it) {}
+        reference operator*() const { return m_it->first; }
+        pointer operator->() const { return &m_it->first; }
+        const_iterator& operator++() {
+            ++m_it;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto it = *this;
+            ++m_it;
+            return it;
+        }
+        bool operator==(const const_iterator& other) const { return m_it == other.m_it; }
+        bool operator!=(const const_iterator& other) const { return m_it != other.m_it; }
+
+    private:
+        friend class ReadIDSet;
+        Map::const_iterator m_it;
+    };
+    using iterator = const_iterator;
+    using value_type = ReadID;
+
+    ReadIDSet() = default;
+    ReadIDSet(std::initializer_list<ReadID> read_ids) { insert(read_ids.begin(), read_ids.end()); }
+
+    const_iterator begin() const { return const_iterator(m_map.begin()); }
+    const_iterator end() const { return const_iterator(m_map.end()); }
+
+    size_t size() const { return m_map.size(); }
+    bool empty() const { return m_map.empty(); }
+    void clear() { m_map.clear(); }
+    void reserve(size_t num_read_ids) { m_map.reserve(num_read_ids); }
+
+    const_iterator find(const ReadID& read_id) const { return const_iterator(m_map.find(read_id)); }
+    size_t count(const ReadID& read_id) const { return m_map.count(read_id); }
+
+    std::pair<const_iterator, bool> insert(const ReadID& read_id) {
+        auto [it, inserted] = m_map.insert({read_id, Empty{}});
+        return {const_iterator(it), inserted};
+    }
+    template <typename InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    void erase(const_iterator it) { m_map.erase(it.m_it); }
+    size_t erase(const ReadID& read_id) { return m_map.erase(read_id); }
+
+private:
+    Map m_map;
+};
+
+}  // namespace dorado
@@ -0,0 +1,86 @@
+#include "SignalBufferPool.h"
+
+#include <new>
+
+namespace dorado::utils {
+
+namespace {
+
+// Buffers are aligned for vectorised conversion of their samples.
+constexpr std::align_val_t kBufferAlignment{64};
+// Signals smaller than this share its class.
+constexpr size_t kMinClassBytes = 4096;
+// Default cap for the shared pool's free buffers.
+constexpr size_t kSharedPoolMaxCachedBytes = size_t(1) << 30;
+
+}  // namespace
+
+SignalBufferPool::SignalBufferPool(size_t max_cached_bytes) : m_state(std::make_shared<State>()) {
+    m_state->max_cached_bytes = max_cached_bytes;
+}
+
+SignalBufferPool::State::~State() {
+    for (auto& [size, buffers] : free_buffers) {
+        for (void* buffer : buffers) {
+            ::operator delete(buffer, kBufferAlignment);
+        }
+    }
+}
+
+void SignalBufferPool::State::release(void* buffer, size_t size) {
+    {
+        std::lock_guard lock(mutex);
+        if (cached_bytes + size <= max_cached_bytes) {
+            free_buffers[size].push_back(buffer);
+            cached_bytes += size;
+            return;
+        }
+    }
+    ::operator delete(buffer, kBufferAlignment);
+}
+
+size_t SignalBufferPool::class_bytes(size_t bytes) {
+    if (bytes <= kMinClassBytes) {
+        return kMinClassBytes;
+    }
+    // A quarter of the largest power of two below bytes, so classes are at most 25% apart.
+    size_t power = kMinClassBytes;
+    while (power * 2 < bytes) {
+        power *= 2;
+    }
+    const size_t step = power / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+torch::Tensor SignalBufferPool::allocate(int64_t num_elems, torch::ScalarType dtype) {
+    const auto options = torch::TensorOptions().dtype(dtype);
+    const size_t size = class_bytes(size_t(num_elems) * c10::elementSize(dtype));
+    void* buffer = nullptr;
+    {
+        std::lock_guard lock(m_state->mutex);
+        auto it = m_state->free_buffers.find(size);
+        if (it != m_state->free_buffers.end() && !it->second.empty()) {
+            buffer = it->second.back();
+            it->second.pop_back();
+            m_state->cached_bytes -= size;
+        }
+    }
+    if (!buffer) {
+        buffer = ::operator new(size, kBufferAlignment);
+    }
+    // The deleter holds the state, so buffers can be returned after the pool has gone.
+    auto deleter = [state = m_state, size](void* data) { state->release(data, size); };
+    return torch::from_blob(buffer, {num_elems}, deleter, options);
+}
+
+size_t SignalBufferPool::cached_bytes() const {
+    std::lock_guard lock(m_state->mutex);
+    return m_state->cached_bytes;
+}
+
+SignalBufferPool& SignalBufferPool::shared() {
+    static SignalBufferPool pool(kSharedPoolMaxCachedBytes);
+    return pool;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado::utils {
+
+// Recycles the memory of reads' signal tensors.  Sizes are rounded up to one of four classes
+// per power of two, so that signals of similar lengths reuse each other's buffers, and a
+// buffer freed by one read's tensor is kept for the next of its class, up to max_cached_bytes
+// of buffers in all.  Over a long run this bounds the fragmentation the spread of read lengths
+// would otherwise cause in the general allocator.  Thread-safe, and the buffers outlive the
+// pool if they are still held by tensors.
+class SignalBufferPool {
+public:
+    explicit SignalBufferPool(size_t max_cached_bytes);
+
+    // An uninitialised contiguous CPU tensor of num_elems elements of dtype, whose buffer goes
+    // back to the pool once the tensor and all its views are destroyed.
+    torch::Tensor allocate(int64_t num_elems, torch::ScalarType dtype);
+
+    // Bytes of free buffers being kept.
+    size_t cached_bytes() const;
+
+    // The size class of a buffer of bytes.
+    static size_t class_bytes(size_t bytes);
+
+    // The pool shared by the pipeline's signal tensors.
+    static SignalBufferPool& shared();
+
+private:
+    struct State {
+        std::mutex mutex;
+        size_t max_cached_bytes;
+        size_t cached_bytes{0};
+        // Free buffers of each size class.
+        std::unordered_map<size_t, std::vector<void*>> free_buffers;
+
+        ~State();
+        void release(void* buffer, size_t size);
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+}  // namespace dorado::utils
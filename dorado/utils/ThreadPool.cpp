@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+#include "numa_utils.h"
+#include "thread_qos.h"
+
+#include <algorithm>
+
+namespace {
+
+// The pool and worker the calling thread belongs to, if any.
+thread_local dorado::utils::ThreadPool* t_current_pool = nullptr;
+thread_local size_t t_worker_index = 0;
+
+}  // namespace
+
+namespace dorado::utils {
+
+ThreadPool::ThreadPool(size_t num_threads, bool spread_across_numa_nodes) {
+    num_threads = std::max(num_threads, size_t(1));
+    // Binding is pointless with a single node.
+    const int num_nodes = spread_across_numa_nodes ? num_numa_nodes() : 0;
+    if (num_nodes > 1) {
+        m_num_numa_nodes = num_nodes;
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Only start the threads once every worker exists, since they steal from each other.
+    for (size_t i = 0; i < num_threads; ++i) {
+        m_workers[i]->thread = std::thread(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+    m_sleep_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    const size_t index = t_current_pool == this ? t_worker_index
+                                                : m_next_worker.fetch_add(1) % m_workers.size();
+    {
+        std::lock_guard lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+    // Pairs with the sleeper count increment in worker_loop(), so either we see the sleeper
+    // or it sees the task.
+    m_num_queued.fetch_add(1);
+    if (m_num_sleeping.load() > 0) {
+        // Taking the mutex ensures a sleeper that has checked for tasks is actually waiting.
+        { std::lock_guard lock(m_sleep_mutex); }
+        m_sleep_cv.notify_one();
+    }
+}
+
+ThreadPool* ThreadPool::current() { return t_current_pool; }
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::thread::hardware_concurrency(), true);
+    return pool;
+}
+
+bool ThreadPool::pop_task(size_t worker_index, Task& task) {
+    // Our own tasks are run oldest first, so that a task which resubmits itself goes behind
+    // other work rather than monopolising the thread.
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        auto& worker = *m_workers[(worker_index + i) % m_workers.size()];
+        std::lock_guard lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        } else {
+            // Steal from the other end from the one the owner takes from.
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        m_num_queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t worker_index) {
+    t_current_pool = this;
+    t_worker_index = worker_index;
+    if (m_num_numa_nodes > 0) {
+        bind_thread_to_numa_node(static_cast<int>(worker_index % m_num_numa_nodes));
+    }
+    set_thread_qos(ThreadQoS::UserInitiated);
+    Task task;
+    for (;;) {
+        if (pop_task(worker_index, task)) {
+            task();
+            // Release whatever the task holds before we sleep.
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock lock(m_sleep_mutex);
+        if (m_stopping && m_num_queued.load() == 0) {
+            return;
+        }
+        m_num_sleeping.fetch_add(1);
+        m_sleep_cv.wait(lock, [this] { return m_num_queued.load() > 0 || m_stopping; });
+        m_num_sleeping.fetch_sub(1);
+    }
+}
+
+}  // namespace dorado::utils
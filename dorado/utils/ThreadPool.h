@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+// Work-stealing pool of threads for CPU tasks.  Each thread has its own deque of tasks, so
+// threads submitting work mostly don't contend with each other, and a thread which runs out
+// of tasks takes them from the back of other threads' deques.
+// The pipeline's CPU nodes run on the one shared() pool rather than starting threads of their
+// own, so that idle threads go to whichever node has work queued.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // With spread_across_numa_nodes set, each thread is bound to the CPUs of one NUMA node, and
+    // threads are dealt out to the nodes in turn.
+    explicit ThreadPool(size_t num_threads, bool spread_across_numa_nodes = false);
+    // Runs any tasks still queued, then stops the threads.
+    ~ThreadPool();
+
+    size_t num_threads() const { return m_workers.size(); }
+
+    // Queues the task.  Tasks submitted from one of the pool's threads go on that thread's
+    // deque, and others are spread across the threads in turn.
+    void submit(Task task);
+
+    // The pool whose thread is calling, or nullptr if called from any other thread.
+    static ThreadPool* current();
+
+    // The pool shared by the pipeline, with a thread per hardware thread, spread across the
+    // NUMA nodes.
+    static ThreadPool& shared();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // Takes the next task from the front of this worker's deque, or else steals one.
+    bool pop_task(size_t worker_index, Task& task);
+    void worker_loop(size_t worker_index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // Number of NUMA nodes the threads are spread across, or 0 if they aren't bound.
+    int m_num_numa_nodes{0};
+    // Where the next task submitted from outside the pool goes.
+    std::atomic<size_t> m_next_worker{0};
+    // Number of tasks queued but not yet taken, so idle threads know when to sleep.
+    std::atomic<size_t> m_num_queued{0};
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_cv;
+    std::atomic<int> m_num_sleeping{0};
+    bool m_stopping{false};
+};
+
+}  // namespace dorado::utils
@@ -48,4 +48,17 @@ std::string alignment_to_str(const char* query,
     return ss.str();
 }
 
+EdlibAlignResult as_edlib_result(BandedAlignment& alignment) {
+    EdlibAlignResult result;
+    result.status = EDLIB_STATUS_OK;
+    result.editDistance = alignment.edit_distance;
+    result.endLocations = &alignment.target_end;
+    result.startLocations = &alignment.target_start;
+    result.numLocations = 1;
+    result.alignment = alignment.path.data();
+    result.alignmentLength = static_cast<int>(alignment.path.size());
+    result.alphabetLength = 4;
+    return result;
+}
+
 }  // namespace dorado::utils
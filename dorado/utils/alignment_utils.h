@@ -1,5 +1,6 @@
 #pragma once
 
+#include "BandedAligner.h"
 #include "edlib.h"
 
 #include <string>
@@ -27,4 +28,9 @@ namespace dorado::utils {
 
 std::string alignment_to_str(const char* query, const char* target, const EdlibAlignResult& result);
 
+// Presents a banded alignment as the result edlibAlign() gives, for code written against edlib.
+// The result refers to the alignment's members, so it mustn't outlive them, and mustn't be
+// passed to edlibFreeAlignResult().
+EdlibAlignResult as_edlib_result(BandedAlignment& alignment);
+
 }  // namespace dorado::utils
@@ -0,0 +1,51 @@
+#include "barcode_kits.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+const std::vector<std::pair<std::string, std::string>> kNativeBarcodes = {
+        {"barcode01", "CACAAAGACACCGACAACTTTCTT"}, {"barcode02", "ACAGACGACTACAAACGGAATCGA"},
+        {"barcode03", "CCTGGTAACTGGGACACAAGACTC"}, {"barcode04", "TAGGGAAACACGATAGAATCCGAA"},
+        {"barcode05", "AAGGTTACACAAACCCTGGACAAG"}, {"barcode06", "GACTACTTTCTGCCTTTGCGAGAA"},
+        {"barcode07", "AAGGATTCATTCCCACGGTAACAC"}, {"barcode08", "ACGTAACTTGGTTTGTTCCCTGAA"},
+        {"barcode09", "AACCAAGACTCGCTGTGCCTAGTT"}, {"barcode10", "GAGAGGACAAAGGTTTCAACGCTT"},
+        {"barcode11", "TCCATTCCCTCCGATAGATGAAAC"}, {"barcode12", "TCCGATTCTGCTTCTTTCTACCTG"},
+};
+
+const std::unordered_map<std::string, dorado::utils::BarcodeKit>& barcode_kits() {
+    static const std::unordered_map<std::string, dorado::utils::BarcodeKit> kits = {
+            {"EXP-NBD104", {"EXP-NBD104", "AAGGTTAA", "CAGCACCT", kNativeBarcodes}},
+            {"SQK-NBD114-12", {"SQK-NBD114-12", "AAGGTTAA", "CAGCACCT", kNativeBarcodes}},
+    };
+    return kits;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+const BarcodeKit& get_barcode_kit(const std::string& name) {
+    const auto& kits = barcode_kits();
+    auto it = kits.find(name);
+    if (it == kits.end()) {
+        throw std::runtime_error("Unknown barcode kit: " + name);
+    }
+    return it->second;
+}
+
+std::vector<BarcodeKit> parse_barcode_kits(const std::string& names) {
+    std::vector<BarcodeKit> kits;
+    std::stringstream stream(names);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (!name.empty()) {
+            kits.push_back(get_barcode_kit(name));
+        }
+    }
+    return kits;
+}
+
+}  // namespace dorado::utils
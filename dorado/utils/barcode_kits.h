@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// The barcodes of a kit, and the sequences either side of each barcode at the start of a read.
+// At the end of a read the whole arrangement appears reverse complemented.
+struct BarcodeKit {
+    std::string name;
+    std::string front_flank;
+    std::string rear_flank;
+    // Barcode names, such as "barcode01", with their sequences.
+    std::vector<std::pair<std::string, std::string>> barcodes;
+};
+
+// Throws std::runtime_error for unknown kits.
+const BarcodeKit& get_barcode_kit(const std::string& name);
+
+// Parses a comma separated list of kit names.  Throws std::runtime_error for unknown kits.
+std::vector<BarcodeKit> parse_barcode_kits(const std::string& names);
+
+}  // namespace dorado::utils
@@ -1,5 +1,6 @@
 #include "base_mod_utils.h"
 
+#include "MotifScanner.h"
 #include "sequence_utils.h"
 
 #include <sstream>
@@ -67,16 +68,40 @@ std::string BaseModContext::encode() const {
     return s.str();
 }
 
+std::array<std::vector<size_t>, 4> BaseModContext::get_context_positions(
+        std::string_view sequence) const {
+    std::array<std::vector<size_t>, 4> positions;
+    std::vector<std::string> motifs;
+    std::vector<size_t> bases;
+    for (size_t i = 0; i < 4; ++i) {
+        if (!m_motifs[i].empty()) {
+            motifs.push_back(m_motifs[i]);
+            bases.push_back(i);
+        }
+    }
+    if (motifs.empty()) {
+        return positions;
+    }
+
+    // All the bases' motifs are found in one pass.  A motif ending on the last base of the
+    // sequence isn't counted.
+    const auto hits = MotifScanner(motifs).scan(sequence);
+    for (size_t m = 0; m < motifs.size(); ++m) {
+        auto& base_positions = positions[bases[m]];
+        for (const auto start : hits[m]) {
+            if (start + motifs[m].size() < sequence.size()) {
+                base_positions.push_back(start + m_offsets[bases[m]]);
+            }
+        }
+    }
+    return positions;
+}
+
 std::vector<int> BaseModContext::get_sequence_mask(std::string_view sequence) const {
     std::vector<int> mask(sequence.size(), 0);
-    for (size_t p = 0; p < sequence.size(); ++p) {
-        auto idx = base_to_int(sequence[p]);
-        if (!m_motifs[idx].empty() && p >= m_offsets[idx] &&
-            p + m_motifs[idx].size() - m_offsets[idx] < sequence.size()) {
-            size_t a = p - m_offsets[idx];
-            if (sequence.substr(a, m_motifs[idx].size()) == m_motifs[idx]) {
-                mask[p] = 1;
-            }
+    for (const auto& base_positions : get_context_positions(sequence)) {
+        for (const auto pos : base_positions) {
+            mask[pos] = 1;
         }
     }
     return mask;
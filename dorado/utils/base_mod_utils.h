@@ -70,6 +70,11 @@ public:
      */
     std::string encode() const;
 
+    /** Return, for each of A, C, G and T, the positions of that base in the sequence which
+     *  satisfy its context, in increasing order.  Bases without a context have none.
+     */
+    std::array<std::vector<size_t>, 4> get_context_positions(std::string_view sequence) const;
+
     /** Return a vector of 0s and 1s indicating which bases have been checked for modification
      *  according to the context information.
      */
@@ -0,0 +1,211 @@
+#include "cache_utils.h"
+
+#include <openssl/sha.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace dorado::utils {
+
+std::optional<fs::path> get_cache_dir() {
+    if (getenv("dorado_no_cache")) {
+        return std::nullopt;
+    }
+    if (const char* cache_dir = getenv("dorado_cache_dir"); cache_dir && *cache_dir) {
+        return fs::path(cache_dir);
+    }
+    if (const char* xdg_cache_home = getenv("XDG_CACHE_HOME"); xdg_cache_home && *xdg_cache_home) {
+        return fs::path(xdg_cache_home) / "dorado";
+    }
+#ifdef _WIN32
+    const char* home = getenv("LOCALAPPDATA");
+#else
+    const char* home = getenv("HOME");
+#endif
+    if (home && *home) {
+        return fs::path(home) / ".cache" / "dorado";
+    }
+    return std::nullopt;
+}
+
+std::string cache_file_name(const std::vector<std::string>& key_parts,
+                            const std::string& extension) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    for (const auto& part : key_parts) {
+        // Include the length of each part so that differently split keys don't collide.
+        const uint64_t size = part.size();
+        SHA256_Update(&sha256, &size, sizeof(size));
+        SHA256_Update(&sha256, part.data(), part.size());
+    }
+    SHA256_Final(hash, &sha256);
+
+    // 128 bits is plenty to tell entries apart.
+    std::ostringstream name;
+    name << std::hex << std::setfill('0');
+    for (int i = 0; i < 16; ++i) {
+        name << std::setw(2) << static_cast<int>(hash[i]);
+    }
+    name << extension;
+    return name.str();
+}
+
+std::string directory_fingerprint(const fs::path& dir) {
+    std::vector<std::string> entries;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::ostringstream description;
+        description << entry.path().filename().string() << ':' << entry.file_size() << ':'
+                    << entry.last_write_time().time_since_epoch().count();
+        entries.push_back(description.str());
+    }
+    // Directory iteration order is unspecified.
+    std::sort(entries.begin(), entries.end());
+
+    std::string fingerprint = fs::canonical(dir).string();
+    for (const auto& entry : entries) {
+        fingerprint += '\n' + entry;
+    }
+    return fingerprint;
+}
+
+std::string file_fingerprint(const fs::path& file) {
+    std::ostringstream fingerprint;
+    fingerprint << fs::canonical(file).string() << ':' << fs::file_size(file) << ':'
+                << fs::last_write_time(file).time_since_epoch().count();
+    return fingerprint.str();
+}
+
+bool write_cache_file(const fs::path& path, const std::function<void(const fs::path&)>& write) {
+    // Unique per writer, so that concurrent runs don't write the same temporary file.
+    static std::atomic<int> counter{0};
+    std::ostringstream temp_name;
+    temp_name << path.filename().string() << ".tmp." << std::this_thread::get_id() << '.'
+              << counter++ << '.' << std::chrono::steady_clock::now().time_since_epoch().count();
+    const auto temp_path = path.parent_path() / temp_name.str();
+
+    try {
+        fs::create_directories(path.parent_path());
+        write(temp_path);
+        fs::rename(temp_path, path);
+        return true;
+    } catch (const std::exception& e) {
+        spdlog::debug("Failed to write cache file {}: {}", path.string(), e.what());
+        std::error_code ec;
+        fs::remove(temp_path, ec);
+        return false;
+    }
+}
+
+void touch_cache_file(const fs::path& path) {
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+}
+
+uintmax_t trim_cache_dir(const fs::path& dir, uintmax_t max_bytes) {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type last_used;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total_bytes = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        // Temporary files belong to writers which haven't renamed them into place yet.
+        if (!entry.is_regular_file(ec) ||
+            entry.path().filename().string().find(".tmp.") != std::string::npos) {
+            continue;
+        }
+        const auto size = entry.file_size(ec);
+        const auto last_used = entry.last_write_time(ec);
+        if (ec) {
+            continue;
+        }
+        entries.push_back({entry.path(), last_used, size});
+        total_bytes += size;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+    uintmax_t removed_bytes = 0;
+    for (const auto& entry : entries) {
+        if (total_bytes - removed_bytes <= max_bytes) {
+            break;
+        }
+        // Another run may have removed it already, which frees the space just the same.
+        fs::remove(entry.path, ec);
+        removed_bytes += entry.size;
+        spdlog::debug("Evicted cache entry {}", entry.path.string());
+    }
+    return removed_bytes;
+}
+
+uintmax_t get_weights_cache_max_bytes() {
+    if (const char* max_mb = getenv("dorado_weights_cache_mb"); max_mb && *max_mb) {
+        return std::strtoull(max_mb, nullptr, 10) << 20;
+    }
+    return kDefaultWeightsCacheMaxBytes;
+}
+
+bool write_cached_value(const fs::path& path, const std::string& value) {
+    return write_cache_file(path, [&value](const fs::path& temp_path) {
+        const auto now = std::chrono::system_clock::now();
+        std::ofstream file(temp_path);
+        file << std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count()
+             << '\n'
+             << value << '\n';
+        if (!file) {
+            throw std::runtime_error("write failed");
+        }
+    });
+}
+
+std::optional<std::string> read_cached_value(const fs::path& path, std::chrono::seconds max_age) {
+    std::ifstream file(path);
+    int64_t written_seconds = 0;
+    std::string value;
+    if (!(file >> written_seconds) || !std::getline(file >> std::ws, value)) {
+        return std::nullopt;
+    }
+    const auto written =
+            std::chrono::system_clock::time_point(std::chrono::seconds(written_seconds));
+    const auto age = std::chrono::system_clock::now() - written;
+    if (age > max_age || age < std::chrono::seconds(0)) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+void clear_cache() {
+    auto cache_dir = get_cache_dir();
+    if (!cache_dir) {
+        return;
+    }
+    for (const auto& subdir : {kWeightsCacheDir, kBatchSizeCacheDir, kChannelIndexCacheDir,
+                              kBasecallCacheDir, kFileMetadataCacheDir, kObjectCacheDir,
+                              kGemmAlgoCacheDir}) {
+        std::error_code ec;
+        fs::remove_all(*cache_dir / subdir, ec);
+        if (ec) {
+            spdlog::warn("Failed to clear cache {}: {}", (*cache_dir / subdir).string(),
+                         ec.message());
+        }
+    }
+    spdlog::info("> Cleared cache {}", cache_dir->string());
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+// Directory holding the on-disk caches that let repeat runs skip expensive setup.
+// This is $dorado_cache_dir if set, otherwise $XDG_CACHE_HOME/dorado or ~/.cache/dorado.
+// Returns std::nullopt if caching has been disabled by setting dorado_no_cache, or if there
+// is nowhere to put the cache.
+std::optional<std::filesystem::path> get_cache_dir();
+
+// Subdirectories of the cache directory holding each kind of entry.
+inline const std::string kWeightsCacheDir = "weights";
+inline const std::string kBatchSizeCacheDir = "batch_sizes";
+inline const std::string kChannelIndexCacheDir = "channel_index";
+inline const std::string kBasecallCacheDir = "basecalls";
+inline const std::string kFileMetadataCacheDir = "file_metadata";
+inline const std::string kObjectCacheDir = "objects";
+inline const std::string kGemmAlgoCacheDir = "gemm_algos";
+
+// Name of the cache entry for a value which depends on exactly the given key parts.
+std::string cache_file_name(const std::vector<std::string>& key_parts,
+                            const std::string& extension);
+
+// Summary of a directory's files (names, sizes and modification times), for keying cache
+// entries derived from them so that the entries go stale when the files change.
+std::string directory_fingerprint(const std::filesystem::path& dir);
+// As directory_fingerprint, for a single file.
+std::string file_fingerprint(const std::filesystem::path& file);
+
+// Creates the cache entry at path by calling write with a temporary path, then renaming it into
+// place, so that concurrent runs never read a partial entry.  Caches are only an optimisation,
+// so failures are logged and otherwise ignored.  Returns whether the entry was written.
+bool write_cache_file(const std::filesystem::path& path,
+                      const std::function<void(const std::filesystem::path&)>& write);
+
+// Marks the entry at path as just used, for trim_cache_dir's least-recently-used eviction.
+void touch_cache_file(const std::filesystem::path& path);
+
+// Removes the least recently used entries in dir, by modification time, until those left total
+// at most max_bytes.  Entries still being written are left alone.  Returns the bytes removed.
+uintmax_t trim_cache_dir(const std::filesystem::path& dir, uintmax_t max_bytes);
+
+// Converted model weights take tens of MB per model, so the weights cache is capped at this
+// size, least recently used models first to go.  dorado_weights_cache_mb overrides the cap, and
+// setting it to 0 disables the weights cache.
+constexpr uintmax_t kDefaultWeightsCacheMaxBytes = uintmax_t(1) << 30;
+uintmax_t get_weights_cache_max_bytes();
+
+// Small single-line values, such as tuned parameters, are stored along with the time they
+// were written.  read_cached_value ignores entries older than max_age.
+bool write_cached_value(const std::filesystem::path& path, const std::string& value);
+std::optional<std::string> read_cached_value(const std::filesystem::path& path,
+                                             std::chrono::seconds max_age);
+
+// Removes every cache entry, e.g. after a driver upgrade changes what the tuned values
+// should be.  Only the cache subdirectories are removed, since the cache directory itself may
+// have been pointed anywhere.
+void clear_cache();
+
+}  // namespace dorado::utils
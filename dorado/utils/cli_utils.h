@@ -83,6 +83,161 @@ inline argparse::ArgumentParser parse_internal_options(
     private_parser.add_argument("--dump_stats_filter")
             .help("Internal processing stats. name filter regex.")
             .default_value(std::string(""));
+    private_parser.add_argument("--memory_summary")
+            .help("Internal processing stats. Log the peak bytes of reads held by each node at "
+                  "the end of the run.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--cuda_streams_per_device")
+            .help("Number of basecall batches each GPU runs concurrently, each on its own CUDA "
+                  "stream.")
+            .default_value(1)
+            .scan<'i', int>();
+    private_parser.add_argument("--cuda_graphs")
+            .help("Capture the basecall model's forward pass as a CUDA graph and replay it for "
+                  "each batch, reducing kernel launch overhead.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--cuda_workspace_arena")
+            .help("Run each CUDA stream's batches within a fixed memory pool sized at startup, "
+                  "captured as CUDA graphs at a few batch sizes, so that models sharing a GPU "
+                  "can't fragment each other's memory.  Implies --cuda_graphs.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--short_read_chunk_sizes")
+            .help("Number of additional, successively halved chunk sizes used to basecall reads "
+                  "shorter than the chunk size, reducing padding. Each needs its own model "
+                  "instance per device.")
+            .default_value(0)
+            .scan<'i', int>();
+    private_parser.add_argument("--chunk_scheduling")
+            .help("Order in which chunks of different reads are basecalled: fifo, shortest "
+                  "(fewest remaining chunks first, with waiting reads aging ahead) or "
+                  "round_robin.")
+            .default_value(std::string("fifo"));
+    private_parser.add_argument("--modbase_signal_on_device")
+            .help("Copy each read's signal to the GPU once for modified base calling, and gather "
+                  "the models' signal windows there, rather than copying every window.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--modbase_kmers_on_device")
+            .help("CUDA: send each modified base chunk's bases and where they start in its signal "
+                  "to the GPU, and one-hot encode its kmers there, rather than copying the "
+                  "encoding.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--modbase_fuse_models")
+            .help("Batch the chunks of modified base models which take the same inputs together, "
+                  "copying each batch to the device once and calling the models in turn on "
+                  "their own rows of it.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--modbase_batch_timeout_ms")
+            .help("Longest a modified base batch which isn't full waits for more chunks before it "
+                  "is called anyway.")
+            .default_value(100)
+            .scan<'i', int>();
+    private_parser.add_argument("--metal_viterbi_decode")
+            .help("Metal: find each chunk's basecalls by a Viterbi search on the GPU, rather than "
+                  "by beam search on the CPU.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--decode_kept_steps_only")
+            .help("CUDA: decode each chunk only a little past the last step that stitching "
+                  "keeps, skipping the rest of its overlap and padding past the end of its read.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--max_working_reads_bytes")
+            .help("Stop taking reads into a basecaller once those being called hold this many "
+                  "bytes of signal and called chunks (e.g. 8G), rather than limiting their "
+                  "number. 0 to disable.")
+            .default_value(std::string("0"));
+    private_parser.add_argument("--min_signal_stdev_pa")
+            .help("Drop reads before basecalling whose signal has a standard deviation below "
+                  "this many pA, as for a blocked pore. 0 to disable.")
+            .default_value(0.f)
+            .scan<'f', float>();
+    private_parser.add_argument("--trim_adapter_tail")
+            .help("Also trim the adapter, and the polyA/T tail after it, from the start of each "
+                  "read's signal, found as a flat stretch, so they aren't basecalled.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--adaptive_batch_latency_ms")
+            .help("Call partial batches when the chunk arrival rate and call time say they would "
+                  "otherwise miss this latency target, rather than after a fixed time without new "
+                  "chunks. 0 to disable.")
+            .default_value(0)
+            .scan<'i', int>();
+    private_parser.add_argument("--pack_short_reads")
+            .help("Pack reads short enough that several fit in a chunk into shared chunks, "
+                  "rather than giving each read a chunk of its own, for short read libraries.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--scale_on_device")
+            .help("CUDA: normalise reads' signal on the first GPU, in batches, rather than on "
+                  "the CPU, for hosts whose pipeline is short of CPU.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--stream_ubam")
+            .help("When writing uncompressed BAM to a pipe, serialise the records in dorado and "
+                  "write them out in large buffers, rather than record by record through htslib.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--clear_cache")
+            .help("Remove cached model weights and auto batch sizes before starting, so they are "
+                  "loaded and measured afresh.")
+            .default_value(false)
+            .implicit_value(true);
+    private_parser.add_argument("--metrics_port")
+            .help("Internal processing stats. Serve live stats in OpenMetrics format at "
+                  "http://<host>:<port>/metrics. 0 to disable.")
+            .default_value(0)
+            .scan<'i', int>();
+    private_parser.add_argument("--metrics_host")
+            .help("Internal processing stats. Address to serve stats on with --metrics_port, "
+                  "0.0.0.0 to allow remote scraping.")
+            .default_value(std::string("127.0.0.1"));
+    private_parser.add_argument("--pairing_max_time_delta_ms")
+            .help("Duplex pairing: maximum gap between the end of a template read and the start "
+                  "of its complement.")
+            .default_value(5000)
+            .scan<'i', int>();
+    private_parser.add_argument("--pairing_min_seq_len_ratio")
+            .help("Duplex pairing: minimum ratio of the shorter read's length to the longer's.")
+            .default_value(0.95f)
+            .scan<'f', float>();
+    private_parser.add_argument("--pairing_min_shared_minimizer_frac")
+            .help("Duplex pairing: minimum fraction of minimizers a template read shares with the "
+                  "reverse complement of its complement. 0 to disable.")
+            .default_value(0.02f)
+            .scan<'f', float>();
+    private_parser.add_argument("--duplex_alignment_band")
+            .help("Duplex: align read pairs in batches on the GPU, considering this many bases "
+                  "either side of the diagonal, rather than one by one with edlib on the CPU. 0 "
+                  "to disable.")
+            .default_value(0)
+            .scan<'i', int>();
+    private_parser.add_argument("--aligner_extension_band")
+            .help("CUDA, with --reference: have minimap2 only seed and chain, and align the "
+                  "chained ranges in batches on the first GPU, considering this many bases either "
+                  "side of the diagonal. Hits outside the band are aligned by minimap2. 0 to "
+                  "disable.")
+            .default_value(0)
+            .scan<'i', int>();
+    private_parser.add_argument("--record_model_outputs")
+            .help("Save the basecall model's decoded chunks to this directory at the end of the "
+                  "run, for --replay_model_outputs.")
+            .default_value(std::string(""));
+    private_parser.add_argument("--replay_model_outputs")
+            .help("Basecall with the decoded chunks recorded in this directory, from the same "
+                  "data and settings, rather than running the model, so that the other stages "
+                  "can be profiled without a GPU.")
+            .default_value(std::string(""));
+    private_parser.add_argument("--replay_chunks_per_s")
+            .help("With --replay_model_outputs, the rate each replayed runner calls chunks at, "
+                  "in place of the device. 0 to replay as fast as possible.")
+            .default_value(0.f)
+            .scan<'f', float>();
     args.insert(args.begin(), prog_name);
     private_parser.parse_args(args);
 
@@ -1,7 +1,10 @@
 #include "cuda_utils.h"
 
+#include "cache_utils.h"
+#include "cli_utils.h"
 #include "cxxpool.h"
 #include "math_utils.h"
+#include "numa_utils.h"
 
 #include <torch/torch.h>
 
@@ -10,18 +13,26 @@ extern "C" {
 }
 
 #include <ATen/cuda/CUDAContext.h>
+#include <c10/cuda/CUDACachingAllocator.h>
 #include <c10/cuda/CUDAGuard.h>
+#include <cublasLt.h>
 #include <cublas_v2.h>
 #include <cuda_runtime.h>
 #include <cuda_runtime_api.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdlib>
 #include <exception>
+#include <iomanip>
 #include <limits>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <regex>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -30,6 +41,45 @@ using namespace std::chrono;
 namespace dorado::utils {
 namespace {
 
+// Auto batch sizes are re-measured after this long, in case anything the key misses changed.
+constexpr auto kBatchSizeCacheMaxAge = std::chrono::hours(24 * 30);
+
+// The UUID of the GPU, for keying cache entries which depend on the exact device.
+std::string gpu_uuid(int device_index) {
+    const auto *prop = at::cuda::getDeviceProperties(device_index);
+    std::ostringstream uuid;
+    uuid << std::hex << std::setfill('0');
+    for (auto byte : prop->uuid.bytes) {
+        uuid << std::setw(2) << static_cast<int>(static_cast<unsigned char>(byte));
+    }
+    return uuid.str();
+}
+
+// Where the auto batch size for the given device and search is cached, if caching is enabled.
+// It depends on the exact GPU and driver and on the model, as well as the search range.
+std::optional<std::filesystem::path> batch_size_cache_path(const CRFModelConfig &model_config,
+                                                           const torch::TensorOptions &options,
+                                                           int granularity,
+                                                           int max_batch_size,
+                                                           const std::string &chunk_key,
+                                                           float memory_limit_fraction) {
+    auto cache_dir = get_cache_dir();
+    if (!cache_dir) {
+        return std::nullopt;
+    }
+    int driver_version = 0;
+    cudaDriverGetVersion(&driver_version);
+
+    return *cache_dir / kBatchSizeCacheDir /
+           cache_file_name({gpu_uuid(options.device().index()), std::to_string(driver_version),
+                            directory_fingerprint(model_config.model_path),
+                            c10::toString(options.dtype().toScalarType()),
+                            std::to_string(granularity), std::to_string(max_batch_size),
+                            chunk_key, std::to_string(memory_limit_fraction),
+                            std::to_string(gpu_memory_limit())},
+                           ".txt");
+}
+
 /**
  * Wrapper around CUDA events to measure GPU timings.
  */
@@ -53,14 +103,14 @@ public:
      * The timer will start once all previously submitted CUDA work
      * has completed on the active stream.
      */
-    void start() { check_cuda_result(cudaEventRecord(m_start)); }
+    void start(cudaStream_t stream = 0) { check_cuda_result(cudaEventRecord(m_start, stream)); }
 
     /**
      * Mark the end of a profiling section.
      * The timer will stop once all previously submitted CUDA work
      * has completed on the active stream.
      */
-    void stop() { check_cuda_result(cudaEventRecord(m_stop)); }
+    void stop(cudaStream_t stream = 0) { check_cuda_result(cudaEventRecord(m_stop, stream)); }
 
     /**
      * Get the time spent on the GPU between the begin and end markers.
@@ -84,6 +134,300 @@ public:
     }
 };
 
+#ifndef DORADO_TX2
+// GEMM algorithm choices are re-measured after this long, in case anything the key misses changed.
+constexpr auto kGemmAlgoCacheMaxAge = std::chrono::hours(24 * 30);
+
+void check_cublaslt_result(cublasStatus_t res, const char *what) {
+    if (res != CUBLAS_STATUS_SUCCESS) {
+        spdlog::error("CuBLASLt error {} in {}", int(res), what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * FP16 GEMMs through cuBLASLt, with the algorithm for each shape picked by timing the
+ * candidates cuBLASLt suggests for it, rather than taking its first guess.  Choices are
+ * cached on disk per GPU, so each shape is only timed the first time it is seen.  Each stream
+ * gets a workspace which is allocated once and reused by every GEMM on it.
+ */
+class LtMatmuls {
+public:
+    // Never destroyed, since the CUDA context may already be gone at exit.
+    static LtMatmuls &instance() {
+        static auto *const matmuls = new LtMatmuls;
+        return *matmuls;
+    }
+
+    void matmul(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
+        constexpr uint16_t HALF_ZERO = 0;      // 0.0 in __half format
+        constexpr uint16_t HALF_ONE = 0x3C00;  // 1.0 in __half format
+        const auto stream = at::cuda::getCurrentCUDAStream(A.device().index());
+        const Plan *plan = nullptr;
+        void *workspace = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            workspace = stream_workspace(A.device().index(), stream);
+            plan = find_plan(A, B, C, workspace != nullptr, stream);
+        }
+        // As in matmul_f16_cublas, C^T = B^T A^T is computed in cuBLAS's column-major terms.
+        check_cublaslt_result(
+                cublasLtMatmul(m_handle, plan->desc, &HALF_ONE, B.data_ptr(), plan->b_layout,
+                               A.data_ptr(), plan->a_layout, &HALF_ZERO, C.data_ptr(),
+                               plan->c_layout, C.data_ptr(), plan->c_layout, &plan->algo,
+                               workspace, plan->workspace_bytes, stream),
+                "cublasLtMatmul");
+        if (plan->uncached) {
+            delete plan;
+        }
+    }
+
+private:
+    static constexpr size_t kWorkspaceBytes = size_t(32) << 20;
+    static constexpr int kMaxCandidates = 8;
+
+    struct Plan {
+        cublasLtMatmulDesc_t desc{nullptr};
+        cublasLtMatrixLayout_t a_layout{nullptr};
+        cublasLtMatrixLayout_t b_layout{nullptr};
+        cublasLtMatrixLayout_t c_layout{nullptr};
+        cublasLtMatmulAlgo_t algo{};
+        size_t workspace_bytes{0};
+        // Chosen while capturing a CUDA graph, so untimed, and only used for that GEMM.
+        bool uncached{false};
+
+        ~Plan() {
+            cublasLtMatrixLayoutDestroy(c_layout);
+            cublasLtMatrixLayoutDestroy(b_layout);
+            cublasLtMatrixLayoutDestroy(a_layout);
+            cublasLtMatmulDescDestroy(desc);
+        }
+    };
+
+    // Device, M, N, K, the leading dimensions of A, B and C, the pointers' common alignment,
+    // and whether there's a workspace.
+    using Shape = std::array<int64_t, 9>;
+
+    LtMatmuls() { check_cublaslt_result(cublasLtCreate(&m_handle), "cublasLtCreate"); }
+
+    // The stream's workspace, or nullptr if it has none and one can't be made now because the
+    // stream is being captured.  Called with the mutex held.
+    void *stream_workspace(int device_index, cudaStream_t stream) {
+        auto &workspace = m_workspaces[{device_index, stream}];
+        if (!workspace.defined()) {
+            if (is_capturing(stream)) {
+                m_workspaces.erase({device_index, stream});
+                return nullptr;
+            }
+            workspace = torch::empty({int64_t(kWorkspaceBytes)},
+                                     torch::TensorOptions()
+                                             .dtype(torch::kUInt8)
+                                             .device(c10::kCUDA, device_index));
+        }
+        return workspace.data_ptr();
+    }
+
+    static bool is_capturing(cudaStream_t stream) {
+        cudaStreamCaptureStatus status = cudaStreamCaptureStatusNone;
+        cudaStreamIsCapturing(stream, &status);
+        return status != cudaStreamCaptureStatusNone;
+    }
+
+    static int64_t alignment(torch::Tensor const &t) {
+        const auto address = reinterpret_cast<uintptr_t>(t.data_ptr());
+        int64_t align = 256;
+        while (align > 2 && address % align != 0) {
+            align /= 2;
+        }
+        return align;
+    }
+
+    // Called with the mutex held.
+    const Plan *find_plan(torch::Tensor const &A,
+                          torch::Tensor const &B,
+                          torch::Tensor &C,
+                          bool has_workspace,
+                          cudaStream_t stream) {
+        const int64_t align = std::min({alignment(A), alignment(B), alignment(C)});
+        const Shape shape{A.device().index(), A.size(0), B.size(1), A.size(1),  A.stride(0),
+                          B.stride(0),        C.stride(0), align,    has_workspace};
+        auto &plan = m_plans[shape];
+        if (plan) {
+            return plan.get();
+        }
+        auto new_plan = make_plan(shape);
+        auto candidates = heuristic_algos(*new_plan, shape);
+        if (candidates.empty()) {
+            spdlog::error("CuBLASLt has no algorithm for a {}x{}x{} GEMM", shape[1], shape[2],
+                          shape[3]);
+            exit(EXIT_FAILURE);
+        }
+        const auto cache_path = algo_cache_path(shape);
+        if (!load_algo(*new_plan, cache_path)) {
+            if (is_capturing(stream)) {
+                // Nothing can be timed until the capture ends, so take cuBLASLt's first choice
+                // for now, and tune the shape when it's next seen outside a capture.
+                m_plans.erase(shape);
+                new_plan->algo = candidates.front().algo;
+                new_plan->workspace_bytes = candidates.front().workspaceSize;
+                new_plan->uncached = true;
+                return new_plan.release();
+            }
+            time_algos(*new_plan, candidates, A, B, C, stream);
+            if (cache_path) {
+                write_cached_value(*cache_path, algo_to_string(new_plan->algo));
+            }
+        }
+        plan = std::move(new_plan);
+        return plan.get();
+    }
+
+    std::unique_ptr<Plan> make_plan(const Shape &shape) {
+        const int64_t M = shape[1], N = shape[2], K = shape[3];
+        const int64_t lda = shape[4], ldb = shape[5], ldc = shape[6];
+        auto plan = std::make_unique<Plan>();
+        check_cublaslt_result(cublasLtMatmulDescCreate(&plan->desc, CUBLAS_COMPUTE_16F, CUDA_R_16F),
+                              "cublasLtMatmulDescCreate");
+        // Column-major, so each matrix is described as its transpose.
+        check_cublaslt_result(cublasLtMatrixLayoutCreate(&plan->a_layout, CUDA_R_16F, K, M, lda),
+                              "cublasLtMatrixLayoutCreate");
+        check_cublaslt_result(cublasLtMatrixLayoutCreate(&plan->b_layout, CUDA_R_16F, N, K, ldb),
+                              "cublasLtMatrixLayoutCreate");
+        check_cublaslt_result(cublasLtMatrixLayoutCreate(&plan->c_layout, CUDA_R_16F, N, M, ldc),
+                              "cublasLtMatrixLayoutCreate");
+        return plan;
+    }
+
+    std::vector<cublasLtMatmulHeuristicResult_t> heuristic_algos(const Plan &plan,
+                                                                 const Shape &shape) {
+        const uint32_t align = uint32_t(shape[7]);
+        const size_t max_workspace = shape[8] ? kWorkspaceBytes : 0;
+        cublasLtMatmulPreference_t preference = nullptr;
+        check_cublaslt_result(cublasLtMatmulPreferenceCreate(&preference),
+                              "cublasLtMatmulPreferenceCreate");
+        cublasLtMatmulPreferenceSetAttribute(preference, CUBLASLT_MATMUL_PREF_MAX_WORKSPACE_BYTES,
+                                             &max_workspace, sizeof(max_workspace));
+        for (auto attr : {CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_A_BYTES,
+                          CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_B_BYTES,
+                          CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_C_BYTES,
+                          CUBLASLT_MATMUL_PREF_MIN_ALIGNMENT_D_BYTES}) {
+            cublasLtMatmulPreferenceSetAttribute(preference, attr, &align, sizeof(align));
+        }
+        std::vector<cublasLtMatmulHeuristicResult_t> results(kMaxCandidates);
+        int num_results = 0;
+        auto res = cublasLtMatmulAlgoGetHeuristic(
+                m_handle, plan.desc, plan.b_layout, plan.a_layout, plan.c_layout, plan.c_layout,
+                preference, kMaxCandidates, results.data(), &num_results);
+        cublasLtMatmulPreferenceDestroy(preference);
+        results.resize(res == CUBLAS_STATUS_SUCCESS ? num_results : 0);
+        return results;
+    }
+
+    // Picks the fastest of the candidates by running each on the GEMM's own operands.
+    void time_algos(Plan &plan,
+                    const std::vector<cublasLtMatmulHeuristicResult_t> &candidates,
+                    torch::Tensor const &A,
+                    torch::Tensor const &B,
+                    torch::Tensor &C,
+                    cudaStream_t stream) {
+        constexpr uint16_t HALF_ZERO = 0;
+        constexpr uint16_t HALF_ONE = 0x3C00;
+        constexpr int kRuns = 10;
+        void *workspace = stream_workspace(A.device().index(), stream);
+        CUDATimer cuda_timer;
+        float best_time = std::numeric_limits<float>::max();
+        for (const auto &candidate : candidates) {
+            auto run = [&] {
+                return cublasLtMatmul(m_handle, plan.desc, &HALF_ONE, B.data_ptr(), plan.b_layout,
+                                      A.data_ptr(), plan.a_layout, &HALF_ZERO, C.data_ptr(),
+                                      plan.c_layout, C.data_ptr(), plan.c_layout,
+                                      &candidate.algo, workspace, candidate.workspaceSize,
+                                      stream);
+            };
+            // Warmup, which also rules out algorithms which fail to launch.
+            if (run() != CUBLAS_STATUS_SUCCESS) {
+                continue;
+            }
+            cuda_timer.start(stream);
+            for (int i = 0; i < kRuns; i++) {
+                run();
+            }
+            cuda_timer.stop(stream);
+            const float time = cuda_timer.result_ms();
+            if (time < best_time) {
+                best_time = time;
+                plan.algo = candidate.algo;
+                plan.workspace_bytes = candidate.workspaceSize;
+            }
+        }
+        if (best_time == std::numeric_limits<float>::max()) {
+            plan.algo = candidates.front().algo;
+            plan.workspace_bytes = candidates.front().workspaceSize;
+        }
+        spdlog::trace("CuBLASLt {}x{}x{} GEMM: best of {} algorithms takes {} ms", A.size(0),
+                      B.size(1), A.size(1), candidates.size(), best_time / kRuns);
+    }
+
+    // Where the algorithm for the shape is cached, if caching is enabled.  It depends on the
+    // exact GPU and cuBLASLt version.
+    static std::optional<std::filesystem::path> algo_cache_path(const Shape &shape) {
+        auto cache_dir = get_cache_dir();
+        if (!cache_dir) {
+            return std::nullopt;
+        }
+        std::vector<std::string> key{gpu_uuid(int(shape[0])), std::to_string(cublasLtGetVersion())};
+        for (size_t i = 1; i < shape.size(); i++) {
+            key.push_back(std::to_string(shape[i]));
+        }
+        return *cache_dir / kGemmAlgoCacheDir / cache_file_name(key, ".txt");
+    }
+
+    static std::string algo_to_string(const cublasLtMatmulAlgo_t &algo) {
+        std::ostringstream out;
+        out << std::hex << std::setfill('0');
+        for (auto word : algo.data) {
+            out << std::setw(16) << word;
+        }
+        return out.str();
+    }
+
+    // Whether a usable algorithm for the plan was read from the cache.
+    bool load_algo(Plan &plan, const std::optional<std::filesystem::path> &cache_path) {
+        if (!cache_path) {
+            return false;
+        }
+        auto cached = read_cached_value(*cache_path, kGemmAlgoCacheMaxAge);
+        constexpr size_t kWordChars = 16;
+        cublasLtMatmulAlgo_t algo{};
+        if (!cached || cached->size() != std::size(algo.data) * kWordChars) {
+            return false;
+        }
+        try {
+            for (size_t i = 0; i < std::size(algo.data); i++) {
+                algo.data[i] = std::stoull(cached->substr(i * kWordChars, kWordChars), nullptr, 16);
+            }
+        } catch (const std::exception &) {
+            return false;
+        }
+        cublasLtMatmulHeuristicResult_t check{};
+        if (cublasLtMatmulAlgoCheck(m_handle, plan.desc, plan.b_layout, plan.a_layout,
+                                    plan.c_layout, plan.c_layout, &algo,
+                                    &check) != CUBLAS_STATUS_SUCCESS ||
+            check.workspaceSize > kWorkspaceBytes) {
+            return false;
+        }
+        plan.algo = algo;
+        plan.workspace_bytes = check.workspaceSize;
+        return true;
+    }
+
+    cublasLtHandle_t m_handle{nullptr};
+    std::mutex m_mutex;
+    std::map<Shape, std::unique_ptr<Plan>> m_plans;
+    std::map<std::pair<int, cudaStream_t>, torch::Tensor> m_workspaces;
+};
+#endif  // DORADO_TX2
+
 }  // namespace
 
 namespace details {
@@ -111,12 +455,24 @@ void matmul_f16_torch(torch::Tensor const &A, torch::Tensor const &B, torch::Ten
     C.copy_(torch::matmul(A, B));
 }
 
+#ifndef DORADO_TX2
+void matmul_f16_cublaslt(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
+    assert(A.dtype() == torch::kF16 && B.dtype() == torch::kF16 && C.dtype() == torch::kF16);
+    assert(A.stride(1) == 1 && B.stride(1) == 1 && C.stride(1) == 1);
+    assert(A.size(0) == C.size(0));  // M
+    assert(B.size(1) == C.size(1));  // N
+    assert(A.size(1) == B.size(0));  // K
+    LtMatmuls::instance().matmul(A, B, C);
+}
+#endif  // DORADO_TX2
+
 }  // namespace details
 
 void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
     // torch::matmul() is a bit slower than cublasGemmEx() on A100 and half the speed on V100,
     // but an order of magnitude faster on our Windows CI machines (1080 Ti), so dynamically
-    // pick which one we should use on first invocation.
+    // pick which one we should use on first invocation, along with cuBLASLt, whose algorithms
+    // are tuned per shape.
     static auto const fastest_mat_mul = [] {
         CUDATimer cuda_timer;
 
@@ -147,7 +503,16 @@ void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C
 
         float const torch_time = run_N_times(details::matmul_f16_torch);
         float const cublas_time = run_N_times(details::matmul_f16_cublas);
-        return cublas_time < torch_time ? details::matmul_f16_cublas : details::matmul_f16_torch;
+        auto fastest = cublas_time < torch_time ? details::matmul_f16_cublas
+                                                : details::matmul_f16_torch;
+#ifndef DORADO_TX2
+        // cuBLASLt tunes each shape as it's first seen, which the warmup covers for this one.
+        float const cublaslt_time = run_N_times(details::matmul_f16_cublaslt);
+        if (cublaslt_time < std::min(torch_time, cublas_time)) {
+            fastest = details::matmul_f16_cublaslt;
+        }
+#endif  // DORADO_TX2
+        return fastest;
     }();
     fastest_mat_mul(A, B, C);
 }
@@ -197,17 +562,75 @@ size_t available_memory(torch::Device device) {
     return free;
 }
 
-int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
-                        const dorado::CRFModelConfig &model_config,
-                        const torch::TensorOptions &options,
-                        int granularity,
-                        float memory_limit_fraction) {
-#ifdef DORADO_TX2
-    return 256;
-#else
+size_t gpu_memory_limit() {
+    static const size_t limit = details::parse_gpu_memory_limit(getenv("dorado_gpu_memory_limit"));
+    return limit;
+}
+
+bool is_mig_device(torch::Device device) {
+    // MIG instances are named after their profile, e.g. "NVIDIA A100-SXM4-40GB MIG 1g.5gb".
+    const auto *prop = at::cuda::getDeviceProperties(device.index());
+    return std::string(prop->name).find(" MIG ") != std::string::npos;
+}
+
+size_t gpu_memory_budget(torch::Device device, float memory_limit_fraction) {
+    const size_t limit = gpu_memory_limit();
+    if (limit == 0) {
+        return size_t(available_memory(device) * memory_limit_fraction);
+    }
+    // A MIG instance reports its own slice's memory, so the limit is clamped to that.  As with
+    // the memory available, what this process already holds on the device isn't available.
+    const size_t total = at::cuda::getDeviceProperties(device.index())->totalGlobalMem;
+    using c10::cuda::CUDACachingAllocator::StatType;
+    const auto stats = c10::cuda::CUDACachingAllocator::getDeviceStats(device.index());
+    const size_t reserved =
+            stats.reserved_bytes[static_cast<size_t>(StatType::AGGREGATE)].current;
+    const size_t capped = std::min(limit, total);
+    return size_t((capped - std::min(capped, reserved)) * memory_limit_fraction);
+}
+
+void apply_gpu_memory_limit(torch::Device device) {
+    const size_t limit = gpu_memory_limit();
+    if (limit == 0) {
+        return;
+    }
+    const size_t total = at::cuda::getDeviceProperties(device.index())->totalGlobalMem;
+    const size_t free = available_memory(device);
+    spdlog::debug("GPU memory limit on {}{}: {}GB of {}GB, {}GB free", device.str(),
+                  is_mig_device(device) ? " (MIG instance)" : "", limit / 1e+9, total / 1e+9,
+                  free / 1e+9);
+    if (limit > free) {
+        spdlog::warn("GPU memory limit of {}GB on {} exceeds the {}GB free", limit / 1e+9,
+                     device.str(), free / 1e+9);
+    }
+    c10::cuda::CUDACachingAllocator::setMemoryFraction(
+            std::min(1.0, double(limit) / double(total)), device.index());
+}
+
+int cuda_device_numa_node(int device_index) {
+    std::array<char, 32> pci_bus_id{};
+    if (cudaDeviceGetPCIBusId(pci_bus_id.data(), static_cast<int>(pci_bus_id.size()),
+                              device_index) != cudaSuccess) {
+        return -1;
+    }
+    return pci_device_numa_node(pci_bus_id.data());
+}
+
+#ifndef DORADO_TX2
+namespace {
+
+// The largest batch size worth trying for the model with memory_limit_fraction of the device,
+// from a table of the largest batch sizes that fit, or nullopt if there's too little memory.
+// The table was measured at kPresetChunkSize, so the bound is scaled down for larger chunks.
+std::optional<int> max_gpu_batch_size(const dorado::CRFModelConfig &model_config,
+                                      const torch::TensorOptions &options,
+                                      int granularity,
+                                      float memory_limit_fraction,
+                                      int chunk_size) {
     // TODO: we really need something better than this hardcoded table of max batch sizes,
     // which fails to take into account chunk size as well as varying memory requirements of
     // different GPU code paths.
+    constexpr int kPresetChunkSize = 10000;
 
     // memory breakpoints in GB
     const std::vector<int> breakpoints{8, 12, 16, 24, 32, 40};
@@ -222,33 +645,73 @@ int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
     };
 
     // compute how much free gpu memory and pick the closest breakpoint
-    auto available = available_memory(options.device()) * memory_limit_fraction / 1e+9;
+    auto available = gpu_memory_budget(options.device(), memory_limit_fraction) / 1e+9;
     spdlog::debug("Auto batch size: GPU memory available: {}GB", available);
     auto presets = details::try_select_max_batch_sizes(breakpoints, batch_sizes, available);
     if (!presets) {
-        spdlog::warn(
-                "Auto batchsize detection failed. Insufficient memory, required 8GB, available "
-                "{}GB",
-                available);
-        return pad_to(128, granularity);
+        return std::nullopt;
     }
 
     int model_type_idx = (model_config.insize <= 128) ? 0 : ((model_config.insize <= 384) ? 1 : 2);
-    const int max_batch_size = presets->at(model_type_idx);
-
-    c10::cuda::CUDAGuard device_guard(options.device());
+    int max_batch_size = presets->at(model_type_idx);
+    if (chunk_size > kPresetChunkSize) {
+        max_batch_size = int(int64_t(max_batch_size) * kPresetChunkSize / chunk_size);
+        max_batch_size = std::max(granularity, max_batch_size / granularity * granularity);
+    }
+    return max_batch_size;
+}
 
+// Times a forward pass of each batch size from granularity up to max_batch_size, in steps of
+// granularity, on chunks of chunk_size samples.  Returns the batch size with the least time
+// per chunk, and that time in ms.
+std::pair<int, float> time_gpu_batch_sizes(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                                           const dorado::CRFModelConfig &model_config,
+                                           const torch::TensorOptions &options,
+                                           int granularity,
+                                           int max_batch_size,
+                                           int chunk_size,
+                                           float memory_limit_fraction) {
     int best_batch_size = granularity;
     float best_time = std::numeric_limits<float>::max();
-    const int chunk_size = model_config.stride * 200;
     CUDATimer cuda_timer;
     spdlog::debug("Auto batch size: testing up to {} in steps of {}", max_batch_size, granularity);
+    // With a memory limit, batch sizes whose working memory exceeds the budget are ruled out,
+    // rather than relying on the preset bound.
+    const bool limited = gpu_memory_limit() != 0;
+    const size_t budget = gpu_memory_budget(options.device(), memory_limit_fraction);
+    const auto device_index = options.device().index();
+    constexpr auto kAggregate =
+            static_cast<size_t>(c10::cuda::CUDACachingAllocator::StatType::AGGREGATE);
     for (int batch_size = granularity; batch_size <= max_batch_size; batch_size += granularity) {
-        auto input = torch::empty({batch_size, model_config.num_features, chunk_size}, options);
-        cuda_timer.start();
-        module->forward(input);
-        cuda_timer.stop();
+        if (limited) {
+            c10::cuda::CUDACachingAllocator::resetPeakStats(device_index);
+        }
+        const auto stats_before = c10::cuda::CUDACachingAllocator::getDeviceStats(device_index);
+        try {
+            auto input =
+                    torch::empty({batch_size, model_config.num_features, chunk_size}, options);
+            cuda_timer.start();
+            module->forward(input);
+            cuda_timer.stop();
+        } catch (const c10::Error &) {
+            if (!limited) {
+                throw;
+            }
+            spdlog::debug("Auto batchsize: {} exceeds the GPU memory limit", batch_size);
+            c10::cuda::CUDACachingAllocator::emptyCache();
+            break;
+        }
         float const time = cuda_timer.result_ms() / batch_size;
+        if (limited) {
+            const auto stats = c10::cuda::CUDACachingAllocator::getDeviceStats(device_index);
+            const size_t working_memory = stats.allocated_bytes[kAggregate].peak -
+                                          stats_before.allocated_bytes[kAggregate].current;
+            if (working_memory > budget) {
+                spdlog::debug("Auto batchsize: {} needs {}GB, over the {}GB budget", batch_size,
+                              working_memory / 1e+9, budget / 1e+9);
+                break;
+            }
+        }
 
         spdlog::debug("Auto batchsize: {}, time per chunk {} ms", batch_size, time);
         if (time < best_time) {
@@ -256,11 +719,133 @@ int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
             best_batch_size = batch_size;
         }
     }
+    return {best_batch_size, best_time};
+}
+
+}  // namespace
+#endif  // DORADO_TX2
 
+int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                        const dorado::CRFModelConfig &model_config,
+                        const torch::TensorOptions &options,
+                        int granularity,
+                        float memory_limit_fraction) {
+#ifdef DORADO_TX2
+    return 256;
+#else
+    const int chunk_size = model_config.stride * 200;
+    const auto max_batch_size = max_gpu_batch_size(model_config, options, granularity,
+                                                   memory_limit_fraction, chunk_size);
+    if (!max_batch_size) {
+        spdlog::warn(
+                "Auto batchsize detection failed. Insufficient memory, required 8GB, available "
+                "{}GB",
+                gpu_memory_budget(options.device(), memory_limit_fraction) / 1e+9);
+        return pad_to(128, granularity);
+    }
+
+    c10::cuda::CUDAGuard device_guard(options.device());
+
+    // The preset bound above already reflects the memory available now, so a cached result
+    // for the same bound is still safe to use.
+    const auto cache_path =
+            batch_size_cache_path(model_config, options, granularity, *max_batch_size,
+                                  std::to_string(chunk_size), memory_limit_fraction);
+    if (cache_path) {
+        if (auto cached = read_cached_value(*cache_path, kBatchSizeCacheMaxAge)) {
+            try {
+                const int cached_batch_size = std::stoi(*cached);
+                if (cached_batch_size >= granularity && cached_batch_size <= *max_batch_size &&
+                    cached_batch_size % granularity == 0) {
+                    spdlog::debug("Auto batch size: using cached batch size {}", cached_batch_size);
+                    return cached_batch_size;
+                }
+            } catch (const std::exception &) {
+                // Fall through and measure it again.
+            }
+        }
+    }
+
+    const int best_batch_size =
+            time_gpu_batch_sizes(module, model_config, options, granularity, *max_batch_size,
+                                 chunk_size, memory_limit_fraction)
+                    .first;
+    if (cache_path) {
+        write_cached_value(*cache_path, std::to_string(best_batch_size));
+    }
     return best_batch_size;
 #endif
 }
 
+GpuChunkChoice auto_gpu_chunk_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                                   const dorado::CRFModelConfig &model_config,
+                                   const torch::TensorOptions &options,
+                                   int granularity,
+                                   float memory_limit_fraction,
+                                   int overlap,
+                                   int batch_size) {
+    const auto candidates = details::candidate_chunk_sizes(model_config.stride, overlap);
+#ifdef DORADO_TX2
+    return {candidates.back(), batch_size != 0 ? batch_size : 256};
+#else
+    c10::cuda::CUDAGuard device_guard(options.device());
+
+    // Keyed on the overlap and any fixed batch size as well as the model and device, since
+    // either changes which candidate wins.
+    const auto cache_key = "auto-" + std::to_string(overlap) + "-" + std::to_string(batch_size);
+    const auto cache_path = batch_size_cache_path(model_config, options, granularity, 0,
+                                                  cache_key, memory_limit_fraction);
+    if (cache_path) {
+        if (auto cached = read_cached_value(*cache_path, kBatchSizeCacheMaxAge)) {
+            std::istringstream fields(*cached);
+            GpuChunkChoice choice{};
+            if (fields >> choice.chunk_size >> choice.batch_size &&
+                std::find(candidates.begin(), candidates.end(), choice.chunk_size) !=
+                        candidates.end() &&
+                choice.batch_size >= granularity && choice.batch_size % granularity == 0) {
+                spdlog::debug("Auto chunk size: using cached chunk size {}, batch size {}",
+                              choice.chunk_size, choice.batch_size);
+                return choice;
+            }
+        }
+    }
+
+    std::vector<details::ChunkSizeTiming> timings;
+    for (const int chunk_size : candidates) {
+        int max_batch_size = batch_size;
+        if (batch_size == 0) {
+            const auto max = max_gpu_batch_size(model_config, options, granularity,
+                                                memory_limit_fraction, chunk_size);
+            if (!max) {
+                spdlog::warn(
+                        "Auto chunk size detection failed. Insufficient memory, using chunk size "
+                        "{}",
+                        candidates.back());
+                return {candidates.back(), pad_to(128, granularity)};
+            }
+            max_batch_size = *max;
+        }
+        const auto [best_batch_size, time_per_chunk] =
+                time_gpu_batch_sizes(module, model_config, options,
+                                     batch_size == 0 ? granularity : batch_size, max_batch_size,
+                                     chunk_size, memory_limit_fraction);
+        spdlog::debug("Auto chunk size: {}, batch size {}, time per chunk {} ms", chunk_size,
+                      best_batch_size, time_per_chunk);
+        timings.push_back({chunk_size, best_batch_size, time_per_chunk});
+        c10::cuda::CUDACachingAllocator::emptyCache();
+    }
+
+    const auto choice = details::select_chunk_size(timings, overlap);
+    spdlog::debug("Auto chunk size: selected chunk size {}, batch size {}", choice.chunk_size,
+                  choice.batch_size);
+    if (cache_path) {
+        write_cached_value(*cache_path, std::to_string(choice.chunk_size) + " " +
+                                                std::to_string(choice.batch_size));
+    }
+    return choice;
+#endif
+}
+
 void handle_cuda_result(int cuda_result) {
     if (cuda_result == cudaSuccess)
         return;
@@ -276,6 +861,17 @@ void handle_cuda_result(int cuda_result) {
 }
 
 namespace details {
+size_t parse_gpu_memory_limit(const char *limit) {
+    if (!limit || !*limit) {
+        return 0;
+    }
+    try {
+        return parse_string_to_size(limit);
+    } catch (const std::exception &) {
+        throw std::runtime_error(std::string("Invalid dorado_gpu_memory_limit: ") + limit);
+    }
+}
+
 std::optional<std::array<int, 3>> try_select_max_batch_sizes(
         std::vector<int> const &breakpoints,
         std::vector<std::array<int, 3>> const &batch_sizes,
@@ -288,6 +884,34 @@ std::optional<std::array<int, 3>> try_select_max_batch_sizes(
     }
     return batch_sizes[idx];
 }
+
+std::vector<int> candidate_chunk_sizes(int stride, int overlap) {
+    constexpr std::array<int, 6> kChunkSizes{4000, 6000, 8000, 10000, 12000, 16000};
+    std::vector<int> candidates;
+    for (const int chunk_size : kChunkSizes) {
+        const int aligned = chunk_size / stride * stride;
+        if (aligned >= 2 * overlap) {
+            candidates.push_back(aligned);
+        }
+    }
+    if (candidates.empty()) {
+        candidates.push_back(pad_to(2 * overlap, stride));
+    }
+    return candidates;
+}
+
+GpuChunkChoice select_chunk_size(const std::vector<ChunkSizeTiming> &timings, int overlap) {
+    GpuChunkChoice best{timings.front().chunk_size, timings.front().batch_size};
+    double best_rate = 0;
+    for (const auto &timing : timings) {
+        const double rate = (timing.chunk_size - overlap) / double(timing.time_per_chunk_ms);
+        if (rate > best_rate) {
+            best_rate = rate;
+            best = {timing.chunk_size, timing.batch_size};
+        }
+    }
+    return best;
+}
 }  // namespace details
 
 }  // namespace dorado::utils
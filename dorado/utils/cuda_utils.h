@@ -25,12 +25,53 @@ std::vector<std::string> parse_cuda_device_string(std::string device_string);
 
 // Reports the amount of available memory (in bytes) for a given device.
 size_t available_memory(torch::Device device);
+
+// Cap (in bytes) on the memory this process uses on each GPU, set by the dorado_gpu_memory_limit
+// environment variable (e.g. "12G"), or 0 if there is none.  Unlike a fraction of the memory
+// available, a cap doesn't depend on what co-scheduled processes have allocated so far.
+size_t gpu_memory_limit();
+
+// Whether the device is a MIG instance, whose memory is a fixed slice of the GPU's.
+bool is_mig_device(torch::Device device);
+
+// Memory (in bytes) this process budgets for memory_limit_fraction of on the device.  With a
+// gpu_memory_limit this is the fraction of what remains of the limit, clamped to the device's
+// (or MIG instance's) total memory, after what this process already holds.  Otherwise it is
+// the fraction of the memory available now.
+size_t gpu_memory_budget(torch::Device device, float memory_limit_fraction);
+
+// Makes the torch allocator enforce any gpu_memory_limit on the device, so allocations beyond
+// it fail in this process rather than taking memory other processes budgeted for.
+void apply_gpu_memory_limit(torch::Device device);
+
+// NUMA node local to the GPU with the given index, from its PCIe location, or -1 if unknown.
+int cuda_device_numa_node(int device_index);
 int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
                         const dorado::CRFModelConfig &model_config,
                         const torch::TensorOptions &options,
                         int batch_size_granularity,
                         float memory_limit_fraction);
 
+// A chunk size, in samples, and the batch size to call it with.
+struct GpuChunkChoice {
+    int chunk_size;
+    int batch_size;
+};
+
+// Times the model on a few chunk sizes, each a multiple of the model stride and at least twice
+// overlap so that most of each chunk is signal no other chunk calls, and picks the one calling
+// the most new samples per second.  Chunks overlap by the same amount whichever is picked, so
+// stitching is as accurate as with the default chunk size.  If batch_size is 0 the best batch
+// size is found for each chunk size as in auto_gpu_batch_size, otherwise only batch_size is
+// timed.  The result is cached alongside auto batch sizes.
+GpuChunkChoice auto_gpu_chunk_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                                   const dorado::CRFModelConfig &model_config,
+                                   const torch::TensorOptions &options,
+                                   int batch_size_granularity,
+                                   float memory_limit_fraction,
+                                   int overlap,
+                                   int batch_size);
+
 void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 
 // Deal with a result from a cudaGetLastError call.  May raise an exception to provide information to the user.
@@ -43,8 +84,27 @@ std::optional<std::array<int, 3>> try_select_max_batch_sizes(
         std::vector<std::array<int, 3>> const &batch_sizes,
         int available_memory_gb);
 
+// Parses a gpu_memory_limit, in bytes with an optional K, M or G suffix.  Returns 0 if there is
+// none, and throws if it can't be parsed.
+size_t parse_gpu_memory_limit(const char *limit);
+
+// The chunk sizes auto_gpu_chunk_size times for a model with the given stride.
+std::vector<int> candidate_chunk_sizes(int stride, int overlap);
+
+struct ChunkSizeTiming {
+    int chunk_size;
+    int batch_size;
+    float time_per_chunk_ms;
+};
+
+// The timed chunk size calling the most samples beyond the overlap per ms.
+GpuChunkChoice select_chunk_size(const std::vector<ChunkSizeTiming> &timings, int overlap);
+
 void matmul_f16_cublas(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 void matmul_f16_torch(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
+// Through cuBLASLt, with the fastest algorithm for the shape, timed the first time it's seen.
+// Not available on TX2.
+void matmul_f16_cublaslt(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 
 }  //  namespace details
 
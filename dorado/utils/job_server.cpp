@@ -0,0 +1,78 @@
+#include "job_server.h"
+
+// Must match dorado/utils/models.cpp, which includes httplib in the same library.
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+
+#include <exception>
+#include <stdexcept>
+
+namespace dorado::utils {
+
+JobServer::JobServer(int port, const std::string& host, JobHandler handler)
+        : m_server(std::make_unique<httplib::Server>()), m_handler(std::move(handler)) {
+    m_server->Post("/basecall", [this](const httplib::Request& request,
+                                       httplib::Response& response) {
+        if (!request.has_param("data") || !request.has_param("output")) {
+            response.status = 400;
+            response.set_content("Both data and output must be given\n", "text/plain");
+            return;
+        }
+        BasecallJob job;
+        job.data_path = request.get_param_value("data");
+        job.output_path = request.get_param_value("output");
+        if (request.has_param("format")) {
+            job.output_format = request.get_param_value("format");
+        }
+        job.recursive = request.has_param("recursive") &&
+                        request.get_param_value("recursive") != "0";
+        if (request.has_param("weight")) {
+            const auto& weight = request.get_param_value("weight");
+            if (weight.empty() || weight.find_first_not_of("0123456789") != std::string::npos ||
+                weight.size() > 6 || std::stoul(weight) == 0) {
+                response.status = 400;
+                response.set_content("weight must be a positive integer\n", "text/plain");
+                return;
+            }
+            job.weight = std::stoul(weight);
+        }
+
+        try {
+            response.set_content(m_handler(job) + "\n", "text/plain");
+        } catch (const std::exception& e) {
+            spdlog::error("Job for {} failed: {}", job.data_path, e.what());
+            response.status = 400;
+            response.set_content(std::string(e.what()) + "\n", "text/plain");
+        }
+    });
+    m_server->Post("/shutdown", [this](const httplib::Request&, httplib::Response& response) {
+        {
+            std::lock_guard lock(m_shutdown_mutex);
+            m_shutdown_requested = true;
+        }
+        m_shutdown_cv.notify_all();
+        response.set_content("Shutting down\n", "text/plain");
+    });
+
+    if (!m_server->bind_to_port(host.c_str(), port)) {
+        throw std::runtime_error("Unable to serve jobs on " + host + ":" + std::to_string(port));
+    }
+    m_server_thread = std::thread([this] { m_server->listen_after_bind(); });
+    spdlog::info("> Accepting jobs at http://{}:{}/basecall", host, port);
+}
+
+JobServer::~JobServer() {
+    // Stopping the server waits for the handlers of in-flight requests to return.
+    m_server->stop();
+    if (m_server_thread.joinable()) {
+        m_server_thread.join();
+    }
+}
+
+void JobServer::wait_for_shutdown() {
+    std::unique_lock lock(m_shutdown_mutex);
+    m_shutdown_cv.wait(lock, [this] { return m_shutdown_requested; });
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace httplib {
+class Server;
+}
+
+namespace dorado::utils {
+
+// A basecalling job submitted to `dorado serve`.
+struct BasecallJob {
+    std::string data_path;
+    std::string output_path;
+    // One of "bam", "sam", "fastq" or "fastq.gz".
+    std::string output_format{"bam"};
+    bool recursive{false};
+    // If end_batch is set, data_path is a POD5 file and only batches [first_batch, end_batch)
+    // of it are called, as for a work unit of a distributed run.
+    size_t first_batch{0};
+    size_t end_batch{0};
+    // Chunks of the job's reads basecalled for each chunk of another job's, while both have
+    // reads waiting to be called.
+    size_t weight{1};
+};
+
+// Accepts basecalling jobs over HTTP, so that a resident process can call data for many
+// clients without each of them loading the models again.
+//   POST /basecall?data=<path>&output=<path>[&format=bam|sam|fastq|fastq.gz][&recursive=1]
+//                 [&weight=<n>]
+//       runs the job to completion, and responds with the handler's summary, or status 400
+//       and the error if the handler throws.
+//   POST /shutdown
+//       stops the server once in-flight jobs have finished.
+// Jobs are run on the server's worker threads, so several can be in flight at once.
+class JobServer {
+public:
+    // Returns a summary of the completed job, or throws if the job fails.
+    using JobHandler = std::function<std::string(const BasecallJob&)>;
+
+    // Throws if the port cannot be bound.
+    JobServer(int port, const std::string& host, JobHandler handler);
+    ~JobServer();
+
+    // Blocks until a client requests shutdown.
+    void wait_for_shutdown();
+
+private:
+    std::unique_ptr<httplib::Server> m_server;
+    std::thread m_server_thread;
+    JobHandler m_handler;
+    std::mutex m_shutdown_mutex;
+    std::condition_variable m_shutdown_cv;
+    bool m_shutdown_requested{false};
+};
+
+}  // namespace dorado::utils
@@ -1,3 +1,6 @@
+#include "log_utils.h"
+
+#include "spdlog/async.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 #include "utils/cli_utils.h"
@@ -8,6 +11,8 @@
 #endif
 
 #include <array>
+#include <cstdlib>
+#include <mutex>
 #include <string>
 
 namespace dorado::utils {
@@ -70,8 +75,25 @@ void InitLogging() {
     }
 }
 
+void EnableAsyncLogging(size_t queue_size) {
+    static std::once_flag async_logging_enabled;
+    std::call_once(async_logging_enabled, [queue_size] {
+        const auto level = spdlog::default_logger_raw()->level();
+        spdlog::init_thread_pool(queue_size, 1);
+        auto logger = spdlog::create_async_nb<spdlog::sinks::stderr_color_sink_mt>("async");
+        logger->set_level(level);
+        // Errors are written as soon as they're dequeued, everything else at least once a second.
+        logger->flush_on(spdlog::level::err);
+        spdlog::set_default_logger(std::move(logger));
+        spdlog::flush_every(std::chrono::seconds(1));
+        // Write out whatever is still queued when the process exits.
+        std::atexit([] { spdlog::shutdown(); });
+    });
+}
+
 void SetDebugLogging() {
     if (is_safe_to_log()) {
+        EnableAsyncLogging();
         spdlog::set_level(spdlog::level::debug);
     }
 }
@@ -1,10 +1,68 @@
 #pragma once
 
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
 namespace dorado::utils {
 
 // Initialises the default logger to point to stderr.
 void InitLogging();
 
+// Replaces the default logger with one which formats and writes messages on its own thread, so
+// logging threads only queue them.  When the queue of queue_size messages is full the oldest are
+// dropped rather than the logging thread waiting.
+void EnableAsyncLogging(size_t queue_size = 8192);
+
+// Enables debug logging, asynchronously so that it doesn't slow the pipeline's threads.
 void SetDebugLogging();
 
+// Lets through at most one message per interval, counting those it holds back.
+class LogRateLimiter {
+public:
+    explicit LogRateLimiter(std::chrono::milliseconds interval) : m_interval(interval.count()) {}
+
+    // Returns the number of messages suppressed since the last one let through, or nothing if
+    // this message should be suppressed.
+    std::optional<size_t> acquire() {
+        const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now().time_since_epoch())
+                                    .count();
+        int64_t last = m_last_ms.load(std::memory_order_relaxed);
+        if ((last == kNever || now - last >= m_interval) &&
+            m_last_ms.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            return m_suppressed.exchange(0, std::memory_order_relaxed);
+        }
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+private:
+    static constexpr int64_t kNever = INT64_MIN;
+    const int64_t m_interval;
+    std::atomic<int64_t> m_last_ms{kNever};
+    std::atomic<size_t> m_suppressed{0};
+};
+
 }  // namespace dorado::utils
+
+// Logs at most one message per interval_ms from this call site, for logging on hot paths.  The
+// arguments aren't evaluated at all if the level is disabled.
+#define DORADO_LOG_EVERY_MS(level, interval_ms, ...)                                            \
+    do {                                                                                        \
+        if (spdlog::default_logger_raw()->should_log(level)) {                                  \
+            static ::dorado::utils::LogRateLimiter dorado_log_limiter{                          \
+                    std::chrono::milliseconds(interval_ms)};                                    \
+            if (const auto dorado_log_suppressed = dorado_log_limiter.acquire()) {              \
+                spdlog::log(level, __VA_ARGS__);                                                \
+                if (*dorado_log_suppressed > 0) {                                               \
+                    spdlog::log(level, "({} similar messages suppressed)",                      \
+                                *dorado_log_suppressed);                                        \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    } while (false)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+namespace dorado::utils {
+
+// The process's resident set size now, and the most it has been, in bytes.  Both are 0 where
+// the platform doesn't report them.
+size_t current_rss_bytes();
+size_t peak_rss_bytes();
+
+}  // namespace dorado::utils
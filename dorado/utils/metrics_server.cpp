@@ -0,0 +1,85 @@
+#include "metrics_server.h"
+
+// Must match dorado/utils/models.cpp, which includes httplib in the same library.
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Metric names may only contain [a-zA-Z0-9_:], and must not start with a digit.
+std::string metric_name(const std::string& stat_name) {
+    std::string name = "dorado_" + stat_name;
+    for (auto& c : name) {
+        const bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                           (c >= '0' && c <= '9') || c == '_' || c == ':';
+        if (!valid) {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+}  // namespace
+
+namespace dorado::stats {
+
+std::string format_open_metrics(const NamedStats& stats) {
+    // Sort by name so scrapes are stable.
+    std::map<std::string, double> metrics;
+    for (const auto& [name, value] : stats) {
+        metrics[metric_name(name)] = value;
+    }
+
+    std::ostringstream out;
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (const auto& [name, value] : metrics) {
+        out << "# TYPE " << name << " gauge\n";
+        out << name << " " << value << "\n";
+    }
+    out << "# EOF\n";
+    return out.str();
+}
+
+MetricsServer::MetricsServer(int port, const std::string& host)
+        : m_server(std::make_unique<httplib::Server>()) {
+    m_server->Get("/metrics", [this](const httplib::Request&, httplib::Response& response) {
+        std::string body;
+        {
+            std::lock_guard lock(m_stats_mutex);
+            body = format_open_metrics(m_latest_stats);
+        }
+        response.set_content(body, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+    });
+
+    if (!m_server->bind_to_port(host.c_str(), port)) {
+        throw std::runtime_error("Unable to serve metrics on " + host + ":" +
+                                 std::to_string(port));
+    }
+    m_server_thread = std::thread([this] { m_server->listen_after_bind(); });
+    spdlog::info("> Serving metrics at http://{}:{}/metrics", host, port);
+}
+
+MetricsServer::~MetricsServer() {
+    m_server->stop();
+    if (m_server_thread.joinable()) {
+        m_server_thread.join();
+    }
+}
+
+StatsCallable MetricsServer::get_stats_callable() {
+    return [this](const NamedStats& stats) { update(stats); };
+}
+
+void MetricsServer::update(const NamedStats& stats) {
+    std::lock_guard lock(m_stats_mutex);
+    m_latest_stats = stats;
+}
+
+}  // namespace dorado::stats
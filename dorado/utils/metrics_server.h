@@ -0,0 +1,42 @@
+#pragma once
+
+#include "stats.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace httplib {
+class Server;
+}
+
+namespace dorado::stats {
+
+// Formats stats in the OpenMetrics text exposition format, one gauge per stat.
+// Stat names such as "BasecallerNode.queue.items" become "dorado_BasecallerNode_queue_items".
+std::string format_open_metrics(const NamedStats& stats);
+
+// Serves the most recent stats sample over HTTP, at /metrics in OpenMetrics format, so
+// that stats can be scraped while a job is running.
+// Stats are fed in by a StatsSampler via the callable returned from get_stats_callable().
+class MetricsServer {
+public:
+    // Throws if the port cannot be bound.  Only local clients can connect unless host is
+    // another interface's address, or "0.0.0.0" for all of them.
+    MetricsServer(int port, const std::string& host = "127.0.0.1");
+    ~MetricsServer();
+
+    // The returned callable must not outlive this object.
+    StatsCallable get_stats_callable();
+
+private:
+    void update(const NamedStats& stats);
+
+    std::unique_ptr<httplib::Server> m_server;
+    std::thread m_server_thread;
+    std::mutex m_stats_mutex;
+    NamedStats m_latest_stats;
+};
+
+}  // namespace dorado::stats
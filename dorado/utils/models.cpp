@@ -2,14 +2,193 @@
 
 #include <elzip/elzip.hpp>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 #include <spdlog/spdlog.h>
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Models fetched at once.  The CDN, rather than one connection, is the limit beyond this.
+constexpr size_t kMaxConcurrentDownloads = 4;
+// Attempts at each download, each resuming from where the previous one stopped.
+constexpr int kMaxDownloadAttempts = 3;
+
+int proxy_port() {
+    const char* ps = getenv("dorado_proxy_port");
+    return ps ? atoi(ps) : 3128;
+}
+
+std::unique_ptr<httplib::Client> make_client() {
+    auto http = std::make_unique<httplib::Client>(dorado::urls::URL_ROOT);
+    http->enable_server_certificate_verification(false);
+    http->set_follow_location(true);
+    if (const char* proxy_url = getenv("dorado_proxy")) {
+        http->set_proxy(proxy_url, proxy_port());
+    }
+    return http;
+}
+
+// Holds an exclusive lock on a file beside a model for its lifetime, so that processes sharing
+// a models directory, such as jobs on one host using a common cache of models, download each
+// model only once.  The lock files are left in place, as removing them would race with others
+// waiting on them.
+class ModelLock {
+public:
+    explicit ModelLock(const fs::path& path) {
+#ifndef _WIN32
+        m_fd = ::open(path.string().c_str(), O_RDWR | O_CREAT, 0666);
+        if (m_fd >= 0 && flock(m_fd, LOCK_EX) != 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        if (m_fd < 0) {
+            spdlog::debug("Failed to lock {}, downloading regardless", path.string());
+        }
+#endif
+    }
+    ~ModelLock() {
+#ifndef _WIN32
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+    ModelLock(const ModelLock&) = delete;
+    ModelLock& operator=(const ModelLock&) = delete;
+
+private:
+    int m_fd = -1;
+};
+
+// The total size of the file being transferred, from a 200 response's Content-Length or a
+// 206 response's Content-Range, or 0 if the server didn't say.
+uint64_t total_size(const httplib::Response& response) {
+    if (response.status == 206) {
+        const auto range = response.get_header_value("Content-Range");
+        const auto slash = range.rfind('/');
+        if (slash != std::string::npos && range.compare(slash + 1, 1, "*") != 0) {
+            return std::strtoull(range.c_str() + slash + 1, nullptr, 10);
+        }
+        return 0;
+    }
+    const auto length = response.get_header_value("Content-Length");
+    return length.empty() ? 0 : std::strtoull(length.c_str(), nullptr, 10);
+}
+
+// Fetches model's archive into partial_path, resuming from any part of it already there.
+// Returns whether the whole archive has been fetched.
+bool fetch_archive(httplib::Client& http, const std::string& url, const fs::path& partial_path) {
+    for (int attempt = 0; attempt < kMaxDownloadAttempts; ++attempt) {
+        const uint64_t offset = fs::exists(partial_path) ? fs::file_size(partial_path) : 0;
+        httplib::Headers headers;
+        if (offset > 0) {
+            headers.emplace("Range", "bytes=" + std::to_string(offset) + "-");
+        }
+
+        std::ofstream out;
+        uint64_t expected_size = 0;
+        int status = 0;
+        auto res = http.Get(
+                url.c_str(), headers,
+                [&](const httplib::Response& response) {
+                    status = response.status;
+                    if (response.status == 206) {
+                        out.open(partial_path, std::ofstream::binary | std::ofstream::app);
+                    } else if (response.status == 200) {
+                        // The server ignored the range, so start again.
+                        out.open(partial_path, std::ofstream::binary | std::ofstream::trunc);
+                    } else {
+                        return false;
+                    }
+                    expected_size = total_size(response);
+                    return out.is_open();
+                },
+                [&](const char* data, size_t length) {
+                    out.write(data, length);
+                    return bool(out);
+                });
+        out.close();
+
+        if (status == 416) {
+            // The partial file isn't a prefix of the archive, so it's discarded.
+            fs::remove(partial_path);
+            continue;
+        }
+        if (status != 0 && status != 200 && status != 206) {
+            // Retrying won't turn a missing model into one which is there.
+            spdlog::debug("Download of {} failed with HTTP status {}", url, status);
+            return false;
+        }
+        if (res == nullptr) {
+            // A dropped connection leaves what was received for the next attempt to resume.
+            spdlog::debug("Download of {} interrupted, attempt {} of {}", url, attempt + 1,
+                          kMaxDownloadAttempts);
+            continue;
+        }
+        const uint64_t size = fs::exists(partial_path) ? fs::file_size(partial_path) : 0;
+        if (expected_size != 0 && size != expected_size) {
+            spdlog::debug("Download of {} has {} of {} bytes", url, size, expected_size);
+            continue;
+        }
+        return size > 0;
+    }
+    return false;
+}
+
+// Downloads and extracts model into directory, unless it is there already.  The extracted
+// model is checked for its config, and removed again if the archive was bad, so that a failed
+// download never leaves a model which looks usable.
+bool download_model(const fs::path& directory, const std::string& model) {
+    ModelLock lock(directory / ("." + model + ".lock"));
+    const auto model_dir = directory / model;
+    if (fs::exists(model_dir / "config.toml")) {
+        spdlog::info(" - {} already downloaded", model);
+        return true;
+    }
+
+    spdlog::info(" - downloading {}", model);
+    const auto url = dorado::urls::URL_ROOT + dorado::urls::URL_PATH + model + ".zip";
+    const fs::path partial_path(directory / (model + ".zip.part"));
+    auto http = make_client();
+    if (!fetch_archive(*http, url, partial_path)) {
+        return false;
+    }
+
+    const fs::path archive(directory / (model + ".zip"));
+    fs::rename(partial_path, archive);
+    bool extracted = false;
+    try {
+        elz::extractZip(archive, directory);
+        extracted = fs::exists(model_dir / "config.toml");
+    } catch (const std::exception& e) {
+        spdlog::debug("Failed to extract {}: {}", archive.string(), e.what());
+    }
+    fs::remove(archive);
+    if (!extracted) {
+        std::error_code error;
+        fs::remove_all(model_dir, error);
+    }
+    return extracted;
+}
+
+}  // namespace
+
 namespace dorado::utils {
 
 bool is_valid_model(const std::string& selected_model) {
@@ -25,46 +204,40 @@ bool is_valid_model(const std::string& selected_model) {
 void download_models(const std::string& target_directory, const std::string& selected_model) {
     fs::path directory(target_directory);
 
-    httplib::Client http(urls::URL_ROOT);
-    http.enable_server_certificate_verification(false);
-    http.set_follow_location(true);
-
-    const char* proxy_url = getenv("dorado_proxy");
-    const char* ps = getenv("dorado_proxy_port");
-
-    int proxy_port = 3128;
-    if (ps) {
-        proxy_port = atoi(ps);
+    std::vector<std::string> selected;
+    for (const auto* model_set : {&simplex::models, &stereo::models, &modified::models}) {
+        for (const auto& model : *model_set) {
+            if (selected_model == "all" || selected_model == model) {
+                selected.push_back(model);
+            }
+        }
+    }
+    if (selected.empty()) {
+        return;
     }
 
-    if (proxy_url) {
-        spdlog::info("using proxy: {}:{}", proxy_url, proxy_port);
-        http.set_proxy(proxy_url, proxy_port);
+    if (const char* proxy_url = getenv("dorado_proxy")) {
+        spdlog::info("using proxy: {}:{}", proxy_url, proxy_port());
     }
 
-    auto download_model_set = [&](std::vector<std::string> models) {
-        for (const auto& model : models) {
-            if (selected_model == "all" || selected_model == model) {
-                auto url = urls::URL_ROOT + urls::URL_PATH + model + ".zip";
-                spdlog::info(" - downloading {}", model);
-                auto res = http.Get(url.c_str());
-                if (res != nullptr) {
-                    fs::path archive(directory / (model + ".zip"));
-                    std::ofstream ofs(archive.string(), std::ofstream::binary);
-                    ofs << res->body;
-                    ofs.close();
-                    elz::extractZip(archive, directory);
-                    fs::remove(archive);
-                } else {
-                    spdlog::error("Failed to download {}", model);
-                }
+    // Each thread takes the next model to download, with a client of its own.
+    std::atomic<size_t> next_model{0};
+    auto download_thread = [&] {
+        for (size_t i = next_model++; i < selected.size(); i = next_model++) {
+            if (!download_model(directory, selected[i])) {
+                spdlog::error("Failed to download {}", selected[i]);
             }
         }
     };
-
-    download_model_set(simplex::models);
-    download_model_set(stereo::models);
-    download_model_set(modified::models);
+    const size_t num_threads = std::min(selected.size(), kMaxConcurrentDownloads);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(download_thread);
+    }
+    download_thread();
+    for (auto& thread : threads) {
+        thread.join();
+    }
 }
 
 bool is_rna_model(const std::filesystem::path& model) {
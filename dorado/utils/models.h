@@ -144,6 +144,9 @@ static const std::unordered_map<std::string, uint16_t> sample_rate_by_model = {
 
 bool is_rna_model(const std::filesystem::path& model);
 bool is_valid_model(const std::string& selected_model);
+// Downloads the selected model, or every model for "all", into target_directory, several at a
+// time.  Interrupted transfers are resumed, and models already in the directory are skipped, so
+// a directory can be shared between concurrent jobs, which lock each model while fetching it.
 void download_models(const std::string& target_directory, const std::string& selected_model);
 
 // finds the matching modification model for a given modification i.e. 5mCG and a simplex model
@@ -0,0 +1,58 @@
+#include "module_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+struct SharedModuleEntry {
+    std::mutex mutex;
+    std::weak_ptr<torch::nn::AnyModule> module;
+};
+
+}  // namespace
+
+namespace dorado::utils {
+
+SharedModule load_shared_module(const std::string& key, const std::function<SharedModule()>& load) {
+    static std::mutex entries_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<SharedModuleEntry>> entries;
+
+    // The map is only locked to find the entry, so that loads of different models, such as
+    // the same model onto different devices, run in parallel.
+    std::shared_ptr<SharedModuleEntry> entry;
+    {
+        std::lock_guard lock(entries_mutex);
+        auto& slot = entries[key];
+        if (!slot) {
+            slot = std::make_shared<SharedModuleEntry>();
+        }
+        entry = slot;
+    }
+
+    std::lock_guard lock(entry->mutex);
+    if (auto module = entry->module.lock()) {
+        spdlog::debug("- sharing the loaded weights of {}", key);
+        return SharedModule(std::move(module));
+    }
+    auto holder = load();
+    entry->module = holder.ptr();
+    return holder;
+}
+
+std::string shared_module_key(const std::string& model_kind,
+                              const std::filesystem::path& model_path,
+                              const torch::TensorOptions& options) {
+    std::error_code error;
+    auto path = std::filesystem::weakly_canonical(model_path, error);
+    if (error) {
+        path = model_path;
+    }
+    return model_kind + " " + path.string() + " on " + options.device().str() + " as " +
+           c10::toString(options.dtype().toScalarType());
+}
+
+}  // namespace dorado::utils
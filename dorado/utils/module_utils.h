@@ -2,6 +2,9 @@
 
 #include <torch/torch.h>
 
+#include <filesystem>
+#include <functional>
+#include <string>
 #include <vector>
 
 namespace dorado::utils {
@@ -20,4 +23,18 @@ inline void load_state_dict(torch::nn::Module& module,
     }
 }
 
+using SharedModule = torch::nn::ModuleHolder<torch::nn::AnyModule>;
+
+// Returns the module loaded for key if any holder of it remains, otherwise calls load and keeps
+// track of the result.  Every model load goes through this, keyed by the model and the device
+// and dtype its weights are on, so a device holds one copy of each model's weights however many
+// runners and pipelines use it.  Modules are only used for inference, which doesn't change them,
+// so they can be shared between threads.  Concurrent loads of the same key wait for the first.
+SharedModule load_shared_module(const std::string& key, const std::function<SharedModule()>& load);
+
+// The key for a model's weights loaded at options.
+std::string shared_module_key(const std::string& model_kind,
+                              const std::filesystem::path& model_path,
+                              const torch::TensorOptions& options);
+
 }  // namespace dorado::utils
@@ -0,0 +1,160 @@
+#include "numa_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+const std::string kNodeDir = "/sys/devices/system/node/";
+
+// The CPUs listed for the node in sysfs, or none if it doesn't exist.
+std::vector<int> numa_node_cpus(int numa_node) {
+    std::ifstream cpulist_file(kNodeDir + "node" + std::to_string(numa_node) + "/cpulist");
+    std::string cpu_list;
+    std::getline(cpulist_file, cpu_list);
+    return dorado::utils::parse_cpu_list(cpu_list);
+}
+
+std::vector<int> current_thread_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpu_set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+bool set_current_thread_cpus(const std::vector<int>& cpus) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (const int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+// The CPUs the process may use, as found by the first thread to ask, before any binding.
+const std::vector<int>& allowed_cpus() {
+    static const std::vector<int> cpus = current_thread_cpus();
+    return cpus;
+}
+#endif
+
+}  // namespace
+
+namespace dorado::utils {
+
+std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(cpu_list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(),
+                                   [](unsigned char c) { return std::isspace(c); }),
+                    range.end());
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            const auto dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last =
+                    dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception&) {
+            spdlog::debug("Ignoring malformed CPU range '{}'", range);
+        }
+    }
+    return cpus;
+}
+
+int num_numa_nodes() {
+#ifdef __linux__
+    int num_nodes = 0;
+    while (!numa_node_cpus(num_nodes).empty()) {
+        ++num_nodes;
+    }
+    return num_nodes;
+#else
+    return 0;
+#endif
+}
+
+int pci_device_numa_node(const std::string& pci_bus_id) {
+#ifdef __linux__
+    // sysfs names devices in lower case, which CUDA doesn't.
+    std::string device = pci_bus_id;
+    std::transform(device.begin(), device.end(), device.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    std::ifstream numa_node_file("/sys/bus/pci/devices/" + device + "/numa_node");
+    int numa_node = -1;
+    if (!(numa_node_file >> numa_node)) {
+        return -1;
+    }
+    return numa_node;
+#else
+    return -1;
+#endif
+}
+
+bool bind_thread_to_numa_node(int numa_node) {
+#ifdef __linux__
+    if (numa_node < 0) {
+        return false;
+    }
+    // Only use the node's CPUs that we're allowed to, e.g. within a container's cpuset.
+    const auto& allowed = allowed_cpus();
+    std::vector<int> cpus;
+    for (const int cpu : numa_node_cpus(numa_node)) {
+        if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty() || !set_current_thread_cpus(cpus)) {
+        spdlog::debug("Unable to bind thread to NUMA node {}", numa_node);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+ScopedNumaBinding::ScopedNumaBinding(int numa_node) {
+#ifdef __linux__
+    auto previous_cpus = current_thread_cpus();
+    if (bind_thread_to_numa_node(numa_node)) {
+        m_previous_cpus = std::move(previous_cpus);
+    }
+#endif
+}
+
+ScopedNumaBinding::~ScopedNumaBinding() {
+#ifdef __linux__
+    if (!m_previous_cpus.empty()) {
+        set_current_thread_cpus(m_previous_cpus);
+    }
+#endif
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+// Helpers for keeping threads and the memory they first touch on the NUMA node local to the
+// device they feed.  Topology is read from sysfs, so on other platforms, or where it isn't
+// available, every node is reported as unknown (-1) and binding does nothing.
+
+// Parses a Linux CPU list such as "0-3,8,10-11" into the CPU indices it names.
+std::vector<int> parse_cpu_list(const std::string& cpu_list);
+
+// Number of NUMA nodes with CPUs, or 0 if the topology isn't known.
+int num_numa_nodes();
+
+// NUMA node of the PCI device with the given bus ID, such as "0000:3b:00.0", or -1 if unknown.
+int pci_device_numa_node(const std::string& pci_bus_id);
+
+// Restricts the calling thread to the CPUs of the NUMA node which it is allowed to use.
+// Returns false, leaving the thread unrestricted, if the node is -1 or can't be used.
+bool bind_thread_to_numa_node(int numa_node);
+
+// Binds the calling thread to a NUMA node for the binding's scope, for example so that
+// buffers allocated in it are placed on that node, and then restores its previous CPUs.
+class ScopedNumaBinding {
+public:
+    explicit ScopedNumaBinding(int numa_node);
+    ~ScopedNumaBinding();
+    ScopedNumaBinding(const ScopedNumaBinding&) = delete;
+    ScopedNumaBinding& operator=(const ScopedNumaBinding&) = delete;
+
+private:
+    // The thread's CPUs before binding, or empty if it wasn't bound.
+    std::vector<int> m_previous_cpus;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,228 @@
+#include "packed_weights.h"
+
+#include <spdlog/spdlog.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// A packed weights file is a header listing each tensor, followed by the tensors' data, each
+// starting at a multiple of kDataAlignment bytes into the file.  Values are in host byte
+// order, as torch::save writes them.
+//   char[8]  kMagic
+//   uint32   number of tensors
+//   then for each tensor:
+//   uint32   name length, followed by the name
+//   int32    c10::ScalarType
+//   uint32   number of dimensions, followed by an int64 size for each
+//   uint64   offset of the data from the start of the file
+//   uint64   number of bytes of data
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'R', 'D', 'P', 'A', 'C', 'K', '1'};
+constexpr uint64_t kDataAlignment = 64;
+
+template <typename T>
+void write_value(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads values from the header, checking that they are all within the file.
+class HeaderReader {
+public:
+    HeaderReader(const std::byte* data, size_t size, const std::filesystem::path& path)
+            : m_data(data), m_size(size), m_path(path) {}
+
+    template <typename T>
+    T read() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string read_string(size_t length) {
+        return std::string(reinterpret_cast<const char*>(take(length)), length);
+    }
+
+private:
+    const std::byte* take(size_t num_bytes) {
+        if (num_bytes > m_size - m_pos) {
+            throw std::runtime_error("Truncated packed weights file " + m_path.string());
+        }
+        const auto* ptr = m_data + m_pos;
+        m_pos += num_bytes;
+        return ptr;
+    }
+
+    const std::byte* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    const std::filesystem::path& m_path;
+};
+
+}  // namespace
+
+namespace dorado::utils {
+
+std::shared_ptr<const PackedWeights> PackedWeights::open(const std::filesystem::path& path) {
+    std::shared_ptr<PackedWeights> weights(new PackedWeights());
+    weights->m_self = weights;
+
+#ifndef _WIN32
+    const int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open packed weights file " + path.string());
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        weights->m_size = size_t(file_stat.st_size);
+        void* mapping = mmap(nullptr, weights->m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            weights->m_data = static_cast<std::byte*>(mapping);
+        }
+    }
+    ::close(fd);
+#endif
+    if (!weights->m_data) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Failed to open packed weights file " + path.string());
+        }
+        weights->m_buffer.resize(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(weights->m_buffer.data()), weights->m_buffer.size());
+        weights->m_data = weights->m_buffer.data();
+        weights->m_size = weights->m_buffer.size();
+    }
+
+    HeaderReader header(weights->m_data, weights->m_size, path);
+    if (header.read_string(sizeof(kMagic)) != std::string(kMagic, sizeof(kMagic))) {
+        throw std::runtime_error("Not a packed weights file: " + path.string());
+    }
+    const auto num_tensors = header.read<uint32_t>();
+    for (uint32_t i = 0; i < num_tensors; ++i) {
+        const auto name = header.read_string(header.read<uint32_t>());
+        Entry entry;
+        entry.dtype = static_cast<c10::ScalarType>(header.read<int32_t>());
+        entry.sizes.resize(header.read<uint32_t>());
+        for (auto& size : entry.sizes) {
+            size = header.read<int64_t>();
+        }
+        entry.offset = header.read<uint64_t>();
+        entry.num_bytes = header.read<uint64_t>();
+        if (entry.offset > weights->m_size || entry.num_bytes > weights->m_size - entry.offset) {
+            throw std::runtime_error("Tensor " + name + " lies outside packed weights file " +
+                                     path.string());
+        }
+        weights->m_entries.emplace(name, std::move(entry));
+    }
+    return weights;
+}
+
+PackedWeights::~PackedWeights() {
+#ifndef _WIN32
+    if (m_data && m_buffer.empty()) {
+        munmap(m_data, m_size);
+    }
+#endif
+}
+
+torch::Tensor PackedWeights::tensor(const std::string& name) const {
+    auto it = m_entries.find(name);
+    if (it == m_entries.end()) {
+        throw std::runtime_error("No tensor " + name + " in packed weights");
+    }
+    const auto& entry = it->second;
+    const auto options = torch::TensorOptions().dtype(entry.dtype);
+    uint64_t num_bytes = c10::elementSize(entry.dtype);
+    for (const auto size : entry.sizes) {
+        num_bytes *= uint64_t(size);
+    }
+    if (num_bytes != entry.num_bytes) {
+        throw std::runtime_error("Tensor " + name + " has the wrong size in packed weights");
+    }
+    return torch::from_blob(
+            m_data + entry.offset, entry.sizes, [self = m_self.lock()](void*) {}, options);
+}
+
+size_t pack_model_weights(const std::filesystem::path& model_dir) {
+    std::vector<std::string> names;
+    for (const auto& file : std::filesystem::directory_iterator(model_dir)) {
+        if (file.is_regular_file() && file.path().extension() == ".tensor") {
+            names.push_back(file.path().filename().string());
+        }
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<torch::Tensor> tensors;
+    for (const auto& name : names) {
+        std::vector<torch::Tensor> loaded;
+        torch::load(loaded, (model_dir / name).string());
+        if (loaded.size() != 1) {
+            throw std::runtime_error("Expected a single tensor in " + (model_dir / name).string());
+        }
+        tensors.push_back(loaded[0].to(torch::kCPU).contiguous());
+    }
+
+    // The header's size doesn't depend on the offsets, so it is sized first, then written.
+    size_t header_size = sizeof(kMagic) + sizeof(uint32_t);
+    for (size_t i = 0; i < names.size(); ++i) {
+        header_size += sizeof(uint32_t) + names[i].size() + sizeof(int32_t) + sizeof(uint32_t) +
+                       tensors[i].dim() * sizeof(int64_t) + 2 * sizeof(uint64_t);
+    }
+    auto align = [](uint64_t offset) {
+        return (offset + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+    };
+
+    std::string header(kMagic, sizeof(kMagic));
+    write_value(header, uint32_t(names.size()));
+    std::vector<uint64_t> offsets;
+    uint64_t offset = align(header_size);
+    for (size_t i = 0; i < names.size(); ++i) {
+        const uint64_t num_bytes = tensors[i].nbytes();
+        write_value(header, uint32_t(names[i].size()));
+        header += names[i];
+        write_value(header, int32_t(tensors[i].scalar_type()));
+        write_value(header, uint32_t(tensors[i].dim()));
+        for (const auto size : tensors[i].sizes()) {
+            write_value(header, int64_t(size));
+        }
+        write_value(header, offset);
+        write_value(header, num_bytes);
+        offsets.push_back(offset);
+        offset = align(offset + num_bytes);
+    }
+
+    // Written alongside and renamed into place, so a run loading the model never sees part of
+    // the file.
+    const auto path = model_dir / kPackedWeightsFile;
+    const auto temp_path = model_dir / (kPackedWeightsFile + ".tmp");
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(header.data(), header.size());
+        uint64_t pos = header.size();
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            const std::string padding(offsets[i] - pos, '\0');
+            out.write(padding.data(), padding.size());
+            out.write(static_cast<const char*>(tensors[i].data_ptr()), tensors[i].nbytes());
+            pos = offsets[i] + tensors[i].nbytes();
+        }
+        if (!out) {
+            throw std::runtime_error("Failed to write " + temp_path.string());
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+    spdlog::debug("Packed {} tensors into {}", names.size(), path.string());
+    return names.size();
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado::utils {
+
+// Name of the file in a model directory holding all of its weight tensors, as written by
+// pack_model_weights.  When present, load_tensors reads weights from it instead of from each
+// .tensor file.
+inline const std::string kPackedWeightsFile = "weights.dpk";
+
+// A packed weights file mapped into memory.  Tensors are views of the mapping, which stays
+// alive for as long as any of them do, so loading a model only touches the pages it uses and
+// nothing is copied until the weights are converted or moved to a device.
+class PackedWeights {
+public:
+    // Throws if the file can't be mapped or isn't a packed weights file.
+    static std::shared_ptr<const PackedWeights> open(const std::filesystem::path& path);
+
+    ~PackedWeights();
+    PackedWeights(const PackedWeights&) = delete;
+    PackedWeights& operator=(const PackedWeights&) = delete;
+
+    bool contains(const std::string& name) const { return m_entries.count(name) != 0; }
+    // The CPU tensor packed from the file called name.  Throws if there is none.  The mapping is
+    // private, so writes to the tensor are never seen by the file or other tensors.
+    torch::Tensor tensor(const std::string& name) const;
+
+private:
+    struct Entry {
+        c10::ScalarType dtype;
+        std::vector<int64_t> sizes;
+        uint64_t offset;
+        uint64_t num_bytes;
+    };
+
+    PackedWeights() = default;
+
+    std::byte* m_data = nullptr;
+    size_t m_size = 0;
+    // Where the file couldn't be mapped it is read into this instead.
+    std::vector<std::byte> m_buffer;
+    std::unordered_map<std::string, Entry> m_entries;
+    // For the tensor deleters, which keep the mapping alive.
+    std::weak_ptr<const PackedWeights> m_self;
+};
+
+// Packs every .tensor file in model_dir, each holding a single tensor saved with torch::save,
+// into model_dir / kPackedWeightsFile.  Returns the number of tensors packed.
+size_t pack_model_weights(const std::filesystem::path& model_dir);
+
+}  // namespace dorado::utils
@@ -29,10 +29,17 @@ struct DefaultParameters {
 
     // Minimum length for a sequence to be outputted.
     size_t min_seqeuence_length{5};
+    // Twice the fastest translocation speed, so that reads with fewer samples than this gives
+    // for the minimum sequence length certainly can't be long enough.
+    float max_bases_per_second{800.f};
 };
 
 static const DefaultParameters default_parameters{};
 
+// Threads for each stage of the pipeline.  Nodes which run on the shared CPU thread pool,
+// such as the scaler and read filter, take theirs as the most of the pool's threads they may
+// use at once rather than starting threads of their own, so these needn't add up to the
+// number of hardware threads.
 struct ThreadAllocations {
     ThreadAllocations(int num_devices, int num_remora_threads, int max_threads = 0) {
         max_threads = max_threads == 0 ? std::thread::hardware_concurrency() : max_threads;
@@ -25,8 +25,10 @@ std::shared_ptr<Read> shallow_copy_read(const Read& read) {
     copy->moves = read.moves;
     copy->run_id = read.run_id;
     copy->model_name = read.model_name;
+    copy->barcode = read.barcode;
 
     copy->base_mod_probs = read.base_mod_probs;
+    copy->base_mod_positions = read.base_mod_positions;
     copy->base_mod_info = read.base_mod_info;
 
     copy->num_trimmed_samples = read.num_trimmed_samples;
@@ -0,0 +1,226 @@
+#include "resume_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string kProgressFileTag = "dorado-progress";
+const std::string kJournalTag = "dorado-journal";
+
+}  // namespace
+
+namespace dorado::utils {
+
+ReadIDSet load_progress_file(const fs::path& path, const std::string& model_name) {
+    const std::string header = kProgressFileTag + '\t' + model_name;
+    if (!fs::exists(path)) {
+        std::ofstream file(path, std::ios::binary);
+        file << header << '\n';
+        if (!file) {
+            throw std::runtime_error("Failed to create progress file " + path.string());
+        }
+        return {};
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::string file_header;
+    if (!std::getline(file, file_header) || file_header.rfind(kProgressFileTag + '\t', 0) != 0) {
+        throw std::runtime_error(path.string() + " is not a dorado progress file");
+    }
+    if (file_header != header) {
+        throw std::runtime_error(
+                "Resume only works if the same model is used. Progress file model was " +
+                file_header.substr(kProgressFileTag.size() + 1) + " and current model is " +
+                model_name);
+    }
+    const auto ids_start = static_cast<uintmax_t>(file.tellg());
+
+    ReadIDSet read_ids;
+    ReadID read_id;
+    uintmax_t num_ids = 0;
+    while (file.read(reinterpret_cast<char*>(read_id.data()), read_id.size())) {
+        read_ids.insert(read_id);
+        ++num_ids;
+    }
+
+    // An interrupted run may have left part of an ID at the end, which has to go before more
+    // are appended.
+    const auto ids_end = ids_start + num_ids * read_id.size();
+    file.close();
+    if (fs::file_size(path) > ids_end) {
+        spdlog::debug("Removing partial read ID from progress file {}", path.string());
+        fs::resize_file(path, ids_end);
+    }
+    spdlog::info("> {} reads found in progress file.", read_ids.size());
+    return read_ids;
+}
+
+ProgressFileWriter::ProgressFileWriter(const fs::path& path)
+        : m_file(path, std::ios::binary | std::ios::app) {
+    if (!m_file) {
+        throw std::runtime_error("Failed to open progress file " + path.string());
+    }
+}
+
+void ProgressFileWriter::append(const std::vector<ReadID>& read_ids) {
+    m_file.write(reinterpret_cast<const char*>(read_ids.data()), read_ids.size() * sizeof(ReadID));
+    m_file.flush();
+    if (!m_file) {
+        throw std::runtime_error("Failed to write progress file");
+    }
+}
+
+ProgressJournal::ProgressJournal(const fs::path& path, const std::string& model_name)
+        : m_path(path) {
+    const std::string header = kJournalTag + '\t' + model_name;
+    std::string contents;
+    if (fs::exists(path)) {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+    }
+
+    // Entries are only complete once their newline is there, so anything after the last one
+    // was cut short by an interrupted run, and has to go before more are appended.
+    const auto entries_end = contents.rfind('\n');
+    if (!contents.empty()) {
+        std::istringstream entries(contents.substr(0, entries_end + 1));
+        std::string line;
+        if (entries_end == std::string::npos || !std::getline(entries, line) ||
+            line.rfind(kJournalTag + '\t', 0) != 0) {
+            throw std::runtime_error(path.string() + " is not a dorado progress journal");
+        }
+        if (line != header) {
+            throw std::runtime_error(
+                    "Resume only works if the same model is used. Progress journal model was " +
+                    line.substr(kJournalTag.size() + 1) + " and current model is " + model_name);
+        }
+        while (std::getline(entries, line)) {
+            std::istringstream fields(line);
+            std::string kind;
+            std::getline(fields, kind, '\t');
+            if (kind == "run") {
+                m_previous_output_size.reset();
+            } else if (kind == "batch") {
+                size_t batch = 0;
+                std::string pod5_path;
+                if (!(fields >> batch) || fields.get() != '\t' ||
+                    !std::getline(fields, pod5_path)) {
+                    throw std::runtime_error("Malformed entry in progress journal " +
+                                             path.string() + ": " + line);
+                }
+                m_complete.emplace(std::move(pod5_path), batch);
+            } else if (kind == "checkpoint") {
+                std::string size;
+                std::getline(fields, size);
+                m_previous_output_size.reset();
+                if (size != "-") {
+                    try {
+                        m_previous_output_size = std::stoull(size);
+                    } catch (const std::exception&) {
+                        throw std::runtime_error("Malformed entry in progress journal " +
+                                                 path.string() + ": " + line);
+                    }
+                }
+            } else {
+                throw std::runtime_error("Malformed entry in progress journal " + path.string() +
+                                         ": " + line);
+            }
+        }
+        if (entries_end + 1 < contents.size()) {
+            spdlog::debug("Removing partial entry from progress journal {}", path.string());
+            fs::resize_file(path, entries_end + 1);
+        }
+        spdlog::info("> {} batches found in progress journal.", m_complete.size());
+    }
+
+    m_file = std::fopen(path.string().c_str(), "ab");
+    if (!m_file) {
+        throw std::runtime_error("Failed to open progress journal " + path.string());
+    }
+    append((contents.empty() ? header + '\n' : std::string()) + "run\n");
+}
+
+ProgressJournal::~ProgressJournal() {
+    if (m_file) {
+        std::fclose(m_file);
+    }
+}
+
+bool ProgressJournal::is_complete(const std::string& pod5_path, size_t batch) const {
+    return m_complete.count({pod5_path, batch}) != 0;
+}
+
+void ProgressJournal::add_batch(const std::string& pod5_path, size_t batch, uint64_t end_order) {
+    std::lock_guard lock(m_pending_mutex);
+    m_pending.push_back({pod5_path, batch, end_order});
+}
+
+void ProgressJournal::checkpoint(uint64_t end_order, std::optional<uint64_t> output_size) {
+    std::string entries;
+    {
+        std::lock_guard lock(m_pending_mutex);
+        while (!m_pending.empty() && m_pending.front().end_order <= end_order) {
+            const auto& batch = m_pending.front();
+            entries += "batch\t" + std::to_string(batch.batch) + '\t' + batch.path + '\n';
+            m_pending.pop_front();
+        }
+    }
+    entries += "checkpoint\t" + (output_size ? std::to_string(*output_size) : "-") + '\n';
+    append(entries);
+}
+
+void ProgressJournal::append(const std::string& entries) {
+    bool ok = std::fwrite(entries.data(), 1, entries.size(), m_file) == entries.size() &&
+              std::fflush(m_file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(m_file)) == 0;
+#else
+    ok = ok && fsync(fileno(m_file)) == 0;
+#endif
+    if (!ok) {
+        throw std::runtime_error("Failed to write progress journal " + m_path.string());
+    }
+}
+
+std::optional<uint64_t> sync_output_file(const std::string& path) {
+#ifdef _WIN32
+    // Windows can't sync a file it didn't open, so the size is all that's known.
+    if (path == "-") {
+        return std::nullopt;
+    }
+    std::error_code error;
+    const auto size = fs::file_size(path, error);
+    return error ? std::nullopt : std::optional<uint64_t>(size);
+#else
+    const int fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    std::optional<uint64_t> size;
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && fsync(fd) == 0) {
+        size = static_cast<uint64_t>(file_stat.st_size);
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+    return size;
+#endif
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "uuid_utils.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// A progress file records the IDs of the reads whose records have been written, so that an
+// interrupted run can be resumed by basecalling only the remaining reads into a new output
+// file, rather than reading and copying the partial output as --resume-from does.
+// The file is a header line naming the model, followed by the 16 byte IDs.
+
+// Loads the IDs recorded in the progress file at path, creating the file if there isn't one.
+// Throws if the file was written by a run with a different model.
+ReadIDSet load_progress_file(const std::filesystem::path& path, const std::string& model_name);
+
+// Appends IDs to a progress file created by load_progress_file.
+class ProgressFileWriter {
+public:
+    explicit ProgressFileWriter(const std::filesystem::path& path);
+    // Writes the IDs and flushes them to the file.
+    void append(const std::vector<ReadID>& read_ids);
+
+private:
+    std::ofstream m_file;
+};
+
+// A progress journal records the POD5 read batches all of whose records have been written, so
+// that an interrupted run can be resumed without reading the batches it finished, whereas the
+// reads in a progress file still have to be found in their batches to be skipped.  The output
+// and then the journal are synced to disk at each checkpoint, so what the journal lists
+// survives the machine going down, not just dorado.
+// Reads are journalled by the order they were loaded in, so their records must be written in
+// that order, as ReadOrderNode does.
+// The file is a header line naming the model, then one tab separated entry per line:
+//   run                     a run started, resuming any before it
+//   batch <index> <path>    every record of the batch's reads has been written
+//   checkpoint <size>       the run's output was synced at <size> bytes, or "-" if unknown
+class ProgressJournal {
+public:
+    // Opens the journal at path, creating it if there isn't one, and starts a run in it.
+    // Throws if it was written by a run with a different model.
+    ProgressJournal(const std::filesystem::path& path, const std::string& model_name);
+    ~ProgressJournal();
+    ProgressJournal(const ProgressJournal&) = delete;
+    ProgressJournal& operator=(const ProgressJournal&) = delete;
+
+    // Whether an earlier run wrote every read of the batch.
+    bool is_complete(const std::string& pod5_path, size_t batch) const;
+    size_t num_complete() const { return m_complete.size(); }
+    // The size of the previous run's output at its last checkpoint, if it had one and the size
+    // was known.  Records after that were written again by this run.
+    std::optional<uint64_t> previous_output_size() const { return m_previous_output_size; }
+
+    // Records that the batch's reads were loaded, the last of them with an order before
+    // end_order.
+    void add_batch(const std::string& pod5_path, size_t batch, uint64_t end_order);
+    // Records that the output, which is output_size bytes long if that is known, has been
+    // synced with the records of every read with an order before end_order.  The batches this
+    // completes are journalled, and the journal synced, before returning.
+    void checkpoint(uint64_t end_order, std::optional<uint64_t> output_size);
+
+private:
+    struct PendingBatch {
+        std::string path;
+        size_t batch;
+        uint64_t end_order;
+    };
+
+    // Appends the entries and syncs the journal to disk.
+    void append(const std::string& entries);
+
+    const std::filesystem::path m_path;
+    std::FILE* m_file{nullptr};
+    std::set<std::pair<std::string, size_t>> m_complete;
+    std::optional<uint64_t> m_previous_output_size;
+    std::mutex m_pending_mutex;
+    // Batches loaded by this run but not yet journalled, in load order.
+    std::deque<PendingBatch> m_pending;
+};
+
+// Syncs what has been written to the file at path, or to stdout if path is "-", to disk, and
+// returns the file's size, if it is a regular file.
+std::optional<uint64_t> sync_output_file(const std::string& path);
+
+}  // namespace dorado::utils
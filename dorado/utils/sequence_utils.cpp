@@ -1,5 +1,6 @@
 #include "sequence_utils.h"
 
+#include "PackedSequence.h"
 #include "htslib/sam.h"
 #include "simd.h"
 
@@ -8,8 +9,10 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <deque>
 #include <iterator>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -23,15 +26,13 @@ namespace {
 #if ENABLE_AVX2_IMPL
 __attribute__((target("default")))
 #endif
-std::string
-reverse_complement_impl(const std::string& sequence) {
-    if (sequence.empty()) {
-        return {};
-    }
-
+void
+reverse_complement_impl(const std::string& sequence, std::string& rev_comp_sequence) {
     const auto num_bases = sequence.size();
-    std::string rev_comp_sequence;
     rev_comp_sequence.resize(num_bases);
+    if (sequence.empty()) {
+        return;
+    }
 
     // Compile-time constant lookup table.
     static constexpr auto kComplementTable = [] {
@@ -51,16 +52,15 @@ reverse_complement_impl(const std::string& sequence) {
         const auto template_base = *template_ptr--;
         *complement_ptr++ = kComplementTable[template_base];
     }
-    return rev_comp_sequence;
 }
 
 #if ENABLE_AVX2_IMPL
 // AVX2 implementation that does in-register lookups of 32 bases at once, using
 // PSHUFB. On strings with over several thousand bases this was measured to be about 10x the speed
 // of the default implementation on Skylake.
-__attribute__((target("avx2"))) std::string reverse_complement_impl(const std::string& sequence) {
+__attribute__((target("avx2"))) void reverse_complement_impl(const std::string& sequence,
+                                                              std::string& rev_comp_sequence) {
     const auto len = sequence.size();
-    std::string rev_comp_sequence;
     rev_comp_sequence.resize(len);
 
     // Maps from lower 4 bits of template base ASCII to complement base ASCII.
@@ -121,34 +121,95 @@ __attribute__((target("avx2"))) std::string reverse_complement_impl(const std::s
         const __m256i complement_base = _mm256_shuffle_epi8(kComplementTable, template_base);
         *complement_ptr++ = _mm256_extract_epi8(complement_base, 0);
     }
+}
+#endif
 
-    return rev_comp_sequence;
+// Error probability of each phred+33 quality byte.
+// Unfortunately std::pow is not constexpr, so this can't be.
+const float* error_probability_table() {
+    static const auto kErrorProbabilityTable = [] {
+        std::array<float, 256> a{};
+        for (int q = 33; q <= 127; ++q) {
+            auto shifted = static_cast<float>(q - 33);
+            a[q] = std::pow(10.0f, -shifted / 10.0f);
+        }
+        return a;
+    }();
+    return kErrorProbabilityTable.data();
+}
+
+// Sum of the error probabilities of the quality bytes.  Several partial sums are kept, so the
+// additions don't all wait on each other.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+float sum_error_probabilities(const uint8_t* qbytes, size_t count) {
+    const float* const table = error_probability_table();
+    std::array<float, 4> sums{};
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (size_t j = 0; j < 4; ++j) {
+            sums[j] += table[qbytes[i + j]];
+        }
+    }
+    for (; i < count; ++i) {
+        sums[0] += table[qbytes[i]];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#if ENABLE_AVX2_IMPL
+// Looks up 16 quality bytes at a time with gathers from the table.
+__attribute__((target("avx2"))) float sum_error_probabilities(const uint8_t* qbytes,
+                                                              size_t count) {
+    const float* const table = error_probability_table();
+    __m256 sums_a = _mm256_setzero_ps();
+    __m256 sums_b = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qbytes + i));
+        const __m256i indices_a = _mm256_cvtepu8_epi32(bytes);
+        const __m256i indices_b = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+        sums_a = _mm256_add_ps(sums_a, _mm256_i32gather_ps(table, indices_a, 4));
+        sums_b = _mm256_add_ps(sums_b, _mm256_i32gather_ps(table, indices_b, 4));
+    }
+    const __m256 sums = _mm256_add_ps(sums_a, sums_b);
+    const __m128 sums_4 = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+    const __m128 sums_2 = _mm_add_ps(sums_4, _mm_movehl_ps(sums_4, sums_4));
+    float sum = _mm_cvtss_f32(_mm_add_ss(sums_2, _mm_shuffle_ps(sums_2, sums_2, 1)));
+    for (; i < count; ++i) {
+        sum += table[qbytes[i]];
+    }
+    return sum;
 }
 #endif
 
+// Invertible integer hash, as used by minimap2, so that minimizers of low complexity sequence
+// such as poly-A aren't always the smallest.
+uint64_t hash_kmer(uint64_t key, uint64_t mask) {
+    key = (~key + (key << 21)) & mask;
+    key = key ^ key >> 24;
+    key = ((key + (key << 3)) + (key << 8)) & mask;
+    key = key ^ key >> 14;
+    key = ((key + (key << 2)) + (key << 4)) & mask;
+    key = key ^ key >> 28;
+    key = (key + (key << 31)) & mask;
+    return key;
+}
+
 }  // namespace
 
 namespace dorado::utils {
 
-float mean_qscore_from_qstring(const std::string& qstring) {
+float mean_qscore_from_qstring(std::string_view qstring) {
     if (qstring.empty()) {
         return 0.0f;
     }
 
     // Lookup table avoids repeated invocation of std::pow, which
     // otherwise dominates run time of this function.
-    // Unfortunately std::pow is not constexpr, so this can't be.
-    static const auto kCharToScoreTable = [] {
-        std::array<float, 256> a{};
-        for (int q = 33; q <= 127; ++q) {
-            auto shifted = static_cast<float>(q - 33);
-            a[q] = std::pow(10.0f, -shifted / 10.0f);
-        }
-        return a;
-    }();
-    float total_error =
-            std::accumulate(qstring.cbegin(), qstring.cend(), 0.0f,
-                            [](float sum, char qchar) { return sum + kCharToScoreTable[qchar]; });
+    float total_error = sum_error_probabilities(reinterpret_cast<const uint8_t*>(qstring.data()),
+                                                qstring.size());
     float mean_error = total_error / static_cast<float>(qstring.size());
     float mean_qscore = -10.0f * std::log10(mean_error);
     return std::clamp(mean_qscore, 1.0f, 50.0f);
@@ -194,20 +255,109 @@ std::vector<uint64_t> move_cum_sums(const std::vector<uint8_t>& moves) {
     return ans;
 }
 
+std::vector<uint64_t> minimizers(const std::string& sequence, int k, int w) {
+    static const auto kBaseCodes = [] {
+        std::array<int8_t, 256> codes;
+        codes.fill(-1);
+        codes['A'] = 0;
+        codes['C'] = 1;
+        codes['G'] = 2;
+        codes['T'] = 3;
+        return codes;
+    }();
+
+    const uint64_t mask = k < 32 ? (uint64_t(1) << (2 * k)) - 1 : ~uint64_t(0);
+    std::vector<uint64_t> result;
+    // Hashes and positions of the k-mers which may yet be the smallest of a window, with
+    // increasing hashes.
+    std::deque<std::pair<uint64_t, size_t>> candidates;
+    std::optional<size_t> last_minimizer_pos;
+    uint64_t kmer = 0;
+    // Number of valid bases since the last unexpected character.
+    int num_bases = 0;
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        const int code = kBaseCodes[static_cast<uint8_t>(sequence[i])];
+        if (code < 0) {
+            num_bases = 0;
+            candidates.clear();
+            continue;
+        }
+        kmer = ((kmer << 2) | code) & mask;
+        if (++num_bases < k) {
+            continue;
+        }
+
+        const uint64_t hash = hash_kmer(kmer, mask);
+        while (!candidates.empty() && candidates.back().first > hash) {
+            candidates.pop_back();
+        }
+        candidates.emplace_back(hash, i);
+        // Positions are those of the k-mers' last bases, so the window holds those after i - w.
+        while (candidates.front().second + w <= i) {
+            candidates.pop_front();
+        }
+        if (num_bases >= k + w - 1 && candidates.front().second != last_minimizer_pos) {
+            last_minimizer_pos = candidates.front().second;
+            result.push_back(candidates.front().first);
+        }
+    }
+    return result;
+}
+
+float shared_minimizer_fraction(const std::string& sequence1,
+                                const std::string& sequence2,
+                                int k,
+                                int w) {
+    auto minimizers1 = minimizers(sequence1, k, w);
+    auto minimizers2 = minimizers(sequence2, k, w);
+    for (auto* m : {&minimizers1, &minimizers2}) {
+        std::sort(m->begin(), m->end());
+        m->erase(std::unique(m->begin(), m->end()), m->end());
+    }
+    const size_t num_minimizers = std::min(minimizers1.size(), minimizers2.size());
+    if (num_minimizers == 0) {
+        return 0.f;
+    }
+
+    size_t num_shared = 0;
+    auto it1 = minimizers1.begin();
+    auto it2 = minimizers2.begin();
+    while (it1 != minimizers1.end() && it2 != minimizers2.end()) {
+        if (*it1 < *it2) {
+            ++it1;
+        } else if (*it2 < *it1) {
+            ++it2;
+        } else {
+            ++num_shared;
+            ++it1;
+            ++it2;
+        }
+    }
+    return static_cast<float>(num_shared) / static_cast<float>(num_minimizers);
+}
+
 // Multiversioned function dispatch doesn't work across the dorado_lib linking
 // boundary.  Without this wrapper, AVX machines still only execute the default
 // version.
 std::string reverse_complement(const std::string& sequence) {
+    std::string rev_comp_sequence;
+    reverse_complement(sequence, rev_comp_sequence);
+    return rev_comp_sequence;
+}
+
+void reverse_complement(const std::string& sequence, std::string& rev_comp_sequence) {
     NVTX3_FUNC_RANGE();
-    return reverse_complement_impl(sequence);
+    reverse_complement_impl(sequence, rev_comp_sequence);
 }
 
 std::string convert_nt16_to_str(uint8_t* bseq, size_t slen) {
-    std::string seq(slen, '*');
-    for (int i = 0; i < slen; i++) {
-        seq[i] = seq_nt16_str[bam_seqi(bseq, i)];
-    }
+    std::string seq;
+    convert_nt16_to_str(bseq, slen, seq);
     return seq;
 }
 
+void convert_nt16_to_str(const uint8_t* bseq, size_t slen, std::string& seq) {
+    unpack_nt16(bseq, slen, seq);
+}
+
 }  // namespace dorado::utils
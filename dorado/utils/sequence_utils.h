@@ -2,12 +2,13 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace dorado::utils {
 
-// Calculate a mean qscore from a per-base Q string.
-float mean_qscore_from_qstring(const std::string& qstring);
+// Calculate a mean qscore from a per-base Q string of phred+33 bytes.
+float mean_qscore_from_qstring(std::string_view qstring);
 
 // Convert a canonical base character (ACGT) to an integer representation (0123).
 // No checking is performed on the input.
@@ -30,9 +31,26 @@ std::vector<uint64_t> move_cum_sums(const std::vector<uint8_t>& moves);
 // Bases are specified as capital letters.
 // Undefined output if characters other than A, C, G, T appear.
 std::string reverse_complement(const std::string& sequence);
+// As above, into rev_comp_sequence, so that its buffer can be reused.
+void reverse_complement(const std::string& sequence, std::string& rev_comp_sequence);
+
+// Compute the (k, w) minimizers of a sequence, as in minimap2: the k-mer with the smallest hash
+// in each window of w consecutive k-mers, reported once per run of windows it is smallest in.
+// K-mers aren't canonicalised, so sequences only share minimizers on the same strand.
+// K-mers containing characters other than A, C, G, T are skipped.  k must be at most 32.
+std::vector<uint64_t> minimizers(const std::string& sequence, int k, int w);
+
+// Fraction of the distinct (k, w) minimizers of whichever sequence has fewer that are also
+// minimizers of the other.  0 if either sequence has none.
+float shared_minimizer_fraction(const std::string& sequence1,
+                                const std::string& sequence2,
+                                int k,
+                                int w);
 
 // Convert the 4bit encoded sequence in a bam1_t structure
 // into a string.
 std::string convert_nt16_to_str(uint8_t* bseq, size_t slen);
+// As above, into seq, so that its buffer can be reused.
+void convert_nt16_to_str(const uint8_t* bseq, size_t slen, std::string& seq);
 
 }  // namespace dorado::utils
@@ -9,4 +9,12 @@
 
 #if ENABLE_AVX2_IMPL
 #include <immintrin.h>
-#endif
\ No newline at end of file
+#endif
+
+// NEON is part of the baseline aarch64 architecture, so needs no runtime check.
+#if defined(__aarch64__)
+#define ENABLE_NEON_IMPL 1
+#include <arm_neon.h>
+#else
+#define ENABLE_NEON_IMPL 0
+#endif
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <functional>
+#include <mutex>
 #include <optional>
 #include <regex>
 #include <set>
@@ -20,6 +24,60 @@ using NamedStats = std::unordered_map<std::string, double>;
 using StatsReporter = std::function<std::tuple<std::string, NamedStats>()>;
 using StatsCallable = std::function<void(const NamedStats&)>;
 
+// Counters registered once by name, each backed by an atomic the registering object already
+// updates, and read back through the integer handle add() returns.  Reading a counter is an
+// atomic load, with no allocation or name lookup, so readers polling often (such as the
+// progress bar) stay cheap however many stats the pipeline reports.  Only names are looked up,
+// once, with find().  Counters must all be added before anything reads them, and the atomics
+// must outlive the registry's readers.
+class CounterRegistry {
+public:
+    using Handle = size_t;
+
+    template <class T>
+    Handle add(std::string name, const std::atomic<T>& source) {
+        m_counters.push_back({std::move(name), &source, [](const void* counter) {
+                                  return static_cast<double>(
+                                          static_cast<const std::atomic<T>*>(counter)->load(
+                                                  std::memory_order_relaxed));
+                              }});
+        return m_counters.size() - 1;
+    }
+
+    size_t size() const { return m_counters.size(); }
+    const std::string& name(Handle handle) const { return m_counters[handle].name; }
+    double value(Handle handle) const {
+        const auto& counter = m_counters[handle];
+        return counter.load(counter.source);
+    }
+
+    std::optional<Handle> find(const std::string& name) const {
+        for (Handle handle = 0; handle < m_counters.size(); ++handle) {
+            if (m_counters[handle].name == name) {
+                return handle;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Reads every counter into values, indexed by handle.  Only allocates if values is smaller
+    // than the registry.
+    void sample(std::vector<double>& values) const {
+        values.resize(m_counters.size());
+        for (Handle handle = 0; handle < m_counters.size(); ++handle) {
+            values[handle] = value(handle);
+        }
+    }
+
+private:
+    struct Counter {
+        std::string name;
+        const void* source;
+        double (*load)(const void*);
+    };
+    std::vector<Counter> m_counters;
+};
+
 class StatsSampler {
 public:
     // Takes 2 arguments
@@ -151,6 +209,191 @@ NamedStats from_obj(const T& obj) {
     return prefixed_stats;
 }
 
+// Records the highest value reached by each sampled stat whose name ends in suffix, such as
+// the bytes each node holds, for a summary of peak memory use at the end of a run.
+class PeakTracker {
+public:
+    explicit PeakTracker(std::string suffix = "_bytes") : m_suffix(std::move(suffix)) {}
+
+    void update(const NamedStats& stats) {
+        std::lock_guard lock(m_mutex);
+        for (const auto& [name, value] : stats) {
+            if (name.size() >= m_suffix.size() &&
+                name.compare(name.size() - m_suffix.size(), m_suffix.size(), m_suffix) == 0) {
+                auto [peak, inserted] = m_peaks.try_emplace(name, value);
+                if (!inserted) {
+                    peak->second = std::max(peak->second, value);
+                }
+            }
+        }
+    }
+
+    // For the StatsSampler, which must not outlive this object.
+    StatsCallable get_callable() {
+        return [this](const NamedStats& stats) { update(stats); };
+    }
+
+    NamedStats peaks() const {
+        std::lock_guard lock(m_mutex);
+        return m_peaks;
+    }
+
+private:
+    const std::string m_suffix;
+    mutable std::mutex m_mutex;
+    NamedStats m_peaks;
+};
+
+// Histogram of durations whose buckets are spaced logarithmically, with 8 buckets per
+// power of 2, so quantiles are accurate to within ~6% from nanoseconds to hours.
+// Recording is lock-free and safe to call from any number of threads.
+class LatencyHistogram {
+public:
+    void record(std::chrono::nanoseconds duration) {
+        const auto ns = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+        m_counts[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64_t count() const {
+        uint64_t total = 0;
+        for (const auto& bucket_count : m_counts) {
+            total += bucket_count.load(std::memory_order_relaxed);
+        }
+        return static_cast<int64_t>(total);
+    }
+
+    // Returns the q'th quantile (0 <= q <= 1) of the recorded durations in microseconds,
+    // or 0 if nothing has been recorded.
+    double quantile_us(double q) const {
+        std::array<uint64_t, kNumBuckets> counts;
+        uint64_t total = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total + 0.5));
+        uint64_t cumulative = 0;
+        size_t index = 0;
+        for (; index < kNumBuckets - 1; ++index) {
+            cumulative += counts[index];
+            if (cumulative >= rank) {
+                break;
+            }
+        }
+        // Report the middle of the bucket.
+        return (bucket_lower_bound(index) + bucket_width(index) / 2.0) / 1000.0;
+    }
+
+    // Adds <prefix>_p50_us, <prefix>_p90_us and <prefix>_p99_us to stats, if anything has
+    // been recorded.
+    void add_stats(NamedStats& stats, const std::string& prefix) const {
+        if (count() == 0) {
+            return;
+        }
+        stats[prefix + "_p50_us"] = quantile_us(0.5);
+        stats[prefix + "_p90_us"] = quantile_us(0.9);
+        stats[prefix + "_p99_us"] = quantile_us(0.99);
+    }
+
+private:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr uint64_t kNumSubBuckets = uint64_t(1) << kSubBucketBits;
+    // Values below kNumSubBuckets get a bucket each, then each power of 2 above that is
+    // split into kNumSubBuckets buckets.
+    static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    static int most_significant_bit(uint64_t value) {
+        int msb = 0;
+        for (int shift = 32; shift > 0; shift /= 2) {
+            if (value >> shift) {
+                value >>= shift;
+                msb += shift;
+            }
+        }
+        return msb;
+    }
+
+    static size_t bucket_index(uint64_t ns) {
+        if (ns < kNumSubBuckets) {
+            return static_cast<size_t>(ns);
+        }
+        const int msb = most_significant_bit(ns);
+        const uint64_t sub_bucket = (ns >> (msb - kSubBucketBits)) & (kNumSubBuckets - 1);
+        return static_cast<size_t>(((msb - kSubBucketBits + 1) << kSubBucketBits) + sub_bucket);
+    }
+
+    static uint64_t bucket_width(size_t index) {
+        const size_t block = index >> kSubBucketBits;
+        return block == 0 ? 1 : uint64_t(1) << (block - 1);
+    }
+
+    static uint64_t bucket_lower_bound(size_t index) {
+        const size_t block = index >> kSubBucketBits;
+        if (block == 0) {
+            return index;
+        }
+        const uint64_t sub_bucket = index & (kNumSubBuckets - 1);
+        return (kNumSubBuckets + sub_bucket) << (block - 1);
+    }
+
+    std::array<std::atomic<uint64_t>, kNumBuckets> m_counts{};
+};
+
+// Latency stats for a queue, recorded by the queue itself.
+// Queue wait is the time from an item being pushed to it being popped.
+// Service time is the time a consumer thread spends between returning from one pop and
+// starting the next, i.e. processing what it popped and passing it on.  Long queue waits mean
+// the consuming node is a bottleneck, as items pile up in front of it.  Short waits while the
+// node's threads spend most of their time blocked in pop mean it is starved by the nodes
+// upstream of it.
+class QueueLatencies {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on entry to a pop by the consuming thread.  Records the service time of
+    // whatever this thread last popped from this queue.
+    void start_pop() {
+        auto& previous = last_pop();
+        if (previous.queue == this) {
+            m_service_time.record(Clock::now() - previous.time);
+            previous.queue = nullptr;
+        }
+    }
+    // Called once per item popped.
+    void record_wait(Clock::time_point enqueue_time, Clock::time_point now) {
+        m_queue_wait.record(now - enqueue_time);
+    }
+    // Called by the consuming thread when a pop succeeds.
+    void end_pop(Clock::time_point now) {
+        auto& previous = last_pop();
+        previous.queue = this;
+        previous.time = now;
+    }
+
+    void add_stats(NamedStats& stats) const {
+        m_queue_wait.add_stats(stats, "wait");
+        m_service_time.add_stats(stats, "service");
+    }
+
+private:
+    // The queue this thread last popped from, and when.  Worker threads generally pop
+    // from a single queue, so one entry per thread suffices.
+    struct LastPop {
+        const QueueLatencies* queue = nullptr;
+        Clock::time_point time;
+    };
+    static LastPop& last_pop() {
+        static thread_local LastPop last_pop;
+        return last_pop;
+    }
+
+    LatencyHistogram m_queue_wait;
+    LatencyHistogram m_service_time;
+};
+
 // Minimal timer object to facilitate recording time spans.
 // Starts a clock when constructed which can be queried in ms subsequently.
 class Timer {
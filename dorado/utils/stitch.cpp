@@ -1,79 +1,132 @@
+#include "stitch.h"
+
 #include "../read_pipeline/ReadPipeline.h"
 #include "math_utils.h"
 
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <numeric>
+
 namespace dorado::utils {
 
-void stitch_chunks(std::shared_ptr<Read> read) {
-    // Calculate the chunk down sampling, round to closest int.
-    read->model_stride = div_round_closest(read->called_chunks[0]->raw_chunk_size,
-                                           read->called_chunks[0]->moves.size());
-
-    int start_pos = 0;
-    int mid_point_front = 0;
-    std::vector<uint8_t> moves;
-    std::vector<std::string> sequences;
-    std::vector<std::string> qstrings;
-
-    for (int i = 0; i < read->num_chunks - 1; i++) {
-        auto current_chunk = read->called_chunks[i];
-        auto next_chunk = read->called_chunks[i + 1];
-        int overlap_size = (current_chunk->raw_chunk_size + current_chunk->input_offset) -
-                           (next_chunk->input_offset);
-        assert(overlap_size % read->model_stride == 0);
-        int overlap_down_sampled = overlap_size / read->model_stride;
+ChunkStitcher::ChunkStitcher(size_t num_chunks, size_t raw_size)
+        : m_num_chunks(num_chunks), m_raw_size(raw_size) {}
+
+void ChunkStitcher::append(const Chunk& chunk, std::optional<size_t> next_chunk_offset) {
+    assert(m_num_appended < m_num_chunks);
+    if (m_num_appended == 0) {
+        // Calculate the chunk down sampling, round to closest int.
+        m_model_stride = div_round_closest(int(chunk.raw_chunk_size), int(chunk.moves.size()));
+        // The trimmed chunks are appended straight onto one buffer per field, sized for the
+        // untrimmed total so that they rarely reallocate.
+        m_moves.reserve(m_num_chunks * chunk.moves.size());
+        m_sequence.reserve(m_num_chunks * chunk.seq.size());
+        m_qstring.reserve(m_num_chunks * chunk.seq.size());
+    }
+    ++m_num_appended;
+
+    // The bases of the front of the overlap with the previous chunk were taken from it.
+    const int start_pos = std::accumulate(
+            chunk.moves.begin(), std::next(chunk.moves.begin(), m_mid_point_front), 0);
+
+    if (next_chunk_offset) {
+        int overlap_size = int(chunk.raw_chunk_size + chunk.input_offset - *next_chunk_offset);
+        assert(overlap_size % m_model_stride == 0);
+        int overlap_down_sampled = overlap_size / m_model_stride;
         int mid_point_rear = overlap_down_sampled / 2;
 
-        int current_chunk_bases_to_trim =
-                std::accumulate(std::prev(current_chunk->moves.end(), mid_point_rear),
-                                current_chunk->moves.end(), 0);
+        int chunk_bases_to_trim = std::accumulate(std::prev(chunk.moves.end(), mid_point_rear),
+                                                  chunk.moves.end(), 0);
 
-        int current_chunk_seq_len = current_chunk->seq.size();
-        int end_pos = current_chunk_seq_len - current_chunk_bases_to_trim;
+        int chunk_seq_len = int(chunk.seq.size());
+        int end_pos = chunk_seq_len - chunk_bases_to_trim;
         int trimmed_len = end_pos - start_pos;
-        sequences.push_back(current_chunk->seq.substr(start_pos, trimmed_len));
-        qstrings.push_back(current_chunk->qstring.substr(start_pos, trimmed_len));
-        moves.insert(moves.end(), std::next(current_chunk->moves.begin(), mid_point_front),
-                     std::prev(current_chunk->moves.end(), mid_point_rear));
-
-        mid_point_front = overlap_down_sampled - mid_point_rear;
+        m_sequence.append(chunk.seq, start_pos, trimmed_len);
+        m_qstring.append(chunk.qstring, start_pos, trimmed_len);
+        m_moves.insert(m_moves.end(), std::next(chunk.moves.begin(), m_mid_point_front),
+                       std::prev(chunk.moves.end(), mid_point_rear));
 
-        start_pos = 0;
-        for (int i = 0; i < mid_point_front; i++) {
-            start_pos += (int)next_chunk->moves[i];
-        }
+        m_mid_point_front = overlap_down_sampled - mid_point_rear;
+        return;
     }
 
-    // Append the final chunk
-    auto& last_chunk = read->called_chunks[read->num_chunks - 1];
-    moves.insert(moves.end(), std::next(last_chunk->moves.begin(), mid_point_front),
-                 last_chunk->moves.end());
+    // The final chunk
+    m_moves.insert(m_moves.end(), std::next(chunk.moves.begin(), m_mid_point_front),
+                   chunk.moves.end());
 
-    if (read->num_chunks == 1) {
+    if (m_num_chunks == 1) {
         // shorten the sequence, qstring & moves where the read is shorter than chunksize
-        int last_index_in_moves_to_keep = read->raw_data.size(0) / read->model_stride;
-        moves = std::vector<uint8_t>(moves.begin(), moves.begin() + last_index_in_moves_to_keep);
-        int end = std::accumulate(moves.begin(), moves.end(), 0);
-        sequences.push_back(last_chunk->seq.substr(start_pos, end));
-        qstrings.push_back(last_chunk->qstring.substr(start_pos, end));
-
+        int last_index_in_moves_to_keep = int(m_raw_size) / m_model_stride;
+        m_moves.resize(last_index_in_moves_to_keep);
+        int end = std::accumulate(m_moves.begin(), m_moves.end(), 0);
+        m_sequence.append(chunk.seq, start_pos, end);
+        m_qstring.append(chunk.qstring, start_pos, end);
     } else {
-        sequences.push_back(last_chunk->seq.substr(start_pos));
-        qstrings.push_back(last_chunk->qstring.substr(start_pos));
+        m_sequence.append(chunk.seq, start_pos);
+        m_qstring.append(chunk.qstring, start_pos);
     }
+}
 
+void ChunkStitcher::finish(Read& read) {
+    assert(m_num_appended == m_num_chunks);
     // Set the read seq and qstring
-    read->seq = std::accumulate(sequences.begin(), sequences.end(), std::string(""));
-    read->qstring = std::accumulate(qstrings.begin(), qstrings.end(), std::string(""));
-    read->moves = std::move(moves);
+    read.model_stride = m_model_stride;
+    read.seq = std::move(m_sequence);
+    read.qstring = std::move(m_qstring);
+    read.moves = std::move(m_moves);
 
     // remove partial stride overhang
-    if (read->moves.size() > static_cast<int>(read->raw_data.size(0) / read->model_stride)) {
-        if (read->moves.back() == 1) {
-            read->seq.pop_back();
-            read->qstring.pop_back();
+    if (read.moves.size() > m_raw_size / m_model_stride) {
+        if (read.moves.back() == 1) {
+            read.seq.pop_back();
+            read.qstring.pop_back();
+        }
+        read.moves.pop_back();
+        assert(std::accumulate(read.moves.begin(), read.moves.end(), 0) == read.seq.size());
+    }
+}
+
+void stitch_chunks(std::shared_ptr<Read> read) {
+    ChunkStitcher stitcher(read->num_chunks, read->raw_data.size(0));
+    for (size_t i = 0; i < read->num_chunks; ++i) {
+        std::optional<size_t> next_chunk_offset;
+        if (i + 1 < read->num_chunks) {
+            next_chunk_offset = read->called_chunks[i + 1]->input_offset;
+        }
+        stitcher.append(*read->called_chunks[i], next_chunk_offset);
+    }
+    stitcher.finish(*read);
+}
+
+void unpack_chunk(Chunk& packed_chunk, int model_stride) {
+    assert(packed_chunk.packed_chunks.size() == packed_chunk.packed_offsets.size());
+    const auto& moves = packed_chunk.moves;
+    const auto stride = size_t(model_stride);
+    // The step reached so far, and the number of bases called before it.
+    size_t step = 0;
+    size_t base = 0;
+    for (size_t i = 0; i < packed_chunk.packed_chunks.size(); ++i) {
+        auto& chunk = *packed_chunk.packed_chunks[i];
+        assert(packed_chunk.packed_offsets[i] % stride == 0);
+        assert(chunk.raw_chunk_size % stride == 0);
+        const size_t first_step = packed_chunk.packed_offsets[i] / stride;
+        const size_t num_steps = chunk.raw_chunk_size / stride;
+        // Bases called in the gap before the read belong to no read.
+        for (; step < first_step && step < moves.size(); ++step) {
+            base += moves[step];
+        }
+        const size_t end_step = std::min(first_step + num_steps, moves.size());
+        const size_t first_base = base;
+        for (; step < end_step; ++step) {
+            base += moves[step];
         }
-        read->moves.pop_back();
-        assert(std::accumulate(read->moves.begin(), read->moves.end(), 0) == read->seq.size());
+        chunk.seq = packed_chunk.seq.substr(first_base, base - first_base);
+        chunk.qstring = packed_chunk.qstring.substr(first_base, base - first_base);
+        chunk.moves.assign(std::next(moves.begin(), std::min(first_step, moves.size())),
+                           std::next(moves.begin(), end_step));
+        // Steps which weren't decoded called no bases.
+        chunk.moves.resize(num_steps, 0);
     }
 }
 
@@ -1,14 +1,50 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace dorado {
 class Read;
+struct Chunk;
 }  // namespace dorado
 
 namespace dorado::utils {
 
+// Stitches a read's called chunks one at a time, in order, so that each chunk's calls can be
+// freed as soon as it has been appended, rather than all being held until the read is done.
+class ChunkStitcher {
+public:
+    // num_chunks and raw_size are those of the read, whose signal is raw_size samples long.
+    ChunkStitcher(size_t num_chunks, size_t raw_size);
+    // Appends the next chunk, trimmed at the middle of its overlaps with its neighbours.
+    // next_chunk_offset is where the chunk after it starts in the signal, if there is one.
+    void append(const Chunk& chunk, std::optional<size_t> next_chunk_offset);
+    // Number of chunks appended so far.
+    size_t num_appended() const { return m_num_appended; }
+    // Gives the read the stitched call, once every chunk has been appended.
+    void finish(Read& read);
+
+private:
+    const size_t m_num_chunks;
+    const size_t m_raw_size;
+    size_t m_num_appended{0};
+    int m_model_stride{0};
+    // Output steps at the start of the next chunk which the previous chunk's call covers.
+    int m_mid_point_front{0};
+    std::vector<uint8_t> m_moves;
+    std::string m_sequence;
+    std::string m_qstring;
+};
+
 // Given a read with unstitched chunks, stitch the chunks (accounting for overlap) and assign basecalled read and
 // qstring to Read
 void stitch_chunks(std::shared_ptr<Read> read);
 
+// Splits the call of a chunk holding several packed reads between the chunks of those reads,
+// each taking the output steps its samples span, and the bases called in them.
+void unpack_chunk(Chunk& packed_chunk, int model_stride);
+
 }  // namespace dorado::utils
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dorado::utils {
+
+// Columns of a sequencing summary, as written by `dorado summary`, for every read.
+inline const std::vector<std::string>& summary_columns() {
+    static const std::vector<std::string> columns = {
+            "filename",
+            "read_id",
+            "run_id",
+            "channel",
+            "mux",
+            "start_time",
+            "duration",
+            "template_start",
+            "template_duration",
+            "sequence_length_template",
+            "mean_qscore_template",
+    };
+    return columns;
+}
+
+// Columns which follow summary_columns() for aligned reads.
+inline const std::vector<std::string>& summary_alignment_columns() {
+    static const std::vector<std::string> columns = {
+            "alignment_genome",         "alignment_genome_start",    "alignment_genome_end",
+            "alignment_strand_start",   "alignment_strand_end",      "alignment_direction",
+            "alignment_length",         "alignment_num_aligned",     "alignment_num_correct",
+            "alignment_num_insertions", "alignment_num_deletions",   "alignment_num_substitutions",
+            "alignment_mapq",           "alignment_strand_coverage", "alignment_identity",
+            "alignment_accuracy"};
+    return columns;
+}
+
+// Appends the fields of a summary row to a string, formatted as iostreams would by default,
+// without the cost of a stream.
+class SummaryRowWriter {
+public:
+    SummaryRowWriter(std::string& row, std::string_view separator)
+            : m_row(row), m_separator(separator) {}
+
+    SummaryRowWriter& first(std::string_view value) {
+        m_row.append(value);
+        return *this;
+    }
+    SummaryRowWriter& operator<<(std::string_view value) {
+        m_row.append(m_separator).append(value);
+        return *this;
+    }
+    SummaryRowWriter& operator<<(int64_t value) {
+        char buffer[24];
+        const int len =
+                std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+        return *this << std::string_view(buffer, len);
+    }
+    SummaryRowWriter& operator<<(int32_t value) { return *this << static_cast<int64_t>(value); }
+    SummaryRowWriter& operator<<(double value) {
+        char buffer[32];
+        const int len = std::snprintf(buffer, sizeof(buffer), "%g", value);
+        return *this << std::string_view(buffer, len);
+    }
+    SummaryRowWriter& operator<<(float value) { return *this << static_cast<double>(value); }
+
+private:
+    std::string& m_row;
+    std::string_view m_separator;
+};
+
+// The header line of a summary, with the alignment columns if aligned.
+inline std::string summary_header(bool aligned, std::string_view separator) {
+    std::string header;
+    SummaryRowWriter row(header, separator);
+    row.first(summary_columns().front());
+    for (size_t col = 1; col < summary_columns().size(); ++col) {
+        row << summary_columns()[col];
+    }
+    if (aligned) {
+        for (const auto& column : summary_alignment_columns()) {
+            row << column;
+        }
+    }
+    header.push_back('\n');
+    return header;
+}
+
+}  // namespace dorado::utils
@@ -1,13 +1,21 @@
 #include "tensor_utils.h"
 
+#include "SignalBufferPool.h"
+#include "packed_weights.h"
 #include "simd.h"
 
 #include <torch/csrc/jit/serialization/pickle.h>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace {
@@ -16,11 +24,24 @@ namespace {
 __attribute__((target("default")))
 #endif
 void convert_f32_to_f16_impl(c10::Half* const dest, const float* const src, std::size_t count) {
+#if ENABLE_NEON_IMPL
+    // vcvt rounds to nearest even, as torch does.
+    static constexpr size_t kUnroll = 4;
+    const size_t vector_count = count - count % kUnroll;
+    for (size_t i = 0; i < vector_count; i += kUnroll) {
+        const float16x4_t elems_f16 = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(reinterpret_cast<uint16_t*>(dest + i), vreinterpret_u16_f16(elems_f16));
+    }
+    for (size_t i = vector_count; i < count; ++i) {
+        dest[i] = c10::Half(src[i]);
+    }
+#else
     // TODO -- handle large counts properly.
     assert(count <= std::numeric_limits<int>::max());
     auto src_tensor_f32 = torch::from_blob(const_cast<float*>(src), {static_cast<int>(count)});
     auto src_tensor_f16 = src_tensor_f32.to(torch::kFloat16);
     std::memcpy(dest, src_tensor_f16.data_ptr(), count * sizeof(c10::Half));
+#endif
 }
 
 #if ENABLE_AVX2_IMPL
@@ -63,6 +84,179 @@ __attribute__((target("avx2,f16c"))) void convert_f32_to_f16_impl(c10::Half* con
 }
 #endif
 
+#if ENABLE_AVX2_IMPL
+// As the AVX2 version, but 16 floats per iteration.  This is picked over it at runtime on CPUs
+// with AVX-512.
+__attribute__((target("avx512f,f16c"))) void convert_f32_to_f16_impl(c10::Half* const dest,
+                                                                     const float* const src,
+                                                                     std::size_t count) {
+    static constexpr size_t kUnroll = 16;
+    const int kRoundNearestEven = 0;
+
+    const size_t vector_count = count - count % kUnroll;
+    for (size_t i = 0; i < vector_count; i += kUnroll) {
+        const __m512 elems_f32 = _mm512_loadu_ps(src + i);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                            _mm512_cvtps_ph(elems_f32, kRoundNearestEven));
+    }
+
+    // Final 0-15 floats, 8 at a time and then singly.
+    size_t i = vector_count;
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), kRoundNearestEven));
+    }
+    for (; i < count; ++i) {
+        const __m128i elem_f16 = _mm_cvtps_ph(_mm_set_ss(src[i]), kRoundNearestEven);
+        *(reinterpret_cast<std::int16_t*>(dest + i)) =
+                static_cast<std::int16_t>(_mm_extract_epi16(elem_f16, 0));
+    }
+}
+#endif
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void convert_f16_to_f32_impl(float* const dest, const c10::Half* const src, std::size_t count) {
+    size_t i = 0;
+#if ENABLE_NEON_IMPL
+    for (; i + 4 <= count; i += 4) {
+        const float16x4_t elems_f16 =
+                vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t*>(src + i)));
+        vst1q_f32(dest + i, vcvt_f32_f16(elems_f16));
+    }
+#endif
+    for (; i < count; ++i) {
+        dest[i] = static_cast<float>(src[i]);
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Every value of a half has an exact float representation, so there is no rounding.
+__attribute__((target("avx2,f16c"))) void convert_f16_to_f32_impl(float* const dest,
+                                                                  const c10::Half* const src,
+                                                                  std::size_t count) {
+    static constexpr size_t kUnroll = 8;
+    const size_t vector_count = count - count % kUnroll;
+    for (size_t i = 0; i < vector_count; i += kUnroll) {
+        const __m128i elems_f16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(elems_f16));
+    }
+    for (size_t i = vector_count; i < count; ++i) {
+        dest[i] = static_cast<float>(src[i]);
+    }
+}
+#endif
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+void scale_i16_to_f16_impl(c10::Half* const dest,
+                           const std::int16_t* const src,
+                           std::size_t count,
+                           float shift,
+                           float scale) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = c10::Half((static_cast<float>(src[i]) - shift) / scale);
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2,f16c"))) void scale_i16_to_f16_impl(c10::Half* const dest,
+                                                                const std::int16_t* const src,
+                                                                std::size_t count,
+                                                                float shift,
+                                                                float scale) {
+    // Unroll to AVX register size: 8 floats.
+    static constexpr size_t kUnroll = 8;
+
+    // Matches torch behaviour.
+    const int kRoundNearestEven = 0;
+
+    const __m256 shift_vec = _mm256_set1_ps(shift);
+    const __m256 scale_vec = _mm256_set1_ps(scale);
+    const size_t vector_count = count - count % kUnroll;
+    for (size_t i = 0; i < vector_count; i += kUnroll) {
+        const __m128i elems_i16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m256 elems_f32 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(elems_i16));
+        const __m256 scaled = _mm256_div_ps(_mm256_sub_ps(elems_f32, shift_vec), scale_vec);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                         _mm256_cvtps_ph(scaled, kRoundNearestEven));
+    }
+
+    // Final 0-7 elements.
+    for (size_t i = vector_count; i < count; ++i) {
+        dest[i] = c10::Half((static_cast<float>(src[i]) - shift) / scale);
+    }
+}
+#endif
+
+// Smallest and largest of count (> 0) samples.
+#if ENABLE_AVX2_IMPL
+__attribute__((target("default")))
+#endif
+std::pair<int, int> minmax_i16(const std::int16_t* const src, std::size_t count) {
+    std::size_t i = 0;
+#if ENABLE_NEON_IMPL
+    if (count >= 8) {
+        int16x8_t mins = vld1q_s16(src);
+        int16x8_t maxs = mins;
+        for (i = 8; i + 8 <= count; i += 8) {
+            const int16x8_t elems = vld1q_s16(src + i);
+            mins = vminq_s16(mins, elems);
+            maxs = vmaxq_s16(maxs, elems);
+        }
+        int lowest = vminvq_s16(mins);
+        int highest = vmaxvq_s16(maxs);
+        for (; i < count; ++i) {
+            lowest = std::min<int>(lowest, src[i]);
+            highest = std::max<int>(highest, src[i]);
+        }
+        return {lowest, highest};
+    }
+#endif
+    int lowest = src[0];
+    int highest = src[0];
+    for (; i < count; ++i) {
+        lowest = std::min<int>(lowest, src[i]);
+        highest = std::max<int>(highest, src[i]);
+    }
+    return {lowest, highest};
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2"))) std::pair<int, int> minmax_i16(const std::int16_t* const src,
+                                                               std::size_t count) {
+    // Unroll to AVX register size: 16 samples.
+    static constexpr size_t kUnroll = 16;
+    std::size_t i = 0;
+    int lowest = src[0];
+    int highest = src[0];
+    if (count >= kUnroll) {
+        __m256i mins = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        __m256i maxs = mins;
+        for (i = kUnroll; i + kUnroll <= count; i += kUnroll) {
+            const __m256i elems = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            mins = _mm256_min_epi16(mins, elems);
+            maxs = _mm256_max_epi16(maxs, elems);
+        }
+        alignas(32) std::int16_t min_lanes[kUnroll];
+        alignas(32) std::int16_t max_lanes[kUnroll];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(min_lanes), mins);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(max_lanes), maxs);
+        for (size_t lane = 0; lane < kUnroll; ++lane) {
+            lowest = std::min<int>(lowest, min_lanes[lane]);
+            highest = std::max<int>(highest, max_lanes[lane]);
+        }
+    }
+    for (; i < count; ++i) {
+        lowest = std::min<int>(lowest, src[i]);
+        highest = std::max<int>(highest, src[i]);
+    }
+    return {lowest, highest};
+}
+#endif
+
 }  // namespace
 
 namespace dorado::utils {
@@ -77,6 +271,15 @@ void serialise_tensor(torch::Tensor t, const std::string& path) {
 std::vector<torch::Tensor> load_tensors(const std::filesystem::path& dir,
                                         const std::vector<std::string>& tensors) {
     auto weights = std::vector<torch::Tensor>();
+    const auto packed_path = dir / kPackedWeightsFile;
+    if (std::filesystem::exists(packed_path)) {
+        const auto packed = PackedWeights::open(packed_path);
+        for (const auto& tensor : tensors) {
+            weights.push_back(packed->tensor(tensor));
+        }
+        return weights;
+    }
+
     for (auto tensor : tensors) {
         auto path = dir / tensor;
         torch::load(weights, path.string());
@@ -106,36 +309,123 @@ torch::Tensor quantile(const torch::Tensor t, const torch::Tensor q) {
     return res;
 }
 
-torch::Tensor quantile_counting(const torch::Tensor t, const torch::Tensor q) {
-    assert(q.dtype() == torch::kF32);
-
-    auto p = t.data_ptr<int16_t>();
-    auto range_min = t.min().item<int16_t>();
-    auto range_max = t.max().item<int16_t>();
-
-    int size = t.size(0);
+void quantile_counting(const std::int16_t* data,
+                       std::size_t size,
+                       const float* q,
+                       std::size_t num_q,
+                       float* result) {
+    if (size == 0) {
+        throw std::runtime_error("quantile_counting requires at least one sample");
+    }
 
-    std::vector<int> counts(range_max - range_min + 1, 0);
-    for (int i = 0; i < size; ++i) {
-        counts[p[i] - range_min]++;
+    // The histogram only covers the samples' range, found in a separate vectorised pass.  It
+    // is kept per thread so that nothing is allocated per call, and cleared again before
+    // returning.  Consecutive samples are counted in different interleaved histograms, so
+    // that runs of the same value, which signal is full of, don't wait on each other's
+    // increments.
+    const auto [range_min, range_max] = minmax_i16(data, size);
+    const std::size_t range = static_cast<std::size_t>(range_max - range_min) + 1;
+    constexpr std::size_t kNumHistograms = 4;
+    thread_local std::vector<std::uint32_t> counts;
+    if (counts.size() < range * kNumHistograms) {
+        counts.resize(range * kNumHistograms, 0);
     }
-    std::partial_sum(counts.begin(), counts.end(), counts.begin());
+    std::uint32_t* const bins = counts.data();
 
-    auto res = torch::empty_like(q);
+    std::size_t i = 0;
+    for (; i + kNumHistograms <= size; i += kNumHistograms) {
+        for (std::size_t h = 0; h < kNumHistograms; ++h) {
+            ++bins[(data[i + h] - range_min) * kNumHistograms + h];
+        }
+    }
+    for (; i < size; ++i) {
+        ++bins[(data[i] - range_min) * kNumHistograms];
+    }
+    // Merge the histograms into the first.
+    for (std::size_t bin = 0; bin < range * kNumHistograms; bin += kNumHistograms) {
+        for (std::size_t h = 1; h < kNumHistograms; ++h) {
+            bins[bin] += bins[bin + h];
+            bins[bin + h] = 0;
+        }
+    }
 
-    for (size_t idx = 0; idx < q.numel(); idx++) {
-        int threshold = q[idx].item<float>() * (size - 1);
-        for (int i = 0; i < counts.size(); ++i) {
-            if (counts[i] > threshold) {
-                res[idx] = i + range_min;
+    for (std::size_t idx = 0; idx < num_q; idx++) {
+        const std::size_t threshold = static_cast<std::size_t>(q[idx] * (size - 1));
+        std::size_t cumulative_count = 0;
+        result[idx] = static_cast<float>(range_max);
+        for (std::size_t bin = 0; bin < range; ++bin) {
+            cumulative_count += bins[bin * kNumHistograms];
+            if (cumulative_count > threshold) {
+                result[idx] = static_cast<float>(range_min + static_cast<int>(bin));
                 break;
             }
         }
     }
 
+    for (std::size_t bin = 0; bin < range * kNumHistograms; bin += kNumHistograms) {
+        bins[bin] = 0;
+    }
+}
+
+std::vector<float> quantile_counting(const std::int16_t* data,
+                                     std::size_t size,
+                                     const std::vector<float>& q) {
+    std::vector<float> res(q.size(), 0.f);
+    quantile_counting(data, size, q.data(), q.size(), res.data());
+    return res;
+}
+
+torch::Tensor quantile_counting(const torch::Tensor t, const torch::Tensor q) {
+    assert(q.dtype() == torch::kF32);
+    assert(t.dtype() == torch::kInt16 && t.is_contiguous());
+
+    const auto q_contiguous = q.contiguous();
+    const float* const q_ptr = q_contiguous.data_ptr<float>();
+    const auto quantiles = quantile_counting(t.data_ptr<std::int16_t>(), t.size(0),
+                                             std::vector<float>(q_ptr, q_ptr + q.numel()));
+
+    auto res = torch::empty_like(q);
+    std::memcpy(res.data_ptr<float>(), quantiles.data(), quantiles.size() * sizeof(float));
     return res;
 }
 
+torch::Tensor segment_quantiles(const torch::Tensor& samples,
+                                const std::vector<std::int64_t>& lengths,
+                                const std::vector<float>& q) {
+    assert(samples.dtype() == torch::kInt16 && samples.dim() == 1);
+    const auto device = samples.device();
+    const auto num_segments = static_cast<std::int64_t>(lengths.size());
+    const auto num_q = static_cast<std::int64_t>(q.size());
+
+    // Each sample's key orders it by its segment first and its value second, so one sort
+    // leaves every segment's samples in order, and in place.
+    constexpr std::int64_t kValueRange = 1 << 16;
+    const auto int64_options = torch::TensorOptions().dtype(torch::kInt64);
+    const auto segment_ids = torch::repeat_interleave(
+            torch::arange(num_segments, int64_options.device(device)),
+            torch::tensor(lengths, int64_options).to(device));
+    const auto keys = segment_ids * kValueRange + samples.to(torch::kInt64) + kValueRange / 2;
+    const auto sorted_keys = std::get<0>(keys.sort());
+
+    std::vector<std::int64_t> positions;
+    positions.reserve(num_segments * num_q);
+    std::int64_t start = 0;
+    for (const auto length : lengths) {
+        if (length == 0) {
+            throw std::runtime_error("segment_quantiles requires at least one sample per segment");
+        }
+        for (const float q_value : q) {
+            positions.push_back(start + static_cast<std::int64_t>(q_value * (length - 1)));
+        }
+        start += length;
+    }
+    const auto quantile_keys =
+            sorted_keys.index_select(0, torch::tensor(positions, int64_options).to(device));
+    return (quantile_keys.remainder(kValueRange) - kValueRange / 2)
+            .to(torch::kFloat)
+            .view({num_segments, num_q});
+}
+
 // Multiversioned function dispatch doesn't work across the dorado_lib linking
 // boundary.  Without this wrapper, AVX machines still only execute the default
 // version.
@@ -143,34 +433,184 @@ void convert_f32_to_f16(c10::Half* const dest, const float* const src, std::size
     return convert_f32_to_f16_impl(dest, src, count);
 }
 
+torch::Tensor scale_i16_to_f16(const torch::Tensor& samples, float shift, float scale) {
+    assert(samples.dtype() == torch::kInt16 && samples.is_contiguous());
+    auto scaled = SignalBufferPool::shared()
+                          .allocate(samples.numel(), torch::kFloat16)
+                          .view(samples.sizes());
+    scale_i16_to_f16_impl(scaled.data_ptr<c10::Half>(), samples.data_ptr<std::int16_t>(),
+                          samples.numel(), shift, scale);
+    return scaled;
+}
+
 void copy_tensor_elems(torch::Tensor& dest_tensor,
-                       std::size_t dest_offset,
                        const torch::Tensor& src_tensor,
-                       std::size_t src_offset,
-                       std::size_t count) {
+                       const std::vector<TensorCopyRange>& ranges) {
     assert(dest_tensor.is_contiguous());
     assert(src_tensor.is_contiguous());
-    assert(dest_offset + count <= dest_tensor.numel());
-    assert(src_offset + count <= src_tensor.numel());
+#ifndef NDEBUG
+    for (const auto& range : ranges) {
+        assert(range.dest_offset + range.count <= size_t(dest_tensor.numel()));
+        assert(range.src_offset + range.count <= size_t(src_tensor.numel()));
+    }
+#endif
 
+    // The dtypes and data pointers are resolved once for all of the ranges.
     if (dest_tensor.dtype() == src_tensor.dtype()) {
         // No conversion.
         auto* const dest_ptr = reinterpret_cast<std::byte*>(dest_tensor.data_ptr());
         const auto* const src_ptr = reinterpret_cast<std::byte*>(src_tensor.data_ptr());
         const size_t elem_size = dest_tensor.element_size();
-        std::memcpy(&dest_ptr[dest_offset * elem_size], &src_ptr[src_offset * elem_size],
-                    count * elem_size);
+        for (const auto& range : ranges) {
+            std::memcpy(&dest_ptr[range.dest_offset * elem_size],
+                        &src_ptr[range.src_offset * elem_size], range.count * elem_size);
+        }
     } else if (dest_tensor.dtype() == torch::kFloat16 && src_tensor.dtype() == torch::kFloat32) {
         // float32 -> float16 conversion.
         auto* const dest_ptr = dest_tensor.data_ptr<c10::Half>();
         const auto* const src_ptr = src_tensor.data_ptr<float>();
-        convert_f32_to_f16_impl(&dest_ptr[dest_offset], &src_ptr[src_offset], count);
+        for (const auto& range : ranges) {
+            convert_f32_to_f16_impl(&dest_ptr[range.dest_offset], &src_ptr[range.src_offset],
+                                    range.count);
+        }
+    } else if (dest_tensor.dtype() == torch::kFloat32 && src_tensor.dtype() == torch::kFloat16) {
+        // float16 -> float32 conversion.
+        auto* const dest_ptr = dest_tensor.data_ptr<float>();
+        const auto* const src_ptr = src_tensor.data_ptr<c10::Half>();
+        for (const auto& range : ranges) {
+            convert_f16_to_f32_impl(&dest_ptr[range.dest_offset], &src_ptr[range.src_offset],
+                                    range.count);
+        }
     } else {
         // Slow fallback path for other conversions.
         using torch::indexing::Slice;
-        dest_tensor.flatten().index_put_(
-                {Slice(dest_offset, dest_offset + count)},
-                src_tensor.flatten().index({Slice(src_offset, src_offset + count)}));
+        auto dest_flat = dest_tensor.flatten();
+        const auto src_flat = src_tensor.flatten();
+        for (const auto& range : ranges) {
+            dest_flat.index_put_(
+                    {Slice(range.dest_offset, range.dest_offset + range.count)},
+                    src_flat.index({Slice(range.src_offset, range.src_offset + range.count)}));
+        }
+    }
+}
+
+void copy_tensor_elems(torch::Tensor& dest_tensor,
+                       std::size_t dest_offset,
+                       const torch::Tensor& src_tensor,
+                       std::size_t src_offset,
+                       std::size_t count) {
+    copy_tensor_elems(dest_tensor, src_tensor, {{dest_offset, src_offset, count}});
+}
+
+void gather_chunks(torch::Tensor& batch,
+                   std::size_t first_idx,
+                   const std::vector<ChunkSource>& sources) {
+    assert(batch.is_contiguous() && batch.dim() == 3);
+    assert(first_idx + sources.size() <= size_t(batch.size(0)));
+    const size_t num_channels = batch.size(1);
+    const size_t chunk_size = batch.size(2);
+
+    std::vector<TensorCopyRange> ranges;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        torch::Tensor signal = *sources[i].signal;
+        if (signal.dtype() != batch.dtype() &&
+            !(signal.dtype() == torch::kFloat16 && batch.dtype() == torch::kFloat32)) {
+            signal = signal.to(batch.dtype());
+        }
+        if (signal.dim() == 1) {
+            signal = signal.unsqueeze(0);
+        }
+        if (signal.stride(1) != 1) {
+            signal = signal.contiguous();
+        }
+        assert(size_t(signal.size(0)) == num_channels);
+        const size_t signal_len = signal.size(1);
+        const size_t offset = sources[i].offset;
+        assert(offset < signal_len);
+
+        for (size_t channel = 0; channel < num_channels; ++channel) {
+            // Each channel's samples are contiguous even when the signal is a column slice of
+            // a wider tensor, as stereo encoded signals are.
+            const auto src_row = signal[channel];
+            size_t dest_offset = ((first_idx + i) * num_channels + channel) * chunk_size;
+            size_t remaining = chunk_size;
+            ranges.clear();
+            while (remaining > 0) {
+                const size_t count = std::min(remaining, signal_len - offset);
+                ranges.push_back({dest_offset, offset, count});
+                dest_offset += count;
+                remaining -= count;
+            }
+            copy_tensor_elems(batch, src_row, ranges);
+        }
+    }
+}
+
+namespace {
+
+// Interleaves the channels of a chunk's samples, of type T, into a channels last batch.  The
+// samples are repeated if there are fewer than chunk_size of them.
+template <typename T>
+void interleave_chunk(T* dest,
+                      const T* src,
+                      size_t num_channels,
+                      size_t signal_len,
+                      size_t chunk_size) {
+    for (size_t channel = 0; channel < num_channels; ++channel) {
+        const T* const src_row = src + channel * signal_len;
+        size_t pos = 0;
+        for (size_t t = 0; t < chunk_size; ++t) {
+            dest[t * num_channels + channel] = src_row[pos];
+            if (++pos == signal_len) {
+                pos = 0;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void gather_chunks_channels_last(torch::Tensor& batch,
+                                 std::size_t first_idx,
+                                 const std::vector<ChunkSource>& sources) {
+    assert(batch.is_contiguous() && batch.dim() == 3);
+    assert(first_idx + sources.size() <= size_t(batch.size(0)));
+    const size_t chunk_size = batch.size(1);
+    const size_t num_channels = batch.size(2);
+    if (num_channels == 1) {
+        // A single channel is laid out the same either way.
+        auto channels_first = batch.view({batch.size(0), 1, batch.size(1)});
+        gather_chunks(channels_first, first_idx, sources);
+        return;
+    }
+
+    using torch::indexing::Slice;
+    const size_t elem_size = batch.element_size();
+    auto* const dest_ptr = reinterpret_cast<std::byte*>(batch.data_ptr());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const torch::Tensor& source = *sources[i].signal;
+        assert(source.dim() == 2 && size_t(source.size(0)) == num_channels);
+        assert(sources[i].offset < size_t(source.size(1)));
+        // Only the chunk's own samples are converted and made contiguous.
+        const auto begin = static_cast<int64_t>(sources[i].offset);
+        const auto end = std::min(begin + static_cast<int64_t>(chunk_size), source.size(1));
+        const auto signal =
+                source.index({Slice(), Slice(begin, end)}).to(batch.dtype()).contiguous();
+        const size_t signal_len = signal.size(1);
+
+        auto* const dest = dest_ptr + (first_idx + i) * chunk_size * num_channels * elem_size;
+        const auto* const src = signal.data_ptr();
+        if (elem_size == 2) {
+            interleave_chunk(reinterpret_cast<uint16_t*>(dest),
+                             static_cast<const uint16_t*>(src), num_channels, signal_len,
+                             chunk_size);
+        } else if (elem_size == 4) {
+            interleave_chunk(reinterpret_cast<uint32_t*>(dest),
+                             static_cast<const uint32_t*>(src), num_channels, signal_len,
+                             chunk_size);
+        } else {
+            throw std::runtime_error("Unsupported batch dtype for channels last chunks");
+        }
     }
 }
 
@@ -3,6 +3,7 @@
 #include <torch/torch.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -11,7 +12,8 @@ namespace dorado::utils {
 
 // Serialise Torch tensor to disk.
 void serialise_tensor(torch::Tensor t, const std::string& path);
-// Load serialised tensor from disk.
+// Load serialised tensor from disk.  If dir has been packed with pack_model_weights, the
+// tensors are views of the memory-mapped packed file instead.
 std::vector<torch::Tensor> load_tensors(const std::filesystem::path& dir,
                                         const std::vector<std::string>& tensors);
 
@@ -25,10 +27,37 @@ torch::Tensor quantile(const torch::Tensor t, const torch::Tensor q);
 // Only `interpolation='lower'` is currently implemented.
 torch::Tensor quantile_counting(const torch::Tensor t, const torch::Tensor q);
 
+// As above, for size int16 samples pointed to by data, writing the num_q quantiles q to
+// result.  This is a single vectorised min/max pass and a single histogram pass over the
+// samples, with no torch calls or allocation.
+void quantile_counting(const std::int16_t* data,
+                       std::size_t size,
+                       const float* q,
+                       std::size_t num_q,
+                       float* result);
+
+// As above, returning one value per entry of q.
+std::vector<float> quantile_counting(const std::int16_t* data,
+                                     std::size_t size,
+                                     const std::vector<float>& q);
+
+// Computes the q-th quantiles of each of the int16 signals concatenated in the 1D tensor
+// samples, the i-th of which has lengths[i] samples, returning a (signals, q) float tensor on
+// samples' device.  Results match quantile_counting: only `interpolation='lower'` is
+// implemented.  The signals are all sorted at once, so a batch costs one sort on the device.
+torch::Tensor segment_quantiles(const torch::Tensor& samples,
+                                const std::vector<std::int64_t>& lengths,
+                                const std::vector<float>& q);
+
 // Converts count float elements pointed to by src to half precision, with
 // the result pointed to by dest.
 void convert_f32_to_f16(c10::Half* dest, const float* src, std::size_t count);
 
+// Returns (samples - shift) / scale in half precision, for the contiguous int16 CPU tensor
+// samples.  This is computed in single precision, as it would be via torch, but without
+// float32 temporaries.
+torch::Tensor scale_i16_to_f16(const torch::Tensor& samples, float shift, float scale);
+
 // Copies count elements from src_offset elements into src to
 // dest_elements into dst.  The tensors must be contiguous.
 void copy_tensor_elems(torch::Tensor& dest_tensor,
@@ -37,4 +66,41 @@ void copy_tensor_elems(torch::Tensor& dest_tensor,
                        std::size_t src_offset,
                        std::size_t count);
 
+// A run of count elements copied by copy_tensor_elems.
+struct TensorCopyRange {
+    std::size_t dest_offset;
+    std::size_t src_offset;
+    std::size_t count;
+};
+
+// As above, for each of ranges, with the dtypes and data pointers resolved only once.
+void copy_tensor_elems(torch::Tensor& dest_tensor,
+                       const torch::Tensor& src_tensor,
+                       const std::vector<TensorCopyRange>& ranges);
+
+// Where a chunk's samples start in its source signal, which has shape (T) or (C, T)
+// with timesteps contiguous.
+struct ChunkSource {
+    const torch::Tensor* signal;
+    std::size_t offset;
+    // Output steps at the start of the chunk which are kept once it is stitched, and so worth
+    // decoding, or 0 for all of them.  Runners whose decoder can't stop early ignore it.
+    std::size_t num_decode_steps{0};
+};
+
+// Fills consecutive entries of the contiguous (N, C, chunk size) CPU batch tensor, starting at
+// first_idx, with a chunk's worth of samples from each source.  Chunks that run off the end of
+// their signal are padded by repeating the samples they do have.  Copies are straight memcpys
+// when the signal and batch dtypes match.
+void gather_chunks(torch::Tensor& batch,
+                   std::size_t first_idx,
+                   const std::vector<ChunkSource>& sources);
+
+// As gather_chunks, for a contiguous (N, chunk size, C) batch with channels innermost, as the
+// Metal convolution kernels take their input, so that chunks are written straight into place
+// rather than gathered and then transposed.
+void gather_chunks_channels_last(torch::Tensor& batch,
+                                 std::size_t first_idx,
+                                 const std::vector<ChunkSource>& sources);
+
 }  // namespace dorado::utils
@@ -0,0 +1,35 @@
+#include "thread_qos.h"
+
+#include <spdlog/spdlog.h>
+
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+
+namespace dorado::utils {
+
+bool set_thread_qos(ThreadQoS qos) {
+#ifdef __APPLE__
+    qos_class_t qos_class = QOS_CLASS_UTILITY;
+    switch (qos) {
+    case ThreadQoS::Interactive:
+        qos_class = QOS_CLASS_USER_INTERACTIVE;
+        break;
+    case ThreadQoS::UserInitiated:
+        qos_class = QOS_CLASS_USER_INITIATED;
+        break;
+    case ThreadQoS::Utility:
+        qos_class = QOS_CLASS_UTILITY;
+        break;
+    }
+    if (pthread_set_qos_class_self_np(qos_class, 0) != 0) {
+        spdlog::debug("Unable to set thread QoS class {}", static_cast<int>(qos_class));
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+}  // namespace dorado::utils
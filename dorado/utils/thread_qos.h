@@ -0,0 +1,22 @@
+#pragma once
+
+namespace dorado::utils {
+
+// Quality of service classes for the pipeline's threads.  On Apple silicon the class decides
+// whether the scheduler keeps a thread on the performance cores or lets it drift onto the
+// efficiency cores.  Other platforms have no equivalent, and the class is ignored.
+enum class ThreadQoS {
+    // Threads a GPU waits on, such as those staging its batches or decoding its scores.
+    // These should number no more than the performance cores.
+    Interactive,
+    // The CPU stages of the pipeline.
+    UserInitiated,
+    // Reading input ahead and writing output, which can lag briefly without holding up calling.
+    Utility,
+};
+
+// Sets the calling thread's QoS class.  Returns false if the class couldn't be set, or has no
+// meaning on this platform.
+bool set_thread_qos(ThreadQoS qos);
+
+}  // namespace dorado::utils
@@ -3,9 +3,12 @@
 #include <date/tz.h>
 
 #include <chrono>
+#include <cstdint>
 #include <ctime>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 namespace dorado::utils {
 
@@ -39,6 +42,85 @@ inline time_t get_unix_time_from_string_timestamp(const std::string& time_stamp)
     return value.count();
 }
 
+namespace details {
+// Reads count decimal digits from ts at pos into value.
+inline bool parse_digits(std::string_view ts, size_t pos, size_t count, int& value) {
+    if (pos + count > ts.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = pos; i < pos + count; ++i) {
+        if (ts[i] < '0' || ts[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (ts[i] - '0');
+    }
+    return true;
+}
+}  // namespace details
+
+// Parses a timestamp encoded like "2017-09-12T09:50:12.456+00:00" or "2017-09-12T09:50:12Z" into
+// microseconds since the epoch, much faster than through date::parse and a stream.  Returns
+// std::nullopt if the timestamp isn't in one of these forms.
+inline std::optional<int64_t> parse_timestamp_us(std::string_view ts) {
+    using details::parse_digits;
+    int year, month, day, hours, minutes, seconds;
+    if (!parse_digits(ts, 0, 4, year) || ts.size() < 19 || ts[4] != '-' ||
+        !parse_digits(ts, 5, 2, month) || ts[7] != '-' || !parse_digits(ts, 8, 2, day) ||
+        ts[10] != 'T' || !parse_digits(ts, 11, 2, hours) || ts[13] != ':' ||
+        !parse_digits(ts, 14, 2, minutes) || ts[16] != ':' || !parse_digits(ts, 17, 2, seconds)) {
+        return std::nullopt;
+    }
+    const date::year_month_day ymd{date::year{year}, date::month(month), date::day(day)};
+    if (!ymd.ok() || hours > 23 || minutes > 59 || seconds > 60) {
+        return std::nullopt;
+    }
+
+    size_t pos = 19;
+    int64_t fraction_us = 0;
+    if (pos < ts.size() && ts[pos] == '.') {
+        // Digits past microseconds are truncated.
+        const size_t first_digit = ++pos;
+        int64_t scale = 100000;
+        for (; pos < ts.size() && ts[pos] >= '0' && ts[pos] <= '9'; ++pos, scale /= 10) {
+            fraction_us += (ts[pos] - '0') * scale;
+        }
+        if (pos == first_digit) {
+            return std::nullopt;
+        }
+    }
+
+    int64_t offset_minutes = 0;
+    if (pos < ts.size() && ts[pos] == 'Z') {
+        ++pos;
+    } else if (pos < ts.size() && (ts[pos] == '+' || ts[pos] == '-')) {
+        const int sign = ts[pos] == '-' ? -1 : 1;
+        int offset_hours, offset_mins;
+        if (!parse_digits(ts, pos + 1, 2, offset_hours)) {
+            return std::nullopt;
+        }
+        pos += 3;
+        if (pos < ts.size() && ts[pos] == ':') {
+            ++pos;
+        }
+        if (!parse_digits(ts, pos, 2, offset_mins)) {
+            return std::nullopt;
+        }
+        pos += 2;
+        offset_minutes = sign * (offset_hours * 60 + offset_mins);
+    } else {
+        return std::nullopt;
+    }
+    if (pos != ts.size()) {
+        return std::nullopt;
+    }
+
+    const int64_t days = date::sys_days(ymd).time_since_epoch().count();
+    const int64_t time_s =
+            days * 86400 + hours * 3600 + minutes * 60 + seconds - offset_minutes * 60;
+    return time_s * 1000000 + fraction_us;
+}
+
 inline std::string adjust_time_ms(const std::string& time_stamp, uint64_t offset_ms) {
     return get_string_timestamp_from_unix_time(get_unix_time_from_string_timestamp(time_stamp) +
                                                offset_ms);
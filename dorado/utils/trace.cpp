@@ -0,0 +1,140 @@
+#include "trace.h"
+
+#include <spdlog/spdlog.h>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t start_us;
+    int64_t duration_us;
+};
+
+// Each thread records into a buffer of its own, which outlives the thread so that its events
+// are still written.
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t tid = 0;
+};
+
+// Enough for a long run at the granularity spans are placed, without using more than a few
+// hundred MB.
+constexpr size_t kMaxEvents = size_t(1) << 24;
+
+std::mutex g_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+std::filesystem::path g_path;
+std::chrono::steady_clock::time_point g_start_time;
+std::atomic<size_t> g_num_events{0};
+std::atomic<size_t> g_num_dropped{0};
+
+ThreadBuffer& thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto new_buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard lock(g_mutex);
+        new_buffer->tid = g_buffers.size();
+        g_buffers.push_back(new_buffer);
+        return new_buffer;
+    }();
+    return *buffer;
+}
+
+void write_json_string(std::ostream& out, const char* str) {
+    out << '"';
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            out << '\\';
+        }
+        out << *str;
+    }
+    out << '"';
+}
+
+}  // namespace
+
+namespace dorado::utils::trace {
+
+namespace detail {
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                 g_start_time)
+            .count();
+}
+
+void record(const char* name, int64_t start_us, int64_t end_us) {
+    if (g_num_events.fetch_add(1, std::memory_order_relaxed) >= kMaxEvents) {
+        g_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto& buffer = thread_buffer();
+    std::lock_guard lock(buffer.mutex);
+    buffer.events.push_back({name, start_us, end_us - start_us});
+}
+
+}  // namespace detail
+
+void start(const std::filesystem::path& path) {
+    std::lock_guard lock(g_mutex);
+    for (auto& buffer : g_buffers) {
+        std::lock_guard buffer_lock(buffer->mutex);
+        buffer->events.clear();
+    }
+    g_path = path;
+    g_num_events = 0;
+    g_num_dropped = 0;
+    g_start_time = std::chrono::steady_clock::now();
+    detail::g_enabled.store(true);
+}
+
+void stop() {
+    if (!detail::g_enabled.exchange(false)) {
+        return;
+    }
+
+    std::lock_guard lock(g_mutex);
+    std::ofstream out(g_path);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    size_t num_written = 0;
+    for (auto& buffer : g_buffers) {
+        std::lock_guard buffer_lock(buffer->mutex);
+        for (const auto& event : buffer->events) {
+            out << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->tid
+                << ",\"ts\":" << event.start_us << ",\"dur\":" << event.duration_us
+                << ",\"name\":";
+            write_json_string(out, event.name);
+            out << '}';
+            first = false;
+        }
+        num_written += buffer->events.size();
+        buffer->events.clear();
+        buffer->events.shrink_to_fit();
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        spdlog::error("Failed to write trace to {}", g_path.string());
+        return;
+    }
+    spdlog::info("> Wrote {} trace spans to {}", num_written, g_path.string());
+    if (g_num_dropped > 0) {
+        spdlog::warn("> {} trace spans were dropped once the trace was full", g_num_dropped.load());
+    }
+}
+
+const char* intern(const std::string& name) {
+    static std::mutex mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard lock(mutex);
+    return names.insert(name).first->c_str();
+}
+
+}  // namespace dorado::utils::trace
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <nvtx3/nvtx3.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Spans of work, recorded as NVTX ranges for Nsight and, while a trace is being exported, as
+// Chrome trace events, which Perfetto and chrome://tracing display, so that production runs
+// can be profiled on hosts without any CUDA tooling.
+namespace dorado::utils::trace {
+
+namespace detail {
+inline std::atomic<bool> g_enabled{false};
+int64_t now_us();
+void record(const char* name, int64_t start_us, int64_t end_us);
+}  // namespace detail
+
+// Starts recording spans, which stop() writes to path as a Chrome trace event JSON file.
+void start(const std::filesystem::path& path);
+// Writes the spans recorded since start(), and stops recording.  Does nothing if no trace
+// was started.
+void stop();
+
+inline bool is_enabled() { return detail::g_enabled.load(std::memory_order_acquire); }
+
+// A copy of name which lives as long as the process, for spans named at runtime.
+const char* intern(const std::string& name);
+
+// Records the span from its construction to its destruction.  name must outlive the trace, as
+// string literals and interned names do.
+class Span {
+public:
+    explicit Span(const char* name) : m_nvtx_range(name), m_name(name) {
+        if (is_enabled()) {
+            m_start_us = detail::now_us();
+        }
+    }
+    ~Span() {
+        if (m_start_us >= 0) {
+            detail::record(m_name, m_start_us, detail::now_us());
+        }
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    nvtx3::scoped_range m_nvtx_range;
+    const char* m_name;
+    int64_t m_start_us = -1;
+};
+
+}  // namespace dorado::utils::trace
+
+#define DORADO_TRACE_CONCAT_INNER(a, b) a##b
+#define DORADO_TRACE_CONCAT(a, b) DORADO_TRACE_CONCAT_INNER(a, b)
+// Traces the rest of the enclosing scope as name.
+#define DORADO_TRACE_SCOPE(name) \
+    ::dorado::utils::trace::Span DORADO_TRACE_CONCAT(dorado_trace_span_, __LINE__)(name)
+// Traces the rest of the enclosing function, named after it.
+#define DORADO_TRACE_FUNCTION() DORADO_TRACE_SCOPE(__func__)
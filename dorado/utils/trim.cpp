@@ -1,33 +1,36 @@
 #include "trim.h"
 
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 
-namespace dorado::utils {
+namespace {
 
-int trim(const torch::Tensor &signal, float threshold, int window_size, int min_elements) {
+template <typename T>
+int trim_samples(const T *const signal,
+                 int signal_len,
+                 float threshold,
+                 int window_size,
+                 int min_elements) {
     const int min_trim = 10;
-    const int num_samples = static_cast<int>(signal.size(0)) - min_trim;
+    const int num_samples = signal_len - min_trim;
     const int num_windows = num_samples / window_size;
 
-    // Access via raw pointers because of torch indexing overhead.
-    const auto signal_f32 = signal.to(torch::kFloat32);
-    assert(signal_f32.is_contiguous());
-    const float *const signal_f32_ptr = signal_f32.data_ptr<float>();
-
     bool seen_peak = false;
     for (int pos = 0; pos < num_windows; ++pos) {
         const int start = pos * window_size + min_trim;
         const int end = start + window_size;
-        assert(start < signal.size(0));
-        assert(end <= signal.size(0));  // end is exclusive
+        assert(start < signal_len);
+        assert(end <= signal_len);  // end is exclusive
 
         const auto num_large_enough =
-                std::count_if(&signal_f32_ptr[start], &signal_f32_ptr[end],
-                              [threshold](float elem) { return elem > threshold; });
+                std::count_if(&signal[start], &signal[end], [threshold](T elem) {
+                    return static_cast<float>(elem) > threshold;
+                });
 
         if (num_large_enough > min_elements || seen_peak) {
             seen_peak = true;
-            if (signal_f32_ptr[end - 1] > threshold) {
+            if (static_cast<float>(signal[end - 1]) > threshold) {
                 continue;
             }
             if (end >= num_samples) {
@@ -41,4 +44,80 @@ int trim(const torch::Tensor &signal, float threshold, int window_size, int min_
     return min_trim;
 }
 
-}  // namespace dorado::utils
\ No newline at end of file
+template <typename T>
+int trim_adapter_tail_samples(const T *const signal,
+                              int signal_len,
+                              int start,
+                              const dorado::utils::TailTrimParams &params) {
+    const int window_size = params.window_size;
+    const int search_end = std::min(signal_len, start + params.max_search_samples);
+
+    int best_end = start;
+    int best_windows = 0;
+    int run_windows = 0;
+    float run_level = 0.f;
+    for (int pos = start; pos + window_size <= signal_len; pos += window_size) {
+        float sum = 0.f;
+        float sum_sq = 0.f;
+        for (int i = pos; i < pos + window_size; ++i) {
+            const auto value = static_cast<float>(signal[i]);
+            sum += value;
+            sum_sq += value * value;
+        }
+        const float mean = sum / window_size;
+        const float variance = std::max(0.f, sum_sq / window_size - mean * mean);
+
+        const bool flat = std::sqrt(variance) < params.max_window_stdev;
+        if (flat && run_windows > 0 && std::abs(mean - run_level) < params.max_level_step) {
+            ++run_windows;
+        } else if (flat && pos < search_end) {
+            run_windows = 1;
+            run_level = mean;
+        } else {
+            run_windows = 0;
+        }
+
+        if (run_windows > best_windows) {
+            best_windows = run_windows;
+            best_end = pos + window_size;
+        } else if (run_windows == 0 && pos >= search_end) {
+            // No run in progress, and none can start any later.
+            break;
+        }
+    }
+
+    if (best_windows < params.min_tail_windows ||
+        best_end + params.min_remaining_samples > signal_len) {
+        return start;
+    }
+    return best_end;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+int trim(const torch::Tensor &signal, float threshold, int window_size, int min_elements) {
+    const int signal_len = static_cast<int>(signal.size(0));
+
+    // Access via raw pointers because of torch indexing overhead.  Half precision signals,
+    // as sent on by the scaler, are read in place rather than converted to a float32 copy.
+    if (signal.dtype() == torch::kFloat16 && signal.is_contiguous()) {
+        return trim_samples(signal.data_ptr<c10::Half>(), signal_len, threshold, window_size,
+                            min_elements);
+    }
+    const auto signal_f32 = signal.to(torch::kFloat32).contiguous();
+    return trim_samples(signal_f32.data_ptr<float>(), signal_len, threshold, window_size,
+                        min_elements);
+}
+
+int trim_adapter_tail(const torch::Tensor &signal, int start, const TailTrimParams &params) {
+    const int signal_len = static_cast<int>(signal.size(0));
+    if (signal.dtype() == torch::kFloat16 && signal.is_contiguous()) {
+        return trim_adapter_tail_samples(signal.data_ptr<c10::Half>(), signal_len, start, params);
+    }
+    const auto signal_f32 = signal.to(torch::kFloat32).contiguous();
+    return trim_adapter_tail_samples(signal_f32.data_ptr<float>(), signal_len, start, params);
+}
+
+}  // namespace dorado::utils
@@ -9,4 +9,23 @@ int trim(const torch::Tensor &signal,
          int window_size = 40,
          int min_elements = 3);
 
+// Settings for finding a polyA/T tail in normalised signal.
+struct TailTrimParams {
+    int window_size = 50;
+    // Windows of the tail are flatter than this, and all within max_level_step of the level
+    // of its first window.
+    float max_window_stdev = 0.25f;
+    float max_level_step = 0.25f;
+    int min_tail_windows = 4;
+    // The tail starts within this many samples of the start of the search.
+    int max_search_samples = 20000;
+    // Samples which must be left after the tail for it to be trimmed.
+    int min_remaining_samples = 500;
+};
+
+// Finds the longest flat stretch of normalised signal after start, as made by a polyA/T
+// tail, and returns its end, so that the adapter before the tail is trimmed along with it.
+// Returns start if there is no such stretch.
+int trim_adapter_tail(const torch::Tensor &signal, int start, const TailTrimParams &params = {});
+
 }  // namespace dorado::utils
\ No newline at end of file
@@ -1,4 +1,4 @@
-#include "alignment_utils.h"
+#include "uuid_utils.h"
 
 #include <openssl/sha.h>
 
@@ -9,6 +9,56 @@
 
 namespace dorado::utils {
 
+std::optional<ReadID> parse_read_id(std::string_view read_id_str) {
+    auto hex_value = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+    // 32 hex digits and 4 dashes.
+    if (read_id_str.size() != 36) {
+        return std::nullopt;
+    }
+    ReadID read_id;
+    size_t byte_idx = 0;
+    for (size_t i = 0; i < read_id_str.size(); ++i) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (read_id_str[i] != '-') {
+                return std::nullopt;
+            }
+            continue;
+        }
+        const int high = hex_value(read_id_str[i]);
+        const int low = hex_value(read_id_str[++i]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        read_id[byte_idx++] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return read_id;
+}
+
+std::string format_read_id(const ReadID& read_id) {
+    constexpr char kHexDigits[] = "0123456789abcdef";
+    std::string read_id_str;
+    read_id_str.reserve(36);
+    for (size_t i = 0; i < read_id.size(); ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            read_id_str += '-';
+        }
+        read_id_str += kHexDigits[read_id[i] >> 4];
+        read_id_str += kHexDigits[read_id[i] & 0xf];
+    }
+    return read_id_str;
+}
+
 std::string derive_uuid(const std::string& input_uuid, const std::string& desc) {
     // Hash the input UUID using SHA-256
     unsigned char hash[SHA256_DIGEST_LENGTH];
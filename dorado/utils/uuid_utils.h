@@ -1,9 +1,19 @@
 #pragma once
 
+#include "ReadIDMap.h"
+
+#include <optional>
 #include <string>
+#include <string_view>
 
 namespace dorado::utils {
 
+// Parses a read ID formatted as a UUID, e.g. by pod5_format_read_id.  Returns std::nullopt if
+// it isn't one.
+std::optional<ReadID> parse_read_id(std::string_view read_id_str);
+// Formats a read ID as a lower case UUID, the inverse of parse_read_id.
+std::string format_read_id(const ReadID& read_id);
+
 /**
  * @brief Generates a derived UUID from a given input UUID and a description string.
  *
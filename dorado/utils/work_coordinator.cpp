@@ -0,0 +1,283 @@
+#include "work_coordinator.h"
+
+// Must match dorado/utils/models.cpp, which includes httplib in the same library.
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace dorado::utils {
+
+std::vector<WorkUnit> plan_work_units(const std::vector<std::pair<std::string, size_t>>& files,
+                                      size_t batches_per_unit) {
+    batches_per_unit = std::max<size_t>(batches_per_unit, 1);
+    std::vector<WorkUnit> units;
+    for (const auto& [path, num_batches] : files) {
+        for (size_t first = 0; first < num_batches; first += batches_per_unit) {
+            units.push_back({units.size(), path, first,
+                             std::min(first + batches_per_unit, num_batches)});
+        }
+    }
+    return units;
+}
+
+WorkUnitTracker::WorkUnitTracker(std::vector<WorkUnit> units, Clock::duration lease_timeout)
+        : m_lease_timeout(lease_timeout) {
+    m_units.reserve(units.size());
+    for (auto& unit : units) {
+        m_units.push_back({std::move(unit)});
+    }
+}
+
+std::optional<WorkUnit> WorkUnitTracker::lease(const std::string& worker, Clock::time_point now) {
+    std::lock_guard lock(m_mutex);
+    for (auto& state : m_units) {
+        if (!state.complete && state.lease_expiry <= now) {
+            if (state.lease_expiry != Clock::time_point::min()) {
+                spdlog::warn("Lease of work unit {} expired, handing it to {}", state.unit.id,
+                             worker);
+            }
+            state.lease_expiry = now + m_lease_timeout;
+            return state.unit;
+        }
+    }
+    return std::nullopt;
+}
+
+bool WorkUnitTracker::complete(size_t id,
+                               const std::string& worker,
+                               const std::string& output_path) {
+    std::lock_guard lock(m_mutex);
+    auto it = std::find_if(m_units.begin(), m_units.end(),
+                           [id](const UnitState& state) { return state.unit.id == id; });
+    if (it == m_units.end() || it->complete) {
+        return false;
+    }
+    it->complete = true;
+    m_completed.push_back({it->unit, worker, output_path});
+    return true;
+}
+
+bool WorkUnitTracker::all_complete() const {
+    std::lock_guard lock(m_mutex);
+    return m_completed.size() == m_units.size();
+}
+
+std::vector<CompletedWorkUnit> WorkUnitTracker::completed() const {
+    std::lock_guard lock(m_mutex);
+    return m_completed;
+}
+
+void write_work_manifest(const std::filesystem::path& path,
+                         const std::vector<CompletedWorkUnit>& completed) {
+    const auto temp_path = path.string() + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        for (const auto& [unit, worker, output_path] : completed) {
+            out << details::format_work_unit(unit) << '\t' << worker << '\t' << output_path
+                << '\n';
+        }
+        if (!out) {
+            throw std::runtime_error("Failed to write " + temp_path);
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+std::vector<CompletedWorkUnit> read_work_manifest(const std::filesystem::path& path) {
+    std::vector<CompletedWorkUnit> completed;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        // The worker and output follow the unit's 4 fields.
+        std::vector<std::string> fields;
+        std::istringstream line_stream(line);
+        for (std::string field; std::getline(line_stream, field, '\t');) {
+            fields.push_back(std::move(field));
+        }
+        if (fields.size() != 6) {
+            throw std::runtime_error("Malformed line in work manifest " + path.string() + ": " +
+                                     line);
+        }
+        const auto unit = details::parse_work_unit(fields[0] + '\t' + fields[1] + '\t' +
+                                                   fields[2] + '\t' + fields[3]);
+        completed.push_back({unit, fields[4], fields[5]});
+    }
+    return completed;
+}
+
+WorkCoordinator::WorkCoordinator(int port,
+                                 const std::string& host,
+                                 std::vector<WorkUnit> units,
+                                 WorkUnitTracker::Clock::duration lease_timeout,
+                                 std::filesystem::path manifest_path)
+        : m_manifest_path(std::move(manifest_path)),
+          m_server(std::make_unique<httplib::Server>()) {
+    // Units from an earlier run of the coordinator are already done.
+    const auto previously_completed = read_work_manifest(m_manifest_path);
+    m_tracker = std::make_unique<WorkUnitTracker>(std::move(units), lease_timeout);
+    for (const auto& done : previously_completed) {
+        m_tracker->complete(done.unit.id, done.worker, done.output_path);
+    }
+    if (!previously_completed.empty()) {
+        spdlog::info("> {} of {} work units already complete", previously_completed.size(),
+                     m_tracker->num_units());
+    }
+
+    m_server->Post("/lease", [this](const httplib::Request& request, httplib::Response& response) {
+        if (!request.has_param("worker")) {
+            response.status = 400;
+            response.set_content("worker must be given\n", "text/plain");
+            return;
+        }
+        const auto worker = request.get_param_value("worker");
+        if (auto unit = m_tracker->lease(worker)) {
+            spdlog::debug("Leased work unit {} to {}", unit->id, worker);
+            response.set_content(details::format_work_unit(*unit) + "\n", "text/plain");
+        } else if (m_tracker->all_complete()) {
+            response.status = 204;
+        } else {
+            response.status = 503;
+            response.set_content("Every remaining unit is leased\n", "text/plain");
+        }
+    });
+    m_server->Post("/complete", [this](const httplib::Request& request,
+                                       httplib::Response& response) {
+        if (!request.has_param("worker") || !request.has_param("id") ||
+            !request.has_param("output")) {
+            response.status = 400;
+            response.set_content("worker, id and output must be given\n", "text/plain");
+            return;
+        }
+        const auto worker = request.get_param_value("worker");
+        size_t id = 0;
+        try {
+            id = std::stoull(request.get_param_value("id"));
+        } catch (const std::exception&) {
+            response.status = 400;
+            response.set_content("Invalid id\n", "text/plain");
+            return;
+        }
+        if (!m_tracker->complete(id, worker, request.get_param_value("output"))) {
+            response.status = 409;
+            response.set_content("Unit already complete\n", "text/plain");
+            return;
+        }
+        {
+            std::lock_guard lock(m_complete_mutex);
+            write_work_manifest(m_manifest_path, m_tracker->completed());
+        }
+        spdlog::info("> Work unit {} completed by {}", id, worker);
+        m_complete_cv.notify_all();
+        response.set_content("Completed\n", "text/plain");
+    });
+
+    if (!m_server->bind_to_port(host.c_str(), port)) {
+        throw std::runtime_error("Unable to coordinate work on " + host + ":" +
+                                 std::to_string(port));
+    }
+    m_server_thread = std::thread([this] { m_server->listen_after_bind(); });
+    spdlog::info("> Coordinating {} work units at http://{}:{}", m_tracker->num_units(), host,
+                 port);
+}
+
+WorkCoordinator::~WorkCoordinator() {
+    m_server->stop();
+    if (m_server_thread.joinable()) {
+        m_server_thread.join();
+    }
+}
+
+void WorkCoordinator::wait_for_completion() {
+    std::unique_lock lock(m_complete_mutex);
+    m_complete_cv.wait(lock, [this] { return m_tracker->all_complete(); });
+}
+
+WorkClient::WorkClient(const std::string& coordinator, std::string worker_name)
+        : m_worker_name(std::move(worker_name)) {
+    const auto colon = coordinator.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Coordinator must be given as host:port, not " + coordinator);
+    }
+    m_host = coordinator.substr(0, colon);
+    try {
+        m_port = std::stoi(coordinator.substr(colon + 1));
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid port in coordinator " + coordinator);
+    }
+}
+
+std::optional<WorkUnit> WorkClient::lease(std::chrono::milliseconds retry_interval) {
+    httplib::Client client(m_host, m_port);
+    while (true) {
+        auto response = client.Post("/lease", httplib::Params{{"worker", m_worker_name}});
+        if (!response) {
+            throw std::runtime_error("Unable to reach coordinator at " + m_host + ":" +
+                                     std::to_string(m_port));
+        }
+        if (response->status == 200) {
+            return details::parse_work_unit(response->body);
+        }
+        if (response->status == 204) {
+            return std::nullopt;
+        }
+        if (response->status != 503) {
+            throw std::runtime_error("Coordinator refused lease: " + response->body);
+        }
+        std::this_thread::sleep_for(retry_interval);
+    }
+}
+
+bool WorkClient::complete(const WorkUnit& unit, const std::string& output_path) {
+    httplib::Client client(m_host, m_port);
+    auto response = client.Post("/complete", httplib::Params{{"worker", m_worker_name},
+                                                             {"id", std::to_string(unit.id)},
+                                                             {"output", output_path}});
+    if (!response) {
+        throw std::runtime_error("Unable to reach coordinator at " + m_host + ":" +
+                                 std::to_string(m_port));
+    }
+    if (response->status == 409) {
+        return false;
+    }
+    if (response->status != 200) {
+        throw std::runtime_error("Coordinator refused completion: " + response->body);
+    }
+    return true;
+}
+
+namespace details {
+
+WorkUnit parse_work_unit(const std::string& text) {
+    std::istringstream fields(text);
+    WorkUnit unit{};
+    std::string id, first_batch, end_batch;
+    if (!std::getline(fields, id, '\t') || !std::getline(fields, unit.path, '\t') ||
+        !std::getline(fields, first_batch, '\t') || !std::getline(fields, end_batch)) {
+        throw std::runtime_error("Malformed work unit: " + text);
+    }
+    try {
+        unit.id = std::stoull(id);
+        unit.first_batch = std::stoull(first_batch);
+        unit.end_batch = std::stoull(end_batch);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Malformed work unit: " + text);
+    }
+    return unit;
+}
+
+std::string format_work_unit(const WorkUnit& unit) {
+    return std::to_string(unit.id) + '\t' + unit.path + '\t' + std::to_string(unit.first_batch) +
+           '\t' + std::to_string(unit.end_batch);
+}
+
+}  // namespace details
+
+}  // namespace dorado::utils
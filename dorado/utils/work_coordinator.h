@@ -0,0 +1,145 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace httplib {
+class Server;
+}
+
+namespace dorado::utils {
+
+// A piece of a distributed run: batches [first_batch, end_batch) of a POD5 file.
+struct WorkUnit {
+    size_t id;
+    std::string path;
+    size_t first_batch;
+    size_t end_batch;
+};
+
+// A work unit a worker has basecalled, and the file it wrote the unit's reads to.
+struct CompletedWorkUnit {
+    WorkUnit unit;
+    std::string worker;
+    std::string output_path;
+};
+
+// Splits each (path, number of batches) file into units of at most batches_per_unit batches,
+// numbered in order.
+std::vector<WorkUnit> plan_work_units(const std::vector<std::pair<std::string, size_t>>& files,
+                                      size_t batches_per_unit);
+
+// Hands out the units of a distributed run, one worker at a time each.  A unit whose worker
+// hasn't completed it within the lease timeout is handed out again, so units held by a worker
+// that died are still called.  The first completion of a unit is kept, and any later ones
+// rejected, so each unit's reads appear in exactly one output file.  Thread-safe.
+class WorkUnitTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    WorkUnitTracker(std::vector<WorkUnit> units, Clock::duration lease_timeout);
+
+    // Leases the next unit that isn't complete or leased to worker, or nullopt if there is
+    // none just now.
+    std::optional<WorkUnit> lease(const std::string& worker, Clock::time_point now = Clock::now());
+    // Records that worker has written unit id to output_path.  Returns false if the unit was
+    // already complete, or there is no such unit, in which case the output isn't needed.
+    bool complete(size_t id, const std::string& worker, const std::string& output_path);
+
+    bool all_complete() const;
+    size_t num_units() const { return m_units.size(); }
+    // Completed units, in the order they were completed.
+    std::vector<CompletedWorkUnit> completed() const;
+
+private:
+    struct UnitState {
+        WorkUnit unit;
+        bool complete = false;
+        // Unleased units have the minimum time.
+        Clock::time_point lease_expiry = Clock::time_point::min();
+    };
+
+    const Clock::duration m_lease_timeout;
+    mutable std::mutex m_mutex;
+    std::vector<UnitState> m_units;
+    std::vector<CompletedWorkUnit> m_completed;
+};
+
+// A manifest lists the completed units of a distributed run and the output file holding each,
+// one tab separated line per unit: id, POD5 path, first batch, end batch, worker and output
+// path.  Concatenating the outputs it lists gives the run's output with no read repeated.
+
+// Writes the manifest to path, replacing any there, so that it is never seen half written.
+void write_work_manifest(const std::filesystem::path& path,
+                         const std::vector<CompletedWorkUnit>& completed);
+// Reads a manifest written by write_work_manifest, or returns nothing if there isn't one.
+// Throws if it can't be parsed.
+std::vector<CompletedWorkUnit> read_work_manifest(const std::filesystem::path& path);
+
+// Serves a WorkUnitTracker's units to workers over HTTP, recording each completed unit in the
+// manifest as it completes, so that a restarted coordinator can skip them.
+//   POST /lease?worker=<name>
+//       responds with a unit as "<id>\t<path>\t<first batch>\t<end batch>", status 503 if
+//       every unit left is leased, so the worker should retry, or status 204 once every unit is
+//       complete.
+//   POST /complete?worker=<name>&id=<id>&output=<path>
+//       responds with status 409 if the unit was already completed by another worker.
+class WorkCoordinator {
+public:
+    // Units already in the manifest are not handed out again.  Throws if the port can't be
+    // bound.
+    WorkCoordinator(int port,
+                    const std::string& host,
+                    std::vector<WorkUnit> units,
+                    WorkUnitTracker::Clock::duration lease_timeout,
+                    std::filesystem::path manifest_path);
+    ~WorkCoordinator();
+
+    // Blocks until every unit is complete.
+    void wait_for_completion();
+
+private:
+    std::filesystem::path m_manifest_path;
+    std::unique_ptr<WorkUnitTracker> m_tracker;
+    std::unique_ptr<httplib::Server> m_server;
+    std::thread m_server_thread;
+    std::mutex m_complete_mutex;
+    std::condition_variable m_complete_cv;
+};
+
+// The worker's side of WorkCoordinator.
+class WorkClient {
+public:
+    // coordinator is the coordinator's "host:port".
+    WorkClient(const std::string& coordinator, std::string worker_name);
+
+    // Waits for a unit to be free, retrying every retry_interval while the rest are leased.
+    // Returns nullopt once every unit is complete.  Throws if the coordinator can't be reached.
+    std::optional<WorkUnit> lease(std::chrono::milliseconds retry_interval);
+    // Returns false if another worker completed the unit first.
+    bool complete(const WorkUnit& unit, const std::string& output_path);
+
+    const std::string& worker_name() const { return m_worker_name; }
+
+private:
+    std::string m_host;
+    int m_port;
+    std::string m_worker_name;
+};
+
+namespace details {
+// Parses a unit as formatted by /lease.  Throws if it can't be parsed.
+WorkUnit parse_work_unit(const std::string& text);
+std::string format_work_unit(const WorkUnit& unit);
+}  // namespace details
+
+}  // namespace dorado::utils
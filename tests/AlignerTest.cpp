@@ -3,12 +3,17 @@
 #include "htslib/sam.h"
 #include "read_pipeline/AlignerNode.h"
 #include "read_pipeline/HtsReader.h"
+#include "read_pipeline/HtsWriter.h"
 #include "utils/bam_utils.h"
 #include "utils/sequence_utils.h"
 
 #include <catch2/catch.hpp>
 
 #include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #define TEST_GROUP "[bam_utils][aligner]"
 
@@ -154,6 +159,50 @@ TEST_CASE("AlignerTest: Check dorado tags are retained", TEST_GROUP) {
     }
 }
 
+TEST_CASE("AlignerTest: Write alignments as CRAM", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    // The reference is copied, as its FASTA index is written alongside it.
+    const auto temp_dir = fs::temp_directory_path() / "aligner_cram_test";
+    fs::create_directories(temp_dir);
+    const auto ref = temp_dir / "basecall_target.fa";
+    fs::copy_file(aligner_test_dir / "basecall_target.fa", ref,
+                  fs::copy_options::overwrite_existing);
+    const auto out_cram = temp_dir / "out.cram";
+    auto query = aligner_test_dir / "basecall.sam";
+
+    {
+        dorado::HtsWriter writer(out_cram.string(), dorado::HtsWriter::OutputMode::CRAM, 2, 0,
+                                 "", "HtsWriter", 0, nullptr, -1, ref.string());
+        dorado::Aligner aligner(writer, ref.string(), 15, 15, 1e9, 2);
+        dorado::HtsReader reader(query.string());
+        auto* header = sam_hdr_dup(reader.header);
+        dorado::utils::add_sq_hdr(header, aligner.get_sequence_records_for_header());
+        writer.write_header(header);
+        sam_hdr_destroy(header);
+        reader.read(aligner, 100);
+        writer.join();
+    }
+
+    // The records read back decode against the reference, with their dorado tags.
+    std::unique_ptr<htsFile, decltype(&hts_close)> file(hts_open(out_cram.string().c_str(), "r"),
+                                                        hts_close);
+    REQUIRE(file);
+    CHECK(file->format.format == cram);
+    REQUIRE(hts_set_fai_filename(file.get(), ref.string().c_str()) == 0);
+    std::unique_ptr<sam_hdr_t, decltype(&sam_hdr_destroy)> header(sam_hdr_read(file.get()),
+                                                                  sam_hdr_destroy);
+    REQUIRE(header);
+    dorado::BamPtr rec(bam_init1());
+    REQUIRE(sam_read1(file.get(), header.get(), rec.get()) >= 0);
+    CHECK(rec->core.tid == 0);
+    CHECK(bam_aux_get(rec.get(), "MM") != nullptr);
+    CHECK(bam_aux_get(rec.get(), "NM") != nullptr);
+    CHECK(sam_read1(file.get(), header.get(), rec.get()) == -1);
+    file.reset();
+
+    fs::remove_all(temp_dir);
+}
+
 TEST_CASE("AlignerTest: Verify impact of updated aligner args", TEST_GROUP) {
     fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
     auto ref = aligner_test_dir / "target.fq";
@@ -180,10 +229,181 @@ TEST_CASE("AlignerTest: Verify impact of updated aligner args", TEST_GROUP) {
     }
 }
 
-TEST_CASE("AlignerTest: Check Aligner crashes if multi index encountered", TEST_GROUP) {
+TEST_CASE("AlignerTest: Align against a split index", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    // The small index batch size puts each of the reference's two sequences in its own part.
+    auto ref = aligner_test_dir / "long_target.fa";
+    auto query = aligner_test_dir / "long_target.fa";
+
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    dorado::Aligner aligner(sink, ref.string(), 15, 15, 1e3, 1);
+
+    // The header covers the sequences of every part.
+    auto sq_records = aligner.get_sequence_records_for_header();
+    REQUIRE(sq_records.size() == 2);
+
+    dorado::HtsReader reader(query.string());
+    reader.read(aligner, 100);
+    auto bam_records = sink.get_messages();
+
+    // Each sequence's primary alignment is to itself, in whichever part it was indexed.
+    int num_primary = 0;
+    for (auto& record : bam_records) {
+        bam1_t* rec = record.get();
+        if (rec->core.flag & (BAM_FUNMAP | BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
+            continue;
+        }
+        ++num_primary;
+        REQUIRE(rec->core.tid >= 0);
+        REQUIRE(rec->core.tid < 2);
+        CHECK(std::string(bam_get_qname(rec)) == std::string(sq_records[rec->core.tid].first));
+    }
+    CHECK(num_primary == 2);
+}
+
+TEST_CASE("AlignerTest: Reuse a saved index", TEST_GROUP) {
     fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
     auto ref = aligner_test_dir / "long_target.fa";
+    auto saved_index = fs::temp_directory_path() / "dorado_aligner_test.mmi";
+    fs::remove(saved_index);
 
+    // Save a split index, so that every part has to be written and loaded back.
+    std::vector<std::pair<std::string, uint32_t>> built_records;
+    {
+        MessageSinkToVector<dorado::BamPtr> sink(100);
+        dorado::Aligner aligner(sink, ref.string(), 15, 15, 1e3, 1, saved_index.string());
+        for (const auto& [name, length] : aligner.get_sequence_records_for_header()) {
+            built_records.emplace_back(name, length);
+        }
+    }
+    REQUIRE(fs::exists(saved_index));
+
+    // The index parameters given are overridden by those of the saved index.
     MessageSinkToVector<dorado::BamPtr> sink(100);
-    CHECK_THROWS(dorado::Aligner(sink, ref.string(), 5, 5, 1e3, 1));
+    dorado::Aligner aligner(sink, saved_index.string(), 10, 10, 1e9, 1);
+    auto loaded_records = aligner.get_sequence_records_for_header();
+    REQUIRE(loaded_records.size() == built_records.size());
+    for (size_t i = 0; i < loaded_records.size(); ++i) {
+        CHECK(std::string(loaded_records[i].first) == built_records[i].first);
+        CHECK(loaded_records[i].second == built_records[i].second);
+    }
+
+    dorado::HtsReader reader(ref.string());
+    reader.read(aligner, 100);
+    auto bam_records = sink.get_messages();
+    int num_primary = 0;
+    for (auto& record : bam_records) {
+        bam1_t* rec = record.get();
+        if (!(rec->core.flag & (BAM_FUNMAP | BAM_FSECONDARY | BAM_FSUPPLEMENTARY))) {
+            ++num_primary;
+        }
+    }
+    CHECK(num_primary == 2);
+
+    fs::remove(saved_index);
+}
+
+TEST_CASE("AlignerTest: Keep input order", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "target.fq";
+    auto query = aligner_test_dir / "target.fq";
+
+    MessageSinkToVector<dorado::BamPtr> query_sink(100);
+    dorado::HtsReader reader(query.string());
+    reader.read(query_sink, 100);
+    auto queries = query_sink.get_messages();
+    REQUIRE(queries.size() == 1);
+
+    // Copies of the query, with tags recording their input position, are spread over many
+    // batches and threads.
+    const int32_t num_copies = 500;
+    MessageSinkToVector<dorado::BamPtr> sink(num_copies);
+    dorado::Aligner aligner(sink, ref.string(), 15, 15, 1e9, 8, "", true);
+    for (int32_t i = 0; i < num_copies; ++i) {
+        dorado::BamPtr copy(bam_dup1(queries[0].get()));
+        bam_aux_append(copy.get(), "xi", 'i', sizeof(i), reinterpret_cast<uint8_t*>(&i));
+        aligner.push_message(std::move(copy));
+    }
+    aligner.terminate();
+    aligner.join();
+
+    auto bam_records = sink.get_messages();
+    REQUIRE(bam_records.size() == num_copies);
+    for (int32_t i = 0; i < num_copies; ++i) {
+        auto* tag = bam_aux_get(bam_records[i].get(), "xi");
+        REQUIRE(tag != nullptr);
+        CHECK(bam_aux2i(tag) == i);
+    }
+}
+
+TEST_CASE("AlignerTest: Align called reads", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "target.fq";
+    auto query = aligner_test_dir / "target.fq";
+
+    // Align the query as a record and as a read, which should give the same alignment.
+    MessageSinkToVector<dorado::BamPtr> record_sink(100);
+    dorado::Aligner record_aligner(record_sink, ref.string(), 15, 15, 1e9, 1);
+    dorado::HtsReader reader(query.string());
+    reader.read(record_aligner, 100);
+    auto expected = record_sink.get_messages();
+    REQUIRE(expected.size() == 1);
+    bam1_t* expected_rec = expected[0].get();
+
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = "read";
+    read->seq = dorado::utils::convert_nt16_to_str(bam_get_seq(expected_rec),
+                                                   expected_rec->core.l_qseq);
+    read->qstring = std::string(read->seq.size(), '5');
+
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    dorado::Aligner aligner(sink, ref.string(), 15, 15, 1e9, 1);
+    aligner.push_message(read);
+    aligner.terminate();
+    aligner.join();
+    auto bam_records = sink.get_messages();
+    REQUIRE(bam_records.size() == 1);
+
+    bam1_t* rec = bam_records[0].get();
+    CHECK(std::string(bam_get_qname(rec)) == "read");
+    CHECK(rec->core.flag == expected_rec->core.flag);
+    CHECK(rec->core.tid == expected_rec->core.tid);
+    CHECK(rec->core.pos == expected_rec->core.pos);
+    CHECK(rec->core.n_cigar == expected_rec->core.n_cigar);
+    CHECK(dorado::utils::convert_nt16_to_str(bam_get_seq(rec), rec->core.l_qseq) == read->seq);
+    // Records made from reads carry the same tags as those from ReadToBamType.
+    CHECK(bam_aux_get(rec, "qs") != nullptr);
+}
+
+TEST_CASE("AlignerTest: Emit PAF", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "supplementary_aln_target.fa";
+    auto query = aligner_test_dir / "supplementary_aln_query.fa";
+
+    MessageSinkToVector<dorado::PafLines> sink(100);
+    dorado::Aligner aligner(sink, ref.string(), 15, 15, 1e9, 10, "", false, {}, true);
+    dorado::HtsReader reader(query.string());
+    reader.read(aligner, 100);
+    auto paf_messages = sink.get_messages();
+    REQUIRE(paf_messages.size() == 1);
+    const auto& paf = paf_messages[0];
+    CHECK(paf.mapped);
+
+    // The primary and secondary alignments, each with the 12 PAF columns.
+    std::istringstream lines(paf.lines);
+    std::vector<std::string> columns_per_line[2];
+    std::string line;
+    for (auto& columns : columns_per_line) {
+        REQUIRE(std::getline(lines, line));
+        std::istringstream fields(line);
+        for (std::string field; std::getline(fields, field, '\t');) {
+            columns.push_back(field);
+        }
+        REQUIRE(columns.size() > 12);
+        CHECK(columns[0] == std::string(bam_get_qname(reader.record.get())));
+        CHECK(std::stoi(columns[1]) == reader.record->core.l_qseq);
+    }
+    CHECK(columns_per_line[0][12] == "tp:A:P");
+    CHECK(columns_per_line[1][12] == "tp:A:S");
+    CHECK_FALSE(std::getline(lines, line));
 }
@@ -0,0 +1,168 @@
+#include "utils/ArrowStreamWriter.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[utils][ArrowStreamWriter]"
+
+namespace fs = std::filesystem;
+
+using dorado::utils::ArrowStreamWriter;
+using Type = ArrowStreamWriter::Type;
+
+namespace {
+
+uint32_t read_u32(const std::string& bytes, size_t pos) {
+    uint32_t value;
+    std::memcpy(&value, bytes.data() + pos, sizeof(value));
+    return value;
+}
+
+int64_t read_i64(const std::string& bytes, size_t pos) {
+    int64_t value;
+    std::memcpy(&value, bytes.data() + pos, sizeof(value));
+    return value;
+}
+
+// Offset of a flatbuffer table's field from the table, or 0 if it is absent.
+uint16_t field_offset(const std::string& bytes, size_t table_pos, int field_id) {
+    const auto vtable_pos = table_pos - int32_t(read_u32(bytes, table_pos));
+    uint16_t vtable_size, offset = 0;
+    std::memcpy(&vtable_size, bytes.data() + vtable_pos, sizeof(vtable_size));
+    if (4 + 2 * field_id < vtable_size) {
+        std::memcpy(&offset, bytes.data() + vtable_pos + 4 + 2 * field_id, sizeof(offset));
+    }
+    return offset;
+}
+
+}  // namespace
+
+TEST_CASE("ArrowStreamWriterTest: Writes a schema, batches and the end marker", TEST_GROUP) {
+    const auto path = fs::temp_directory_path() / "arrow_stream_writer_test.arrow";
+    FILE* file = fopen(path.string().c_str(), "wb");
+    REQUIRE(file);
+
+    std::vector<ArrowStreamWriter::Column> columns{{"read_id", Type::Utf8},
+                                                   {"channel", Type::Int32},
+                                                   {"moves", Type::UInt8List}};
+    ArrowStreamWriter writer(file, columns);
+    columns[0].append(std::string_view("read_1"));
+    columns[1].append(int32_t(12));
+    columns[2].append(std::vector<uint8_t>{1, 0, 1});
+    columns[0].append(std::string_view("read_2"));
+    columns[1].append(int32_t(34));
+    columns[2].append(std::vector<uint8_t>{1});
+    writer.write_batch(columns);
+    CHECK(columns[0].num_rows() == 0);
+    writer.finish();
+    fclose(file);
+    CHECK(writer.num_batches_written() == 1);
+
+    std::ifstream stream(path, std::ios::binary);
+    const std::string bytes{std::istreambuf_iterator<char>(stream),
+                            std::istreambuf_iterator<char>()};
+    stream.close();
+    fs::remove(path);
+
+    // Each message is the continuation marker, the size of its metadata, its metadata and its
+    // body, all 8 byte aligned, and the stream ends with an empty message.
+    size_t pos = 0;
+    std::vector<std::string> bodies;
+    while (true) {
+        REQUIRE(pos % 8 == 0);
+        REQUIRE(pos + 8 <= bytes.size());
+        CHECK(read_u32(bytes, pos) == 0xFFFFFFFF);
+        const auto metadata_size = read_u32(bytes, pos + 4);
+        pos += 8;
+        if (metadata_size == 0) {
+            break;
+        }
+        REQUIRE(metadata_size % 8 == 0);
+        // The Message table's version is V5, and bodyLength its fourth field.
+        const auto message_pos = pos + read_u32(bytes, pos);
+        const auto version_offset = field_offset(bytes, message_pos, 0);
+        REQUIRE(version_offset != 0);
+        CHECK(bytes[message_pos + version_offset] == 4);
+        const auto body_length_offset = field_offset(bytes, message_pos, 3);
+        REQUIRE(body_length_offset != 0);
+        const auto body_length = read_i64(bytes, message_pos + body_length_offset);
+        pos += metadata_size;
+        bodies.push_back(bytes.substr(pos, body_length));
+        pos += body_length;
+    }
+    CHECK(pos == bytes.size());
+
+    // The schema has no body, and the batch's holds the columns' values.
+    REQUIRE(bodies.size() == 2);
+    CHECK(bodies[0].empty());
+    CHECK(bodies[1].size() % 8 == 0);
+    CHECK(bodies[1].find("read_1read_2") != std::string::npos);
+    const char moves[] = {1, 0, 1, 1};
+    CHECK(bodies[1].find(std::string(moves, sizeof(moves))) != std::string::npos);
+}
+
+TEST_CASE("ArrowStreamWriterTest: Values and batches must match the schema", TEST_GROUP) {
+    ArrowStreamWriter::Column column("channel", Type::Int32);
+    CHECK_THROWS_AS(column.append(uint64_t(1)), std::runtime_error);
+    CHECK_THROWS_AS(column.append(std::string_view("1")), std::runtime_error);
+    column.append(int32_t(1));
+    CHECK(column.num_rows() == 1);
+
+    const auto path = fs::temp_directory_path() / "arrow_stream_writer_schema_test.arrow";
+    FILE* file = fopen(path.string().c_str(), "wb");
+    REQUIRE(file);
+    {
+        std::vector<ArrowStreamWriter::Column> columns{{"read_id", Type::Utf8}};
+        ArrowStreamWriter writer(file, columns);
+        std::vector<ArrowStreamWriter::Column> other{{"channel", Type::Int32}};
+        CHECK_THROWS_AS(writer.write_batch(other), std::runtime_error);
+        columns.emplace_back("channel", Type::Int32);
+        CHECK_THROWS_AS(writer.write_batch(columns), std::runtime_error);
+    }
+    fclose(file);
+    fs::remove(path);
+}
+
+// Writes a stream with every column type, for check_arrow_stream.py to read with pyarrow and
+// compare with the values it expects, which must match those written here.  Hidden, since it
+// only checks anything when run by that script, which passes the path to write to.
+TEST_CASE("ArrowStreamWriterTest: Writes a stream for Arrow readers", "[.][arrow_readers]") {
+    const char* output_path = std::getenv("DORADO_ARROW_STREAM_OUTPUT");
+    REQUIRE(output_path);
+    FILE* file = fopen(output_path, "wb");
+    REQUIRE(file);
+
+    std::vector<ArrowStreamWriter::Column> columns{
+            {"read_id", Type::Utf8},       {"channel", Type::Int32},
+            {"mux", Type::UInt8},          {"read_number", Type::UInt32},
+            {"num_samples", Type::UInt64}, {"mean_qscore", Type::Float32},
+            {"moves", Type::UInt8List},    {"modbase_positions", Type::UInt32List}};
+    ArrowStreamWriter writer(file, columns);
+    // Two batches, the second with an empty string and empty lists.
+    for (uint32_t batch = 0; batch < 2; ++batch) {
+        for (uint32_t row = 0; row < 3; ++row) {
+            const uint32_t index = batch * 3 + row;
+            columns[0].append(std::string_view(index == 5 ? "" : "read_" + std::to_string(index)));
+            columns[1].append(int32_t(index) - 2);
+            columns[2].append(uint8_t(index + 1));
+            columns[3].append(uint32_t(4000000000u + index));
+            columns[4].append((uint64_t(1) << 40) + index);
+            columns[5].append(float(index) + 0.25f);
+            columns[6].append(std::vector<uint8_t>(index % 5, uint8_t(index % 2)));
+            columns[7].append(std::vector<uint32_t>(index % 5, index * 1000));
+        }
+        writer.write_batch(columns);
+    }
+    writer.finish();
+    fclose(file);
+    CHECK(writer.num_batches_written() == 2);
+}
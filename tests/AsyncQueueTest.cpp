@@ -4,13 +4,20 @@
 
 #define TEST_GROUP "AsyncQueue "
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <thread>
+#include <vector>
 
-TEST_CASE(TEST_GROUP ": InputsMatchOutputs") {
+#define QUEUE_POLICIES LockingQueuePolicy, LockFreeQueuePolicy
+
+TEMPLATE_TEST_CASE(TEST_GROUP ": InputsMatchOutputs", TEST_GROUP, QUEUE_POLICIES) {
     const int n = 10;
-    AsyncQueue<int> queue(n);
+    AsyncQueue<int, TestType> queue(n);
 
     for (int i = 0; i < n; ++i) {
         const bool success = queue.try_push(std::move(i));
@@ -23,15 +30,15 @@ TEST_CASE(TEST_GROUP ": InputsMatchOutputs") {
     }
 }
 
-TEST_CASE(TEST_GROUP ": PushFailsIfTerminating") {
-    AsyncQueue<int> queue(1);
+TEMPLATE_TEST_CASE(TEST_GROUP ": PushFailsIfTerminating", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(1);
     queue.terminate();
     const bool success = queue.try_push(42);
     REQUIRE(!success);
 }
 
-TEST_CASE(TEST_GROUP ": PopFailsIfTerminating") {
-    AsyncQueue<int> queue(1);
+TEMPLATE_TEST_CASE(TEST_GROUP ": PopFailsIfTerminating", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(1);
     queue.terminate();
     int val;
     const bool success = queue.try_pop(val);
@@ -40,8 +47,8 @@ TEST_CASE(TEST_GROUP ": PopFailsIfTerminating") {
 
 // Spawned thread sits waiting for an item.
 // Main thread supplies that item.
-TEST_CASE(TEST_GROUP ": PopFromOtherThread") {
-    AsyncQueue<int> queue(1);
+TEMPLATE_TEST_CASE(TEST_GROUP ": PopFromOtherThread", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(1);
     std::atomic_bool thread_started{false};
     bool try_pop_result = false;
 
@@ -67,8 +74,8 @@ TEST_CASE(TEST_GROUP ": PopFromOtherThread") {
 
 // Spawned thread sits waiting for an item.
 // Main thread terminates wait.
-TEST_CASE(TEST_GROUP ": TerminateFromOtherThread") {
-    AsyncQueue<int> queue(1);
+TEMPLATE_TEST_CASE(TEST_GROUP ": TerminateFromOtherThread", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(1);
     std::atomic_bool thread_started{false};
     bool try_pop_result = false;
 
@@ -90,4 +97,209 @@ TEST_CASE(TEST_GROUP ": TerminateFromOtherThread") {
 
     // This will fail, since the wait is terminated.
     REQUIRE(!try_pop_result);
-}
\ No newline at end of file
+}
+
+// Items pushed before termination are still popped, and then pops fail.
+TEMPLATE_TEST_CASE(TEST_GROUP ": PopDrainsAfterTerminate", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(4);
+    REQUIRE(queue.try_push(1));
+    REQUIRE(queue.try_push(2));
+    queue.terminate();
+
+    int val = -1;
+    REQUIRE(queue.try_pop(val));
+    REQUIRE(val == 1);
+    REQUIRE(queue.try_pop(val));
+    REQUIRE(val == 2);
+    REQUIRE(!queue.try_pop(val));
+}
+
+// Non-trivial items left in the queue are destroyed along with it.
+TEMPLATE_TEST_CASE(TEST_GROUP ": DestroysRemainingItems", TEST_GROUP, QUEUE_POLICIES) {
+    auto item = std::make_shared<int>(42);
+    {
+        AsyncQueue<std::shared_ptr<int>, TestType> queue(4);
+        auto copy = item;
+        REQUIRE(queue.try_push(std::move(copy)));
+        REQUIRE(item.use_count() == 2);
+    }
+    REQUIRE(item.use_count() == 1);
+}
+
+// Several producers and consumers hammering a small queue, so pushes regularly
+// block on a full queue and pops on an empty one.  Every item must come out once.
+TEMPLATE_TEST_CASE(TEST_GROUP ": MultipleProducersConsumers", TEST_GROUP, QUEUE_POLICIES) {
+    const int kNumProducers = 4;
+    const int kNumConsumers = 4;
+    const int kItemsPerProducer = 10000;
+    AsyncQueue<int, TestType> queue(8);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kNumProducers; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < kItemsPerProducer; ++i) {
+                queue.try_push(p * kItemsPerProducer + i);
+            }
+        });
+    }
+
+    std::vector<std::vector<int>> popped(kNumConsumers);
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < kNumConsumers; ++c) {
+        consumers.emplace_back([&queue, &popped, c]() {
+            int val;
+            while (queue.try_pop(val)) {
+                popped[c].push_back(val);
+            }
+        });
+    }
+
+    for (auto& t : producers) {
+        t.join();
+    }
+    queue.terminate();
+    for (auto& t : consumers) {
+        t.join();
+    }
+
+    std::vector<int> all_items;
+    for (const auto& items : popped) {
+        all_items.insert(all_items.end(), items.begin(), items.end());
+    }
+    std::sort(all_items.begin(), all_items.end());
+    REQUIRE(all_items.size() == kNumProducers * kItemsPerProducer);
+    for (int i = 0; i < int(all_items.size()); ++i) {
+        REQUIRE(all_items[i] == i);
+    }
+
+    const auto stats = queue.sample_stats();
+    REQUIRE(stats.at("pushes") == kNumProducers * kItemsPerProducer);
+    REQUIRE(stats.at("pops") == kNumProducers * kItemsPerProducer);
+    REQUIRE(stats.at("items") == 0);
+}
+
+TEMPLATE_TEST_CASE(TEST_GROUP ": BatchInputsMatchOutputs", TEST_GROUP, QUEUE_POLICIES) {
+    const int n = 10;
+    AsyncQueue<int, TestType> queue(n);
+
+    std::vector<int> items(n);
+    std::iota(items.begin(), items.end(), 0);
+    REQUIRE(queue.try_push_batch(std::move(items)));
+
+    // Pops are capped at the requested size.
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 4));
+    REQUIRE(popped == std::vector<int>{0, 1, 2, 3});
+    REQUIRE(queue.try_pop_batch(popped, 100));
+    REQUIRE(popped == std::vector<int>{4, 5, 6, 7, 8, 9});
+
+    queue.terminate();
+    REQUIRE(!queue.try_pop_batch(popped, 100));
+    REQUIRE(popped.empty());
+}
+
+TEMPLATE_TEST_CASE(TEST_GROUP ": BatchPushFailsIfTerminating", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(4);
+    queue.terminate();
+    REQUIRE(!queue.try_push_batch({1, 2, 3}));
+}
+
+// A batch larger than the queue capacity is pushed in pieces as a consumer drains it.
+TEMPLATE_TEST_CASE(TEST_GROUP ": BatchLargerThanCapacity", TEST_GROUP, QUEUE_POLICIES) {
+    const int n = 1000;
+    AsyncQueue<int, TestType> queue(3);
+
+    std::vector<int> popped;
+    auto popping_thread = std::thread([&]() {
+        std::vector<int> batch;
+        while (queue.try_pop_batch(batch, 2)) {
+            popped.insert(popped.end(), batch.begin(), batch.end());
+        }
+    });
+
+    std::vector<int> items(n);
+    std::iota(items.begin(), items.end(), 0);
+    const bool success = queue.try_push_batch(std::move(items));
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(success);
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+// A queue of one item still never holds more than one, nor loses any.
+TEMPLATE_TEST_CASE(TEST_GROUP ": SingleItemCapacity", TEST_GROUP, QUEUE_POLICIES) {
+    const int n = 1000;
+    AsyncQueue<int, TestType> queue(1);
+
+    std::vector<int> popped;
+    size_t max_items = 0;
+    auto popping_thread = std::thread([&]() {
+        int val = -1;
+        while (queue.try_pop(val)) {
+            popped.push_back(val);
+        }
+    });
+
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(queue.try_push(int(i)));
+        const auto items = static_cast<size_t>(queue.sample_stats().at("items"));
+        max_items = std::max(max_items, items);
+    }
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(max_items <= 1);
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+TEMPLATE_TEST_CASE(TEST_GROUP ": NonBlockingPushPop", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(2);
+    int val = -1;
+    REQUIRE(queue.try_pop_nowait(val) == QueueStatus::Empty);
+
+    int item = 1;
+    REQUIRE(queue.try_push_nowait(item) == QueueStatus::Success);
+    item = 2;
+    REQUIRE(queue.try_push_nowait(item) == QueueStatus::Success);
+    item = 3;
+    REQUIRE(queue.try_push_nowait(item) == QueueStatus::Full);
+    // Items which can't be pushed are left in place.
+    REQUIRE(item == 3);
+
+    queue.terminate();
+    REQUIRE(queue.try_push_nowait(item) == QueueStatus::Terminated);
+    // Queued items can still be popped once terminating.
+    REQUIRE(queue.try_pop_nowait(val) == QueueStatus::Success);
+    REQUIRE(val == 1);
+    REQUIRE(queue.try_pop_nowait(val) == QueueStatus::Success);
+    REQUIRE(val == 2);
+    REQUIRE(queue.try_pop_nowait(val) == QueueStatus::Terminated);
+}
+
+TEMPLATE_TEST_CASE(TEST_GROUP ": LatencyStats", TEST_GROUP, QUEUE_POLICIES) {
+    AsyncQueue<int, TestType> queue(10);
+    // No latency stats until something has been popped.
+    REQUIRE(queue.sample_stats().count("wait_p50_us") == 0);
+
+    queue.try_push(1);
+    queue.try_push(2);
+    int item = 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    REQUIRE(queue.try_pop(item));
+    // Service time is only known once this thread comes back for more.
+    REQUIRE(queue.sample_stats().count("service_p50_us") == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    REQUIRE(queue.try_pop(item));
+
+    const auto stats = queue.sample_stats();
+    REQUIRE(stats.at("wait_p50_us") >= 1000.0);
+    REQUIRE(stats.at("wait_p99_us") >= stats.at("wait_p50_us"));
+    REQUIRE(stats.at("service_p50_us") >= 1000.0);
+}
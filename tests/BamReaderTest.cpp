@@ -56,6 +56,19 @@ TEST_CASE("HtsReaderTest: Read SAM to sink", TEST_GROUP) {
     REQUIRE(bam_records.size() == 11);  // SAM file has 11 reads.
 }
 
+TEST_CASE("HtsReaderTest: Read SAM to sink with and without a limit", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
+    auto sam = aligner_test_dir / "small.sam";
+
+    auto max_reads = GENERATE(-1, 5);
+    CAPTURE(max_reads);
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    dorado::HtsReader reader(sam.string());
+    reader.read(sink, max_reads);
+    auto bam_records = sink.get_messages();
+    REQUIRE(bam_records.size() == (max_reads < 0 ? 11 : 5));
+}
+
 TEST_CASE("HtsReaderTest: Read SAM line by line", TEST_GROUP) {
     fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
     auto sam = aligner_test_dir / "small.sam";
@@ -78,6 +91,22 @@ TEST_CASE("HtsReaderTest: read_bam API w/ SAM", TEST_GROUP) {
     REQUIRE(read_map.size() == 2);  // read_id filter is only asking for 2 reads.
 }
 
+TEST_CASE("HtsReaderTest: read_bam API w/ SAM on several threads", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
+    auto sam = aligner_test_dir / "small.sam";
+    const auto read_ids = dorado::fetch_read_ids(sam.string());
+
+    auto expected = dorado::read_bam(sam.string(), read_ids);
+    auto read_map = dorado::read_bam(sam.string(), read_ids, 4);
+    REQUIRE(read_map.size() == expected.size());
+    for (const auto& [read_id, read] : expected) {
+        CAPTURE(read_id);
+        REQUIRE(read_map.count(read_id) == 1);
+        CHECK(read_map[read_id]->seq == read->seq);
+        CHECK(read_map[read_id]->qstring == read->qstring);
+    }
+}
+
 TEST_CASE("HtsReaderTest: fetch_read_ids API w/ SAM", TEST_GROUP) {
     fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
     auto sam = aligner_test_dir / "small.sam";
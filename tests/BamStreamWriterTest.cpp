@@ -0,0 +1,91 @@
+#include "TestUtils.h"
+#include "htslib/sam.h"
+#include "read_pipeline/HtsReader.h"
+#include "utils/BamStreamWriter.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[utils][BamStreamWriter]"
+
+namespace fs = std::filesystem;
+using namespace dorado;
+
+namespace {
+
+void check_same_record(bam1_t* expected, bam1_t* actual) {
+    CHECK(std::string(bam_get_qname(expected)) == bam_get_qname(actual));
+    CHECK(expected->core.flag == actual->core.flag);
+    CHECK(expected->core.tid == actual->core.tid);
+    CHECK(expected->core.pos == actual->core.pos);
+    CHECK(expected->core.qual == actual->core.qual);
+    CHECK(expected->core.n_cigar == actual->core.n_cigar);
+    CHECK(expected->core.l_qseq == actual->core.l_qseq);
+    REQUIRE(expected->l_data == actual->l_data);
+    CHECK(std::memcmp(expected->data, actual->data, expected->l_data) == 0);
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Written records read back the same through htslib", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_bam = fs::temp_directory_path() / "bam_stream_writer_test.bam";
+
+    std::vector<BamPtr> records;
+    {
+        HtsReader reader(in_sam.string());
+        // A small buffer so that blocks are written out along the way.
+        utils::BamStreamWriter writer(out_bam.string(), 1);
+        writer.write_header(reader.header);
+        while (reader.read()) {
+            writer.write(reader.record.get());
+            records.emplace_back(bam_dup1(reader.record.get()));
+        }
+    }
+    REQUIRE(!records.empty());
+
+    HtsReader reader(out_bam.string());
+    CHECK(std::string(reader.format).find("BAM") != std::string::npos);
+    for (const auto& record : records) {
+        REQUIRE(reader.read());
+        check_same_record(record.get(), reader.record.get());
+    }
+    CHECK_FALSE(reader.read());
+    fs::remove(out_bam);
+}
+
+TEST_CASE(TEST_GROUP ": CIGARs too long for BAM are written to a CG tag", TEST_GROUP) {
+    const auto out_bam = fs::temp_directory_path() / "bam_stream_writer_cigar_test.bam";
+
+    // Alternating matches and insertions, with more operations than BAM's n_cigar field holds.
+    const size_t num_ops = 70000;
+    std::vector<uint32_t> cigar(num_ops);
+    for (size_t i = 0; i < num_ops; ++i) {
+        cigar[i] = bam_cigar_gen(1, i % 2 ? BAM_CINS : BAM_CMATCH);
+    }
+    const std::string seq(num_ops, 'A');
+    const std::string qual(num_ops, 20);
+
+    std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> header(sam_hdr_init(), sam_hdr_destroy);
+    sam_hdr_add_line(header.get(), "SQ", "SN", "ref", "LN", "100000", NULL);
+    BamPtr record(bam_init1());
+    bam_set1(record.get(), 4, "read", 0, 0, 10, 60, num_ops, cigar.data(), -1, -1, 0, seq.size(),
+             seq.c_str(), qual.c_str(), 0);
+    {
+        utils::BamStreamWriter writer(out_bam.string());
+        writer.write_header(header.get());
+        writer.write(record.get());
+    }
+
+    HtsReader reader(out_bam.string());
+    REQUIRE(reader.header->n_targets == 1);
+    CHECK(std::string(reader.header->target_name[0]) == "ref");
+    REQUIRE(reader.read());
+    // htslib moves the CG tag back into the CIGAR.
+    check_same_record(record.get(), reader.record.get());
+    fs::remove(out_bam);
+}
@@ -7,6 +7,9 @@
 #include <catch2/catch.hpp>
 
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
 
 #define TEST_GROUP "[bam_utils][hts_writer]"
 
@@ -41,14 +44,134 @@ private:
 
 TEST_CASE_METHOD(HtsWriterTestsFixture, "HtsWriterTest: Write BAM", TEST_GROUP) {
     int num_threads = GENERATE(1, 10);
-    HtsWriter::OutputMode emit_fastq = GENERATE(
-            HtsWriter::OutputMode::SAM, HtsWriter::OutputMode::BAM, HtsWriter::OutputMode::FASTQ);
+    HtsWriter::OutputMode emit_fastq =
+            GENERATE(HtsWriter::OutputMode::SAM, HtsWriter::OutputMode::BAM,
+                     HtsWriter::OutputMode::FASTQ, HtsWriter::OutputMode::FASTQ_GZ);
     REQUIRE_NOTHROW(generate_bam(emit_fastq, num_threads));
 }
 
+TEST_CASE("HtsWriterTest: Multithreaded SAM output matches single threaded", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    auto write_sam = [&in_sam](const fs::path& out_sam, int num_threads) {
+        HtsReader reader(in_sam.string());
+        HtsWriter writer(out_sam.string(), HtsWriter::OutputMode::SAM, num_threads, 0);
+        writer.write_header(reader.header);
+        reader.read(writer, 1000);
+        writer.join();
+    };
+    auto read_file = [](const fs::path& path) {
+        std::ifstream stream(path);
+        return std::string(std::istreambuf_iterator<char>(stream), {});
+    };
+
+    const auto single_sam = fs::temp_directory_path() / "single_threaded.sam";
+    const auto multi_sam = fs::temp_directory_path() / "multi_threaded.sam";
+    // The writers are closed, and their output flushed, when the lambda returns.
+    write_sam(single_sam, 1);
+    write_sam(multi_sam, 10);
+
+    const auto expected = read_file(single_sam);
+    CHECK(!expected.empty());
+    CHECK(read_file(multi_sam) == expected);
+
+    fs::remove(single_sam);
+    fs::remove(multi_sam);
+}
+
 TEST_CASE("HtsWriterTest: Output mode conversion", TEST_GROUP) {
     CHECK(HtsWriter::get_output_mode("sam") == HtsWriter::OutputMode::SAM);
     CHECK(HtsWriter::get_output_mode("bam") == HtsWriter::OutputMode::BAM);
     CHECK(HtsWriter::get_output_mode("fastq") == HtsWriter::OutputMode::FASTQ);
+    CHECK(HtsWriter::get_output_mode("fastq.gz") == HtsWriter::OutputMode::FASTQ_GZ);
     CHECK_THROWS_WITH(HtsWriter::get_output_mode("blah"), "Unknown output mode: blah");
 }
+
+TEST_CASE("HtsWriterTest: Sorted BAM output is in coordinate order and indexed", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_bam = fs::temp_directory_path() / "sorted.bam";
+    // A budget of a byte spills every record to a run of its own.
+    const size_t sort_memory_bytes = GENERATE(size_t(1), size_t(1) << 30);
+    CAPTURE(sort_memory_bytes);
+    {
+        HtsReader reader(in_sam.string());
+        HtsWriter writer(out_bam.string(), HtsWriter::OutputMode::BAM, 2, 0, "", "HtsWriter",
+                         sort_memory_bytes);
+        writer.write_header(reader.header);
+        reader.read(writer, 1000);
+        writer.join();
+    }
+    // No runs are left behind.
+    for (const auto& entry : fs::directory_iterator(fs::temp_directory_path())) {
+        CHECK(entry.path().filename().string().rfind("sorted.bam.sort", 0) != 0);
+    }
+    CHECK(fs::exists(out_bam.string() + ".bai"));
+
+    HtsReader sorted(out_bam.string());
+    kstring_t sort_order = KS_INITIALIZE;
+    REQUIRE(sam_hdr_find_tag_hd(sorted.header, "SO", &sort_order) == 0);
+    CHECK(std::string(ks_str(&sort_order)) == "coordinate");
+    ks_free(&sort_order);
+
+    std::vector<BamPtr> records;
+    while (sorted.read()) {
+        records.push_back(BamPtr(bam_dup1(sorted.record.get())));
+    }
+    CHECK(records.size() == 11);
+    for (size_t i = 1; i < records.size(); ++i) {
+        CHECK_FALSE(utils::coordinate_less(records[i].get(), records[i - 1].get()));
+    }
+    // Unmapped records come last.
+    CHECK(records.back()->core.tid == -1);
+
+    // The index written alongside finds the mapped records.
+    std::unique_ptr<htsFile, decltype(&hts_close)> file(hts_open(out_bam.string().c_str(), "r"),
+                                                        hts_close);
+    REQUIRE(file);
+    std::unique_ptr<hts_idx_t, decltype(&hts_idx_destroy)> index(
+            sam_index_load(file.get(), out_bam.string().c_str()), hts_idx_destroy);
+    REQUIRE(index);
+    uint64_t num_mapped = 0, num_unmapped = 0;
+    REQUIRE(hts_idx_get_stat(index.get(), 0, &num_mapped, &num_unmapped) == 0);
+    CHECK(num_mapped > 0);
+
+    fs::remove(out_bam);
+    fs::remove(out_bam.string() + ".bai");
+}
+
+TEST_CASE("HtsWriterTest: Only SAM and BAM output can be sorted", TEST_GROUP) {
+    const auto out_fastq = fs::temp_directory_path() / "sorted.fastq";
+    CHECK_THROWS(HtsWriter(out_fastq.string(), HtsWriter::OutputMode::FASTQ, 1, 0, "",
+                           "HtsWriter", 1000));
+    fs::remove(out_fastq);
+}
+
+TEST_CASE("HtsWriterTest: BAM is readable at every compression level", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_bam = fs::temp_directory_path() / "levels.bam";
+    const int compression_level = GENERATE(-1, 1, 9);
+    CAPTURE(compression_level);
+    {
+        HtsReader reader(in_sam.string());
+        HtsWriter writer(out_bam.string(), HtsWriter::OutputMode::BAM, 2, 0, "", "HtsWriter", 0,
+                         nullptr, compression_level);
+        writer.write_header(reader.header);
+        reader.read(writer, 1000);
+        writer.join();
+    }
+    HtsReader written(out_bam.string());
+    size_t num_records = 0;
+    while (written.read()) {
+        ++num_records;
+    }
+    CHECK(num_records == 11);
+    fs::remove(out_bam);
+}
+
+TEST_CASE("HtsWriterTest: Compression level must be between 1 and 9", TEST_GROUP) {
+    const auto out_bam = fs::temp_directory_path() / "levels.bam";
+    CHECK_THROWS(HtsWriter(out_bam.string(), HtsWriter::OutputMode::BAM, 1, 0, "", "HtsWriter", 0,
+                           nullptr, 10));
+    CHECK_THROWS(HtsWriter(out_bam.string(), HtsWriter::OutputMode::BAM, 1, 0, "", "HtsWriter", 0,
+                           nullptr, 0));
+    fs::remove(out_bam);
+}
@@ -0,0 +1,149 @@
+#include "utils/BandedAligner.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[utils][BandedAligner]"
+
+using dorado::utils::BandedAligner;
+using dorado::utils::BandedAlignment;
+
+namespace {
+
+std::string random_sequence(size_t len) {
+    const std::string bases("ACGT");
+    std::string seq(len, ' ');
+    for (auto& base : seq) {
+        base = bases.at(std::rand() % 4);
+    }
+    return seq;
+}
+
+// Copies seq with a few random substitutions, insertions and deletions.
+std::string mutate(const std::string& seq, int num_edits) {
+    std::string mutated = seq;
+    for (int i = 0; i < num_edits && !mutated.empty(); ++i) {
+        const size_t pos = std::rand() % mutated.size();
+        switch (std::rand() % 3) {
+        case 0:
+            mutated[pos] = "ACGT"[std::rand() % 4];
+            break;
+        case 1:
+            mutated.insert(pos, 1, "ACGT"[std::rand() % 4]);
+            break;
+        default:
+            mutated.erase(pos, 1);
+            break;
+        }
+    }
+    return mutated;
+}
+
+// Global edit distance, by dynamic programming over the whole matrix.
+int edit_distance(const std::string& query, const std::string& target) {
+    std::vector<int> row(target.size() + 1);
+    std::iota(row.begin(), row.end(), 0);
+    for (size_t i = 1; i <= query.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = static_cast<int>(i);
+        for (size_t j = 1; j <= target.size(); ++j) {
+            const int substitution = diagonal + (query[i - 1] == target[j - 1] ? 0 : 1);
+            diagonal = row[j];
+            row[j] = std::min({substitution, row[j] + 1, row[j - 1] + 1});
+        }
+    }
+    return row.back();
+}
+
+// Checks that the path spells out an alignment of the whole of both sequences, with the
+// alignment's edit distance.
+void check_path(const BandedAlignment& alignment,
+                const std::string& query,
+                const std::string& target) {
+    size_t query_pos = 0;
+    size_t target_pos = 0;
+    int num_edits = 0;
+    for (const auto op : alignment.path) {
+        if (op == BandedAligner::kMatch || op == BandedAligner::kMismatch) {
+            REQUIRE(query_pos < query.size());
+            REQUIRE(target_pos < target.size());
+            CHECK((query[query_pos] == target[target_pos]) == (op == BandedAligner::kMatch));
+            num_edits += op == BandedAligner::kMismatch;
+            ++query_pos;
+            ++target_pos;
+        } else if (op == BandedAligner::kInsertion) {
+            ++query_pos;
+            ++num_edits;
+        } else {
+            REQUIRE(op == BandedAligner::kDeletion);
+            ++target_pos;
+            ++num_edits;
+        }
+    }
+    CHECK(query_pos == query.size());
+    CHECK(target_pos == target.size());
+    CHECK(num_edits == alignment.edit_distance);
+    CHECK(alignment.target_start == 0);
+    CHECK(alignment.target_end == static_cast<int>(target.size()) - 1);
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Identical sequences match throughout", TEST_GROUP) {
+    BandedAligner aligner(torch::Device(torch::kCPU), 8);
+    const auto seq = random_sequence(200);
+    const auto alignments = aligner.align({{seq, seq}});
+    REQUIRE(alignments.size() == 1);
+    CHECK(alignments[0].edit_distance == 0);
+    CHECK(alignments[0].path == std::vector<unsigned char>(seq.size(), BandedAligner::kMatch));
+}
+
+TEST_CASE(TEST_GROUP ": Finds the edit distance of similar sequences", TEST_GROUP) {
+    std::srand(42);
+    // A small traceback limit splits the pairs across several batches.
+    const int64_t max_batch_cells = GENERATE(int64_t(1) << 30, 20000);
+    BandedAligner aligner(torch::Device(torch::kCPU), 32, max_batch_cells);
+
+    std::vector<std::string> queries;
+    std::vector<std::string> targets;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(random_sequence(1 + std::rand() % 300));
+        targets.push_back(mutate(queries.back(), std::rand() % 20));
+    }
+    // Empty sequences are aligned entirely by insertions or deletions.
+    queries.push_back("");
+    targets.push_back("ACGT");
+    queries.push_back("ACGT");
+    targets.push_back("");
+
+    std::vector<BandedAligner::SequencePair> pairs;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        pairs.emplace_back(queries[i], targets[i]);
+    }
+    const auto alignments = aligner.align(pairs);
+    REQUIRE(alignments.size() == pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        CAPTURE(queries[i], targets[i]);
+        CHECK(alignments[i].edit_distance == edit_distance(queries[i], targets[i]));
+        check_path(alignments[i], queries[i], targets[i]);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Gives no path for pairs too far from the diagonal", TEST_GROUP) {
+    std::srand(7);
+    BandedAligner aligner(torch::Device(torch::kCPU), 4);
+    // The query's 50 base prefix is missing from the target, so the best path runs 50 bases
+    // off the diagonal near the start.
+    const auto target = random_sequence(400);
+    const auto query = random_sequence(50) + target;
+    const auto alignments = aligner.align({{query, target}});
+    REQUIRE(alignments.size() == 1);
+    CHECK(alignments[0].edit_distance == -1);
+    CHECK(alignments[0].path.empty());
+}
@@ -0,0 +1,133 @@
+#include "read_pipeline/BarcodeClassifierNode.h"
+
+#include "MessageSinkUtils.h"
+#include "utils/barcode_kits.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <string>
+
+#define TEST_GROUP "[read_pipeline][BarcodeClassifierNode]"
+
+using namespace dorado;
+
+namespace {
+
+std::string random_sequence(std::minstd_rand& rng, size_t length) {
+    std::uniform_int_distribution<int> base(0, 3);
+    std::string sequence(length, 'A');
+    for (auto& c : sequence) {
+        c = "ACGT"[base(rng)];
+    }
+    return sequence;
+}
+
+std::shared_ptr<Read> make_read(const std::string& seq) {
+    auto read = std::make_shared<Read>();
+    read->read_id = "read";
+    read->seq = seq;
+    read->qstring = std::string(seq.size(), '5');
+    read->model_stride = 5;
+    // Each base takes two moves.
+    for (size_t i = 0; i < seq.size(); ++i) {
+        read->moves.push_back(1);
+        read->moves.push_back(0);
+    }
+    read->raw_data = torch::zeros({int64_t(read->moves.size() * read->model_stride)});
+    read->num_trimmed_samples = 10;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Classifies and trims barcoded reads", TEST_GROUP) {
+    std::minstd_rand rng(42);
+    BarcodeClassifierSettings settings;
+    settings.kits = utils::parse_barcode_kits("EXP-NBD104");
+    settings.trim = GENERATE(true, false);
+    CAPTURE(settings.trim);
+    MessageSinkToVector<std::shared_ptr<Read>> sink(100);
+    BarcodeClassifierNode classifier(sink, settings, 1);
+
+    const auto& kit = settings.kits.front();
+    const auto& [name, barcode] = kit.barcodes[2];
+    const auto arrangement = kit.front_flank + barcode + kit.rear_flank;
+    const auto prefix = random_sequence(rng, 20);
+    const auto insert = random_sequence(rng, 500);
+    const auto suffix = random_sequence(rng, 15);
+
+    SECTION("Barcode at the front") {
+        auto read = make_read(prefix + arrangement + insert);
+        const auto num_samples = read->get_num_raw_samples() + read->num_trimmed_samples;
+        CHECK(classifier.classify(*read));
+        CHECK(read->barcode == "EXP-NBD104_" + name);
+        if (settings.trim) {
+            CHECK(read->seq == insert);
+            CHECK(read->qstring.size() == insert.size());
+            CHECK(read->moves.size() == 2 * insert.size());
+            // The trimmed bases' signal is counted as trimmed, so the total is unchanged.
+            CHECK(read->get_num_raw_samples() + read->num_trimmed_samples == num_samples);
+        } else {
+            CHECK(read->seq == prefix + arrangement + insert);
+        }
+    }
+
+    SECTION("Barcode reverse complemented at the rear") {
+        auto read = make_read(insert + utils::reverse_complement(arrangement) + suffix);
+        CHECK(classifier.classify(*read));
+        CHECK(read->barcode == "EXP-NBD104_" + name);
+        if (settings.trim) {
+            CHECK(read->seq == insert);
+        }
+    }
+
+    SECTION("No barcode") {
+        auto read = make_read(insert);
+        CHECK_FALSE(classifier.classify(*read));
+        CHECK(read->barcode == BarcodeClassifierNode::kUnclassified);
+        CHECK(read->seq == insert);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Can require barcodes at both ends", TEST_GROUP) {
+    std::minstd_rand rng(7);
+    BarcodeClassifierSettings settings;
+    settings.kits = utils::parse_barcode_kits("EXP-NBD104");
+    settings.require_both_ends = true;
+    MessageSinkToVector<std::shared_ptr<Read>> sink(100);
+    BarcodeClassifierNode classifier(sink, settings, 1);
+
+    const auto& kit = settings.kits.front();
+    const auto arrangement = kit.front_flank + kit.barcodes[0].second + kit.rear_flank;
+    const auto insert = random_sequence(rng, 400);
+
+    auto single_ended = make_read(arrangement + insert);
+    CHECK_FALSE(classifier.classify(*single_ended));
+    auto double_ended = make_read(arrangement + insert + utils::reverse_complement(arrangement));
+    CHECK(classifier.classify(*double_ended));
+    CHECK(double_ended->barcode == "EXP-NBD104_barcode01");
+}
+
+TEST_CASE(TEST_GROUP ": Passes every read on", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> sink(100);
+    {
+        BarcodeClassifierSettings settings;
+        settings.kits = utils::parse_barcode_kits("EXP-NBD104");
+        BarcodeClassifierNode classifier(sink, settings, 2);
+        for (int i = 0; i < 10; ++i) {
+            classifier.push_message(make_read("ACGTACGTACGT"));
+        }
+    }
+    auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 10);
+    for (const auto& read : reads) {
+        CHECK(read->barcode == BarcodeClassifierNode::kUnclassified);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Rejects unknown kits", TEST_GROUP) {
+    CHECK_THROWS(utils::parse_barcode_kits("EXP-NBD104,NOT-A-KIT"));
+    CHECK(utils::parse_barcode_kits("EXP-NBD104,SQK-NBD114-12").size() == 2);
+}
@@ -0,0 +1,82 @@
+#include "TestUtils.h"
+#include "utils/BasecallCache.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[BasecallCache]"
+
+namespace fs = std::filesystem;
+using dorado::utils::BasecallCache;
+
+namespace {
+
+BasecallCache::Call make_call(const std::string& seq) {
+    return {seq, std::string(seq.size(), '5'), {1, 0, 1, 1, 0}, 5};
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": calls are found by signal hash and length", CUT_TAG) {
+    TempDir dir;
+    BasecallCache cache(dir.m_path / "calls.bin");
+    CHECK_FALSE(cache.find(1, 100));
+
+    cache.insert(1, 100, make_call("ACGT"));
+    cache.insert(2, 100, make_call("TTT"));
+    const auto call = cache.find(1, 100);
+    REQUIRE(call);
+    CHECK(call->seq == "ACGT");
+    CHECK(call->qstring == "5555");
+    CHECK(call->moves == std::vector<uint8_t>{1, 0, 1, 1, 0});
+    CHECK(call->model_stride == 5);
+    CHECK(cache.find(2, 100)->seq == "TTT");
+    CHECK_FALSE(cache.find(1, 101));
+
+    // The first call of a signal is kept.
+    cache.insert(1, 100, make_call("GG"));
+    CHECK(cache.find(1, 100)->seq == "ACGT");
+    CHECK(cache.size() == 2);
+}
+
+TEST_CASE(CUT_TAG ": calls persist, and a partial record is dropped", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "calls.bin";
+    {
+        BasecallCache cache(path);
+        cache.insert(1, 100, make_call("ACGT"));
+        cache.insert(2, 200, make_call("CCCCCC"));
+    }
+    // Cut the last record short, as an interrupted run might.
+    fs::resize_file(path, fs::file_size(path) - 3);
+
+    BasecallCache cache(path);
+    CHECK(cache.size() == 1);
+    CHECK(cache.find(1, 100)->seq == "ACGT");
+    CHECK_FALSE(cache.find(2, 200));
+    cache.insert(2, 200, make_call("CCCCCC"));
+    CHECK(cache.find(2, 200)->seq == "CCCCCC");
+}
+
+TEST_CASE(CUT_TAG ": other files are not taken for a cache", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "calls.bin";
+    std::ofstream(path) << "not a cache";
+    CHECK_THROWS(BasecallCache(path));
+}
+
+TEST_CASE(CUT_TAG ": signal_hash depends on the signal", CUT_TAG) {
+    const std::vector<int16_t> signal = {1, 2, 3, 4};
+    auto other = signal;
+    other[3] = 5;
+    const auto bytes = signal.size() * sizeof(int16_t);
+    CHECK(BasecallCache::signal_hash(signal.data(), bytes) ==
+          BasecallCache::signal_hash(signal.data(), bytes));
+    CHECK(BasecallCache::signal_hash(signal.data(), bytes) !=
+          BasecallCache::signal_hash(other.data(), bytes));
+}
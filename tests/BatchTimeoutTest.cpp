@@ -0,0 +1,67 @@
+#include "read_pipeline/BatchTimeout.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+
+#define TEST_GROUP "[read_pipeline][BatchTimeout]"
+
+using dorado::AdaptiveBatchTimeout;
+using namespace std::chrono_literals;
+
+TEST_CASE("BatchTimeoutTest: An empty batch waits for the latency target", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(200);
+    CHECK(timeout.wait_ms(0, 64, AdaptiveBatchTimeout::Clock::now()) == 200);
+}
+
+TEST_CASE("BatchTimeoutTest: Steady arrivals fill the batch up to the target", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(200);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    // A chunk every 5ms.
+    for (int i = 0; i < 10; ++i) {
+        timeout.chunks_added(1, now);
+        now += 5ms;
+    }
+    // The first chunk arrived 50ms ago, so the rest of the target is left to fill the batch.
+    CHECK(timeout.wait_ms(10, 64, now) == 150);
+    CHECK(timeout.timeout_ms() == 200);
+}
+
+TEST_CASE("BatchTimeoutTest: The call time is allowed for, up to half the target", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(200);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    timeout.chunks_added(1, now);
+    timeout.batch_called(40);
+    timeout.chunks_added(1, now);
+    timeout.chunks_added(1, now);
+    CHECK(timeout.wait_ms(2, 64, now) == 160);
+
+    AdaptiveBatchTimeout slow_runner(200);
+    slow_runner.batch_called(500);
+    slow_runner.chunks_added(1, now);
+    slow_runner.chunks_added(1, now);
+    CHECK(slow_runner.wait_ms(2, 64, now) == 100);
+}
+
+TEST_CASE("BatchTimeoutTest: A batch is called once arrivals stop", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(1000);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    for (int i = 0; i < 10; ++i) {
+        timeout.chunks_added(1, now);
+        now += 10ms;
+    }
+    // Once 300ms have passed without a chunk, against a usual gap of 10ms, another 300ms is
+    // expected, which the target still allows.  After 620ms, another 620ms is too long.
+    now += 290ms;
+    CHECK(timeout.wait_ms(10, 64, now) == 610);
+    now += 320ms;
+    CHECK(timeout.wait_ms(10, 64, now) == 0);
+}
+
+TEST_CASE("BatchTimeoutTest: A batch past its target is called at once", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(100);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    timeout.chunks_added(1, now);
+    CHECK(timeout.wait_ms(1, 64, now + 150ms) == 0);
+    CHECK(timeout.timeout_ms() == 150);
+}
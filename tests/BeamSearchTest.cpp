@@ -0,0 +1,113 @@
+#include "decode/beam_search.h"
+
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[BeamSearch]"
+
+// The kernels under test are AVX2 on x86 CPUs which support it, NEON on aarch64, and scalar
+// elsewhere.  Each is checked against these scalar references.  Results must match exactly:
+// max and >= comparisons don't round, so only the sign of a zero max may differ, which ==
+// treats as equal.
+namespace {
+
+float reference_max(const std::vector<float>& scores) {
+    float max = -std::numeric_limits<float>::max();
+    for (float score : scores) {
+        if (score > max) {
+            max = score;
+        }
+    }
+    return max;
+}
+
+size_t reference_count_at_least(const std::vector<float>& scores, float threshold) {
+    size_t count = 0;
+    for (float score : scores) {
+        if (score >= threshold) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::vector<float> random_scores(size_t count, std::mt19937& gen) {
+    std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+    std::vector<float> scores(count);
+    for (auto& score : scores) {
+        score = dist(gen);
+    }
+    return scores;
+}
+
+// Lengths around the 4 and 8 float vector widths, so every path runs both its vector loop and
+// its scalar tail, as well as a typical beam front of 5 * 32 candidates.
+const std::vector<size_t> kLengths = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 160, 163};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": max_beam_front_score matches the scalar reference", CUT_TAG) {
+    std::mt19937 gen{42};
+    for (size_t length : kLengths) {
+        CAPTURE(length);
+        const auto scores = random_scores(length, gen);
+        CHECK(max_beam_front_score(scores.data(), scores.size()) == reference_max(scores));
+    }
+}
+
+TEST_CASE(CUT_TAG ": max_beam_front_score finds a max in the scalar tail", CUT_TAG) {
+    std::vector<float> scores(19, -5.0f);
+    scores.back() = 3.0f;
+    CHECK(max_beam_front_score(scores.data(), scores.size()) == 3.0f);
+}
+
+TEST_CASE(CUT_TAG ": max_beam_front_score ignores NaN scores", CUT_TAG) {
+    std::mt19937 gen{42};
+    for (size_t length : kLengths) {
+        CAPTURE(length);
+        auto scores = random_scores(length, gen);
+        for (size_t i = 0; i < scores.size(); i += 3) {
+            scores[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+        const float max = max_beam_front_score(scores.data(), scores.size());
+        CHECK_FALSE(std::isnan(max));
+        CHECK(max == reference_max(scores));
+    }
+}
+
+TEST_CASE(CUT_TAG ": count_beam_front_scores_at_least matches the scalar reference", CUT_TAG) {
+    std::mt19937 gen{42};
+    for (size_t length : kLengths) {
+        CAPTURE(length);
+        auto scores = random_scores(length, gen);
+        // Ties with the threshold must be counted.
+        if (!scores.empty()) {
+            scores[scores.size() / 2] = 10.0f;
+        }
+        for (float threshold : {-101.0f, -50.0f, 0.0f, 10.0f, 99.0f, 101.0f}) {
+            CAPTURE(threshold);
+            CHECK(count_beam_front_scores_at_least(scores.data(), scores.size(), threshold) ==
+                  reference_count_at_least(scores, threshold));
+        }
+    }
+}
+
+TEST_CASE(CUT_TAG ": count_beam_front_scores_at_least ignores NaN scores", CUT_TAG) {
+    std::mt19937 gen{42};
+    for (size_t length : kLengths) {
+        CAPTURE(length);
+        auto scores = random_scores(length, gen);
+        for (size_t i = 1; i < scores.size(); i += 2) {
+            scores[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+        for (float threshold : {-101.0f, 0.0f}) {
+            CAPTURE(threshold);
+            CHECK(count_beam_front_scores_at_least(scores.data(), scores.size(), threshold) ==
+                  reference_count_at_least(scores, threshold));
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#include "TestUtils.h"
+#include "utils/cache_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#define CUT_TAG "[CacheUtils]"
+
+namespace fs = std::filesystem;
+
+TEST_CASE(CUT_TAG ": cache_file_name depends on every key part", CUT_TAG) {
+    const auto name = dorado::utils::cache_file_name({"model", "cuda:0", "Half"}, ".pt");
+    CHECK(name == dorado::utils::cache_file_name({"model", "cuda:0", "Half"}, ".pt"));
+    CHECK(name.size() == 32 + 3);
+    CHECK(name.substr(32) == ".pt");
+    CHECK(name != dorado::utils::cache_file_name({"model", "cuda:0", "Float"}, ".pt"));
+    // Key parts are not simply concatenated.
+    CHECK(dorado::utils::cache_file_name({"ab", "c"}, "") !=
+          dorado::utils::cache_file_name({"a", "bc"}, ""));
+}
+
+TEST_CASE(CUT_TAG ": directory_fingerprint changes with the files", CUT_TAG) {
+    TempDir dir;
+    std::ofstream(dir.m_path / "config.toml") << "a";
+    const auto fingerprint = dorado::utils::directory_fingerprint(dir.m_path);
+    CHECK(fingerprint == dorado::utils::directory_fingerprint(dir.m_path));
+
+    std::ofstream(dir.m_path / "config.toml") << "ab";
+    CHECK(fingerprint != dorado::utils::directory_fingerprint(dir.m_path));
+}
+
+TEST_CASE(CUT_TAG ": file_fingerprint changes with the file", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "reads.pod5";
+    std::ofstream(path) << "a";
+    const auto fingerprint = dorado::utils::file_fingerprint(path);
+    CHECK(fingerprint == dorado::utils::file_fingerprint(path));
+
+    std::ofstream(path) << "ab";
+    CHECK(fingerprint != dorado::utils::file_fingerprint(path));
+}
+
+TEST_CASE(CUT_TAG ": write_cache_file", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "sub" / "entry.txt";
+
+    SECTION("The entry is moved into place") {
+        CHECK(dorado::utils::write_cache_file(
+                path, [](const fs::path& temp_path) { std::ofstream(temp_path) << "cached"; }));
+        std::string contents;
+        std::ifstream(path) >> contents;
+        CHECK(contents == "cached");
+        // Only the entry itself is left behind.
+        CHECK(std::distance(fs::directory_iterator(path.parent_path()), fs::directory_iterator()) ==
+              1);
+    }
+
+    SECTION("Failed writes leave no entry") {
+        CHECK_FALSE(dorado::utils::write_cache_file(path, [](const fs::path& temp_path) {
+            std::ofstream(temp_path) << "partial";
+            throw std::runtime_error("write failed");
+        }));
+        CHECK_FALSE(fs::exists(path));
+        CHECK(fs::is_empty(path.parent_path()));
+    }
+}
+
+TEST_CASE(CUT_TAG ": trim_cache_dir evicts the least recently used entries", CUT_TAG) {
+    TempDir dir;
+    const auto now = fs::file_time_type::clock::now();
+    // Four 100 byte entries, last used in the order of their names.
+    for (int i = 0; i < 4; ++i) {
+        const auto path = dir.m_path / ("entry" + std::to_string(i));
+        std::ofstream(path) << std::string(100, 'x');
+        fs::last_write_time(path, now - std::chrono::hours(4 - i));
+    }
+    // Using the oldest entry makes it the most recent.
+    dorado::utils::touch_cache_file(dir.m_path / "entry0");
+    // Entries still being written don't count and are never evicted.
+    std::ofstream(dir.m_path / "entry4.tmp.1") << std::string(1000, 'x');
+
+    CHECK(dorado::utils::trim_cache_dir(dir.m_path, 250) == 200);
+    CHECK(fs::exists(dir.m_path / "entry0"));
+    CHECK_FALSE(fs::exists(dir.m_path / "entry1"));
+    CHECK_FALSE(fs::exists(dir.m_path / "entry2"));
+    CHECK(fs::exists(dir.m_path / "entry3"));
+    CHECK(fs::exists(dir.m_path / "entry4.tmp.1"));
+
+    // Nothing more to do when under the limit.
+    CHECK(dorado::utils::trim_cache_dir(dir.m_path, 250) == 0);
+}
+
+#ifndef _WIN32
+TEST_CASE(CUT_TAG ": get_weights_cache_max_bytes honours the environment", CUT_TAG) {
+    CHECK(dorado::utils::get_weights_cache_max_bytes() ==
+          dorado::utils::kDefaultWeightsCacheMaxBytes);
+    setenv("dorado_weights_cache_mb", "3", 1);
+    CHECK(dorado::utils::get_weights_cache_max_bytes() == 3 * 1024 * 1024);
+    setenv("dorado_weights_cache_mb", "0", 1);
+    CHECK(dorado::utils::get_weights_cache_max_bytes() == 0);
+    unsetenv("dorado_weights_cache_mb");
+}
+
+TEST_CASE(CUT_TAG ": get_cache_dir honours the environment", CUT_TAG) {
+    setenv("dorado_cache_dir", "/tmp/dorado_cache", 1);
+    CHECK(dorado::utils::get_cache_dir() == fs::path("/tmp/dorado_cache"));
+    setenv("dorado_no_cache", "1", 1);
+    CHECK_FALSE(dorado::utils::get_cache_dir().has_value());
+    unsetenv("dorado_no_cache");
+    unsetenv("dorado_cache_dir");
+}
+#endif
+
+TEST_CASE(CUT_TAG ": cached values expire", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "value.txt";
+    CHECK_FALSE(dorado::utils::read_cached_value(path, std::chrono::hours(1)).has_value());
+
+    REQUIRE(dorado::utils::write_cached_value(path, "1024"));
+    CHECK(dorado::utils::read_cached_value(path, std::chrono::hours(1)) == "1024");
+
+    // An entry whose timestamp is decades old.
+    std::ofstream(path) << "100\n1024\n";
+    CHECK_FALSE(dorado::utils::read_cached_value(path, std::chrono::hours(1)).has_value());
+}
+
+#ifndef _WIN32
+TEST_CASE(CUT_TAG ": clear_cache removes only cache entries", CUT_TAG) {
+    TempDir dir;
+    setenv("dorado_cache_dir", dir.m_path.c_str(), 1);
+    const auto entry = dir.m_path / dorado::utils::kBatchSizeCacheDir / "entry.txt";
+    REQUIRE(dorado::utils::write_cached_value(entry, "1024"));
+    std::ofstream(dir.m_path / "unrelated.txt") << "keep";
+
+    dorado::utils::clear_cache();
+    CHECK_FALSE(fs::exists(entry));
+    CHECK(fs::exists(dir.m_path / "unrelated.txt"));
+    unsetenv("dorado_cache_dir");
+}
+#endif
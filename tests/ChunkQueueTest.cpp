@@ -0,0 +1,156 @@
+#include "read_pipeline/ChunkQueue.h"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][ChunkQueue]"
+
+namespace {
+
+std::vector<std::shared_ptr<dorado::Chunk>> make_chunks(const std::shared_ptr<dorado::Read>& read,
+                                                        size_t num_chunks) {
+    std::vector<std::shared_ptr<dorado::Chunk>> chunks;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        chunks.push_back(std::make_shared<dorado::Chunk>(read.get(), i * 10, i, 10));
+    }
+    return chunks;
+}
+
+// Pushes reads "a" (3 chunks), "b" (1 chunk) and "c" (2 chunks) and returns
+// "<read_id><idx_in_read>" for each chunk in the order they are popped.
+std::vector<std::string> pop_order(dorado::ChunkSchedulingPolicy policy) {
+    dorado::ChunkQueue queue(policy);
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    for (auto [read_id, num_chunks] : {std::pair{"a", 3}, {"b", 1}, {"c", 2}}) {
+        auto read = std::make_shared<dorado::Read>();
+        read->read_id = read_id;
+        queue.push_read_chunks(make_chunks(read, num_chunks));
+        reads.push_back(std::move(read));
+    }
+    CHECK(queue.size() == 6);
+
+    std::vector<std::string> order;
+    while (!queue.empty()) {
+        auto chunk = queue.pop();
+        order.push_back(chunk->source_read->read_id + std::to_string(chunk->idx_in_read));
+    }
+    return order;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": FIFO keeps read arrival order", TEST_GROUP) {
+    CHECK(pop_order(dorado::ChunkSchedulingPolicy::FIFO) ==
+          std::vector<std::string>{"a0", "a1", "a2", "b0", "c0", "c1"});
+}
+
+TEST_CASE(TEST_GROUP ": Shortest remaining read is called first", TEST_GROUP) {
+    CHECK(pop_order(dorado::ChunkSchedulingPolicy::ShortestRemainingFirst) ==
+          std::vector<std::string>{"b0", "c0", "c1", "a0", "a1", "a2"});
+}
+
+TEST_CASE(TEST_GROUP ": Shortest remaining accounts for chunks already called", TEST_GROUP) {
+    dorado::ChunkQueue queue(dorado::ChunkSchedulingPolicy::ShortestRemainingFirst);
+    auto long_read = std::make_shared<dorado::Read>();
+    auto short_read = std::make_shared<dorado::Read>();
+    queue.push_read_chunks(make_chunks(long_read, 3));
+    CHECK(queue.pop()->source_read == long_read.get());
+    CHECK(queue.pop()->source_read == long_read.get());
+    // The long read now has fewer chunks left than the new read.
+    queue.push_read_chunks(make_chunks(short_read, 2));
+    CHECK(queue.pop()->source_read == long_read.get());
+    CHECK(queue.pop()->source_read == short_read.get());
+    CHECK(queue.pop()->source_read == short_read.get());
+    CHECK(queue.empty());
+}
+
+TEST_CASE(TEST_GROUP ": Shortest remaining ages long reads so they aren't starved", TEST_GROUP) {
+    constexpr size_t kAgingChunks = 4;
+    constexpr size_t kLongReadChunks = 10;
+    dorado::ChunkQueue queue(dorado::ChunkSchedulingPolicy::ShortestRemainingFirst,
+                             kAgingChunks);
+    auto long_read = std::make_shared<dorado::Read>();
+    queue.push_read_chunks(make_chunks(long_read, kLongReadChunks));
+
+    // A short read arrives for every chunk called, which would hold the long read up for
+    // ever without aging.
+    std::vector<std::shared_ptr<dorado::Read>> short_reads;
+    size_t num_popped = 0;
+    size_t long_chunks_popped = 0;
+    while (long_chunks_popped < kLongReadChunks && num_popped < 1000) {
+        short_reads.push_back(std::make_shared<dorado::Read>());
+        queue.push_read_chunks(make_chunks(short_reads.back(), 1));
+        if (queue.pop()->source_read == long_read.get()) {
+            ++long_chunks_popped;
+        }
+        ++num_popped;
+    }
+    CHECK(long_chunks_popped == kLongReadChunks);
+    // It waits until it has aged past the short reads, and then finishes.
+    CHECK(num_popped == (kLongReadChunks - 1) * kAgingChunks + kLongReadChunks);
+}
+
+TEST_CASE(TEST_GROUP ": Round robin interleaves reads", TEST_GROUP) {
+    CHECK(pop_order(dorado::ChunkSchedulingPolicy::RoundRobin) ==
+          std::vector<std::string>{"a0", "b0", "c0", "a1", "c1", "a2"});
+}
+
+TEST_CASE(TEST_GROUP ": Clients take turns whatever the policy", TEST_GROUP) {
+    // A large job queued ahead of a small one doesn't hold it up.
+    dorado::ChunkQueue queue(dorado::ChunkSchedulingPolicy::FIFO);
+    auto large = std::make_shared<dorado::Read>();
+    large->client_id = 1;
+    auto small = std::make_shared<dorado::Read>();
+    small->client_id = 2;
+    queue.push_read_chunks(make_chunks(large, 4));
+    queue.push_read_chunks(make_chunks(small, 2));
+
+    std::vector<int32_t> clients;
+    while (!queue.empty()) {
+        clients.push_back(queue.pop()->source_read->client_id);
+    }
+    CHECK(clients == std::vector<int32_t>{1, 2, 1, 2, 1, 1});
+}
+
+TEST_CASE(TEST_GROUP ": Clients take their weight in chunks each turn", TEST_GROUP) {
+    dorado::ChunkQueue queue(dorado::ChunkSchedulingPolicy::RoundRobin);
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    for (int32_t client_id : {1, 2}) {
+        auto read = std::make_shared<dorado::Read>();
+        read->client_id = client_id;
+        queue.push_read_chunks(make_chunks(read, 4));
+        reads.push_back(std::move(read));
+    }
+    queue.set_client_weight(2, 3);
+
+    std::vector<int32_t> clients;
+    while (!queue.empty()) {
+        clients.push_back(queue.pop()->source_read->client_id);
+    }
+    CHECK(clients == std::vector<int32_t>{1, 2, 2, 2, 1, 2, 1, 1});
+
+    // Setting the weight back to 1 forgets it.
+    queue.set_client_weight(2, 1);
+    for (const auto& read : reads) {
+        queue.push_read_chunks(make_chunks(read, 2));
+    }
+    clients.clear();
+    while (!queue.empty()) {
+        clients.push_back(queue.pop()->source_read->client_id);
+    }
+    CHECK(clients == std::vector<int32_t>{1, 2, 1, 2});
+}
+
+TEST_CASE(TEST_GROUP ": Parse scheduling policy names", TEST_GROUP) {
+    CHECK(dorado::parse_chunk_scheduling_policy("fifo") == dorado::ChunkSchedulingPolicy::FIFO);
+    CHECK(dorado::parse_chunk_scheduling_policy("shortest") ==
+          dorado::ChunkSchedulingPolicy::ShortestRemainingFirst);
+    CHECK(dorado::parse_chunk_scheduling_policy("round_robin") ==
+          dorado::ChunkSchedulingPolicy::RoundRobin);
+    CHECK_THROWS_AS(dorado::parse_chunk_scheduling_policy("random"), std::runtime_error);
+}
@@ -0,0 +1,82 @@
+#include "read_pipeline/ClientRouterNode.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][ClientRouterNode]"
+
+namespace {
+
+std::shared_ptr<dorado::Read> make_read(const std::string& read_id, int32_t client_id) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = read_id;
+    read->client_id = client_id;
+    return read;
+}
+
+}  // namespace
+
+using ReadSink = MessageSinkToVector<std::shared_ptr<dorado::Read>>;
+
+TEST_CASE(TEST_GROUP ": Reads are routed back to their client", TEST_GROUP) {
+    dorado::ClientRouterNode router;
+    ReadSink sink_a(100), sink_b(100);
+    router.add_client(1, sink_a);
+    router.add_client(2, sink_b);
+
+    router.push_message(make_read("a0", 1));
+    std::vector<dorado::Message> batch;
+    batch.push_back(make_read("b0", 2));
+    batch.push_back(make_read("b1", 2));
+    batch.push_back(make_read("a1", 1));
+    router.push_messages(std::move(batch));
+    // Reads for clients which aren't registered are dropped.
+    router.push_message(make_read("x0", 3));
+
+    CHECK(router.wait_for_reads(1, 2));
+    CHECK(router.wait_for_reads(2, 2));
+    CHECK(router.remove_client(1) == 2);
+    CHECK(router.remove_client(2) == 2);
+    sink_a.terminate();
+    sink_b.terminate();
+
+    auto reads_a = sink_a.get_messages();
+    REQUIRE(reads_a.size() == 2);
+    CHECK(reads_a[0]->read_id == "a0");
+    CHECK(reads_a[1]->read_id == "a1");
+    auto reads_b = sink_b.get_messages();
+    REQUIRE(reads_b.size() == 2);
+    CHECK(reads_b[0]->read_id == "b0");
+    CHECK(reads_b[1]->read_id == "b1");
+
+    auto stats = router.sample_stats();
+    CHECK(stats["messages_routed"] == 4);
+    CHECK(stats["messages_dropped"] == 1);
+}
+
+TEST_CASE(TEST_GROUP ": Waiting for reads", TEST_GROUP) {
+    dorado::ClientRouterNode router;
+    ReadSink sink(100);
+    router.add_client(0, sink);
+    CHECK_THROWS_AS(router.add_client(0, sink), std::runtime_error);
+
+    std::thread producer([&router] {
+        for (int i = 0; i < 10; ++i) {
+            router.push_message(make_read(std::to_string(i), 0));
+        }
+    });
+    CHECK(router.wait_for_reads(0, 10));
+    producer.join();
+
+    // Termination releases waiters whose reads will never arrive.
+    std::thread terminator([&router] { router.terminate(); });
+    CHECK_FALSE(router.wait_for_reads(0, 11));
+    terminator.join();
+    sink.terminate();
+}
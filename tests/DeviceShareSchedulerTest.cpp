@@ -0,0 +1,132 @@
+#include "nn/DeviceShareScheduler.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[nn][DeviceShareScheduler]"
+
+using namespace std::chrono_literals;
+using dorado::DeviceShareScheduler;
+
+namespace {
+
+// Records the order in which each pipeline's batches get the device.
+class CallRecorder {
+public:
+    explicit CallRecorder(DeviceShareScheduler& scheduler) : m_scheduler(scheduler) {}
+
+    // Runs a batch of the named pipeline on a new thread, once the scheduler allows, and waits
+    // for it to be queued.
+    void call(size_t pipeline, const std::string& name, std::chrono::milliseconds call_time) {
+        const auto num_waiting = m_scheduler.sample_stats().at(name + ".waiting");
+        m_threads.emplace_back([this, pipeline, name, call_time] {
+            m_scheduler.acquire(pipeline);
+            {
+                std::lock_guard lock(m_mutex);
+                m_order.push_back(name);
+            }
+            m_scheduler.release(pipeline, call_time);
+        });
+        while (m_scheduler.sample_stats().at(name + ".waiting") == num_waiting) {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+
+    std::vector<std::string> order() {
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+        return m_order;
+    }
+
+private:
+    DeviceShareScheduler& m_scheduler;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::vector<std::string> m_order;
+};
+
+}  // namespace
+
+TEST_CASE("DeviceShareScheduler: The pipeline furthest behind its share goes next", TEST_GROUP) {
+    DeviceShareScheduler scheduler("scheduler", 1);
+    const auto simplex = scheduler.add_pipeline("simplex", 1.);
+    const auto stereo = scheduler.add_pipeline("stereo", 1.);
+
+    // Both pipelines queue a batch behind a long simplex batch, after which stereo is behind.
+    CallRecorder recorder(scheduler);
+    scheduler.acquire(simplex);
+    recorder.call(simplex, "simplex", 10ms);
+    recorder.call(stereo, "stereo", 10ms);
+    scheduler.release(simplex, 100ms);
+
+    CHECK(recorder.order() == std::vector<std::string>{"stereo", "simplex"});
+    const auto stats = scheduler.sample_stats();
+    CHECK(stats.at("simplex.calls") == 2.);
+    CHECK(stats.at("stereo.calls") == 1.);
+    CHECK(stats.at("simplex.device_ms") == Approx(110.));
+}
+
+TEST_CASE("DeviceShareScheduler: Pipelines get device time by weight", TEST_GROUP) {
+    DeviceShareScheduler scheduler("scheduler", 1);
+    const auto simplex = scheduler.add_pipeline("simplex", 1.);
+    const auto stereo = scheduler.add_pipeline("stereo", 2.);
+
+    CallRecorder recorder(scheduler);
+    scheduler.acquire(simplex);
+    recorder.call(simplex, "simplex", 100ms);
+    for (int i = 0; i < 3; ++i) {
+        recorder.call(stereo, "stereo", 100ms);
+    }
+    scheduler.release(simplex, 100ms);
+
+    // Stereo's 100ms batches count half as much, so it has two for each of simplex's.
+    CHECK(recorder.order() == std::vector<std::string>{"stereo", "stereo", "simplex", "stereo"});
+}
+
+TEST_CASE("DeviceShareScheduler: An idle pipeline doesn't catch up on time it left", TEST_GROUP) {
+    DeviceShareScheduler scheduler("scheduler", 1);
+    const auto simplex = scheduler.add_pipeline("simplex", 1.);
+    const auto stereo = scheduler.add_pipeline("stereo", 1.);
+
+    // Simplex has the device to itself for a while.
+    for (int i = 0; i < 10; ++i) {
+        scheduler.acquire(simplex);
+        scheduler.release(simplex, 100ms);
+    }
+
+    // Stereo then starts level with simplex, rather than taking the next ten batches.
+    CallRecorder recorder(scheduler);
+    scheduler.acquire(simplex);
+    recorder.call(simplex, "simplex", 100ms);
+    recorder.call(stereo, "stereo", 100ms);
+    recorder.call(stereo, "stereo", 100ms);
+    scheduler.release(simplex, 100ms);
+
+    CHECK(recorder.order() == std::vector<std::string>{"stereo", "simplex", "stereo"});
+}
+
+TEST_CASE("DeviceShareScheduler: Batches run concurrently up to the limit", TEST_GROUP) {
+    DeviceShareScheduler scheduler("scheduler", 2);
+    const auto simplex = scheduler.add_pipeline("simplex", 1.);
+    const auto stereo = scheduler.add_pipeline("stereo", 1.);
+
+    scheduler.acquire(simplex);
+    scheduler.acquire(stereo);
+    CallRecorder recorder(scheduler);
+    recorder.call(simplex, "simplex", 10ms);
+    scheduler.release(stereo, 10ms);
+    CHECK(recorder.order() == std::vector<std::string>{"simplex"});
+    scheduler.release(simplex, 10ms);
+}
+
+TEST_CASE("DeviceShareScheduler: Shares must be positive", TEST_GROUP) {
+    DeviceShareScheduler scheduler("scheduler", 1);
+    CHECK_THROWS(scheduler.add_pipeline("simplex", 0.));
+}
@@ -0,0 +1,160 @@
+#include "MessageSinkUtils.h"
+#include "TestUtils.h"
+#include "api/dorado_api.h"
+#include "data_loader/DataLoader.h"
+#include "utils/models.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[api]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A model whose sample rate matches the test POD5 data.
+const std::string kModelName = "dna_r9.4.1_e8_fast@v3.4";
+
+// Size of dorado_pipeline_options in API version 1.  Callers built against that header pass
+// this struct_size, which is smaller than sizeof once fields are added.
+constexpr size_t kPipelineOptionsV1Size =
+        offsetof(dorado_pipeline_options, read_callback_user_data) + sizeof(void*);
+
+}  // namespace
+
+TEST_CASE("DoradoApiTest: Init functions set the struct size and defaults", TEST_GROUP) {
+    CHECK(dorado_api_version() == DORADO_API_VERSION);
+
+    dorado_pipeline_options options;
+    dorado_pipeline_options_init(&options);
+    CHECK(options.struct_size == sizeof(dorado_pipeline_options));
+    CHECK(options.model_path == nullptr);
+    CHECK(options.read_callback == nullptr);
+
+    dorado_signal signal;
+    dorado_signal_init(&signal);
+    CHECK(signal.struct_size == sizeof(dorado_signal));
+    CHECK(signal.samples == nullptr);
+    CHECK(signal.calibration_scale == 1.f);
+}
+
+TEST_CASE("DoradoApiTest: A missing model is an invalid argument", TEST_GROUP) {
+    dorado_pipeline_options options;
+    dorado_pipeline_options_init(&options);
+    options.model_path = "/this/model/does/not/exist";
+
+    dorado_pipeline* pipeline = nullptr;
+    CHECK(dorado_pipeline_create(&options, &pipeline) == DORADO_ERROR_INVALID_ARGUMENT);
+    CHECK(pipeline == nullptr);
+    CHECK(std::string(dorado_last_error()).find("/this/model/does/not/exist") !=
+          std::string::npos);
+}
+
+TEST_CASE("DoradoApiTest: Structs not set up by their init function are rejected", TEST_GROUP) {
+    dorado_pipeline_options options{};
+    dorado_pipeline* pipeline = nullptr;
+    CHECK(dorado_pipeline_create(&options, &pipeline) == DORADO_ERROR_INVALID_ARGUMENT);
+    CHECK(std::string(dorado_last_error()).size() > 0);
+}
+
+TEST_CASE("DoradoApiTest: Structs smaller than in version 1 are rejected", TEST_GROUP) {
+    dorado_pipeline_options options;
+    dorado_pipeline_options_init(&options);
+    options.model_path = "/this/model/does/not/exist";
+    options.struct_size = kPipelineOptionsV1Size - 1;
+
+    dorado_pipeline* pipeline = nullptr;
+    CHECK(dorado_pipeline_create(&options, &pipeline) == DORADO_ERROR_INVALID_ARGUMENT);
+    CHECK(std::string(dorado_last_error()).find("dorado_pipeline_options_init") !=
+          std::string::npos);
+}
+
+TEST_CASE("DoradoApiTest: Structs from older and newer headers are accepted", TEST_GROUP) {
+    // The options are read, as far as the model path which is then found to be missing.
+    // A newer header's options are followed by fields this library doesn't know.
+    struct NewerOptions {
+        dorado_pipeline_options options;
+        int64_t new_field;
+    } newer{};
+    dorado_pipeline_options_init(&newer.options);
+    newer.options.model_path = "/this/model/does/not/exist";
+    const auto struct_size = GENERATE(kPipelineOptionsV1Size, sizeof(NewerOptions));
+    CAPTURE(struct_size);
+    newer.options.struct_size = struct_size;
+
+    dorado_pipeline* pipeline = nullptr;
+    CHECK(dorado_pipeline_create(&newer.options, &pipeline) == DORADO_ERROR_INVALID_ARGUMENT);
+    CHECK(std::string(dorado_last_error()).find("/this/model/does/not/exist") !=
+          std::string::npos);
+}
+
+TEST_CASE("DoradoApiTest: Submitted reads are called and can be polled", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> loader_sink(100);
+    dorado::DataLoader loader(loader_sink, "cpu", 1, 0);
+    loader.load_reads(get_pod5_data_dir(), false);
+    const auto reads = loader_sink.get_messages();
+    REQUIRE(reads.size() == 1);
+    const auto& read = *reads.front();
+
+    TempDir model_dir;
+    dorado::utils::download_models(model_dir.m_path.string(), kModelName);
+    const auto model_path = (model_dir.m_path / kModelName).string();
+
+    dorado_pipeline_options options;
+    dorado_pipeline_options_init(&options);
+    options.model_path = model_path.c_str();
+    options.device = "cpu";
+    options.batch_size = 32;
+    dorado_pipeline* pipeline = nullptr;
+    REQUIRE(dorado_pipeline_create(&options, &pipeline) == DORADO_OK);
+
+    // The read is submitted twice, once from a newer header's larger struct.
+    struct NewerSignal {
+        dorado_signal signal;
+        int64_t new_field;
+    } newer{};
+    for (uint64_t tag : {1, 2}) {
+        auto& signal = newer.signal;
+        dorado_signal_init(&signal);
+        if (tag == 2) {
+            signal.struct_size = sizeof(NewerSignal);
+        }
+        signal.read_id = read.read_id.c_str();
+        signal.read_tag = tag;
+        signal.samples = read.raw_data.data_ptr<int16_t>();
+        signal.num_samples = read.raw_data.size(0);
+        signal.sample_rate = read.sample_rate;
+        signal.calibration_offset = read.offset;
+        signal.calibration_scale = read.scaling;
+        CHECK(dorado_pipeline_submit(pipeline, &signal) == DORADO_OK);
+    }
+    REQUIRE(dorado_pipeline_finish(pipeline) == DORADO_OK);
+
+    std::vector<uint64_t> tags;
+    dorado_read* called = nullptr;
+    while (dorado_pipeline_poll(pipeline, &called, 1000) == DORADO_OK) {
+        CHECK(std::string(dorado_read_id(called)) == read.read_id);
+        tags.push_back(dorado_read_tag(called));
+        size_t sequence_length = 0;
+        size_t qstring_length = 0;
+        dorado_read_sequence(called, &sequence_length);
+        dorado_read_qstring(called, &qstring_length);
+        CHECK(sequence_length > 0);
+        CHECK(qstring_length == sequence_length);
+        dorado_read_free(called);
+    }
+    CHECK(dorado_pipeline_poll(pipeline, &called, 0) == DORADO_FINISHED);
+    std::sort(tags.begin(), tags.end());
+    CHECK(tags == std::vector<uint64_t>{1, 2});
+
+    // Nothing more is taken once the pipeline is finished.
+    CHECK(dorado_pipeline_submit(pipeline, &newer.signal) == DORADO_ERROR_INVALID_STATE);
+    dorado_pipeline_destroy(pipeline);
+}
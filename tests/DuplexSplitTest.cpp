@@ -115,3 +115,56 @@ TEST_CASE("4 subread split tagging", TEST_GROUP) {
                       }));
     CHECK(std::all_of(reads.begin(), reads.end(), [](const auto &r) { return r->read_tag == 42; }));
 }
+
+TEST_CASE("Subread tagging waits for duplex reads and rejections", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SubreadTaggerNode tag_node(sink, 2);
+
+        // Two input reads, split in two, each with two candidate pairs, one of which is
+        // rejected, with their messages interleaved.
+        std::vector<std::shared_ptr<dorado::Read>> templates;
+        for (uint64_t read_tag : {7, 8}) {
+            for (size_t subread_id = 0; subread_id < 2; ++subread_id) {
+                auto subread = std::make_shared<dorado::Read>();
+                subread->read_id = std::to_string(read_tag) + "_" + std::to_string(subread_id);
+                subread->read_tag = read_tag;
+                subread->subread_id = subread_id;
+                subread->split_count = 2;
+                subread->is_duplex = false;
+                if (subread_id == 0) {
+                    subread->num_duplex_candidate_pairs = 2;
+                    templates.push_back(subread);
+                }
+                tag_node.push_message(std::move(subread));
+            }
+        }
+        for (const auto& template_read : templates) {
+            auto duplex_read = std::make_shared<dorado::Read>();
+            duplex_read->read_id = template_read->read_id + ";complement";
+            duplex_read->read_tag = template_read->read_tag;
+            duplex_read->is_duplex = true;
+            tag_node.push_message(std::move(duplex_read));
+        }
+        for (const auto& template_read : templates) {
+            --template_read->num_duplex_candidate_pairs;
+            tag_node.push_message(dorado::CandidatePairRejectedMessage{template_read->read_tag});
+        }
+    }
+
+    auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 6);
+    for (uint64_t read_tag : {7, 8}) {
+        CAPTURE(read_tag);
+        std::vector<size_t> subread_ids;
+        for (const auto& read : reads) {
+            if (read->read_tag == read_tag) {
+                CHECK(read->split_count == 3);
+                CHECK(read->is_duplex == (read->subread_id == 2));
+                subread_ids.push_back(read->subread_id);
+            }
+        }
+        std::sort(subread_ids.begin(), subread_ids.end());
+        CHECK(subread_ids == std::vector<size_t>{0, 1, 2});
+    }
+}
@@ -0,0 +1,69 @@
+#include "read_pipeline/FakeDataLoader.h"
+
+#include "MessageSinkUtils.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <numeric>
+#include <set>
+
+#define TEST_GROUP "[read_pipeline][FakeDataLoader]"
+
+TEST_CASE("FakeDataLoader: Reads follow one another on each channel", TEST_GROUP) {
+    dorado::FakeReadSettings settings;
+    settings.median_read_samples = 8000;
+    settings.read_samples_sigma = 0.5f;
+    settings.num_channels = 2;
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::FakeDataLoader loader(sink, settings);
+    loader.load_reads(6);
+    sink.terminate();
+
+    const auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 6);
+    std::set<std::string> read_ids;
+    for (size_t i = 0; i < reads.size(); ++i) {
+        const auto& read = reads[i];
+        read_ids.insert(read->read_id);
+        CHECK(read->attributes.channel_number == int(i % 2) + 1);
+        CHECK(read->attributes.read_number == int(i / 2));
+        CHECK(size_t(read->raw_data.size(0)) >= settings.min_read_samples);
+        CHECK(read->attributes.num_samples == size_t(read->raw_data.size(0)));
+        CHECK(read->seq.empty());
+        if (i >= 2) {
+            CHECK(read->start_time_ms >=
+                  reads[i - 2]->get_end_time_ms() + settings.read_gap_ms);
+        }
+    }
+    CHECK(read_ids.size() == reads.size());
+}
+
+TEST_CASE("FakeDataLoader: Complements pair with their templates", TEST_GROUP) {
+    dorado::FakeReadSettings settings;
+    settings.median_read_samples = 4000;
+    settings.num_channels = 1;
+    settings.duplex_fraction = 1.f;
+    settings.basecalled = true;
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::FakeDataLoader loader(sink, settings);
+    loader.load_reads(4);
+    sink.terminate();
+
+    const auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 4);
+    for (size_t i = 0; i < reads.size(); i += 2) {
+        const auto& read = reads[i];
+        const auto& complement = reads[i + 1];
+        CHECK(read->moves.size() == 4000 / 5);
+        CHECK(std::accumulate(read->moves.begin(), read->moves.end(), size_t(0)) ==
+              read->seq.size());
+        CHECK(read->qstring.size() == read->seq.size());
+        CHECK(complement->seq == dorado::utils::reverse_complement(read->seq));
+        CHECK(complement->moves.front() == 1);
+        CHECK(std::accumulate(complement->moves.begin(), complement->moves.end(), size_t(0)) ==
+              complement->seq.size());
+        CHECK(complement->attributes.channel_number == read->attributes.channel_number);
+        CHECK(complement->start_time_ms > read->get_end_time_ms());
+    }
+}
@@ -88,6 +88,21 @@ TEST_CASE(TEST_GROUP "Test loading single-read Fast5 file, matched read list") {
     REQUIRE(mock_sink.get_read_count() == 1);
 }
 
+TEST_CASE(TEST_GROUP "Test loading single-read Fast5 file, read in ignore list") {
+    // Create a mock sink for testing output of reads
+    MockSink mock_sink;
+
+    dorado::ReadIDSet read_ignore_list;
+    // Read present in Fast5 file.
+    read_ignore_list.insert(
+            *dorado::utils::parse_read_id("59097f00-0f1c-4fac-aea2-3c23d79b0a58"));
+    std::string data_path(get_fast5_data_dir());
+    dorado::DataLoader loader(mock_sink, "cpu", 2, 0, std::nullopt, read_ignore_list);
+    loader.load_reads(data_path, false);
+
+    REQUIRE(mock_sink.get_read_count() == 0);
+}
+
 TEST_CASE(TEST_GROUP "Test loading sample rate from fast5 returns nullopt") {
     std::string data_path(get_fast5_data_dir());
     REQUIRE(dorado::DataLoader::get_sample_rate(data_path) == 6024);
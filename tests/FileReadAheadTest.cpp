@@ -0,0 +1,72 @@
+#include "TestUtils.h"
+#include "utils/FileReadAhead.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[FileReadAhead]"
+
+namespace fs = std::filesystem;
+using dorado::utils::FileReadAhead;
+
+namespace {
+
+std::string write_file(const fs::path& path, size_t size) {
+    std::ofstream file(path, std::ios::binary);
+    file << std::string(size, 'x');
+    return path.string();
+}
+
+// Waits a while for the read-ahead to have read expected_bytes.
+bool wait_for_bytes_read(const FileReadAhead& read_ahead, uint64_t expected_bytes) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (read_ahead.bytes_read() < expected_bytes &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return read_ahead.bytes_read() == expected_bytes;
+}
+
+}  // namespace
+
+#ifndef _WIN32
+
+TEST_CASE(CUT_TAG ": reads ahead of the consumer, as far as the window", CUT_TAG) {
+    TempDir dir;
+    constexpr size_t kFileBytes = 3 << 20;
+    const std::vector<std::string> paths{write_file(dir.m_path / "a", kFileBytes),
+                                         (dir.m_path / "missing").string(),
+                                         write_file(dir.m_path / "b", kFileBytes + 1)};
+
+    FileReadAhead read_ahead(paths, kFileBytes);
+    CHECK(read_ahead.file_size(0) == kFileBytes);
+    CHECK(read_ahead.file_size(1) == 0);
+    CHECK(read_ahead.file_size(2) == kFileBytes + 1);
+    CHECK(wait_for_bytes_read(read_ahead, kFileBytes));
+
+    read_ahead.set_read_position(2, 0);
+    CHECK(wait_for_bytes_read(read_ahead, 2 * kFileBytes + 1));
+}
+
+TEST_CASE(CUT_TAG ": skips forward to a consumer which is ahead", CUT_TAG) {
+    TempDir dir;
+    constexpr size_t kFileBytes = 1 << 20;
+    const std::vector<std::string> paths{write_file(dir.m_path / "a", kFileBytes),
+                                         write_file(dir.m_path / "b", kFileBytes)};
+
+    FileReadAhead read_ahead(paths, 0);
+    read_ahead.set_read_position(1, kFileBytes / 2);
+    read_ahead.set_read_position(2, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // The window is empty, so nothing but what the consumer was already past could be read.
+    CHECK(read_ahead.bytes_read() == 0);
+}
+
+#endif  // _WIN32
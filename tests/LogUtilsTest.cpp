@@ -0,0 +1,27 @@
+#include "utils/log_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+#define CUT_TAG "[LogUtils]"
+
+TEST_CASE(CUT_TAG ": LogRateLimiter lets one message through per interval", CUT_TAG) {
+    dorado::utils::LogRateLimiter limiter(50ms);
+
+    // The first message always goes through, with nothing suppressed before it.
+    auto suppressed = limiter.acquire();
+    REQUIRE(suppressed.has_value());
+    CHECK(*suppressed == 0);
+
+    CHECK_FALSE(limiter.acquire().has_value());
+    CHECK_FALSE(limiter.acquire().has_value());
+
+    std::this_thread::sleep_for(60ms);
+    suppressed = limiter.acquire();
+    REQUIRE(suppressed.has_value());
+    CHECK(*suppressed == 2);
+}
@@ -0,0 +1,26 @@
+#include "utils/metrics_server.h"
+
+#include <catch2/catch.hpp>
+
+#define CUT_TAG "[MetricsServer]"
+
+TEST_CASE(CUT_TAG ": format_open_metrics empty", CUT_TAG) {
+    CHECK(dorado::stats::format_open_metrics({}) == "# EOF\n");
+}
+
+TEST_CASE(CUT_TAG ": format_open_metrics sanitises and sorts names", CUT_TAG) {
+    dorado::stats::NamedStats stats;
+    stats["ScalerNode.queue.items"] = 3;
+    stats["BasecallerNode.samples_processed"] = 123456789;
+    stats["cuda:0-runner.batch size"] = 0.5;
+
+    const std::string expected =
+            "# TYPE dorado_BasecallerNode_samples_processed gauge\n"
+            "dorado_BasecallerNode_samples_processed 123456789\n"
+            "# TYPE dorado_ScalerNode_queue_items gauge\n"
+            "dorado_ScalerNode_queue_items 3\n"
+            "# TYPE dorado_cuda:0_runner_batch_size gauge\n"
+            "dorado_cuda:0_runner_batch_size 0.5\n"
+            "# EOF\n";
+    CHECK(dorado::stats::format_open_metrics(stats) == expected);
+}
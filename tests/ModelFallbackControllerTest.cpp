@@ -0,0 +1,65 @@
+#include "read_pipeline/ModelFallbackController.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+#define TEST_GROUP "[read_pipeline][ModelFallbackController]"
+
+using namespace std::chrono_literals;
+
+TEST_CASE(TEST_GROUP ": Reads go to the main model until it is measured", TEST_GROUP) {
+    dorado::ModelFallbackController controller(10.0);
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(controller.route_read(start + i * 10ms) == 0);
+    }
+    // Warming up, the main model hasn't called anything yet.
+    int64_t reads_called = 0;
+    controller.set_reads_called_source([&reads_called] { return reads_called; });
+    for (int i = 0; i < 10; ++i) {
+        CHECK(controller.route_read(start + 10s + i * 1s) == 0);
+    }
+    CHECK_FALSE(controller.using_fallback());
+}
+
+TEST_CASE(TEST_GROUP ": Falls back under a backlog and switches back as it drains", TEST_GROUP) {
+    dorado::ModelFallbackController controller(10.0);
+    int64_t reads_called = 0;
+    controller.set_reads_called_source([&reads_called] { return reads_called; });
+    auto now = std::chrono::steady_clock::now();
+
+    // Routes the reads arriving in a second, in which the main model calls reads_called_per_s.
+    auto run_second = [&](int reads_arriving, int reads_called_per_s) {
+        size_t to_fallback = 0;
+        for (int i = 0; i < reads_arriving; ++i) {
+            to_fallback += controller.route_read(now);
+        }
+        reads_called += reads_called_per_s;
+        now += 1s;
+        return to_fallback;
+    };
+    // 100 reads arrive per second, but the main model calls 10 per second.
+    size_t seconds = 0;
+    while (!controller.using_fallback()) {
+        run_second(100, 10);
+        REQUIRE(++seconds < 10);
+    }
+    // More than 10s worth of reads were waiting for the main model.
+    CHECK(controller.sample_stats().at("backlog_s") > 10.0);
+    CHECK(run_second(100, 10) == 100);
+
+    // Once acquisition slows down, the main model works through its backlog, and takes the
+    // reads again.
+    seconds = 0;
+    while (controller.using_fallback()) {
+        run_second(5, 10);
+        REQUIRE(++seconds < 100);
+    }
+    CHECK(controller.sample_stats().at("backlog_s") < 5.0);
+    CHECK(controller.sample_stats().at("switches") == 2);
+    for (int i = 0; i < 10; ++i) {
+        CHECK(run_second(5, 10) == 0);
+    }
+}
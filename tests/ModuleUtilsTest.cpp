@@ -0,0 +1,47 @@
+#include "utils/module_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <string>
+
+#define CUT_TAG "[ModuleUtils]"
+
+namespace {
+
+dorado::utils::SharedModule make_module(int& num_loads) {
+    ++num_loads;
+    return dorado::utils::SharedModule(torch::nn::AnyModule(torch::nn::Linear(4, 2)));
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": load_shared_module loads each key once while it is held", CUT_TAG) {
+    int num_loads = 0;
+    auto load = [&num_loads] { return make_module(num_loads); };
+
+    auto first = dorado::utils::load_shared_module("test model a", load);
+    auto second = dorado::utils::load_shared_module("test model a", load);
+    CHECK(num_loads == 1);
+    CHECK(first.ptr() == second.ptr());
+
+    auto other = dorado::utils::load_shared_module("test model b", load);
+    CHECK(num_loads == 2);
+    CHECK(other.ptr() != first.ptr());
+
+    // Once every holder is gone, the weights are freed and the next load reloads them.
+    first = dorado::utils::SharedModule(nullptr);
+    second = dorado::utils::SharedModule(nullptr);
+    dorado::utils::load_shared_module("test model a", load);
+    CHECK(num_loads == 3);
+}
+
+TEST_CASE(CUT_TAG ": shared_module_key depends on the device and dtype", CUT_TAG) {
+    const auto options = torch::TensorOptions().device(torch::kCPU).dtype(torch::kFloat32);
+    const auto key = dorado::utils::shared_module_key("crf", "models/a", options);
+    CHECK(key == dorado::utils::shared_module_key("crf", "models/./a", options));
+    CHECK(key != dorado::utils::shared_module_key("crf", "models/b", options));
+    CHECK(key != dorado::utils::shared_module_key("remora", "models/a", options));
+    CHECK(key != dorado::utils::shared_module_key("crf", "models/a",
+                                                  options.dtype(torch::kFloat16)));
+}
@@ -0,0 +1,81 @@
+#include "utils/MotifScanner.h"
+
+#include "utils/base_mod_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[utils][MotifScanner]"
+
+using namespace dorado::utils;
+
+namespace {
+
+// Every start of motif in sequence, found one position at a time.
+std::vector<size_t> naive_hits(const std::string& sequence, const std::string& motif) {
+    std::vector<size_t> hits;
+    for (size_t pos = 0; pos + motif.size() <= sequence.size(); ++pos) {
+        bool match = true;
+        for (size_t i = 0; i < motif.size() && match; ++i) {
+            // H is anything but G, as in the CHG and CHH contexts.
+            match = motif[i] == 'H' ? sequence[pos + i] != 'G' : sequence[pos + i] == motif[i];
+        }
+        if (match) {
+            hits.push_back(pos);
+        }
+    }
+    return hits;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Finds every occurrence of each motif", TEST_GROUP) {
+    std::srand(42);
+    // Enough motifs that they don't fit in one word, including a repeat.
+    const std::vector<std::string> motifs = {
+            "CG", "CHG", "CHH", "A", "GATC", "CG", "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT"};
+    const MotifScanner scanner(motifs);
+    CHECK(scanner.num_motifs() == motifs.size());
+
+    for (int trial = 0; trial < 50; ++trial) {
+        std::string sequence(std::rand() % 500, 'A');
+        for (auto& base : sequence) {
+            base = "ACGT"[std::rand() % 4];
+        }
+        if (trial == 0) {
+            sequence += motifs.back() + "CGT";
+        }
+        const auto hits = scanner.scan(sequence);
+        REQUIRE(hits.size() == motifs.size());
+        for (size_t m = 0; m < motifs.size(); ++m) {
+            CAPTURE(trial, motifs[m]);
+            CHECK(hits[m] == naive_hits(sequence, motifs[m]));
+        }
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Overlapping hits and other bases", TEST_GROUP) {
+    const MotifScanner scanner({"AA", "CG"});
+    const auto hits = scanner.scan("AAAANCGNcg");
+    CHECK(hits[0] == std::vector<size_t>{0, 1, 2});
+    CHECK(hits[1] == std::vector<size_t>{5, 8});
+    CHECK(scanner.scan("")[0].empty());
+}
+
+TEST_CASE(TEST_GROUP ": Invalid motifs are rejected", TEST_GROUP) {
+    CHECK_THROWS(MotifScanner({""}));
+    CHECK_THROWS(MotifScanner({"CXG"}));
+    CHECK_THROWS(MotifScanner({std::string(65, 'A')}));
+}
+
+TEST_CASE(TEST_GROUP ": BaseModContext sequence mask", TEST_GROUP) {
+    BaseModContext context;
+    context.set_context("CG", 0);
+    context.set_context("GATC", 1);
+    const auto mask = context.get_sequence_mask("CGATCGTCGACG");
+    const std::vector<int> expected = {1, 0, 1, 0, 1, 0, 0, 1, 0, 0, 0, 0};
+    CHECK(mask == expected);
+}
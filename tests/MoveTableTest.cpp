@@ -0,0 +1,51 @@
+#include "utils/MoveTable.h"
+
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+#define TEST_GROUP "[utils][MoveTable]"
+
+using namespace dorado::utils;
+
+TEST_CASE(TEST_GROUP ": Matches the unpacked move table functions", TEST_GROUP) {
+    std::srand(42);
+    const size_t kStride = 5;
+    // Lengths either side of whole words and SIMD registers.
+    for (size_t length : {0, 1, 31, 63, 64, 65, 127, 128, 200, 4001}) {
+        CAPTURE(length);
+        std::vector<uint8_t> moves(length);
+        for (auto& move : moves) {
+            move = std::rand() % 3 == 0;
+        }
+        const MoveTable table(moves);
+        const auto cum_sums = move_cum_sums(moves);
+        CHECK(table.num_timesteps() == length);
+        CHECK(table.num_moves() == (cum_sums.empty() ? 0 : cum_sums.back()));
+        CHECK(table.cum_sums() == cum_sums);
+        for (size_t i = 0; i < length; ++i) {
+            REQUIRE(table.cum_sum(i) == cum_sums[i]);
+            REQUIRE(table.is_move(i) == (moves[i] != 0));
+        }
+        const size_t signal_len = length * kStride + 3;
+        CHECK(table.to_sig_map(kStride, signal_len) == moves_to_map(moves, kStride, signal_len));
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Packs moves a bit per timestep and unpacks them again", TEST_GROUP) {
+    const std::vector<uint8_t> moves{1, 0, 1, 1, 0, 0, 0, 0, 2, 1};
+    const auto packed = pack_move_bits(moves);
+    CHECK(packed == std::vector<uint8_t>{0x0d, 0x03});
+    CHECK(unpack_move_bits(packed, moves.size()) ==
+          std::vector<uint8_t>{1, 0, 1, 1, 0, 0, 0, 0, 1, 1});
+    CHECK(pack_move_bits({}).empty());
+}
+
+TEST_CASE(TEST_GROUP ": Treats any nonzero value as a move", TEST_GROUP) {
+    const MoveTable table(std::vector<uint8_t>{2, 0, 255, 1});
+    CHECK(table.num_moves() == 3);
+    CHECK(table.to_sig_map(1, 4) == std::vector<uint64_t>{0, 2, 3, 4});
+}
@@ -1,4 +1,5 @@
 #include "MessageSinkUtils.h"
+#include "TestUtils.h"
 #include "decode/CPUDecoder.h"
 #include "nn/CRFModel.h"
 #include "nn/ModBaseRunner.h"
@@ -111,40 +112,11 @@ using NodeSmokeTestBam = NodeSmokeTestBase<dorado::BamPtr>;
     } while (false)
 #endif
 
-// Wrapper around a temporary directory since one doesn't exist in the standard
-struct TempDir {
-    TempDir(std::filesystem::path path) : m_path(std::move(path)) {}
-    ~TempDir() { std::filesystem::remove_all(m_path); }
-
-    TempDir(const TempDir&) = delete;
-    TempDir& operator=(const TempDir&) = delete;
-
-    std::filesystem::path m_path;
-};
-
 // Download a model to a temporary directory
 TempDir download_model(std::string const& model) {
-    // Create a new directory to download the model to
-#ifdef _WIN32
-    std::filesystem::path path;
-    while (true) {
-        char temp[L_tmpnam];
-        char const* name = std::tmpnam(temp);
-        if (std::filesystem::create_directories(name)) {
-            path = std::filesystem::canonical(name);
-            break;
-        }
-    }
-#else
-    // macOS (rightfully) complains about tmpnam() usage, so make use of mkdtemp() on platforms that support it
-    std::string temp = (std::filesystem::temp_directory_path() / "model_XXXXXXXXXX").string();
-    char const* name = mkdtemp(temp.data());
-    auto path = std::filesystem::canonical(name);
-#endif
-
-    // Download it
-    dorado::utils::download_models(path.string(), model);
-    return TempDir(std::move(path));
+    TempDir dir;
+    dorado::utils::download_models(dir.m_path.string(), model);
+    return dir;
 }
 
 DEFINE_TEST(NodeSmokeTestRead, "ScalerNode") {
@@ -0,0 +1,26 @@
+#include "utils/numa_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+#define CUT_TAG "[NumaUtils]"
+
+TEST_CASE(CUT_TAG ": parse_cpu_list", CUT_TAG) {
+    using Cpus = std::vector<int>;
+    CHECK(dorado::utils::parse_cpu_list("") == Cpus{});
+    CHECK(dorado::utils::parse_cpu_list("5") == Cpus{5});
+    CHECK(dorado::utils::parse_cpu_list("0-3") == Cpus{0, 1, 2, 3});
+    CHECK(dorado::utils::parse_cpu_list("0-1,8,10-11\n") == Cpus{0, 1, 8, 10, 11});
+    // Malformed ranges are skipped.
+    CHECK(dorado::utils::parse_cpu_list("x,2") == Cpus{2});
+}
+
+TEST_CASE(CUT_TAG ": Unknown nodes aren't bound", CUT_TAG) {
+    CHECK(!dorado::utils::bind_thread_to_numa_node(-1));
+    CHECK(dorado::utils::pci_device_numa_node("not-a-device") == -1);
+    // Binding to a node only lasts for the binding's scope, whether or not it succeeds.
+    { dorado::utils::ScopedNumaBinding binding(0); }
+    { dorado::utils::ScopedNumaBinding binding(-1); }
+    CHECK(dorado::utils::num_numa_nodes() >= 0);
+}
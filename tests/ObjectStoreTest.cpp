@@ -0,0 +1,52 @@
+#include "TestUtils.h"
+#include "utils/ObjectStore.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[ObjectStore]"
+
+namespace fs = std::filesystem;
+using dorado::utils::ObjectInfo;
+using dorado::utils::ObjectPrefetcher;
+
+TEST_CASE(CUT_TAG ": object store URLs are told apart from local paths", CUT_TAG) {
+    CHECK(dorado::utils::is_object_store_url("s3://bucket/run/pod5"));
+    CHECK(dorado::utils::is_object_store_url("gs://bucket"));
+    CHECK_FALSE(dorado::utils::is_object_store_url("/data/s3://run"));
+    CHECK_FALSE(dorado::utils::is_object_store_url("run/pod5"));
+}
+
+TEST_CASE(CUT_TAG ": staged objects are used without downloading them again", CUT_TAG) {
+    TempDir dir;
+    const std::string url = "s3://bucket/run/";
+    const std::vector<ObjectInfo> objects{{"run/a.pod5", 3, "etag_a"}, {"run/b.pod5", 0, "b"}};
+    const auto staged_a = ObjectPrefetcher::staged_path(dir.m_path, "s3://bucket/run/a.pod5",
+                                                        objects[0]);
+    CHECK(staged_a.extension() == ".pod5");
+    std::ofstream(staged_a, std::ios::binary) << "abc";
+
+    ObjectPrefetcher prefetcher(url, objects, dir.m_path);
+    auto path = prefetcher.next();
+    REQUIRE(path);
+    CHECK(*path == staged_a);
+    prefetcher.release(*path);
+    CHECK_FALSE(fs::exists(staged_a));
+
+    // An empty object needs no download either.
+    path = prefetcher.next();
+    REQUIRE(path);
+    CHECK(fs::file_size(*path) == 0);
+    CHECK_FALSE(prefetcher.next());
+    CHECK(prefetcher.bytes_downloaded() == 0);
+}
+
+TEST_CASE(CUT_TAG ": uploads need an object to upload to", CUT_TAG) {
+    CHECK_THROWS(dorado::utils::ObjectUploader("s3://bucket"));
+    CHECK_THROWS(dorado::utils::ObjectUploader("s3://bucket/"));
+}
@@ -0,0 +1,109 @@
+#include "read_pipeline/OutputShards.h"
+
+#include "htslib/sam.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+
+#define TEST_GROUP "[read_pipeline][OutputShards]"
+
+using namespace dorado;
+
+namespace {
+
+Message make_record(const std::string& read_id, const std::string& read_group, int channel) {
+    BamPtr record(bam_init1());
+    bam_set1(record.get(), read_id.size(), read_id.c_str(), BAM_FUNMAP, -1, -1, 0, 0, nullptr,
+             -1, -1, 0, 0, nullptr, nullptr, 0);
+    if (!read_group.empty()) {
+        bam_aux_append(record.get(), "RG", 'Z', read_group.size() + 1,
+                       reinterpret_cast<const uint8_t*>(read_group.c_str()));
+    }
+    if (channel > 0) {
+        bam_aux_append(record.get(), "ch", 'i', sizeof(channel),
+                       reinterpret_cast<const uint8_t*>(&channel));
+    }
+    return record;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Parses shard policies", TEST_GROUP) {
+    CHECK(parse_output_shard_policy("read_id").key == OutputShardPolicy::Key::ReadId);
+    CHECK(parse_output_shard_policy("read_group").key == OutputShardPolicy::Key::ReadGroup);
+    auto channel = parse_output_shard_policy("channel");
+    CHECK(channel.key == OutputShardPolicy::Key::Channel);
+    CHECK(channel.max_channel == 3000);
+    CHECK(parse_output_shard_policy("channel:512").max_channel == 512);
+    CHECK_THROWS(parse_output_shard_policy("channel:"));
+    CHECK_THROWS(parse_output_shard_policy("channel:0"));
+    CHECK_THROWS(parse_output_shard_policy("channels"));
+    CHECK_THROWS(parse_output_shard_policy("mux"));
+}
+
+TEST_CASE(TEST_GROUP ": Names shard files by index and format", TEST_GROUP) {
+    CHECK(output_shard_filename("out/calls", 7, HtsWriter::OutputMode::BAM) ==
+          "out/calls_007.bam");
+    CHECK(output_shard_filename("calls", 12, HtsWriter::OutputMode::SAM) == "calls_012.sam");
+    CHECK(output_shard_filename("calls", 1234, HtsWriter::OutputMode::FASTQ) ==
+          "calls_1234.fastq");
+    CHECK(output_shard_filename("calls", 3, HtsWriter::OutputMode::FASTQ_GZ) ==
+          "calls_003.fastq.gz");
+}
+
+TEST_CASE(TEST_GROUP ": Routes read IDs to every shard, the same way each time", TEST_GROUP) {
+    const size_t kNumShards = 4;
+    auto route = make_output_shard_route(parse_output_shard_policy("read_id"), kNumShards, {});
+    auto route_again =
+            make_output_shard_route(parse_output_shard_policy("read_id"), kNumShards, {});
+    std::set<size_t> shards;
+    for (int i = 0; i < 100; ++i) {
+        const auto record = make_record("read_" + std::to_string(i), "", 0);
+        const size_t shard = route(record);
+        CHECK(shard < kNumShards);
+        CHECK(route_again(record) == shard);
+        shards.insert(shard);
+    }
+    CHECK(shards.size() == kNumShards);
+}
+
+TEST_CASE(TEST_GROUP ": Routes channels in equal ranges", TEST_GROUP) {
+    auto route = make_output_shard_route(parse_output_shard_policy("channel:512"), 4, {});
+    CHECK(route(make_record("read", "", 1)) == 0);
+    CHECK(route(make_record("read", "", 128)) == 0);
+    CHECK(route(make_record("read", "", 129)) == 1);
+    CHECK(route(make_record("read", "", 512)) == 3);
+    // Channels past the maximum go to the last shard, and records without one to the first.
+    CHECK(route(make_record("read", "", 600)) == 3);
+    CHECK(route(make_record("read", "", 0)) == 0);
+}
+
+TEST_CASE(TEST_GROUP ": Routes read groups in the order given", TEST_GROUP) {
+    auto route = make_output_shard_route(parse_output_shard_policy("read_group"), 2,
+                                         {"run0_model", "run1_model", "run2_model"});
+    CHECK(route(make_record("read", "run0_model", 0)) == 0);
+    CHECK(route(make_record("read", "run1_model", 0)) == 1);
+    CHECK(route(make_record("read", "run2_model", 0)) == 0);
+    CHECK(route(make_record("read", "unknown_model", 0)) < 2);
+    CHECK(route(make_record("read", "", 0)) == 0);
+}
+
+TEST_CASE(TEST_GROUP ": Routes barcodes to their own shards", TEST_GROUP) {
+    auto policy = parse_output_shard_policy("barcode");
+    CHECK(policy.key == OutputShardPolicy::Key::Barcode);
+    auto route = make_output_shard_route(policy, 3, {}, {"kit_barcode01", "kit_barcode02"});
+    auto make_barcoded_record = [](const std::string& barcode) {
+        auto record = make_record("read", "", 0);
+        bam_aux_append(std::get<BamPtr>(record).get(), "BC", 'Z', barcode.size() + 1,
+                       reinterpret_cast<const uint8_t*>(barcode.c_str()));
+        return record;
+    };
+    CHECK(route(make_barcoded_record("kit_barcode01")) == 1);
+    CHECK(route(make_barcoded_record("kit_barcode02")) == 2);
+    CHECK(route(make_barcoded_record("unclassified")) == 0);
+    CHECK(route(make_record("read", "", 0)) == 0);
+}
@@ -0,0 +1,71 @@
+#include "utils/PackedSequence.h"
+
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <string>
+
+#define TEST_GROUP "[utils][PackedSequence]"
+
+using namespace dorado::utils;
+
+namespace {
+
+std::string random_sequence(size_t length) {
+    const std::string bases("ACGT");
+    std::string sequence(length, 'A');
+    for (auto& base : sequence) {
+        base = bases[std::rand() % 4];
+    }
+    return sequence;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Packs two bases per byte as BAM does", TEST_GROUP) {
+    const PackedSequence sequence("ACGTN");
+    REQUIRE(sequence.size() == 5);
+    REQUIRE(sequence.num_bytes() == 3);
+    CHECK(sequence.data()[0] == 0x12);
+    CHECK(sequence.data()[1] == 0x48);
+    // The padding nibble after an odd number of bases is 0.
+    CHECK(sequence.data()[2] == 0xf0);
+    CHECK(sequence.base(3) == 'T');
+    CHECK(sequence.to_string() == "ACGTN");
+    CHECK(PackedSequence("acgt").to_string() == "ACGT");
+    CHECK(unpack_nt16(sequence.data(), sequence.size()) == "ACGTN");
+}
+
+TEST_CASE(TEST_GROUP ": Copies packed bases", TEST_GROUP) {
+    const uint8_t packed[] = {0x12, 0x48, 0x1f};
+    CHECK(PackedSequence::from_nt16(packed, 6).to_string() == "ACGTAN");
+    const auto odd = PackedSequence::from_nt16(packed, 5);
+    CHECK(odd.to_string() == "ACGTA");
+    CHECK(odd.data()[2] == 0x10);
+}
+
+TEST_CASE(TEST_GROUP ": Reverse complements packed bases", TEST_GROUP) {
+    CHECK(PackedSequence("").reverse_complement().empty());
+    CHECK(PackedSequence("AACGN").reverse_complement().to_string() == "NCGTT");
+    std::srand(42);
+    // Lengths either side of whole SIMD registers, odd and even.
+    for (size_t length : {1, 2, 63, 64, 65, 127, 128, 129, 1001, 20000}) {
+        CAPTURE(length);
+        const auto sequence = random_sequence(length);
+        const auto reversed = PackedSequence(sequence).reverse_complement();
+        CHECK(reversed.to_string() == reverse_complement(sequence));
+        if (length % 2 != 0) {
+            CHECK((reversed.data()[reversed.num_bytes() - 1] & 0xf) == 0);
+        }
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Extracts k-mers", TEST_GROUP) {
+    const PackedSequence sequence("ACGTTGCANA");
+    CHECK(sequence.kmer(0, 4) == 0b00011011);
+    CHECK(sequence.kmer(4, 4) == 0b11100100);
+    CHECK(sequence.kmer(9, 1) == 0);
+    CHECK_FALSE(sequence.kmer(6, 3).has_value());
+}
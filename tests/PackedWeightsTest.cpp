@@ -0,0 +1,79 @@
+#include "TestUtils.h"
+#include "utils/packed_weights.h"
+#include "utils/tensor_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[PackedWeights]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void save_tensor(const fs::path& path, const torch::Tensor& tensor) {
+    torch::save(std::vector<torch::Tensor>{tensor}, path.string());
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": load_tensors reads the same tensors once packed", CUT_TAG) {
+    torch::manual_seed(42);
+    TempDir dir;
+    const std::vector<std::string> names = {"0.conv.weight.tensor", "0.conv.bias.tensor",
+                                            "1.linear.weight.tensor"};
+    save_tensor(dir.m_path / names[0], torch::rand({4, 1, 5}));
+    save_tensor(dir.m_path / names[1], torch::rand({4}, torch::kFloat16));
+    // A transposed tensor is packed contiguously.
+    save_tensor(dir.m_path / names[2], torch::rand({3, 7}).t());
+
+    const auto unpacked = dorado::utils::load_tensors(dir.m_path, names);
+    CHECK(dorado::utils::pack_model_weights(dir.m_path) == names.size());
+    CHECK(fs::exists(dir.m_path / dorado::utils::kPackedWeightsFile));
+
+    // Remove the original files, so the tensors can only come from the packed file.
+    for (const auto& name : names) {
+        fs::remove(dir.m_path / name);
+    }
+    const auto packed = dorado::utils::load_tensors(dir.m_path, names);
+    REQUIRE(packed.size() == unpacked.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        CHECK(packed[i].dtype() == unpacked[i].dtype());
+        CHECK(torch::equal(packed[i], unpacked[i]));
+    }
+}
+
+TEST_CASE(CUT_TAG ": packed tensors outlive the PackedWeights and may be written", CUT_TAG) {
+    TempDir dir;
+    save_tensor(dir.m_path / "w.tensor", torch::arange(10, torch::kFloat32));
+    dorado::utils::pack_model_weights(dir.m_path);
+
+    torch::Tensor tensor = dorado::utils::PackedWeights::open(dir.m_path /
+                                                              dorado::utils::kPackedWeightsFile)
+                                   ->tensor("w.tensor");
+    tensor.mul_(2);
+    CHECK(torch::equal(tensor, torch::arange(10, torch::kFloat32) * 2));
+
+    // The write isn't seen by anything else mapping the file.
+    const auto reloaded =
+            dorado::utils::PackedWeights::open(dir.m_path / dorado::utils::kPackedWeightsFile);
+    CHECK(torch::equal(reloaded->tensor("w.tensor"), torch::arange(10, torch::kFloat32)));
+    CHECK_FALSE(reloaded->contains("missing.tensor"));
+    CHECK_THROWS(reloaded->tensor("missing.tensor"));
+}
+
+TEST_CASE(CUT_TAG ": other files are rejected", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / dorado::utils::kPackedWeightsFile;
+    std::ofstream(path) << "not packed weights";
+    CHECK_THROWS(dorado::utils::PackedWeights::open(path));
+
+    // A header cut short is caught rather than read past the end of the file.
+    std::ofstream(path, std::ios::binary) << "DRDPACK1\x05";
+    CHECK_THROWS(dorado::utils::PackedWeights::open(path));
+}
@@ -0,0 +1,66 @@
+#include "utils/PairTable.h"
+#include "utils/uuid_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <sstream>
+
+#define CUT_TAG "[PairTable]"
+
+using dorado::utils::PairTable;
+
+namespace {
+
+const std::string kTemplate1 = "002bd127-db82-436f-b828-28567c3d505d";
+const std::string kComplement1 = "0007f755-bc82-432c-82be-76220b107ec5";
+const std::string kTemplate2 = "00646cea-16c8-4170-a4a2-6ac6c6b00034";
+const std::string kComplement2 = "012d4ba8-4fa5-4cb6-9b38-2a1bc3106791";
+
+dorado::ReadID id(const std::string& read_id) { return *dorado::utils::parse_read_id(read_id); }
+
+PairTable read_table(const std::string& pairs_list) {
+    std::istringstream in(pairs_list);
+    return PairTable::read(in);
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": pairs are found from either read", CUT_TAG) {
+    // The last line has no newline, and the first a Windows line ending.
+    const auto table = read_table(kTemplate2 + " " + kComplement2 + "\r\n\n" + kTemplate1 + " " +
+                                  kComplement1);
+    REQUIRE(table.size() == 2);
+    CHECK(table.num_skipped_lines() == 0);
+
+    CHECK(table.complement_of(id(kTemplate1)) == id(kComplement1));
+    CHECK(table.complement_of(id(kTemplate2)) == id(kComplement2));
+    CHECK(table.template_of(id(kComplement1)) == id(kTemplate1));
+    CHECK(table.template_of(id(kComplement2)) == id(kTemplate2));
+    CHECK_FALSE(table.complement_of(id(kComplement1)));
+    CHECK_FALSE(table.template_of(id(kTemplate1)));
+
+    // Pairs are listed in template order.
+    CHECK(table.pairs().front().first == id(kTemplate1));
+}
+
+TEST_CASE(CUT_TAG ": lines which aren't pairs of UUIDs are skipped", CUT_TAG) {
+    const auto table = read_table("read_1 read_2\n" + kTemplate1 + "\n" + kTemplate1 + " " +
+                                  kComplement1 + "\n");
+    CHECK(table.size() == 1);
+    CHECK(table.num_skipped_lines() == 2);
+}
+
+TEST_CASE(CUT_TAG ": the last pair listed for a read is kept", CUT_TAG) {
+    const auto table =
+            read_table(kTemplate1 + " " + kComplement1 + "\n" + kTemplate1 + " " + kComplement2);
+    REQUIRE(table.size() == 1);
+    CHECK(table.complement_of(id(kTemplate1)) == id(kComplement2));
+    CHECK(table.template_of(id(kComplement2)) == id(kTemplate1));
+    // The replaced pair is gone from both sides.
+    CHECK(table.template_of(id(kComplement1)) == std::nullopt);
+}
+
+TEST_CASE(CUT_TAG ": read IDs are formatted as they are parsed", CUT_TAG) {
+    CHECK(dorado::utils::format_read_id(id(kTemplate1)) == kTemplate1);
+    CHECK(dorado::utils::format_read_id(id("002BD127-DB82-436F-B828-28567C3D505D")) == kTemplate1);
+}
@@ -1,10 +1,15 @@
 #include "read_pipeline/PairingNode.h"
 
 #include "MessageSinkUtils.h"
+#include "utils/sequence_utils.h"
 #include "utils/time_utils.h"
 
 #include <catch2/catch.hpp>
 
+#include <memory>
+#include <random>
+#include <sstream>
+
 #define TEST_GROUP "[PairingNodeTest]"
 
 namespace {
@@ -25,6 +30,20 @@ std::shared_ptr<dorado::Read> make_read(int delay_ms, size_t seq_len) {
     read->seq = std::string(seq_len, 'A');
     return read;
 }
+
+std::shared_ptr<const dorado::utils::PairTable> make_pair_table(const std::string& pairs_list) {
+    std::istringstream in(pairs_list);
+    return std::make_shared<const dorado::utils::PairTable>(dorado::utils::PairTable::read(in));
+}
+
+std::string random_sequence(size_t len, std::mt19937& gen) {
+    std::uniform_int_distribution<int> dist(0, 3);
+    std::string seq(len, 'A');
+    for (auto& base : seq) {
+        base = "ACGT"[dist(gen)];
+    }
+    return seq;
+}
 }  // namespace
 
 TEST_CASE("Split read pairing", TEST_GROUP) {
@@ -43,8 +62,16 @@ TEST_CASE("Split read pairing", TEST_GROUP) {
     };
     // clang-format on
 
+    // Only {3} is the reverse complement of {2}.
+    std::mt19937 gen(42);
+    for (auto& read : reads) {
+        read->seq = random_sequence(read->seq.size(), gen);
+    }
+    reads[3]->seq =
+            dorado::utils::reverse_complement(reads[2]->seq).substr(0, reads[3]->seq.size());
+
     MessageSinkToVector<dorado::Message> sink(5);
-    dorado::PairingNode pairing_node(sink, std::nullopt, 1,
+    dorado::PairingNode pairing_node(sink, nullptr, 1,
                                      1);  // one thread, one read - force reads through in order
     for (auto& read : reads) {
         pairing_node.push_message(std::move(read));
@@ -64,3 +91,101 @@ TEST_CASE("Split read pairing", TEST_GROUP) {
             });
     CHECK(num_pairs == 1);
 }
+
+TEST_CASE("Minimizer prefilter rejects reads from different molecules", TEST_GROUP) {
+    // Two reads which meet the time and length criteria, but aren't complementary.
+    std::mt19937 gen(42);
+    std::vector<std::shared_ptr<dorado::Read>> reads = {make_read(0, 1000),
+                                                        make_read(3000, 1000)};
+    for (auto& read : reads) {
+        read->seq = random_sequence(read->seq.size(), gen);
+    }
+
+    dorado::DuplexPairingParameters params;
+    const bool prefilter_enabled = GENERATE(true, false);
+    if (!prefilter_enabled) {
+        params.min_shared_minimizer_frac = 0.f;
+    }
+
+    MessageSinkToVector<dorado::Message> sink(5);
+    dorado::PairingNode pairing_node(sink, nullptr, 1, 1, params);
+    for (auto& read : reads) {
+        pairing_node.push_message(std::move(read));
+    }
+    pairing_node.terminate();
+    auto messages = sink.get_messages();
+    auto num_pairs =
+            std::count_if(messages.begin(), messages.end(), [](const dorado::Message& message) {
+                return std::holds_alternative<std::shared_ptr<dorado::ReadPair>>(message);
+            });
+    CHECK(num_pairs == (prefilter_enabled ? 0 : 1));
+    CHECK(pairing_node.sample_stats().at("minimizer_rejected_pairs") ==
+          (prefilter_enabled ? 1 : 0));
+}
+
+TEST_CASE("Pair list pairing", TEST_GROUP) {
+    const std::string template_id = "002bd127-db82-436f-b828-28567c3d505d";
+    const std::string complement_id = "0007f755-bc82-432c-82be-76220b107ec5";
+    auto pairs = make_pair_table(template_id + " " + complement_id +
+                                 "\nnot_a_uuid also_not_a_uuid\n");
+
+    std::vector<std::shared_ptr<dorado::Read>> reads = {make_read(0, 1000), make_read(10, 1000),
+                                                        make_read(20, 1000)};
+    // The complement arrives first, and the last read isn't in the list.
+    reads[0]->read_id = complement_id;
+    reads[1]->read_id = "unlisted";
+    reads[2]->read_id = template_id;
+
+    MessageSinkToVector<dorado::Message> sink(5);
+    dorado::PairingNode pairing_node(sink, pairs, 1, 1);
+    for (auto& read : reads) {
+        pairing_node.push_message(std::move(read));
+    }
+    pairing_node.terminate();
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 1);
+    auto read_pair = std::get<std::shared_ptr<dorado::ReadPair>>(messages[0]);
+    CHECK(read_pair->read_1->read_id == template_id);
+    CHECK(read_pair->read_2->read_id == complement_id);
+}
+
+TEST_CASE("Reads outside the pairing window are evicted", TEST_GROUP) {
+    SECTION("Generating pairs") {
+        MessageSinkToVector<dorado::Message> sink(5);
+        dorado::PairingNode pairing_node(sink, nullptr, 1, 1);
+        // The first read is passed on once the pore has moved on by more than the window.
+        pairing_node.push_message(make_read(0, 1000));
+        pairing_node.push_message(make_read(400 * 1000, 1000));
+        pairing_node.terminate();
+        CHECK(sink.get_messages().size() == 2);
+
+        auto stats = pairing_node.sample_stats();
+        CHECK(stats.at("evicted_reads") == 1);
+        CHECK(stats.at("cached_reads") == 0);
+    }
+
+    SECTION("Pair list") {
+        auto pairs = make_pair_table(
+                "002bd127-db82-436f-b828-28567c3d505d 0007f755-bc82-432c-82be-76220b107ec5\n"
+                "00646cea-16c8-4170-a4a2-6ac6c6b00034 012d4ba8-4fa5-4cb6-9b38-2a1bc3106791\n");
+        std::vector<std::shared_ptr<dorado::Read>> reads = {make_read(0, 1000),
+                                                            make_read(400 * 1000, 1000)};
+        // Neither partner ever arrives.
+        reads[0]->read_id = "002bd127-db82-436f-b828-28567c3d505d";
+        reads[1]->read_id = "00646cea-16c8-4170-a4a2-6ac6c6b00034";
+
+        MessageSinkToVector<dorado::Message> sink(5);
+        dorado::PairingNode pairing_node(sink, pairs, 1, 1);
+        for (auto& read : reads) {
+            pairing_node.push_message(std::move(read));
+        }
+        pairing_node.terminate();
+        CHECK(sink.get_messages().empty());
+
+        // The templates were picked to share a cache shard, since reads are only evicted by
+        // later reads from the same shard.
+        auto stats = pairing_node.sample_stats();
+        CHECK(stats.at("evicted_reads") == 1);
+        CHECK(stats.at("cached_reads") == 1);
+    }
+}
@@ -0,0 +1,160 @@
+#include "utils/PatternMatcher.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[utils][PatternMatcher]"
+
+using dorado::utils::PatternMatcher;
+
+namespace {
+
+std::string random_sequence(size_t len) {
+    const std::string bases("ACGT");
+    std::string seq(len, ' ');
+    for (auto& base : seq) {
+        base = bases.at(std::rand() % 4);
+    }
+    return seq;
+}
+
+// Copies seq with a few random substitutions, insertions and deletions.
+std::string mutate(const std::string& seq, int num_edits) {
+    std::string mutated = seq;
+    for (int i = 0; i < num_edits && !mutated.empty(); ++i) {
+        const size_t pos = std::rand() % mutated.size();
+        switch (std::rand() % 3) {
+        case 0:
+            mutated[pos] = "ACGT"[std::rand() % 4];
+            break;
+        case 1:
+            mutated.insert(pos, 1, "ACGT"[std::rand() % 4]);
+            break;
+        default:
+            mutated.erase(pos, 1);
+            break;
+        }
+    }
+    return mutated;
+}
+
+// Edit distance between pattern and text[start, end) for every start and end, by dynamic
+// programming, with distances[end][start] holding the distance.
+std::vector<std::vector<int>> all_substring_distances(const std::string& pattern,
+                                                      const std::string& text) {
+    const size_t n = text.size();
+    std::vector<std::vector<int>> distances(n + 1, std::vector<int>(n + 1, 0));
+    for (size_t start = 0; start <= n; ++start) {
+        std::vector<int> column(pattern.size() + 1);
+        std::iota(column.begin(), column.end(), 0);
+        distances[start][start] = column.back();
+        for (size_t end = start + 1; end <= n; ++end) {
+            int diagonal = column[0];
+            column[0] = static_cast<int>(end - start);
+            for (size_t i = 1; i <= pattern.size(); ++i) {
+                const int substitution = diagonal + (pattern[i - 1] == text[end - 1] ? 0 : 1);
+                diagonal = column[i];
+                column[i] = std::min({substitution, column[i] + 1, column[i - 1] + 1});
+            }
+            distances[end][start] = column.back();
+        }
+    }
+    return distances;
+}
+
+struct ExpectedMatch {
+    int distance;
+    size_t start;
+    size_t end;
+};
+
+// The best match as edlib reports it: the first end with the lowest distance, and of the
+// matches ending there, the longest.
+ExpectedMatch expected_best_match(const std::string& pattern, const std::string& text) {
+    const auto distances = all_substring_distances(pattern, text);
+    ExpectedMatch best{std::numeric_limits<int>::max(), 0, 0};
+    for (size_t end = 1; end <= text.size(); ++end) {
+        for (size_t start = 0; start < end; ++start) {
+            if (distances[end][start] < best.distance) {
+                best = {distances[end][start], start, end};
+            } else if (distances[end][start] == best.distance && end == best.end) {
+                best.start = std::min(best.start, start);
+            }
+        }
+    }
+    return best;
+}
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Exact and missing matches", TEST_GROUP) {
+    PatternMatcher matcher("TACTTCGTTCAGTTACGTATTGCT");
+    const std::string text = "GGGGGTACTTCGTTCAGTTACGTATTGCTAAAAA";
+
+    CHECK(matcher.edit_distance(text, 0) == 0);
+    const auto match = matcher.find_best_match(text, 0);
+    REQUIRE(match.has_value());
+    CHECK(match->first == 5);
+    CHECK(match->second == 29);
+
+    CHECK(!matcher.edit_distance("GGGGGGGGGGGGGGGGGGGGGGGGGGGGG", 4).has_value());
+    CHECK(!matcher.edit_distance("", 100).has_value());
+    CHECK(!matcher.find_best_match("", 100).has_value());
+    // Characters which aren't in the pattern never match.
+    CHECK(matcher.edit_distance("NNNNN", 100) == 24);
+
+    CHECK_THROWS_AS(PatternMatcher(""), std::runtime_error);
+}
+
+TEST_CASE(TEST_GROUP ": Matches agree with dynamic programming", TEST_GROUP) {
+    std::srand(42);
+    // Patterns both within one word and spread over several.
+    const size_t pattern_len = GENERATE(1, 7, 24, 63, 64, 65, 150);
+    for (int trial = 0; trial < 20; ++trial) {
+        const std::string pattern = random_sequence(pattern_len);
+        const std::string text = random_sequence(std::rand() % 100) +
+                                 mutate(pattern, std::rand() % 6) +
+                                 random_sequence(std::rand() % 100);
+        CAPTURE(pattern, text);
+
+        const auto expected = expected_best_match(pattern, text);
+        PatternMatcher matcher(pattern);
+        CHECK(matcher.edit_distance(text, expected.distance) == expected.distance);
+        CHECK(!matcher.edit_distance(text, expected.distance - 1).has_value());
+
+        const auto match = matcher.find_best_match(text, expected.distance);
+        REQUIRE(match.has_value());
+        CHECK(match->first == expected.start);
+        CHECK(match->second == expected.end);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Batched windows agree with single searches", TEST_GROUP) {
+    std::srand(42);
+    const size_t pattern_len = GENERATE(24, 100);
+    const std::string pattern = random_sequence(pattern_len);
+    PatternMatcher matcher(pattern);
+
+    // Windows of varied lengths, including empty ones, so that lanes finish at different times.
+    const std::string text = random_sequence(5000) + mutate(pattern, 3) + random_sequence(5000);
+    std::vector<std::string_view> windows;
+    for (int i = 0; i < 23; ++i) {
+        const size_t start = std::rand() % text.size();
+        windows.push_back(std::string_view(text).substr(start, std::rand() % 300));
+    }
+    windows.push_back(text);
+
+    const auto distances = matcher.edit_distances(windows, 10);
+    REQUIRE(distances.size() == windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        CHECK(distances[i] == matcher.edit_distance(windows[i], 10));
+    }
+    CHECK(distances.back().has_value());
+}
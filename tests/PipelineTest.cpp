@@ -0,0 +1,157 @@
+#include "read_pipeline/Pipeline.h"
+
+#include "MessageSinkUtils.h"
+#include "read_pipeline/MessageRouterNode.h"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][Pipeline]"
+
+namespace {
+
+// Forwards every message to its sink from a worker thread, terminating the sink once
+// its own queue has been drained, in the same way as the real nodes.
+class PassthroughNode : public dorado::MessageSink {
+public:
+    PassthroughNode(dorado::MessageSink& sink, std::string name)
+            : MessageSink(100),
+              m_sink(sink),
+              m_name(std::move(name)),
+              m_worker(&PassthroughNode::worker_thread, this) {}
+    ~PassthroughNode() {
+        terminate();
+        join();
+        m_sink.terminate();
+    }
+    void join() override {
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+    std::string get_name() const override { return m_name; }
+
+private:
+    void worker_thread() {
+        dorado::Message message;
+        while (m_work_queue.try_pop(message)) {
+            m_sink.push_message(std::move(message));
+        }
+        m_sink.terminate();
+    }
+
+    dorado::MessageSink& m_sink;
+    std::string m_name;
+    std::thread m_worker;
+};
+
+std::shared_ptr<dorado::Read> make_read(const std::string& read_id, const std::string& seq) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = read_id;
+    read->seq = seq;
+    return read;
+}
+
+}  // namespace
+
+using ReadSink = MessageSinkToVector<std::shared_ptr<dorado::Read>>;
+
+TEST_CASE(TEST_GROUP ": Linear pipeline delivers every message", TEST_GROUP) {
+    dorado::PipelineDescriptor desc;
+    auto sink = desc.add_node<ReadSink>({}, size_t(100));
+    auto second = desc.add_node<PassthroughNode>({sink}, std::string("second"));
+    auto first = desc.add_node<PassthroughNode>({second}, std::string("first"));
+    auto pipeline = dorado::Pipeline::create(std::move(desc));
+
+    auto& input = pipeline->get_node(first);
+    for (int i = 0; i < 10; ++i) {
+        input.push_message(make_read(std::to_string(i), "ACGT"));
+    }
+    pipeline->terminate();
+
+    auto reads = pipeline->get_node<ReadSink>(sink).get_messages();
+    REQUIRE(reads.size() == 10);
+    for (int i = 0; i < 10; ++i) {
+        CHECK(reads[i]->read_id == std::to_string(i));
+    }
+    // Only named nodes are reported.
+    CHECK(pipeline->get_stats_reporters().size() == 2);
+}
+
+TEST_CASE(TEST_GROUP ": Fan-in node waits for all producers", TEST_GROUP) {
+    dorado::PipelineDescriptor desc;
+    auto sink = desc.add_node<ReadSink>({}, size_t(100));
+    auto producer_a = desc.add_node<PassthroughNode>({sink}, std::string("a"));
+    auto producer_b = desc.add_node<PassthroughNode>({sink}, std::string("b"));
+    auto pipeline = dorado::Pipeline::create(std::move(desc));
+
+    // Terminating one producer must not cut off the other.
+    pipeline->get_node(producer_a).push_message(make_read("a", "ACGT"));
+    pipeline->get_node(producer_a).terminate();
+    pipeline->get_node(producer_a).join();
+    pipeline->get_node(producer_b).push_message(make_read("b", "ACGT"));
+    pipeline->terminate();
+
+    auto reads = pipeline->get_node<ReadSink>(sink).get_messages();
+    REQUIRE(reads.size() == 2);
+    CHECK(reads[0]->read_id == "a");
+    CHECK(reads[1]->read_id == "b");
+}
+
+TEST_CASE(TEST_GROUP ": Router sends already called reads around", TEST_GROUP) {
+    dorado::PipelineDescriptor desc;
+    auto called_sink = desc.add_node<ReadSink>({}, size_t(100));
+    auto uncalled_sink = desc.add_node<ReadSink>({}, size_t(100));
+    auto router = desc.add_router({uncalled_sink, called_sink},
+                                  dorado::MessageRouterNode::route_uncalled_reads);
+    auto pipeline = dorado::Pipeline::create(std::move(desc));
+
+    auto& input = pipeline->get_node(router);
+    input.push_message(make_read("uncalled", ""));
+    input.push_message(make_read("called", "ACGT"));
+    pipeline->terminate();
+
+    auto uncalled = pipeline->get_node<ReadSink>(uncalled_sink).get_messages();
+    auto called = pipeline->get_node<ReadSink>(called_sink).get_messages();
+    REQUIRE(uncalled.size() == 1);
+    CHECK(uncalled[0]->read_id == "uncalled");
+    REQUIRE(called.size() == 1);
+    CHECK(called[0]->read_id == "called");
+}
+
+TEST_CASE(TEST_GROUP ": Router sends reads to the model of their sample rate", TEST_GROUP) {
+    dorado::PipelineDescriptor desc;
+    auto sink_4khz = desc.add_node<ReadSink>({}, size_t(100));
+    auto sink_5khz = desc.add_node<ReadSink>({}, size_t(100));
+    auto router = desc.add_router({sink_4khz, sink_5khz},
+                                  dorado::MessageRouterNode::route_by_sample_rate({4000, 5000}));
+    auto pipeline = dorado::Pipeline::create(std::move(desc));
+
+    auto& input = pipeline->get_node(router);
+    const std::vector<std::pair<std::string, uint64_t>> sample_rates{
+            {"a", 4000}, {"b", 5000}, {"c", 4096}};
+    for (const auto& [read_id, sample_rate] : sample_rates) {
+        auto read = make_read(read_id, "");
+        read->sample_rate = sample_rate;
+        input.push_message(std::move(read));
+    }
+    pipeline->terminate();
+
+    auto reads_4khz = pipeline->get_node<ReadSink>(sink_4khz).get_messages();
+    auto reads_5khz = pipeline->get_node<ReadSink>(sink_5khz).get_messages();
+    REQUIRE(reads_4khz.size() == 2);
+    CHECK(reads_4khz[0]->read_id == "a");
+    CHECK(reads_4khz[1]->read_id == "c");
+    REQUIRE(reads_5khz.size() == 1);
+    CHECK(reads_5khz[0]->read_id == "b");
+}
+
+TEST_CASE(TEST_GROUP ": Sinks must be added before their producers", TEST_GROUP) {
+    dorado::PipelineDescriptor desc;
+    CHECK_THROWS_AS(desc.add_node<PassthroughNode>({0}, std::string("orphan")),
+                    std::runtime_error);
+}
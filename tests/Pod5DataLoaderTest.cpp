@@ -2,9 +2,16 @@
 #include "TestUtils.h"
 #include "data_loader/DataLoader.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/cache_utils.h"
 
 #include <catch2/catch.hpp>
 
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+
 #define TEST_GROUP "Pod5DataLoaderTest: "
 
 namespace {
@@ -119,6 +126,29 @@ TEST_CASE(TEST_GROUP "Find sample rate from nested pod5.") {
     CHECK(dorado::DataLoader::get_sample_rate(data_path, true) == 4000);
 }
 
+#ifndef _WIN32
+TEST_CASE(TEST_GROUP "Scan metadata of pod5 files, reusing the cached scan.") {
+    std::string data_path(get_pod5_data_dir());
+    TempDir temp_dir;
+    const auto cache_dir = temp_dir.m_path / "cache";
+    setenv("dorado_cache_dir", cache_dir.c_str(), 1);
+
+    for (int scan = 0; scan < 2; ++scan) {
+        const auto metadata = dorado::DataLoader::scan_metadata(data_path);
+        CHECK(metadata.num_reads == 1);
+        CHECK(metadata.sample_rate == 4000);
+        REQUIRE(metadata.runs.size() == 1);
+        const auto read_groups = metadata.read_groups("model");
+        REQUIRE(read_groups.size() == 1);
+        CHECK(read_groups.begin()->first == metadata.runs[0].run_id + "_model");
+        CHECK(read_groups.begin()->second.basecalling_model == "model");
+        CHECK(std::filesystem::exists(cache_dir / dorado::utils::kFileMetadataCacheDir));
+    }
+
+    unsetenv("dorado_cache_dir");
+}
+#endif
+
 TEST_CASE(TEST_GROUP "Load data sorted by channel id.") {
     std::string data_path(get_data_dir("multi_read_pod5"));
 
@@ -138,8 +168,10 @@ TEST_CASE(TEST_GROUP "Test loading POD5 file with read ignore list") {
     std::string data_path(get_data_dir("multi_read_pod5"));
 
     SECTION("read ignore list with 1 read") {
-        auto read_ignore_list = std::unordered_set<std::string>();
-        read_ignore_list.insert("0007f755-bc82-432c-82be-76220b107ec5");  // read present in POD5
+        dorado::ReadIDSet read_ignore_list;
+        // Read present in POD5.
+        read_ignore_list.insert(
+                *dorado::utils::parse_read_id("0007f755-bc82-432c-82be-76220b107ec5"));
 
         CHECK(dorado::DataLoader::get_num_reads(data_path, std::nullopt, read_ignore_list) == 3);
 
@@ -153,8 +185,10 @@ TEST_CASE(TEST_GROUP "Test loading POD5 file with read ignore list") {
     SECTION("same read in read_ids and ignore list") {
         auto read_list = std::unordered_set<std::string>();
         read_list.insert("0007f755-bc82-432c-82be-76220b107ec5");  // read present in POD5
-        auto read_ignore_list = std::unordered_set<std::string>();
-        read_ignore_list.insert("0007f755-bc82-432c-82be-76220b107ec5");  // read present in POD5
+        dorado::ReadIDSet read_ignore_list;
+        // Read present in POD5.
+        read_ignore_list.insert(
+                *dorado::utils::parse_read_id("0007f755-bc82-432c-82be-76220b107ec5"));
 
         CHECK(dorado::DataLoader::get_num_reads(data_path, read_list, read_ignore_list) == 0);
 
@@ -165,3 +199,93 @@ TEST_CASE(TEST_GROUP "Test loading POD5 file with read ignore list") {
         REQUIRE(mock_sink.get_read_count() == 0);
     }
 }
+
+TEST_CASE(TEST_GROUP "Watch for POD5 files as they are written") {
+    TempDir temp_dir;
+    const auto& watch_dir = temp_dir.m_path;
+
+    // A file which turns up after watching starts is loaded too.
+    std::thread writer([&watch_dir] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (const auto& entry :
+             std::filesystem::directory_iterator(get_data_dir("multi_read_pod5"))) {
+            std::filesystem::copy(entry.path(), watch_dir / entry.path().filename());
+        }
+    });
+
+    MockSink mock_sink;
+    dorado::DataLoader loader(mock_sink, "cpu", 1, 0);
+    loader.watch_reads(watch_dir.string(), false, std::chrono::milliseconds(10),
+                       std::chrono::milliseconds(500));
+    writer.join();
+
+    CHECK(loader.get_num_reads_loaded() == 4);
+    REQUIRE(mock_sink.get_read_count() == 4);
+}
+
+TEST_CASE(TEST_GROUP "Load only listed reads from multi-read POD5") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+
+    auto read_list = std::unordered_set<std::string>();
+    read_list.insert("0007f755-bc82-432c-82be-76220b107ec5");  // read present in POD5
+    read_list.insert("read_1");                                // not a POD5 read ID
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::DataLoader loader(sink, "cpu", 1, 0, read_list);
+    loader.load_reads(data_path, false);
+
+    auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 1);
+    CHECK(reads[0]->read_id == "0007f755-bc82-432c-82be-76220b107ec5");
+}
+
+TEST_CASE(TEST_GROUP "Channel shards split the reads between them") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+    const auto traversal_order =
+            GENERATE(dorado::DataLoader::UNRESTRICTED, dorado::DataLoader::BY_CHANNEL);
+
+    size_t total_reads = 0;
+    for (size_t index = 0; index < 2; ++index) {
+        MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+        dorado::DataLoader loader(sink, "cpu", 1, 0);
+        loader.set_channel_shard({index, 2});
+        loader.load_reads(data_path, false, traversal_order);
+
+        const auto reads = sink.get_messages();
+        for (const auto &read : reads) {
+            CHECK(size_t(read->attributes.channel_number) % 2 == index);
+        }
+        total_reads += reads.size();
+    }
+    CHECK(total_reads == 4);
+}
+
+TEST_CASE(TEST_GROUP "Parse channel shards") {
+    const auto shard = dorado::ChannelShard::parse("1/4");
+    CHECK(shard.index == 1);
+    CHECK(shard.count == 4);
+    CHECK(shard.contains(5));
+    CHECK_FALSE(shard.contains(6));
+
+    CHECK_THROWS(dorado::ChannelShard::parse("4/4"));
+    CHECK_THROWS(dorado::ChannelShard::parse("0/0"));
+    CHECK_THROWS(dorado::ChannelShard::parse("1"));
+    CHECK_THROWS(dorado::ChannelShard::parse("-1/4"));
+    CHECK_THROWS(dorado::ChannelShard::parse("1/4x"));
+}
+
+TEST_CASE(TEST_GROUP "Load exactly max reads, however the reads are traversed") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+    const auto traversal_order =
+            GENERATE(dorado::DataLoader::UNRESTRICTED, dorado::DataLoader::BY_CHANNEL);
+    // The directory holds 4 reads.
+    const size_t max_reads = GENERATE(1, 2, 3, 4);
+    CAPTURE(traversal_order, max_reads);
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::DataLoader loader(sink, "cpu", 1, max_reads);
+    loader.load_reads(data_path, false, traversal_order);
+
+    CHECK(sink.get_messages().size() == max_reads);
+    CHECK(loader.get_num_reads_loaded() == max_reads);
+}
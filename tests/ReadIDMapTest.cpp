@@ -0,0 +1,95 @@
+#include "utils/ReadIDMap.h"
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#define CUT_TAG "[ReadIDMap]"
+
+namespace {
+
+dorado::ReadID make_read_id(uint32_t n) {
+    dorado::ReadID read_id{};
+    for (size_t i = 0; i < sizeof(n); ++i) {
+        read_id[i] = static_cast<uint8_t>(n >> (8 * i));
+    }
+    return read_id;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": Map insert, find and erase", CUT_TAG) {
+    dorado::ReadIDMap<std::string> map;
+    CHECK(map.empty());
+    CHECK(map.find(make_read_id(1)) == map.end());
+    CHECK(map.erase(make_read_id(1)) == 0);
+
+    auto [it, inserted] = map.insert({make_read_id(1), "a"});
+    CHECK(inserted);
+    CHECK(it->second == "a");
+    // Existing entries aren't replaced.
+    std::tie(it, inserted) = map.insert({make_read_id(1), "b"});
+    CHECK_FALSE(inserted);
+    CHECK(it->second == "a");
+    map[make_read_id(2)] = "c";
+    CHECK(map.size() == 2);
+    CHECK(map.count(make_read_id(2)) == 1);
+    CHECK(map.find(make_read_id(2))->second == "c");
+
+    map.erase(map.find(make_read_id(1)));
+    CHECK(map.size() == 1);
+    CHECK(map.count(make_read_id(1)) == 0);
+    CHECK(map.count(make_read_id(2)) == 1);
+}
+
+TEST_CASE(CUT_TAG ": Map matches std::map", CUT_TAG) {
+    // Many inserts and erases of a small key space, so that the table grows and entries are
+    // shifted back over erased ones.
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> key_dist(0, 2000);
+    std::uniform_int_distribution<int> op_dist(0, 2);
+    dorado::ReadIDMap<std::shared_ptr<int>> map;
+    std::map<dorado::ReadID, int> expected;
+    for (int i = 0; i < 50000; ++i) {
+        const auto key = make_read_id(key_dist(gen));
+        if (op_dist(gen) == 0) {
+            CHECK(map.erase(key) == expected.erase(key));
+        } else {
+            const bool inserted = map.insert({key, std::make_shared<int>(i)}).second;
+            CHECK(inserted == expected.emplace(key, i).second);
+        }
+    }
+
+    REQUIRE(map.size() == expected.size());
+    size_t num_iterated = 0;
+    for (const auto& [key, value] : map) {
+        auto it = expected.find(key);
+        REQUIRE(it != expected.end());
+        CHECK(*value == it->second);
+        ++num_iterated;
+    }
+    CHECK(num_iterated == expected.size());
+    for (uint32_t n = 0; n <= 2000; ++n) {
+        CHECK(map.count(make_read_id(n)) == expected.count(make_read_id(n)));
+    }
+}
+
+TEST_CASE(CUT_TAG ": Set", CUT_TAG) {
+    dorado::ReadIDSet set{make_read_id(1), make_read_id(2), make_read_id(1)};
+    CHECK(set.size() == 2);
+    CHECK(set.find(make_read_id(1)) != set.end());
+    CHECK(set.find(make_read_id(3)) == set.end());
+    CHECK(set.insert(make_read_id(3)).second);
+    CHECK_FALSE(set.insert(make_read_id(3)).second);
+
+    dorado::ReadIDSet copy;
+    copy.reserve(set.size());
+    copy.insert(set.begin(), set.end());
+    CHECK(copy.size() == 3);
+    CHECK(copy.erase(make_read_id(2)) == 1);
+    CHECK(copy.count(make_read_id(2)) == 0);
+    CHECK(set.count(make_read_id(2)) == 1);
+}
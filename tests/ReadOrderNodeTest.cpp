@@ -0,0 +1,101 @@
+#include "MessageSinkUtils.h"
+#include "htslib/sam.h"
+#include "read_pipeline/ReadOrderNode.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][ReadOrderNode]"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// A record told apart from the others by its position.
+dorado::BamPtr make_record(int64_t pos) {
+    dorado::BamPtr record(bam_init1());
+    record->core.pos = pos;
+    return record;
+}
+
+std::vector<dorado::BamPtr> make_records(std::initializer_list<int64_t> positions) {
+    std::vector<dorado::BamPtr> records;
+    for (auto pos : positions) {
+        records.push_back(make_record(pos));
+    }
+    return records;
+}
+
+}  // namespace
+
+TEST_CASE("ReadOrderNode: records are written in the order their reads were loaded",
+          TEST_GROUP) {
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    {
+        dorado::ReadOrderNode order_node(sink, 100);
+        std::vector<std::shared_ptr<dorado::ReadOrderTicket>> tickets;
+        for (int i = 0; i < 5; ++i) {
+            tickets.push_back(order_node.issue_ticket());
+        }
+
+        // Reads finish out of order, one of them with two records and one of them dropped.
+        auto records_4 = make_records({6});
+        tickets[4]->finish(records_4);
+        auto records_2 = make_records({2, 3});
+        tickets[2]->finish(records_2);
+        auto records_0 = make_records({0});
+        tickets[0]->finish(records_0);
+        tickets[1].reset();
+        auto records_3 = make_records({4});
+        tickets[3]->finish(records_3);
+
+        for (auto* records : {&records_3, &records_4, &records_2, &records_0}) {
+            for (auto& record : *records) {
+                order_node.push_message(std::move(record));
+            }
+        }
+        // A record not from a read with a ticket goes straight through.
+        order_node.push_message(make_record(100));
+    }
+
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 6);
+    std::vector<int64_t> ordered_positions;
+    size_t num_unordered = 0;
+    for (const auto& record : messages) {
+        if (record->core.pos == 100) {
+            ++num_unordered;
+        } else {
+            ordered_positions.push_back(record->core.pos);
+        }
+    }
+    CHECK(num_unordered == 1);
+    CHECK(ordered_positions == std::vector<int64_t>{0, 2, 3, 4, 6});
+}
+
+TEST_CASE("ReadOrderNode: tickets wait for room in the window", TEST_GROUP) {
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    dorado::ReadOrderNode order_node(sink, 2);
+    auto first = order_node.issue_ticket();
+    auto second = order_node.issue_ticket();
+
+    std::atomic<bool> issued{false};
+    std::thread issuer([&] {
+        auto third = order_node.issue_ticket();
+        issued = true;
+    });
+    std::this_thread::sleep_for(50ms);
+    CHECK_FALSE(issued);
+
+    // Finishing a later read doesn't make room, but finishing the oldest does.
+    second.reset();
+    std::this_thread::sleep_for(50ms);
+    CHECK_FALSE(issued);
+    first.reset();
+    issuer.join();
+    CHECK(issued);
+}
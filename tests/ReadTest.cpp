@@ -60,6 +60,88 @@ TEST_CASE(TEST_GROUP ": Test tag generation", TEST_GROUP) {
     CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "RG")), Equals("xyz_test_model"));
 }
 
+TEST_CASE(TEST_GROUP ": Tags survive releasing the signal", TEST_GROUP) {
+    dorado::Read test_read;
+    test_read.read_id = "read1";
+    test_read.raw_data = torch::empty(4000);
+    test_read.seq = "ACGT";
+    test_read.qstring = "////";
+    test_read.sample_rate = 4000.0;
+    test_read.num_trimmed_samples = 132;
+    test_read.is_duplex = false;
+
+    test_read.release_raw_data();
+    CHECK(!test_read.raw_data.defined());
+    CHECK(test_read.get_num_raw_samples() == 4000);
+
+    auto alignments = test_read.extract_sam_lines(false);
+    REQUIRE(alignments.size() == 1);
+    bam1_t* aln = alignments[0].get();
+
+    CHECK(bam_aux2i(bam_aux_get(aln, "ns")) == 4132);
+    CHECK(bam_aux2f(bam_aux_get(aln, "du")) == Approx(1.033).margin(1e-6));
+}
+
+TEST_CASE(TEST_GROUP ": Move table tag generation", TEST_GROUP) {
+    dorado::Read test_read;
+    test_read.read_id = "read1";
+    test_read.raw_data = torch::empty(40);
+    test_read.seq = "ACGT";
+    test_read.qstring = "////";
+    test_read.sample_rate = 4000.0;
+    test_read.num_trimmed_samples = 0;
+    test_read.model_stride = 5;
+    test_read.moves = {1, 0, 1, 1, 0, 0, 1, 0};
+    test_read.run_id = "xyz";
+    test_read.model_name = "test_model";
+    test_read.is_duplex = false;
+
+    auto alignments = test_read.extract_sam_lines(true);
+    REQUIRE(alignments.size() == 1);
+    bam1_t* aln = alignments[0].get();
+
+    auto mv = bam_aux_get(aln, "mv");
+    REQUIRE(mv != nullptr);
+    REQUIRE(bam_auxB_len(mv) == test_read.moves.size() + 1);
+    CHECK(bam_auxB2i(mv, 0) == 5);
+    for (size_t i = 0; i < test_read.moves.size(); ++i) {
+        CAPTURE(i);
+        CHECK(bam_auxB2i(mv, i + 1) == test_read.moves[i]);
+    }
+    // Tags appended after the move table are still found.
+    CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "RG")), Equals("xyz_test_model"));
+}
+
+TEST_CASE(TEST_GROUP ": Packed move table tag generation", TEST_GROUP) {
+    dorado::Read test_read;
+    test_read.read_id = "read1";
+    test_read.raw_data = torch::empty(40);
+    test_read.seq = "ACGT";
+    test_read.qstring = "////";
+    test_read.sample_rate = 4000.0;
+    test_read.num_trimmed_samples = 0;
+    test_read.model_stride = 5;
+    test_read.moves = {1, 0, 1, 1, 0, 0, 1, 0, 0, 1};
+    test_read.run_id = "xyz";
+    test_read.model_name = "test_model";
+    test_read.is_duplex = false;
+
+    auto alignments = test_read.extract_sam_lines(true, 0, true);
+    REQUIRE(alignments.size() == 1);
+    bam1_t* aln = alignments[0].get();
+
+    CHECK(bam_aux_get(aln, "mv") == nullptr);
+    auto mp = bam_aux_get(aln, "mp");
+    REQUIRE(mp != nullptr);
+    // The stride, the 6 unused bits of the second byte, then the moves a bit each.
+    REQUIRE(bam_auxB_len(mp) == 4);
+    CHECK(bam_auxB2i(mp, 0) == 5);
+    CHECK(bam_auxB2i(mp, 1) == 6);
+    CHECK(bam_auxB2i(mp, 2) == 0x4d);
+    CHECK(bam_auxB2i(mp, 3) == 0x02);
+    CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "RG")), Equals("xyz_test_model"));
+}
+
 TEST_CASE(TEST_GROUP ": Test sam record generation", TEST_GROUP) {
     dorado::Read test_read{};
     SECTION("Generating sam record for empty read throws") {
@@ -150,6 +232,10 @@ TEST_CASE(TEST_GROUP ": Methylation tag generation", TEST_GROUP) {
     read.seq = "ACAGTGACTAAACTC";
     read.qstring = "***************";
     read.base_mod_probs = modbase_probs;
+    // Every base has a row of probabilities.
+    for (uint32_t i = 0; i < read.seq.size(); ++i) {
+        read.base_mod_positions.push_back(i);
+    }
     read.is_duplex = false;
 
     std::string methylation_tag;
@@ -219,6 +305,44 @@ TEST_CASE(TEST_GROUP ": Methylation tag generation", TEST_GROUP) {
                                       expected_methylation_tag_with_context_prob);
     }
 
+    SECTION("Only the called bases need rows") {
+        const std::vector<uint32_t> called = {0, 6, 7, 12};
+        dorado::Read sparse_read;
+        sparse_read.read_id = read.read_id;
+        sparse_read.seq = read.seq;
+        sparse_read.qstring = read.qstring;
+        sparse_read.is_duplex = false;
+        sparse_read.base_mod_positions = called;
+        const size_t num_channels = modbase_alphabet.size();
+        for (const auto pos : called) {
+            sparse_read.base_mod_probs.insert(sparse_read.base_mod_probs.end(),
+                                              modbase_probs.begin() + pos * num_channels,
+                                              modbase_probs.begin() + (pos + 1) * num_channels);
+        }
+
+        for (const std::string context : {"", "XC:_:_:_", "_:XG:_:_"}) {
+            const auto info = std::make_shared<dorado::utils::BaseModInfo>(
+                    modbase_alphabet, modbase_long_names, context);
+            read.base_mod_info = info;
+            sparse_read.base_mod_info = info;
+            for (uint8_t threshold : {0, 10, 50, 255}) {
+                CAPTURE(context, int(threshold));
+                auto dense_lines = read.extract_sam_lines(false, threshold);
+                auto sparse_lines = sparse_read.extract_sam_lines(false, threshold);
+                bam1_t* dense_aln = dense_lines[0].get();
+                bam1_t* sparse_aln = sparse_lines[0].get();
+                CHECK_THAT(bam_aux2Z(bam_aux_get(sparse_aln, "MM")),
+                           Equals(bam_aux2Z(bam_aux_get(dense_aln, "MM"))));
+                const uint8_t* dense_ml = bam_aux_get(dense_aln, "ML");
+                std::vector<int64_t> expected_ml;
+                for (uint32_t i = 0; i < bam_auxB_len(dense_ml); ++i) {
+                    expected_ml.push_back(bam_auxB2i(dense_ml, i));
+                }
+                require_sam_tag_B_int_matches(bam_aux_get(sparse_aln, "ML"), expected_ml);
+            }
+        }
+    }
+
     SECTION("Test handling of incorrect base names") {
         std::string modbase_long_names_unknown = "12mA 5mq";
 
@@ -92,3 +92,90 @@ TEST_CASE("Encode sequence for modified basecalling", TEST_GROUP) {
     // clang-format on    
     CHECK(expected_slice2 == slice2.data);
 }
+
+TEST_CASE("Encode sequence for modified basecalling into a buffer", TEST_GROUP) {
+    const size_t BLOCK_STRIDE = 5;
+    const size_t CONTEXT_SAMPLES = 100;
+    // A kmer length of 9 takes the specialised path.
+    const int BASES_BEFORE = GENERATE(1, 4);
+    const int BASES_AFTER = BASES_BEFORE;
+
+    std::string sequence;
+    std::vector<uint8_t> moves;
+    for (int i = 0; i < 60; ++i) {
+        sequence += "ACGT"[(i * 7 + i / 3) % 4];
+        moves.push_back(1);
+        moves.insert(moves.end(), i % 4, 0);
+    }
+    auto seq_ints = dorado::utils::sequence_to_ints(sequence);
+    auto seq_to_sig_map =
+            dorado::utils::moves_to_map(moves, BLOCK_STRIDE, moves.size() * BLOCK_STRIDE);
+
+    dorado::RemoraEncoder encoder(BLOCK_STRIDE, CONTEXT_SAMPLES, BASES_BEFORE, BASES_AFTER);
+    encoder.init(seq_ints, seq_to_sig_map);
+    REQUIRE(encoder.encoded_context_size() ==
+            size_t(BASES_BEFORE + BASES_AFTER + 1) * 4 * CONTEXT_SAMPLES);
+
+    // Every entry of the buffer is written, whatever it held before.
+    std::vector<int8_t> buffer(encoder.encoded_context_size());
+    for (size_t seq_pos = 0; seq_pos < sequence.size(); ++seq_pos) {
+        std::fill(buffer.begin(), buffer.end(), int8_t(-1));
+        auto expected = encoder.get_context(seq_pos);
+        auto context = encoder.get_context(seq_pos, buffer.data());
+        CHECK(context.data.empty());
+        CHECK(context.first_sample == expected.first_sample);
+        CHECK(context.num_samples == expected.num_samples);
+        CHECK(context.lead_samples_needed == expected.lead_samples_needed);
+        CHECK(context.tail_samples_needed == expected.tail_samples_needed);
+        CHECK(buffer == expected.data);
+    }
+}
+
+TEST_CASE("Expand compact contexts into the kmer encoding", TEST_GROUP) {
+    const size_t BLOCK_STRIDE = 5;
+    const size_t CONTEXT_SAMPLES = 100;
+    const int BASES_BEFORE = GENERATE(1, 4);
+    const int BASES_AFTER = BASES_BEFORE;
+    const int KMER_LEN = BASES_BEFORE + BASES_AFTER + 1;
+
+    std::string sequence;
+    std::vector<uint8_t> moves;
+    for (int i = 0; i < 60; ++i) {
+        sequence += "ACGT"[(i * 7 + i / 3) % 4];
+        moves.push_back(1);
+        moves.insert(moves.end(), i % 4, 0);
+    }
+    auto seq_ints = dorado::utils::sequence_to_ints(sequence);
+    auto seq_to_sig_map =
+            dorado::utils::moves_to_map(moves, BLOCK_STRIDE, moves.size() * BLOCK_STRIDE);
+
+    dorado::RemoraEncoder encoder(BLOCK_STRIDE, CONTEXT_SAMPLES, BASES_BEFORE, BASES_AFTER);
+    encoder.init(seq_ints, seq_to_sig_map);
+
+    // Every position's context, from the start of the read to the end, in one batch.
+    const auto num_contexts = int64_t(sequence.size());
+    const auto max_bases =
+            int64_t(dorado::RemoraEncoder::max_context_bases(BLOCK_STRIDE, CONTEXT_SAMPLES));
+    auto bases = torch::empty({num_contexts, max_bases + KMER_LEN - 1}, torch::kInt8);
+    auto base_ends = torch::empty({num_contexts, max_bases}, torch::kInt16);
+    for (int64_t seq_pos = 0; seq_pos < num_contexts; ++seq_pos) {
+        auto expected = encoder.get_context(seq_pos);
+        auto context = encoder.get_context_bases(seq_pos, bases[seq_pos].data_ptr<int8_t>(),
+                                                 base_ends[seq_pos].data_ptr<int16_t>());
+        CHECK(context.data.empty());
+        CHECK(context.first_sample == expected.first_sample);
+        CHECK(context.num_samples == expected.num_samples);
+        CHECK(context.lead_samples_needed == expected.lead_samples_needed);
+        CHECK(context.tail_samples_needed == expected.tail_samples_needed);
+    }
+
+    auto encoded = dorado::expand_kmer_encoding(bases, base_ends, CONTEXT_SAMPLES, torch::kInt8);
+    REQUIRE(encoded.sizes() == torch::IntArrayRef{num_contexts, int64_t(CONTEXT_SAMPLES),
+                                                  int64_t(KMER_LEN * 4)});
+    encoded = encoded.contiguous();
+    for (int64_t seq_pos = 0; seq_pos < num_contexts; ++seq_pos) {
+        auto expected = encoder.get_context(seq_pos);
+        const auto* const data = encoded[seq_pos].data_ptr<int8_t>();
+        CHECK(std::vector<int8_t>(data, data + expected.data.size()) == expected.data);
+    }
+}
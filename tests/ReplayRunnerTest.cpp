@@ -0,0 +1,86 @@
+#include "TestUtils.h"
+#include "nn/ReplayRunner.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[ReplayRunner]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Decodes each chunk as its offset, so that the replayed chunks can be told apart.
+class OffsetRunner final : public dorado::ModelRunnerBase {
+public:
+    void accept_chunks(int first_chunk_idx,
+                       const std::vector<dorado::utils::ChunkSource>& chunks) final {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            m_offsets[first_chunk_idx + i] = chunks[i].offset;
+        }
+    }
+    std::vector<dorado::DecodedChunk> call_chunks(int num_chunks) final {
+        std::vector<dorado::DecodedChunk> chunks;
+        for (int i = 0; i < num_chunks; ++i) {
+            const auto offset = std::to_string(m_offsets[i]);
+            chunks.push_back({offset, std::string(offset.size(), '!'), {1, 0, uint8_t(i)}});
+        }
+        return chunks;
+    }
+    size_t model_stride() const final { return 5; }
+    size_t chunk_size() const final { return 10; }
+    size_t batch_size() const final { return 4; }
+    void terminate() final {}
+    std::string get_name() const final { return "OffsetRunner"; }
+    dorado::stats::NamedStats sample_stats() const final { return {}; }
+
+private:
+    std::vector<size_t> m_offsets = std::vector<size_t>(4);
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": replayed chunks are those recorded for the same input", CUT_TAG) {
+    TempDir dir;
+    const auto signal = torch::arange(25, torch::kInt16);
+    const std::vector<dorado::utils::ChunkSource> sources = {
+            {&signal, 0}, {&signal, 10}, {&signal, 20}};
+
+    {
+        auto recording = std::make_shared<dorado::ModelOutputRecording>();
+        std::vector<dorado::Runner> runners = {std::make_shared<OffsetRunner>()};
+        dorado::record_runners(runners, recording);
+        runners[0]->accept_chunks(0, sources);
+        CHECK(runners[0]->call_chunks(3)[1].sequence == "10");
+        CHECK(recording->size() == 3);
+        recording->save(dir.m_path);
+    }
+
+    auto recording = std::make_shared<const dorado::ModelOutputRecording>(dir.m_path);
+    CHECK(recording->size() == 3);
+    CHECK(recording->model_stride() == 5);
+    auto runners = dorado::create_replay_runners(recording, 0.);
+    REQUIRE(runners.size() == 1);
+    auto& runner = runners[0];
+    CHECK(runner->chunk_size() == 10);
+    CHECK(runner->batch_size() == 4);
+
+    // Chunks are found by their input, whichever batch entries they are in.
+    runner->accept_chunks(0, {sources[2], sources[0]});
+    const auto chunks = runner->call_chunks(2);
+    REQUIRE(chunks.size() == 2);
+    CHECK(chunks[0].sequence == "20");
+    CHECK(chunks[0].qstring == "!!");
+    CHECK(chunks[0].moves == std::vector<uint8_t>{1, 0, 2});
+    CHECK(chunks[1].sequence == "0");
+
+    // A chunk decoded to a different length doesn't match.
+    runner->accept_chunks(0, {{&signal, 10, 1}});
+    CHECK_THROWS(runner->call_chunks(1));
+}
@@ -18,5 +18,7 @@ TEST_CASE(TEST_GROUP) {
     sink.terminate();
     CHECK(sink.get_messages().size() == 1);
     auto read_ids = loader.get_processed_read_ids();
-    CHECK(read_ids.find("002bd127-db82-436f-b828-28567c3d505d") != read_ids.end());
+    auto read_id = dorado::utils::parse_read_id("002bd127-db82-436f-b828-28567c3d505d");
+    REQUIRE(read_id);
+    CHECK(read_ids.find(*read_id) != read_ids.end());
 }
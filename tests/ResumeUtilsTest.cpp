@@ -0,0 +1,168 @@
+#include "TestUtils.h"
+#include "utils/resume_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[ResumeUtils]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A progress file path in a directory which is removed again at the end of the test.
+struct TempProgressFile {
+    TempDir dir;
+    fs::path path = dir.m_path / "reads.progress";
+};
+
+const std::string kReadId1 = "002bd127-db82-436f-b828-28567c3d505d";
+const std::string kReadId2 = "0007f755-bc82-432c-82be-76220b107ec5";
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": parse_read_id", CUT_TAG) {
+    auto read_id = dorado::utils::parse_read_id(kReadId1);
+    REQUIRE(read_id);
+    CHECK((*read_id)[0] == 0x00);
+    CHECK((*read_id)[1] == 0x2b);
+    CHECK((*read_id)[15] == 0x5d);
+    CHECK(dorado::utils::parse_read_id("002BD127-DB82-436F-B828-28567C3D505D") == read_id);
+
+    CHECK_FALSE(dorado::utils::parse_read_id(""));
+    CHECK_FALSE(dorado::utils::parse_read_id("read_1"));
+    CHECK_FALSE(dorado::utils::parse_read_id("002bd127-db82-436f-b828-28567c3d505d;duplex"));
+    CHECK_FALSE(dorado::utils::parse_read_id("002bd127xdb82-436f-b828-28567c3d505d"));
+    CHECK_FALSE(dorado::utils::parse_read_id("g02bd127-db82-436f-b828-28567c3d505d"));
+}
+
+TEST_CASE(CUT_TAG ": Progress file round trip", CUT_TAG) {
+    TempProgressFile file;
+    CHECK(dorado::utils::load_progress_file(file.path, "model").empty());
+    REQUIRE(fs::exists(file.path));
+
+    const auto read_id1 = *dorado::utils::parse_read_id(kReadId1);
+    const auto read_id2 = *dorado::utils::parse_read_id(kReadId2);
+    {
+        dorado::utils::ProgressFileWriter writer(file.path);
+        writer.append({read_id1});
+    }
+    {
+        // Later runs append to the IDs already there.
+        dorado::utils::ProgressFileWriter writer(file.path);
+        writer.append({read_id2, read_id1});
+    }
+
+    auto read_ids = dorado::utils::load_progress_file(file.path, "model");
+    CHECK(read_ids.size() == 2);
+    CHECK(read_ids.count(read_id1) == 1);
+    CHECK(read_ids.count(read_id2) == 1);
+}
+
+TEST_CASE(CUT_TAG ": Partial IDs are removed from progress files", CUT_TAG) {
+    TempProgressFile file;
+    dorado::utils::load_progress_file(file.path, "model");
+    const auto read_id1 = *dorado::utils::parse_read_id(kReadId1);
+    const auto read_id2 = *dorado::utils::parse_read_id(kReadId2);
+    dorado::utils::ProgressFileWriter(file.path).append({read_id1});
+    {
+        // As if a run was interrupted while writing an ID.
+        std::ofstream stream(file.path, std::ios::binary | std::ios::app);
+        stream.write(reinterpret_cast<const char*>(read_id2.data()), 5);
+    }
+
+    auto read_ids = dorado::utils::load_progress_file(file.path, "model");
+    CHECK(read_ids.size() == 1);
+    CHECK(read_ids.count(read_id1) == 1);
+
+    // IDs appended afterwards are read back whole.
+    dorado::utils::ProgressFileWriter(file.path).append({read_id2});
+    read_ids = dorado::utils::load_progress_file(file.path, "model");
+    CHECK(read_ids.size() == 2);
+    CHECK(read_ids.count(read_id2) == 1);
+}
+
+TEST_CASE(CUT_TAG ": Progress files are tied to their model", CUT_TAG) {
+    TempProgressFile file;
+    dorado::utils::load_progress_file(file.path, "model_a");
+    CHECK_THROWS_AS(dorado::utils::load_progress_file(file.path, "model_b"), std::runtime_error);
+
+    std::ofstream(file.path) << "not a progress file\n";
+    CHECK_THROWS_AS(dorado::utils::load_progress_file(file.path, "model_a"), std::runtime_error);
+}
+
+TEST_CASE(CUT_TAG ": Batches are journalled once their reads are written", CUT_TAG) {
+    TempProgressFile file;
+    {
+        dorado::utils::ProgressJournal journal(file.path, "model");
+        CHECK(journal.num_complete() == 0);
+        CHECK_FALSE(journal.previous_output_size());
+        journal.add_batch("a.pod5", 0, 11);
+        journal.add_batch("a.pod5", 1, 21);
+        // A batch with no reads ends where the one before it did.
+        journal.add_batch("b.pod5", 0, 21);
+        journal.add_batch("b.pod5", 1, 31);
+        // Reads 1 to 20 are written, so the first three batches are complete.
+        journal.checkpoint(21, 1234);
+    }
+
+    {
+        dorado::utils::ProgressJournal journal(file.path, "model");
+        CHECK(journal.num_complete() == 3);
+        CHECK(journal.is_complete("a.pod5", 0));
+        CHECK(journal.is_complete("a.pod5", 1));
+        CHECK(journal.is_complete("b.pod5", 0));
+        CHECK_FALSE(journal.is_complete("b.pod5", 1));
+        CHECK(journal.previous_output_size() == 1234);
+
+        journal.add_batch("b.pod5", 1, 5);
+        journal.checkpoint(5, std::nullopt);
+    }
+
+    dorado::utils::ProgressJournal journal(file.path, "model");
+    CHECK(journal.is_complete("b.pod5", 1));
+    // The size is of the latest run's output, which wasn't known.
+    CHECK_FALSE(journal.previous_output_size());
+}
+
+TEST_CASE(CUT_TAG ": Partial entries are removed from progress journals", CUT_TAG) {
+    TempProgressFile file;
+    {
+        dorado::utils::ProgressJournal journal(file.path, "model");
+        journal.add_batch("a.pod5", 0, 2);
+        journal.checkpoint(2, 100);
+    }
+    {
+        // As if a run was interrupted while writing an entry.
+        std::ofstream stream(file.path, std::ios::binary | std::ios::app);
+        stream << "run\nbatch\t1\ta.po";
+    }
+
+    {
+        dorado::utils::ProgressJournal journal(file.path, "model");
+        CHECK(journal.num_complete() == 1);
+        // The interrupted run got no further than starting, so has no output to keep.
+        CHECK_FALSE(journal.previous_output_size());
+        journal.add_batch("a.pod5", 1, 3);
+        journal.checkpoint(3, 200);
+    }
+
+    dorado::utils::ProgressJournal journal(file.path, "model");
+    CHECK(journal.is_complete("a.pod5", 1));
+    CHECK(journal.previous_output_size() == 200);
+}
+
+TEST_CASE(CUT_TAG ": Progress journals are tied to their model", CUT_TAG) {
+    TempProgressFile file;
+    dorado::utils::ProgressJournal(file.path, "model_a");
+    CHECK_THROWS_AS(dorado::utils::ProgressJournal(file.path, "model_b"), std::runtime_error);
+
+    std::ofstream(file.path) << "not a progress journal\n";
+    CHECK_THROWS_AS(dorado::utils::ProgressJournal(file.path, "model_a"), std::runtime_error);
+}
@@ -0,0 +1,27 @@
+#include "nn/Runners.h"
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+#define CUT_TAG "[Runners]"
+
+TEST_CASE(CUT_TAG ": split_cpu_spill_device splits off CPU runners", CUT_TAG) {
+    using dorado::split_cpu_spill_device;
+
+    CHECK(split_cpu_spill_device("cuda:all") == std::make_pair(std::string("cuda:all"), size_t(0)));
+    CHECK(split_cpu_spill_device("cpu") == std::make_pair(std::string("cpu"), size_t(0)));
+    CHECK(split_cpu_spill_device("cuda:all,cpu:16") ==
+          std::make_pair(std::string("cuda:all"), size_t(16)));
+    CHECK(split_cpu_spill_device("cuda:0,1,cpu:2") ==
+          std::make_pair(std::string("cuda:0,1"), size_t(2)));
+
+    const auto [device, num_cpu_runners] = split_cpu_spill_device("cuda:0,cpu");
+    CHECK(device == "cuda:0");
+    CHECK(num_cpu_runners == std::max(1u, std::thread::hardware_concurrency()));
+
+    CHECK_THROWS(split_cpu_spill_device("cuda:all,cpu:0"));
+    CHECK_THROWS(split_cpu_spill_device("cuda:all,cpu:x"));
+    CHECK_THROWS(split_cpu_spill_device("cuda:all,cpu:4x"));
+    CHECK_THROWS(split_cpu_spill_device("cuda:all,cpus"));
+}
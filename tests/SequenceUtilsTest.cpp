@@ -2,6 +2,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 
 #define TEST_GROUP "[utils]"
@@ -47,6 +49,19 @@ TEST_CASE(TEST_GROUP "reverse_complement") {
     }
 }
 
+TEST_CASE(TEST_GROUP "convert_nt16_to_str") {
+    // ACGTN packed as in a BAM record, with a padding nibble after the odd last base.
+    uint8_t packed[] = {0x12, 0x48, 0xf0};
+    CHECK(dorado::utils::convert_nt16_to_str(packed, 5) == "ACGTN");
+    CHECK(dorado::utils::convert_nt16_to_str(packed, 4) == "ACGT");
+    CHECK(dorado::utils::convert_nt16_to_str(packed, 0) == "");
+
+    // The output buffer is reused, and shrunk to fit.
+    std::string seq("TTTTTTTT");
+    dorado::utils::convert_nt16_to_str(packed, 3, seq);
+    CHECK(seq == "ACG");
+}
+
 TEST_CASE(TEST_GROUP "mean_q_score") {
     CHECK(dorado::utils::mean_qscore_from_qstring("") == 0.0f);
 
@@ -71,3 +86,74 @@ TEST_CASE(TEST_GROUP "mean_q_score") {
         CHECK(dorado::utils::mean_qscore_from_qstring(str) == Approx(score));
     }
 }
+
+TEST_CASE(TEST_GROUP "mean_q_score matches a reference for every length") {
+    // Covers the vectorised blocks and the remainders after them.
+    std::srand(7);
+    for (size_t len = 1; len <= 100; ++len) {
+        std::string q_string(len, ' ');
+        double total_error = 0.0;
+        for (auto& qchar : q_string) {
+            const int q = std::rand() % 45;
+            qchar = static_cast<char>('!' + q);
+            total_error += std::pow(10.0, -q / 10.0);
+        }
+        const double mean_qscore = -10.0 * std::log10(total_error / len);
+        CAPTURE(q_string);
+        CHECK(dorado::utils::mean_qscore_from_qstring(q_string) ==
+              Approx(std::clamp(mean_qscore, 1.0, 50.0)).epsilon(1e-4));
+    }
+}
+
+TEST_CASE(TEST_GROUP "minimizers") {
+    CHECK(dorado::utils::minimizers("", 5, 3).empty());
+    CHECK(dorado::utils::minimizers("ACGTACG", 5, 4).empty());
+    // One window of 3 5-mers, whose minimizer is reported once.
+    CHECK(dorado::utils::minimizers("ACGTACG", 5, 3).size() == 1);
+    // K-mers spanning other characters are skipped.
+    CHECK(dorado::utils::minimizers("ACGTNACGTA", 5, 1).size() == 1);
+
+    std::srand(42);
+    const std::string bases("ACGT");
+    std::string seq(5000, ' ');
+    for (auto& base : seq) {
+        base = bases.at(std::rand() % 4);
+    }
+    const auto seq_minimizers = dorado::utils::minimizers(seq, 15, 10);
+    // Minimizers are expected once every (w + 1) / 2 bases.
+    CHECK(seq_minimizers.size() > 800);
+    CHECK(seq_minimizers.size() < 1200);
+    // Every window is represented, so a suffix shares the minimizers after its first window.
+    const auto suffix_minimizers = dorado::utils::minimizers(seq.substr(2500), 15, 10);
+    CHECK(std::equal(suffix_minimizers.rbegin(), suffix_minimizers.rend() - 1,
+                     seq_minimizers.rbegin()));
+}
+
+TEST_CASE(TEST_GROUP "shared_minimizer_fraction") {
+    std::srand(42);
+    const std::string bases("ACGT");
+    std::string seq1(5000, ' ');
+    std::string seq2(5000, ' ');
+    for (size_t i = 0; i < seq1.size(); ++i) {
+        seq1[i] = bases.at(std::rand() % 4);
+        seq2[i] = bases.at(std::rand() % 4);
+    }
+
+    CHECK(dorado::utils::shared_minimizer_fraction("", seq1, 15, 10) == 0.f);
+    CHECK(dorado::utils::shared_minimizer_fraction(seq1, seq1, 15, 10) == 1.f);
+    // Fractions are of the sequence with fewer minimizers.
+    CHECK(dorado::utils::shared_minimizer_fraction(seq1, seq1.substr(1000, 2000), 15, 10) == 1.f);
+    CHECK(dorado::utils::shared_minimizer_fraction(seq1, seq2, 15, 10) < 0.01f);
+    // Minimizers aren't canonical, so reverse complements don't match.
+    CHECK(dorado::utils::shared_minimizer_fraction(
+                  seq1, dorado::utils::reverse_complement(seq1), 15, 10) < 0.01f);
+
+    // A 5% substitution rate still leaves plenty of minimizers in common.
+    std::string mutated = seq1;
+    for (auto& base : mutated) {
+        if (std::rand() % 20 == 0) {
+            base = bases.at((bases.find(base) + 1 + std::rand() % 3) % 4);
+        }
+    }
+    CHECK(dorado::utils::shared_minimizer_fraction(seq1, mutated, 15, 10) > 0.2f);
+}
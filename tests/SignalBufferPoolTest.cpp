@@ -0,0 +1,54 @@
+#include "utils/SignalBufferPool.h"
+
+#include <catch2/catch.hpp>
+
+#define CUT_TAG "[SignalBufferPool]"
+
+using dorado::utils::SignalBufferPool;
+
+TEST_CASE(CUT_TAG ": sizes are rounded up to classes a quarter power of two apart", CUT_TAG) {
+    CHECK(SignalBufferPool::class_bytes(1) == 4096);
+    CHECK(SignalBufferPool::class_bytes(4096) == 4096);
+    CHECK(SignalBufferPool::class_bytes(4097) == 5120);
+    CHECK(SignalBufferPool::class_bytes(8192) == 8192);
+    CHECK(SignalBufferPool::class_bytes(8193) == 10240);
+    CHECK(SignalBufferPool::class_bytes(1000000) == 1048576);
+}
+
+TEST_CASE(CUT_TAG ": a freed buffer is reused for a signal of its class", CUT_TAG) {
+    SignalBufferPool pool(1 << 20);
+    auto samples = pool.allocate(3000, torch::kInt16);
+    CHECK(samples.numel() == 3000);
+    CHECK(samples.dtype() == torch::kInt16);
+    const void* const data = samples.data_ptr();
+
+    // A view keeps the buffer out of the pool.
+    auto trimmed = samples.slice(0, 100);
+    samples = torch::Tensor();
+    CHECK(pool.cached_bytes() == 0);
+    trimmed = torch::Tensor();
+    CHECK(pool.cached_bytes() == 6144);
+
+    auto scaled = pool.allocate(2900, torch::kFloat16);
+    CHECK(scaled.data_ptr() == data);
+    CHECK(pool.cached_bytes() == 0);
+}
+
+TEST_CASE(CUT_TAG ": free buffers beyond the cap are released", CUT_TAG) {
+    SignalBufferPool pool(10000);
+    auto first = pool.allocate(4096, torch::kInt16);
+    auto second = pool.allocate(4096, torch::kInt16);
+    first = torch::Tensor();
+    second = torch::Tensor();
+    CHECK(pool.cached_bytes() == 8192);
+}
+
+TEST_CASE(CUT_TAG ": tensors outlive their pool", CUT_TAG) {
+    torch::Tensor samples;
+    {
+        SignalBufferPool pool(1 << 20);
+        samples = pool.allocate(10, torch::kInt16);
+    }
+    samples.fill_(7);
+    CHECK(samples.sum().item<int64_t>() == 70);
+}
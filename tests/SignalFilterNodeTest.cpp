@@ -0,0 +1,59 @@
+#include "read_pipeline/SignalFilterNode.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "[read_pipeline][SignalFilterNode]"
+
+namespace {
+
+std::shared_ptr<dorado::Read> make_read(std::string read_id, torch::Tensor raw_data) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = std::move(read_id);
+    read->raw_data = std::move(raw_data);
+    read->sample_rate = 5000;
+    read->scaling = 0.2f;
+    read->offset = 10.f;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("SignalFilterNode: Filter read too short for the minimum read length", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        // 100 bases at 500 bases/s need at least 1000 samples at 5kHz.
+        dorado::SignalFilterNode filter(sink, 100, 500.f, 0.f, 2);
+        filter.push_message(make_read("short", torch::randint(-500, 500, {999}, torch::kI16)));
+        filter.push_message(make_read("long", torch::randint(-500, 500, {1000}, torch::kI16)));
+    }
+
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 1);
+    CHECK(messages[0]->read_id == "long");
+}
+
+TEST_CASE("SignalFilterNode: Filter read with a flat signal", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SignalFilterNode filter(sink, 0, 500.f, 5.f, 2);
+        // A standard deviation of a few raw units is under 1pA at this scaling.
+        filter.push_message(make_read("flat", torch::randint(400, 410, {4000}, torch::kI16)));
+        filter.push_message(make_read("strand", torch::randint(0, 500, {4000}, torch::kI16)));
+    }
+
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 1);
+    CHECK(messages[0]->read_id == "strand");
+}
+
+TEST_CASE("SignalFilterNode: Flat signal filter is disabled by a zero threshold", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SignalFilterNode filter(sink, 0, 500.f, 0.f, 2);
+        filter.push_message(make_read("flat", torch::full({4000}, 400, torch::kI16)));
+    }
+
+    CHECK(sink.get_messages().size() == 1);
+}
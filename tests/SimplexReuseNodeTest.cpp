@@ -0,0 +1,86 @@
+#include "read_pipeline/SimplexReuseNode.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+
+#define TEST_GROUP "[read_pipeline][SimplexReuseNode]"
+
+namespace {
+
+std::shared_ptr<dorado::Read> make_read(std::string read_id, int64_t num_samples) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = std::move(read_id);
+    read->raw_data = torch::zeros({num_samples}, torch::kFloat16);
+    read->num_trimmed_samples = 10;
+    return read;
+}
+
+std::shared_ptr<dorado::Read> make_simplex(std::string read_id,
+                                           uint64_t num_trimmed_samples,
+                                           size_t num_moves) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = std::move(read_id);
+    read->seq = "ACGT";
+    read->qstring = "!!!!";
+    read->model_stride = 5;
+    read->num_trimmed_samples = num_trimmed_samples;
+    read->moves.assign(num_moves, 0);
+    read->moves.front() = 1;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("SimplexReuseNode: Reads take the earlier basecall", TEST_GROUP) {
+    dorado::read_map simplex_reads;
+    simplex_reads["same_trim"] = make_simplex("same_trim", 10, 20);
+    // 95 samples are left after the extra trimming, enough for 19 whole strides and a partial.
+    simplex_reads["extra_trim"] = make_simplex("extra_trim", 15, 20);
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SimplexReuseNode reuse(sink, std::move(simplex_reads), 5, "model", 2);
+        reuse.push_message(make_read("same_trim", 100));
+        reuse.push_message(make_read("extra_trim", 100));
+    }
+
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 2);
+    std::sort(messages.begin(), messages.end(),
+              [](const auto& a, const auto& b) { return a->read_id > b->read_id; });
+    CHECK(messages[0]->read_id == "same_trim");
+    CHECK(messages[0]->raw_data.size(0) == 100);
+    CHECK(messages[1]->raw_data.size(0) == 95);
+    CHECK(messages[1]->num_trimmed_samples == 15);
+    for (const auto& read : messages) {
+        CHECK(read->seq == "ACGT");
+        CHECK(read->moves.size() == 20);
+        CHECK(read->model_stride == 5);
+        CHECK(read->model_name == "model");
+    }
+}
+
+TEST_CASE("SimplexReuseNode: Reads without a matching basecall are dropped", TEST_GROUP) {
+    dorado::read_map simplex_reads;
+    simplex_reads["less_trim"] = make_simplex("less_trim", 5, 20);
+    simplex_reads["too_many_moves"] = make_simplex("too_many_moves", 10, 21);
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SimplexReuseNode reuse(sink, std::move(simplex_reads), 5, "model", 2);
+        reuse.push_message(make_read("missing", 100));
+        reuse.push_message(make_read("less_trim", 100));
+        reuse.push_message(make_read("too_many_moves", 100));
+        reuse.terminate();
+        reuse.join();
+
+        const auto stats = reuse.sample_stats();
+        CHECK(stats.at("reads_missing") == 1.);
+        CHECK(stats.at("reads_mismatched") == 2.);
+    }
+
+    CHECK(sink.get_messages().empty());
+}
@@ -0,0 +1,91 @@
+#include "utils/stats.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[Stats]"
+
+using namespace std::chrono_literals;
+
+TEST_CASE(CUT_TAG ": LatencyHistogram empty", CUT_TAG) {
+    dorado::stats::LatencyHistogram histogram;
+    CHECK(histogram.count() == 0);
+    CHECK(histogram.quantile_us(0.5) == 0);
+
+    dorado::stats::NamedStats stats;
+    histogram.add_stats(stats, "wait");
+    CHECK(stats.empty());
+}
+
+TEST_CASE(CUT_TAG ": LatencyHistogram quantiles", CUT_TAG) {
+    dorado::stats::LatencyHistogram histogram;
+    // 1us to 100us in 1us steps, then a single 10ms outlier.
+    for (int i = 1; i <= 100; ++i) {
+        histogram.record(std::chrono::microseconds(i));
+    }
+    histogram.record(10ms);
+    CHECK(histogram.count() == 101);
+
+    // Buckets are within ~6% of the recorded values.
+    CHECK(histogram.quantile_us(0.5) == Approx(51).epsilon(0.07));
+    CHECK(histogram.quantile_us(0.9) == Approx(91).epsilon(0.07));
+    CHECK(histogram.quantile_us(1.0) == Approx(10000).epsilon(0.07));
+    CHECK(histogram.quantile_us(0.0) == Approx(1).epsilon(0.07));
+
+    dorado::stats::NamedStats stats;
+    histogram.add_stats(stats, "service");
+    CHECK(stats.size() == 3);
+    CHECK(stats.at("service_p99_us") == Approx(100).epsilon(0.07));
+}
+
+TEST_CASE(CUT_TAG ": LatencyHistogram concurrent recording", CUT_TAG) {
+    dorado::stats::LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram] {
+            for (int i = 0; i < 1000; ++i) {
+                histogram.record(std::chrono::nanoseconds(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(histogram.count() == 4000);
+}
+
+TEST_CASE(CUT_TAG ": CounterRegistry reads counters through handles", CUT_TAG) {
+    std::atomic<int64_t> reads{0};
+    std::atomic<size_t> bytes{0};
+    dorado::stats::CounterRegistry registry;
+    const auto reads_handle = registry.add("Node.reads", reads);
+    const auto bytes_handle = registry.add("Node.bytes", bytes);
+    CHECK(registry.size() == 2);
+    CHECK(registry.find("Node.bytes") == bytes_handle);
+    CHECK_FALSE(registry.find("Node.missing").has_value());
+    CHECK(registry.name(reads_handle) == "Node.reads");
+
+    // Values are read when asked for, not when registered.
+    reads += 3;
+    bytes = 1024;
+    CHECK(registry.value(reads_handle) == 3);
+    std::vector<double> values;
+    registry.sample(values);
+    CHECK(values == std::vector<double>{3, 1024});
+}
+
+TEST_CASE(CUT_TAG ": PeakTracker keeps the highest value of each matching stat", CUT_TAG) {
+    dorado::stats::PeakTracker peaks;
+    auto callable = peaks.get_callable();
+    callable({{"Node.cached_reads_bytes", 100}, {"Node.cached_reads", 2}});
+    callable({{"Node.cached_reads_bytes", 300}, {"Other.working_reads_bytes", 50}});
+    callable({{"Node.cached_reads_bytes", 200}});
+
+    const auto result = peaks.peaks();
+    CHECK(result.size() == 2);
+    CHECK(result.at("Node.cached_reads_bytes") == 300);
+    CHECK(result.at("Other.working_reads_bytes") == 50);
+}
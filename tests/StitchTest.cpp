@@ -48,7 +48,8 @@ TEST_CASE("Test stitch_chunks", TEST_GROUP) {
     size_t offset = 0;
     size_t chunk_in_read_idx = 0;
     size_t signal_chunk_step = CHUNK_SIZE - OVERLAP;
-    auto chunk = std::make_shared<dorado::Chunk>(read, offset, chunk_in_read_idx++, CHUNK_SIZE);
+    auto chunk =
+            std::make_shared<dorado::Chunk>(read.get(), offset, chunk_in_read_idx++, CHUNK_SIZE);
     chunk->qstring = QSTR[read->num_chunks];
     chunk->seq = SEQS[read->num_chunks];
     chunk->moves = MOVES[read->num_chunks];
@@ -56,7 +57,8 @@ TEST_CASE("Test stitch_chunks", TEST_GROUP) {
     read->num_chunks++;
     while (offset + CHUNK_SIZE < RAW_SIGNAL_SIZE) {
         offset = std::min(offset + signal_chunk_step, RAW_SIGNAL_SIZE - CHUNK_SIZE);
-        chunk = std::make_shared<dorado::Chunk>(read, offset, chunk_in_read_idx++, CHUNK_SIZE);
+        chunk = std::make_shared<dorado::Chunk>(read.get(), offset, chunk_in_read_idx++,
+                                                CHUNK_SIZE);
         chunk->qstring = QSTR[read->num_chunks];
         chunk->seq = SEQS[read->num_chunks];
         chunk->moves = MOVES[read->num_chunks];
@@ -76,3 +78,32 @@ TEST_CASE("Test stitch_chunks", TEST_GROUP) {
     REQUIRE(read->qstring == expected_qstring);
     REQUIRE(read->moves == expected_moves);
 }
+
+TEST_CASE("Test unpack_chunk", TEST_GROUP) {
+    constexpr int MODEL_STRIDE = 2;
+    auto packed = std::make_shared<dorado::Chunk>(nullptr, 0, 0, 24);
+    // Reads of 3, 2 and 3 steps, with gaps of 2 and 1 steps between them, and 1 step after.
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    for (const auto [offset, size] : {std::pair<size_t, size_t>{0, 6}, {10, 4}, {16, 6}}) {
+        const auto &read = reads.emplace_back(std::make_shared<dorado::Read>());
+        packed->packed_chunks.push_back(std::make_shared<dorado::Chunk>(read.get(), 0, 0, size));
+        packed->packed_offsets.push_back(offset);
+    }
+    packed->moves = {1, 0, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1};
+    packed->seq = "ACGTACGT";
+    packed->qstring = "12345678";
+
+    dorado::utils::unpack_chunk(*packed, MODEL_STRIDE);
+
+    // The bases called in the gaps are dropped.
+    const auto &chunks = packed->packed_chunks;
+    CHECK(chunks[0]->seq == "AC");
+    CHECK(chunks[0]->qstring == "12");
+    CHECK(chunks[0]->moves == std::vector<uint8_t>{1, 0, 1});
+    CHECK(chunks[1]->seq == "T");
+    CHECK(chunks[1]->qstring == "4");
+    CHECK(chunks[1]->moves == std::vector<uint8_t>{0, 1});
+    CHECK(chunks[2]->seq == "CG");
+    CHECK(chunks[2]->qstring == "67");
+    CHECK(chunks[2]->moves == std::vector<uint8_t>{1, 1, 0});
+}
@@ -0,0 +1,53 @@
+#include "read_pipeline/SummaryWriterNode.h"
+
+#include "MessageSinkUtils.h"
+#include "utils/summary_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#define TEST_GROUP "[read_pipeline][SummaryWriterNode]"
+
+namespace fs = std::filesystem;
+
+TEST_CASE("SummaryWriterNode: Writes a row for each read and passes it on", TEST_GROUP) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = "read_1";
+    read->run_id = "run";
+    read->raw_data = torch::zeros({4500}, torch::kI16);
+    read->num_trimmed_samples = 500;
+    read->sample_rate = 5000;
+    read->run_acquisition_start_time_ms = 1000000;
+    read->start_time_ms = 1002500;
+    read->seq = "ACGT";
+    read->qstring = "++++";
+    read->attributes.fast5_filename = "reads.pod5";
+    read->attributes.channel_number = 12;
+    read->attributes.mux = 3;
+
+    const auto summary_file = fs::temp_directory_path() / "summary_writer_node_test.tsv";
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    {
+        dorado::SummaryWriterNode summary_writer(sink, summary_file.string());
+        summary_writer.push_message(read);
+    }
+
+    auto messages = sink.get_messages();
+    REQUIRE(messages.size() == 1);
+    CHECK(messages[0]->read_id == "read_1");
+
+    std::ifstream file(summary_file);
+    std::string header, row, end;
+    std::getline(file, header);
+    std::getline(file, row);
+    CHECK(header + '\n' == dorado::utils::summary_header(false, "\t"));
+    // The start time is relative to the start of the run, and the template starts after the
+    // trimmed samples.
+    CHECK(row == "reads.pod5\tread_1\trun\t12\t3\t2.5\t1\t2.6\t0.9\t4\t10");
+    CHECK_FALSE(std::getline(file, end));
+    file.close();
+    fs::remove(summary_file);
+}
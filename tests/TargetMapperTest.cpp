@@ -0,0 +1,65 @@
+#include "TestUtils.h"
+#include "read_pipeline/TargetMapper.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#define CUT_TAG "[TargetMapper]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// The sequence of the one read in the aligner tests' target.
+std::string target_sequence(const fs::path& target) {
+    std::ifstream file(target);
+    std::string name, seq;
+    std::getline(file, name);
+    std::getline(file, seq);
+    return seq;
+}
+
+struct TempBed {
+    explicit TempBed(const std::string& contents) { std::ofstream(path) << contents; }
+    TempDir dir;
+    fs::path path = dir.m_path / "targets.bed";
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": reads mapping to the reference are on target", CUT_TAG) {
+    const auto ref = fs::path(get_aligner_data_dir()) / "target.fq";
+    const auto seq = target_sequence(ref);
+    REQUIRE(seq.size() > 1000);
+
+    dorado::TargetMapper mapper(ref.string(), "", 15, 10, 1e9, 5, 1);
+    CHECK(mapper.is_on_target(seq.substr(0, 600)));
+
+    std::string unrelated;
+    for (size_t i = 0; i < 600; ++i) {
+        unrelated += "ACGT"[(i * 7 + i / 3) % 4];
+    }
+    CHECK_FALSE(mapper.is_on_target(unrelated));
+}
+
+TEST_CASE(CUT_TAG ": with a BED file only mappings overlapping its regions are on target",
+          CUT_TAG) {
+    const auto ref = fs::path(get_aligner_data_dir()) / "target.fq";
+    const auto seq = target_sequence(ref);
+
+    TempBed near_start("# targets\nread_0\t100\t200\n");
+    dorado::TargetMapper near_start_mapper(ref.string(), near_start.path.string(), 15, 10, 1e9,
+                                           5, 1);
+    CHECK(near_start_mapper.is_on_target(seq.substr(0, 600)));
+
+    TempBed near_end("read_0\t1500\t1800\tfar\nother\t0\t1000\n");
+    dorado::TargetMapper near_end_mapper(ref.string(), near_end.path.string(), 15, 10, 1e9, 5,
+                                         1);
+    CHECK_FALSE(near_end_mapper.is_on_target(seq.substr(0, 600)));
+
+    TempBed invalid("read_0\t200\t100\n");
+    CHECK_THROWS(dorado::TargetMapper(ref.string(), invalid.path.string(), 15, 10, 1e9, 5, 1));
+}
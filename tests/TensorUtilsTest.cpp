@@ -4,6 +4,7 @@
 #include <torch/torch.h>
 
 #include <cstdlib>
+#include <limits>
 #include <random>
 
 #define CUT_TAG "[TensorUtils]"
@@ -58,6 +59,41 @@ TEST_CASE(CUT_TAG ": test quantiles_counting", CUT_TAG) {
     REQUIRE(torch::equal(computed, expected));
 }
 
+TEST_CASE(CUT_TAG ": quantile_counting on raw samples", CUT_TAG) {
+    auto in = torch::randint(-1000, 1000, 5000).to(torch::kI16);
+    auto q = torch::tensor({0.2, 0.9}, {torch::kFloat});
+
+    auto expected = dorado::utils::quantile_counting(in, q);
+    // Called twice to check that the reused histogram is cleared between calls.
+    for (int i = 0; i < 2; ++i) {
+        auto computed = dorado::utils::quantile_counting(in.data_ptr<int16_t>(), in.size(0),
+                                                         {0.2f, 0.9f});
+        REQUIRE(computed.size() == 2);
+        CHECK(computed[0] == expected[0].item<float>());
+        CHECK(computed[1] == expected[1].item<float>());
+    }
+}
+
+TEST_CASE(CUT_TAG ": quantile_counting into an array", CUT_TAG) {
+    // Long enough for the vectorised min/max, with a short tail, and a constant signal.
+    auto in = torch::randint(-3000, 3000, 1037).to(torch::kI16);
+    auto q = torch::tensor({0.f, 0.2f, 0.9f, 1.f}, {torch::kFloat});
+    auto expected = torch::quantile(in.to(torch::kFloat), q, 0, false, c10::string_view("lower"));
+    const float q_values[4] = {0.f, 0.2f, 0.9f, 1.f};
+    float computed[4];
+    dorado::utils::quantile_counting(in.data_ptr<int16_t>(), in.size(0), q_values, 4, computed);
+    for (int i = 0; i < 4; ++i) {
+        CHECK(computed[i] == expected[i].item<float>());
+    }
+
+    auto flat = torch::full({100}, 42, torch::kI16);
+    dorado::utils::quantile_counting(flat.data_ptr<int16_t>(), flat.size(0), q_values, 4,
+                                     computed);
+    for (int i = 0; i < 4; ++i) {
+        CHECK(computed[i] == 42.f);
+    }
+}
+
 TEST_CASE(CUT_TAG ": quantile_counting guppy comparison", CUT_TAG) {
     // Generate some (fixed) random inputs
     // These should match the equivalent test in guppy
@@ -86,6 +122,31 @@ TEST_CASE(CUT_TAG ": quantile_counting guppy comparison", CUT_TAG) {
     }
 }
 
+TEST_CASE(CUT_TAG ": segment_quantiles", CUT_TAG) {
+    torch::manual_seed(42);
+    const std::vector<std::int64_t> lengths{1, 5000, 37, 1200};
+    const std::vector<float> q{0.f, 0.2f, 0.9f, 1.f};
+    std::vector<torch::Tensor> signals;
+    for (const auto length : lengths) {
+        signals.push_back(torch::randint(-3000, 3000, length).to(torch::kI16));
+    }
+    // Values at the ends of the int16 range mustn't spill into the neighbouring segments.
+    signals[2][0] = std::numeric_limits<std::int16_t>::min();
+    signals[2][1] = std::numeric_limits<std::int16_t>::max();
+
+    const auto computed =
+            dorado::utils::segment_quantiles(torch::cat(signals), lengths, q).contiguous();
+    REQUIRE(computed.size(0) == int64_t(lengths.size()));
+    REQUIRE(computed.size(1) == int64_t(q.size()));
+    for (size_t i = 0; i < signals.size(); ++i) {
+        const auto expected = dorado::utils::quantile_counting(signals[i].data_ptr<int16_t>(),
+                                                               signals[i].size(0), q);
+        for (size_t j = 0; j < q.size(); ++j) {
+            CHECK(computed[i][j].item<float>() == expected[j]);
+        }
+    }
+}
+
 TEST_CASE(CUT_TAG ": convert_f32_to_f16", CUT_TAG) {
     torch::manual_seed(42);
     srand(42);
@@ -103,6 +164,24 @@ TEST_CASE(CUT_TAG ": convert_f32_to_f16", CUT_TAG) {
     }
 }
 
+TEST_CASE(CUT_TAG ": scale_i16_to_f16", CUT_TAG) {
+    torch::manual_seed(42);
+    srand(42);
+
+    for (int i = 0; i < 10; ++i) {
+        const int num_elems = rand() % 100;
+        const auto samples = torch::randint(-2000, 2000, {num_elems}, torch::kInt16);
+        const float shift = 80.5f;
+        const float scale = 12.25f;
+        const auto expected = ((samples.to(torch::kFloat) - shift) / scale).to(torch::kHalf);
+        const auto scaled = dorado::utils::scale_i16_to_f16(samples, shift, scale);
+        CHECK(scaled.dtype() == torch::kHalf);
+        const float kRelTolerance = 0.0f;
+        const float kAbsTolerance = 0.0f;
+        CHECK(torch::allclose(expected, scaled, kRelTolerance, kAbsTolerance));
+    }
+}
+
 TEST_CASE(CUT_TAG ": copy_tensor_elems", CUT_TAG) {
     torch::manual_seed(42);
     srand(42);
@@ -136,3 +215,82 @@ TEST_CASE(CUT_TAG ": copy_tensor_elems", CUT_TAG) {
         }
     }
 }
+
+TEST_CASE(CUT_TAG ": copy_tensor_elems with several ranges", CUT_TAG) {
+    torch::manual_seed(42);
+    using torch::indexing::Slice;
+
+    for (auto src_dtype : {torch::kFloat16, torch::kFloat32}) {
+        for (auto dest_dtype : {torch::kFloat16, torch::kFloat32}) {
+            // Lengths either side of every vector width, and an empty range.
+            const std::vector<dorado::utils::TensorCopyRange> ranges = {
+                    {0, 5, 17}, {20, 0, 33}, {60, 40, 0}, {60, 1, 8}, {70, 100, 31}};
+            const torch::Tensor src_tensor = torch::rand({131}, src_dtype);
+            const torch::Tensor orig_dest_tensor = torch::rand({101}, dest_dtype);
+
+            auto expected = orig_dest_tensor.clone();
+            for (const auto& range : ranges) {
+                const auto src_range = Slice(range.src_offset, range.src_offset + range.count);
+                expected.index_put_({Slice(range.dest_offset, range.dest_offset + range.count)},
+                                    src_tensor.index({src_range}));
+            }
+
+            auto result = orig_dest_tensor.clone();
+            dorado::utils::copy_tensor_elems(result, src_tensor, ranges);
+            CHECK(torch::equal(expected, result));
+        }
+    }
+}
+
+TEST_CASE(CUT_TAG ": gather_chunks", CUT_TAG) {
+    using torch::indexing::Slice;
+    const int kChunkSize = 10;
+
+    SECTION("Single channel signals, with repeat padding") {
+        const auto long_signal = torch::rand({25}, torch::kFloat16);
+        const auto short_signal = torch::rand({4}, torch::kFloat16);
+        for (auto batch_dtype : {torch::kFloat16, torch::kFloat32}) {
+            auto batch = torch::zeros({3, 1, kChunkSize}, batch_dtype);
+            dorado::utils::gather_chunks(batch, 1, {{&long_signal, 15}, {&short_signal, 0}});
+
+            CHECK(torch::equal(batch[0], torch::zeros({1, kChunkSize}, batch_dtype)));
+            CHECK(torch::equal(batch[1][0], long_signal.index({Slice(15, 25)}).to(batch_dtype)));
+            const auto padded = torch::concat(
+                    {short_signal, short_signal, short_signal.index({Slice(0, 2)})});
+            CHECK(torch::equal(batch[2][0], padded.to(batch_dtype)));
+        }
+    }
+
+    SECTION("Multi channel column slice") {
+        const auto wide_signal = torch::rand({3, 40}, torch::kFloat16);
+        const auto signal = wide_signal.index({Slice(), Slice(0, 16)});
+        auto batch = torch::zeros({1, 3, kChunkSize}, torch::kFloat16);
+        dorado::utils::gather_chunks(batch, 0, {{&signal, 8}});
+
+        const auto expected = torch::concat(
+                {signal.index({Slice(), Slice(8, 16)}), signal.index({Slice(), Slice(8, 10)})}, 1);
+        CHECK(torch::equal(batch[0], expected));
+    }
+}
+
+TEST_CASE(CUT_TAG ": gather_chunks_channels_last", CUT_TAG) {
+    using torch::indexing::Slice;
+    const int kChunkSize = 10;
+    // Chunks with channels innermost match those gathered with timesteps innermost, transposed.
+    const auto wide_signal = torch::rand({3, 40}, torch::kFloat32);
+    const auto signal = wide_signal.index({Slice(), Slice(0, 16)});
+    const auto mono_signal = torch::rand({25}, torch::kFloat16);
+    for (auto batch_dtype : {torch::kFloat16, torch::kFloat32}) {
+        auto expected = torch::zeros({3, 3, kChunkSize}, batch_dtype);
+        dorado::utils::gather_chunks(expected, 1, {{&signal, 0}, {&signal, 8}});
+        auto batch = torch::zeros({3, kChunkSize, 3}, batch_dtype);
+        dorado::utils::gather_chunks_channels_last(batch, 1, {{&signal, 0}, {&signal, 8}});
+        CHECK(torch::equal(batch, expected.transpose(1, 2)));
+
+        auto mono_batch = torch::zeros({2, kChunkSize, 1}, batch_dtype);
+        dorado::utils::gather_chunks_channels_last(mono_batch, 0, {{&mono_signal, 20}});
+        const auto padded = torch::concat({mono_signal.index({Slice(20, 25)}),
+                                           mono_signal.index({Slice(20, 25)})});
+        CHECK(torch::equal(mono_batch[0].squeeze(1), padded.to(batch_dtype)));
+    }
+}
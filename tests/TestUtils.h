@@ -2,9 +2,19 @@
 
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#endif
 
 static std::string get_data_dir(const std::string& sub_dir) {
     const std::filesystem::path data_path = std::filesystem::path("./tests/data/") / sub_dir;
@@ -38,6 +48,48 @@ static std::vector<uint8_t> ReadFileIntoVector(const std::filesystem::path& path
     return vec;
 }
 
+// Wrapper around a temporary directory since one doesn't exist in the standard.  Each one is
+// created empty with a name no other TempDir has, even in other test processes, and is removed
+// with everything in it when it goes out of scope.
+class TempDir {
+public:
+    TempDir() : m_path(create_unique()) {}
+    ~TempDir() {
+        if (!m_path.empty()) {
+            std::error_code ec;
+            std::filesystem::remove_all(m_path, ec);
+        }
+    }
+
+    TempDir(TempDir&& other) noexcept : m_path(std::move(other.m_path)) { other.m_path.clear(); }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::filesystem::path m_path;
+
+private:
+    static std::filesystem::path create_unique() {
+        const auto temp_dir = std::filesystem::temp_directory_path();
+#ifdef _WIN32
+        static std::atomic<int> counter{0};
+        while (true) {
+            const auto path = temp_dir / ("dorado_test_" + std::to_string(_getpid()) + "_" +
+                                          std::to_string(counter++));
+            if (std::filesystem::create_directory(path)) {
+                return std::filesystem::canonical(path);
+            }
+        }
+#else
+        std::string temp = (temp_dir / "dorado_test_XXXXXX").string();
+        if (!mkdtemp(temp.data())) {
+            throw std::runtime_error("Failed to create a temporary directory in " +
+                                     temp_dir.string());
+        }
+        return std::filesystem::canonical(temp);
+#endif
+    }
+};
+
 #define get_fast5_data_dir() get_data_dir("fast5")
 
 #define get_pod5_data_dir() get_data_dir("pod5")
@@ -0,0 +1,96 @@
+#include "utils/ThreadPool.h"
+
+#include "MessageSinkUtils.h"
+#include "read_pipeline/ReadPipeline.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define TEST_GROUP "[utils][ThreadPool]"
+
+using dorado::utils::ThreadPool;
+
+namespace {
+
+// Passes reads on from the shared pool, with a queue of a single message so that pushes to it
+// often find it full.
+class PoolForwardingNode : public dorado::MessageSink {
+public:
+    PoolForwardingNode(dorado::MessageSink& sink, int max_concurrency)
+            : MessageSink(1), m_sink(sink) {
+        start_pool_processing(
+                [this](dorado::Message&& message) {
+                    ++m_num_processed;
+                    m_sink.push_message(std::move(message));
+                },
+                max_concurrency, [this] { m_sink.terminate(); });
+    }
+    ~PoolForwardingNode() {
+        terminate();
+        join();
+    }
+    void join() override { join_pool_processing(); }
+
+    std::atomic<int> m_num_processed{0};
+
+private:
+    dorado::MessageSink& m_sink;
+};
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": Runs every task", TEST_GROUP) {
+    std::atomic<int> num_run{0};
+    {
+        ThreadPool pool(4);
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit([&num_run] { ++num_run; });
+        }
+        // Remaining tasks are run before the pool is destroyed.
+    }
+    CHECK(num_run == 1000);
+}
+
+TEST_CASE(TEST_GROUP ": Tasks submitted from tasks are run", TEST_GROUP) {
+    std::atomic<int> num_run{0};
+    std::atomic<bool> on_pool_thread{true};
+    {
+        ThreadPool pool(3);
+        for (int i = 0; i < 10; ++i) {
+            pool.submit([&] {
+                on_pool_thread = on_pool_thread && ThreadPool::current() == &pool;
+                for (int j = 0; j < 100; ++j) {
+                    pool.submit([&num_run] { ++num_run; });
+                }
+            });
+        }
+    }
+    CHECK(num_run == 1000);
+    CHECK(on_pool_thread);
+    CHECK(ThreadPool::current() == nullptr);
+}
+
+TEST_CASE(TEST_GROUP ": Chained pool nodes with full queues finish", TEST_GROUP) {
+    const int max_concurrency = GENERATE(1, 64);
+    const int num_reads = 2000;
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(num_reads);
+    {
+        // Every pool thread could be stuck pushing into a full queue, unless pushes make room.
+        PoolForwardingNode last(sink, max_concurrency);
+        PoolForwardingNode middle(last, max_concurrency);
+        PoolForwardingNode first(middle, max_concurrency);
+        for (int i = 0; i < num_reads; ++i) {
+            first.push_message(std::make_shared<dorado::Read>());
+        }
+        first.terminate();
+        first.join();
+        middle.join();
+        last.join();
+        CHECK(first.m_num_processed == num_reads);
+        CHECK(last.m_num_processed == num_reads);
+    }
+    CHECK(sink.get_messages().size() == num_reads);
+}
@@ -83,4 +83,33 @@ TEST_CASE(CUT_TAG ": adjust_time", CUT_TAG) {
     CAPTURE(timestamp);
     auto result_time_stamp = dorado::utils::adjust_time(timestamp, adjustment);
     CHECK(result_time_stamp == adjusted_timestamp);
-}
\ No newline at end of file
+}
+TEST_CASE(CUT_TAG ": parse_timestamp_us matches date::parse", CUT_TAG) {
+    auto timestamp = GENERATE(as<std::string>{}, "1970-01-01T00:00:00Z",
+                              "1975-01-02T00:00:00.456+00:00", "2017-09-12T09:50:12.456123+00:00",
+                              "2017-09-12T09:50:12.4+01:30", "2017-09-12T09:50:12-05:00",
+                              "2020-02-29T23:59:59.999999Z");
+    CAPTURE(timestamp);
+
+    std::istringstream ss(timestamp);
+    date::sys_time<std::chrono::microseconds> expected;
+    ss >> date::parse("%FT%T%Ez", expected);
+    if (ss.fail()) {
+        ss.clear();
+        ss.str(timestamp);
+        ss >> date::parse("%FT%TZ", expected);
+    }
+    REQUIRE(!ss.fail());
+
+    auto result_us = dorado::utils::parse_timestamp_us(timestamp);
+    REQUIRE(result_us.has_value());
+    CHECK(*result_us == expected.time_since_epoch().count());
+}
+
+TEST_CASE(CUT_TAG ": parse_timestamp_us rejects other forms", CUT_TAG) {
+    auto timestamp = GENERATE(as<std::string>{}, "", "2017-09-12", "2017-09-12T09:50:12",
+                              "2017-09-12 09:50:12Z", "2017-13-12T09:50:12Z",
+                              "2017-09-12T09:50:12.Z", "2017-09-12T09:50:12+01", "garbage");
+    CAPTURE(timestamp);
+    CHECK_FALSE(dorado::utils::parse_timestamp_us(timestamp).has_value());
+}
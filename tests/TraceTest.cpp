@@ -0,0 +1,70 @@
+#include "utils/trace.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#define CUT_TAG "[Trace]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string read_file(const fs::path& path) {
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+size_t count(const std::string& str, const std::string& substr) {
+    size_t num = 0;
+    for (auto pos = str.find(substr); pos != std::string::npos; pos = str.find(substr, pos + 1)) {
+        ++num;
+    }
+    return num;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": spans from every thread are written", CUT_TAG) {
+    const auto path = fs::temp_directory_path() / "dorado_trace_test.json";
+    fs::remove(path);
+
+    { DORADO_TRACE_SCOPE("before_start"); }
+    dorado::utils::trace::start(path);
+    CHECK(dorado::utils::trace::is_enabled());
+    {
+        DORADO_TRACE_SCOPE("outer");
+        DORADO_TRACE_SCOPE(dorado::utils::trace::intern("runtime \"name\""));
+    }
+    std::thread([] { DORADO_TRACE_SCOPE("other_thread"); }).join();
+    dorado::utils::trace::stop();
+    CHECK_FALSE(dorado::utils::trace::is_enabled());
+    { DORADO_TRACE_SCOPE("after_stop"); }
+
+    const auto trace = read_file(path);
+    CHECK(trace.find("\"traceEvents\"") != std::string::npos);
+    CHECK(count(trace, "\"ph\":\"X\"") == 3);
+    CHECK(count(trace, "\"name\":\"outer\"") == 1);
+    CHECK(count(trace, "\"name\":\"runtime \\\"name\\\"\"") == 1);
+    CHECK(count(trace, "\"name\":\"other_thread\"") == 1);
+    CHECK(trace.find("before_start") == std::string::npos);
+    CHECK(trace.find("after_stop") == std::string::npos);
+
+    // Stopping again doesn't overwrite the trace.
+    fs::remove(path);
+    dorado::utils::trace::stop();
+    CHECK_FALSE(fs::exists(path));
+}
+
+TEST_CASE(CUT_TAG ": interned names are shared", CUT_TAG) {
+    const std::string name = "node";
+    const char* interned = dorado::utils::trace::intern(name);
+    CHECK(interned == dorado::utils::trace::intern(std::string("node")));
+    CHECK(std::string(interned) == name);
+}
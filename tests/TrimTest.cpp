@@ -58,6 +58,13 @@ TEST_CASE("Test trim signal", TEST_GROUP) {
         CHECK(pos == expected_pos);
     }
 
+    SECTION("Half precision signal") {
+        int pos = dorado::utils::trim(signal_tensor.to(torch::kFloat16));
+
+        int expected_pos = 90;
+        CHECK(pos == expected_pos);
+    }
+
     SECTION("Peak beyond max samples") {
         for (int i = 500; i < 555; ++i) {
             signal[i] += 50;
@@ -69,3 +76,43 @@ TEST_CASE("Test trim signal", TEST_GROUP) {
         CHECK(pos == expected_pos);
     }
 }
+
+TEST_CASE("Test trim adapter tail", TEST_GROUP) {
+    constexpr int signal_len = 4000;
+
+    // Normalised signal with a new level every 10 samples, as for sequence.
+    std::mt19937 gen{42};
+    std::normal_distribution<float> noise{0, 0.1f};
+    std::uniform_real_distribution<float> level{-2, 2};
+    std::vector<float> signal(signal_len);
+    for (int i = 0; i < signal_len; i += 10) {
+        const float base_level = level(gen);
+        for (int j = i; j < i + 10; ++j) {
+            signal[j] = base_level + noise(gen);
+        }
+    }
+    auto signal_tensor = torch::from_blob(signal.data(), {signal_len});
+
+    SECTION("No tail") { CHECK(dorado::utils::trim_adapter_tail(signal_tensor, 90) == 90); }
+
+    SECTION("Tail after the adapter") {
+        for (int i = 300; i < 600; ++i) {
+            signal[i] = 0.5f + noise(gen) * 0.5f;
+        }
+        // The tail ends in the last whole window of 50 samples after the start.
+        CHECK(dorado::utils::trim_adapter_tail(signal_tensor, 90) == 590);
+        CHECK(dorado::utils::trim_adapter_tail(signal_tensor.to(torch::kFloat16), 90) == 590);
+    }
+
+    SECTION("Tail beyond the search") {
+        std::fill(signal.begin() + 3000, signal.begin() + 3400, 0.5f);
+        dorado::utils::TailTrimParams params;
+        params.max_search_samples = 1000;
+        CHECK(dorado::utils::trim_adapter_tail(signal_tensor, 90, params) == 90);
+    }
+
+    SECTION("All signal flat") {
+        std::fill(signal.begin(), signal.end(), 0.5f);
+        CHECK(dorado::utils::trim_adapter_tail(signal_tensor, 90) == 90);
+    }
+}
@@ -0,0 +1,105 @@
+#include "TestUtils.h"
+#include "utils/work_coordinator.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[WorkCoordinator]"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+using dorado::utils::WorkUnit;
+using dorado::utils::WorkUnitTracker;
+
+TEST_CASE(CUT_TAG ": plan_work_units splits each file into units", CUT_TAG) {
+    const auto units =
+            dorado::utils::plan_work_units({{"a.pod5", 5}, {"b.pod5", 0}, {"c.pod5", 2}}, 2);
+    REQUIRE(units.size() == 4);
+    CHECK(units[0].path == "a.pod5");
+    CHECK(units[0].first_batch == 0);
+    CHECK(units[0].end_batch == 2);
+    // The last unit of a file holds what is left over.
+    CHECK(units[2].first_batch == 4);
+    CHECK(units[2].end_batch == 5);
+    CHECK(units[3].path == "c.pod5");
+    CHECK(units[3].end_batch == 2);
+    for (size_t i = 0; i < units.size(); ++i) {
+        CHECK(units[i].id == i);
+    }
+}
+
+TEST_CASE(CUT_TAG ": a unit is leased to one worker until its lease expires", CUT_TAG) {
+    const auto start = WorkUnitTracker::Clock::time_point{} + 1h;
+    WorkUnitTracker tracker(dorado::utils::plan_work_units({{"a.pod5", 2}}, 1), 10s);
+
+    const auto first = tracker.lease("w1", start);
+    const auto second = tracker.lease("w2", start);
+    REQUIRE(first);
+    REQUIRE(second);
+    CHECK(first->id != second->id);
+    CHECK_FALSE(tracker.lease("w3", start + 5s));
+
+    // w1 dies, so its unit goes to w3 once the lease expires.
+    CHECK(tracker.complete(second->id, "w2", "w2.bam"));
+    const auto reassigned = tracker.lease("w3", start + 10s);
+    REQUIRE(reassigned);
+    CHECK(reassigned->id == first->id);
+    CHECK_FALSE(tracker.all_complete());
+
+    // The first completion wins, even from the worker whose lease expired.
+    CHECK(tracker.complete(first->id, "w1", "w1.bam"));
+    CHECK_FALSE(tracker.complete(first->id, "w3", "w3.bam"));
+    CHECK_FALSE(tracker.complete(99, "w3", "w3.bam"));
+    CHECK(tracker.all_complete());
+    CHECK_FALSE(tracker.lease("w3", start + 1h));
+
+    const auto completed = tracker.completed();
+    REQUIRE(completed.size() == 2);
+    CHECK(completed[0].worker == "w2");
+    CHECK(completed[1].worker == "w1");
+    CHECK(completed[1].output_path == "w1.bam");
+}
+
+TEST_CASE(CUT_TAG ": the manifest reads back what was written", CUT_TAG) {
+    TempDir dir;
+    const auto path = dir.m_path / "manifest.tsv";
+    CHECK(dorado::utils::read_work_manifest(path).empty());
+
+    const std::vector<dorado::utils::CompletedWorkUnit> completed = {
+            {WorkUnit{3, "/data/a b.pod5", 6, 8}, "host-1", "/out/host-1.unit3.bam"},
+            {WorkUnit{0, "/data/c.pod5", 0, 2}, "host-2", "/out/host-2.unit0.bam"},
+    };
+    dorado::utils::write_work_manifest(path, completed);
+    CHECK_FALSE(fs::exists(path.string() + ".tmp"));
+
+    const auto read = dorado::utils::read_work_manifest(path);
+    REQUIRE(read.size() == completed.size());
+    for (size_t i = 0; i < read.size(); ++i) {
+        CHECK(read[i].unit.id == completed[i].unit.id);
+        CHECK(read[i].unit.path == completed[i].unit.path);
+        CHECK(read[i].unit.first_batch == completed[i].unit.first_batch);
+        CHECK(read[i].unit.end_batch == completed[i].unit.end_batch);
+        CHECK(read[i].worker == completed[i].worker);
+        CHECK(read[i].output_path == completed[i].output_path);
+    }
+
+    std::ofstream(path) << "1\ta.pod5\t0\n";
+    CHECK_THROWS(dorado::utils::read_work_manifest(path));
+}
+
+TEST_CASE(CUT_TAG ": work units are parsed as they are formatted", CUT_TAG) {
+    const WorkUnit unit{7, "/data/run 1/x.pod5", 16, 24};
+    const auto parsed =
+            dorado::utils::details::parse_work_unit(dorado::utils::details::format_work_unit(unit));
+    CHECK(parsed.id == unit.id);
+    CHECK(parsed.path == unit.path);
+    CHECK(parsed.first_batch == unit.first_batch);
+    CHECK(parsed.end_batch == unit.end_batch);
+
+    CHECK_THROWS(dorado::utils::details::parse_work_unit("7\tx.pod5\t16"));
+    CHECK_THROWS(dorado::utils::details::parse_work_unit("seven\tx.pod5\t16\t24"));
+}
@@ -0,0 +1,30 @@
+#include "utils/AsyncQueue.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+
+#define TEST_GROUP "[benchmark][AsyncQueue]"
+
+TEMPLATE_TEST_CASE("AsyncQueue handoff", TEST_GROUP, LockingQueuePolicy, LockFreeQueuePolicy) {
+    const int kNumItems = 100000;
+    for (size_t capacity : {size_t(10), size_t(1000)}) {
+        BENCHMARK("push/pop between threads, capacity " + std::to_string(capacity)) {
+            AsyncQueue<int, TestType> queue(capacity);
+            std::thread producer([&queue] {
+                for (int i = 0; i < kNumItems; ++i) {
+                    queue.try_push(std::move(i));
+                }
+                queue.terminate();
+            });
+            int item = 0;
+            int num_popped = 0;
+            while (queue.try_pop(item)) {
+                ++num_popped;
+            }
+            producer.join();
+            return num_popped;
+        };
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "read_pipeline/ReadPipeline.h"
+
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dorado::benchmarks {
+
+// Read lengths, in samples, that each benchmark is run over.
+inline const std::vector<int> kReadLengths{4000, 40000, 400000};
+
+// Shape of the synthetic basecalls, roughly that of a 4kHz DNA model.
+constexpr int kModelStride = 5;
+constexpr int kChunkSize = 4000;
+constexpr int kChunkOverlap = 500;
+
+inline std::string random_sequence(size_t length, std::mt19937& rng) {
+    std::uniform_int_distribution<int> base(0, 3);
+    std::string seq(length, 'A');
+    std::generate(seq.begin(), seq.end(), [&] { return "ACGT"[base(rng)]; });
+    return seq;
+}
+
+inline std::vector<uint8_t> random_moves(size_t length, std::mt19937& rng) {
+    std::bernoulli_distribution move(0.4);
+    std::vector<uint8_t> moves(length);
+    std::generate(moves.begin(), moves.end(), [&] { return static_cast<uint8_t>(move(rng)); });
+    // The first block always emits a base.
+    moves[0] = 1;
+    return moves;
+}
+
+// A read of |read_length| float16 samples with the called chunks the basecaller would give it,
+// ready for stitching.
+inline std::shared_ptr<Read> make_chunked_read(int read_length, std::mt19937& rng) {
+    // Chunk offsets must be multiples of the stride for stitching.
+    read_length = std::max(kChunkSize, read_length / kModelStride * kModelStride);
+
+    auto read = std::make_shared<Read>();
+    read->raw_data = torch::randn({read_length}).to(torch::kFloat16);
+
+    std::vector<size_t> offsets{0};
+    const size_t last_offset = read_length - kChunkSize;
+    while (offsets.back() < last_offset) {
+        offsets.push_back(std::min(offsets.back() + kChunkSize - kChunkOverlap, last_offset));
+    }
+    for (size_t idx = 0; idx < offsets.size(); ++idx) {
+        auto chunk = std::make_shared<Chunk>(read.get(), offsets[idx], idx, kChunkSize);
+        chunk->moves = random_moves(kChunkSize / kModelStride, rng);
+        const auto num_bases = std::accumulate(chunk->moves.begin(), chunk->moves.end(), 0);
+        chunk->seq = random_sequence(num_bases, rng);
+        chunk->qstring.assign(num_bases, '5');
+        read->called_chunks.push_back(std::move(chunk));
+    }
+    read->num_chunks = read->called_chunks.size();
+    return read;
+}
+
+}  // namespace dorado::benchmarks
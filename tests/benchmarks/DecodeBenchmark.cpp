@@ -0,0 +1,28 @@
+#include "BenchmarkUtils.h"
+#include "decode/CPUDecoder.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <string>
+
+#define TEST_GROUP "[benchmark][decode]"
+
+using namespace dorado::benchmarks;
+
+TEST_CASE("CPU beam_search_decode", TEST_GROUP) {
+    // Scores for a model with a state length of 4, i.e. 4^5 transitions per block, for one
+    // chunk of each read length.
+    const int64_t kNumTransitions = 1024;
+    dorado::CPUDecoder decoder;
+    dorado::DecoderOptions options;
+
+    torch::manual_seed(42);
+    for (auto read_length : {kChunkSize, 2 * kChunkSize}) {
+        const int64_t num_blocks = read_length / kModelStride;
+        auto scores = torch::randn({num_blocks, 1, kNumTransitions});
+        BENCHMARK("beam_search_decode " + std::to_string(read_length)) {
+            return decoder.beam_search(scores, 1, options);
+        };
+    }
+}
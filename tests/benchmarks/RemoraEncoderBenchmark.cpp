@@ -0,0 +1,48 @@
+#include "BenchmarkUtils.h"
+#include "modbase/remora_encoder.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[benchmark][remora_encoder]"
+
+using namespace dorado::benchmarks;
+
+TEST_CASE("RemoraEncoder::get_context", TEST_GROUP) {
+    // Context of a typical CpG model.
+    const size_t kContextSamples = 200;
+    const int kBasesBefore = 2;
+    const int kBasesAfter = 2;
+
+    std::mt19937 rng(42);
+    for (auto read_length : kReadLengths) {
+        const auto moves = random_moves(read_length / kModelStride, rng);
+        const auto num_bases = std::accumulate(moves.begin(), moves.end(), size_t(0));
+        const auto seq = random_sequence(num_bases, rng);
+        const auto seq_to_sig_map =
+                dorado::utils::moves_to_map(moves, kModelStride, read_length, num_bases + 1);
+
+        dorado::RemoraEncoder encoder(kModelStride, kContextSamples, kBasesBefore, kBasesAfter);
+        encoder.init(dorado::utils::sequence_to_ints(seq), seq_to_sig_map);
+
+        std::vector<size_t> cpg_sites;
+        for (size_t pos = 0; pos + 1 < seq.size(); ++pos) {
+            if (seq[pos] == 'C' && seq[pos + 1] == 'G') {
+                cpg_sites.push_back(pos);
+            }
+        }
+
+        BENCHMARK("get_context " + std::to_string(read_length)) {
+            size_t num_samples = 0;
+            for (auto pos : cpg_sites) {
+                num_samples += encoder.get_context(pos).num_samples;
+            }
+            return num_samples;
+        };
+    }
+}
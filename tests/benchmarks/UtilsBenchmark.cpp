@@ -0,0 +1,69 @@
+#include "BenchmarkUtils.h"
+#include "utils/sequence_utils.h"
+#include "utils/stitch.h"
+#include "utils/tensor_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[benchmark][utils]"
+
+using namespace dorado::benchmarks;
+
+TEST_CASE("stitch_chunks", TEST_GROUP) {
+    std::mt19937 rng(42);
+    for (auto read_length : kReadLengths) {
+        auto read = make_chunked_read(read_length, rng);
+        BENCHMARK("stitch_chunks " + std::to_string(read_length)) {
+            dorado::utils::stitch_chunks(read);
+            return read->seq.size();
+        };
+    }
+}
+
+TEST_CASE("quantile_counting", TEST_GROUP) {
+    const std::vector<float> q{0.2f, 0.9f};
+    for (auto read_length : kReadLengths) {
+        auto signal = torch::randint(0, 2047, read_length).to(torch::kInt16);
+        BENCHMARK("quantile_counting " + std::to_string(read_length)) {
+            return dorado::utils::quantile_counting(signal.data_ptr<int16_t>(), read_length, q);
+        };
+    }
+}
+
+TEST_CASE("convert_f32_to_f16", TEST_GROUP) {
+    for (auto read_length : kReadLengths) {
+        auto src = torch::randn(read_length);
+        auto dest = torch::empty(read_length, torch::kFloat16);
+        BENCHMARK("convert_f32_to_f16 " + std::to_string(read_length)) {
+            dorado::utils::convert_f32_to_f16(dest.data_ptr<c10::Half>(), src.data_ptr<float>(),
+                                              read_length);
+        };
+    }
+}
+
+TEST_CASE("reverse_complement", TEST_GROUP) {
+    std::mt19937 rng(42);
+    for (auto read_length : kReadLengths) {
+        // Roughly one base per ten samples.
+        const auto seq = random_sequence(read_length / 10, rng);
+        BENCHMARK("reverse_complement " + std::to_string(read_length)) {
+            return dorado::utils::reverse_complement(seq);
+        };
+    }
+}
+
+TEST_CASE("moves_to_map", TEST_GROUP) {
+    std::mt19937 rng(42);
+    for (auto read_length : kReadLengths) {
+        const auto moves = random_moves(read_length / kModelStride, rng);
+        const auto num_bases = std::accumulate(moves.begin(), moves.end(), size_t(0));
+        BENCHMARK("moves_to_map " + std::to_string(read_length)) {
+            return dorado::utils::moves_to_map(moves, kModelStride, read_length, num_bases + 1);
+        };
+    }
+}
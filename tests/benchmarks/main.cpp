@@ -0,0 +1,9 @@
+#define CATCH_CONFIG_RUNNER
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+int main(int argc, char* argv[]) {
+    // Benchmark single threaded performance, as the tests do.
+    torch::set_num_threads(1);
+    return Catch::Session().run(argc, argv);
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Checks that pyarrow reads the Arrow IPC streams ArrowStreamWriter writes.
+
+Runs the hidden "Writes a stream for Arrow readers" test of dorado_tests to write a stream with
+every column type, reads it back with pyarrow, and compares its schema and values with those the
+test writes.  Exits with 77, which CTest treats as skipped, if pyarrow isn't installed.
+
+Usage: check_arrow_stream.py <dorado_tests binary>
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+SKIPPED = 77
+
+try:
+    import pyarrow as pa
+    import pyarrow.ipc
+except ImportError:
+    print("pyarrow is not installed, skipping")
+    sys.exit(SKIPPED)
+
+
+def expected_columns():
+    """The values written by the test, which has two batches of three rows."""
+    indices = range(6)
+    return {
+        "read_id": ["" if i == 5 else f"read_{i}" for i in indices],
+        "channel": [i - 2 for i in indices],
+        "mux": [i + 1 for i in indices],
+        "read_number": [4000000000 + i for i in indices],
+        "num_samples": [(1 << 40) + i for i in indices],
+        # Quarters are exact in float32, so compare equal once widened to Python floats.
+        "mean_qscore": [i + 0.25 for i in indices],
+        "moves": [[i % 2] * (i % 5) for i in indices],
+        "modbase_positions": [[i * 1000] * (i % 5) for i in indices],
+    }
+
+
+EXPECTED_TYPES = {
+    "read_id": pa.utf8(),
+    "channel": pa.int32(),
+    "mux": pa.uint8(),
+    "read_number": pa.uint32(),
+    "num_samples": pa.uint64(),
+    "mean_qscore": pa.float32(),
+    "moves": pa.list_(pa.uint8()),
+    "modbase_positions": pa.list_(pa.uint32()),
+}
+
+
+def main():
+    tests_binary = sys.argv[1]
+    with tempfile.TemporaryDirectory() as temp_dir:
+        stream_path = os.path.join(temp_dir, "all_types.arrow")
+        env = dict(os.environ, DORADO_ARROW_STREAM_OUTPUT=stream_path)
+        subprocess.run([tests_binary, "[arrow_readers]"], env=env, check=True)
+
+        with pa.OSFile(stream_path, "rb") as source:
+            reader = pa.ipc.open_stream(source)
+            batches = list(reader)
+
+    failures = []
+    if len(batches) != 2:
+        failures.append(f"expected 2 batches, read {len(batches)}")
+    table = pa.Table.from_batches(batches)
+
+    names = [field.name for field in table.schema]
+    if names != list(EXPECTED_TYPES):
+        failures.append(f"expected columns {list(EXPECTED_TYPES)}, read {names}")
+    for field in table.schema:
+        expected_type = EXPECTED_TYPES.get(field.name)
+        # List child field names aren't part of what's being checked.
+        if pa.types.is_list(field.type) and expected_type is not None:
+            matches = pa.types.is_list(expected_type) and (
+                field.type.value_type == expected_type.value_type)
+        else:
+            matches = field.type == expected_type
+        if not matches:
+            failures.append(f"column {field.name}: expected {expected_type}, read {field.type}")
+
+    columns = table.to_pydict()
+    for name, expected in expected_columns().items():
+        if columns.get(name) != expected:
+            failures.append(f"column {name}: expected {expected}, read {columns.get(name)}")
+
+    for failure in failures:
+        print(failure)
+    if failures:
+        sys.exit(1)
+    print(f"pyarrow {pa.__version__} read {table.num_rows} rows as written")
+
+
+if __name__ == "__main__":
+    main()
@@ -131,6 +131,52 @@ DEFINE_TEST("matmul_f16") {
     const double rtol = 1e-3;
     const double atol = 0;
     REQUIRE(torch::allclose(C1, C2, rtol, atol));
+
+#ifndef DORADO_TX2
+    // cuBLASLt, both when the shape is first seen and tuned, and once its algorithm is chosen.
+    for (int i = 0; i < 2; i++) {
+        auto C3 = torch::zeros({L, N}, options);
+        dorado::utils::details::matmul_f16_cublaslt(A, B, C3);
+        REQUIRE(torch::allclose(C3, C2, rtol, atol));
+    }
+#endif  // DORADO_TX2
+}
+
+DEFINE_TEST("parse_gpu_memory_limit parses byte counts with optional suffixes") {
+    using dorado::utils::details::parse_gpu_memory_limit;
+    CHECK(parse_gpu_memory_limit(nullptr) == 0);
+    CHECK(parse_gpu_memory_limit("") == 0);
+    CHECK(parse_gpu_memory_limit("123456") == 123456);
+    CHECK(parse_gpu_memory_limit("512M") == 512000000);
+    CHECK(parse_gpu_memory_limit("12G") == 12000000000);
+    CHECK_THROWS_AS(parse_gpu_memory_limit("12X"), std::runtime_error);
+    CHECK_THROWS_AS(parse_gpu_memory_limit("lots"), std::runtime_error);
+}
+
+DEFINE_TEST("candidate_chunk_sizes are stride multiples at least twice the overlap") {
+    using dorado::utils::details::candidate_chunk_sizes;
+    const auto candidates = candidate_chunk_sizes(6, 2500);
+    REQUIRE_FALSE(candidates.empty());
+    for (const int chunk_size : candidates) {
+        CHECK(chunk_size % 6 == 0);
+        CHECK(chunk_size >= 5000);
+    }
+    // With an overlap too large for any of them, there is still one to use.
+    CHECK(candidate_chunk_sizes(5, 20000) == std::vector<int>{40000});
+}
+
+DEFINE_TEST("select_chunk_size picks the most samples beyond the overlap per ms") {
+    using dorado::utils::details::select_chunk_size;
+    // The smallest chunk is quicker per sample, but the middle one calls more new samples
+    // per ms once the overlap is discounted.
+    const std::vector<dorado::utils::details::ChunkSizeTiming> timings{
+            {4000, 1024, 0.72f},  // 4861 new samples per ms
+            {8000, 512, 1.5f},    // 5000 new samples per ms
+            {10000, 384, 2.5f},   // 3800 new samples per ms
+    };
+    const auto choice = select_chunk_size(timings, 500);
+    CHECK(choice.chunk_size == 8000);
+    CHECK(choice.batch_size == 512);
 }
 
 }  // namespace
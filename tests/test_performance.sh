@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Check the dorado binary's throughput and peak memory against a baseline recorded on the same
+# hardware.  The baseline is recorded, and the check passes, if the baseline file doesn't exist
+# yet.
+# Usage: test_performance.sh <dorado binary> [baseline file] [tolerance]
+
+set -ex
+set -o pipefail
+
+test_dir=$(dirname $0)
+dorado_bin=$(cd "$(dirname $1)"; pwd -P)/$(basename $1)
+baseline=${2:-$test_dir/test_output/performance_baseline.txt}
+tolerance=${3:-0.1}
+data_dir=$test_dir/data
+output_dir=${test_dir}/test_output
+mkdir -p $output_dir
+
+benchmark_args="--num-reads 200 --read-length 40000 --threads 4 --data $data_dir/pod5 --json $output_dir/performance.json"
+
+if [ -f "$baseline" ]; then
+    $dorado_bin benchmark $benchmark_args --baseline $baseline --tolerance $tolerance
+else
+    echo "No baseline at $baseline, recording one"
+    mkdir -p $(dirname $baseline)
+    $dorado_bin benchmark $benchmark_args --record-baseline $baseline
+fi
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Load the pipeline with synthetic reads for a while and check that neither the process's nor
+# any node's memory grows, nor the throughput falls, from the start of the run to its end.
+# Usage: test_soak.sh <dorado binary> [duration in seconds]
+
+set -ex
+set -o pipefail
+
+test_dir=$(dirname $0)
+dorado_bin=$(cd "$(dirname $1)"; pwd -P)/$(basename $1)
+duration=${2:-3600}
+output_dir=${test_dir}/test_output
+mkdir -p $output_dir
+
+$dorado_bin benchmark soak --duration $duration --warmup $((duration / 10)) \
+    --sample-interval $((duration / 100 > 1 ? duration / 100 : 1)) \
+    --dump-stats $output_dir/soak_stats.csv